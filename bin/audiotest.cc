@@ -1,5 +1,5 @@
 //help: AC97 audio smoke tests
-//help: Usage: audiotest <sine|opl|pan|sweep|all>
+//help: Usage: audiotest <sine|opl|oplcmp|oplcore|pan|sweep|mix|all>
 
 void main() {
     char *args;
@@ -8,7 +8,7 @@ void main() {
     args = (char*)get_args();
 
     if (strlen(args) == 0) {
-        serial_write_string("Usage: audiotest <sine|opl|pan|sweep|all>\n");
+        serial_write_string("Usage: audiotest <sine|opl|oplcmp|oplcore|pan|sweep|mix|all>\n");
         return;
     }
 
@@ -27,6 +27,28 @@ void main() {
         return;
     }
 
+    if (strcmp(args, "oplcmp") == 0) {
+        opl_compare();
+        return;
+    }
+
+    if (strncmp(args, "oplcore", 7) == 0) {
+        if (strcmp(args, "oplcore fast") == 0) {
+            midiopl_set_core(1);
+        } else if (strcmp(args, "oplcore nuked") == 0) {
+            midiopl_set_core(0);
+        } else if (strcmp(args, "oplcore") != 0) {
+            serial_write_string("Usage: audiotest oplcore <nuked|fast>\n");
+            return;
+        }
+        if (midiopl_get_core() == 1) {
+            serial_write_string("OPL core: fast\n");
+        } else {
+            serial_write_string("OPL core: nuked\n");
+        }
+        return;
+    }
+
     if (strcmp(args, "pan") == 0) {
         ac97_smoke_pan();
         return;
@@ -37,6 +59,11 @@ void main() {
         return;
     }
 
+    if (strcmp(args, "mix") == 0) {
+        mixer_bench();
+        return;
+    }
+
     if (strcmp(args, "all") == 0) {
         audiotest_all();
         return;
@@ -15,6 +15,7 @@
 #include "browser/js_dom.cc"
 #include "browser/js_interp.cc"
 #include "browser/js_parse.cc"
+#include "browser/js_compile.cc"
 #include "browser/parser.cc"
 #include "browser/css.cc"
 #include "browser/woff.cc"
@@ -812,7 +812,7 @@ int ff_format_score(char *text, int f_start, int f_len) {
  * 3 by score (ties broken by source order) become the slot's fallback
  * chain; the pump tries them in order until one decodes.
  *
- * WOFF1 is decompressed via woff.cc + kdeflate_raw. WOFF2 is currently
+ * WOFF1 is decompressed via woff.cc + kdeflate_zlib. WOFF2 is currently
  * stubbed (woff2.cc returns NULL); the pump falls through to the next
  * URL. local() tokens are silently skipped (no system-font lookup
  * surface).*/
@@ -1,20 +1,23 @@
 /* <img> fetch + decode pump.
  *
- * Mirrors font_face.cc's per-tick async pump. After first paint, walk
- * the DOM for T_IMG nodes whose `src` attr resolves to a fetchable URL,
- * queue them, and decode one per render tick. Branches on Content-Type
- * to feed PNG / JPEG into kernel/gfx/gfx2d_assets.gfx2d_image_load_mem,
- * which returns an opaque handle paint.cc draws via
- * gfx2d_image_draw_scaled.
+ * After first paint, walk the DOM for T_IMG nodes whose `src` attr
+ * resolves to a fetchable URL and queue them. Each render tick starts
+ * fetches through net_async_start (several on the wire at once, over
+ * pooled keep-alive connections), polls them, and decodes whichever
+ * bodies have landed, so images appear as they arrive. Branches on
+ * Content-Type to feed PNG / JPEG into kernel/gfx/gfx2d_assets.
+ * gfx2d_image_load_mem, which returns an opaque handle paint.cc draws
+ * via gfx2d_image_draw_scaled.
  *
  * Reference: blink/Source/core/loader/ImageLoader.cpp (deferred fetch +
  * once-loaded relayout); blink/Source/core/rendering/RenderImage.cpp
  * (intrinsic size from decoded data).*/
 
 enum {
-    IMG_S_PENDING = 0,
-    IMG_S_LOADED  = 1,
-    IMG_S_FAILED  = 2
+    IMG_S_PENDING  = 0,
+    IMG_S_LOADED   = 1,
+    IMG_S_FAILED   = 2,
+    IMG_S_FETCHING = 3      /* net_async transfer in img_xfer / bg_xfer */
 };
 
 int  img_count;
@@ -27,6 +30,7 @@ char img_url[32][1024];
 int  img_url_len[32];
 int  img_dom[32];          /* DOM node index of the <img> */
 int  img_state[32];
+int  img_xfer[32];
 
 /* Background-image pump. Parallel queue keyed by style index instead
  * of DOM node, since CSS bg images attach to (selector, declaration)
@@ -43,15 +47,22 @@ int  bg_url_w[16];
 int  bg_url_h[16];
 int  bg_cs[16];
 int  bg_state[16];
+int  bg_xfer[16];
 int  bg_count;
 
+/* Page-load report: logged once per navigation when the last queued
+ * image settles (see image_report_page_load).*/
+int  img_reported;
+
 void image_queue_init(void) {
     img_count = 0;
     img_state_dirty = 0;
+    img_reported = 0;
     for (int i = 0; i < 32; i = i + 1) {
         img_url_len[i] = 0;
         img_dom[i]     = -1;
         img_state[i]   = IMG_S_PENDING;
+        img_xfer[i]    = -1;
     }
     /* Per-DOM-node handle table: reset every slot, not just the ones
      * the previous page populated. Otherwise <img>s in the new document
@@ -71,6 +82,7 @@ void image_queue_init(void) {
         bg_url_h[i] = 0;
         bg_cs[i] = -1;
         bg_state[i] = IMG_S_PENDING;
+        bg_xfer[i] = -1;
     }
     for (int i = 0; i < 4096; i = i + 1) {
         cs_bg_handle[i] = -1;
@@ -79,6 +91,24 @@ void image_queue_init(void) {
     }
 }
 
+/* Drop in-flight fetches when navigating away. The slots are marked
+ * FAILED so nothing refetches them for a page that is going away (a
+ * failed navigation blanks the page too).*/
+void image_cancel_fetches(void) {
+    for (int i = 0; i < img_count; i = i + 1) {
+        if (img_state[i] != IMG_S_FETCHING) continue;
+        net_async_free(img_xfer[i]);
+        img_xfer[i] = -1;
+        img_state[i] = IMG_S_FAILED;
+    }
+    for (int i = 0; i < bg_count; i = i + 1) {
+        if (bg_state[i] != IMG_S_FETCHING) continue;
+        net_async_free(bg_xfer[i]);
+        bg_xfer[i] = -1;
+        bg_state[i] = IMG_S_FAILED;
+    }
+}
+
 /* Free all decoded images on per-page navigation. Each handle came from
  * gfx2d_image_load_mem, which kmalloc'd both the metadata and the
  * decoded RGBA pixel buffer; gfx2d_image_free reclaims both.*/
@@ -153,6 +183,7 @@ void image_queue_collect(void) {
         img_url_len[slot] = slen;
         img_dom[slot] = n;
         img_state[slot] = IMG_S_PENDING;
+        img_xfer[slot] = -1;
     }
 }
 
@@ -164,53 +195,8 @@ int image_decode_blob(char *buf, int len) {
     return gfx2d_image_load_mem(buf, len);
 }
 
-/* Drive ONE pending slot through fetch + decode per call. Returns 1 if
- * a slot was advanced, 0 if no PENDING slots. Saves / restores cur_*
- * + page_buf so the outer page state survives the synchronous fetch.*/
-int image_advance_one_pending(void) {
-    int slot = -1;
-    for (int i = 0; i < img_count; i = i + 1) {
-        if (img_state[i] == IMG_S_PENDING) { slot = i; break; }
-    }
-    if (slot < 0) return 0;
-
-    char saved_host[256];
-    char saved_path[1024];
-    char saved_url [1024];
-    char saved_status[256];
-    int  saved_port    = cur_port;
-    int  saved_https   = cur_is_https;
-    int  saved_page_len = page_len;
-    b_strcpy_n(saved_host, cur_host, 256);
-    b_strcpy_n(saved_path, cur_path, 1024);
-    b_strcpy_n(saved_url,  cur_url,  1024);
-    /* Preserve the page-level status message so a sub-resource fetch
-     * failure (a 404 image, a fake @font-face URL) doesn't replace
-     * the user-visible status with `HTTP error: 404`. fetch_url writes
-     * status_msg unconditionally on non-2xx - sub-resource fetches
-     * silently fail and the main page's status text stays intact.*/
-    b_strcpy_n(saved_status, status_msg, 256);
-
-    char ct[128]; ct[0] = 0;
-    char absu[1024];
-    compute_url_relative(img_url[slot], absu, 1024);
-    int rc = fetch_url(absu, ct);
-
-    int handle = -1;
-    if (rc == 0 && page_len > 0) {
-        handle = image_decode_blob(page_buf, page_len);
-    } else {
-        serial_printf("[browser] <img> fetch failed: %s\n", img_url[slot]);
-    }
-
-    b_strcpy_n(cur_host, saved_host, 256);
-    b_strcpy_n(cur_path, saved_path, 1024);
-    b_strcpy_n(cur_url,  saved_url,  1024);
-    b_strcpy_n(status_msg, saved_status, 256);
-    cur_port     = saved_port;
-    cur_is_https = saved_https;
-    page_len     = saved_page_len;
-
+/* A fetched <img> body decoded to `handle` (or failed, handle < 0). */
+void image_apply_loaded(int slot, int handle) {
     if (handle >= 0) {
         int dom = img_dom[slot];
         n_img_handle[dom]      = handle;
@@ -245,11 +231,6 @@ int image_advance_one_pending(void) {
     } else {
         img_state[slot] = IMG_S_FAILED;
     }
-    return 1;
-}
-
-void image_pump(void) {
-    image_advance_one_pending();
 }
 
 /* Walk styled cs slots and queue any bg-image URL we don't already have
@@ -286,9 +267,10 @@ void bg_image_queue_collect(void) {
                 /* No img_state_dirty: layout doesn't depend on bg-image
                  * dims, so the next render() picks up the handle without
                  * a reflow. Setting dirty here was the source of the
-                 * fetch loop.*/
+                 * fetch loop. It does need a repaint.*/
+                paint_invalidate_all();
             }
-            /* For PENDING/FAILED reuse slots we just wait - nothing to
+            /* For PENDING/FETCHING/FAILED reuse slots we just wait - nothing to
              * link yet, and we don't enqueue a duplicate slot.*/
             continue;
         }
@@ -302,50 +284,12 @@ void bg_image_queue_collect(void) {
         bg_url_h[slot] = 0;
         bg_cs[slot] = s;
         bg_state[slot] = IMG_S_PENDING;
+        bg_xfer[slot] = -1;
     }
 }
 
-/* Drive ONE pending bg-image slot through fetch + decode. Same save /
- * restore dance as image_advance_one_pending.*/
-int bg_image_advance_one_pending(void) {
-    int slot = -1;
-    for (int i = 0; i < bg_count; i = i + 1) {
-        if (bg_state[i] == IMG_S_PENDING) { slot = i; break; }
-    }
-    if (slot < 0) return 0;
-
-    char saved_host[256];
-    char saved_path[1024];
-    char saved_url [1024];
-    char saved_status[256];
-    int  saved_port    = cur_port;
-    int  saved_https   = cur_is_https;
-    int  saved_page_len = page_len;
-    b_strcpy_n(saved_host, cur_host, 256);
-    b_strcpy_n(saved_path, cur_path, 1024);
-    b_strcpy_n(saved_url,  cur_url,  1024);
-    b_strcpy_n(saved_status, status_msg, 256);
-
-    char ct[128]; ct[0] = 0;
-    char absu[1024];
-    compute_url_relative(bg_url[slot], absu, 1024);
-    int rc = fetch_url(absu, ct);
-
-    int handle = -1;
-    if (rc == 0 && page_len > 0) {
-        handle = image_decode_blob(page_buf, page_len);
-    } else {
-        serial_printf("[browser] bg-image fetch failed: %s\n", bg_url[slot]);
-    }
-
-    b_strcpy_n(cur_host, saved_host, 256);
-    b_strcpy_n(cur_path, saved_path, 1024);
-    b_strcpy_n(cur_url,  saved_url,  1024);
-    b_strcpy_n(status_msg, saved_status, 256);
-    cur_port     = saved_port;
-    cur_is_https = saved_https;
-    page_len     = saved_page_len;
-
+/* A fetched background-image body decoded to `handle` (or failed). */
+void bg_image_apply_loaded(int slot, int handle) {
     if (handle >= 0) {
         int s = bg_cs[slot];
         int decoded_w = gfx2d_image_width(handle);
@@ -379,10 +323,102 @@ int bg_image_advance_one_pending(void) {
          * frame so the next render() shows the image without a reflow.
          * Triggering reflow here would wipe cs_bg_handle in
          * init_style_for_cs and cause an infinite re-fetch loop.*/
+        paint_invalidate_all();
         serial_printf("[browser] bg-image load: %s -> handle %d (%dx%d)\n",
                       bg_url[slot], handle, decoded_w, decoded_h);
     } else {
         bg_state[slot] = IMG_S_FAILED;
     }
-    return 1;
+}
+
+/* Log how long the page took once nothing is queued or in flight. */
+void image_report_page_load(void) {
+    if (img_reported) return;
+    int loaded = 0;
+    int failed = 0;
+    for (int i = 0; i < img_count; i = i + 1) {
+        if (img_state[i] == IMG_S_PENDING || img_state[i] == IMG_S_FETCHING) return;
+        if (img_state[i] == IMG_S_LOADED) loaded = loaded + 1;
+        else failed = failed + 1;
+    }
+    for (int i = 0; i < bg_count; i = i + 1) {
+        if (bg_state[i] == IMG_S_PENDING || bg_state[i] == IMG_S_FETCHING) return;
+        if (bg_state[i] == IMG_S_LOADED) loaded = loaded + 1;
+        else failed = failed + 1;
+    }
+    img_reported = 1;
+    serial_printf("[browser] page load: %s: %d images (%d failed) in %d ms, %d connects, %d reused, %d from cache\n",
+                  cur_url, loaded, failed, uptime_ms() - nav_t0,
+                  net_stat_connects - nav_connects0, net_stat_reuses - nav_reuses0,
+                  net_cache_hits - nav_cache_hits0);
+    /* The page has settled: persist what it added to the cache. */
+    http_cache_sync();
+}
+
+/* Start fetches for queued slots while transfer slots and per-origin
+ * connections are free, service everything in flight, and decode each
+ * body that has landed. Busy (0) just leaves the slot for a later
+ * tick; a hard failure (-1) keeps the placeholder.*/
+void image_pump(void) {
+    char absu[1024];
+    for (int i = 0; i < img_count; i = i + 1) {
+        if (img_state[i] != IMG_S_PENDING) continue;
+        compute_url_relative(img_url[i], absu, 1024);
+        int x = net_async_start(absu);
+        if (x == 0) continue;
+        if (x < 0) {
+            serial_printf("[browser] <img> fetch failed: %s\n", img_url[i]);
+            img_state[i] = IMG_S_FAILED;
+            continue;
+        }
+        img_xfer[i] = x;
+        img_state[i] = IMG_S_FETCHING;
+    }
+    for (int i = 0; i < bg_count; i = i + 1) {
+        if (bg_state[i] != IMG_S_PENDING) continue;
+        compute_url_relative(bg_url[i], absu, 1024);
+        int x = net_async_start(absu);
+        if (x == 0) continue;
+        if (x < 0) {
+            serial_printf("[browser] bg-image fetch failed: %s\n", bg_url[i]);
+            bg_state[i] = IMG_S_FAILED;
+            continue;
+        }
+        bg_xfer[i] = x;
+        bg_state[i] = IMG_S_FETCHING;
+    }
+
+    net_async_poll();
+
+    for (int i = 0; i < img_count; i = i + 1) {
+        if (img_state[i] != IMG_S_FETCHING) continue;
+        int x = img_xfer[i];
+        int r = net_async_result(x);
+        if (r == 0) continue;
+        int handle = -1;
+        if (r > 0 && net_async_len(x) > 0) {
+            handle = image_decode_blob(net_async_body(x), net_async_len(x));
+        } else {
+            serial_printf("[browser] <img> fetch failed: %s\n", img_url[i]);
+        }
+        net_async_free(x);
+        img_xfer[i] = -1;
+        image_apply_loaded(i, handle);
+    }
+    for (int i = 0; i < bg_count; i = i + 1) {
+        if (bg_state[i] != IMG_S_FETCHING) continue;
+        int x = bg_xfer[i];
+        int r = net_async_result(x);
+        if (r == 0) continue;
+        int handle = -1;
+        if (r > 0 && net_async_len(x) > 0) {
+            handle = image_decode_blob(net_async_body(x), net_async_len(x));
+        } else {
+            serial_printf("[browser] bg-image fetch failed: %s\n", bg_url[i]);
+        }
+        net_async_free(x);
+        bg_xfer[i] = -1;
+        bg_image_apply_loaded(i, handle);
+    }
+    image_report_page_load();
 }
@@ -135,14 +135,17 @@ void handle_input_key(int sc, int ch) {
         return;
     }
     if (ch == 27) { focus_mode = FOCUS_PAGE; return; }
+    /* Typing changes neither style nor layout: repaint just the control. */
     if (ch == 8) {
         if (vl > 0) v[vl - 1] = 0;
-        return;
-    }
-    if (ch >= 32 && ch < 127 && vl < 126) {
+    } else if (ch >= 32 && ch < 127 && vl < 126) {
         v[vl] = (char)ch;
         v[vl + 1] = 0;
+    } else {
+        return;
     }
+    paint_key_t0 = uptime_ms();
+    paint_invalidate_rt(n_rt[input_node[ii]]);
 }
 
 void handle_page_key(int sc, int ch) {
@@ -273,7 +276,10 @@ void handle_left_click(int mx, int my) {
                             char *t2 = dom_attr_str(k, "type");
                             if (!t2 || !b_strieq(t2, "radio")) continue;
                             int kn = dom_attr_get(k, "name");
-                            if (kn == my_name) n_checkbox_state[k] = 0;
+                            if (kn == my_name && n_checkbox_state[k]) {
+                                n_checkbox_state[k] = 0;
+                                paint_invalidate_rt(n_rt[k]);
+                            }
                         }
                     }
                     n_checkbox_state[toggle_dom] = 1;
@@ -281,6 +287,7 @@ void handle_left_click(int mx, int my) {
                     n_checkbox_state[toggle_dom] =
                         n_checkbox_state[toggle_dom] ? 0 : 1;
                 }
+                paint_invalidate_rt(n_rt[toggle_dom]);
                 focus_mode = FOCUS_PAGE;
                 return;
             }
@@ -356,13 +363,24 @@ void handle_mouse() {
     if (left_click) handle_left_click(mx, my);
     handle_hover(mx, my);
 
-    /* If a rule actually references :hover/:focus, restyle and re-layout
-     * when the hovered DOM node changes. Skipped when no dynamic pseudo
-     * rule is active to avoid pointless work on every pixel of motion.*/
-    if (css_has_dynamic_pseudo && hover_dom_node != prev_hover_dom_node) {
-        prev_hover_dom_node = hover_dom_node;
-        style_resolve_all();
-        run_layout();
+    /* If a rule actually references :hover/:focus, restyle the elements
+     * whose match can have changed and re-layout only the boxes that
+     * moved. Skipped when no dynamic pseudo rule is active to avoid
+     * pointless work on every pixel of motion.*/
+    if (css_has_dynamic_pseudo) {
+        if (hover_dom_node != prev_hover_dom_node) {
+            style_mark_state_change(prev_hover_dom_node, hover_dom_node, 1);
+            prev_hover_dom_node = hover_dom_node;
+        }
+        int focus_dom = -1;
+        if (focused_input >= 0 && focused_input < inputs_count) {
+            focus_dom = input_node[focused_input];
+        }
+        if (focus_dom != prev_focus_dom_node) {
+            style_mark_state_change(prev_focus_dom_node, focus_dom, 0);
+            prev_focus_dom_node = focus_dom;
+        }
+        if (style_dirty_count > 0) run_dirty_update();
     }
 
     int dz = mouse_scroll();
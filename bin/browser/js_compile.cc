@@ -0,0 +1,601 @@
+/* §7 JavaScript bytecode compiler. Lowers the AST from js_parse.cc into
+ * the jbc_*[] arrays run by the stack VM in js_interp.cc. Names are
+ * resolved here, once: a function's params, vars and nested function
+ * declarations are hoisted into numbered local slots, variables of
+ * enclosing functions become (hops, slot) pairs, and script top-level
+ * names become global binding indices. Only names no script has
+ * declared yet are looked up at run time, through an inline cache.
+ *
+ * Per-op operands (a/b/c; jumps hold the target pc in a):
+ *   GETL/SETL/STL:   a = local slot         (ST* = store and pop)
+ *   INCL:            a = local slot, b = +1 / -1 (no result)
+ *   GETB/SETB/STB:   a = global binding index
+ *   INCB:            a = global binding index, b = +1 / -1
+ *   GETU/SETU/STU:   a = hops up the scope chain, b = slot
+ *   GETG/SETG:       a/b = name off/len (cache: jbc_ic_obj)
+ *   PUSH_NUM:        a = jk_num[] index
+ *   PUSH_STR:        a/b = js_str_pool off/len
+ *   PUSH_BOOL:       a = 0 or 1
+ *   JF / JFK / JTK:  jump if false (pop) / if false, else pop / if
+ *                    true, else pop (the last two implement && and ||)
+ *   JCMP:            pop two, jump to a unless `x b y` holds, b = the
+ *                    JS_TOK_LT/GT/LE/GE token
+ *   LOOP:            backward jump, counted against JS_LOOP_CAP
+ *   GETP/SETP/GETM/INITP: a/b = name off/len, c = JSD_P_* id
+ *   NEWARR:          a = element count
+ *   CALL/CALLM/LOG:  a = argc. CALL: callee, args. CALLM: receiver,
+ *                    method (from GETM), args.
+ *   CLOSURE:         a = jpr_* proto
+ *
+ * Mutually recursive js_cc_* calls resolve through CupidC's deferred
+ * cross-resolve pass, as in js_parse.cc.*/
+
+int js_cc_emit(int op, int a, int b) {
+    if (jbc_count >= MAX_JS_CODE) { js_set_err("js: bytecode pool full"); return -1; }
+    int pc = jbc_count;
+    jbc_op[pc] = op;
+    jbc_a [pc] = a;
+    jbc_b [pc] = b;
+    jbc_c [pc] = 0;
+    jbc_ic_obj [pc] = -1;
+    jbc_ic_prop[pc] = -1;
+    jbc_count = pc + 1;
+    return pc;
+}
+
+/* Point the jump at `pc` (and the chain linked through its a operand
+ * when it is a break/continue list) at the next instruction.*/
+void js_cc_patch(int pc) {
+    while (pc >= 0) {
+        int next = jbc_a[pc];
+        jbc_a[pc] = jbc_count;
+        pc = next;
+    }
+    jc_label_pc = jbc_count;
+}
+
+int js_cc_num_const(int v) {
+    for (int i = 0; i < jk_count; i++) if (jk_int[i] == v) return i;
+    if (jk_count >= MAX_JS_CONSTS) { js_set_err("js: constant pool full"); return 0; }
+    int k = jk_count;
+    jk_int[k] = v;
+    jk_num[k] = (double)v;
+    jk_count = k + 1;
+    return k;
+}
+
+/* Pop the value just computed. An assignment directly before it
+ * becomes its store-and-pop form unless a jump lands between them.*/
+void js_cc_pop() {
+    int last = jbc_count - 1;
+    if (last >= 0 && jc_label_pc != jbc_count) {
+        int op = jbc_op[last];
+        if (op == JS_OP_SETL) { jbc_op[last] = JS_OP_STL; return; }
+        if (op == JS_OP_SETB) { jbc_op[last] = JS_OP_STB; return; }
+        if (op == JS_OP_SETU) { jbc_op[last] = JS_OP_STU; return; }
+    }
+    js_cc_emit(JS_OP_POP, 0, 0);
+}
+
+/* Global names */
+
+int js_global_lookup(int off, int len) {
+    for (int i = 0; i < jsg_count; i++) {
+        int b = jsg_bind[i];
+        if (js_str_eq(jb_name_off[b], jb_name_len[b], off, len)) return b;
+    }
+    return -1;
+}
+
+/* Root scope frame; holds the globals and is the captured scope of
+ * top-level functions.*/
+void js_root_scope() {
+    if (jsc_top > 0) return;
+    jsc_parent[0] = -1;
+    jsc_first[0] = 0;
+    jsc_count[0] = 0;
+    jsc_top = 1;
+}
+
+int js_global_define(int off, int len) {
+    int b = js_global_lookup(off, len);
+    if (b >= 0) return b;
+    if (jsg_count >= MAX_JS_GLOBALS) { js_set_err("js: too many globals"); return -1; }
+    js_root_scope();
+    b = js_binding_alloc(0, off, len);
+    if (b < 0) return -1;
+    jsg_bind[jsg_count] = b;
+    jsg_count = jsg_count + 1;
+    js_env_pin();
+    return b;
+}
+
+/* Local names */
+
+int js_cc_local_in(int d, int off, int len) {
+    int first = jcx_local_first[d];
+    int last = jcl_count;
+    if (d < jcx_depth) last = jcx_local_first[d + 1];
+    for (int i = first; i < last; i++) {
+        if (js_str_eq(jcl_name_off[i], jcl_name_len[i], off, len)) return i - first;
+    }
+    return -1;
+}
+
+void js_cc_declare(int off, int len) {
+    if (off < 0) return;
+    if (jcx_depth == 0) { js_global_define(off, len); return; }
+    if (js_cc_local_in(jcx_depth, off, len) >= 0) return;
+    if (jcl_count >= MAX_JS_LOCALS) { js_set_err("js: too many locals"); return; }
+    jcl_name_off[jcl_count] = off;
+    jcl_name_len[jcl_count] = len;
+    jcl_count = jcl_count + 1;
+}
+
+/* Resolve a name for the current function. Returns the GET op for the
+ * kind of storage it lives in and fills *x / *y with its operands.*/
+int js_cc_resolve(int off, int len, int *x, int *y) {
+    int d = jcx_depth;
+    while (d > 0) {
+        int slot = js_cc_local_in(d, off, len);
+        if (slot >= 0) {
+            if (d == jcx_depth) { *x = slot; *y = 0; return JS_OP_GETL; }
+            *x = jcx_depth - d; *y = slot;
+            return JS_OP_GETU;
+        }
+        d = d - 1;
+    }
+    int b = js_global_lookup(off, len);
+    if (b >= 0) { *x = b; *y = 0; return JS_OP_GETB; }
+    *x = off; *y = len;
+    return JS_OP_GETG;
+}
+
+void js_cc_load(int off, int len) {
+    int x; int y;
+    int op = js_cc_resolve(off, len, &x, &y);
+    js_cc_emit(op, x, y);
+}
+
+void js_cc_store(int off, int len) {
+    int x; int y;
+    int op = js_cc_resolve(off, len, &x, &y);
+    if (op == JS_OP_GETL)      op = JS_OP_SETL;
+    else if (op == JS_OP_GETU) op = JS_OP_SETU;
+    else if (op == JS_OP_GETB) op = JS_OP_SETB;
+    else                       op = JS_OP_SETG;
+    js_cc_emit(op, x, y);
+}
+
+/* Hoisting: declare every var and function-declaration name of a body
+ * (not descending into nested functions), then create the declared
+ * functions before the first statement runs.*/
+void js_cc_hoist(int node) {
+    if (node < 0) return;
+    int k = jn_kind[node];
+    if (k == JS_NODE_BLOCK || k == JS_NODE_PROGRAM) {
+        int s = jn_a[node];
+        while (s >= 0) { js_cc_hoist(s); s = jn_next[s]; }
+        return;
+    }
+    if (k == JS_NODE_VAR_DECL) {
+        int d = jn_a[node];
+        while (d >= 0) { js_cc_declare(jn_a[d], jn_b[d]); d = jn_next[d]; }
+        return;
+    }
+    if (k == JS_NODE_FUNC_DECL) { js_cc_declare(jn_a[node], jn_b[node]); return; }
+    if (k == JS_NODE_IF)    { js_cc_hoist(jn_b[node]); js_cc_hoist(jn_c[node]); return; }
+    if (k == JS_NODE_WHILE) { js_cc_hoist(jn_b[node]); return; }
+    if (k == JS_NODE_FOR)   { js_cc_hoist(jn_a[node]); js_cc_hoist(jn_d[node]); return; }
+}
+
+void js_cc_hoist_funcs(int node) {
+    if (node < 0) return;
+    int k = jn_kind[node];
+    if (k == JS_NODE_BLOCK || k == JS_NODE_PROGRAM) {
+        int s = jn_a[node];
+        while (s >= 0) { js_cc_hoist_funcs(s); s = jn_next[s]; }
+        return;
+    }
+    if (k == JS_NODE_FUNC_DECL) {
+        if (jn_a[node] < 0 || jn_b[node] <= 0) return;
+        int p = js_cc_function(node);
+        if (p < 0) return;
+        js_cc_emit(JS_OP_CLOSURE, p, 0);
+        js_cc_store(jn_a[node], jn_b[node]);
+        js_cc_pop();
+        return;
+    }
+    if (k == JS_NODE_IF)    { js_cc_hoist_funcs(jn_b[node]); js_cc_hoist_funcs(jn_c[node]); return; }
+    if (k == JS_NODE_WHILE) { js_cc_hoist_funcs(jn_b[node]); return; }
+    if (k == JS_NODE_FOR)   { js_cc_hoist_funcs(jn_d[node]); return; }
+}
+
+/* Compile a FUNC_DECL / FUNC_EXPR body into a proto. The code sits
+ * inline behind a jump so the enclosing code can carry on around it.*/
+int js_cc_function(int node) {
+    if (jpr_count >= MAX_JS_PROTOS) { js_set_err("js: function pool full"); return -1; }
+    if (jcx_depth + 1 >= MAX_JS_NEST) { js_set_err("js: functions nested too deep"); return -1; }
+    int p = jpr_count;
+    jpr_count = p + 1;
+    int skip = js_cc_emit(JS_OP_JMP, -1, 0);
+    jpr_code[p] = jbc_count;
+
+    int d = jcx_depth + 1;
+    jcx_depth = d;
+    jcx_local_first[d] = jcl_count;
+    jcx_loop_base[d] = jcb_depth;
+    int np = 0;
+    int prm = jn_c[node];
+    while (prm >= 0) {
+        /* Params take the first slots in order, even if repeated. */
+        if (jcl_count >= MAX_JS_LOCALS) { js_set_err("js: too many locals"); break; }
+        jcl_name_off[jcl_count] = jn_a[prm];
+        jcl_name_len[jcl_count] = jn_b[prm];
+        jcl_count = jcl_count + 1;
+        np = np + 1;
+        prm = jn_next[prm];
+    }
+    jpr_nparams[p] = np;
+    js_cc_hoist(jn_d[node]);
+    jpr_nlocals[p] = jcl_count - jcx_local_first[d];
+    js_cc_hoist_funcs(jn_d[node]);
+    js_cc_stmt(jn_d[node]);
+    js_cc_emit(JS_OP_PUSH_UNDEF, 0, 0);
+    js_cc_emit(JS_OP_RET, 0, 0);
+
+    jcl_count = jcx_local_first[d];
+    jcb_depth = jcx_loop_base[d];
+    jcx_depth = d - 1;
+    js_cc_patch(skip);
+    return p;
+}
+
+int js_cc_binop(int tok) {
+    if (tok == JS_TOK_PLUS)    return JS_OP_ADD;
+    if (tok == JS_TOK_MINUS)   return JS_OP_SUB;
+    if (tok == JS_TOK_STAR)    return JS_OP_MUL;
+    if (tok == JS_TOK_SLASH)   return JS_OP_DIV;
+    if (tok == JS_TOK_PERCENT) return JS_OP_MOD;
+    if (tok == JS_TOK_LT)      return JS_OP_LT;
+    if (tok == JS_TOK_GT)      return JS_OP_GT;
+    if (tok == JS_TOK_LE)      return JS_OP_LE;
+    if (tok == JS_TOK_GE)      return JS_OP_GE;
+    if (tok == JS_TOK_EQ)      return JS_OP_EQ;
+    if (tok == JS_TOK_NEQ)     return JS_OP_NE;
+    if (tok == JS_TOK_EQ_EQ)   return JS_OP_SEQ;
+    if (tok == JS_TOK_NEQ_EQ)  return JS_OP_SNE;
+    if (tok == JS_TOK_PLUS_EQ)  return JS_OP_ADD;
+    if (tok == JS_TOK_MINUS_EQ) return JS_OP_SUB;
+    if (tok == JS_TOK_STAR_EQ)  return JS_OP_MUL;
+    if (tok == JS_TOK_SLASH_EQ) return JS_OP_DIV;
+    return -1;
+}
+
+void js_cc_prop_op(int op, int off, int len) {
+    int pc = js_cc_emit(op, off, len);
+    if (pc >= 0) jbc_c[pc] = jsd_prop_id(off, len);
+}
+
+int js_cc_is_console_log(int callee) {
+    if (callee < 0 || jn_kind[callee] != JS_NODE_MEMBER) return 0;
+    int obj = jn_a[callee];
+    if (obj < 0 || jn_kind[obj] != JS_NODE_IDENT) return 0;
+    if (jn_b[obj] != 7 || jn_c[callee] != 3) return 0;
+    return b_streq_n(js_str_pool + jn_a[obj], "console", 7) &&
+           b_streq_n(js_str_pool + jn_b[callee], "log", 3);
+}
+
+int js_cc_args(int arg) {
+    int argc = 0;
+    while (arg >= 0) {
+        js_cc_expr(arg);
+        arg = jn_next[arg];
+        argc = argc + 1;
+    }
+    return argc;
+}
+
+void js_cc_call(int node) {
+    int callee = jn_a[node];
+    /* console is not a runtime global; console.log is recognised here. */
+    if (js_cc_is_console_log(callee)) {
+        js_cc_emit(JS_OP_LOG, js_cc_args(jn_b[node]), 0);
+        return;
+    }
+    if (callee >= 0 && jn_kind[callee] == JS_NODE_MEMBER) {
+        js_cc_expr(jn_a[callee]);
+        js_cc_prop_op(JS_OP_GETM, jn_b[callee], jn_c[callee]);
+        js_cc_emit(JS_OP_CALLM, js_cc_args(jn_b[node]), 0);
+        return;
+    }
+    js_cc_expr(callee);
+    js_cc_emit(JS_OP_CALL, js_cc_args(jn_b[node]), 0);
+}
+
+void js_cc_assign(int node) {
+    int op = jn_a[node];
+    int lhs = jn_b[node];
+    int rhs = jn_c[node];
+    int arith = -1;
+    if (op != JS_TOK_ASSIGN) arith = js_cc_binop(op);
+    int kind = -1;
+    if (lhs >= 0) kind = jn_kind[lhs];
+    if (kind == JS_NODE_IDENT) {
+        if (arith >= 0) js_cc_load(jn_a[lhs], jn_b[lhs]);
+        js_cc_expr(rhs);
+        if (arith >= 0) js_cc_emit(arith, 0, 0);
+        js_cc_store(jn_a[lhs], jn_b[lhs]);
+        return;
+    }
+    if (kind == JS_NODE_MEMBER) {
+        js_cc_expr(jn_a[lhs]);
+        if (arith >= 0) {
+            js_cc_emit(JS_OP_DUP, 0, 0);
+            js_cc_prop_op(JS_OP_GETP, jn_b[lhs], jn_c[lhs]);
+        }
+        js_cc_expr(rhs);
+        if (arith >= 0) js_cc_emit(arith, 0, 0);
+        js_cc_prop_op(JS_OP_SETP, jn_b[lhs], jn_c[lhs]);
+        return;
+    }
+    if (kind == JS_NODE_INDEX) {
+        js_cc_expr(jn_a[lhs]);
+        js_cc_expr(jn_b[lhs]);
+        if (arith >= 0) {
+            js_cc_emit(JS_OP_DUP2, 0, 0);
+            js_cc_emit(JS_OP_GETI, 0, 0);
+        }
+        js_cc_expr(rhs);
+        if (arith >= 0) js_cc_emit(arith, 0, 0);
+        js_cc_emit(JS_OP_SETI, 0, 0);
+        return;
+    }
+    js_set_err("js: assignment target unsupported");
+}
+
+/* ++x / x++ / --x / x-- with a value. Statement-level forms on a local
+ * or declared global become a single INCL / INCB (js_cc_expr_discard).*/
+void js_cc_inc(int node, int post) {
+    int operand = jn_b[node];
+    if (operand < 0 || jn_kind[operand] != JS_NODE_IDENT) {
+        js_set_err("js: ++/-- target must be identifier");
+        return;
+    }
+    int step = JS_OP_ADD;
+    if (jn_a[node] == JS_TOK_MINUS_MINUS) step = JS_OP_SUB;
+    js_cc_load(jn_a[operand], jn_b[operand]);
+    js_cc_emit(JS_OP_TONUM, 0, 0);
+    if (post) js_cc_emit(JS_OP_DUP, 0, 0);
+    js_cc_emit(JS_OP_PUSH_NUM, js_cc_num_const(1), 0);
+    js_cc_emit(step, 0, 0);
+    js_cc_store(jn_a[operand], jn_b[operand]);
+    if (post) js_cc_pop();
+}
+
+void js_cc_expr(int node) {
+    if (node < 0) { js_cc_emit(JS_OP_PUSH_UNDEF, 0, 0); return; }
+    if (js_last_error[0] != 0) return;
+    int k = jn_kind[node];
+    if (k == JS_NODE_NUM)   { js_cc_emit(JS_OP_PUSH_NUM, js_cc_num_const(jn_a[node]), 0); return; }
+    if (k == JS_NODE_STR)   { js_cc_emit(JS_OP_PUSH_STR, jn_a[node], jn_b[node]); return; }
+    if (k == JS_NODE_BOOL)  { js_cc_emit(JS_OP_PUSH_BOOL, jn_a[node], 0); return; }
+    if (k == JS_NODE_NULL)  { js_cc_emit(JS_OP_PUSH_NULL, 0, 0); return; }
+    if (k == JS_NODE_UNDEF) { js_cc_emit(JS_OP_PUSH_UNDEF, 0, 0); return; }
+    if (k == JS_NODE_IDENT) { js_cc_load(jn_a[node], jn_b[node]); return; }
+    if (k == JS_NODE_BIN) {
+        int op = jn_a[node];
+        if (op == JS_TOK_AND_AND || op == JS_TOK_OR_OR) {
+            js_cc_expr(jn_b[node]);
+            int j = js_cc_emit(op == JS_TOK_AND_AND ? JS_OP_JFK : JS_OP_JTK, -1, 0);
+            js_cc_expr(jn_c[node]);
+            js_cc_patch(j);
+            return;
+        }
+        js_cc_expr(jn_b[node]);
+        js_cc_expr(jn_c[node]);
+        js_cc_emit(js_cc_binop(op), 0, 0);
+        return;
+    }
+    if (k == JS_NODE_UNARY) {
+        int op = jn_a[node];
+        js_cc_expr(jn_b[node]);
+        if (op == JS_TOK_NOT)           js_cc_emit(JS_OP_NOT, 0, 0);
+        else if (op == JS_TOK_MINUS)    js_cc_emit(JS_OP_NEG, 0, 0);
+        else if (op == JS_TOK_PLUS)     js_cc_emit(JS_OP_TONUM, 0, 0);
+        else if (op == JS_TOK_KW_TYPEOF) js_cc_emit(JS_OP_TYPEOF, 0, 0);
+        return;
+    }
+    if (k == JS_NODE_ASSIGN)   { js_cc_assign(node); return; }
+    if (k == JS_NODE_PRE_INC)  { js_cc_inc(node, 0); return; }
+    if (k == JS_NODE_POST_INC) { js_cc_inc(node, 1); return; }
+    if (k == JS_NODE_COND) {
+        int jf = js_cc_cond_jump(jn_a[node]);
+        js_cc_expr(jn_b[node]);
+        int jend = js_cc_emit(JS_OP_JMP, -1, 0);
+        js_cc_patch(jf);
+        js_cc_expr(jn_c[node]);
+        js_cc_patch(jend);
+        return;
+    }
+    if (k == JS_NODE_CALL) { js_cc_call(node); return; }
+    if (k == JS_NODE_FUNC_EXPR) {
+        int p = js_cc_function(node);
+        if (p >= 0) js_cc_emit(JS_OP_CLOSURE, p, 0);
+        return;
+    }
+    if (k == JS_NODE_ARR_LIT) {
+        int n = 0;
+        int e = jn_a[node];
+        while (e >= 0) { js_cc_expr(e); n = n + 1; e = jn_next[e]; }
+        js_cc_emit(JS_OP_NEWARR, n, 0);
+        return;
+    }
+    if (k == JS_NODE_OBJ_LIT) {
+        js_cc_emit(JS_OP_NEWOBJ, 0, 0);
+        int prop = jn_a[node];
+        while (prop >= 0) {
+            js_cc_expr(jn_c[prop]);
+            js_cc_prop_op(JS_OP_INITP, jn_a[prop], jn_b[prop]);
+            prop = jn_next[prop];
+        }
+        return;
+    }
+    if (k == JS_NODE_MEMBER) {
+        js_cc_expr(jn_a[node]);
+        js_cc_prop_op(JS_OP_GETP, jn_b[node], jn_c[node]);
+        return;
+    }
+    if (k == JS_NODE_INDEX) {
+        js_cc_expr(jn_a[node]);
+        js_cc_expr(jn_b[node]);
+        js_cc_emit(JS_OP_GETI, 0, 0);
+        return;
+    }
+    js_set_err("js: unsupported expression");
+}
+
+/* Evaluate an expression for its side effects only. */
+void js_cc_expr_discard(int node) {
+    if (node >= 0 && (jn_kind[node] == JS_NODE_PRE_INC || jn_kind[node] == JS_NODE_POST_INC)) {
+        int operand = jn_b[node];
+        if (operand >= 0 && jn_kind[operand] == JS_NODE_IDENT) {
+            int x; int y;
+            int op = js_cc_resolve(jn_a[operand], jn_b[operand], &x, &y);
+            int delta = 1;
+            if (jn_a[node] == JS_TOK_MINUS_MINUS) delta = -1;
+            if (op == JS_OP_GETL) { js_cc_emit(JS_OP_INCL, x, delta); return; }
+            if (op == JS_OP_GETB) { js_cc_emit(JS_OP_INCB, x, delta); return; }
+        }
+    }
+    js_cc_expr(node);
+    js_cc_pop();
+}
+
+/* Emit a test of `cond` that jumps when it is false; returns the jump
+ * to patch. A relational compare becomes one JCMP.*/
+int js_cc_cond_jump(int cond) {
+    if (cond >= 0 && jn_kind[cond] == JS_NODE_BIN) {
+        int op = jn_a[cond];
+        if (op == JS_TOK_LT || op == JS_TOK_GT || op == JS_TOK_LE || op == JS_TOK_GE) {
+            js_cc_expr(jn_b[cond]);
+            js_cc_expr(jn_c[cond]);
+            return js_cc_emit(JS_OP_JCMP, -1, op);
+        }
+    }
+    js_cc_expr(cond);
+    return js_cc_emit(JS_OP_JF, -1, 0);
+}
+
+void js_cc_loop_open() {
+    if (jcb_depth >= MAX_JS_NEST) { js_set_err("js: loops nested too deep"); return; }
+    jcb_break[jcb_depth] = -1;
+    jcb_cont[jcb_depth] = -1;
+    jcb_depth = jcb_depth + 1;
+}
+
+void js_cc_stmt(int node) {
+    if (node < 0) return;
+    if (js_last_error[0] != 0) return;
+    int k = jn_kind[node];
+    if (k == JS_NODE_BLOCK) {
+        int s = jn_a[node];
+        while (s >= 0 && js_last_error[0] == 0) { js_cc_stmt(s); s = jn_next[s]; }
+        return;
+    }
+    if (k == JS_NODE_EXPR_STMT) { js_cc_expr_discard(jn_a[node]); return; }
+    if (k == JS_NODE_VAR_DECL) {
+        int d = jn_a[node];
+        while (d >= 0) {
+            if (jn_c[d] >= 0) {
+                js_cc_expr(jn_c[d]);
+                js_cc_store(jn_a[d], jn_b[d]);
+                js_cc_pop();
+            }
+            d = jn_next[d];
+        }
+        return;
+    }
+    if (k == JS_NODE_IF) {
+        int jf = js_cc_cond_jump(jn_a[node]);
+        js_cc_stmt(jn_b[node]);
+        if (jn_c[node] >= 0) {
+            int jend = js_cc_emit(JS_OP_JMP, -1, 0);
+            js_cc_patch(jf);
+            js_cc_stmt(jn_c[node]);
+            js_cc_patch(jend);
+        } else {
+            js_cc_patch(jf);
+        }
+        return;
+    }
+    if (k == JS_NODE_WHILE || k == JS_NODE_FOR) {
+        int cond = jn_a[node];
+        int body = jn_b[node];
+        int step = -1;
+        if (k == JS_NODE_FOR) {
+            js_cc_stmt(jn_a[node]);
+            cond = jn_b[node];
+            body = jn_d[node];
+            step = jn_c[node];
+        }
+        js_cc_loop_open();
+        if (js_last_error[0] != 0) return;
+        int top = jbc_count;
+        jc_label_pc = top;
+        int jexit = -1;
+        if (cond >= 0) jexit = js_cc_cond_jump(cond);
+        js_cc_stmt(body);
+        int l = jcb_depth - 1;
+        js_cc_patch(jcb_cont[l]);
+        if (step >= 0) js_cc_expr_discard(step);
+        js_cc_emit(JS_OP_LOOP, top, 0);
+        js_cc_patch(jexit);
+        js_cc_patch(jcb_break[l]);
+        jcb_depth = l;
+        return;
+    }
+    if (k == JS_NODE_BREAK || k == JS_NODE_CONTINUE) {
+        if (jcb_depth <= jcx_loop_base[jcx_depth]) {
+            js_set_err("js: break/continue outside loop");
+            return;
+        }
+        int l = jcb_depth - 1;
+        if (k == JS_NODE_BREAK) {
+            int j = js_cc_emit(JS_OP_JMP, jcb_break[l], 0);
+            if (j >= 0) jcb_break[l] = j;
+        } else {
+            int j = js_cc_emit(JS_OP_JMP, jcb_cont[l], 0);
+            if (j >= 0) jcb_cont[l] = j;
+        }
+        return;
+    }
+    if (k == JS_NODE_RETURN) {
+        js_cc_expr(jn_a[node]);
+        if (jcx_depth > 0) { js_cc_emit(JS_OP_RET, 0, 0); return; }
+        /* Top-level return ends the script. */
+        js_cc_emit(JS_OP_POP, 0, 0);
+        js_cc_emit(JS_OP_END, 0, 0);
+        return;
+    }
+    /* FUNC_DECL was hoisted by js_cc_hoist_funcs. */
+}
+
+/* Compile a PROGRAM node. Returns the entry pc, or -1 on error. */
+int js_compile_program(int root) {
+    if (root < 0) return -1;
+    int entry = jbc_count;
+    jcx_depth = 0;
+    jcx_local_first[0] = 0;
+    jcx_loop_base[0] = 0;
+    jcl_count = 0;
+    jcb_depth = 0;
+    jc_label_pc = -1;
+    js_cc_hoist(root);
+    js_cc_hoist_funcs(root);
+    int s = jn_a[root];
+    while (s >= 0 && js_last_error[0] == 0) { js_cc_stmt(s); s = jn_next[s]; }
+    js_cc_emit(JS_OP_END, 0, 0);
+    if (js_last_error[0] != 0) return -1;
+    return entry;
+}
@@ -4,11 +4,13 @@
  *   - document.getElementById(id)         -> DOMNODE
  *   - element.textContent / innerText     (read)
  *   - element.tagName                     (read)
+ *   - performance.now()                   -> ms since boot
  *
- * DOMNODE values carry an int dom_idx in jvs_dom_idx. Property reads
- * on a DOMNODE go through jsd_dom_member_get; method calls (e.g.
- * getElementById) are surfaced as NATIVE function values so the
- * existing CALL machinery stays uniform.
+ * DOMNODE values carry an int dom_idx in jvs_dom_idx. Property names
+ * are mapped to JSD_P_* ids at compile time (jsd_prop_id), so reads
+ * and writes on a DOMNODE go through jsd_dom_prop_get / _set without
+ * string compares; method calls (e.g. getElementById) are surfaced
+ * as NATIVE function values so the VM's CALLM stays uniform.
 */
 
 void js_push_domnode(int dom_idx) {
@@ -104,32 +106,48 @@ int jsd_tag_name(int tag, char *buf, int max) {
     return i;
 }
 
-/* Read a property of a DOMNODE; pushes the resulting value. */
-void jsd_dom_member_get(int dom_idx, int koff, int klen) {
-    if (dom_idx < 0) { js_push_undef(); return; }
+/* Map a property name to its JSD_P_* id (JSD_P_NONE if it is not one
+ * the DOM bindings know). Done once per member expression when
+ * js_compile.cc emits it, so DOM reads and writes dispatch on an int.*/
+int jsd_prop_id(int koff, int klen) {
     char *name = js_str_pool + koff;
-    if (klen == 11 && b_strieq_n(name, "textContent", 11)) {
-        char buf[1024];
-        int n = jsd_collect_text(dom_idx, buf, 1024);
-        int off = js_str_intern(buf, n);
-        js_push_str(off, n);
-        return;
-    }
-    if (klen == 9 && b_strieq_n(name, "innerText", 9)) {
+    if (klen == 11 && b_strieq_n(name, "textContent", 11))  return JSD_P_TEXT_CONTENT;
+    if (klen == 9  && b_strieq_n(name, "innerText", 9))     return JSD_P_INNER_TEXT;
+    if (klen == 9  && b_strieq_n(name, "innerHTML", 9))     return JSD_P_INNER_HTML;
+    if (klen == 7  && b_strieq_n(name, "tagName", 7))       return JSD_P_TAG_NAME;
+    if (klen == 2  && b_strieq_n(name, "id", 2))            return JSD_P_ID;
+    if (klen == 9  && b_strieq_n(name, "className", 9))     return JSD_P_CLASS_NAME;
+    if (klen == 5  && b_strieq_n(name, "style", 5))         return JSD_P_STYLE;
+    if (klen == 10 && b_strieq_n(name, "parentNode", 10))   return JSD_P_PARENT_NODE;
+    if (klen == 10 && b_strieq_n(name, "firstChild", 10))   return JSD_P_FIRST_CHILD;
+    if (klen == 11 && b_strieq_n(name, "nextSibling", 11))  return JSD_P_NEXT_SIBLING;
+    if (klen == 12 && b_strieq_n(name, "getAttribute", 12)) return JSD_P_GET_ATTRIBUTE;
+    if (klen == 12 && b_strieq_n(name, "setAttribute", 12)) return JSD_P_SET_ATTRIBUTE;
+    if (klen == 11 && b_strieq_n(name, "appendChild", 11))  return JSD_P_APPEND_CHILD;
+    if (klen == 6  && b_strieq_n(name, "remove", 6))        return JSD_P_REMOVE;
+    if (klen == 6  && b_streq_n(name, "length", 6))         return JSD_P_LENGTH;
+    return JSD_P_NONE;
+}
+
+/* Read property `id` (JSD_P_*) of a DOMNODE; pushes the resulting value. */
+void jsd_dom_prop_get(int dom_idx, int id) {
+    if (dom_idx < 0) { js_push_undef(); return; }
+    if (id == JSD_P_TEXT_CONTENT || id == JSD_P_INNER_TEXT) {
         char buf[1024];
         int n = jsd_collect_text(dom_idx, buf, 1024);
-        int off = js_str_intern(buf, n);
+        int off = js_str_new(buf, n);
+        if (off < 0) { js_push_undef(); return; }
         js_push_str(off, n);
         return;
     }
-    if (klen == 7 && b_strieq_n(name, "tagName", 7)) {
+    if (id == JSD_P_TAG_NAME) {
         char buf[32];
         int n = jsd_tag_name(n_tag[dom_idx], buf, 32);
         int off = js_str_intern(buf, n);
         js_push_str(off, n);
         return;
     }
-    if (klen == 2 && b_strieq_n(name, "id", 2)) {
+    if (id == JSD_P_ID) {
         int idoff = dom_id_off[dom_idx];
         if (idoff < 0) { js_push_str(js_str_intern("", 0), 0); return; }
         char *idv = attr_pool + idoff;
@@ -138,7 +156,7 @@ void jsd_dom_member_get(int dom_idx, int koff, int klen) {
         js_push_str(o, idlen);
         return;
     }
-    if (klen == 9 && b_strieq_n(name, "className", 9)) {
+    if (id == JSD_P_CLASS_NAME) {
         int co = dom_class_off[dom_idx];
         if (co < 0) { js_push_str(js_str_intern("", 0), 0); return; }
         char *cv = attr_pool + co;
@@ -147,41 +165,33 @@ void jsd_dom_member_get(int dom_idx, int koff, int klen) {
         js_push_str(o, cl);
         return;
     }
-    if (klen == 5 && b_strieq_n(name, "style", 5)) {
+    if (id == JSD_P_STYLE) {
         js_push_undef();
         int t = jvs_top - 1;
         jvs_tag[t] = JS_VAL_STYLE;
         jvs_dom_idx[t] = dom_idx;
         return;
     }
-    if (klen == 10 && b_strieq_n(name, "parentNode", 10)) {
+    if (id == JSD_P_PARENT_NODE) {
         int p = n_parent[dom_idx];
         if (p < 0) js_push_null(); else js_push_domnode(p);
         return;
     }
-    if (klen == 10 && b_strieq_n(name, "firstChild", 10)) {
+    if (id == JSD_P_FIRST_CHILD) {
         int c = n_first_child[dom_idx];
         if (c < 0) js_push_null(); else js_push_domnode(c);
         return;
     }
-    if (klen == 11 && b_strieq_n(name, "nextSibling", 11)) {
+    if (id == JSD_P_NEXT_SIBLING) {
         int s = n_next[dom_idx];
         if (s < 0) js_push_null(); else js_push_domnode(s);
         return;
     }
-    /* Method callees - return a NATIVE value so eval_call dispatches. */
-    if (klen == 12 && b_strieq_n(name, "getAttribute", 12)) {
-        js_push_native(JS_NATIVE_EL_GET_ATTRIBUTE); return;
-    }
-    if (klen == 12 && b_strieq_n(name, "setAttribute", 12)) {
-        js_push_native(JS_NATIVE_EL_SET_ATTRIBUTE); return;
-    }
-    if (klen == 11 && b_strieq_n(name, "appendChild", 11)) {
-        js_push_native(JS_NATIVE_EL_APPEND_CHILD); return;
-    }
-    if (klen == 6 && b_strieq_n(name, "remove", 6)) {
-        js_push_native(JS_NATIVE_EL_REMOVE); return;
-    }
+    /* Method callees - return a NATIVE value so CALLM dispatches. */
+    if (id == JSD_P_GET_ATTRIBUTE) { js_push_native(JS_NATIVE_EL_GET_ATTRIBUTE); return; }
+    if (id == JSD_P_SET_ATTRIBUTE) { js_push_native(JS_NATIVE_EL_SET_ATTRIBUTE); return; }
+    if (id == JSD_P_APPEND_CHILD)  { js_push_native(JS_NATIVE_EL_APPEND_CHILD); return; }
+    if (id == JSD_P_REMOVE)        { js_push_native(JS_NATIVE_EL_REMOVE); return; }
     js_push_undef();
 }
 
@@ -295,24 +305,18 @@ void jsd_parse_inner_html(int parent, char *s, int len) {
 
 /* Write a property on a DOMNODE; reads top-of-stack as the rvalue.
  * F2b implements textContent / innerText. F2d adds attribute / style.*/
-void jsd_dom_member_set(int dom_idx, int koff, int klen) {
-    if (dom_idx < 0) { serial_printf("[c2] member_set: dom_idx<0\n"); return; }
-    char *name = js_str_pool + koff;
+void jsd_dom_prop_set(int dom_idx, int id) {
+    if (dom_idx < 0) return;
     int t = jvs_top - 1;
-    serial_printf("[c2] member_set dom=%d name=", dom_idx);
-    for (int i = 0; i < klen && i < 32; i = i + 1) serial_printf("%c", name[i]);
-    serial_printf("\n");
-    if ((klen == 11 && b_strieq_n(name, "textContent", 11)) ||
-        (klen == 9  && b_strieq_n(name, "innerText", 9))) {
+    if (id == JSD_P_TEXT_CONTENT || id == JSD_P_INNER_TEXT) {
         char buf[1024];
         int n = js_to_string_at(t, buf, 1024);
-        serial_printf("[c2] textContent set len=%d dom=%d\n", n, dom_idx);
         jsd_clear_children(dom_idx);
         jsd_make_text_child(dom_idx, buf, n);
         dom_dirty = 1;
         return;
     }
-    if (klen == 9 && b_strieq_n(name, "innerHTML", 9)) {
+    if (id == JSD_P_INNER_HTML) {
         /* Standalone fragment parser scoped to innerHTML. Re-entering the
          * main HTML parser would clobber its file-scope globals (page_buf,
          * tok_*[], ap_*[]); instead we walk the fragment locally and
@@ -349,6 +353,18 @@ void jsd_dom_set_attr(int dom_idx, char *name, int nlen, char *value, int vlen)
     if (found >= 0) {
         dom_ap_value_off[found] = v_off;
     } else {
+        /* A node's pairs must stay contiguous: unless they already end
+         * the table, move them to its end before appending.*/
+        if (count > 0 && first + count != dom_ap_count) {
+            if (dom_ap_count + count >= MAX_ATTR_PAIRS) return;
+            for (int i = 0; i < count; i++) {
+                dom_ap_name_off [dom_ap_count + i] = dom_ap_name_off [first + i];
+                dom_ap_value_off[dom_ap_count + i] = dom_ap_value_off[first + i];
+            }
+            first = dom_ap_count;
+            dom_attrs_first[dom_idx] = first;
+            dom_ap_count = first + count;
+        }
         if (dom_ap_count >= MAX_ATTR_PAIRS) return;
         int k = dom_ap_count;
         dom_ap_name_off[k]  = attr_intern(name, nlen);
@@ -359,7 +375,10 @@ void jsd_dom_set_attr(int dom_idx, char *name, int nlen, char *value, int vlen)
     }
     /* Refresh fast-path slots. */
     if (nlen == 5 && b_strieq_n(name, "class", 5)) dom_class_off[dom_idx] = v_off;
-    if (nlen == 2 && b_strieq_n(name, "id", 2))    dom_id_off[dom_idx]    = v_off;
+    if (nlen == 2 && b_strieq_n(name, "id", 2)) {
+        dom_id_off[dom_idx] = v_off;
+        jsd_id_cache_clear();
+    }
 }
 
 /* Read a style declaration from an element's inline style="..."
@@ -512,17 +531,8 @@ void jsd_doc_query_selector(int argc) {
     if (i >= n) { js_push_null(); return; }
     if (sel[i] == '#') {
         i = i + 1;
-        char *want = sel + i;
-        int wn = n - i;
-        for (int k = 0; k < nodes_count; k++) {
-            int idoff = dom_id_off[k];
-            if (idoff < 0) continue;
-            char *idv = attr_pool + idoff;
-            if (b_strieq_n(idv, want, wn) && idv[wn] == 0) {
-                js_push_domnode(k); return;
-            }
-        }
-        js_push_null();
+        int k = jsd_find_by_id(sel + i, n - i);
+        if (k < 0) js_push_null(); else js_push_domnode(k);
         return;
     }
     /* bare tag */
@@ -534,19 +544,52 @@ void jsd_doc_query_selector(int argc) {
     js_push_null();
 }
 
-/* document.getElementById(s) - walks DOM, matches dom_id_off entries. */
+/* getElementById cache: a small direct-mapped table from id hash to
+ * node, refilled on miss. Emptied when an id attribute changes and on
+ * page reset, so a hit is always checked against the live id anyway.*/
+void jsd_id_cache_clear() {
+    for (int i = 0; i < JSD_ID_CACHE; i++) jsd_idc_node[i] = -1;
+}
+
+int jsd_id_hash(char *s, int n) {
+    int h = 0;
+    for (int i = 0; i < n; i++) {
+        int c = s[i];
+        if (c >= 'A' && c <= 'Z') c = c + 32;
+        h = h * 31 + c;
+    }
+    return h & 0x7FFFFFFF;
+}
+
+/* First node whose id matches want (case-insensitive), -1 if none. */
+int jsd_find_by_id(char *want, int wn) {
+    int h = jsd_id_hash(want, wn);
+    int slot = h & (JSD_ID_CACHE - 1);
+    int n = jsd_idc_node[slot];
+    if (n >= 0 && jsd_idc_hash[slot] == h && n < nodes_count && dom_id_off[n] >= 0) {
+        char *idv = attr_pool + dom_id_off[n];
+        if (b_strieq_n(idv, want, wn) && idv[wn] == 0) return n;
+    }
+    for (int k = 0; k < nodes_count; k++) {
+        int idoff = dom_id_off[k];
+        if (idoff < 0) continue;
+        char *idv = attr_pool + idoff;
+        if (b_strieq_n(idv, want, wn) && idv[wn] == 0) {
+            jsd_idc_hash[slot] = h;
+            jsd_idc_node[slot] = k;
+            return k;
+        }
+    }
+    return -1;
+}
+
+/* document.getElementById(s) - id cache, then a DOM walk. */
 void jsd_doc_get_element_by_id(int argc) {
     if (argc < 1) { js_push_null(); return; }
     int t = jvs_top - argc;
     char want[128];
     int wn = js_to_string_at(t, want, 128);
-    int found = -1;
-    for (int n = 0; n < nodes_count; n++) {
-        int idoff = dom_id_off[n];
-        if (idoff < 0) continue;
-        char *idv = attr_pool + idoff;
-        if (b_strieq_n(idv, want, wn) && idv[wn] == 0) { found = n; break; }
-    }
+    int found = jsd_find_by_id(want, wn);
     if (found < 0) js_push_null(); else js_push_domnode(found);
 }
 
@@ -572,7 +615,7 @@ void js_native_return(int saved, int result_top) {
     jvs_native_id[t]= new_native;
 }
 
-/* Native dispatch entry point invoked by eval_call. The native
+/* Native dispatch entry point invoked by the VM's CALL / CALLM. The native
  * function id is known; argc args sit at [jvs_top-argc .. jvs_top-1].*/
 void js_native_call(int native_id, int argc) {
     int saved = jvs_top - argc;
@@ -593,6 +636,12 @@ void js_native_call(int native_id, int argc) {
         js_native_return(saved, jvs_top - 1);
         return;
     }
+    if (native_id == JS_NATIVE_PERF_NOW) {
+        int now = uptime_ms();
+        jvs_top = saved;
+        js_push_num((double)now);
+        return;
+    }
     if (native_id == JS_NATIVE_EL_APPEND_CHILD) {
         if (receiver_tag != JS_VAL_DOMNODE || argc < 1 ||
             jvs_tag[jvs_top - argc] != JS_VAL_DOMNODE) {
@@ -649,12 +698,31 @@ void js_native_call(int native_id, int argc) {
     js_push_undef();
 }
 
+/* Bind global `name` to object o. */
+void jsd_bind_global_obj(char *name, int o) {
+    int len = b_strlen(name);
+    int b = js_global_define(js_str_intern(name, len), len);
+    if (b >= 0) {
+        jb_tag[b]     = JS_VAL_OBJ;
+        jb_obj_idx[b] = o;
+    }
+}
+
+/* Set property `key` of object o to the native function id. */
+void jsd_set_native_prop(int o, char *key, int native_id) {
+    int len = b_strlen(key);
+    js_push_native(native_id);
+    js_obj_set_prop_from_top(o, js_str_intern(key, len), len);
+    js_pop();
+}
+
 /* Build the document/window globals at the start of script execution.
  * Called from parser.cc after the render tree is built and just before
- * running queued scripts so document.body has a valid DOM index.*/
+ * running queued scripts so document.body has a valid DOM index. They
+ * are defined before any script is compiled, so scripts reach them
+ * through resolved global binding indices.*/
 void js_install_globals() {
-    /* Ensure root scope exists. */
-    if (jsc_top == 0) jsc_cur = js_scope_enter(-1);
+    js_root_scope();
 
     /* document = { body: <body-domnode>, getElementById: <native> } */
     int doc = js_alloc_object(0);
@@ -666,37 +734,15 @@ void js_install_globals() {
             js_obj_set_prop_from_top(doc, koff, 4);
             js_pop();
         }
-        js_push_native(JS_NATIVE_DOC_GET_ELEMENT_BY_ID);
-        int koff = js_str_intern("getElementById", 14);
-        js_obj_set_prop_from_top(doc, koff, 14);
-        js_pop();
-        js_push_native(JS_NATIVE_DOC_CREATE_ELEMENT);
-        int koff2 = js_str_intern("createElement", 13);
-        js_obj_set_prop_from_top(doc, koff2, 13);
-        js_pop();
-        js_push_native(JS_NATIVE_DOC_QUERY_SELECTOR);
-        int koff3 = js_str_intern("querySelector", 13);
-        js_obj_set_prop_from_top(doc, koff3, 13);
-        js_pop();
-
-        int b = js_lookup_binding(0, js_str_intern("document", 8), 8);
-        if (b < 0) b = js_binding_alloc(0, js_str_intern("document", 8), 8);
-        if (b >= 0) {
-            jb_tag[b]     = JS_VAL_OBJ;
-            jb_obj_idx[b] = doc;
-        }
+        jsd_set_native_prop(doc, "getElementById", JS_NATIVE_DOC_GET_ELEMENT_BY_ID);
+        jsd_set_native_prop(doc, "createElement", JS_NATIVE_DOC_CREATE_ELEMENT);
+        jsd_set_native_prop(doc, "querySelector", JS_NATIVE_DOC_QUERY_SELECTOR);
+        jsd_bind_global_obj("document", doc);
     }
 
     /* window: a plain object alias to a global namespace - empty for now. */
     int win_obj = js_alloc_object(0);
-    if (win_obj >= 0) {
-        int b = js_lookup_binding(0, js_str_intern("window", 6), 6);
-        if (b < 0) b = js_binding_alloc(0, js_str_intern("window", 6), 6);
-        if (b >= 0) {
-            jb_tag[b]     = JS_VAL_OBJ;
-            jb_obj_idx[b] = win_obj;
-        }
-    }
+    if (win_obj >= 0) jsd_bind_global_obj("window", win_obj);
 
     /* location object holds href as a string property. Read works,
      * write updates the property but does not trigger navigate.*/
@@ -708,11 +754,13 @@ void js_install_globals() {
         int koff = js_str_intern("href", 4);
         js_obj_set_prop_from_top(loc, koff, 4);
         js_pop();
-        int b = js_lookup_binding(0, js_str_intern("location", 8), 8);
-        if (b < 0) b = js_binding_alloc(0, js_str_intern("location", 8), 8);
-        if (b >= 0) {
-            jb_tag[b]     = JS_VAL_OBJ;
-            jb_obj_idx[b] = loc;
-        }
+        jsd_bind_global_obj("location", loc);
+    }
+
+    /* performance.now() for script timing. */
+    int perf = js_alloc_object(0);
+    if (perf >= 0) {
+        jsd_set_native_prop(perf, "now", JS_NATIVE_PERF_NOW);
+        jsd_bind_global_obj("performance", perf);
     }
 }
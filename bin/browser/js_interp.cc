@@ -1,30 +1,32 @@
-/* §7 JavaScript tree-walking interpreter. F1b scope:
+/* §7 JavaScript bytecode VM. Runs the code js_compile.cc emits:
  *   - primitives: number (double), string, bool, null, undefined
- *   - operators: + - * / %, == !=  !==, < <= > >=, && || !
+ *   - operators: + - * / %, == != === !==, < <= > >=, && || !
  *               assignment + compound, prefix/postfix ++/--
  *   - control flow: if/else, while, for(init;cond;step), break/continue
- *   - var declarations (let/const treated as var; const-write check
- *     deferred until F1c gives us the binding kind tag at lookup)
+ *   - functions and closures, objects, arrays, DOM nodes (js_dom.cc)
  *   - console.log builtin: stringify args, route to serial_printf and
  *     status_msg
- * Functions, objects, arrays land in F1c / F1d.*/
+ * One dispatch loop, no recursion: a call pushes a jcs_* frame and
+ * jumps to the proto's code, RET pops it. Values live on the jvs_*
+ * stack; locals in the jb_* bindings of the call's environment.*/
 
 /* CupidC limitation: comparison operators on double operands (< > <= >=
  * and even == / !=) emit "invalid operator for floating-point operands".
- * js_dcmp scales the difference into an int range so all double
- * comparisons go through int compare. The 1e6 scale loses precision
- * past ~2^31 / 1e6 ≈ 2147 magnitude; sufficient for typical browser-
- * script arithmetic. Returns a sign-int: <0 a<b, 0 equal, >0 a>b.*/
-int js_dcmp(double a, double b) {
-    return (int)((a - b) * 1000000.0);
-}
-int js_dnz(double v) {
-    return (int)(v * 1000000.0);
+ * js_dsign reads the sign and zero-ness from the bits of v narrowed to
+ * float instead, which keeps the sign of any double and is exact for
+ * everything but magnitudes below float's denormal range (~1e-45),
+ * which compare as zero. Returns -1, 0 or 1.*/
+int js_dsign(double v) {
+    float f = (float)v;
+    int bits = *(int*)&f;
+    if ((bits & 0x7FFFFFFF) == 0) return 0;
+    if (bits < 0) return -1;
+    return 1;
 }
 
 /* value stack helpers */
 void js_push_undef() {
-    if (jvs_top >= MAX_JS_VS) return;
+    if (jvs_top >= MAX_JS_VS) { js_set_err("js: value stack overflow"); return; }
     int t = jvs_top;
     jvs_tag[t] = JS_VAL_UNDEF; jvs_num[t] = 0.0;
     jvs_str_off[t] = -1; jvs_str_len[t] = 0;
@@ -35,10 +37,12 @@ void js_push_null() {
     js_push_undef();
     jvs_tag[jvs_top - 1] = JS_VAL_NULL;
 }
+/* Numbers only ever read jvs_num, so the other fields are left as is. */
 void js_push_num(double v) {
-    js_push_undef();
-    int t = jvs_top - 1;
+    if (jvs_top >= MAX_JS_VS) { js_set_err("js: value stack overflow"); return; }
+    int t = jvs_top;
     jvs_tag[t] = JS_VAL_NUM; jvs_num[t] = v;
+    jvs_top = t + 1;
 }
 void js_push_bool(int b) {
     js_push_undef();
@@ -53,17 +57,23 @@ void js_push_str(int off, int len) {
 
 void js_pop() { if (jvs_top > 0) jvs_top = jvs_top - 1; }
 
+/* Overwrite stack slot dst with slot src. */
+void js_vs_copy(int dst, int src) {
+    if (dst == src) return;
+    jvs_tag[dst]      = jvs_tag[src];
+    jvs_num[dst]      = jvs_num[src];
+    jvs_str_off[dst]  = jvs_str_off[src];
+    jvs_str_len[dst]  = jvs_str_len[src];
+    jvs_obj_idx[dst]  = jvs_obj_idx[src];
+    jvs_dom_idx[dst]  = jvs_dom_idx[src];
+    jvs_native_id[dst]= jvs_native_id[src];
+}
+
 void js_copy_top_from(int src) {
-    if (jvs_top >= MAX_JS_VS || src < 0 || src >= jvs_top) return;
-    int t = jvs_top;
-    jvs_tag[t]      = jvs_tag[src];
-    jvs_num[t]      = jvs_num[src];
-    jvs_str_off[t]  = jvs_str_off[src];
-    jvs_str_len[t]  = jvs_str_len[src];
-    jvs_obj_idx[t]  = jvs_obj_idx[src];
-    jvs_dom_idx[t]  = jvs_dom_idx[src];
-    jvs_native_id[t]= jvs_native_id[src];
-    jvs_top = t + 1;
+    if (jvs_top >= MAX_JS_VS) { js_set_err("js: value stack overflow"); return; }
+    if (src < 0 || src >= jvs_top) return;
+    js_vs_copy(jvs_top, src);
+    jvs_top = jvs_top + 1;
 }
 
 /* coercion */
@@ -74,21 +84,22 @@ double js_to_number_at(int idx) {
     if (t == JS_VAL_NULL) return 0.0;
     if (t == JS_VAL_STR) {
         char *s = js_str_pool + jvs_str_off[idx];
+        int n = jvs_str_len[idx];
         int sign = 1;
         int i = 0;
-        while (s[i] == ' ' || s[i] == '\t') i = i + 1;
-        if (s[i] == '-') { sign = -1; i = i + 1; }
-        else if (s[i] == '+') { i = i + 1; }
+        while (i < n && (s[i] == ' ' || s[i] == '\t')) i = i + 1;
+        if (i < n && s[i] == '-') { sign = -1; i = i + 1; }
+        else if (i < n && s[i] == '+') { i = i + 1; }
         double v = 0.0;
         int saw = 0;
-        while (s[i] >= '0' && s[i] <= '9') {
+        while (i < n && s[i] >= '0' && s[i] <= '9') {
             v = v * 10.0 + (double)(s[i] - '0');
             i = i + 1; saw = 1;
         }
-        if (s[i] == '.') {
+        if (i < n && s[i] == '.') {
             i = i + 1;
             double frac = 0.1;
-            while (s[i] >= '0' && s[i] <= '9') {
+            while (i < n && s[i] >= '0' && s[i] <= '9') {
                 v = v + frac * (double)(s[i] - '0');
                 frac = frac * 0.1;
                 i = i + 1; saw = 1;
@@ -104,8 +115,8 @@ double js_to_number_at(int idx) {
 int js_to_bool_at(int idx) {
     int t = jvs_tag[idx];
     if (t == JS_VAL_UNDEF || t == JS_VAL_NULL) return 0;
-    if (t == JS_VAL_BOOL) return js_dnz(jvs_num[idx]) != 0;
-    if (t == JS_VAL_NUM)  return js_dnz(jvs_num[idx]) != 0;
+    if (t == JS_VAL_BOOL) return (int)jvs_num[idx] != 0;
+    if (t == JS_VAL_NUM)  return js_dsign(jvs_num[idx]) != 0;
     if (t == JS_VAL_STR) return jvs_str_len[idx] > 0;
     return 1;       /* objects/funcs always truthy */
 }
@@ -133,13 +144,11 @@ int js_format_int(int v, char *buf) {
 
 /* Format a double into buf without %f. CupidC can't mix int and
  * double args in one call, so the signature is (double, char*) and
- * the buffer is assumed to be at least 64 bytes. Sign and fractional
- * presence are detected through int-scaled comparisons because the
- * parser also rejects '<' '>' on doubles.*/
+ * the buffer is assumed to be at least 64 bytes. The sign comes from
+ * js_dsign because the parser also rejects '<' '>' on doubles.*/
 int js_format_num(double v, char *buf) {
     int b = 0;
-    int sign_probe = (int)(v * 1000000.0);
-    if (sign_probe < 0) {
+    if (js_dsign(v) < 0) {
         buf[b] = '-'; b = b + 1;
         v = 0.0 - v;
     }
@@ -183,7 +192,7 @@ int js_to_string_at(int idx, char *buf, int max) {
         buf[i] = 0; return i;
     }
     if (t == JS_VAL_BOOL) {
-        char *s = (js_dnz(jvs_num[idx]) != 0) ? "true" : "false";
+        char *s = ((int)jvs_num[idx] != 0) ? "true" : "false";
         int i = 0;
         while (s[i] && i < max - 1) { buf[i] = s[i]; i = i + 1; }
         buf[i] = 0; return i;
@@ -211,12 +220,12 @@ int js_to_string_at(int idx, char *buf, int max) {
 
 int js_eq_at(int a, int b) {
     /* loose equality - just a thin pass for numbers, strings, bools.
-     * Object identity is deferred until F1d.*/
+     * Objects compare by identity.*/
     int ta = jvs_tag[a]; int tb = jvs_tag[b];
     if (ta == JS_VAL_NULL && tb == JS_VAL_UNDEF) return 1;
     if (ta == JS_VAL_UNDEF && tb == JS_VAL_NULL) return 1;
     if (ta == JS_VAL_NUM || tb == JS_VAL_NUM) {
-        return js_dcmp(js_to_number_at(a), js_to_number_at(b)) == 0;
+        return js_dsign(js_to_number_at(a) - js_to_number_at(b)) == 0;
     }
     if (ta == JS_VAL_STR && tb == JS_VAL_STR) {
         if (jvs_str_len[a] != jvs_str_len[b]) return 0;
@@ -226,8 +235,14 @@ int js_eq_at(int a, int b) {
         for (int i = 0; i < n; i++) if (sa[i] != sb[i]) return 0;
         return 1;
     }
-    if (ta == JS_VAL_BOOL && tb == JS_VAL_BOOL) return js_dcmp(jvs_num[a], jvs_num[b]) == 0;
-    return ta == tb;
+    if (ta == JS_VAL_BOOL && tb == JS_VAL_BOOL) return (int)jvs_num[a] == (int)jvs_num[b];
+    if (ta != tb) return 0;
+    if (ta == JS_VAL_DOMNODE || ta == JS_VAL_STYLE) return jvs_dom_idx[a] == jvs_dom_idx[b];
+    if (ta == JS_VAL_NATIVE) return jvs_native_id[a] == jvs_native_id[b];
+    if (ta == JS_VAL_OBJ || ta == JS_VAL_ARR || ta == JS_VAL_FUNC) {
+        return jvs_obj_idx[a] == jvs_obj_idx[b];
+    }
+    return 1;
 }
 
 int js_strict_eq_at(int a, int b) {
@@ -235,17 +250,70 @@ int js_strict_eq_at(int a, int b) {
     return js_eq_at(a, b);
 }
 
-/* scope / bindings */
-int js_scope_enter(int parent) {
-    if (jsc_top >= MAX_JS_SCOPES) { js_set_err("js: scope overflow"); return -1; }
-    int s = jsc_top;
-    jsc_parent[s] = parent;
-    jsc_first[s]  = jb_count;
-    jsc_count[s]  = 0;
-    jsc_top = s + 1;
-    return s;
+/* strings */
+
+int js_str_eq(int off1, int len1, int off2, int len2) {
+    if (len1 != len2) return 0;
+    char *s1 = js_str_pool + off1;
+    char *s2 = js_str_pool + off2;
+    for (int i = 0; i < len1; i++) if (s1[i] != s2[i]) return 0;
+    return 1;
+}
+
+/* Append bytes to js_str_pool without the js_str_intern dedup scan.
+ * Used for values made at run time (concatenations, array keys).*/
+int js_str_new(char *src, int n) {
+    if (js_str_pool_pos + n + 1 >= JS_STR_POOL) { js_set_err("js: string pool full"); return -1; }
+    int off = js_str_pool_pos;
+    for (int i = 0; i < n; i++) js_str_pool[off + i] = src[i];
+    js_str_pool[off + n] = 0;
+    js_str_pool_pos = off + n + 1;
+    return off;
+}
+
+/* Replace stack slots a, a+1 with their concatenation. The result of
+ * the previous concatenation, if it is still the last thing in the
+ * pool, grows in place, so `s = s + x` in a loop costs the length of
+ * x rather than of s. Earlier holders of that value keep their own
+ * shorter length, and every reader of pool strings is length-bounded.*/
+void js_concat_at(int a) {
+    int b = a + 1;
+    char abuf[64]; char bbuf[64];
+    int aoff = -1; int alen = 0;
+    int boff = -1; int blen = 0;
+    if (jvs_tag[a] == JS_VAL_STR) { aoff = jvs_str_off[a]; alen = jvs_str_len[a]; }
+    else alen = js_to_string_at(a, abuf, 64);
+    if (jvs_tag[b] == JS_VAL_STR) { boff = jvs_str_off[b]; blen = jvs_str_len[b]; }
+    else blen = js_to_string_at(b, bbuf, 64);
+    int off = js_str_pool_pos;
+    int in_place = aoff >= 0 && aoff == js_str_dyn_off &&
+                   aoff + alen + 1 == js_str_pool_pos;
+    if (in_place) off = aoff;
+    if (off + alen + blen + 1 >= JS_STR_POOL) {
+        js_set_err("js: string pool full");
+        jvs_top = a;
+        js_push_undef();
+        return;
+    }
+    if (!in_place) {
+        for (int i = 0; i < alen; i++) {
+            if (aoff >= 0) js_str_pool[off + i] = js_str_pool[aoff + i];
+            else js_str_pool[off + i] = abuf[i];
+        }
+    }
+    for (int i = 0; i < blen; i++) {
+        if (boff >= 0) js_str_pool[off + alen + i] = js_str_pool[boff + i];
+        else js_str_pool[off + alen + i] = bbuf[i];
+    }
+    js_str_pool[off + alen + blen] = 0;
+    js_str_pool_pos = off + alen + blen + 1;
+    js_str_dyn_off = off;
+    jvs_top = a;
+    js_push_str(off, alen + blen);
 }
 
+/* scope / bindings */
+
 int js_binding_alloc(int scope, int name_off, int name_len) {
     if (jb_count >= MAX_JS_BINDINGS) { js_set_err("js: bindings overflow"); return -1; }
     int b = jb_count;
@@ -263,32 +331,29 @@ int js_binding_alloc(int scope, int name_off, int name_len) {
     return b;
 }
 
-int js_str_eq(int off1, int len1, int off2, int len2) {
-    if (len1 != len2) return 0;
-    char *s1 = js_str_pool + off1;
-    char *s2 = js_str_pool + off2;
-    for (int i = 0; i < len1; i++) if (s1[i] != s2[i]) return 0;
-    return 1;
+/* Frame for one call: n contiguous, undefined locals. */
+int js_env_alloc(int parent, int n) {
+    if (jsc_top >= MAX_JS_SCOPES || jb_count + n > MAX_JS_BINDINGS) {
+        js_set_err("js: scope overflow");
+        return -1;
+    }
+    int s = jsc_top;
+    jsc_parent[s] = parent;
+    jsc_first[s]  = jb_count;
+    jsc_count[s]  = 0;
+    jsc_top = s + 1;
+    for (int i = 0; i < n; i++) js_binding_alloc(s, -1, 0);
+    return s;
 }
 
-int js_lookup_binding(int scope, int name_off, int name_len) {
-    int s = scope;
-    while (s >= 0) {
-        int first = jsc_first[s];
-        int n = jsc_count[s];
-        for (int i = 0; i < n; i++) {
-            int b = first + i;
-            if (js_str_eq(jb_name_off[b], jb_name_len[b], name_off, name_len)) {
-                return b;
-            }
-        }
-        s = jsc_parent[s];
-    }
-    return -1;
+/* Everything allocated so far outlives the calls now running: a
+ * closure may hold one of their frames, or a global was added.*/
+void js_env_pin() {
+    js_env_keep_sc = jsc_top;
+    js_env_keep_b = jb_count;
 }
 
-void js_binding_set_from_top(int b) {
-    int t = jvs_top - 1;
+void js_binding_set_from(int b, int t) {
     jb_tag[b]       = jvs_tag[t];
     jb_num[b]       = jvs_num[t];
     jb_str_off[b]   = jvs_str_off[t];
@@ -299,8 +364,9 @@ void js_binding_set_from_top(int b) {
 }
 
 void js_push_from_binding(int b) {
-    js_push_undef();
-    int t = jvs_top - 1;
+    if (jvs_top >= MAX_JS_VS) { js_set_err("js: value stack overflow"); return; }
+    int t = jvs_top;
+    jvs_top = t + 1;
     jvs_tag[t]       = jb_tag[b];
     jvs_num[t]       = jb_num[b];
     jvs_str_off[t]   = jb_str_off[b];
@@ -310,6 +376,14 @@ void js_push_from_binding(int b) {
     jvs_native_id[t] = jb_native_id[b];
 }
 
+/* ++ / -- on a binding, as a statement. */
+void js_binding_inc(int b, int delta) {
+    if (jb_tag[b] != JS_VAL_NUM && jb_tag[b] != JS_VAL_BOOL) jb_num[b] = 0.0;
+    jb_tag[b] = JS_VAL_NUM;
+    if (delta > 0) jb_num[b] = jb_num[b] + 1.0;
+    else jb_num[b] = jb_num[b] - 1.0;
+}
+
 /* console builtin */
 void js_console_log_top_n(int argc) {
     /* args sit on the value stack at [top-argc .. top-1]. */
@@ -333,7 +407,7 @@ void js_console_log_top_n(int argc) {
     status_msg[s] = 0;
 }
 
-/* expression eval - CupidC defers cross-resolve for recursive calls. */
+/* objects */
 
 int js_alloc_object(int kind) {
     if (jobj_count >= MAX_JS_OBJS) { js_set_err("js: object pool full"); return -1; }
@@ -358,17 +432,38 @@ void js_push_arr(int obj_idx) {
     jvs_obj_idx[t] = obj_idx;
 }
 
-/* Find property `key` on object `obj`. Returns property index or -1. */
-int js_obj_find_prop(int obj, int key_off, int key_len) {
+/* Find property `key` (len bytes) on object `obj`. Returns property
+ * index or -1.*/
+int js_obj_find_prop_s(int obj, char *key, int len) {
     int p = jobj_first_prop[obj];
     while (p >= 0) {
-        if (js_str_eq(jp_key_off[p], jp_key_len[p], key_off, key_len)) return p;
+        if (jp_key_len[p] == len) {
+            char *k = js_str_pool + jp_key_off[p];
+            int i = 0;
+            while (i < len && k[i] == key[i]) i = i + 1;
+            if (i == len) return p;
+        }
         p = jp_next[p];
     }
     return -1;
 }
 
-int js_obj_set_prop_from_top(int obj, int key_off, int key_len) {
+int js_obj_find_prop(int obj, int key_off, int key_len) {
+    return js_obj_find_prop_s(obj, js_str_pool + key_off, key_len);
+}
+
+void js_prop_set_from(int p, int t) {
+    jp_tag    [p] = jvs_tag[t];
+    jp_num    [p] = jvs_num[t];
+    jp_str_off[p] = jvs_str_off[t];
+    jp_str_len[p] = jvs_str_len[t];
+    jp_obj_idx[p] = jvs_obj_idx[t];
+    jp_dom_idx[p] = jvs_dom_idx[t];
+    jp_native_id[p] = jvs_native_id[t];
+}
+
+/* Set `key` on `obj` from stack slot t, adding the property if needed. */
+int js_obj_set_prop_at(int obj, int key_off, int key_len, int t) {
     int p = js_obj_find_prop(obj, key_off, key_len);
     if (p < 0) {
         if (jp_count >= MAX_JS_PROPS) { js_set_err("js: prop pool full"); return -1; }
@@ -379,17 +474,14 @@ int js_obj_set_prop_from_top(int obj, int key_off, int key_len) {
         jobj_first_prop[obj] = p;
         jp_count = p + 1;
     }
-    int t = jvs_top - 1;
-    jp_tag    [p] = jvs_tag[t];
-    jp_num    [p] = jvs_num[t];
-    jp_str_off[p] = jvs_str_off[t];
-    jp_str_len[p] = jvs_str_len[t];
-    jp_obj_idx[p] = jvs_obj_idx[t];
-    jp_dom_idx[p] = jvs_dom_idx[t];
-    jp_native_id[p] = jvs_native_id[t];
+    js_prop_set_from(p, t);
     return p;
 }
 
+int js_obj_set_prop_from_top(int obj, int key_off, int key_len) {
+    return js_obj_set_prop_at(obj, key_off, key_len, jvs_top - 1);
+}
+
 void js_push_from_prop(int p) {
     js_push_undef();
     int t = jvs_top - 1;
@@ -402,27 +494,38 @@ void js_push_from_prop(int p) {
     jvs_native_id[t]= jp_native_id[p];
 }
 
-/* For [obj][index]: convert TOS to a string key; returns interned offset. */
-int js_index_top_to_key(int *out_off, int *out_len) {
-    int t = jvs_top - 1;
-    if (jvs_tag[t] == JS_VAL_STR) {
-        *out_off = jvs_str_off[t];
-        *out_len = jvs_str_len[t];
-        return 0;
+/* For obj[key]: a string key is used as is; anything else is
+ * formatted into buf. Returns the key length and sets *off to its pool
+ * offset, or to -1 when the key is in buf.*/
+int js_key_at(int idx, char *buf, int *off) {
+    if (jvs_tag[idx] == JS_VAL_STR) {
+        *off = jvs_str_off[idx];
+        return jvs_str_len[idx];
     }
-    char buf[64];
-    int n = js_to_string_at(t, buf, 64);
-    int off = js_str_intern(buf, n);
-    *out_off = off;
-    *out_len = n;
-    return 0;
+    *off = -1;
+    return js_to_string_at(idx, buf, 64);
+}
+
+int js_key_find(int obj, int off, char *buf, int len) {
+    if (off >= 0) return js_obj_find_prop(obj, off, len);
+    return js_obj_find_prop_s(obj, buf, len);
 }
 
-int js_alloc_function(int param_first, int body, int captured_scope) {
+/* Property p of object oi for the GETP/GETM/SETP at pc. Properties are
+ * never removed or moved, so once found the pair stays valid.*/
+int js_vm_prop(int pc, int oi) {
+    if (jbc_ic_obj[pc] == oi) return jbc_ic_prop[pc];
+    int p = js_obj_find_prop(oi, jbc_a[pc], jbc_b[pc]);
+    if (p >= 0) { jbc_ic_obj[pc] = oi; jbc_ic_prop[pc] = p; }
+    return p;
+}
+
+/* functions */
+
+int js_alloc_function(int proto, int captured_scope) {
     if (jfn_count >= MAX_JS_FUNCS) { js_set_err("js: function pool full"); return -1; }
     int f = jfn_count;
-    jfn_param_first[f]    = param_first;
-    jfn_body[f]           = body;
+    jfn_proto[f]          = proto;
     jfn_captured_scope[f] = captured_scope;
     jfn_native_id[f]      = -1;
     jfn_count = f + 1;
@@ -436,691 +539,462 @@ void js_push_func(int fn_idx) {
     jvs_obj_idx[t] = fn_idx;
 }
 
-void js_call_user_function(int fn_idx, int argc) {
-    /* args sit at [jvs_top-argc .. jvs_top-1]. Build a fresh scope
-     * frame parented to the function's captured scope (closure), bind
-     * each param, run the body, restore caller scope.*/
-    int saved_scope = jsc_cur;
-    int new_scope = js_scope_enter(jfn_captured_scope[fn_idx]);
-    if (new_scope < 0) { jvs_top = jvs_top - argc; js_push_undef(); return; }
-    jsc_cur = new_scope;
-    /* bind params */
-    int p = jfn_param_first[fn_idx];
-    int i = 0;
-    while (p >= 0) {
-        int o = jn_a[p]; int l = jn_b[p];
-        int b = js_binding_alloc(new_scope, o, l);
-        if (i < argc && b >= 0) {
-            int src = jvs_top - argc + i;
-            jb_tag[b]      = jvs_tag[src];
-            jb_num[b]      = jvs_num[src];
-            jb_str_off[b]  = jvs_str_off[src];
-            jb_str_len[b]  = jvs_str_len[src];
-            jb_obj_idx[b]  = jvs_obj_idx[src];
-            jb_dom_idx[b]  = jvs_dom_idx[src];
-        }
-        p = jn_next[p];
-        i = i + 1;
-    }
-    /* drop args */
-    jvs_top = jvs_top - argc;
-    /* execute body */
-    int saved_signal = js_ctrl_signal;
-    js_ctrl_signal = 0;
-    int saved_vs_top = jvs_top;
-    js_eval_stmt(jfn_body[fn_idx]);
-    /* if RETURN signaled, top of stack already holds the return value. */
-    if (js_ctrl_signal != 3) {
-        /* fell off end - push undefined */
-        if (jvs_top == saved_vs_top) js_push_undef();
-        else {
-            /* stray values on stack from expr stmts - drop them */
-            while (jvs_top > saved_vs_top + 1) js_pop();
-        }
+/* Enter user function fn: argc args start at stack slot args, and its
+ * result goes to slot base. Binds the params in a fresh environment
+ * and pushes the return frame. Returns the environment, -1 on error.*/
+int js_vm_enter(int fn, int args, int argc, int base, int ret_pc, int env) {
+    if (jcs_top >= MAX_JS_CALLS) { js_set_err("js: call stack overflow"); return -1; }
+    int p = jfn_proto[fn];
+    int f = jcs_top;
+    jcs_pc[f]   = ret_pc;
+    jcs_env[f]  = env;
+    jcs_base[f] = base;
+    jcs_sc[f]   = jsc_top;
+    jcs_b[f]    = jb_count;
+    int ne = js_env_alloc(jfn_captured_scope[fn], jpr_nlocals[p]);
+    if (ne < 0) return -1;
+    int n = jpr_nparams[p];
+    if (argc < n) n = argc;
+    int first = jsc_first[ne];
+    for (int i = 0; i < n; i++) js_binding_set_from(first + i, args + i);
+    jvs_top = base;
+    jcs_top = f + 1;
+    return ne;
+}
+
+/* Binary arithmetic and comparison on slots a, a+1 for operands that
+ * are not both numbers; leaves the result in slot a.*/
+void js_vm_binop(int op, int a) {
+    int b = a + 1;
+    if (op == JS_OP_ADD && (jvs_tag[a] == JS_VAL_STR || jvs_tag[b] == JS_VAL_STR)) {
+        js_concat_at(a);
+        return;
     }
-    js_ctrl_signal = saved_signal;
-    jsc_cur = saved_scope;
-}
-
-void js_eval_call(int node) {
-    int callee = jn_a[node];
-    /* Special-case console.log syntactically: there is no console
-     * global at runtime, so the regular MEMBER path can't find it.*/
-    int handled_console_log = 0;
-    if (callee >= 0 && jn_kind[callee] == JS_NODE_MEMBER) {
-        int obj = jn_a[callee];
-        int koff = jn_b[callee];
-        int klen = jn_c[callee];
-        if (obj >= 0 && jn_kind[obj] == JS_NODE_IDENT) {
-            int ioff = jn_a[obj]; int ilen = jn_b[obj];
-            if (ilen == 7 && klen == 3 &&
-                js_str_eq(ioff, ilen,
-                          js_str_intern("console", 7), 7) &&
-                js_str_eq(koff, klen,
-                          js_str_intern("log", 3), 3)) {
-                handled_console_log = 1;
-            }
-        }
+    if (op == JS_OP_EQ || op == JS_OP_NE || op == JS_OP_SEQ || op == JS_OP_SNE) {
+        int eq = 0;
+        if (op == JS_OP_SEQ || op == JS_OP_SNE) eq = js_strict_eq_at(a, b);
+        else eq = js_eq_at(a, b);
+        if (op == JS_OP_NE || op == JS_OP_SNE) eq = !eq;
+        jvs_top = a; js_push_bool(eq);
+        return;
     }
-    /* If the callee is a MEMBER expression on a value, capture the
-     * receiver before evaluating - the property lookup eats the
-     * object off the stack.*/
-    int has_this = 0;
-    int this_tag = JS_VAL_UNDEF;
-    int this_dom_idx = -1;
-    int this_obj_idx = -1;
-    if (!handled_console_log && callee >= 0 && jn_kind[callee] == JS_NODE_MEMBER) {
-        js_eval_expr(jn_a[callee]);
-        int rt = jvs_top - 1;
-        this_tag     = jvs_tag[rt];
-        this_dom_idx = jvs_dom_idx[rt];
-        this_obj_idx = jvs_obj_idx[rt];
-        has_this = 1;
-        int koff = jn_b[callee]; int klen = jn_c[callee];
-        if (this_tag == JS_VAL_DOMNODE) {
-            jvs_top = rt;
-            jsd_dom_member_get(this_dom_idx, koff, klen);
-        } else if (this_tag == JS_VAL_OBJ || this_tag == JS_VAL_ARR) {
-            int p = js_obj_find_prop(this_obj_idx, koff, klen);
-            jvs_top = rt;
-            if (p >= 0) js_push_from_prop(p); else js_push_undef();
-        } else {
-            jvs_top = rt;
-            js_push_undef();
+    double na = js_to_number_at(a);
+    double nb = js_to_number_at(b);
+    double v = 0.0;
+    if (op == JS_OP_ADD)      v = na + nb;
+    else if (op == JS_OP_SUB) v = na - nb;
+    else if (op == JS_OP_MUL) v = na * nb;
+    else if (op == JS_OP_DIV) {
+        if (js_dsign(nb) != 0) v = na / nb;
+    }
+    else if (op == JS_OP_MOD) {
+        if (js_dsign(nb) != 0) {
+            int q = (int)(na / nb);
+            v = na - (double)q * nb;
         }
-    } else if (!handled_console_log) {
-        js_eval_expr(callee);
     }
-    int callee_top = jvs_top - 1;
-    int saved_before_args = jvs_top;
-    int argc = 0;
-    int arg = jn_b[node];
-    while (arg >= 0) {
-        js_eval_expr(arg);
-        arg = jn_next[arg];
-        argc = argc + 1;
-    }
-    if (handled_console_log) {
-        js_console_log_top_n(argc);
-        jvs_top = saved_before_args - argc;       /* drop args + (no callee) */
-        js_push_undef();
+    else {
+        int s = js_dsign(na - nb);
+        int bv = 0;
+        if (op == JS_OP_LT)      bv = s < 0;
+        else if (op == JS_OP_GT) bv = s > 0;
+        else if (op == JS_OP_LE) bv = s <= 0;
+        else if (op == JS_OP_GE) bv = s >= 0;
+        jvs_top = a; js_push_bool(bv);
         return;
     }
-    int ctag = jvs_tag[callee_top];
-    if (ctag == JS_VAL_FUNC) {
-        int fn_idx = jvs_obj_idx[callee_top];
-        for (int k = 0; k < argc; k++) {
-            int dst = callee_top + k;
-            int src = callee_top + 1 + k;
-            jvs_tag[dst]     = jvs_tag[src];
-            jvs_num[dst]     = jvs_num[src];
-            jvs_str_off[dst] = jvs_str_off[src];
-            jvs_str_len[dst] = jvs_str_len[src];
-            jvs_obj_idx[dst] = jvs_obj_idx[src];
-            jvs_dom_idx[dst] = jvs_dom_idx[src];
-        }
-        jvs_top = callee_top + argc;
-        js_call_user_function(fn_idx, argc);
+    jvs_top = a;
+    js_push_num(v);
+}
+
+void js_vm_typeof(int t) {
+    char *s = "undefined";
+    int tag = jvs_tag[t];
+    if (tag == JS_VAL_NUM)  s = "number";
+    else if (tag == JS_VAL_STR)  s = "string";
+    else if (tag == JS_VAL_BOOL) s = "boolean";
+    else if (tag == JS_VAL_NULL) s = "object";
+    else if (tag == JS_VAL_FUNC || tag == JS_VAL_NATIVE) s = "function";
+    else if (tag == JS_VAL_OBJ || tag == JS_VAL_ARR || tag == JS_VAL_DOMNODE) s = "object";
+    int sl = 0; while (s[sl]) sl = sl + 1;
+    int off = js_str_intern(s, sl);
+    jvs_top = t; js_push_str(off, sl);
+}
+
+/* obj.name (GETP at pc): slot t holds obj and receives the value. */
+void js_vm_getp(int pc, int t) {
+    int tag = jvs_tag[t];
+    int id = jbc_c[pc];
+    if (tag == JS_VAL_OBJ || tag == JS_VAL_ARR) {
+        int oi = jvs_obj_idx[t];
+        jvs_top = t;
+        if (tag == JS_VAL_ARR && id == JSD_P_LENGTH) { js_push_num((double)jobj_arr_len[oi]); return; }
+        int p = js_vm_prop(pc, oi);
+        if (p >= 0) js_push_from_prop(p); else js_push_undef();
         return;
     }
-    if (ctag == JS_VAL_NATIVE) {
-        int native_id = jvs_native_id[callee_top];
-        /* Make args contiguous at top. */
-        for (int k = 0; k < argc; k++) {
-            int dst = callee_top + k;
-            int src = callee_top + 1 + k;
-            jvs_tag[dst]     = jvs_tag[src];
-            jvs_num[dst]     = jvs_num[src];
-            jvs_str_off[dst] = jvs_str_off[src];
-            jvs_str_len[dst] = jvs_str_len[src];
-            jvs_obj_idx[dst] = jvs_obj_idx[src];
-            jvs_dom_idx[dst] = jvs_dom_idx[src];
-        }
-        jvs_top = callee_top + argc;
-        if (has_this) {
-            jsd_this_tag = this_tag;
-            jsd_this_dom_idx = this_dom_idx;
-            jsd_this_obj_idx = this_obj_idx;
-        } else {
-            jsd_this_tag = JS_VAL_UNDEF;
-            jsd_this_dom_idx = -1;
-            jsd_this_obj_idx = -1;
-        }
-        js_native_call(native_id, argc);
+    if (tag == JS_VAL_STR && id == JSD_P_LENGTH) {
+        int n = jvs_str_len[t];
+        jvs_top = t;
+        js_push_num((double)n);
         return;
     }
-    jvs_top = callee_top;
-    js_set_err("js: callee is not a function");
+    int dom = jvs_dom_idx[t];
+    jvs_top = t;
+    if (tag == JS_VAL_DOMNODE) { jsd_dom_prop_get(dom, id); return; }
+    if (tag == JS_VAL_STYLE)   { jsd_style_get(dom, jbc_a[pc], jbc_b[pc]); return; }
     js_push_undef();
 }
 
-void js_assign_to_target(int target_node) {
-    /* Top of stack holds the rvalue. */
-    if (target_node < 0) { js_pop(); return; }
-    int kind = jn_kind[target_node];
-    if (kind == JS_NODE_IDENT) {
-        int o = jn_a[target_node]; int l = jn_b[target_node];
-        int b = js_lookup_binding(jsc_cur, o, l);
-        if (b < 0) {
-            /* Implicit global - create at root scope. */
-            b = js_binding_alloc(0, o, l);
-        }
-        if (b >= 0) js_binding_set_from_top(b);
-        return;
-    }
-    if (kind == JS_NODE_MEMBER) {
-        /* Save rvalue, evaluate object, restore rvalue on top. */
-        int rv_pos = jvs_top - 1;
-        js_eval_expr(jn_a[target_node]);
-        int obj_top = jvs_top - 1;
-        int koff = jn_b[target_node]; int klen = jn_c[target_node];
-        int tag = jvs_tag[obj_top];
-        int dom = jvs_dom_idx[obj_top];
-        int oi  = jvs_obj_idx[obj_top];
-        serial_printf("[c2] member-set: tag=%d dom=%d klen=%d\n", tag, dom, klen);
-        if (tag == JS_VAL_STYLE) {
-            /* el.style.X = "..."; serialise into inline style attribute. */
-            char vbuf[256];
-            int vlen = js_to_string_at(rv_pos, vbuf, 256);
-            jsd_style_set(dom, koff, klen, vbuf, vlen);
-            jvs_top = rv_pos + 1;
-            return;
-        }
-        if (tag == JS_VAL_DOMNODE) {
-            /* Write rvalue back to top so jsd_dom_member_set reads it. */
-            int srct = jvs_tag[rv_pos];
-            double srcn = jvs_num[rv_pos];
-            int srcs_o = jvs_str_off[rv_pos];
-            int srcs_l = jvs_str_len[rv_pos];
-            int srco   = jvs_obj_idx[rv_pos];
-            int srcd   = jvs_dom_idx[rv_pos];
-            jvs_tag[obj_top]     = srct;
-            jvs_num[obj_top]     = srcn;
-            jvs_str_off[obj_top] = srcs_o;
-            jvs_str_len[obj_top] = srcs_l;
-            jvs_obj_idx[obj_top] = srco;
-            jvs_dom_idx[obj_top] = srcd;
-            jsd_dom_member_set(dom, koff, klen);
-            jvs_top = rv_pos + 1;
-            jvs_tag[rv_pos]     = srct;
-            jvs_num[rv_pos]     = srcn;
-            jvs_str_off[rv_pos] = srcs_o;
-            jvs_str_len[rv_pos] = srcs_l;
-            jvs_obj_idx[rv_pos] = srco;
-            jvs_dom_idx[rv_pos] = srcd;
-            return;
-        }
-        if (tag == JS_VAL_OBJ || tag == JS_VAL_ARR) {
-            /* Move rvalue to top of stack (it's at rv_pos, currently
-             * shadowed by the object). Swap so the rvalue sits at top.*/
-            int srct = jvs_tag[rv_pos];
-            double srcn = jvs_num[rv_pos];
-            int srcs_o = jvs_str_off[rv_pos];
-            int srcs_l = jvs_str_len[rv_pos];
-            int srco   = jvs_obj_idx[rv_pos];
-            int srcd   = jvs_dom_idx[rv_pos];
-            /* Top now is obj; we want rvalue on top so set_prop_from_top sees it. */
-            jvs_tag[obj_top]     = srct;
-            jvs_num[obj_top]     = srcn;
-            jvs_str_off[obj_top] = srcs_o;
-            jvs_str_len[obj_top] = srcs_l;
-            jvs_obj_idx[obj_top] = srco;
-            jvs_dom_idx[obj_top] = srcd;
-            js_obj_set_prop_from_top(oi, koff, klen);
-            jvs_top = rv_pos;        /* leave rvalue at original slot */
-            jvs_tag[rv_pos]     = srct;
-            jvs_num[rv_pos]     = srcn;
-            jvs_str_off[rv_pos] = srcs_o;
-            jvs_str_len[rv_pos] = srcs_l;
-            jvs_obj_idx[rv_pos] = srco;
-            jvs_dom_idx[rv_pos] = srcd;
-            jvs_top = rv_pos + 1;
-            return;
-        }
-        jvs_top = rv_pos + 1;
-        js_pop();
-        return;
-    }
-    if (kind == JS_NODE_INDEX) {
-        int rv_pos = jvs_top - 1;
-        js_eval_expr(jn_a[target_node]);
-        int obj_top = jvs_top - 1;
-        int otag = jvs_tag[obj_top];
-        int oi   = jvs_obj_idx[obj_top];
-        js_eval_expr(jn_b[target_node]);
-        int koff; int klen;
-        js_index_top_to_key(&koff, &klen);
-        jvs_top = obj_top + 1;       /* drop key, leave object on top */
-        if (otag == JS_VAL_OBJ || otag == JS_VAL_ARR) {
-            int srct = jvs_tag[rv_pos];
-            double srcn = jvs_num[rv_pos];
-            int srcs_o = jvs_str_off[rv_pos];
-            int srcs_l = jvs_str_len[rv_pos];
-            int srco   = jvs_obj_idx[rv_pos];
-            int srcd   = jvs_dom_idx[rv_pos];
-            jvs_tag[obj_top]     = srct;
-            jvs_num[obj_top]     = srcn;
-            jvs_str_off[obj_top] = srcs_o;
-            jvs_str_len[obj_top] = srcs_l;
-            jvs_obj_idx[obj_top] = srco;
-            jvs_dom_idx[obj_top] = srcd;
-            js_obj_set_prop_from_top(oi, koff, klen);
-            jvs_top = rv_pos + 1;
-            jvs_tag[rv_pos]     = srct;
-            jvs_num[rv_pos]     = srcn;
-            jvs_str_off[rv_pos] = srcs_o;
-            jvs_str_len[rv_pos] = srcs_l;
-            jvs_obj_idx[rv_pos] = srco;
-            jvs_dom_idx[rv_pos] = srcd;
-            return;
+/* obj.name = v (SETP at pc): slots t, t+1 hold obj, v; v is left in t. */
+void js_vm_setp(int pc, int t) {
+    int v = t + 1;
+    int tag = jvs_tag[t];
+    if (tag == JS_VAL_OBJ || tag == JS_VAL_ARR) {
+        int oi = jvs_obj_idx[t];
+        if (jbc_ic_obj[pc] == oi) {
+            js_prop_set_from(jbc_ic_prop[pc], v);
+        } else {
+            int p = js_obj_set_prop_at(oi, jbc_a[pc], jbc_b[pc], v);
+            if (p >= 0) { jbc_ic_obj[pc] = oi; jbc_ic_prop[pc] = p; }
         }
-        jvs_top = rv_pos + 1;
-        js_pop();
-        return;
-    }
-    js_set_err("js: assignment target unsupported");
+    } else if (tag == JS_VAL_DOMNODE) {
+        jsd_dom_prop_set(jvs_dom_idx[t], jbc_c[pc]);
+    } else if (tag == JS_VAL_STYLE) {
+        /* el.style.X = "..."; serialise into inline style attribute. */
+        char vbuf[256];
+        int vlen = js_to_string_at(v, vbuf, 256);
+        jsd_style_set(jvs_dom_idx[t], jbc_a[pc], jbc_b[pc], vbuf, vlen);
+    }
+    js_vs_copy(t, v);
+    jvs_top = t + 1;
 }
 
-void js_eval_assign(int node) {
-    int op = jn_a[node];
-    int lhs = jn_b[node];
-    int rhs = jn_c[node];
-    if (op == JS_TOK_ASSIGN) {
-        js_eval_expr(rhs);
-        /* duplicate top so assignment leaves the value on the stack */
-        js_copy_top_from(jvs_top - 1);
-        js_assign_to_target(lhs);
+/* obj[key]: slots t, t+1 hold obj, key; the value goes to t. */
+void js_vm_geti(int t) {
+    int tag = jvs_tag[t];
+    if (tag == JS_VAL_OBJ || tag == JS_VAL_ARR) {
+        int oi = jvs_obj_idx[t];
+        char kb[64];
+        int koff;
+        int kl = js_key_at(t + 1, kb, &koff);
+        jvs_top = t;
+        if (tag == JS_VAL_ARR && koff >= 0 && kl == 6 &&
+            b_streq_n(js_str_pool + koff, "length", 6)) {
+            js_push_num((double)jobj_arr_len[oi]);
+            return;
+        }
+        int p = js_key_find(oi, koff, kb, kl);
+        if (p >= 0) js_push_from_prop(p); else js_push_undef();
         return;
     }
-    /* compound assignment: load lhs, op with rhs, store, leave value */
-    js_eval_expr(lhs);
-    js_eval_expr(rhs);
-    int a = jvs_top - 2;
-    int b = jvs_top - 1;
-    double na = js_to_number_at(a);
-    double nb = js_to_number_at(b);
-    double r = na;
-    if (op == JS_TOK_PLUS_EQ) r = na + nb;
-    else if (op == JS_TOK_MINUS_EQ) r = na - nb;
-    else if (op == JS_TOK_STAR_EQ)  r = na * nb;
-    else if (op == JS_TOK_SLASH_EQ) {
-        if (js_dnz(nb) != 0) r = na / nb; else r = 0.0;
-    }
-    jvs_top = a;
-    js_push_num(r);
-    js_copy_top_from(jvs_top - 1);
-    js_assign_to_target(lhs);
+    jvs_top = t;
+    js_push_undef();
 }
 
-void js_eval_bin(int node) {
-    int op = jn_a[node];
-    int l = jn_b[node];
-    int r = jn_c[node];
-    /* Short-circuit operators evaluate one side first. */
-    if (op == JS_TOK_AND_AND) {
-        js_eval_expr(l);
-        if (!js_to_bool_at(jvs_top - 1)) return;
-        js_pop();
-        js_eval_expr(r);
-        return;
-    }
-    if (op == JS_TOK_OR_OR) {
-        js_eval_expr(l);
-        if (js_to_bool_at(jvs_top - 1)) return;
-        js_pop();
-        js_eval_expr(r);
-        return;
-    }
-    js_eval_expr(l);
-    js_eval_expr(r);
-    int a = jvs_top - 2;
-    int b = jvs_top - 1;
-    /* + with any string -> string concat */
-    if (op == JS_TOK_PLUS && (jvs_tag[a] == JS_VAL_STR || jvs_tag[b] == JS_VAL_STR)) {
-        char la[256]; char lb[256];
-        int al = js_to_string_at(a, la, 256);
-        int bl = js_to_string_at(b, lb, 256);
-        char joined[512];
-        int p = 0;
-        for (int i = 0; i < al && p < 511; i++) { joined[p] = la[i]; p = p + 1; }
-        for (int i = 0; i < bl && p < 511; i++) { joined[p] = lb[i]; p = p + 1; }
-        joined[p] = 0;
-        int off = js_str_intern(joined, p);
-        jvs_top = a;
-        js_push_str(off, p);
-        return;
-    }
-    if (op == JS_TOK_EQ_EQ || op == JS_TOK_EQ) {
-        int eq = (op == JS_TOK_EQ_EQ) ? js_strict_eq_at(a, b) : js_eq_at(a, b);
-        jvs_top = a; js_push_bool(eq); return;
-    }
-    if (op == JS_TOK_NEQ_EQ || op == JS_TOK_NEQ) {
-        int eq = (op == JS_TOK_NEQ_EQ) ? js_strict_eq_at(a, b) : js_eq_at(a, b);
-        jvs_top = a; js_push_bool(!eq); return;
-    }
-    double na = js_to_number_at(a);
-    double nb = js_to_number_at(b);
-    double v = 0.0;
-    int as_bool = 0;
-    int bv = 0;
-    if (op == JS_TOK_PLUS)        v = na + nb;
-    else if (op == JS_TOK_MINUS)  v = na - nb;
-    else if (op == JS_TOK_STAR)   v = na * nb;
-    else if (op == JS_TOK_SLASH)  {
-        if (js_dnz(nb) != 0) v = na / nb; else v = 0.0;
-    }
-    else if (op == JS_TOK_PERCENT) {
-        if (js_dnz(nb) != 0) {
-            int q = (int)(na / nb);
-            v = na - (double)q * nb;
-        } else v = 0.0;
+/* obj[key] = v: slots t..t+2 hold obj, key, v; v is left in t. */
+void js_vm_seti(int t) {
+    int k = t + 1;
+    int v = t + 2;
+    int tag = jvs_tag[t];
+    if (tag == JS_VAL_OBJ || tag == JS_VAL_ARR) {
+        int oi = jvs_obj_idx[t];
+        char kb[64];
+        int koff;
+        int kl = js_key_at(k, kb, &koff);
+        int p = js_key_find(oi, koff, kb, kl);
+        if (p >= 0) {
+            js_prop_set_from(p, v);
+        } else {
+            if (koff < 0) koff = js_str_new(kb, kl);
+            if (koff >= 0) js_obj_set_prop_at(oi, koff, kl, v);
+        }
+        if (tag == JS_VAL_ARR && jvs_tag[k] == JS_VAL_NUM) {
+            int i = (int)jvs_num[k];
+            if (i >= jobj_arr_len[oi]) jobj_arr_len[oi] = i + 1;
+        }
     }
-    else if (op == JS_TOK_LT) { as_bool = 1; bv = js_dcmp(na, nb) <  0; }
-    else if (op == JS_TOK_GT) { as_bool = 1; bv = js_dcmp(na, nb) >  0; }
-    else if (op == JS_TOK_LE) { as_bool = 1; bv = js_dcmp(na, nb) <= 0; }
-    else if (op == JS_TOK_GE) { as_bool = 1; bv = js_dcmp(na, nb) >= 0; }
-    jvs_top = a;
-    if (as_bool) js_push_bool(bv); else js_push_num(v);
+    js_vs_copy(t, v);
+    jvs_top = t + 1;
 }
 
-void js_eval_unary(int node) {
-    int op = jn_a[node];
-    int operand = jn_b[node];
-    js_eval_expr(operand);
-    int t = jvs_top - 1;
-    if (op == JS_TOK_NOT) {
-        int b = !js_to_bool_at(t);
-        jvs_top = t; js_push_bool(b); return;
-    }
-    if (op == JS_TOK_MINUS) {
-        double v = 0.0 - js_to_number_at(t);
-        jvs_top = t; js_push_num(v); return;
-    }
-    if (op == JS_TOK_PLUS) {
-        double v = js_to_number_at(t);
-        jvs_top = t; js_push_num(v); return;
-    }
-    if (op == JS_TOK_KW_TYPEOF) {
-        char *s = "undefined";
-        int tag = jvs_tag[t];
-        if (tag == JS_VAL_NUM)  s = "number";
-        else if (tag == JS_VAL_STR)  s = "string";
-        else if (tag == JS_VAL_BOOL) s = "boolean";
-        else if (tag == JS_VAL_NULL) s = "object";
-        else if (tag == JS_VAL_FUNC || tag == JS_VAL_NATIVE) s = "function";
-        else if (tag == JS_VAL_OBJ || tag == JS_VAL_ARR || tag == JS_VAL_DOMNODE) s = "object";
-        int sl = 0; while (s[sl]) sl = sl + 1;
-        int off = js_str_intern(s, sl);
-        jvs_top = t; js_push_str(off, sl); return;
+void js_vm_newarr(int n) {
+    int first = jvs_top - n;
+    int o = js_alloc_object(1);
+    if (o < 0) { jvs_top = first; js_push_undef(); return; }
+    char keybuf[16];
+    for (int i = 0; i < n; i++) {
+        int kn = js_format_int(i, keybuf);
+        int koff = js_str_intern(keybuf, kn);
+        js_obj_set_prop_at(o, koff, kn, first + i);
     }
+    jobj_arr_len[o] = n;
+    jvs_top = first;
+    js_push_arr(o);
 }
 
-void js_eval_inc(int node, int post) {
-    int op = jn_a[node];
-    int operand = jn_b[node];
-    if (jn_kind[operand] != JS_NODE_IDENT) {
-        js_set_err("js: ++/-- target must be identifier");
-        js_push_undef();
-        return;
-    }
-    int o = jn_a[operand]; int l = jn_b[operand];
-    int b = js_lookup_binding(jsc_cur, o, l);
-    if (b < 0) { js_set_err("js: undefined variable in ++/--"); js_push_undef(); return; }
-    double cur = (jb_tag[b] == JS_VAL_NUM) ? jb_num[b]
-               : (jb_tag[b] == JS_VAL_BOOL ? jb_num[b] : 0.0);
-    double next = (op == JS_TOK_PLUS_PLUS) ? cur + 1.0 : cur - 1.0;
-    if (post) js_push_num(cur); else js_push_num(next);
-    jb_tag[b] = JS_VAL_NUM;
-    jb_num[b] = next;
+/* Global binding for the GETG/SETG at pc, -1 if not defined yet. */
+int js_vm_global(int pc) {
+    int b = jbc_ic_obj[pc];
+    if (b >= 0) return b;
+    b = js_global_lookup(jbc_a[pc], jbc_b[pc]);
+    if (b >= 0) jbc_ic_obj[pc] = b;
+    return b;
 }
 
-void js_eval_expr(int node) {
-    if (node < 0) { js_push_undef(); return; }
-    if (js_last_error[0] != 0) { js_push_undef(); return; }
-    int k = jn_kind[node];
-    if (k == JS_NODE_NUM)   { js_push_num((double)jn_a[node]); return; }
-    if (k == JS_NODE_STR)   { js_push_str(jn_a[node], jn_b[node]); return; }
-    if (k == JS_NODE_BOOL)  { js_push_bool(jn_a[node]); return; }
-    if (k == JS_NODE_NULL)  { js_push_null(); return; }
-    if (k == JS_NODE_UNDEF) { js_push_undef(); return; }
-    if (k == JS_NODE_IDENT) {
-        int o = jn_a[node]; int l = jn_b[node];
-        int b = js_lookup_binding(jsc_cur, o, l);
-        if (b < 0) { js_push_undef(); return; }
-        js_push_from_binding(b); return;
-    }
-    if (k == JS_NODE_BIN)        { js_eval_bin(node); return; }
-    if (k == JS_NODE_UNARY)      { js_eval_unary(node); return; }
-    if (k == JS_NODE_ASSIGN)     { js_eval_assign(node); return; }
-    if (k == JS_NODE_PRE_INC)    { js_eval_inc(node, 0); return; }
-    if (k == JS_NODE_POST_INC)   { js_eval_inc(node, 1); return; }
-    if (k == JS_NODE_COND) {
-        js_eval_expr(jn_a[node]);
-        int b = js_to_bool_at(jvs_top - 1);
-        js_pop();
-        if (b) js_eval_expr(jn_b[node]); else js_eval_expr(jn_c[node]);
-        return;
-    }
-    if (k == JS_NODE_CALL) { js_eval_call(node); return; }
-    if (k == JS_NODE_FUNC_EXPR) {
-        int fn = js_alloc_function(jn_c[node], jn_d[node], jsc_cur);
-        if (fn < 0) { js_push_undef(); return; }
-        js_push_func(fn);
-        return;
-    }
-    if (k == JS_NODE_ARR_LIT) {
-        int o = js_alloc_object(1);
-        if (o < 0) { js_push_undef(); return; }
-        int e = jn_a[node];
-        int i = 0;
-        char keybuf[16];
-        while (e >= 0) {
-            js_eval_expr(e);
-            int kn = js_format_int(i, keybuf);
-            int koff = js_str_intern(keybuf, kn);
-            js_obj_set_prop_from_top(o, koff, kn);
-            js_pop();
-            i = i + 1;
-            e = jn_next[e];
+/* Binding `slot` of the environment `hops` levels above env. */
+int js_vm_upvalue(int env, int hops, int slot) {
+    int s = env;
+    while (hops > 0 && s > 0) { s = jsc_parent[s]; hops = hops - 1; }
+    return jsc_first[s] + slot;
+}
+
+/* Run bytecode from `entry` until END or an error. Ops are tested
+ * roughly in order of how often loop bodies execute them.*/
+void js_vm_run(int entry) {
+    int pc = entry;
+    int env = 0;
+    int eb = 0;
+    int base0 = jvs_top;
+    jcs_top = 0;
+    js_vm_loops = 0;
+    while (js_last_error[0] == 0) {
+        int op = jbc_op[pc];
+        if (op == JS_OP_GETL) { js_push_from_binding(eb + jbc_a[pc]); pc = pc + 1; continue; }
+        if (op == JS_OP_GETB) { js_push_from_binding(jbc_a[pc]); pc = pc + 1; continue; }
+        if (op == JS_OP_PUSH_NUM) { js_push_num(jk_num[jbc_a[pc]]); pc = pc + 1; continue; }
+        if (op == JS_OP_JCMP) {
+            int y = jvs_top - 1;
+            int x = y - 1;
+            double d = 0.0;
+            if (jvs_tag[x] == JS_VAL_NUM && jvs_tag[y] == JS_VAL_NUM) d = jvs_num[x] - jvs_num[y];
+            else d = js_to_number_at(x) - js_to_number_at(y);
+            jvs_top = x;
+            float f = (float)d;
+            int bits = *(int*)&f;
+            int s = 0;
+            if ((bits & 0x7FFFFFFF) != 0) s = (bits < 0) ? -1 : 1;
+            int tok = jbc_b[pc];
+            int holds = 0;
+            if (tok == JS_TOK_LT)      holds = s < 0;
+            else if (tok == JS_TOK_GT) holds = s > 0;
+            else if (tok == JS_TOK_LE) holds = s <= 0;
+            else                       holds = s >= 0;
+            if (holds) pc = pc + 1; else pc = jbc_a[pc];
+            continue;
         }
-        jobj_arr_len[o] = i;
-        js_push_arr(o);
-        return;
-    }
-    if (k == JS_NODE_OBJ_LIT) {
-        int o = js_alloc_object(0);
-        if (o < 0) { js_push_undef(); return; }
-        int prop = jn_a[node];
-        while (prop >= 0) {
-            int koff = jn_a[prop];
-            int klen = jn_b[prop];
-            int val = jn_c[prop];
-            js_eval_expr(val);
-            js_obj_set_prop_from_top(o, koff, klen);
-            js_pop();
-            prop = jn_next[prop];
+        if (op == JS_OP_INCL) { js_binding_inc(eb + jbc_a[pc], jbc_b[pc]); pc = pc + 1; continue; }
+        if (op == JS_OP_INCB) { js_binding_inc(jbc_a[pc], jbc_b[pc]); pc = pc + 1; continue; }
+        if (op == JS_OP_STL) {
+            js_binding_set_from(eb + jbc_a[pc], jvs_top - 1);
+            jvs_top = jvs_top - 1; pc = pc + 1; continue;
         }
-        js_push_obj(o);
-        return;
-    }
-    if (k == JS_NODE_MEMBER) {
-        js_eval_expr(jn_a[node]);
-        int t = jvs_top - 1;
-        int koff = jn_b[node]; int klen = jn_c[node];
-        int tag = jvs_tag[t];
-        /* arrays expose .length */
-        if (tag == JS_VAL_ARR && klen == 6 &&
-            js_str_eq(koff, klen, js_str_intern("length", 6), 6)) {
-            double n = (double)jobj_arr_len[jvs_obj_idx[t]];
-            jvs_top = t;
-            js_push_num(n);
-            return;
+        if (op == JS_OP_STB) {
+            js_binding_set_from(jbc_a[pc], jvs_top - 1);
+            jvs_top = jvs_top - 1; pc = pc + 1; continue;
         }
-        if (tag == JS_VAL_DOMNODE) {
-            int dom_idx = jvs_dom_idx[t];
-            jvs_top = t;
-            jsd_dom_member_get(dom_idx, koff, klen);
-            return;
+        if (op >= JS_OP_ADD && op <= JS_OP_GE) {
+            int a = jvs_top - 2;
+            if (jvs_tag[a] == JS_VAL_NUM && jvs_tag[a + 1] == JS_VAL_NUM && op <= JS_OP_MUL) {
+                double l = jvs_num[a];
+                double r = jvs_num[a + 1];
+                if (op == JS_OP_ADD)      jvs_num[a] = l + r;
+                else if (op == JS_OP_SUB) jvs_num[a] = l - r;
+                else                      jvs_num[a] = l * r;
+                jvs_top = a + 1;
+            } else {
+                js_vm_binop(op, a);
+            }
+            pc = pc + 1;
+            continue;
         }
-        if (tag == JS_VAL_STYLE) {
-            int dom_idx = jvs_dom_idx[t];
-            jvs_top = t;
-            jsd_style_get(dom_idx, koff, klen);
-            return;
+        if (op == JS_OP_LOOP) {
+            js_vm_loops = js_vm_loops + 1;
+            if (js_vm_loops > JS_LOOP_CAP) { js_set_err("js: loop iteration cap reached"); break; }
+            pc = jbc_a[pc];
+            continue;
         }
-        if (tag == JS_VAL_OBJ || tag == JS_VAL_ARR) {
-            int p = js_obj_find_prop(jvs_obj_idx[t], koff, klen);
-            jvs_top = t;
-            if (p >= 0) js_push_from_prop(p); else js_push_undef();
-            return;
+        if (op == JS_OP_JF) {
+            int b = js_to_bool_at(jvs_top - 1);
+            jvs_top = jvs_top - 1;
+            if (b) pc = pc + 1; else pc = jbc_a[pc];
+            continue;
         }
-        jvs_top = t;
-        js_push_undef();
-        return;
-    }
-    if (k == JS_NODE_INDEX) {
-        js_eval_expr(jn_a[node]);
-        int obj_top = jvs_top - 1;
-        js_eval_expr(jn_b[node]);
-        int koff; int klen;
-        js_index_top_to_key(&koff, &klen);
-        int tag = jvs_tag[obj_top];
-        int oi = jvs_obj_idx[obj_top];
-        jvs_top = obj_top;
-        if (tag == JS_VAL_OBJ || tag == JS_VAL_ARR) {
-            if (tag == JS_VAL_ARR && klen == 6 &&
-                js_str_eq(koff, klen, js_str_intern("length", 6), 6)) {
-                js_push_num((double)jobj_arr_len[oi]);
-                return;
+        if (op == JS_OP_JMP) { pc = jbc_a[pc]; continue; }
+        if (op == JS_OP_GETP) { js_vm_getp(pc, jvs_top - 1); pc = pc + 1; continue; }
+        if (op == JS_OP_SETP) { js_vm_setp(pc, jvs_top - 2); pc = pc + 1; continue; }
+        if (op == JS_OP_POP)  { js_pop(); pc = pc + 1; continue; }
+        if (op == JS_OP_PUSH_STR) { js_push_str(jbc_a[pc], jbc_b[pc]); pc = pc + 1; continue; }
+        if (op == JS_OP_SETL) { js_binding_set_from(eb + jbc_a[pc], jvs_top - 1); pc = pc + 1; continue; }
+        if (op == JS_OP_SETB) { js_binding_set_from(jbc_a[pc], jvs_top - 1); pc = pc + 1; continue; }
+        if (op == JS_OP_GETM) {
+            int t = jvs_top - 1;
+            int tag = jvs_tag[t];
+            if (tag == JS_VAL_OBJ || tag == JS_VAL_ARR) {
+                int p = js_vm_prop(pc, jvs_obj_idx[t]);
+                if (p >= 0) js_push_from_prop(p); else js_push_undef();
+            } else if (tag == JS_VAL_DOMNODE) {
+                jsd_dom_prop_get(jvs_dom_idx[t], jbc_c[pc]);
+            } else {
+                js_push_undef();
             }
-            int p = js_obj_find_prop(oi, koff, klen);
-            if (p >= 0) js_push_from_prop(p); else js_push_undef();
-            return;
+            pc = pc + 1;
+            continue;
         }
-        js_push_undef();
-        return;
-    }
-    js_set_err("js: unsupported expression");
-    js_push_undef();
-}
-
-/* statements */
-void js_exec_block(int block_node) {
-    if (block_node < 0) return;
-    int s = jn_a[block_node];
-    while (s >= 0 && js_ctrl_signal == 0 && js_last_error[0] == 0) {
-        js_eval_stmt(s);
-        s = jn_next[s];
-    }
-}
-
-void js_eval_stmt(int node) {
-    if (node < 0) return;
-    if (js_last_error[0] != 0) return;
-    int k = jn_kind[node];
-    if (k == JS_NODE_BLOCK) { js_exec_block(node); return; }
-    if (k == JS_NODE_EXPR_STMT) {
-        js_eval_expr(jn_a[node]);
-        js_pop();
-        return;
-    }
-    if (k == JS_NODE_VAR_DECL) {
-        int d = jn_a[node];
-        while (d >= 0) {
-            int o = jn_a[d]; int l = jn_b[d]; int init = jn_c[d];
-            int b = js_lookup_binding(jsc_cur, o, l);
-            if (b < 0) b = js_binding_alloc(jsc_cur, o, l);
-            if (init >= 0 && b >= 0) {
-                js_eval_expr(init);
-                js_binding_set_from_top(b);
-                js_pop();
+        if (op == JS_OP_CALL || op == JS_OP_CALLM) {
+            int argc = jbc_a[pc];
+            int fslot = jvs_top - argc - 1;
+            int base = fslot;
+            if (op == JS_OP_CALLM) base = fslot - 1;
+            int ctag = jvs_tag[fslot];
+            if (ctag == JS_VAL_FUNC) {
+                int fn = jvs_obj_idx[fslot];
+                int ne = js_vm_enter(fn, fslot + 1, argc, base, pc + 1, env);
+                if (ne < 0) break;
+                env = ne;
+                eb = jsc_first[ne];
+                pc = jpr_code[jfn_proto[fn]];
+                continue;
+            }
+            if (ctag == JS_VAL_NATIVE) {
+                if (op == JS_OP_CALLM) {
+                    jsd_this_tag     = jvs_tag[base];
+                    jsd_this_dom_idx = jvs_dom_idx[base];
+                    jsd_this_obj_idx = jvs_obj_idx[base];
+                } else {
+                    jsd_this_tag = JS_VAL_UNDEF;
+                    jsd_this_dom_idx = -1;
+                    jsd_this_obj_idx = -1;
+                }
+                js_native_call(jvs_native_id[fslot], argc);
+                js_vs_copy(base, jvs_top - 1);
+                jvs_top = base + 1;
+                pc = pc + 1;
+                continue;
             }
-            d = jn_next[d];
+            jvs_top = base;
+            js_set_err("js: callee is not a function");
+            break;
         }
-        return;
-    }
-    if (k == JS_NODE_IF) {
-        js_eval_expr(jn_a[node]);
-        int b = js_to_bool_at(jvs_top - 1);
-        js_pop();
-        if (b) js_eval_stmt(jn_b[node]);
-        else if (jn_c[node] >= 0) js_eval_stmt(jn_c[node]);
-        return;
-    }
-    if (k == JS_NODE_WHILE) {
-        int guard = 0;
-        while (guard < 100000) {
-            js_eval_expr(jn_a[node]);
+        if (op == JS_OP_RET) {
+            int f = jcs_top - 1;
+            if (f < 0) break;
+            int base = jcs_base[f];
+            js_vs_copy(base, jvs_top - 1);
+            jvs_top = base + 1;
+            if (jcs_sc[f] >= js_env_keep_sc && jcs_b[f] >= js_env_keep_b) {
+                jsc_top = jcs_sc[f];
+                jb_count = jcs_b[f];
+            }
+            pc = jcs_pc[f];
+            env = jcs_env[f];
+            eb = jsc_first[env];
+            jcs_top = f;
+            continue;
+        }
+        if (op == JS_OP_GETU) {
+            js_push_from_binding(js_vm_upvalue(env, jbc_a[pc], jbc_b[pc]));
+            pc = pc + 1;
+            continue;
+        }
+        if (op == JS_OP_SETU || op == JS_OP_STU) {
+            js_binding_set_from(js_vm_upvalue(env, jbc_a[pc], jbc_b[pc]), jvs_top - 1);
+            if (op == JS_OP_STU) jvs_top = jvs_top - 1;
+            pc = pc + 1;
+            continue;
+        }
+        if (op == JS_OP_GETG) {
+            int b = js_vm_global(pc);
+            if (b >= 0) js_push_from_binding(b); else js_push_undef();
+            pc = pc + 1;
+            continue;
+        }
+        if (op == JS_OP_SETG) {
+            /* Assigning an undeclared name creates a global. */
+            int b = js_vm_global(pc);
+            if (b < 0) b = js_global_define(jbc_a[pc], jbc_b[pc]);
+            if (b >= 0) js_binding_set_from(b, jvs_top - 1);
+            pc = pc + 1;
+            continue;
+        }
+        if (op == JS_OP_GETI) { js_vm_geti(jvs_top - 2); pc = pc + 1; continue; }
+        if (op == JS_OP_SETI) { js_vm_seti(jvs_top - 3); pc = pc + 1; continue; }
+        if (op >= JS_OP_EQ && op <= JS_OP_SNE) { js_vm_binop(op, jvs_top - 2); pc = pc + 1; continue; }
+        if (op == JS_OP_JFK || op == JS_OP_JTK) {
             int b = js_to_bool_at(jvs_top - 1);
-            js_pop();
-            if (!b) break;
-            js_eval_stmt(jn_b[node]);
-            if (js_ctrl_signal == 1) { js_ctrl_signal = 0; break; }
-            if (js_ctrl_signal == 2) { js_ctrl_signal = 0; }
-            if (js_ctrl_signal == 3) break;
-            if (js_last_error[0] != 0) break;
-            guard = guard + 1;
+            if (op == JS_OP_JFK) b = !b;
+            if (b) { pc = jbc_a[pc]; continue; }
+            jvs_top = jvs_top - 1;
+            pc = pc + 1;
+            continue;
         }
-        if (guard >= 100000) js_set_err("js: while loop iteration cap reached");
-        return;
-    }
-    if (k == JS_NODE_FOR) {
-        if (jn_a[node] >= 0) js_eval_stmt(jn_a[node]);
-        int guard = 0;
-        while (guard < 100000) {
-            int b = 1;
-            if (jn_b[node] >= 0) {
-                js_eval_expr(jn_b[node]);
-                b = js_to_bool_at(jvs_top - 1);
-                js_pop();
-            }
-            if (!b) break;
-            js_eval_stmt(jn_d[node]);
-            if (js_ctrl_signal == 1) { js_ctrl_signal = 0; break; }
-            if (js_ctrl_signal == 2) { js_ctrl_signal = 0; }
-            if (js_ctrl_signal == 3) break;
-            if (js_last_error[0] != 0) break;
-            if (jn_c[node] >= 0) {
-                js_eval_expr(jn_c[node]);
-                js_pop();
-            }
-            guard = guard + 1;
+        if (op == JS_OP_DUP) { js_copy_top_from(jvs_top - 1); pc = pc + 1; continue; }
+        if (op == JS_OP_DUP2) {
+            js_copy_top_from(jvs_top - 2);
+            js_copy_top_from(jvs_top - 2);
+            pc = pc + 1;
+            continue;
         }
-        if (guard >= 100000) js_set_err("js: for loop iteration cap reached");
-        return;
-    }
-    if (k == JS_NODE_BREAK)    { js_ctrl_signal = 1; return; }
-    if (k == JS_NODE_CONTINUE) { js_ctrl_signal = 2; return; }
-    if (k == JS_NODE_RETURN) {
-        if (jn_a[node] >= 0) js_eval_expr(jn_a[node]); else js_push_undef();
-        js_ctrl_signal = 3;
-        return;
-    }
-    if (k == JS_NODE_FUNC_DECL) {
-        int fn = js_alloc_function(jn_c[node], jn_d[node], jsc_cur);
-        if (fn < 0) return;
-        int o = jn_a[node]; int l = jn_b[node];
-        if (o >= 0 && l > 0) {
-            int b = js_lookup_binding(jsc_cur, o, l);
-            if (b < 0) b = js_binding_alloc(jsc_cur, o, l);
-            if (b >= 0) {
-                jb_tag[b]      = JS_VAL_FUNC;
-                jb_num[b]      = 0.0;
-                jb_obj_idx[b]  = fn;
-            }
+        if (op == JS_OP_TONUM || op == JS_OP_NEG) {
+            int t = jvs_top - 1;
+            double v = js_to_number_at(t);
+            if (op == JS_OP_NEG) v = 0.0 - v;
+            jvs_top = t;
+            js_push_num(v);
+            pc = pc + 1;
+            continue;
         }
-        return;
+        if (op == JS_OP_NOT) {
+            int t = jvs_top - 1;
+            int b = !js_to_bool_at(t);
+            jvs_top = t;
+            js_push_bool(b);
+            pc = pc + 1;
+            continue;
+        }
+        if (op == JS_OP_TYPEOF) { js_vm_typeof(jvs_top - 1); pc = pc + 1; continue; }
+        if (op == JS_OP_PUSH_BOOL)  { js_push_bool(jbc_a[pc]); pc = pc + 1; continue; }
+        if (op == JS_OP_PUSH_UNDEF) { js_push_undef(); pc = pc + 1; continue; }
+        if (op == JS_OP_PUSH_NULL)  { js_push_null(); pc = pc + 1; continue; }
+        if (op == JS_OP_LOG) {
+            int argc = jbc_a[pc];
+            js_console_log_top_n(argc);
+            jvs_top = jvs_top - argc;
+            js_push_undef();
+            pc = pc + 1;
+            continue;
+        }
+        if (op == JS_OP_CLOSURE) {
+            int fn = js_alloc_function(jbc_a[pc], env);
+            if (fn < 0) break;
+            js_env_pin();
+            js_push_func(fn);
+            pc = pc + 1;
+            continue;
+        }
+        if (op == JS_OP_NEWOBJ) {
+            int o = js_alloc_object(0);
+            if (o < 0) break;
+            js_push_obj(o);
+            pc = pc + 1;
+            continue;
+        }
+        if (op == JS_OP_INITP) {
+            int t = jvs_top - 1;
+            js_obj_set_prop_at(jvs_obj_idx[t - 1], jbc_a[pc], jbc_b[pc], t);
+            jvs_top = t;
+            pc = pc + 1;
+            continue;
+        }
+        if (op == JS_OP_NEWARR) { js_vm_newarr(jbc_a[pc]); pc = pc + 1; continue; }
+        if (op == JS_OP_END) break;
+        js_set_err("js: bad opcode");
     }
-}
-
-void js_exec_program(int root) {
-    if (root < 0) return;
-    /* Allocate (or re-use) the root scope. */
-    if (jsc_top == 0) jsc_cur = js_scope_enter(-1);
-    int s = jn_a[root];
-    while (s >= 0 && js_last_error[0] == 0) {
-        js_eval_stmt(s);
-        if (js_ctrl_signal == 3) break;        /* top-level return is rare but safe */
-        s = jn_next[s];
+    /* An error can leave calls open; drop their environments. */
+    if (jcs_top > 0 && jcs_sc[0] >= js_env_keep_sc && jcs_b[0] >= js_env_keep_b) {
+        jsc_top = jcs_sc[0];
+        jb_count = jcs_b[0];
     }
+    jcs_top = 0;
+    jvs_top = base0;
 }
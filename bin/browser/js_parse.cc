@@ -600,8 +600,24 @@ void js_reset_per_page() {
     jtk_count = 0;
     jn_count = 0;
     js_str_pool_pos = 0;
+    js_str_dyn_off = -1;
     js_script_count = 0;
     js_last_error[0] = 0;
+    /* Runtime state of the previous page's scripts. */
+    jvs_top = 0;
+    jb_count = 0;
+    jsc_top = 0;
+    jfn_count = 0;
+    jobj_count = 0;
+    jp_count = 0;
+    jbc_count = 0;
+    jk_count = 0;
+    jpr_count = 0;
+    jsg_count = 0;
+    jcs_top = 0;
+    js_env_keep_sc = 0;
+    js_env_keep_b = 0;
+    jsd_id_cache_clear();
 }
 
 void js_queue_script(int off, int len) {
@@ -612,26 +628,35 @@ void js_queue_script(int off, int len) {
 }
 
 int js_run(char *src, int len) {
-    /* Per-script reset of token/AST pools so successive scripts don't
-     * stack into a single pool. js_str_pool persists for the page so
-     * later scripts can reference earlier literals.*/
+    /* Per-script reset of token pool so successive scripts don't
+     * stack into a single pool. js_str_pool, the AST and the bytecode
+     * persist for the page so later scripts can reference earlier
+     * literals and call earlier scripts' functions.*/
     jtk_count = 0;
     int saved_jn = jn_count;
+    int saved_bc = jbc_count;
     js_last_error[0] = 0;
-    js_ctrl_signal = 0;
     js_tokenize(src, len);
     int root = js_parse();
     if (js_last_error[0] != 0) {
         serial_printf("[js] parse error: %s\n", js_last_error);
         return -1;
     }
-    serial_printf("[js] === script (%d tokens, %d nodes) ===\n",
-                  jtk_count, jn_count - saved_jn);
-    js_exec_program(root);
+    int entry = js_compile_program(root);
+    if (entry < 0) {
+        serial_printf("[js] compile error: %s\n", js_last_error);
+        return -1;
+    }
+    serial_printf("[js] === script (%d tokens, %d nodes, %d ops) ===\n",
+                  jtk_count, jn_count - saved_jn, jbc_count - saved_bc);
+    int t0 = uptime_ms();
+    js_vm_run(entry);
+    int dt = uptime_ms() - t0;
     if (js_last_error[0] != 0) {
-        serial_printf("[js] runtime error: %s\n", js_last_error);
+        serial_printf("[js] runtime error: %s (after %d ms)\n", js_last_error, dt);
         return -1;
     }
+    serial_printf("[js] script done in %d ms\n", dt);
     return 0;
 }
 
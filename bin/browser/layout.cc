@@ -332,17 +332,22 @@ void emit_text_atoms(int rt_text_n, int parent_rt) {
      * behind the inline link text (background-color is non-inherited, so
      * the text node's own cs_bg stays -1). Block ancestors paint their
      * own background through paint_rt_box_decoration; stop the walk there
-     * to avoid double-painting a block fill behind every word.*/
+     * to avoid double-painting a block fill behind every word. An
+     * absolutely positioned inline is blockified, so the walk ends
+     * there too.*/
     int p = rt_text_n;
+    int bg_done = 0;
     while (p >= 0) {
         if (rt_link_idx[p] >= 0 && link_idx < 0) link_idx = rt_link_idx[p];
-        if (bg < 0 && p != rt_text_n) {
+        if (bg < 0 && !bg_done && p != rt_text_n) {
             int kp = rt_kind[p];
             if (kp != RT_INLINE && kp != RT_TEXT) break;
             int cs_p = rt_style[p];
             if (cs_bg[cs_p] >= 0) bg = cs_bg[cs_p];
+            if (cs_position[cs_p] == POS_ABSOLUTE ||
+                cs_position[cs_p] == POS_FIXED) bg_done = 1;
         }
-        if (link_idx >= 0 && bg >= 0) break;
+        if (link_idx >= 0 && (bg >= 0 || bg_done)) break;
         p = rt_parent[p];
     }
 
@@ -417,7 +422,7 @@ void emit_text_atoms(int rt_text_n, int parent_rt) {
             if (c == ' ' || c == '\t' || c == '\n' || c == '\r') { i++; saw_ws = 1; }
             else break;
         }
-        if (saw_ws && la_count > 0 && la_count < MAX_LINE_ATOMS) {
+        if (saw_ws && la_count > la_run_first && la_count < MAX_LINE_ATOMS) {
             /* Inter-word space atom: text_len=1, text_off pointing at a literal " ". */
             la_text_off[la_count] = attr_intern(" ", 1);
             la_text_len[la_count] = 1;
@@ -502,13 +507,40 @@ void shrink_to_fit_inline_block(int n) {
     int fc = rt_first_child[n];
     if (fc < 0) return;
     if (rt_kind[fc] != RT_TEXT) return;
-    if (rt_next[fc] >= 0) return;
+    /* Line boxes from the previous layout don't count as content. */
+    if (rt_next[fc] >= 0 && rt_kind[rt_next[fc]] != RT_LINE_BOX) return;
     int csz = cs_font_size_px[sty];
     int chw = 8;
     if (csz > 0) chw = csz / 2 + 1;
     cs_width[sty] = rt_text_len[fc] * chw;
 }
 
+/* Lay out the inline-blocks in inline subtree n as mini blocks. Runs
+ * before the parent opens its atom pile: the inline-block's own line
+ * boxes draw atoms from the same pool, and laying it out mid-run would
+ * splice them into the parent's pile (painted twice, and repositioned
+ * by the parent's lines). An inline-block is its own BFC (CSS 2.1
+ * §9.4.1), so outer floats are hidden meanwhile.*/
+void layout_inline_blocks(int n) {
+    int kind = rt_kind[n];
+    if (kind == RT_INLINE) {
+        int c = rt_first_child[n];
+        while (c >= 0) {
+            layout_inline_blocks(c);
+            c = rt_next[c];
+        }
+        return;
+    }
+    if (kind != RT_INLINE_BLOCK) return;
+    int saved_visible = float_visible_first;
+    int saved_count   = float_count;
+    float_visible_first = float_count;
+    shrink_to_fit_inline_block(n);
+    layout_block(n, viewport_content_w());
+    float_visible_first = saved_visible;
+    float_count         = saved_count;
+}
+
 void collect_inline_atoms(int n) {
     int kind = rt_kind[n];
     if (kind == RT_TEXT) {
@@ -524,13 +556,8 @@ void collect_inline_atoms(int n) {
         return;
     }
     if (kind == RT_INLINE_BLOCK || kind == RT_REPLACED) {
-        /* For replaced/inline-block: lay out as a mini block, then atom carries
-         * the resulting w/h.*/
-        int avail = viewport_content_w();
-        if (kind == RT_INLINE_BLOCK) {
-            shrink_to_fit_inline_block(n);
-            layout_block(n, avail);
-        }
+        /* For replaced/inline-block the atom carries the box's w/h;
+         * inline-blocks were laid out by layout_inline_blocks.*/
         int w = (rt_intrinsic_w[n] > 0) ? rt_intrinsic_w[n] : rt_w[n];
         int h = (rt_intrinsic_h[n] > 0) ? rt_intrinsic_h[n] : rt_h[n];
         /* Stamp the resolved size on the node now so hit_test (which
@@ -699,7 +726,34 @@ void flush_inline(int parent, int *atom_pile_first, int *atom_pile_count,
     *atom_pile_count = 0;
 }
 
+/* Block layout entry point. In an incremental pass (run_layout_dirty) a
+ * box that is not marked dirty, was last laid out at the same avail
+ * width, and neither saw nor leaked a float would come out the same, so
+ * its subtree - line boxes included - is kept and only its size handed
+ * back. Positions are parent-relative and callers place the box after
+ * this returns, so a kept subtree moves with it. Table rows and flex
+ * containers resize children after layout; rt_laid_w/h undo that.*/
 void layout_block(int n, int avail_w) {
+    if (layout_incremental && !rt_needs_layout[n] && rt_laid_ok[n] &&
+        rt_laid_avail[n] == avail_w && float_count == float_visible_first) {
+        rt_w[n] = rt_laid_w[n];
+        rt_h[n] = rt_laid_h[n];
+        layout_stat_kept = layout_stat_kept + 1;
+        return;
+    }
+    int saw_float = (float_count != float_visible_first);
+    int float_count0 = float_count;
+    rt_free_line_boxes(n);
+    layout_block_box(n, avail_w);
+    rt_laid_avail[n] = avail_w;
+    rt_laid_w[n] = rt_w[n];
+    rt_laid_h[n] = rt_h[n];
+    rt_laid_ok[n] = (!saw_float && float_count == float_count0);
+    rt_needs_layout[n] = 0;
+    layout_stat_laid = layout_stat_laid + 1;
+}
+
+void layout_block_box(int n, int avail_w) {
     /* Resolve width. CSS box-sizing module:
      *   content-box (default): cs_width describes the CONTENT box.
      *   border-box:            cs_width describes the BORDER box, so
@@ -816,6 +870,19 @@ void layout_block(int n, int avail_w) {
      *   - self-collapsing block: a block with no in-flow content and zero
      *     padding/border combines its own top + bottom margins together.
      * Floats and clearance break collapse: deferred to B2.*/
+    {
+        int c = rt_first_child[n];
+        while (c >= 0) {
+            int k = rt_kind[c];
+            int c_sty = rt_style[c];
+            if ((k == RT_INLINE || k == RT_INLINE_BLOCK) &&
+                cs_position[c_sty] != POS_ABSOLUTE && cs_position[c_sty] != POS_FIXED &&
+                cs_float[c_sty] != FLOAT_LEFT && cs_float[c_sty] != FLOAT_RIGHT) {
+                layout_inline_blocks(c);
+            }
+            c = rt_next[c];
+        }
+    }
     int pile_first = la_count;
     int pile_count = 0;
     int pend_pos = 0;
@@ -1098,7 +1165,10 @@ void layout_block(int n, int avail_w) {
             saved_neg = pend_neg;
             last_was_block = 1;
         } else {
-            /* Inline / text / inline-block / replaced: accumulate as atoms */
+            /* Inline / text / inline-block / replaced: accumulate as atoms.
+             * A new run starts past anything block children appended. */
+            if (pile_count == 0) pile_first = la_count;
+            la_run_first = pile_first;
             collect_inline_atoms(c);
             pile_count = la_count - pile_first;
         }
@@ -1248,6 +1318,12 @@ void layout_oof_one(int oof) {
     int sty = rt_style[oof];
     int pos = cs_position[sty];
     if (pos != POS_ABSOLUTE && pos != POS_FIXED) return;
+    /* The in-flow pass never places this box, so its static position is
+     * its parent's origin. Drop the doc-space rect a previous pass left
+     * here, or an incremental relayout would take it as the offset.*/
+    rt_x[oof] = 0;
+    rt_y[oof] = 0;
+    rt_is_oof[oof] = 0;
 
     int cb_x = 0;
     int cb_y = 0;
@@ -1301,11 +1377,8 @@ void layout_oof_one(int oof) {
     }
     /* When width is auto AND we have at most one of left/right, do a
      * shrink-to-fit pre-measurement: walk the subtree's text content
-     * to estimate intrinsic width, then lay out ONCE at that width.
-     * (Doing it as a re-layout would orphan the first pass's
-     * line-box children on rt_first_child[oof] alongside the new ones,
-     * since layout_block is purely additive - paint would then walk
-     * both and double-render the text.)
+     * to estimate intrinsic width, then lay out ONCE at that width
+     * rather than laying out twice.
      * Reference: blink/Source/core/rendering/RenderBox.cpp
      * shrinkToFitWidth + computePreferredLogicalWidths.*/
     int extra_w_self = rt_padding_l(oof) + rt_padding_r(oof)
@@ -1365,6 +1438,10 @@ void layout_oof(void) {
 void run_layout() {
     if (rt_count == 0) return;
     int root = 0;
+    /* Every box is laid out again, so every atom slice is rebuilt. */
+    la_count = 0;
+    layout_incremental = 0;
+    layout_root_count = 0;
     /* Root sits at document origin (0,0). rt_screen_x/y in paint.cc add
      * viewport_x()/viewport_y() at paint time. Float list resets per
      * layout pass; placement happens in document-relative coordinates
@@ -1377,6 +1454,117 @@ void run_layout() {
     layout_block(root, avail);
     layout_oof();
     doc_h = rt_y[root] + rt_h[root];
+    paint_invalidate_list();
+    paint_invalidate_all();
+}
+
+/* Nearest box whose own rect bounds the change to `n`: inline-level
+ * boxes live in their block's line boxes, so the block is what moves.*/
+int layout_damage_box(int n) {
+    while (n >= 0) {
+        int k = rt_kind[n];
+        int inl = (k == RT_INLINE || k == RT_TEXT || k == RT_INLINE_BLOCK ||
+                   k == RT_LINE_BOX ||
+                   (k == RT_REPLACED && cs_display[rt_style[n]] != DISP_BLOCK));
+        if (!inl) return n;
+        n = rt_parent[n];
+    }
+    return 0;
+}
+
+/* Mark box n for relayout: n and every ancestor get rt_needs_layout, and
+ * the box bounding the change is remembered with the screen band it
+ * covers now, so the repaint can cover both old and new geometry.*/
+void layout_mark_dirty(int n) {
+    if (n < 0) return;
+    int b = layout_damage_box(n);
+    /* Inline boxes are never passed to layout_block and keep the bit
+     * from rt_alloc, so a set bit says nothing about the ancestors:
+     * walk the whole chain.*/
+    int p = n;
+    while (p >= 0) {
+        rt_needs_layout[p] = 1;
+        p = rt_parent[p];
+    }
+    for (int k = 0; k < layout_root_count; k = k + 1) {
+        if (layout_root[k] == b) return;
+    }
+    if (layout_root_count >= LAYOUT_ROOTS_MAX) {
+        layout_root_count = LAYOUT_ROOTS_MAX + 1;   /* too many: repaint all */
+        return;
+    }
+    int y0;
+    int y1;
+    paint_rt_band(b, &y0, &y1);
+    layout_root[layout_root_count] = b;
+    layout_root_y0[layout_root_count] = y0;
+    layout_root_y1[layout_root_count] = y1;
+    layout_root_w[layout_root_count] = rt_w[b];
+    layout_root_h[layout_root_count] = rt_h[b];
+    layout_root_count = layout_root_count + 1;
+}
+
+/* Relayout after layout_mark_dirty. Same walk from the root as
+ * run_layout, but layout_block keeps clean subtrees, so the cost follows
+ * the dirty spine and the blocks whose line boxes it touches. Kept
+ * line boxes pin their atom slices, so new atoms append; once the pool
+ * is three-quarters spent a full pass compacts it. Repaint is limited
+ * to the dirty bands when no box changed size, since only then does
+ * nothing else on the page move.*/
+void run_layout_dirty() {
+    if (rt_count == 0) return;
+    if (la_count > (MAX_LINE_ATOMS * 3) / 4 ||
+        layout_root_count > LAYOUT_ROOTS_MAX) {
+        run_layout();
+        return;
+    }
+    int root = 0;
+    int old_doc_h = doc_h;
+    layout_stat_laid = 0;
+    layout_stat_kept = 0;
+    layout_incremental = 1;
+    float_count = 0;
+    float_visible_first = 0;
+    layout_block(root, viewport_content_w());
+    layout_oof();
+    layout_incremental = 0;
+    doc_h = rt_y[root] + rt_h[root];
+    paint_invalidate_list();
+    int moved = (doc_h != old_doc_h);
+    for (int k = 0; k < layout_root_count && !moved; k = k + 1) {
+        int b = layout_root[k];
+        if (rt_w[b] != layout_root_w[k] || rt_h[b] != layout_root_h[k]) moved = 1;
+    }
+    if (moved) {
+        paint_invalidate_all();
+    } else {
+        for (int k = 0; k < layout_root_count; k = k + 1) {
+            int y0;
+            int y1;
+            paint_rt_band(layout_root[k], &y0, &y1);
+            if (layout_root_y0[k] < y0) y0 = layout_root_y0[k];
+            if (layout_root_y1[k] > y1) y1 = layout_root_y1[k];
+            paint_invalidate_band(y0, y1);
+        }
+    }
+    layout_root_count = 0;
+}
+
+/* Bring styles, boxes and pixels up to date after n_style_dirty marks,
+ * going only as far as the restyle reaches: nothing, a repaint, a
+ * partial relayout, or a rebuilt box tree.*/
+void run_dirty_update() {
+    int change = style_resolve_dirty();
+    if (change == STYLE_CHANGE_TREE) {
+        build_render_tree();
+        run_layout();
+        clamp_scroll();
+        return;
+    }
+    if (change == STYLE_CHANGE_LAYOUT) {
+        run_layout_dirty();
+        clamp_scroll();
+    }
 }
 
 /* CSS Flexible Box Layout Module (single-line, no wrap).
@@ -1537,12 +1725,10 @@ void layout_flex(int n, int content_w, int cx, int cy) {
         int it = items[i];
         if (is_col) {
             /* Pass 1 (auto-basis branch above) already laid out the item
-             * and recorded base[i] = rt_h. Re-running layout_block here
-             * would append a SECOND set of RT_LINE_BOX children to the
-             * same node, and paint draws both -> duplicated/overlapping
-             * text ("525" rendered as "52525"). Only re-layout when
+             * and recorded base[i] = rt_h. Only re-layout when
              * flex-grow/shrink actually changed the main size; otherwise
-             * keep the dimensions pass 1 computed.*/
+             * keep the dimensions pass 1 computed rather than laying the
+             * whole subtree out a second time.*/
             if (final_main[i] != base[i]) {
                 int item_w = (cs_width[rt_style[it]] >= 0)
                            ? cs_width[rt_style[it]]
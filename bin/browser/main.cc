@@ -5,6 +5,10 @@ enum {
     SOL_TLS    = 1,
     TLS_ENABLE = 1,
 
+    /* kdeflate_stream_new wrappers (kernel/gfx/deflate.h) */
+    KDEFLATE_WRAP_GZIP = 2,
+    KDEFLATE_WRAP_AUTO = 3,
+
     WIN_W      = 600,
     WIN_H      = 420,
     WIN_X      = 20,
@@ -22,6 +26,21 @@ enum {
     REQ_MAX         = 4096,
     RECV_BUF_SIZE   = 4096,
 
+    /* net.cc keep-alive pool + concurrent transfers. Transfer slot 0 is
+     * fetch_url's; 1..NET_XFER_MAX-1 are net_async_start's.*/
+    NET_POOL_MAX     = 8,
+    NET_PER_ORIGIN   = 4,
+    NET_XFER_MAX     = 7,
+    NET_IDLE_MS      = 15000,
+    NET_STALL_MS     = 30000,
+    NET_POLL_RECVS   = 32,
+    TCPS_ESTABLISHED = 4,
+
+    /* http_cache_lookup results (kernel/network/http_cache.h) */
+    HTTP_CACHE_FRESH = 1,
+    HTTP_CACHE_STALE = 2,
+    NET_CACHE_HDR_MAX = 1024,
+
     MAX_NODES = 4096,
     MAX_LINKS = 1024,
     MAX_INPUTS = 64,
@@ -34,10 +53,22 @@ enum {
     MAX_TOKENS = 16384,
     MAX_ATTR_PAIRS = 8192,
 
+    /* Progressive rendering while the page downloads: first partial
+     * paint once this much has arrived, then at most one per interval.*/
+    PARSE_FIRST_PAINT_BYTES = 4096,
+    PARSE_PAINT_MS = 250,
+
     /* §3 render tree pool */
     MAX_RT_NODES = 6144,
     MAX_LINE_ATOMS = 8192,
 
+    /* §6 display list: items are indexed by DL_BAND_H-tall bands of the
+     * page so a repaint visits only the bands it overlaps.*/
+    DL_BAND_H = 256,
+    MAX_DL_BANDS = 1024,
+    MAX_DL_REFS = 16384,
+    MAX_DL_CLIPS = 256,
+
     /* §2 style/CSS - css rule + value-pool caps doubled for real-world
      * stylesheets which routinely exceed the original 256/32K caps.
      * MAX_COMPUTED_STYLES tracks MAX_NODES (one entry per styled DOM
@@ -225,6 +256,26 @@ enum {
 
     MAX_CSS_SELECTORS = 2048,
 
+    /* §2 rule index + ancestor filter (style.cc). Key kinds salt the
+     * hash so id "x", class "x" and a tag never share a key.*/
+    STYLE_BUCKETS = 256,
+    STYLE_KEY_ID = 1,
+    STYLE_KEY_CLASS = 2,
+    STYLE_KEY_TAG = 3,
+    STYLE_KEYS_MAX = 16,          /* tag + id + class tokens per element */
+    STYLE_ANC_KEYS = 4,           /* ancestor keys recorded per rule */
+    STYLE_BLOOM_DEPTH = 64,       /* filter rows; deeper nodes skip the fast-reject */
+    STYLE_BLOOM_WORDS = 8,        /* 256-bit filter per row */
+    STYLE_SHARE_DEPTH = 32,       /* sibling-share slots, one per depth */
+    STYLE_SHARE_MAX = 256,        /* matched rules kept per share slot */
+
+    /* style_resolve_dirty result: how far a restyle reaches. */
+    STYLE_CHANGE_NONE = 0,
+    STYLE_CHANGE_PAINT = 1,       /* repaint the box's band */
+    STYLE_CHANGE_LAYOUT = 2,      /* relayout the dirty boxes */
+    STYLE_CHANGE_TREE = 3,        /* box tree changed: rebuild + full layout */
+    LAYOUT_ROOTS_MAX = 32,
+
     /* §2 selector pseudo-class IDs (stored in css_sel_pseudo[]) */
     PSEUDO_NONE = 0,
     PSEUDO_HOVER = 1,
@@ -292,6 +343,15 @@ enum {
     MAX_JS_FUNCS  = 256,
     MAX_JS_OBJS   = 512,
     MAX_JS_PROPS  = 4096,
+    MAX_JS_CODE   = 16384,  /* bytecode instructions per page */
+    MAX_JS_CONSTS = 1024,   /* number constant pool */
+    MAX_JS_PROTOS = 256,    /* compiled function bodies */
+    MAX_JS_LOCALS = 512,    /* compile-time local-name table */
+    MAX_JS_NEST   = 32,     /* function / loop nesting while compiling */
+    MAX_JS_CALLS  = 64,     /* VM call-frame depth */
+    MAX_JS_GLOBALS = 512,
+    JS_LOOP_CAP   = 1000000, /* backward jumps per script run */
+    JSD_ID_CACHE  = 64,     /* getElementById cache slots (power of 2) */
 
     /* JS value tags */
     JS_VAL_UNDEF = 0,
@@ -336,6 +396,34 @@ enum {
     JS_NATIVE_EL_SET_ATTRIBUTE,
     JS_NATIVE_EL_APPEND_CHILD,
     JS_NATIVE_EL_REMOVE,
+    JS_NATIVE_PERF_NOW,
+
+    /* Well-known property names, resolved once per bytecode site by
+     * jsd_prop_id so DOM reads and writes skip the name compares.*/
+    JSD_P_NONE = 0,
+    JSD_P_TEXT_CONTENT, JSD_P_INNER_TEXT, JSD_P_INNER_HTML,
+    JSD_P_TAG_NAME, JSD_P_ID, JSD_P_CLASS_NAME, JSD_P_STYLE,
+    JSD_P_PARENT_NODE, JSD_P_FIRST_CHILD, JSD_P_NEXT_SIBLING,
+    JSD_P_GET_ATTRIBUTE, JSD_P_SET_ATTRIBUTE, JSD_P_APPEND_CHILD,
+    JSD_P_REMOVE, JSD_P_LENGTH,
+
+    /* JS bytecode ops; operand layout is documented in js_compile.cc */
+    JS_OP_END = 0,
+    JS_OP_GETL, JS_OP_SETL, JS_OP_STL, JS_OP_INCL,
+    JS_OP_GETB, JS_OP_SETB, JS_OP_STB, JS_OP_INCB,
+    JS_OP_GETU, JS_OP_SETU, JS_OP_STU,
+    JS_OP_GETG, JS_OP_SETG,
+    JS_OP_PUSH_NUM, JS_OP_PUSH_STR, JS_OP_PUSH_BOOL,
+    JS_OP_PUSH_UNDEF, JS_OP_PUSH_NULL,
+    JS_OP_POP, JS_OP_DUP, JS_OP_DUP2,
+    JS_OP_ADD, JS_OP_SUB, JS_OP_MUL, JS_OP_DIV, JS_OP_MOD,
+    JS_OP_LT, JS_OP_GT, JS_OP_LE, JS_OP_GE,
+    JS_OP_EQ, JS_OP_NE, JS_OP_SEQ, JS_OP_SNE,
+    JS_OP_NOT, JS_OP_NEG, JS_OP_TONUM, JS_OP_TYPEOF,
+    JS_OP_JMP, JS_OP_JF, JS_OP_JFK, JS_OP_JTK, JS_OP_JCMP, JS_OP_LOOP,
+    JS_OP_GETP, JS_OP_SETP, JS_OP_GETI, JS_OP_SETI, JS_OP_GETM,
+    JS_OP_NEWOBJ, JS_OP_INITP, JS_OP_NEWARR,
+    JS_OP_CALL, JS_OP_CALLM, JS_OP_LOG, JS_OP_RET, JS_OP_CLOSURE,
 
     /* JS AST node kinds */
     JS_NODE_NONE = 0,
@@ -493,6 +581,49 @@ int css_not_attr_val_off[256];
 int css_not_attr_op    [256];
 int css_not_pseudo     [256];   /* simple pseudos (:first-child etc.); no :not */
 int css_not_pseudo_arg [256];
+
+/* §2 rule index, rebuilt by css_index_build at the top of every
+ * style_resolve_all. Each rule hangs off one hash bucket keyed by its
+ * subject compound (id, else class, else tag) or off the universal list;
+ * chains run in rule order. css_rule_anc_key[] holds up to
+ * STYLE_ANC_KEYS keys the rule's ancestor compounds require, checked
+ * against the ancestor Bloom filter. css_rule_share_unsafe marks rules
+ * whose subject match depends on more than the element's own attributes
+ * and ancestors (:hover, :nth-child, +, ~ ...), which rules out sibling
+ * sharing for any element that has them as candidates.*/
+int css_bucket_first[256];
+int css_universal_first;
+int css_rule_key        [1024];
+int css_rule_bucket_next[1024];
+int css_rule_anc_key    [1024][4];
+int css_rule_anc_count  [1024];
+int css_rule_share_unsafe[1024];
+
+/* §2 style_resolve_all scratch. style_match[] is the current element's
+ * matched rules in rule order. The Bloom rows hold the keys of a node's
+ * ancestors, one row per depth (row d serves children of
+ * style_bloom_owner[d]); the share slots keep the last element's matched
+ * list per depth so an identical next sibling can reuse it. Both are
+ * valid only when their _gen equals style_pass.*/
+int style_pass;
+int style_key[16];
+int style_key_count;
+int style_key_full;               /* more class tokens than style_key[] holds */
+int style_match[1024];
+int style_match_count;
+int style_match_unsafe;
+int style_bloom[512];             /* STYLE_BLOOM_DEPTH * STYLE_BLOOM_WORDS */
+int style_bloom_owner[64];
+int style_bloom_gen  [64];
+int style_share_rules[8192];      /* STYLE_SHARE_DEPTH * STYLE_SHARE_MAX */
+int style_share_count[32];
+int style_share_node [32];
+int style_share_gen  [32];
+/* Last style_resolve_all: wall time and matcher counters (serial log). */
+int style_last_ms;
+int style_stat_tested;
+int style_stat_rejected;
+int style_stat_shared;
 /* Set true at parse time if any rule references :hover or :focus.
  * Cheap gate: when false, the hover-driven restyle path is skipped.*/
 int css_has_dynamic_pseudo;
@@ -501,6 +632,19 @@ int css_has_dynamic_pseudo;
  * change and trigger restyle.*/
 int hover_dom_node;
 int prev_hover_dom_node;
+/* Input element :focus last styled against (input_node of focused_input). */
+int prev_focus_dom_node;
+/* Set by css_index_build when a :hover/:focus compound sits left of a
+ * + or ~ combinator, so a state flip can restyle the element's siblings
+ * and not just its subtree.*/
+int css_dyn_sibling;
+
+/* §2 incremental restyle. n_style_dirty marks elements whose matched
+ * rules may have changed (hover/focus flips); style_resolve_dirty
+ * restyles each marked element with its subtree, since inherited values
+ * flow down, and reports how far the result reaches (STYLE_CHANGE_*).*/
+int n_style_dirty[4096];
+int style_dirty_count;
 
 /* CSS value pool - separate from attr_pool. */
 char css_value_pool[65536];
@@ -666,6 +810,32 @@ int rt_is_fixed [6144];
  * position:relative with an explicit z-index. CSS 2.1 §9.9.1.*/
 int rt_is_stack [6144];
 
+/* §4 incremental relayout. layout_mark_dirty sets rt_needs_layout on a
+ * box and every ancestor, so a relayout walks only the dirty spine.
+ * rt_laid_* keep the avail width and size of the last layout_block; a
+ * clean box given the same width with no floats in play keeps its
+ * geometry and line boxes. rt_laid_ok is 0 when the last layout saw an
+ * outer float or let one of its own escape. n_rt maps a DOM node to its
+ * principal box (-1 for display:none).*/
+int rt_needs_layout[6144];
+int rt_laid_avail  [6144];
+int rt_laid_w      [6144];
+int rt_laid_h      [6144];
+int rt_laid_ok     [6144];
+int n_rt           [4096];
+int rt_free_first;            /* recycled line-box slots, chained by rt_next */
+int layout_incremental;       /* 1 while run_layout_dirty runs */
+/* Boxes whose subtree changed geometry, with the screen band they
+ * covered before the relayout (paint damage). Overflow -> full repaint.*/
+int layout_root_count;
+int layout_root     [32];
+int layout_root_y0  [32];
+int layout_root_y1  [32];
+int layout_root_w   [32];
+int layout_root_h   [32];
+int layout_stat_laid;         /* layout_block calls that did work */
+int layout_stat_kept;         /* ... and that kept a clean subtree */
+
 /* Floats. Module-level storage so flush_inline / layout_block share
  * one list across the document; line-box exclusion and cs_clear
  * resolution both query it. Each entry is in DOCUMENT-relative
@@ -691,6 +861,7 @@ int float_visible_first;
  * line_box render nodes are LINE_BOX kind with rt_first_child indexing into
  * the atom pool via a separate atom_first/count pair.*/
 int la_count;
+int la_run_first;    /* first atom of the inline run being collected */
 int la_x        [8192];   /* x within line box (cumulative) */
 int la_w        [8192];
 int la_text_off [8192];   /* into attr_pool */
@@ -723,7 +894,38 @@ int n_img_intrinsic_h [4096];
 int rt_line_atom_first[6144];
 int rt_line_atom_count[6144];
 
-/* §1 tokenizer scratch - populated by tokenize(), consumed by tree builder.
+/* §6 display list, rebuilt by dl_build after each layout. One item per
+ * painted box in paint order; dl_x/dl_y are its screen position at
+ * scroll 0 and dl_y0/dl_y1 the rows it may touch (shadows, markers).
+ * dl_clip indexes the overflow:hidden clip in force (-1 for none) and
+ * dl_fixed marks items under a position:fixed box, which ignore
+ * scroll_y. dlb_* slice dl_ref into per-band item lists; fixed items
+ * sit in dl_fix_list instead. dl_linear is set when dl_ref overflowed
+ * and replay falls back to testing every item.*/
+int dl_count;
+int dl_n     [6144];
+int dl_x     [6144];
+int dl_y     [6144];
+int dl_y0    [6144];
+int dl_y1    [6144];
+int dl_clip  [6144];
+int dl_fixed [6144];
+int dlc_count;
+int dlc_x[256];
+int dlc_y[256];
+int dlc_w[256];
+int dlc_h[256];
+int dl_band_count;
+int dlb_first[1024];
+int dlb_count[1024];
+int dl_ref_count;
+int dl_ref[16384];
+int dl_fix_count;
+int dl_fix_list[6144];
+int dl_linear;
+int dl_dirty;
+
+/* §1 tokenizer scratch - filled by tokenize_feed(), consumed by tree builder.
  * tok_text_len uses bit 0x40000000 as a sentinel: if set, tok_text_off is an
  * attr_pool offset (decoded RCDATA text); otherwise it is a page_buf offset.
  * The tree builder reads this as:
@@ -739,6 +941,27 @@ int  tok_text_off [16384];   /* offset into page_buf or attr_pool (see flag abov
 int  tok_text_len [16384];
 int  tok_self_close[16384];
 
+/* Tokenizer and tree-builder state between parse_feed calls, so a page
+ * can be parsed while it downloads (see tokenize_feed).*/
+int  tz_state;
+int  tz_i;              /* next byte of page_buf to look at */
+int  tz_text_start;
+int  tz_tag_start;
+int  tz_tag_is_end;
+int  tz_cur_tag;
+int  tz_attr_first;
+int  tz_attr_count;
+int  tz_self_close;
+int  tz_scan;           /* resume point of a comment / raw-text scan */
+int  tz_done;           /* EOF emitted */
+int  tb_root;
+int  tb_stack[64];      /* open elements */
+int  tb_sp;
+int  tb_body_implicit;
+int  tb_mode;           /* IM_* */
+int  tb_next;           /* next token for the tree builder */
+int  tb_link_sheets;    /* <link rel=stylesheet> seen so far */
+
 /* attr-pair pool: name and value byte-offsets into attr_pool */
 int  ap_count;
 int  ap_name_off  [8192];
@@ -764,8 +987,8 @@ int  scroll_y;
 int  page_bg;
 int  page_fg;
 /* Set by document_bg() when body's bg propagates up to the canvas;
- * paint_rt_node uses it to skip body's own bg paint and avoid the
- * margin-inset double-paint.*/
+ * paint_rt_box_decoration uses it to skip body's own bg paint and
+ * avoid the margin-inset double-paint.*/
 int  doc_bg_suppress_body;
 
 /* §7 JS engine pools. Reset per page from navigate() (mirrors the
@@ -792,6 +1015,7 @@ int  jn_count;
  * fields. Reset per page.*/
 char js_str_pool[65536];
 int  js_str_pool_pos;
+int  js_str_dyn_off;        /* offset of the last concatenation result, -1 if none */
 
 /* Queue of <script> source ranges to run after parse + render-tree
  * build; entries are (attr_pool offset, length).*/
@@ -804,9 +1028,10 @@ int  js_script_count;
 char js_last_error[256];
 
 /* §7 JS interpreter state. The value stack holds intermediate
- * expression results in parallel arrays so each eval pushes a fully
- * tagged value without struct return.  Scope frames + bindings form
- * the lexical environment; lookups walk the parent chain.*/
+ * expression results in parallel arrays so each op pushes a fully
+ * tagged value without struct return. Scope frames + bindings form
+ * the lexical environment: frame 0 holds the globals, every call gets
+ * a frame parented to its closure's captured frame.*/
 int    jvs_tag    [1024];
 double jvs_num    [1024];
 int    jvs_str_off[1024];
@@ -829,15 +1054,11 @@ int    jb_count;
 
 int    jsc_parent[256];
 int    jsc_first [256];     /* first binding index covered by this frame */
-int    jsc_count [256];
+int    jsc_count [256];     /* bindings in the frame (locals of a call) */
 int    jsc_top;             /* number of allocated frames */
-int    jsc_cur;             /* index of the active frame */
-
-/* Statement result codes propagated up the eval tree. */
-int    js_ctrl_signal;      /* 0 normal, 1 break, 2 continue, 3 return */
 
 /* Implicit `this` for the currently-being-prepared method call. Set by
- * js_eval_call when the callee comes from MEMBER on a DOMNODE/object.
+ * the VM's CALLM when the callee comes from a DOMNODE/object member.
  * Native function bodies read these instead of an explicit receiver
  * argument.*/
 int    jsd_this_tag;
@@ -849,10 +1070,10 @@ int    jsd_this_obj_idx;
 int    dom_dirty;
 
 /* §7 JS function records. A function value carries an int handle
- * into these parallel arrays. captured_scope is the scope frame
- * active when the function was defined (closure).*/
-int    jfn_param_first    [256];
-int    jfn_body           [256];
+ * into these parallel arrays. proto is the compiled body (jpr_*);
+ * captured_scope is the environment active when the function was
+ * created (closure).*/
+int    jfn_proto          [256];
 int    jfn_captured_scope [256];
 int    jfn_native_id      [256];   /* -1 for user functions, >=0 native */
 int    jfn_count;
@@ -877,11 +1098,85 @@ int    jp_native_id[4096];     /* JS_NATIVE_* when jp_tag == NATIVE */
 int    jp_next    [4096];
 int    jp_count;
 
+/* §7 JS bytecode, reset per page. js_compile.cc lowers each script's
+ * AST into these parallel arrays and js_interp.cc runs them. A function
+ * body is a proto: its entry pc, parameter count and local-slot count.
+ * Locals live in the jb_* bindings of a per-call environment (a jsc_*
+ * frame whose bindings are contiguous), so a local read is
+ * jsc_first[env] + slot. jbc_ic_* are per-instruction inline caches,
+ * -1 until the instruction first runs.*/
+int    jbc_op     [16384];     /* MAX_JS_CODE */
+int    jbc_a      [16384];
+int    jbc_b      [16384];
+int    jbc_c      [16384];
+int    jbc_ic_obj [16384];     /* GETP/SETP/GETM: object; GETG/SETG: binding */
+int    jbc_ic_prop[16384];     /* GETP/SETP/GETM: property of that object */
+int    jbc_count;
+
+double jk_num     [1024];      /* number constants */
+int    jk_int     [1024];      /* integer literal each came from (dedup) */
+int    jk_count;
+
+int    jpr_code   [256];
+int    jpr_nparams[256];
+int    jpr_nlocals[256];
+int    jpr_count;
+
+/* Global bindings by name. Script top-level vars and functions are
+ * defined here at compile time, so later code addresses them by
+ * binding index; names still unknown at compile time resolve on first
+ * use through the GETG/SETG inline cache.*/
+int    jsg_bind   [512];       /* MAX_JS_GLOBALS */
+int    jsg_count;
+
+/* Compiler state: local names of the functions being compiled (one
+ * range per nesting level) and open loops' break/continue patch
+ * chains, threaded through the jump instructions' a operand.*/
+int    jcl_name_off[512];      /* MAX_JS_LOCALS */
+int    jcl_name_len[512];
+int    jcl_count;
+int    jcx_local_first[32];    /* MAX_JS_NEST */
+int    jcx_loop_base  [32];
+int    jcx_depth;
+int    jcb_break[32];
+int    jcb_cont [32];
+int    jcb_depth;
+int    jc_label_pc;            /* last pc a jump was patched to */
+
+/* VM call frames. An environment allocated for a call is released on
+ * return unless a closure or a new global was created since the call
+ * began (js_env_keep_*), so plain calls in a loop don't use up the
+ * scope and binding pools.*/
+int    jcs_pc  [64];           /* MAX_JS_CALLS: return pc */
+int    jcs_env [64];
+int    jcs_base[64];           /* value-stack slot the result goes to */
+int    jcs_sc  [64];           /* jsc_top / jb_count before the call */
+int    jcs_b   [64];
+int    jcs_top;
+int    js_env_keep_sc;
+int    js_env_keep_b;
+int    js_vm_loops;
+
+/* getElementById / querySelector("#id") cache, keyed by a hash of the
+ * id string. An entry is trusted only while that node still carries
+ * the id; jsd_dom_set_attr drops the table when an id changes.*/
+int    jsd_idc_hash[64];       /* JSD_ID_CACHE */
+int    jsd_idc_node[64];
+
 /* history */
 char hist_url_pool[16384];
 int  hist_count;
 int  hist_pos;        /* 1-based index of current entry; 0 = empty */
 int  nav_no_push;     /* when 1, navigate() skips the push (used by back/fwd) */
+int  nav_t0;          /* uptime_ms() when navigate() started (page-load log) */
+int  nav_connects0;   /* net_stat_connects / _reuses at that point */
+int  nav_reuses0;
+int  nav_cache_hits0; /* net_cache_hits at that point */
+int  page_stream;     /* fetch_url hands body bytes to nav_page_progress */
+int  nav_parsing;     /* parse_begin ran for the page being fetched */
+int  nav_paints;      /* partial paints so far */
+int  nav_paint_ms;    /* uptime_ms() after the last partial paint */
+int  nav_first_paint_ms;
 
 /* state */
 int  focus_mode;     /* 0=page, 1=addr, 2=input */
@@ -927,21 +1222,33 @@ void browser_main() {
     hover_link = -1;
     hover_dom_node = -1;
     prev_hover_dom_node = -1;
+    prev_focus_dom_node = -1;
+    style_dirty_count = 0;
+    rt_free_first = -1;
+    layout_root_count = 0;
+    paint_damage_init();
     css_has_dynamic_pseudo = 0;
     css_not_count = 0;
     jtk_count = 0;
     jn_count = 0;
     js_str_pool_pos = 0;
+    js_str_dyn_off = -1;
     js_script_count = 0;
     js_last_error[0] = 0;
     jvs_top = 0;
     jb_count = 0;
     jsc_top = 0;
-    jsc_cur = -1;
-    js_ctrl_signal = 0;
     jfn_count = 0;
     jobj_count = 0;
     jp_count = 0;
+    jbc_count = 0;
+    jk_count = 0;
+    jpr_count = 0;
+    jsg_count = 0;
+    jcs_top = 0;
+    js_env_keep_sc = 0;
+    js_env_keep_b = 0;
+    jsd_id_cache_clear();
     jsd_this_tag = JS_VAL_UNDEF;
     jsd_this_dom_idx = -1;
     jsd_this_obj_idx = -1;
@@ -1018,15 +1325,15 @@ void browser_main() {
             font_face_state_clear();
         }
 
-        /* <img> async pump (mirrors the webfont path). After first
-         * paint we collect every <img src=...> in the DOM into the
-         * queue, then decode one per tick. When a decode lands, we
-         * relayout so the intrinsic dimensions can size the box; this
-         * is the same FOUT-style retry loop ImageLoader uses in Blink.*/
+        /* <img> async pump. After first paint we collect every
+         * <img src=...> and background-image into the queues; the pump
+         * keeps several fetches in flight and decodes each as it lands.
+         * When a decode lands, we relayout so the intrinsic dimensions
+         * can size the box; this is the same FOUT-style retry loop
+         * ImageLoader uses in Blink.*/
         image_queue_collect();
-        image_pump();
         bg_image_queue_collect();
-        bg_image_advance_one_pending();
+        image_pump();
         if (image_any_state_changed()) {
             populate_sibling_caches();
             style_resolve_all();
@@ -1038,4 +1345,9 @@ void browser_main() {
 
         yield();
     }
+    /* Pooled keep-alive sockets outlive individual fetches; hand them
+     * back to the kernel's socket table on exit.*/
+    net_async_cancel_all();
+    net_pool_close_all();
+    http_cache_sync();
 }
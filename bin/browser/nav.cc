@@ -42,75 +42,67 @@ void compute_url_relative(char *rel, char *out, int max) {
 }
 
 /* §2.x External stylesheet loader. After the tokenizer and tree builder
- * complete (so all text is interned in attr_pool and page_buf is free
- * for reuse), walk the DOM for `<link rel="stylesheet" href="...">` and
- * fetch each, feeding the body into css_parse_block.
+ * complete (so all text is interned in attr_pool), walk the DOM for
+ * `<link rel="stylesheet" href="...">` and fetch them concurrently
+ * through net_async_start, feeding each body into css_parse_block.
+ * Layout needs every sheet, so this waits for all of them; bodies are
+ * parsed strictly in document order as the prefix of finished fetches
+ * grows. Fetches also start in document order (stopping at the first
+ * busy one), so the earliest unparsed sheet always holds a transfer
+ * slot and can't be starved by later ones.
  *
  * Cascade caveat: external rules are always appended AFTER inline
  * <style> rules emitted during tree-build, so a `<style>` preceding a
  * `<link>` in the source will out-rank it on doc-order ties. Real-world
  * pages put link first; document the limitation and move on. Reference:
- * Blink core/css/StyleEngine.cpp::createSheet.
- *
- * Net globals (cur_host/cur_port/cur_path/cur_is_https/cur_url/page_buf/
- * page_len) are saved on entry and restored on exit so the outer
- * navigate() resumes against the original document URL.*/
+ * Blink core/css/StyleEngine.cpp::createSheet.*/
 void fetch_external_stylesheets(void) {
+    int link_node[16];
+    int link_xfer[16];      /* transfer id, 0 = not started, -1 = failed */
     int link_count = 0;
-    /* Pre-scan: count and short-circuit if no candidates so the save/restore
-     * dance and serial spam stay off the hot path.*/
-    for (int n = 0; n < nodes_count; n = n + 1) {
+    for (int n = 0; n < nodes_count && link_count < 16; n = n + 1) {
         if (n_tag[n] != T_LINK) continue;
         char *rel = dom_attr_str(n, "rel");
         if (!rel || !b_strieq(rel, "stylesheet")) continue;
         char *href = dom_attr_str(n, "href");
         if (!href || href[0] == 0) continue;
+        link_node[link_count] = n;
+        link_xfer[link_count] = 0;
         link_count = link_count + 1;
     }
     if (link_count == 0) return;
-    if (link_count > 16) link_count = 16;     /* PENDING_LINK_MAX */
-
-    /* Save net state so fetch_url's clobber of cur_* + page_buf is reversible. */
-    char saved_host[256];
-    char saved_path[1024];
-    char saved_url [1024];
-    int  saved_port    = cur_port;
-    int  saved_https   = cur_is_https;
-    int  saved_page_len = page_len;
-    b_strcpy_n(saved_host, cur_host, 256);
-    b_strcpy_n(saved_path, cur_path, 1024);
-    b_strcpy_n(saved_url,  cur_url,  1024);
-
-    int parsed = 0;
-    for (int n = 0; n < nodes_count && parsed < 16; n = n + 1) {
-        if (n_tag[n] != T_LINK) continue;
-        char *rel = dom_attr_str(n, "rel");
-        if (!rel || !b_strieq(rel, "stylesheet")) continue;
-        char *href = dom_attr_str(n, "href");
-        if (!href || href[0] == 0) continue;
-
-        char absu[1024];
-        compute_url_relative(href, absu, URL_MAX);
 
-        char ct[128]; ct[0] = 0;
-        if (fetch_url(absu, ct) != 0) {
-            serial_printf("[browser] link skip (fetch failed): %s\n", absu);
-            continue;
+    int next_start = 0;
+    int next_parse = 0;
+    char absu[1024];
+    while (next_parse < link_count) {
+        while (next_start < link_count) {
+            compute_url_relative(dom_attr_str(link_node[next_start], "href"),
+                                 absu, URL_MAX);
+            int x = net_async_start(absu);
+            if (x == 0) break;
+            if (x < 0) serial_printf("[browser] link skip (fetch failed): %s\n", absu);
+            link_xfer[next_start] = x;
+            next_start = next_start + 1;
         }
-        serial_printf("[browser] link parsed: %s (%d bytes)\n", absu, page_len);
-        css_parse_block(page_buf, page_len);
-        parsed = parsed + 1;
+        net_async_poll();
+        while (next_parse < next_start) {
+            int x = link_xfer[next_parse];
+            if (x > 0) {
+                int r = net_async_result(x);
+                if (r == 0) break;
+                if (r > 0) {
+                    serial_printf("[browser] link parsed: %s (%d bytes)\n",
+                                  dom_attr_str(link_node[next_parse], "href"),
+                                  net_async_len(x));
+                    css_parse_block(net_async_body(x), net_async_len(x));
+                }
+                net_async_free(x);
+            }
+            next_parse = next_parse + 1;
+        }
+        if (next_parse < link_count) yield();
     }
-
-    /* Restore. page_buf contents are no longer needed by anything (text was
-     * interned during tree-build), so we don't bother to repopulate it -
-     * only the metadata globals matter.*/
-    b_strcpy_n(cur_host, saved_host, 256);
-    b_strcpy_n(cur_path, saved_path, 1024);
-    b_strcpy_n(cur_url,  saved_url,  1024);
-    cur_port     = saved_port;
-    cur_is_https = saved_https;
-    page_len     = saved_page_len;
 }
 
 void about_dump() {
@@ -121,11 +113,66 @@ void about_dump() {
     serial_printf("[browser] === about:dump ===\n");
     serial_printf("[browser] %d DOM nodes, %d RT nodes, %d CSS rules\n",
                   nodes_count, rt_count, css_rule_count);
+    serial_printf("[browser] http cache: %d hits, %d revalidated, %d misses; %d entries, %d bytes\n",
+                  net_cache_hits, net_cache_revalidated, net_cache_misses,
+                  http_cache_count(), http_cache_bytes());
     if (rt_count > 0) dump_rt(0, 0);
     for (int n = 0; n < nodes_count; n = n + 1) dump_style(n);
     serial_printf("[browser] === end about:dump ===\n");
 }
 
+/* Per-page resets, then start the parser. Runs when the first body
+ * bytes of the new page arrive, or after the fetch for a body that
+ * came in one piece (cache hit).*/
+void nav_begin_page(void) {
+    /* Reset persistent string pool BEFORE the tokenizer runs: it
+     * interns into attr_pool as it goes.*/
+    attr_pool_pos = 1;
+    js_reset_per_page();
+    /* Per-page eviction: free webfont blobs and decoded image buffers
+     * before parsing the new document. font_face_init now unregisters
+     * each kernel face_id and kfrees the heap blob; image_evict_all
+     * walks the previous DOM and gfx2d_image_free's every cached
+     * handle. Without this, heap usage climbs across navigations.*/
+    image_evict_all();
+    font_face_init();
+    image_queue_init();
+    parse_begin();
+    nav_parsing = 1;
+}
+
+/* fetch_url calls this with the body length so far each time more of
+ * the page lands in page_buf. The DOM is built as the bytes arrive;
+ * once PARSE_FIRST_PAINT_BYTES are in and <body> has started, the
+ * partial tree is styled, laid out and painted, and again at most every
+ * PARSE_PAINT_MS after that. The interval runs from the end of a paint,
+ * so a slow pass can't starve the socket. A <link rel=stylesheet> holds
+ * partial paints back: the sheet is only fetched with the complete
+ * document, and painting without it would flash unstyled content.*/
+void nav_page_progress(int len) {
+    if (!nav_parsing) nav_begin_page();
+    parse_feed(len, 0);
+    if (tb_link_sheets > 0 || tb_mode < IM_IN_BODY) return;
+    if (nav_paints == 0) {
+        if (len < PARSE_FIRST_PAINT_BYTES) return;
+    } else if (uptime_ms() - nav_paint_ms < PARSE_PAINT_MS) {
+        return;
+    }
+    populate_sibling_caches();
+    style_resolve_all();
+    build_render_tree();
+    run_layout();
+    scroll_y = 0;
+    render();
+    nav_paint_ms = uptime_ms();
+    if (nav_paints == 0) {
+        nav_first_paint_ms = nav_paint_ms - nav_t0;
+        serial_printf("[browser] first paint: %d ms, %d bytes in, %d nodes\n",
+                      nav_first_paint_ms, len, nodes_count);
+    }
+    nav_paints = nav_paints + 1;
+}
+
 void navigate(char *u) {
     /* about:dump - dump the previous page's render tree and per-node
      * computed style to serial; do not actually fetch anything. The
@@ -140,8 +187,23 @@ void navigate(char *u) {
     b_strcpy_n(status_msg + sl, u, 256 - sl);
     render();
 
+    /* Images still in flight belong to the page being left. */
+    image_cancel_fetches();
+    nav_t0 = uptime_ms();
+    nav_connects0 = net_stat_connects;
+    nav_reuses0 = net_stat_reuses;
+    nav_cache_hits0 = net_cache_hits;
+    /* Back/Forward show whatever copy is cached, however old; the page
+     * and everything it pulls in come from the cache when they can.*/
+    net_cache_stale_ok = nav_no_push;
+
+    nav_parsing = 0;
+    nav_paints = 0;
+    page_stream = 1;
     char ct[128]; ct[0] = 0;
-    if (fetch_url(u, ct) != 0) {
+    int rc = fetch_url(u, ct);
+    page_stream = 0;
+    if (rc != 0) {
         nodes_count = 0;
         doc_h = 0;
         scroll_y = 0;
@@ -171,22 +233,18 @@ void navigate(char *u) {
         hist_pos = hist_count;
     }
     nav_no_push = 0;
-    /* Reset persistent string pool BEFORE parse_html runs. The tree
-     * builder used to do this internally, but now tokenize() interns into
-     * attr_pool, so we must reset before tokenize starts.*/
-    attr_pool_pos = 1;
-    js_reset_per_page();
-    /* Per-page eviction: free webfont blobs and decoded image buffers
-     * before parsing the new document. font_face_init now unregisters
-     * each kernel face_id and kfrees the heap blob; image_evict_all
-     * walks the previous DOM and gfx2d_image_free's every cached
-     * handle. Without this, heap usage climbs across navigations.*/
-    image_evict_all();
-    font_face_init();
-    image_queue_init();
-    parse_html(page_len);
+    if (!nav_parsing) nav_begin_page();
+    parse_feed(page_len, 1);
+    parse_finish();
     run_layout();           /* render-tree layout drives the visible pipeline */
     scroll_y = 0;
+    if (nav_paints > 0) {
+        serial_printf("[browser] page parsed: %d bytes, first paint %d ms, complete %d ms, %d partial paints\n",
+                      page_len, nav_first_paint_ms, uptime_ms() - nav_t0, nav_paints);
+    } else {
+        serial_printf("[browser] page parsed: %d bytes, complete %d ms\n",
+                      page_len, uptime_ms() - nav_t0);
+    }
     if (title_buf[0]) b_strcpy_n(status_msg, title_buf, 256);
     else              b_strcpy_n(status_msg, cur_url, 256);
     /* update address bar */
@@ -1,19 +1,117 @@
-/* HTTP fetch */
+/* HTTP fetch
+ *
+ * Connections are pooled per origin (host, port, scheme) and kept open
+ * with HTTP/1.1 keep-alive, so a page's stylesheets and images pay DNS +
+ * TCP connect + TLS handshake once per connection instead of once per
+ * URL. A response is parsed incrementally by a per-transfer state
+ * machine (net_xfer_*), which knows from Content-Length / chunked
+ * framing when the body ends and the connection can go back to the pool.
+ *
+ * fetch_url drives transfer slot 0 synchronously into page_buf; while
+ * navigate() sets page_stream, each body chunk goes on to the parser as
+ * it lands. The net_async_* calls run up to NET_XFER_MAX-1 transfers at
+ * once into heap buffers; net_async_poll services whichever sockets are
+ * readable and returns without waiting, so the render loop keeps
+ * painting while subresources are on the wire.
+ *
+ * Both consult the kernel's HTTP cache (http_cache_*) first: a fresh
+ * entry is served without touching the network, a stale one goes out
+ * as a conditional GET and a 304 serves the stored body. Every 200 is
+ * offered back to the cache. History navigation (net_cache_stale_ok)
+ * takes any stored copy, so Back/Forward need no round trip.*/
 
-int build_request(char *buf, char *method, char *p, char *h) {
+/* Connection pool. A slot is busy while a transfer owns it; idle slots
+ * are reused for the same origin until NET_IDLE_MS passes or the server
+ * closes them.*/
+int  pool_used[8];
+int  pool_fd[8];
+int  pool_busy[8];
+char pool_host[8][256];
+int  pool_port[8];
+int  pool_https[8];
+int  pool_last_ms[8];
+int  pool_reqs[8];          /* requests sent on this connection */
+int  net_stat_connects;
+int  net_stat_reuses;
+int  net_cache_hits;        /* served from the cache, no request */
+int  net_cache_revalidated; /* 304 to a conditional request */
+int  net_cache_misses;      /* full body over the network */
+int  net_cache_stale_ok;    /* set by navigate() for Back/Forward */
+
+/* Last error from the transfer layer. fetch_url copies it to status_msg;
+ * async callers only log it, so a failed image never replaces the page
+ * status.*/
+char net_err[256];
+
+/* Per-transfer response state, indexed by transfer slot. */
+int   xf_used[7];
+int   xf_conn[7];           /* pool slot, -1 while waiting for one */
+int   xf_reused[7];         /* request went out on a pooled connection */
+int   xf_retries[7];
+char  xf_url[7][1024];
+char  xf_host[7][256];
+int   xf_port[7];
+int   xf_https[7];
+int   xf_redirects[7];
+int   xf_t0[7];
+int   xf_last_ms[7];        /* last time bytes arrived (stall timeout) */
+int   xf_got_bytes[7];
+int   xf_hdr_state[7];
+int   xf_in_body[7];
+int   xf_status[7];
+char  xf_line[7][1024];
+int   xf_line_len[7];
+int   xf_nlines[7];
+char  xf_location[7][1024];
+int   xf_loc_len[7];
+char  xf_ct[7][128];
+int   xf_clen[7];           /* Content-Length, -1 = absent */
+int   xf_close[7];          /* connection can't be reused after this response */
+int   xf_chunked[7];
+int   xf_ch_state[7];
+int   xf_ch_left[7];
+int   xf_body_wire[7];      /* framed body bytes consumed */
+int   xf_done[7];           /* response fully delimited */
+int   xf_skip[7];           /* redirect: body is discarded */
+int   xf_enc[7];            /* KDEFLATE_WRAP_* of the response, 0 = identity */
+char *xf_z[7];              /* kdeflate stream while xf_enc != 0 */
+int   xf_z_err[7];
+int   xf_z_truncated[7];
+int   xf_wire_len[7];       /* body bytes as received */
+char *xf_out[7];
+int   xf_out_len[7];
+int   xf_out_cap[7];
+int   xf_out_heap[7];       /* xf_out is kmalloc'd and grows up to PAGE_BUF_SIZE */
+int   xf_result[7];         /* 0 running, 1 done, -1 failed */
+int   xf_cache[7];          /* http_cache_lookup result at the start */
+char  xf_cval[7][256];      /* If-None-Match / If-Modified-Since lines */
+char  xf_chdr[7][1024];     /* response header lines the cache reads */
+int   xf_chdr_len[7];
+
+void net_set_err(char *msg, char *detail) {
+    b_strcpy_n(net_err, msg, 256);
+    if (detail) {
+        int sl = b_strlen(net_err);
+        b_strcpy_n(net_err + sl, detail, 256 - sl);
+    }
+}
+
+int build_request(char *buf, char *method, char *p, char *h, char *extra) {
     int q = 0;
     q = b_append(buf, q, method);
     buf[q] = ' '; q = q + 1;
     q = b_append(buf, q, p);
-    /* HTTP/1.1 + explicit Connection: close so we get a clean
-     * close-on-eof body without chunked transfer-encoding (which our
-     * parser doesn't yet decode). Accept*/ /* covers images, fonts
-     * and HTML alike - Wikimedia/Cloudflare CDNs reject the previous
-     * "text/html,*\/*" string for image paths.*/
+    /* HTTP/1.1 keep-alive: the body is delimited by Content-Length or
+     * chunked framing and the connection goes back to the pool. Accept*/ /*
+     * covers images, fonts and HTML alike - Wikimedia/Cloudflare CDNs
+     * reject the previous "text/html,*\/*" string for image paths.
+     * gzip/deflate bodies are inflated in net_xfer_body.*/
     q = b_append(buf, q, " HTTP/1.1\r\nHost: ");
     q = b_append(buf, q, h);
     q = b_append(buf, q, "\r\nUser-Agent: cupidos-browser/1.0\r\n");
-    q = b_append(buf, q, "Accept: */*\r\nAccept-Encoding: identity\r\nConnection: close\r\n\r\n");
+    q = b_append(buf, q, "Accept: */*\r\nAccept-Encoding: gzip, deflate\r\nConnection: keep-alive\r\n");
+    q = b_append(buf, q, extra);
+    q = b_append(buf, q, "\r\n");
     return q;
 }
 
@@ -46,244 +144,740 @@ int parse_ipv4_dotted(char *h, U32 *ip_out) {
     return 1;
 }
 
-/* Fetch into page_buf. Sets page_len. Returns 0 on success, -1 on fail. */
-int fetch_url(char *url, char *content_type_out) {
-    int redirects = 0;
-    page_len = 0;
-    content_type_out[0] = 0;
-    char work_url[1024];
-    b_strcpy_n(work_url, url, URL_MAX);
+/* Connection pool */
 
-    while (1) {
-        int rc = parse_url(work_url, cur_host, &cur_port, cur_path, &cur_is_https);
-        if (rc != 0) {
-            b_strcpy_n(status_msg, "bad URL", 256);
-            return -1;
-        }
+void net_conn_drop(int s) {
+    if (!pool_used[s]) return;
+    close(pool_fd[s]);
+    pool_used[s] = 0;
+    pool_busy[s] = 0;
+}
 
-        U32 ip = 0;
-        if (!parse_ipv4_dotted(cur_host, &ip)) {
-            if (dns_resolve(cur_host, &ip) != 0) {
-                b_strcpy_n(status_msg, "DNS lookup failed: ", 256);
-                int sl = b_strlen(status_msg);
-                b_strcpy_n(status_msg + sl, cur_host, 256 - sl);
-                return -1;
-            }
+void net_pool_close_all(void) {
+    for (int s = 0; s < NET_POOL_MAX; s = s + 1) net_conn_drop(s);
+}
+
+/* An idle connection is only reused if the server hasn't closed it (or
+ * sent anything unsolicited) while it sat in the pool.*/
+int net_conn_alive(int s) {
+    int fd = pool_fd[s];
+    if (uptime_ms() - pool_last_ms[s] > NET_IDLE_MS) return 0;
+    if (sock_state(fd) != TCPS_ESTABLISHED) return 0;
+    if (sock_readable(fd) != 0) return 0;
+    return 1;
+}
+
+/* Hand out a connection to host:port for one request: an idle pooled
+ * one if possible, else a fresh one (evicting the least recently used
+ * idle slot when the pool is full). `limit` caps busy connections per
+ * origin; 0 = no cap. Returns the pool slot, -1 on failure (net_err
+ * set) or -2 when the origin / pool has no connection free right now.*/
+int net_conn_get(char *host, int port, int https, int limit) {
+    int active = 0;
+    for (int s = 0; s < NET_POOL_MAX; s = s + 1) {
+        if (!pool_used[s]) continue;
+        if (pool_port[s] != port || pool_https[s] != https) continue;
+        if (!b_strieq(pool_host[s], host)) continue;
+        if (pool_busy[s]) { active = active + 1; continue; }
+        if (!net_conn_alive(s)) { net_conn_drop(s); continue; }
+        pool_busy[s] = 1;
+        pool_reqs[s] = pool_reqs[s] + 1;
+        net_stat_reuses = net_stat_reuses + 1;
+        return s;
+    }
+    if (limit > 0 && active >= limit) return -2;
+
+    int slot = -1;
+    for (int s = 0; s < NET_POOL_MAX; s = s + 1) {
+        if (!pool_used[s]) { slot = s; break; }
+    }
+    if (slot < 0) {
+        for (int s = 0; s < NET_POOL_MAX; s = s + 1) {
+            if (pool_busy[s]) continue;
+            if (slot < 0 || pool_last_ms[s] < pool_last_ms[slot]) slot = s;
         }
+        if (slot < 0) return -2;
+        net_conn_drop(slot);
+    }
 
-        int fd = socket(SOCK_TCP);
-        if (fd < 0) {
-            b_strcpy_n(status_msg, "socket() failed", 256);
+    U32 ip = 0;
+    if (!parse_ipv4_dotted(host, &ip)) {
+        if (dns_resolve(host, &ip) != 0) {
+            net_set_err("DNS lookup failed: ", host);
             return -1;
         }
-        if (connect(fd, ip, htons(cur_port)) != 0) {
-            b_strcpy_n(status_msg, "connect failed", 256);
+    }
+    int fd = socket(SOCK_TCP);
+    if (fd < 0) {
+        net_set_err("socket() failed", (char*)0);
+        return -1;
+    }
+    if (connect(fd, ip, htons(port)) != 0) {
+        net_set_err("connect failed", (char*)0);
+        close(fd);
+        return -1;
+    }
+    if (https) {
+        int hl = b_strlen(host);
+        if (setsockopt(fd, SOL_TLS, TLS_ENABLE, host, hl + 1) != 0) {
+            net_set_err("TLS handshake failed", (char*)0);
             close(fd);
             return -1;
         }
-        if (cur_is_https) {
-            int hl = 0;
-            while (cur_host[hl]) hl = hl + 1;
-            if (setsockopt(fd, SOL_TLS, TLS_ENABLE, cur_host, hl + 1) != 0) {
-                b_strcpy_n(status_msg, "TLS handshake failed", 256);
-                close(fd);
-                return -1;
+    }
+    pool_used[slot] = 1;
+    pool_fd[slot] = fd;
+    pool_busy[slot] = 1;
+    b_strcpy_n(pool_host[slot], host, HOST_MAX);
+    pool_port[slot] = port;
+    pool_https[slot] = https;
+    pool_reqs[slot] = 1;
+    pool_last_ms[slot] = uptime_ms();
+    net_stat_connects = net_stat_connects + 1;
+    return slot;
+}
+
+/* Return a connection after its response. Anything not cleanly
+ * delimited (EOF-framed body, Connection: close, error) is closed.*/
+void net_conn_release(int s, int keep) {
+    if (s < 0 || !pool_used[s]) return;
+    if (!keep) {
+        net_conn_drop(s);
+        return;
+    }
+    pool_busy[s] = 0;
+    pool_last_ms[s] = uptime_ms();
+}
+
+/* Response parsing */
+
+/* Append decoded body bytes. fetch_url's slot writes straight into
+ * page_buf; async slots start at 64 KB and double up to PAGE_BUF_SIZE.
+ * Either way the body is capped like page_buf always was.*/
+void net_xfer_store(int x, char *src, int len) {
+    int need = xf_out_len[x] + len + 1;
+    if (need > xf_out_cap[x] && xf_out_heap[x] && xf_out_cap[x] < PAGE_BUF_SIZE) {
+        int cap = xf_out_cap[x] ? xf_out_cap[x] * 2 : 65536;
+        while (cap < need && cap < PAGE_BUF_SIZE) cap = cap * 2;
+        if (cap > PAGE_BUF_SIZE) cap = PAGE_BUF_SIZE;
+        char *nb = (char*)kmalloc(cap);
+        if (nb) {
+            if (xf_out[x]) {
+                memcpy(nb, xf_out[x], xf_out_len[x]);
+                kfree(xf_out[x]);
             }
+            xf_out[x] = nb;
+            xf_out_cap[x] = cap;
+        }
+    }
+    int can = xf_out_cap[x] - 1 - xf_out_len[x];
+    if (len > can) len = can;
+    if (len <= 0) return;
+    memcpy(xf_out[x] + xf_out_len[x], src, len);
+    xf_out_len[x] = xf_out_len[x] + len;
+}
+
+/* Content-Encoding. Every body byte (after chunked decoding) goes
+ * through here; gzip/deflate bodies are inflated through a kernel
+ * kdeflate stream on the way into the transfer's buffer.*/
+void net_xfer_body(int x, char *src, int len) {
+    if (xf_skip[x]) return;
+    xf_wire_len[x] = xf_wire_len[x] + len;
+    if (!xf_enc[x]) {
+        net_xfer_store(x, src, len);
+        return;
+    }
+    if (!xf_z[x] && !xf_z_err[x]) {
+        xf_z[x] = (char*)kdeflate_stream_new(xf_enc[x]);
+        if (!xf_z[x]) xf_z_err[x] = 1;
+    }
+    char out[4096];
+    while (len > 0 && !xf_z_err[x]) {
+        int used = kdeflate_stream_push(xf_z[x], src, len);
+        src = src + used;
+        len = len - used;
+        while (1) {
+            int got = kdeflate_stream_pull(xf_z[x], out, 4096);
+            if (got < 0) { xf_z_err[x] = 1; break; }
+            if (got == 0) break;
+            net_xfer_store(x, out, got);
         }
+        if (used == 0) break;   /* stream already complete */
+    }
+}
 
-        char req[4096];
-        int rlen = build_request(req, "GET", cur_path, cur_host);
-        if (send(fd, req, rlen) < 0) {
-            b_strcpy_n(status_msg, "send failed", 256);
-            close(fd);
-            return -1;
+/* "gzip" / "x-gzip" / "deflate" -> wrapper for kdeflate_stream_new.
+ * "deflate" is sniffed: servers send both zlib and bare DEFLATE.*/
+int net_parse_encoding(char *v, int n) {
+    if (n >= 4 && b_strieq_n(v, "gzip", 4)) return KDEFLATE_WRAP_GZIP;
+    if (n >= 6 && b_strieq_n(v, "x-gzip", 6)) return KDEFLATE_WRAP_GZIP;
+    if (n >= 7 && b_strieq_n(v, "deflate", 7)) return KDEFLATE_WRAP_AUTO;
+    return 0;
+}
+
+/* Forget the response headers so the slot can read the next response
+ * (interim 1xx, redirect hop or retry).*/
+void net_xfer_reset_headers(int x) {
+    xf_hdr_state[x] = 0;
+    xf_in_body[x] = 0;
+    xf_status[x] = 0;
+    xf_line_len[x] = 0;
+    xf_nlines[x] = 0;
+    xf_location[x][0] = 0;
+    xf_loc_len[x] = 0;
+    xf_ct[x][0] = 0;
+    xf_clen[x] = -1;
+    xf_close[x] = 0;
+    xf_chunked[x] = 0;
+    xf_ch_state[x] = 0;
+    xf_ch_left[x] = 0;
+    xf_body_wire[x] = 0;
+    xf_done[x] = 0;
+    xf_skip[x] = 0;
+    xf_enc[x] = 0;
+    xf_chdr_len[x] = 0;
+}
+
+void net_xfer_reset(int x) {
+    net_xfer_reset_headers(x);
+    xf_got_bytes[x] = 0;
+    xf_z[x] = (char*)0;
+    xf_z_err[x] = 0;
+    xf_z_truncated[x] = 0;
+    xf_wire_len[x] = 0;
+    xf_out_len[x] = 0;
+}
+
+/* Index of the first non-blank byte after a header name of length k. */
+int net_hdr_value(int x, int k) {
+    while (k < xf_line_len[x] && (xf_line[x][k] == ' ' || xf_line[x][k] == '\t'))
+        k = k + 1;
+    return k;
+}
+
+/* Keep the header lines http_cache_store / _revalidated look at. */
+void net_xfer_cache_header(int x, char *line, int line_len) {
+    if (!(b_strieq_n(line, "cache-control:", 14) || b_strieq_n(line, "expires:", 8) ||
+          b_strieq_n(line, "date:", 5) || b_strieq_n(line, "age:", 4) ||
+          b_strieq_n(line, "etag:", 5) || b_strieq_n(line, "last-modified:", 14) ||
+          b_strieq_n(line, "pragma:", 7) || b_strieq_n(line, "vary:", 5) ||
+          b_strieq_n(line, "content-type:", 13))) return;
+    int n = xf_chdr_len[x];
+    if (n + line_len + 1 > NET_CACHE_HDR_MAX) return;
+    memcpy(xf_chdr[x] + n, line, line_len);
+    xf_chdr[x][n + line_len] = '\n';
+    xf_chdr_len[x] = n + line_len + 1;
+}
+
+/* One complete header line (CR stripped) in xf_line[x]. */
+void net_xfer_header_line(int x) {
+    char *line = xf_line[x];
+    int line_len = xf_line_len[x];
+    xf_nlines[x] = xf_nlines[x] + 1;
+    if (xf_nlines[x] == 1) {
+        /* Status line "HTTP/1.x NNN reason". HTTP/1.0 servers close. */
+        if (line_len >= 8 && b_strieq_n(line, "HTTP/1.0", 8)) xf_close[x] = 1;
+        int li = 0;
+        while (li < line_len && line[li] != ' ') li = li + 1;
+        li = li + 1;
+        int v = 0;
+        while (li < line_len && line[li] >= '0' && line[li] <= '9') {
+            v = v * 10 + (line[li] - '0');
+            li = li + 1;
+        }
+        xf_status[x] = v;
+        return;
+    }
+    net_xfer_cache_header(x, line, line_len);
+    if (line_len > 9 && b_strieq_n(line, "location:", 9)) {
+        int li = net_hdr_value(x, 9);
+        int lo = 0;
+        while (li < line_len && lo < URL_MAX - 1) {
+            xf_location[x][lo] = line[li];
+            lo = lo + 1; li = li + 1;
+        }
+        xf_location[x][lo] = 0;
+        xf_loc_len[x] = lo;
+    } else if (line_len > 13 && b_strieq_n(line, "content-type:", 13)) {
+        int li = net_hdr_value(x, 13);
+        int lo = 0;
+        while (li < line_len && line[li] != ';' && lo < 127) {
+            xf_ct[x][lo] = line[li];
+            lo = lo + 1; li = li + 1;
+        }
+        xf_ct[x][lo] = 0;
+    } else if (line_len > 15 && b_strieq_n(line, "content-length:", 15)) {
+        int li = net_hdr_value(x, 15);
+        int v = 0;
+        int digits = 0;
+        while (li < line_len && line[li] >= '0' && line[li] <= '9' && digits < 9) {
+            v = v * 10 + (line[li] - '0');
+            li = li + 1;
+            digits = digits + 1;
+        }
+        if (digits > 0) xf_clen[x] = v;
+    } else if (line_len > 18 && b_strieq_n(line, "transfer-encoding:", 18)) {
+        int li = net_hdr_value(x, 18);
+        if (line_len - li >= 7 && b_strieq_n(line + li, "chunked", 7)) {
+            xf_chunked[x] = 1;
         }
+    } else if (line_len > 17 && b_strieq_n(line, "content-encoding:", 17)) {
+        int li = net_hdr_value(x, 17);
+        xf_enc[x] = net_parse_encoding(line + li, line_len - li);
+    } else if (line_len > 11 && b_strieq_n(line, "connection:", 11)) {
+        int li = net_hdr_value(x, 11);
+        if (line_len - li >= 5 && b_strieq_n(line + li, "close", 5)) xf_close[x] = 1;
+    }
+}
 
-        char buf[4096];
-        int hdr_state = 0;
-        int in_body = 0;
-        int status = 0;
-        int sl_state = 0;
-        int sl_digits = 0;
-        char location[1024]; location[0] = 0;
-        int loc_len = 0;
-        char line[1024]; int line_len = 0;
-        int chunked = 0;
-        /* Chunked decoder state. Each chunk: hex-size CRLF data CRLF.
-         *   ch_state 0 = reading hex size
-         *   ch_state 1 = saw CR after hex, waiting for LF
-         *   ch_state 2 = copying `ch_left` body bytes
-         *   ch_state 3 = saw CR after data, waiting for LF
-         *   ch_state 4 = done (size 0 chunk seen, drain trailers)*/
-        int ch_state = 0;
-        int ch_left = 0;
-        page_len = 0;
+/* Blank line after the headers: work out how the body is framed. */
+void net_xfer_headers_done(int x) {
+    int status = xf_status[x];
+    if (status >= 100 && status < 200) {
+        /* Interim response (100 Continue, 103 Early Hints); the real
+         * status line follows on the same connection.*/
+        net_xfer_reset_headers(x);
+        return;
+    }
+    xf_in_body[x] = 1;
+    xf_skip[x] = (status >= 300 && status < 400 &&
+                  xf_loc_len[x] > 0 && xf_redirects[x] < 5);
+    if (status == 204 || status == 304) {
+        xf_done[x] = 1;
+    } else if (!xf_chunked[x]) {
+        if (xf_clen[x] == 0) xf_done[x] = 1;
+        if (xf_clen[x] < 0) xf_close[x] = 1;    /* body runs to EOF */
+    }
+}
 
-        while (1) {
-            int n = recv(fd, buf, RECV_BUF_SIZE);
-            if (n <= 0) break;
-            int j = 0;
-            if (!in_body) {
-                while (j < n) {
-                    char b = buf[j];
-
-                    if (sl_state == 0) {
-                        if (b == ' ') sl_state = 1;
-                    } else if (sl_state == 1) {
-                        if (b >= '0' && b <= '9') {
-                            sl_digits = sl_digits * 10 + (b - '0');
-                        } else {
-                            status = sl_digits;
-                            sl_state = 2;
-                        }
-                    }
-
-                    if (b == '\n') {
-                        if (line_len > 9 && b_strieq_n(line, "location:", 9)) {
-                            int li = 9;
-                            while (li < line_len &&
-                                   (line[li] == ' ' || line[li] == '\t')) li = li + 1;
-                            int lo = 0;
-                            while (li < line_len && line[li] != '\r' &&
-                                   lo < URL_MAX - 1) {
-                                location[lo] = line[li];
-                                lo = lo + 1; li = li + 1;
-                            }
-                            location[lo] = 0;
-                            loc_len = lo;
-                        } else if (line_len > 13 &&
-                                   b_strieq_n(line, "content-type:", 13)) {
-                            int li = 13;
-                            while (li < line_len &&
-                                   (line[li] == ' ' || line[li] == '\t')) li = li + 1;
-                            int lo = 0;
-                            while (li < line_len && line[li] != '\r' &&
-                                   line[li] != ';' && lo < 127) {
-                                content_type_out[lo] = line[li];
-                                lo = lo + 1; li = li + 1;
-                            }
-                            content_type_out[lo] = 0;
-                        } else if (line_len > 18 &&
-                                   b_strieq_n(line, "transfer-encoding:", 18)) {
-                            int li = 18;
-                            while (li < line_len &&
-                                   (line[li] == ' ' || line[li] == '\t')) li = li + 1;
-                            if (line_len - li >= 7 &&
-                                b_strieq_n(line + li, "chunked", 7)) {
-                                chunked = 1;
-                            }
-                        }
-                        line_len = 0;
-                    } else if (b != '\r' && line_len < HEADER_LINE_MAX - 1) {
-                        line[line_len] = b; line_len = line_len + 1;
-                    }
-
-                    if (b == '\r' && (hdr_state == 0 || hdr_state == 2)) hdr_state = hdr_state + 1;
-                    else if (b == '\n' && (hdr_state == 1 || hdr_state == 3)) hdr_state = hdr_state + 1;
-                    else hdr_state = 0;
-                    j = j + 1;
-                    if (hdr_state == 4) { in_body = 1; break; }
-                }
-            }
-            int skip_body = (status >= 300 && status < 400 &&
-                             loc_len > 0 && redirects < 5);
-            if (in_body && j < n && !skip_body) {
-                if (!chunked) {
-                    int blen = n - j;
-                    int can = PAGE_BUF_SIZE - 1 - page_len;
-                    if (blen > can) blen = can;
-                    if (blen > 0) {
-                        int k = 0;
-                        while (k < blen) {
-                            page_buf[page_len + k] = buf[j + k];
-                            k = k + 1;
-                        }
-                        page_len = page_len + blen;
-                    }
-                } else {
-                    /* RFC 7230 §4.1 chunked decoding. Drains every
-                     * available byte each loop; servers can split a
-                     * single chunk across multiple recv() boundaries.*/
-                    while (j < n && ch_state != 4) {
-                        char b = buf[j];
-                        if (ch_state == 0) {
-                            int dig = -1;
-                            if (b >= '0' && b <= '9') dig = b - '0';
-                            else if (b >= 'a' && b <= 'f') dig = 10 + (b - 'a');
-                            else if (b >= 'A' && b <= 'F') dig = 10 + (b - 'A');
-                            if (dig >= 0) {
-                                ch_left = ch_left * 16 + dig;
-                                j = j + 1;
-                            } else if (b == ';') {
-                                /* Skip chunk extensions until CR. */
-                                while (j < n && buf[j] != '\r') j = j + 1;
-                            } else if (b == '\r') {
-                                ch_state = 1;
-                                j = j + 1;
-                            } else {
-                                j = j + 1;
-                            }
-                        } else if (ch_state == 1) {
-                            if (b == '\n') {
-                                if (ch_left == 0) ch_state = 4;
-                                else ch_state = 2;
-                            }
-                            j = j + 1;
-                        } else if (ch_state == 2) {
-                            int blen = n - j;
-                            if (blen > ch_left) blen = ch_left;
-                            int can = PAGE_BUF_SIZE - 1 - page_len;
-                            if (blen > can) blen = can;
-                            if (blen > 0) {
-                                int k = 0;
-                                while (k < blen) {
-                                    page_buf[page_len + k] = buf[j + k];
-                                    k = k + 1;
-                                }
-                                page_len = page_len + blen;
-                                ch_left = ch_left - blen;
-                                j = j + blen;
-                            }
-                            if (ch_left == 0) ch_state = 3;
-                        } else if (ch_state == 3) {
-                            if (b == '\n') {
-                                ch_state = 0;
-                                ch_left = 0;
-                            }
-                            j = j + 1;
-                        }
-                    }
-                }
+/* Feed bytes read from the connection. Sets xf_done once the response
+ * is complete; bytes past the end are unexpected and stop reuse.*/
+void net_xfer_feed(int x, char *buf, int n) {
+    int j = 0;
+    xf_got_bytes[x] = 1;
+    xf_last_ms[x] = uptime_ms();
+    while (j < n && !xf_in_body[x]) {
+        char b = buf[j];
+        if (b == '\n') {
+            if (xf_line_len[x] > 0) net_xfer_header_line(x);
+            xf_line_len[x] = 0;
+        } else if (b != '\r' && xf_line_len[x] < HEADER_LINE_MAX - 1) {
+            xf_line[x][xf_line_len[x]] = b;
+            xf_line_len[x] = xf_line_len[x] + 1;
+        }
+        int hs = xf_hdr_state[x];
+        if (b == '\r' && (hs == 0 || hs == 2)) hs = hs + 1;
+        else if (b == '\n' && (hs == 1 || hs == 3)) hs = hs + 1;
+        else hs = 0;
+        xf_hdr_state[x] = hs;
+        j = j + 1;
+        if (hs == 4) net_xfer_headers_done(x);
+    }
+    if (!xf_in_body[x] || j >= n) return;
+    if (xf_done[x]) {
+        xf_close[x] = 1;
+        return;
+    }
+    if (!xf_chunked[x]) {
+        int blen = n - j;
+        if (xf_clen[x] >= 0) {
+            int left = xf_clen[x] - xf_body_wire[x];
+            if (blen > left) {
+                blen = left;
+                xf_close[x] = 1;
             }
         }
-        close(fd);
-        page_buf[page_len] = 0;
-
-        if (status >= 300 && status < 400 && loc_len > 0 && redirects < 5) {
-            char new_url[1024];
-            if (resolve_redirect(location, cur_host, cur_port, cur_is_https,
-                                 new_url, URL_MAX) != 0) {
-                b_strcpy_n(status_msg, "bad Location header", 256);
-                return -1;
+        xf_body_wire[x] = xf_body_wire[x] + blen;
+        net_xfer_body(x, buf + j, blen);
+        if (xf_clen[x] >= 0 && xf_body_wire[x] >= xf_clen[x]) xf_done[x] = 1;
+        return;
+    }
+    /* RFC 7230 §4.1 chunked decoding. Each chunk: hex-size CRLF data
+     * CRLF; the zero-size chunk is followed by trailer lines and a
+     * blank line. Servers split all of it across recv() boundaries.
+     *   ch_state 0 = reading hex size
+     *   ch_state 1 = saw CR after hex, waiting for LF
+     *   ch_state 2 = copying `ch_left` body bytes
+     *   ch_state 3 = saw CR after data, waiting for LF
+     *   ch_state 4 = start of a trailer line (blank line ends the body)
+     *   ch_state 5 = inside a trailer line*/
+    while (j < n && !xf_done[x]) {
+        char b = buf[j];
+        int st = xf_ch_state[x];
+        if (st == 0) {
+            int dig = -1;
+            if (b >= '0' && b <= '9') dig = b - '0';
+            else if (b >= 'a' && b <= 'f') dig = 10 + (b - 'a');
+            else if (b >= 'A' && b <= 'F') dig = 10 + (b - 'A');
+            if (dig >= 0) {
+                xf_ch_left[x] = xf_ch_left[x] * 16 + dig;
+                j = j + 1;
+            } else if (b == ';') {
+                /* Skip chunk extensions until CR. */
+                while (j < n && buf[j] != '\r') j = j + 1;
+            } else if (b == '\r') {
+                xf_ch_state[x] = 1;
+                j = j + 1;
+            } else {
+                j = j + 1;
             }
-            b_strcpy_n(work_url, new_url, URL_MAX);
-            redirects = redirects + 1;
-            continue;
+        } else if (st == 1) {
+            if (b == '\n') {
+                if (xf_ch_left[x] == 0) xf_ch_state[x] = 4;
+                else xf_ch_state[x] = 2;
+            }
+            j = j + 1;
+        } else if (st == 2) {
+            int blen = n - j;
+            if (blen > xf_ch_left[x]) blen = xf_ch_left[x];
+            if (blen > 0) {
+                net_xfer_body(x, buf + j, blen);
+                xf_ch_left[x] = xf_ch_left[x] - blen;
+                j = j + blen;
+            }
+            if (xf_ch_left[x] == 0) xf_ch_state[x] = 3;
+        } else if (st == 3) {
+            if (b == '\n') {
+                xf_ch_state[x] = 0;
+                xf_ch_left[x] = 0;
+            }
+            j = j + 1;
+        } else if (st == 4) {
+            if (b == '\n') xf_done[x] = 1;
+            else if (b != '\r') xf_ch_state[x] = 5;
+            j = j + 1;
+        } else {
+            if (b == '\n') xf_ch_state[x] = 4;
+            j = j + 1;
         }
+    }
+    if (j < n) xf_close[x] = 1;
+}
+
+/* Connect (or reuse a connection) and send the GET for xf_url[x].
+ * Returns 0 once the request is out, -1 on failure (net_err set), or
+ * -2 when no connection is free under `limit`.*/
+int net_xfer_start(int x, int limit) {
+    char host[256];
+    char path[1024];
+    int port = 0;
+    int https = 0;
+    if (parse_url(xf_url[x], host, &port, path, &https) != 0) {
+        net_set_err("bad URL", (char*)0);
+        return -1;
+    }
+    b_strcpy_n(xf_host[x], host, HOST_MAX);
+    xf_port[x] = port;
+    xf_https[x] = https;
 
-        if (status < 200 || status >= 300) {
-            serial_printf("[net] fetch_url: %s -> HTTP %d (page_len=%d, chunked=%d)\n",
-                          work_url, status, page_len, chunked);
-            b_strcpy_n(status_msg, "HTTP error: ", 256);
-            int sl = b_strlen(status_msg);
-            int el = b_append_int(status_msg, sl, status);
-            status_msg[el] = 0;
+    char req[4096];
+    int rlen = build_request(req, "GET", path, host, xf_cval[x]);
+    while (1) {
+        int s = net_conn_get(host, port, https, limit);
+        if (s < 0) return s;
+        net_xfer_reset(x);
+        xf_conn[x] = s;
+        xf_reused[x] = pool_reqs[s] > 1;
+        xf_last_ms[x] = uptime_ms();
+        if (send(pool_fd[s], req, rlen) >= 0) return 0;
+        net_conn_drop(s);
+        xf_conn[x] = -1;
+        /* A pooled connection the server closed under us: go round
+         * again for another (or a fresh) one.*/
+        if (!xf_reused[x]) break;
+    }
+    net_set_err("send failed", (char*)0);
+    return -1;
+}
+
+/* The response finished, hit EOF, or was abandoned. Releases the
+ * connection and decides what happens next:
+ *    0 = response accepted (body NUL-terminated in xf_out)
+ *    1 = start xf_url[x] again (redirect hop, or a stale keep-alive
+ *        connection closed before answering)
+ *   -1 = failed (net_err set)*/
+int net_xfer_complete(int x) {
+    if (xf_z[x]) {
+        xf_z_truncated[x] = !kdeflate_stream_done(xf_z[x]);
+        kdeflate_stream_free(xf_z[x]);
+        xf_z[x] = (char*)0;
+    }
+    net_conn_release(xf_conn[x], xf_done[x] && !xf_close[x]);
+    xf_conn[x] = -1;
+    char *out = xf_out[x];
+    if (out) out[xf_out_len[x]] = 0;
+
+    if (!xf_got_bytes[x] && xf_reused[x] && xf_retries[x] < 2) {
+        xf_retries[x] = xf_retries[x] + 1;
+        return 1;
+    }
+    int status = xf_status[x];
+    if (xf_skip[x]) {
+        char new_url[1024];
+        if (resolve_redirect(xf_location[x], xf_host[x], xf_port[x], xf_https[x],
+                             new_url, URL_MAX) != 0) {
+            net_set_err("bad Location header", (char*)0);
             return -1;
         }
-        serial_printf("[net] fetch_url: %s -> HTTP %d (page_len=%d, chunked=%d, ct=%s)\n",
-                      work_url, status, page_len, chunked, content_type_out);
-        b_strcpy_n(cur_url, work_url, URL_MAX);
+        b_strcpy_n(xf_url[x], new_url, URL_MAX);
+        xf_redirects[x] = xf_redirects[x] + 1;
+        /* The validators were for the URL that redirected. */
+        xf_cache[x] = 0;
+        xf_cval[x][0] = 0;
+        return 1;
+    }
+    if (status == 304 && xf_cache[x] == HTTP_CACHE_STALE) {
+        http_cache_revalidated(xf_url[x], xf_chdr[x], xf_chdr_len[x]);
+        xf_cache[x] = 0;
+        xf_cval[x][0] = 0;
+        /* Evicted meanwhile: ask again without validators. */
+        if (net_cache_load(x) != 0) return 1;
+        net_cache_revalidated = net_cache_revalidated + 1;
+        serial_printf("[net] fetch_url: %s -> 304, %d bytes from cache in %d ms\n",
+                      xf_url[x], xf_out_len[x], uptime_ms() - xf_t0[x]);
         return 0;
     }
+    if (status < 200 || status >= 300) {
+        serial_printf("[net] fetch_url: %s -> HTTP %d (page_len=%d, chunked=%d)\n",
+                      xf_url[x], status, xf_out_len[x], xf_chunked[x]);
+        b_strcpy_n(net_err, "HTTP error: ", 256);
+        int sl = b_strlen(net_err);
+        int el = b_append_int(net_err, sl, status);
+        net_err[el] = 0;
+        return -1;
+    }
+    /* A truncated compressed body keeps what inflated; corrupt data
+     * fails the fetch.*/
+    if (xf_z_err[x]) {
+        serial_printf("[net] fetch_url: %s -> corrupt %s body\n", xf_url[x],
+                      xf_enc[x] == KDEFLATE_WRAP_GZIP ? "gzip" : "deflate");
+        net_set_err("corrupt compressed body", (char*)0);
+        return -1;
+    }
+    net_cache_misses = net_cache_misses + 1;
+    /* Only a complete body is worth keeping: not one cut short by the
+     * buffer, the connection or a truncated compressed stream.*/
+    if (status == 200 && !xf_z_truncated[x] &&
+        (xf_done[x] || (!xf_chunked[x] && xf_clen[x] < 0)) &&
+        xf_out_len[x] < xf_out_cap[x] - 1) {
+        http_cache_store(xf_url[x], xf_chdr[x], xf_chdr_len[x], xf_out[x], xf_out_len[x]);
+    }
+    serial_printf("[net] fetch_url: %s -> HTTP %d (page_len=%d, chunked=%d, ct=%s)\n",
+                  xf_url[x], status, xf_out_len[x], xf_chunked[x], xf_ct[x]);
+    serial_printf("[net] fetch_url: wire=%d body=%d enc=%d%s conn=%s in %d ms\n",
+                  xf_wire_len[x], xf_out_len[x], xf_enc[x],
+                  xf_z_truncated[x] ? " (truncated)" : "",
+                  xf_reused[x] ? "reused" : "new", uptime_ms() - xf_t0[x]);
+    return 0;
+}
+
+void net_xfer_begin(int x, char *url) {
+    xf_used[x] = 1;
+    xf_conn[x] = -1;
+    xf_retries[x] = 0;
+    xf_redirects[x] = 0;
+    xf_result[x] = 0;
+    xf_cache[x] = 0;
+    xf_cval[x][0] = 0;
+    xf_t0[x] = uptime_ms();
+    b_strcpy_n(xf_url[x], url, URL_MAX);
+    net_xfer_reset(x);
+}
+
+/* Copy the cached body of xf_url[x] into the transfer's buffer (a
+ * heap buffer is sized to fit). Returns 0, or -1 if there is no usable
+ * entry.*/
+int net_cache_load(int x) {
+    int len = http_cache_length(xf_url[x]);
+    if (len < 0) return -1;
+    if (xf_out_heap[x] && xf_out_cap[x] < len + 1) {
+        char *nb = (char*)kmalloc(len + 1);
+        if (!nb) return -1;
+        if (xf_out[x]) kfree(xf_out[x]);
+        xf_out[x] = nb;
+        xf_out_cap[x] = len + 1;
+    }
+    if (len + 1 > xf_out_cap[x]) return -1;
+    int n = http_cache_read(xf_url[x], xf_out[x], xf_out_cap[x] - 1, xf_ct[x], 128);
+    if (n < 0) return -1;
+    xf_out_len[x] = n;
+    char *out = xf_out[x];
+    out[n] = 0;
+    return 0;
+}
+
+/* Consult the cache before going to the network. Returns 1 when the
+ * entry is fresh and now sits in the transfer's buffer; a stale entry
+ * leaves its validators in xf_cval so the GET goes out conditional.*/
+int net_cache_begin(int x) {
+    xf_cache[x] = http_cache_lookup(xf_url[x], net_cache_stale_ok);
+    if (xf_cache[x] == HTTP_CACHE_FRESH) {
+        if (net_cache_load(x) == 0) {
+            net_cache_hits = net_cache_hits + 1;
+            serial_printf("[net] fetch_url: %s -> cache hit (%d bytes, ct=%s)\n",
+                          xf_url[x], xf_out_len[x], xf_ct[x]);
+            return 1;
+        }
+        xf_cache[x] = 0;
+    }
+    if (xf_cache[x] == HTTP_CACHE_STALE) {
+        if (http_cache_validators(xf_url[x], xf_cval[x], 256) <= 0) xf_cache[x] = 0;
+    }
+    return 0;
+}
+
+/* Fetch into page_buf. Sets page_len. Returns 0 on success, -1 on fail. */
+int fetch_url(char *url, char *content_type_out) {
+    int x = 0;
+    page_len = 0;
+    page_buf[0] = 0;
+    content_type_out[0] = 0;
+    net_xfer_begin(x, url);
+    xf_out[x] = page_buf;
+    xf_out_cap[x] = PAGE_BUF_SIZE;
+    xf_out_heap[x] = 0;
+
+    char buf[4096];
+    int rc = 1;
+    if (net_cache_begin(x)) {
+        parse_url(xf_url[x], cur_host, &cur_port, cur_path, &cur_is_https);
+        rc = 0;
+    }
+    while (rc == 1) {
+        parse_url(xf_url[x], cur_host, &cur_port, cur_path, &cur_is_https);
+        if (net_xfer_start(x, 0) != 0) {
+            rc = -1;
+            break;
+        }
+        int fd = pool_fd[xf_conn[x]];
+        while (!xf_done[x]) {
+            int n = recv(fd, buf, RECV_BUF_SIZE);
+            if (n <= 0) break;
+            net_xfer_feed(x, buf, n);
+            /* navigate() parses the page as it arrives. */
+            if (page_stream && xf_in_body[x] && !xf_skip[x] &&
+                xf_status[x] >= 200 && xf_status[x] < 300) {
+                nav_page_progress(xf_out_len[x]);
+            }
+        }
+        rc = net_xfer_complete(x);
+    }
+    page_len = xf_out_len[x];
+    xf_used[x] = 0;
+    xf_out[x] = (char*)0;
+    if (rc != 0) {
+        b_strcpy_n(status_msg, net_err, 256);
+        return -1;
+    }
+    b_strcpy_n(content_type_out, xf_ct[x], 128);
+    b_strcpy_n(cur_url, xf_url[x], URL_MAX);
+    return 0;
+}
+
+/* Concurrent fetches */
+
+/* Start a GET for an absolute URL. Returns a transfer id (> 0), 0 when
+ * every transfer slot or the origin's connections are busy (try again
+ * on a later tick), or -1 if the fetch failed outright (net_err set).*/
+int net_async_start(char *url) {
+    int x = -1;
+    for (int i = 1; i < NET_XFER_MAX; i = i + 1) {
+        if (!xf_used[i]) { x = i; break; }
+    }
+    if (x < 0) return 0;
+    net_xfer_begin(x, url);
+    xf_out[x] = (char*)0;
+    xf_out_cap[x] = 0;
+    xf_out_heap[x] = 1;
+    if (net_cache_begin(x)) {
+        xf_result[x] = 1;
+        return x;
+    }
+    int rc = net_xfer_start(x, NET_PER_ORIGIN);
+    if (rc == 0) return x;
+    xf_used[x] = 0;
+    if (rc == -2) return 0;
+    serial_printf("[net] async %s failed: %s\n", url, net_err);
     return -1;
 }
+
+/* Abandon a running transfer: its connection is mid-response, so it is
+ * closed rather than pooled.*/
+void net_async_abort(int x) {
+    if (xf_z[x]) {
+        kdeflate_stream_free(xf_z[x]);
+        xf_z[x] = (char*)0;
+    }
+    if (xf_conn[x] >= 0) net_conn_release(xf_conn[x], 0);
+    xf_conn[x] = -1;
+}
+
+void net_async_fail(int x) {
+    net_async_abort(x);
+    xf_result[x] = -1;
+    serial_printf("[net] async %s failed: %s\n", xf_url[x], net_err);
+}
+
+/* Service every running transfer whose socket is readable, without
+ * waiting on any of them. Each transfer reads at most NET_POLL_RECVS
+ * buffers per call so one large body can't starve the others or the
+ * render loop. Finished transfers report through net_async_result.*/
+void net_async_poll(void) {
+    char buf[4096];
+    for (int x = 1; x < NET_XFER_MAX; x = x + 1) {
+        if (!xf_used[x] || xf_result[x] != 0) continue;
+        if (xf_conn[x] < 0) {
+            /* Redirect hop or retry still waiting for a connection. */
+            int rc = net_xfer_start(x, NET_PER_ORIGIN);
+            if (rc == -2) continue;
+            if (rc != 0) { net_async_fail(x); continue; }
+        }
+        int fd = pool_fd[xf_conn[x]];
+        int ended = 0;
+        int rounds = 0;
+        while (!xf_done[x] && rounds < NET_POLL_RECVS) {
+            int r = sock_readable(fd);
+            if (r == 0) break;
+            int n = -1;
+            if (r > 0) n = recv(fd, buf, RECV_BUF_SIZE);
+            if (n <= 0) { ended = 1; break; }
+            net_xfer_feed(x, buf, n);
+            rounds = rounds + 1;
+        }
+        if (!xf_done[x] && !ended) {
+            if (uptime_ms() - xf_last_ms[x] > NET_STALL_MS) {
+                net_set_err("timed out", (char*)0);
+                net_async_fail(x);
+            }
+            continue;
+        }
+        int rc = net_xfer_complete(x);
+        if (rc == 1) {
+            rc = net_xfer_start(x, NET_PER_ORIGIN);
+            if (rc == 0 || rc == -2) continue;  /* -2: retried next poll */
+        }
+        if (rc == 0) xf_result[x] = 1;
+        else net_async_fail(x);
+    }
+}
+
+/* 0 while running, 1 when the body is ready, -1 on failure. */
+int net_async_result(int x) { return xf_result[x]; }
+char *net_async_body(int x) { return xf_out[x]; }
+int net_async_len(int x) { return xf_out_len[x]; }
+
+/* Release a transfer slot and its buffer, cancelling it if it is still
+ * running.*/
+void net_async_free(int x) {
+    if (x <= 0 || x >= NET_XFER_MAX || !xf_used[x]) return;
+    if (xf_result[x] == 0) net_async_abort(x);
+    if (xf_out[x]) kfree(xf_out[x]);
+    xf_out[x] = (char*)0;
+    xf_out_cap[x] = 0;
+    xf_out_len[x] = 0;
+    xf_used[x] = 0;
+}
+
+void net_async_cancel_all(void) {
+    for (int x = 1; x < NET_XFER_MAX; x = x + 1) net_async_free(x);
+}
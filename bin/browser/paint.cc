@@ -67,6 +67,164 @@ void paint_clip_pop(void) {
                    paint_clip_h[paint_clip_top]);
 }
 
+/* Damage tracking. render() repaints only the union rect paint_dmg_*
+ * (surface coordinates, empty when paint_dmg_w is 0) unless paint_full
+ * is set, and hands just that rect to the compositor. Document changes
+ * report themselves (run_layout, run_layout_dirty, style_resolve_dirty,
+ * form input); chrome state is compared against what the last frame
+ * painted in paint_check_chrome, so scrolling, focus moves, address-bar
+ * edits and status text need no call sites of their own. A pure scroll
+ * is kept apart in paint_scroll_dy (rows the page moved up since the
+ * last frame): render() block-moves the pixels it already has and
+ * paints only the strip that scrolled in.*/
+int paint_full;
+int paint_scroll_dy;
+int paint_doc_bg;   /* document_bg() as of the last full repaint */
+int paint_dmg_x;
+int paint_dmg_y;
+int paint_dmg_w;
+int paint_dmg_h;
+int paint_seen_scroll;
+int paint_seen_doc_h;
+int paint_seen_cw;
+int paint_seen_ch;
+int paint_seen_focus;
+int paint_seen_input;
+int paint_seen_addr;   /* length-seeded hash of addr_buf */
+int paint_seen_addr_cursor;
+int paint_seen_hist;
+char paint_seen_status[80];
+/* Keystroke-to-paint probe: uptime_ms() of the last form keystroke not
+ * yet on screen, -1 when none is pending.*/
+int paint_key_t0;
+
+void paint_damage_init() {
+    paint_full = 1;
+    paint_dmg_w = 0;
+    paint_scroll_dy = 0;
+    paint_key_t0 = -1;
+    dl_dirty = 1;
+}
+
+void paint_invalidate_all() {
+    paint_full = 1;
+}
+
+/* Box positions or paint bounds changed: rebuild the display list before
+ * the next replay. Layout calls this; pure color changes don't need to,
+ * since replay reads styles live.*/
+void paint_invalidate_list() {
+    dl_dirty = 1;
+}
+
+void paint_invalidate_rect(int x, int y, int w, int h) {
+    if (x < 0) { w = w + x; x = 0; }
+    if (y < 0) { h = h + y; y = 0; }
+    if (x + w > cur_cw) w = cur_cw - x;
+    if (y + h > cur_ch) h = cur_ch - y;
+    if (w <= 0 || h <= 0) return;
+    if (paint_dmg_w <= 0) {
+        paint_dmg_x = x; paint_dmg_y = y;
+        paint_dmg_w = w; paint_dmg_h = h;
+        return;
+    }
+    int x1 = paint_dmg_x + paint_dmg_w;
+    int y1 = paint_dmg_y + paint_dmg_h;
+    if (x + w > x1) x1 = x + w;
+    if (y + h > y1) y1 = y + h;
+    if (x < paint_dmg_x) paint_dmg_x = x;
+    if (y < paint_dmg_y) paint_dmg_y = y;
+    paint_dmg_w = x1 - paint_dmg_x;
+    paint_dmg_h = y1 - paint_dmg_y;
+}
+
+/* Full-width strip [y0, y1) of the viewport. Boxes are damaged as bands
+ * because their paint can spill sideways (list markers in the padding,
+ * shadows, unbreakable text); vertical spill is covered by
+ * paint_rt_band measuring the whole subtree.*/
+void paint_invalidate_band(int y0, int y1) {
+    int top = viewport_y();
+    int bot = viewport_y() + viewport_h();
+    if (y0 < top) y0 = top;
+    if (y1 > bot) y1 = bot;
+    if (y1 <= y0) return;
+    paint_invalidate_rect(0, y0, cur_cw, y1 - y0);
+}
+
+/* Screen-space vertical extent of n's subtree, box shadows included. */
+void paint_rt_band(int n, int *y0, int *y1) {
+    int sy = rt_screen_y(n);
+    int top = sy;
+    int bot = sy + rt_h[n];
+    int cs = rt_style[n];
+    if (cs_shadow_has[cs]) {
+        if (cs_shadow_dy[cs] < 0) top = top + cs_shadow_dy[cs];
+        else                      bot = bot + cs_shadow_dy[cs];
+    }
+    int c = rt_first_child[n];
+    while (c >= 0) {
+        int ct;
+        int cb;
+        paint_rt_band(c, &ct, &cb);
+        if (ct < top) top = ct;
+        if (cb > bot) bot = cb;
+        c = rt_next[c];
+    }
+    *y0 = top;
+    *y1 = bot;
+}
+
+/* Repaint the box for one form control (text input, checkbox). */
+void paint_invalidate_rt(int n) {
+    if (n < 0) return;
+    paint_invalidate_rect(rt_screen_x(n), rt_screen_y(n), rt_w[n], rt_h[n]);
+}
+
+/* Compare chrome inputs against the last painted frame and damage what
+ * they drive. Resizing moves the whole page; focus moves restyle the
+ * address bar and the focus ring, which is cheap enough to take as a
+ * full repaint too. Scrolling is recorded for render() to blit.*/
+void paint_check_chrome() {
+    if (doc_h != paint_seen_doc_h ||
+        cur_cw != paint_seen_cw || cur_ch != paint_seen_ch ||
+        focus_mode != paint_seen_focus || focused_input != paint_seen_input) {
+        paint_full = 1;
+    }
+    paint_scroll_dy = paint_scroll_dy + scroll_y - paint_seen_scroll;
+    int hist = hist_pos * 256 + hist_count;
+    int addr_h = addr_len;
+    int k = 0;
+    while (k < addr_len) { addr_h = addr_h * 31 + addr_buf[k]; k = k + 1; }
+    if (addr_h != paint_seen_addr || addr_cursor != paint_seen_addr_cursor ||
+        hist != paint_seen_hist) {
+        paint_invalidate_rect(0, 0, cur_cw, ADDR_H);
+    }
+    paint_seen_scroll = scroll_y;
+    paint_seen_doc_h = doc_h;
+    paint_seen_cw = cur_cw;
+    paint_seen_ch = cur_ch;
+    paint_seen_focus = focus_mode;
+    paint_seen_input = focused_input;
+    paint_seen_addr = addr_h;
+    paint_seen_addr_cursor = addr_cursor;
+    paint_seen_hist = hist;
+    /* Status text: the hovered link's URL wins over status_msg, same
+     * choice draw_status_bar makes.*/
+    char *m = status_msg;
+    if (hover_link >= 0 && hover_link < links_count) {
+        m = attr_pool + link_url_off[hover_link];
+    }
+    int diff = 0;
+    k = 0;
+    while (k < 79) {
+        if (paint_seen_status[k] != m[k]) { diff = 1; paint_seen_status[k] = m[k]; }
+        if (!m[k]) break;
+        k = k + 1;
+    }
+    paint_seen_status[79] = 0;
+    if (diff) paint_invalidate_rect(0, cur_ch - STATUS_H, cur_cw, STATUS_H);
+}
+
 int rt_screen_x(int n) {
     /* Walk parent chain summing x offsets; viewport_x() is the page
      * origin. rt_is_oof nodes hold absolute document-space coords (set
@@ -123,7 +281,7 @@ int rt_screen_y(int n) {
     return y + viewport_y() - sub;
 }
 
-/* Box decoration (shadow + bg + border). Split out from paint_rt_node so
+/* Box decoration (shadow + bg + border). Split out from dl_paint_item so
  * border-radius and box-shadow live in one place; matches the structure of
  * Blink's BoxPainter::paintBoxDecorationBackground.*/
 void paint_rt_box_decoration(int n, int sx, int sy, int w, int h) {
@@ -366,38 +524,165 @@ void paint_rt_content(int n, int sx, int sy) {
     }
 }
 
-void paint_rt_node(int n) {
+/* §6 Display list. Resolving rt_screen_x/y for every box on every
+ * repaint made scrolling cost the whole document, so dl_build walks the
+ * render tree once per layout, recording each box with its position and
+ * vertical bounds, and render() replays only the items that meet the
+ * repaint rect. Items go in paint order, so
+ * replaying a subset in index order keeps the stacking order of the
+ * full walk.*/
+
+/* Like rt_screen_y: does n's chain end at a position:fixed box? */
+int rt_screen_fixed(int n) {
+    int cur = n;
+    while (cur >= 0) {
+        if (rt_is_fixed[cur]) return 1;
+        if (rt_is_oof[cur]) return 0;
+        cur = rt_parent[cur];
+    }
+    return 0;
+}
+
+/* text-align shift for a line box. la_x is stored line-cx relative and
+ * atoms pack from the left. To center / right-align, compute the visible
+ * content width (rightmost atom's la_x + width) and shift every atom by
+ * (line_w - content_w) or its half. CSS 2.1 §16.2.
+ * Reference: blink/Source/core/rendering/RenderBlockLineLayout.cpp
+ * (computeInlineDirectionPositionsForLine + setInlineBoxesAlignment).*/
+int line_align_shift(int n) {
+    int align = cs_text_align[rt_style[n]];
+    if (align == TA_LEFT) return 0;
+    int first = rt_line_atom_first[n];
+    int count = rt_line_atom_count[n];
+    int content_w = 0;
+    int k;
+    for (k = first; k < first + count; k = k + 1) {
+        if (la_x[k] < 0) continue;
+        int rightmost = la_x[k] + la_w[k];
+        if (rightmost > content_w) content_w = rightmost;
+    }
+    int slack = rt_w[n] - content_w;
+    if (slack < 0) slack = 0;
+    if (align == TA_CENTER) return slack / 2;
+    if (align == TA_RIGHT) return slack;
+    return 0;
+}
+
+int dl_cur_clip;
+
+void dl_emit(int n, int sx, int sy) {
+    if (dl_count >= MAX_RT_NODES) return;
+    int i = dl_count;
+    dl_count = dl_count + 1;
+    int cs = rt_style[n];
+    /* 2px slack covers glyph overhang and the focus ring. */
+    int top = sy - 2;
+    int bot = sy + rt_h[n] + 2;
+    if (cs_shadow_has[cs]) {
+        if (cs_shadow_dy[cs] < 0) top = top + cs_shadow_dy[cs];
+        else                      bot = bot + cs_shadow_dy[cs];
+    }
+    if (rt_kind[n] == RT_LIST_MARKER) {
+        /* Markers are zero-height; the glyph hangs off the li's first line. */
+        int fs = cs_font_size_px[rt_style[rt_parent[n]]];
+        if (fs <= 0) fs = 14;
+        if (bot < sy + fs + 4) bot = sy + fs + 4;
+    }
+    dl_n[i] = n;
+    dl_x[i] = sx;
+    dl_y[i] = sy;
+    dl_y0[i] = top;
+    dl_y1[i] = bot;
+    dl_clip[i] = dl_cur_clip;
+    dl_fixed[i] = rt_screen_fixed(n);
+}
+
+/* Push an overflow:hidden clip, intersected with the one in force. The
+ * table is full -> keep the outer clip, which only loosens trimming.*/
+void dl_clip_enter(int x, int y, int w, int h) {
+    if (dlc_count >= MAX_DL_CLIPS) return;
+    int p = dl_cur_clip;
+    if (p >= 0) {
+        int x1 = x + w;
+        int y1 = y + h;
+        if (x < dlc_x[p]) x = dlc_x[p];
+        if (y < dlc_y[p]) y = dlc_y[p];
+        if (x1 > dlc_x[p] + dlc_w[p]) x1 = dlc_x[p] + dlc_w[p];
+        if (y1 > dlc_y[p] + dlc_h[p]) y1 = dlc_y[p] + dlc_h[p];
+        w = x1 - x; if (w < 0) w = 0;
+        h = y1 - y; if (h < 0) h = 0;
+    }
+    dlc_x[dlc_count] = x;
+    dlc_y[dlc_count] = y;
+    dlc_w[dlc_count] = w;
+    dlc_h[dlc_count] = h;
+    dl_cur_clip = dlc_count;
+    dlc_count = dlc_count + 1;
+}
+
+/* Skip rule shared by both child passes of dl_build_node. */
+int dl_child_skipped(int c) {
+    int ck = rt_kind[c];
+    int c_cs = rt_style[c];
+    /* Inline-level children (RT_INLINE/TEXT/INLINE_BLOCK and inline
+     * RT_REPLACED) were absorbed into RT_LINE_BOX siblings; the line box
+     * emits the replaced / inline-block ones itself. But a BLOCK-level
+     * RT_REPLACED (e.g. <img display:block>) lays out as its own block
+     * child rather than going into a line box, so emit it directly.*/
+    if (ck == RT_INLINE || ck == RT_TEXT || ck == RT_INLINE_BLOCK) return 1;
+    if (ck == RT_REPLACED && cs_display[c_cs] != DISP_BLOCK) return 1;
+    /* Out-of-flow positioned children are emitted in a separate z-index-
+     * ordered pass at the document root after the in-flow walk; skip
+     * them here. Reference: blink/Source/core/paint/PaintLayerPainter
+     * paintLayerWithEffects + sortByZOrder.*/
+    if (rt_is_stack[c]) return 1;
+    return 0;
+}
+
+/* Emit n and its subtree: decoration + content, then children. */
+void dl_build_node(int n) {
     int sx = rt_screen_x(n);
     int sy = rt_screen_y(n);
     int w  = rt_w[n];
     int h  = rt_h[n];
-
     int cs = rt_style[n];
 
-    /* Off-screen cull */
-    if (sy + h < viewport_y()) return;
-    if (sy > viewport_y() + viewport_h()) return;
-
-    paint_rt_box_decoration(n, sx, sy, w, h);
-    paint_rt_content(n, sx, sy);
+    dl_emit(n, sx, sy);
 
-    /* Push a clip rect for overflow:hidden so descendant paints are
-     * trimmed to the content area. Match Blink's RenderLayer clip-rect
-     * behaviour for non-stacking-context overflow clip: clip to the
-     * border box (we don't yet inset by border width).*/
-    int clip_pushed = 0;
-    if (cs_overflow[cs] == OVERFLOW_HIDDEN) {
-        paint_clip_push(sx, sy, w, h);
-        clip_pushed = 1;
+    if (rt_kind[n] == RT_LINE_BOX) {
+        /* Replaced / inline-block atoms. Stash document-space x/y on the
+         * rt node so rt_screen_x/y land it at the line origin:
+         * rt_screen_y sums ancestor rt_y values then adds
+         * viewport_y-scroll_y, so rt_y[child] = sy - rt_screen_y(parent)
+         * makes rt_screen_y(child) == sy exactly. Hit-testing reads the
+         * same values. Width/height come from the intrinsic stash;
+         * render_tree.cc sets these for <input>, <img>, <button> and
+         * rt_alloc zeroes rt_w/h for everything else, so
+         * paint_rt_replaced was drawing 0x0 invisible boxes (input row
+         * "missing or clipped" bug). Each atom becomes its own items
+         * right after the line's text.*/
+        int first = rt_line_atom_first[n];
+        int count = rt_line_atom_count[n];
+        int shift = line_align_shift(n);
+        int k;
+        for (k = first; k < first + count; k = k + 1) {
+            if (la_x[k] < 0 || la_text_off[k] >= 0) continue;
+            int rt_n = -la_text_off[k] - 1;
+            rt_x[rt_n] = sx + la_x[k] + shift - rt_screen_x(rt_parent[rt_n]);
+            rt_y[rt_n] = sy - rt_screen_y(rt_parent[rt_n]);
+            if (rt_intrinsic_w[rt_n] > 0) rt_w[rt_n] = rt_intrinsic_w[rt_n];
+            if (rt_intrinsic_h[rt_n] > 0) rt_h[rt_n] = rt_intrinsic_h[rt_n];
+            dl_build_node(rt_n);
+        }
     }
 
-    /* Children. Inline subtrees (RT_INLINE/RT_TEXT/RT_INLINE_BLOCK/
-     * RT_REPLACED) were absorbed into RT_LINE_BOX siblings during
-     * flush_inline; LINE_BOX paint walks the atom slice and re-enters
-     * replaced/inline-block via la_text_off < 0. Skip them here to avoid
-     * double-paint.
-     *
-     * Two-pass to honour CSS 2.1 §E.2 stacking order: in-flow block
+    /* Clip descendants for overflow:hidden. Match Blink's RenderLayer
+     * clip-rect behaviour for non-stacking-context overflow clip: clip
+     * to the border box (we don't yet inset by border width).*/
+    int saved_clip = dl_cur_clip;
+    if (cs_overflow[cs] == OVERFLOW_HIDDEN) dl_clip_enter(sx, sy, w, h);
+
+    /* Two-pass to honour CSS 2.1 §E.2 stacking order: in-flow block
      * backgrounds + line content paint first, then floats paint over
      * them (floats sit at stacking level 4, in-flow non-positioned
      * blocks at level 3). Without this, a wide block's background
@@ -407,58 +692,193 @@ void paint_rt_node(int n) {
      * paintBackgroundForFragments / paintFloats / paintForeground.*/
     int c = rt_first_child[n];
     while (c >= 0) {
-        int ck = rt_kind[c];
-        int c_cs = rt_style[c];
-        /* Inline-level children (RT_INLINE/TEXT/INLINE_BLOCK and inline
-         * RT_REPLACED) were absorbed into RT_LINE_BOX siblings; skip
-         * them here and let LINE_BOX paint walk the atom slice. But a
-         * BLOCK-level RT_REPLACED (e.g. <img display:block>) lays out
-         * as its own block child rather than going into a line box, so
-         * paint it directly.*/
-        int is_inline_atom_kind = (ck == RT_INLINE || ck == RT_TEXT ||
-                                   ck == RT_INLINE_BLOCK ||
-                                   (ck == RT_REPLACED &&
-                                    cs_display[c_cs] != DISP_BLOCK));
-        if (is_inline_atom_kind) {
-            c = rt_next[c]; continue;
-        }
-        /* Out-of-flow positioned children paint in a separate z-index-
-         * ordered pass at the document root after the in-flow walk; skip
-         * them here. Reference: blink/Source/core/paint/PaintLayerPainter
-         * paintLayerWithEffects + sortByZOrder.*/
-        if (rt_is_stack[c]) {
-            c = rt_next[c]; continue;
-        }
-        int is_float_child = (rt_dom[c] >= 0) && (cs_float[c_cs] != FLOAT_NONE);
-        if (is_float_child) {
-            c = rt_next[c]; continue;
+        if (!dl_child_skipped(c) &&
+            !(rt_dom[c] >= 0 && cs_float[rt_style[c]] != FLOAT_NONE)) {
+            dl_build_node(c);
         }
-        paint_rt_node(c);
         c = rt_next[c];
     }
     c = rt_first_child[n];
     while (c >= 0) {
-        int ck = rt_kind[c];
-        int c_cs = rt_style[c];
-        int is_inline_atom_kind = (ck == RT_INLINE || ck == RT_TEXT ||
-                                   ck == RT_INLINE_BLOCK ||
-                                   (ck == RT_REPLACED &&
-                                    cs_display[c_cs] != DISP_BLOCK));
-        if (is_inline_atom_kind) {
-            c = rt_next[c]; continue;
+        if (!dl_child_skipped(c) &&
+            rt_dom[c] >= 0 && cs_float[rt_style[c]] != FLOAT_NONE) {
+            dl_build_node(c);
         }
-        if (rt_is_stack[c]) {
-            c = rt_next[c]; continue;
+        c = rt_next[c];
+    }
+
+    dl_cur_clip = saved_clip;
+}
+
+int dl_band_of(int y) {
+    int b = (y - viewport_y()) / DL_BAND_H;
+    if (y < viewport_y()) b = 0;
+    if (b >= MAX_DL_BANDS) b = MAX_DL_BANDS - 1;
+    return b;
+}
+
+/* Bucket every scrolling item into each band its bounds overlap, in
+ * item order so each band's list stays sorted.*/
+void dl_index_bands() {
+    int i;
+    int b;
+    dl_band_count = 1;
+    for (i = 0; i < dl_count; i = i + 1) {
+        if (dl_fixed[i]) continue;
+        b = dl_band_of(dl_y1[i] - 1) + 1;
+        if (b > dl_band_count) dl_band_count = b;
+    }
+    for (b = 0; b < dl_band_count; b = b + 1) dlb_count[b] = 0;
+    int total = 0;
+    for (i = 0; i < dl_count; i = i + 1) {
+        if (dl_fixed[i]) continue;
+        int b1 = dl_band_of(dl_y1[i] - 1);
+        for (b = dl_band_of(dl_y0[i]); b <= b1; b = b + 1) {
+            dlb_count[b] = dlb_count[b] + 1;
+            total = total + 1;
         }
-        int is_float_child = (rt_dom[c] >= 0) && (cs_float[c_cs] != FLOAT_NONE);
-        if (!is_float_child) {
-            c = rt_next[c]; continue;
+    }
+    dl_linear = (total > MAX_DL_REFS);
+    dl_ref_count = 0;
+    dl_fix_count = 0;
+    if (dl_linear) return;
+    for (b = 0; b < dl_band_count; b = b + 1) {
+        dlb_first[b] = dl_ref_count;
+        dl_ref_count = dl_ref_count + dlb_count[b];
+        dlb_count[b] = 0;
+    }
+    for (i = 0; i < dl_count; i = i + 1) {
+        if (dl_fixed[i]) {
+            dl_fix_list[dl_fix_count] = i;
+            dl_fix_count = dl_fix_count + 1;
+            continue;
         }
-        paint_rt_node(c);
-        c = rt_next[c];
+        int b1 = dl_band_of(dl_y1[i] - 1);
+        for (b = dl_band_of(dl_y0[i]); b <= b1; b = b + 1) {
+            dl_ref[dlb_first[b] + dlb_count[b]] = i;
+            dlb_count[b] = dlb_count[b] + 1;
+        }
+    }
+}
+
+void dl_build() {
+    int t0 = uptime_ms();
+    dl_count = 0;
+    dlc_count = 0;
+    dl_cur_clip = -1;
+    dl_dirty = 0;
+    if (rt_count <= 0) {
+        dl_index_bands();
+        return;
+    }
+    /* Record positions at scroll 0; replay subtracts the live scroll_y. */
+    int saved_scroll = scroll_y;
+    scroll_y = 0;
+    dl_build_node(0);
+
+    /* Out-of-flow positioned subtrees go AFTER the in-flow walk, in
+     * z-index ascending order (document order as the stable tiebreaker).
+     * Insertion sort runs in-place on rt_oof_list; layout rebuilds the
+     * list each render-tree pass so the mutation never leaks across
+     * frames. Reference:
+     * blink/Source/core/paint/PaintLayerStackingNode.cpp
+     * PaintLayerStackingNode::dirtyZOrderLists + sort by z-index.*/
+    int oof_n = rt_oof_count;
+    int oi;
+    for (oi = 1; oi < oof_n; oi = oi + 1) {
+        int key_n = rt_oof_list[oi];
+        int key_z = cs_z_index[rt_style[key_n]];
+        int oj = oi - 1;
+        while (oj >= 0 && cs_z_index[rt_style[rt_oof_list[oj]]] > key_z) {
+            rt_oof_list[oj + 1] = rt_oof_list[oj];
+            oj = oj - 1;
+        }
+        rt_oof_list[oj + 1] = key_n;
+    }
+    for (oi = 0; oi < oof_n; oi = oi + 1) {
+        dl_cur_clip = -1;
+        dl_build_node(rt_oof_list[oi]);
+    }
+    scroll_y = saved_scroll;
+    dl_index_bands();
+    serial_printf("[browser] display list: %d items, %d refs, %d bands, %d ms\n",
+                  dl_count, dl_ref_count, dl_band_count, uptime_ms() - t0);
+}
+
+/* Items run in index order, so consecutive items usually share a clip;
+ * only switch the clip stack when it changes.*/
+int dl_replay_clip;
+
+void dl_paint_item(int i) {
+    int n = dl_n[i];
+    int off = dl_fixed[i] ? 0 : scroll_y;
+    int c = dl_clip[i];
+    if (c != dl_replay_clip) {
+        if (dl_replay_clip >= 0) paint_clip_pop();
+        if (c >= 0) paint_clip_push(dlc_x[c], dlc_y[c] - off, dlc_w[c], dlc_h[c]);
+        dl_replay_clip = c;
     }
+    int sy = dl_y[i] - off;
+    paint_rt_box_decoration(n, dl_x[i], sy, rt_w[n], rt_h[n]);
+    paint_rt_content(n, dl_x[i], sy);
+}
 
-    if (clip_pushed) paint_clip_pop();
+int dl_item_hits(int i, int y0, int y1) {
+    int off = dl_fixed[i] ? 0 : scroll_y;
+    return dl_y1[i] - off > y0 && dl_y0[i] - off < y1;
+}
+
+/* Replay the items that meet screen rows [y0, y1): merge the lists of
+ * the bands covering those rows with the fixed list, taking the lowest
+ * item index at each step so paint order holds and an item listed in
+ * two bands paints once. The clip stack must already hold the repaint
+ * rect at its root.*/
+void dl_replay(int y0, int y1) {
+    int cur[16];
+    int end[16];
+    int nb = 0;
+    int i;
+    dl_replay_clip = -1;
+    if (!dl_linear) {
+        int b0 = dl_band_of(y0 + scroll_y);
+        int b1 = dl_band_of(y1 - 1 + scroll_y);
+        if (b1 >= dl_band_count) b1 = dl_band_count - 1;
+        if (b1 - b0 + 1 > 15) {
+            nb = -1;
+        } else {
+            int b;
+            for (b = b0; b <= b1; b = b + 1) {
+                cur[nb] = dlb_first[b];
+                end[nb] = dlb_first[b] + dlb_count[b];
+                nb = nb + 1;
+            }
+        }
+    }
+    if (dl_linear || nb < 0) {
+        for (i = 0; i < dl_count; i = i + 1) {
+            if (dl_item_hits(i, y0, y1)) dl_paint_item(i);
+        }
+    } else {
+        int fc = 0;
+        while (1) {
+            int best = -1;
+            int j;
+            for (j = 0; j < nb; j = j + 1) {
+                if (cur[j] < end[j] && (best < 0 || dl_ref[cur[j]] < best))
+                    best = dl_ref[cur[j]];
+            }
+            if (fc < dl_fix_count && (best < 0 || dl_fix_list[fc] < best))
+                best = dl_fix_list[fc];
+            if (best < 0) break;
+            for (j = 0; j < nb; j = j + 1) {
+                if (cur[j] < end[j] && dl_ref[cur[j]] == best) cur[j] = cur[j] + 1;
+            }
+            if (fc < dl_fix_count && dl_fix_list[fc] == best) fc = fc + 1;
+            if (dl_item_hits(best, y0, y1)) dl_paint_item(best);
+        }
+    }
+    if (dl_replay_clip >= 0) paint_clip_pop();
+    dl_replay_clip = -1;
 }
 
 void paint_rt_text(int n, int sx, int sy) {
@@ -495,30 +915,12 @@ void paint_rt_text(int n, int sx, int sy) {
 void paint_rt_line_box(int n, int sx, int sy) {
     int first = rt_line_atom_first[n];
     int count = rt_line_atom_count[n];
-    /* Per-line text-align: la_x is stored line-cx relative and atoms
-     * pack from the left. To center / right-align, compute the visible
-     * content width (rightmost atom's la_x + width) and shift every
-     * atom by (line_w - content_w) or its half. CSS 2.1 §16.2.
-     * Reference: blink/Source/core/rendering/RenderBlockLineLayout.cpp
-     * (computeInlineDirectionPositionsForLine + setInlineBoxesAlignment).*/
-    int line_cs = rt_style[n];
-    int align = cs_text_align[line_cs];
-    int align_shift = 0;
-    if (align != TA_LEFT) {
-        int content_w = 0;
-        int kk;
-        for (kk = first; kk < first + count; kk = kk + 1) {
-            if (la_x[kk] < 0) continue;
-            int rightmost = la_x[kk] + la_w[kk];
-            if (rightmost > content_w) content_w = rightmost;
-        }
-        int slack = rt_w[n] - content_w;
-        if (slack < 0) slack = 0;
-        if (align == TA_CENTER) align_shift = slack / 2;
-        else if (align == TA_RIGHT) align_shift = slack;
-    }
+    int align_shift = line_align_shift(n);
     for (int k = first; k < first + count; k++) {
         if (la_x[k] < 0) continue;       /* sentinel atom - break point not painted */
+        /* Replaced/inline-block reference: dl_build placed it and gave
+         * it display-list items of its own.*/
+        if (la_text_off[k] < 0) continue;
         int ax = sx + la_x[k] + align_shift;
         int tier = la_font_tier[k];
         /* Center glyph vertically in the line box: line_h is taller than the
@@ -527,24 +929,6 @@ void paint_rt_line_box(int n, int sx, int sy) {
          * baseline-anchored.*/
         int glyph_h = (tier >= 3) ? 16 : 8;
         int ay = sy + (rt_h[n] - glyph_h) / 2;
-        if (la_text_off[k] < 0) {
-            /* Replaced/inline-block reference. Stash document-space x/y on
-             * the rt node so paint_rt_node's rt_screen_x/y land it at the
-             * line origin: rt_screen_y sums ancestor rt_y values then adds
-             * viewport_y-scroll_y, so rt_y[child] = sy - rt_screen_y(parent)
-             * makes rt_screen_y(child) == sy exactly. Width/height come
-             * from the intrinsic stash; render_tree.cc sets these for
-             * <input>, <img>, <button> and rt_alloc zeroes rt_w/h for
-             * everything else, so paint_rt_replaced was drawing 0x0
-             * invisible boxes (input row "missing or clipped" bug).*/
-            int rt_n = -la_text_off[k] - 1;
-            rt_x[rt_n] = sx + la_x[k] + align_shift - rt_screen_x(rt_parent[rt_n]);
-            rt_y[rt_n] = sy - rt_screen_y(rt_parent[rt_n]);
-            if (rt_intrinsic_w[rt_n] > 0) rt_w[rt_n] = rt_intrinsic_w[rt_n];
-            if (rt_intrinsic_h[rt_n] > 0) rt_h[rt_n] = rt_intrinsic_h[rt_n];
-            paint_rt_node(rt_n);
-            continue;
-        }
         int fg = la_fg[k];
         if (fg < 0) fg = 0x000000;
         int bg = la_bg[k];
@@ -774,6 +1158,10 @@ void paint_rt_replaced(int n, int sx, int sy) {
             char *iv = input_value + ii * 128;
             int tx = sx + 3 + inset;
             int ty = sy + 2 + inset;
+            /* Keep the value inside the control: a keystroke repaints
+             * only this box, so text spilling past it would never be
+             * erased.*/
+            paint_clip_push(sx, sy, rt_w[n], rt_h[n]);
             gfx2d_text(tx, ty, iv, 0x000000, 0);
             if (is_focused) {
                 /* Caret at end of text. Width measured via gfx2d so it
@@ -782,6 +1170,7 @@ void paint_rt_replaced(int n, int sx, int sy) {
                 int cx = tx + tw;
                 gfx2d_rect_fill(cx, ty, 1, 10, 0x000000);
             }
+            paint_clip_pop();
         }
         return;
     }
@@ -952,10 +1341,11 @@ void draw_scrollbar(int sx, int sy) {
  * index, so we scan for T_HTML / T_BODY by tag.
  *
  * Side effect: when body's bg is consumed by the canvas (html had none),
- * set doc_bg_suppress_body so paint_rt_node skips body's own bg paint -
- * otherwise body would paint a second, smaller (margin-inset) rect of
- * the same color, which is wrong if html bg is later set or if the body
- * has a non-default border.*/
+ * set doc_bg_suppress_body so paint_rt_box_decoration skips body's own
+ * bg paint - otherwise body would paint a second, smaller (margin-inset)
+ * rect of the same color, which is wrong if html bg is later set or if
+ * the body has a non-default border. This scans every node, so render()
+ * calls it on full repaints only and keeps the result in paint_doc_bg.*/
 int document_bg() {
     int html_bg = -1;
     int body_bg = -1;
@@ -970,68 +1360,125 @@ int document_bg() {
     return page_bg;
 }
 
-void render() {
-    if (gui_win_begin_paint(win) != 0) return;
-    /* Drawing inside begin_paint targets the window's offscreen surface
-     * which has its own (0,0) origin; do NOT use gui_win_content_x/y
-     * here.  Mouse handlers translate screen coords back to surface coords
-     * separately.*/
-    int cx = 0;
-    int cy = 0;
+/* Repaint screen rect (x, y, w, h) from scratch: every layer below is
+ * clipped to it.*/
+void paint_region(int x, int y, int w, int h) {
+    gfx2d_clip_set(x, y, w, h);
 
     /* Surface background (covers everything before chrome paints over) */
-    gfx2d_rect_fill(cx, cy, cur_cw, cur_ch, page_bg);
+    gfx2d_rect_fill(0, 0, cur_cw, cur_ch, page_bg);
 
     /* Document background: html bg, then body bg, then white. Filled across
      * the full web viewport so a centered body still sits over its
      * propagated page color (CSS canvas-painting rule).*/
-    int doc_color = document_bg();
-    gfx2d_rect_fill(cx + viewport_x(), cy + viewport_y(),
-                    cur_cw, viewport_h(), doc_color);
+    gfx2d_rect_fill(viewport_x(), viewport_y(), cur_cw, viewport_h(), paint_doc_bg);
 
     /* address bar */
-    draw_address_bar(cx, cy, cur_cw);
+    draw_address_bar(0, 0, cur_cw);
 
-    /* viewport (clipped) - paint the render tree into the content area.
+    /* viewport (clipped) - replay the display list into the content area.
      * paint_clip_init seeds the userland clip stack so OVERFLOW_HIDDEN
      * pushes intersect with the viewport rect.*/
-    int vx = cx + viewport_x();
-    int vy = cy + viewport_y();
-    paint_clip_init(vx, vy, cur_cw - 12, viewport_h());
-
-    if (rt_count > 0) paint_rt_node(0);
-
-    /* Out-of-flow positioned subtrees paint AFTER the in-flow walk, in
-     * z-index ascending order (document order as the stable tiebreaker).
-     * Insertion sort runs in-place on rt_oof_list; layout rebuilds the
-     * list each render-tree pass so the mutation never leaks across
-     * frames. Reference:
-     * blink/Source/core/paint/PaintLayerStackingNode.cpp
-     * PaintLayerStackingNode::dirtyZOrderLists + sort by z-index.*/
-    int oof_n = rt_oof_count;
-    int oi;
-    for (oi = 1; oi < oof_n; oi = oi + 1) {
-        int key_n = rt_oof_list[oi];
-        int key_z = cs_z_index[rt_style[key_n]];
-        int oj = oi - 1;
-        while (oj >= 0 && cs_z_index[rt_style[rt_oof_list[oj]]] > key_z) {
-            rt_oof_list[oj + 1] = rt_oof_list[oj];
-            oj = oj - 1;
-        }
-        rt_oof_list[oj + 1] = key_n;
+    int vx = viewport_x();
+    int vy = viewport_y();
+    int vx1 = vx + cur_cw - 12;
+    int vy1 = vy + viewport_h();
+    if (vx < x) vx = x;
+    if (vy < y) vy = y;
+    if (vx1 > x + w) vx1 = x + w;
+    if (vy1 > y + h) vy1 = y + h;
+    if (vx1 > vx && vy1 > vy && rt_count > 0) {
+        paint_clip_init(vx, vy, vx1 - vx, vy1 - vy);
+        dl_replay(vy, vy1);
     }
-    for (oi = 0; oi < oof_n; oi = oi + 1) paint_rt_node(rt_oof_list[oi]);
 
-    gfx2d_clip_clear();
+    gfx2d_clip_set(x, y, w, h);
 
     /* scrollbar */
-    draw_scrollbar(cx, cy + viewport_y());
+    draw_scrollbar(0, viewport_y());
 
     /* status bar */
-    draw_status_bar(cx, cy + cur_ch - STATUS_H, cur_cw);
+    draw_status_bar(0, cur_ch - STATUS_H, cur_cw);
 
-    gui_win_end_paint(win);
-    gui_win_present(win);
+    gfx2d_clip_clear();
+}
+
+void render() {
+    paint_check_chrome();
+    if (!paint_full && paint_dmg_w <= 0 && paint_scroll_dy == 0) return;
+    if (gui_win_begin_paint(win) != 0) return;
+    /* Drawing inside begin_paint targets the window's offscreen surface
+     * which has its own (0,0) origin; do NOT use gui_win_content_x/y
+     * here.  Mouse handlers translate screen coords back to surface coords
+     * separately.*/
+    int t0 = uptime_ms();
+    if (dl_dirty) dl_build();
+
+    /* A scroll reuses the pixels already on the surface, which only works
+     * when nothing else in the viewport changed and no fixed box has to
+     * stay put while the page moves under it.*/
+    int vy = viewport_y();
+    int vh = viewport_h();
+    int sdy = paint_scroll_dy;
+    int blit = 0;
+    if (sdy != 0 && !paint_full) {
+        int ady = sdy < 0 ? -sdy : sdy;
+        int dmg_in_view = (paint_dmg_w > 0 && paint_dmg_y < vy + vh &&
+                           paint_dmg_y + paint_dmg_h > vy);
+        if (ady < vh && dl_fix_count == 0 && !dl_linear && !dmg_in_view) blit = 1;
+        else paint_full = 1;
+    }
+    paint_scroll_dy = 0;
+
+    /* The surface keeps the last frame, so a partial repaint clips every
+     * layer below to the damage rect and redraws only that.*/
+    int full = paint_full;
+    int dx = full ? 0 : paint_dmg_x;
+    int dy = full ? 0 : paint_dmg_y;
+    int dw = full ? cur_cw : paint_dmg_w;
+    int dh = full ? cur_ch : paint_dmg_h;
+    paint_full = 0;
+    paint_dmg_w = 0;
+    if (full) paint_doc_bg = document_bg();
+
+    if (blit) {
+        /* Move the page content (not the scrollbar column), then paint
+         * the strip that scrolled in and the scrollbar.*/
+        int vw = cur_cw - 12;
+        gfx2d_clip_clear();
+        gfx2d_scroll_rect(viewport_x(), vy, vw, vh, -sdy);
+        int ady = sdy < 0 ? -sdy : sdy;
+        int strip_y = sdy > 0 ? vy + vh - ady : vy;
+        paint_region(viewport_x(), strip_y, vw, ady);
+        paint_region(viewport_x() + vw, vy, 12, vh);
+        if (dw > 0) paint_region(dx, dy, dw, dh);
+        /* Hand the compositor the viewport plus any chrome damage. */
+        int ux = 0;
+        int uy = vy;
+        int ux1 = cur_cw;
+        int uy1 = vy + vh;
+        if (dw > 0) {
+            if (dx < ux) ux = dx;
+            if (dy < uy) uy = dy;
+            if (dx + dw > ux1) ux1 = dx + dw;
+            if (dy + dh > uy1) uy1 = dy + dh;
+        }
+        gui_win_end_paint_rect(win, ux, uy, ux1 - ux, uy1 - uy);
+        gui_win_present(win);
+        serial_printf("[browser] scroll %d: %d ms (%d px strip)\n",
+                      sdy, uptime_ms() - t0, ady);
+    } else {
+        paint_region(dx, dy, dw, dh);
+        if (full) gui_win_end_paint(win);
+        else      gui_win_end_paint_rect(win, dx, dy, dw, dh);
+        gui_win_present(win);
+    }
+
+    if (paint_key_t0 >= 0) {
+        serial_printf("[browser] key->paint: %d ms (%s %dx%d)\n",
+                      uptime_ms() - paint_key_t0, full ? "full" : "rect", dw, dh);
+        paint_key_t0 = -1;
+    }
 }
 
 void error_page(char *msg) {
@@ -1044,6 +1491,7 @@ void error_page(char *msg) {
     page_bg = 0xFFE8E8;
     page_fg = 0x000000;
     doc_h = 40;
+    dl_dirty = 1;
     if (gui_win_begin_paint(win) != 0) return;
     gfx2d_rect_fill(0, 0, cur_cw, cur_ch, page_bg);
     draw_address_bar(0, 0, cur_cw);
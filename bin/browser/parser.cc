@@ -21,6 +21,17 @@ enum {
     ST_RCDATA          /* used inside <title>/<textarea> */
 };
 
+/* §1 tree-builder insertion modes (simplified) */
+enum {
+    IM_INITIAL = 0,
+    IM_IN_HEAD,
+    IM_IN_BODY,
+    IM_IN_TABLE,
+    IM_IN_ROW,
+    IM_IN_CELL,
+    IM_IN_CAPTION
+};
+
 int emit_token(int kind, int tag, int text_off, int text_len,
                int attr_first, int attr_count, int self_close) {
     if (tok_count >= MAX_TOKENS) return -1;
@@ -34,20 +45,45 @@ int emit_token(int kind, int tag, int text_off, int text_len,
     return tok_count++;
 }
 
-void tokenize(int html_len) {
+void tokenize_begin(void) {
     tok_count = 0;
     ap_count  = 0;
-    int state = ST_DATA;
-    int i = 0;
-    int text_start = 0;
-    int tag_start = 0;
-    int tag_is_end = 0;
-    int cur_tag = 0;            /* T_* during ST_TAG_NAME */
-    int cur_attr_first = 0;
-    int cur_attr_count = 0;
-    int cur_self_close = 0;
+    tz_state = ST_DATA;
+    tz_i = 0;
+    tz_text_start = 0;
+    tz_tag_start = 0;
+    tz_tag_is_end = 0;
+    tz_cur_tag = 0;
+    tz_attr_first = 0;
+    tz_attr_count = 0;
+    tz_self_close = 0;
+    tz_scan = 0;
+    tz_done = 0;
+}
+
+/* Tokenize page_buf[0..html_len). Resumable: with eof == 0 the bytes
+ * so far are only a prefix of the page, so the tokenizer stops where
+ * it would need to see past html_len - in the middle of a text run,
+ * before a comment's "-->" or a </script> - and keeps its state in
+ * tz_* for the next call. Nothing is emitted that more input could
+ * change, so feeding a page in pieces gives the same tokens as one
+ * call with eof == 1, which also emits the trailing text and EOF.
+ * Long scans (comments, <script>/<style> bodies) resume at tz_scan
+ * instead of rescanning from the start of the construct.*/
+void tokenize_feed(int html_len, int eof) {
+    if (tz_done) return;
+    int state = tz_state;
+    int i = tz_i;
+    int text_start = tz_text_start;
+    int tag_start = tz_tag_start;
+    int tag_is_end = tz_tag_is_end;
+    int cur_tag = tz_cur_tag;            /* T_* during ST_TAG_NAME */
+    int cur_attr_first = tz_attr_first;
+    int cur_attr_count = tz_attr_count;
+    int cur_self_close = tz_self_close;
 
     while (i <= html_len) {
+        if (i >= html_len && !eof) break;
         int c = (i < html_len) ? (page_buf[i] & 0xFF) : -1;
 
         if (state == ST_DATA) {
@@ -69,6 +105,7 @@ void tokenize(int html_len) {
                     emit_token(TK_TEXT, 0, text_start, i - text_start, 0, 0, 0);
                 }
                 emit_token(TK_EOF, 0, 0, 0, 0, 0, 0);
+                tz_done = 1;
                 return;
             }
             i++;
@@ -97,7 +134,10 @@ void tokenize(int html_len) {
                 continue;
             }
             /* malformed; skip to '>' */
-            while (i < html_len && page_buf[i] != '>') i++;
+            int k = i;
+            while (k < html_len && page_buf[k] != '>') k++;
+            if (k >= html_len && !eof) break;
+            i = k;
             if (i < html_len) i++;
             state = ST_DATA;
             text_start = i;
@@ -226,6 +266,7 @@ void tokenize(int html_len) {
 
         if (state == ST_MARKUP_DECL) {
             /* If next two bytes are "--", it's a comment; otherwise treat as DOCTYPE-like */
+            if (i + 1 >= html_len && !eof) break;
             if (i + 1 < html_len && page_buf[i] == '-' && page_buf[i+1] == '-') {
                 state = ST_COMMENT;
                 i += 2;
@@ -237,18 +278,24 @@ void tokenize(int html_len) {
 
         if (state == ST_COMMENT) {
             /* skip until '-->' */
-            while (i + 2 < html_len &&
-                   !(page_buf[i] == '-' && page_buf[i+1] == '-' && page_buf[i+2] == '>')) {
-                i++;
+            int k = (tz_scan > i) ? tz_scan : i;
+            while (k + 2 < html_len &&
+                   !(page_buf[k] == '-' && page_buf[k+1] == '-' && page_buf[k+2] == '>')) {
+                k++;
             }
-            if (i + 2 < html_len) i += 3; else i = html_len;
+            if (k + 2 >= html_len && !eof) { tz_scan = k; break; }
+            tz_scan = 0;
+            if (k + 2 < html_len) i = k + 3; else i = html_len;
             state = ST_DATA;
             text_start = i;
             continue;
         }
 
         if (state == ST_DOCTYPE) {
-            while (i < html_len && page_buf[i] != '>') i++;
+            int k = i;
+            while (k < html_len && page_buf[k] != '>') k++;
+            if (k >= html_len && !eof) break;
+            i = k;
             if (i < html_len) i++;
             state = ST_DATA;
             text_start = i;
@@ -269,6 +316,7 @@ void tokenize(int html_len) {
             else { state = ST_DATA; continue; }
 
             int t_start = i;
+            if (tz_scan > i) i = tz_scan;
             while (i < html_len) {
                 if (page_buf[i] == '<' && i + 1 + close_name_len < html_len &&
                     page_buf[i+1] == '/' &&
@@ -280,6 +328,20 @@ void tokenize(int html_len) {
                 i++;
             }
             int t_end = i;
+            if (!eof) {
+                /* The close tag, through its '>', must be here before
+                 * the body can be emitted; else resume the scan where a
+                 * split "</name" could still start.*/
+                int k = i + 2 + close_name_len;
+                while (k < html_len && page_buf[k] != '>') k++;
+                if (k >= html_len) {
+                    tz_scan = (i < html_len) ? i : html_len - close_name_len - 2;
+                    if (tz_scan < t_start) tz_scan = t_start;
+                    i = t_start;
+                    break;
+                }
+            }
+            tz_scan = 0;
 
             if (t_end > t_start) {
                 if (state == ST_RCDATA) {
@@ -320,11 +382,23 @@ void tokenize(int html_len) {
         }
 
         /* catch-all fallback: skip to '>' and resume in DATA */
-        while (i < html_len && page_buf[i] != '>') i++;
+        int k = i;
+        while (k < html_len && page_buf[k] != '>') k++;
+        if (k >= html_len && !eof) break;
+        i = k;
         if (i < html_len) i++;
         state = ST_DATA;
         text_start = i;
     }
+    tz_state = state;
+    tz_i = i;
+    tz_text_start = text_start;
+    tz_tag_start = tag_start;
+    tz_tag_is_end = tag_is_end;
+    tz_cur_tag = cur_tag;
+    tz_attr_first = cur_attr_first;
+    tz_attr_count = cur_attr_count;
+    tz_self_close = cur_self_close;
 }
 
 int tag_id(char *name, int len) {
@@ -417,19 +491,16 @@ int is_list_container(int tag) {
     return tag == T_UL || tag == T_OL || tag == T_DL;
 }
 
-/* Build DOM by consuming the token stream produced by tokenize().
+/* Build DOM by consuming the token stream produced by tokenize_feed().
  * Tree builder uses an open-elements stack with simplified insertion modes
- * to drive implicit-close rules per spec §1.
+ * to drive implicit-close rules per spec §1. The stack, mode and next
+ * token live in tb_* between calls, so the DOM grows as tokens arrive.
  *
- * Note: attr_pool_pos is NOT reset here because tokenize() has already
- * interned attr names/values into attr_pool; resetting would invalidate
+ * Note: attr_pool_pos is NOT reset here because the tokenizer interns
+ * attr names/values into attr_pool as it goes; resetting would invalidate
  * those offsets. Whole-page reset of attr_pool_pos happens in error_page()
- * and per-navigation in navigate() before tokenize() starts.*/
-void parse_html(int html_len) {
-    tokenize(html_len);
-    serial_printf("[browser] tokenize: %d tokens, %d attr-pairs\n",
-                  tok_count, ap_count);
-
+ * and per-navigation in navigate() before the tokenizer starts.*/
+void tree_build_begin(void) {
     nodes_count = 0;
     dom_ap_count = 0;
     forms_count = 0;
@@ -445,7 +516,13 @@ void parse_html(int html_len) {
         n_pseudo_after_off [k] = -1;
         n_pseudo_after_len [k] = 0;
         n_checkbox_state   [k] = 0;
+        n_style_dirty      [k] = 0;
     }
+    style_dirty_count = 0;
+    /* Node indices from the previous page mean nothing in this one. */
+    hover_dom_node = -1;
+    prev_hover_dom_node = -1;
+    prev_focus_dom_node = -1;
 
     /* §2 reset CSS state - author rules accumulate per page */
     css_rule_count = 0;
@@ -454,29 +531,28 @@ void parse_html(int html_len) {
     css_has_dynamic_pseudo = 0;
 
     /* synthetic root */
-    int root = alloc_node(T_ROOT, -1, -1);
-
-    int stack[64];
-    int sp = 0;
-    stack[sp] = root;
-    sp = sp + 1;
-
+    tb_root = alloc_node(T_ROOT, -1, -1);
+    tb_stack[0] = tb_root;
+    tb_sp = 1;
     /* Implicit <body> tracking. Tag-soup pages frequently omit
      * <html>/<head>/<body>; when body-flow content arrives at the
      * document root with no <body> in scope, we auto-create one so
      * author `body { ... }` rules can match.*/
-    int body_implicit = -1;
-
-    int IM_INITIAL = 0;
-    int IM_IN_HEAD = 1;
-    int IM_IN_BODY = 2;
-    int IM_IN_TABLE = 3;
-    int IM_IN_ROW = 4;
-    int IM_IN_CELL = 5;
-    int IM_IN_CAPTION = 6;
-    int mode = IM_INITIAL;
-
-    for (int ti = 0; ti < tok_count; ti = ti + 1) {
+    tb_body_implicit = -1;
+    tb_mode = IM_INITIAL;
+    tb_next = 0;
+    tb_link_sheets = 0;
+}
+
+void tree_build_feed(void) {
+    int root = tb_root;
+    int stack[64];
+    int sp = tb_sp;
+    for (int k = 0; k < sp; k = k + 1) stack[k] = tb_stack[k];
+    int body_implicit = tb_body_implicit;
+    int mode = tb_mode;
+
+    for (int ti = tb_next; ti < tok_count; ti = ti + 1) {
         int kind = tok_kind[ti];
         int tag  = tok_tag[ti];
 
@@ -676,6 +752,13 @@ void parse_html(int html_len) {
              * layout.cc; layout resets links_count and rebuilds during
              * each pass.)*/
 
+            /* A stylesheet link is fetched once the document is
+             * complete; until then a partial render would be unstyled.*/
+            if (tag == T_LINK) {
+                char *rel = dom_attr_str(n, "rel");
+                if (rel && b_strieq(rel, "stylesheet")) tb_link_sheets = tb_link_sheets + 1;
+            }
+
             /* register forms */
             if (tag == T_FORM && forms_count < MAX_FORMS) {
                 int a_off = dom_attr_get(n, "action");
@@ -773,7 +856,29 @@ void parse_html(int html_len) {
             continue;
         }
     }
+    tb_next = tok_count;
+    for (int k = 0; k < sp; k = k + 1) tb_stack[k] = stack[k];
+    tb_sp = sp;
+    tb_body_implicit = body_implicit;
+    tb_mode = mode;
+}
+
+/* Start a document. page_buf is then handed over in one or more
+ * parse_feed calls as it fills (the last with eof = 1), and
+ * parse_finish runs the rest of the pipeline.*/
+void parse_begin(void) {
+    tokenize_begin();
+    tree_build_begin();
+}
 
+void parse_feed(int html_len, int eof) {
+    tokenize_feed(html_len, eof);
+    tree_build_feed();
+}
+
+void parse_finish(void) {
+    serial_printf("[browser] tokenize: %d tokens, %d attr-pairs\n",
+                  tok_count, ap_count);
     serial_printf("[browser] css: %d rules, %d sels, %d val-bytes\n",
                   css_rule_count, css_sel_count, css_value_pool_pos);
 
@@ -784,7 +889,9 @@ void parse_html(int html_len) {
 
     populate_sibling_caches();
     style_resolve_all();
-    serial_printf("[browser] style: %d computed entries\n", cs_count);
+    serial_printf("[browser] style: %d computed entries in %d ms (%d chains tried, %d bloom-rejected, %d shared)\n",
+                  cs_count, style_last_ms, style_stat_tested,
+                  style_stat_rejected, style_stat_shared);
 
     build_render_tree();
     serial_printf("[browser] rt: %d nodes\n", rt_count);
@@ -807,3 +914,10 @@ void parse_html(int html_len) {
         }
     }
 }
+
+/* Parse a page that is already complete in page_buf. */
+void parse_html(int html_len) {
+    parse_begin();
+    parse_feed(html_len, 1);
+    parse_finish();
+}
@@ -1,8 +1,15 @@
 /* §3 Render tree builder */
 
 int rt_alloc(int kind, int dom, int parent, int style_cs) {
-    if (rt_count >= MAX_RT_NODES) return -1;
-    int n = rt_count++;
+    int n;
+    if (rt_free_first >= 0) {
+        /* Line boxes dropped by a relayout (rt_free_line_boxes). */
+        n = rt_free_first;
+        rt_free_first = rt_next[n];
+    } else {
+        if (rt_count >= MAX_RT_NODES) return -1;
+        n = rt_count++;
+    }
     rt_dom[n] = dom;
     rt_parent[n] = parent;
     rt_first_child[n] = -1;
@@ -31,6 +38,8 @@ int rt_alloc(int kind, int dom, int parent, int style_cs) {
     rt_input_idx[n] = -1;
     rt_line_atom_first[n] = 0;
     rt_line_atom_count[n] = 0;
+    rt_needs_layout[n] = 1;
+    rt_laid_ok[n] = 0;
     if (parent >= 0) {
         if (rt_first_child[parent] < 0) {
             rt_first_child[parent] = n;
@@ -127,6 +136,7 @@ void build_rt_children(int dom, int rt_parent_n) {
             }
             int rt_t = rt_alloc(RT_TEXT, c, target, c);
             if (rt_t < 0) return;
+            n_rt[c] = rt_t;
             rt_text_off[rt_t] = n_text_off[c];
             rt_text_len[rt_t] = n_text_len[c];
             c = n_next[c];
@@ -181,6 +191,7 @@ int build_rt_subtree(int dom, int rt_parent_n) {
 
     int n = rt_alloc(kind, dom, rt_parent_n, cs_d);
     if (n < 0) return -1;
+    n_rt[dom] = n;
 
     /* For <a>: bind the link index, registering a new entry if this href
      * hasn't been seen yet. (Earlier code relied on layout to register
@@ -297,6 +308,27 @@ int build_rt_subtree(int dom, int rt_parent_n) {
     return n;
 }
 
+/* Unlink n's RT_LINE_BOX children onto the free list. flush_inline adds
+ * a fresh set each time n is laid out, so a relayout drops the old set
+ * first; otherwise paint draws both.*/
+void rt_free_line_boxes(int n) {
+    int prev = -1;
+    int c = rt_first_child[n];
+    while (c >= 0) {
+        int nx = rt_next[c];
+        if (rt_kind[c] == RT_LINE_BOX) {
+            if (prev < 0) rt_first_child[n] = nx;
+            else          rt_next[prev] = nx;
+            rt_parent[c] = -1;
+            rt_next[c] = rt_free_first;
+            rt_free_first = c;
+        } else {
+            prev = c;
+        }
+        c = nx;
+    }
+}
+
 /* Anonymous-table-ancestor wrapping. For Plan 2, table layout is the same as
  * block fallback (no real grid), so anon-table wrappers cosmetically don't
  * matter - they're just additional block boxes. Skip the wrap for Plan 2;
@@ -333,12 +365,15 @@ void rt_collect_oof(int n) {
 
 void build_render_tree() {
     rt_count = 0;
+    rt_free_first = -1;
     rt_oof_count = 0;
     la_count = 0;
+    for (int k = 0; k < nodes_count; k = k + 1) n_rt[k] = -1;
     links_count = 0;     /* rebuilt as <a> nodes are walked below */
     /* Synthetic RT root mirrors DOM root (DOM index 0 = T_ROOT) */
     int root = rt_alloc(RT_BLOCK, 0, -1, 0);
     if (root < 0) return;
+    n_rt[0] = root;
     build_rt_children(0, root);
     rt_anon_table_fixup();
     rt_collect_oof(root);
@@ -6,6 +6,10 @@
  *   - apply_inline_style parses a style="..." attribute body and applies it.
  *   - sel_compound_matches / sel_chain_matches match a CSS selector chain
  *     against a DOM node + ancestor chain (descendant combinator only).
+ *   - css_index_build / style_collect_matches narrow each element to the
+ *     rules bucketed under its tag, id and classes, fast-reject chains
+ *     through an ancestor Bloom filter, and share matched-rule lists
+ *     between identical siblings.
  *   - style_resolve_all walks every DOM node, allocates one ComputedStyle,
  *     and runs UA defaults -> author cascade (specificity, doc-order) ->
  *     inline style -> inheritance from parent.*/
@@ -2290,6 +2294,401 @@ int sel_chain_matches_pseudo(int sel_first, int sel_count, int node, int wanted_
     return sel_chain_walk(sel_first, last, node);
 }
 
+/* Step 5.3b: rule index, ancestor filter, sibling sharing
+ *
+ * css_index_build files every rule under one key from its subject
+ * compound (the rightmost compound plus anything chained onto it with
+ * COMB_SUBSELECTOR): the id if there is one, else a class, else the tag.
+ * Rules with none of those go on the universal list. An element then only
+ * tries the rules under its own tag, id and class tokens plus the
+ * universal list rather than the whole sheet. Reference: Blink's RuleSet
+ * id / class / tag / universal buckets.
+ *
+ * The ancestor filter is a Bloom filter over the tag, id and class keys
+ * of the element's ancestors. Each rule records the keys its
+ * descendant/child compounds need; if one is missing, no ancestor can
+ * match and sel_chain_walk is skipped. Reference: Blink's SelectorFilter.*/
+
+/* ASCII-case-folded FNV-1a over s[0..len), salted by key kind. Selector
+ * matching compares ids and classes case-insensitively, so the keys must
+ * fold case the same way.*/
+int style_hash(char *s, int len, int kind) {
+    int h = kind * 16777619;
+    int c;
+    for (int i = 0; i < len; i = i + 1) {
+        c = s[i];
+        if (c >= 'A' && c <= 'Z') c = c + 32;
+        h = (h ^ c) * 16777619;
+    }
+    return h ^ (h >> 15);
+}
+
+int style_tag_key(int tag) {
+    int h = ((STYLE_KEY_TAG * 16777619) ^ tag) * 16777619;
+    return h ^ (h >> 15);
+}
+
+/* Pseudo-element (PSELT_*) on the tail compound of rule r. */
+int rule_pseudo_elt(int r) {
+    return css_sel_pseudo_elt[css_rule_sel_first[r] + css_rule_sel_count[r] - 1];
+}
+
+/* Best bucket key for compound `s`: id over class over tag. *rank gets
+ * 3/2/1 for the kind found, 0 when the compound names none of them.*/
+int sel_compound_key(int s, int *rank) {
+    char *str;
+    if (css_sel_id_off[s] >= 0) {
+        str = attr_pool + css_sel_id_off[s];
+        *rank = 3;
+        return style_hash(str, b_strlen(str), STYLE_KEY_ID);
+    }
+    if (css_sel_class_off[s] >= 0) {
+        str = attr_pool + css_sel_class_off[s];
+        *rank = 2;
+        return style_hash(str, b_strlen(str), STYLE_KEY_CLASS);
+    }
+    if (css_sel_tag[s] != 0) {
+        *rank = 1;
+        return style_tag_key(css_sel_tag[s]);
+    }
+    *rank = 0;
+    return 0;
+}
+
+/* Record the id / class / tag keys of compound `s` as ancestor
+ * requirements of rule r, up to STYLE_ANC_KEYS in all.*/
+void rule_add_anc_keys(int r, int s) {
+    char *str;
+    int n = css_rule_anc_count[r];
+    if (n < STYLE_ANC_KEYS && css_sel_id_off[s] >= 0) {
+        str = attr_pool + css_sel_id_off[s];
+        css_rule_anc_key[r][n] = style_hash(str, b_strlen(str), STYLE_KEY_ID);
+        n = n + 1;
+    }
+    if (n < STYLE_ANC_KEYS && css_sel_class_off[s] >= 0) {
+        str = attr_pool + css_sel_class_off[s];
+        css_rule_anc_key[r][n] = style_hash(str, b_strlen(str), STYLE_KEY_CLASS);
+        n = n + 1;
+    }
+    if (n < STYLE_ANC_KEYS && css_sel_tag[s] != 0) {
+        css_rule_anc_key[r][n] = style_tag_key(css_sel_tag[s]);
+        n = n + 1;
+    }
+    css_rule_anc_count[r] = n;
+}
+
+/* Build the rule index. Walking the rules backwards and pushing onto the
+ * chain heads leaves every chain in ascending rule order. O(rules), so it
+ * simply runs on every restyle instead of tracking sheet changes.*/
+void css_index_build() {
+    int r;
+    int sf;
+    int sc;
+    int s;
+    int key;
+    int best;
+    int k;
+    int rank;
+    int p;
+    int comb;
+    int anc;
+    int b;
+    for (b = 0; b < STYLE_BUCKETS; b = b + 1) css_bucket_first[b] = -1;
+    css_universal_first = -1;
+    css_dyn_sibling = 0;
+    for (r = css_rule_count - 1; r >= 0; r = r - 1) {
+        sf = css_rule_sel_first[r];
+        sc = css_rule_sel_count[r];
+        /* :hover/:focus on a compound followed by + or ~ (see
+         * style_mark_state_change).*/
+        for (s = sf; s < sf + sc; s = s + 1) {
+            p = css_sel_pseudo[s];
+            if (p != PSEUDO_HOVER && p != PSEUDO_FOCUS) continue;
+            k = s + 1;
+            while (k < sf + sc && css_sel_combinator[k] == COMB_SUBSELECTOR) k = k + 1;
+            if (k < sf + sc) {
+                comb = css_sel_combinator[k];
+                if (comb == COMB_ADJACENT || comb == COMB_GEN_SIBLING) css_dyn_sibling = 1;
+            }
+        }
+        css_rule_anc_count[r] = 0;
+        css_rule_share_unsafe[r] = 0;
+        css_rule_key[r] = 0;
+        if (sc == 0) continue;          /* never matches; leave unfiled */
+        /* Subject compounds, right to left. */
+        s = sf + sc - 1;
+        key = 0;
+        best = 0;
+        while (1) {
+            k = sel_compound_key(s, &rank);
+            if (rank > best) { best = rank; key = k; }
+            p = css_sel_pseudo[s];
+            if (p != PSEUDO_NONE && p != PSEUDO_LINK &&
+                p != PSEUDO_VISITED && p != PSEUDO_ROOT) {
+                css_rule_share_unsafe[r] = 1;
+            }
+            if (s == sf || css_sel_combinator[s] != COMB_SUBSELECTOR) break;
+            s = s - 1;
+        }
+        /* A subject reached through + or ~ depends on its own siblings. */
+        if (s > sf) {
+            comb = css_sel_combinator[s];
+            if (comb == COMB_ADJACENT || comb == COMB_GEN_SIBLING) css_rule_share_unsafe[r] = 1;
+        }
+        /* Ancestor compounds: those reached through > or whitespace.
+         * Compounds behind + or ~ sit on a sibling of the subject or of
+         * an ancestor and are skipped, but that sibling's own ancestors
+         * are the same elements, so collection resumes past them.*/
+        anc = 0;
+        while (s > sf) {
+            comb = css_sel_combinator[s];
+            if (comb == COMB_CHILD || comb == COMB_DESCENDANT) anc = 1;
+            else if (comb != COMB_SUBSELECTOR) anc = 0;
+            s = s - 1;
+            if (anc) rule_add_anc_keys(r, s);
+        }
+        if (best > 0) {
+            css_rule_key[r] = key;
+            b = key & (STYLE_BUCKETS - 1);
+            css_rule_bucket_next[r] = css_bucket_first[b];
+            css_bucket_first[b] = r;
+        } else {
+            css_rule_bucket_next[r] = css_universal_first;
+            css_universal_first = r;
+        }
+    }
+}
+
+/* Fill style_key[] with the element's own keys: tag, id, class tokens.
+ * Sets style_key_full when the class list has more tokens than fit.*/
+void style_node_keys(int node) {
+    char *str;
+    int len;
+    int i;
+    int ws;
+    style_key[0] = style_tag_key(n_tag[node]);
+    style_key_count = 1;
+    style_key_full = 0;
+    if (dom_id_off[node] >= 0) {
+        str = attr_pool + dom_id_off[node];
+        len = b_strlen(str);
+        if (len > 0) {
+            style_key[style_key_count] = style_hash(str, len, STYLE_KEY_ID);
+            style_key_count = style_key_count + 1;
+        }
+    }
+    if (dom_class_off[node] < 0) return;
+    str = attr_pool + dom_class_off[node];
+    len = b_strlen(str);
+    i = 0;
+    while (i < len) {
+        while (i < len && (str[i] == ' ' || str[i] == '\t')) i = i + 1;
+        ws = i;
+        while (i < len && str[i] != ' ' && str[i] != '\t') i = i + 1;
+        if (i == ws) continue;
+        if (style_key_count >= STYLE_KEYS_MAX) { style_key_full = 1; return; }
+        style_key[style_key_count] = style_hash(str + ws, i - ws, STYLE_KEY_CLASS);
+        style_key_count = style_key_count + 1;
+    }
+}
+
+/* Two filter bits per key, taken from separate bytes of the hash. */
+int style_bloom_has(int row, int h) {
+    int base = row * STYLE_BLOOM_WORDS;
+    int b1 = h & 255;
+    int b2 = (h >> 8) & 255;
+    if ((style_bloom[base + (b1 >> 5)] & (1 << (b1 & 31))) == 0) return 0;
+    if ((style_bloom[base + (b2 >> 5)] & (1 << (b2 & 31))) == 0) return 0;
+    return 1;
+}
+
+/* Make row `d` the ancestor filter for children of `p`, a node at depth
+ * d-1 (row 0, for the root, is empty). A document-order walk finds the
+ * parent's row already in place; after DOM surgery puts a child before
+ * its parent the rows are rebuilt from the nearest valid one upward.
+ * Clobbers style_key[].*/
+void style_bloom_fill(int p, int d) {
+    int base = d * STYLE_BLOOM_WORDS;
+    int prev;
+    int w;
+    int k;
+    int b;
+    if (style_bloom_gen[d] == style_pass && style_bloom_owner[d] == p) return;
+    if (d == 0) {
+        for (w = 0; w < STYLE_BLOOM_WORDS; w = w + 1) style_bloom[w] = 0;
+    } else {
+        style_bloom_fill(n_parent[p], d - 1);
+        prev = base - STYLE_BLOOM_WORDS;
+        for (w = 0; w < STYLE_BLOOM_WORDS; w = w + 1) style_bloom[base + w] = style_bloom[prev + w];
+        style_node_keys(p);
+        for (k = 0; k < style_key_count; k = k + 1) {
+            b = style_key[k] & 255;
+            style_bloom[base + (b >> 5)] = style_bloom[base + (b >> 5)] | (1 << (b & 31));
+            b = (style_key[k] >> 8) & 255;
+            style_bloom[base + (b >> 5)] = style_bloom[base + (b >> 5)] | (1 << (b & 31));
+        }
+        /* Keys that did not fit could be anything: saturate. */
+        if (style_key_full) {
+            for (w = 0; w < STYLE_BLOOM_WORDS; w = w + 1) style_bloom[base + w] = -1;
+        }
+    }
+    style_bloom_owner[d] = p;
+    style_bloom_gen[d] = style_pass;
+}
+
+/* Try candidate rule r on `node`, appending it to style_match[] on a hit.
+ * `row` is the node's ancestor-filter row, -1 when it is too deep to have
+ * one. Pseudo-element rules are kept only for `content:`, the one
+ * property resolve_pseudo_content consumes.*/
+void style_try_rule(int r, int node, int row) {
+    int sf = css_rule_sel_first[r];
+    int sc = css_rule_sel_count[r];
+    int pe;
+    int k;
+    pe = css_sel_pseudo_elt[sf + sc - 1];
+    if (pe != PSELT_NONE && css_rule_prop_id[r] != CP_CONTENT) return;
+    if (row >= 0) {
+        for (k = 0; k < css_rule_anc_count[r]; k = k + 1) {
+            if (!style_bloom_has(row, css_rule_anc_key[r][k])) {
+                style_stat_rejected = style_stat_rejected + 1;
+                return;
+            }
+        }
+    }
+    /* A Bloom reject holds for every sibling too (same ancestors), so
+     * only rules that get this far can make the result position-bound.*/
+    if (css_rule_share_unsafe[r]) style_match_unsafe = 1;
+    style_stat_tested = style_stat_tested + 1;
+    if (pe == PSELT_NONE) {
+        if (!sel_chain_matches(sf, sc, node)) return;
+    } else {
+        if (!sel_chain_matches_pseudo(sf, sc, node, pe)) return;
+    }
+    style_match[style_match_count] = r;
+    style_match_count = style_match_count + 1;
+}
+
+/* Collect the rules matching `node` into style_match[], in rule order.
+ * Expects style_key[] to hold the node's keys. The candidate chains (one
+ * per key, plus the universal list) are each sorted, so a k-way merge
+ * yields candidates in rule order; heads sitting on the same rule
+ * advance together, which drops duplicates from keys that share a
+ * bucket.*/
+void style_match_rules(int node, int row) {
+    int head[17];
+    int hkey[17];
+    int nh = 0;
+    int h;
+    int r;
+    int best;
+    style_match_count = 0;
+    style_match_unsafe = 0;
+    if (style_key_full) {
+        for (r = 0; r < css_rule_count; r = r + 1) {
+            if (css_rule_sel_count[r] > 0) style_try_rule(r, node, row);
+        }
+        return;
+    }
+    for (h = 0; h < style_key_count; h = h + 1) {
+        head[nh] = css_bucket_first[style_key[h] & (STYLE_BUCKETS - 1)];
+        hkey[nh] = style_key[h];
+        nh = nh + 1;
+    }
+    /* Universal list last: its head skips no entries. */
+    head[nh] = css_universal_first;
+    nh = nh + 1;
+    while (1) {
+        best = -1;
+        for (h = 0; h < nh; h = h + 1) {
+            r = head[h];
+            if (h < nh - 1) {
+                while (r >= 0 && css_rule_key[r] != hkey[h]) r = css_rule_bucket_next[r];
+                head[h] = r;
+            }
+            if (r >= 0 && (best < 0 || r < best)) best = r;
+        }
+        if (best < 0) break;
+        for (h = 0; h < nh; h = h + 1) {
+            if (head[h] == best) head[h] = css_rule_bucket_next[best];
+        }
+        style_try_rule(best, node, row);
+    }
+}
+
+/* Same tag and the same attributes in the same order (compared the way
+ * the matchers compare them: case-insensitively). Together with a shared
+ * parent this makes every share-safe rule match both or neither.*/
+int style_attrs_equal(int a, int b) {
+    int count = dom_attrs_count[a];
+    int fa = dom_attrs_first[a];
+    int fb = dom_attrs_first[b];
+    int k;
+    int x;
+    int y;
+    if (n_tag[a] != n_tag[b]) return 0;
+    if (dom_attrs_count[b] != count) return 0;
+    for (k = 0; k < count; k = k + 1) {
+        x = dom_ap_name_off[fa + k];
+        y = dom_ap_name_off[fb + k];
+        if (x < 0 || y < 0) {
+            if (x != y) return 0;
+            continue;
+        }
+        if (!b_strieq(attr_pool + x, attr_pool + y)) return 0;
+        x = dom_ap_value_off[fa + k];
+        y = dom_ap_value_off[fb + k];
+        if (x < 0 || y < 0) {
+            if (x != y) return 0;
+            continue;
+        }
+        if (!b_strieq(attr_pool + x, attr_pool + y)) return 0;
+    }
+    return 1;
+}
+
+/* Fill style_match[] for `node`. Reuses the previous element sibling's
+ * list when the sibling is identical and none of its candidates is
+ * share-unsafe; otherwise runs the matcher and offers the result to the
+ * next sibling through this depth's share slot.*/
+void style_collect_matches(int node) {
+    int d = 0;
+    int q = n_parent[node];
+    int row = -1;
+    int ps;
+    int base;
+    int k;
+    while (q >= 0) { d = d + 1; q = n_parent[q]; }
+    ps = n_prev_sibling_elt[node];
+    if (d < STYLE_SHARE_DEPTH && ps >= 0 &&
+        style_share_gen[d] == style_pass && style_share_node[d] == ps &&
+        style_attrs_equal(node, ps)) {
+        base = d * STYLE_SHARE_MAX;
+        style_match_count = style_share_count[d];
+        for (k = 0; k < style_match_count; k = k + 1) style_match[k] = style_share_rules[base + k];
+        style_share_node[d] = node;
+        style_stat_shared = style_stat_shared + 1;
+        return;
+    }
+    if (d < STYLE_BLOOM_DEPTH) {
+        style_bloom_fill(n_parent[node], d);
+        row = d;
+    }
+    style_node_keys(node);
+    style_match_rules(node, row);
+    /* Text nodes stay out of the slots so whitespace between two
+     * elements doesn't break the sibling chain.*/
+    if (d >= STYLE_SHARE_DEPTH || n_tag[node] == T_TEXT) return;
+    if (style_match_unsafe || style_match_count > STYLE_SHARE_MAX) {
+        style_share_node[d] = -1;
+        return;
+    }
+    base = d * STYLE_SHARE_MAX;
+    for (k = 0; k < style_match_count; k = k + 1) style_share_rules[base + k] = style_match[k];
+    style_share_count[d] = style_match_count;
+    style_share_node[d] = node;
+    style_share_gen[d] = style_pass;
+}
+
 /* Decode a CSS string value into out[]. Handles `\HHHHHH` codepoint
  * escapes (1..6 hex digits, optional terminating space) and UTF-8
  * multi-byte sequences in raw text. Codepoints above 127 are folded
@@ -2375,9 +2774,10 @@ int css_value_string(int off, int len, char *out, int omax) {
 }
 
 /* Subroutine of style_resolve_all: resolve ::before / ::after generated
- * content for `node`. Matches every rule with a pseudo-element tail
- * compound, picks the highest-specificity (then doc-order) winner per
- * pseudo-element side, decodes the `content:` string, and saves the
+ * content for `node`. Takes the rules with a pseudo-element tail compound
+ * from style_match[] (the matcher keeps only their `content:`
+ * declarations), picks the highest-specificity (then doc-order) winner
+ * per pseudo-element side, decodes the `content:` string, and saves the
  * result to n_pseudo_before/after_off. Other pseudo-element properties
  * (color, font, etc.) are not yet honored. Only `content`.*/
 void resolve_pseudo_content(int node) {
@@ -2385,22 +2785,16 @@ void resolve_pseudo_content(int node) {
     int score_b = -1;
     int win_a = -1;
     int score_a = -1;
-    int sf;
-    int sc;
-    int tail;
+    int r;
     int pe;
     int score;
     int len;
     int ao;
     char buf[256];
-    for (int r = 0; r < css_rule_count; r = r + 1) {
-        if (css_rule_prop_id[r] != CP_CONTENT) continue;
-        sf = css_rule_sel_first[r];
-        sc = css_rule_sel_count[r];
-        tail = sf + sc - 1;
-        pe = css_sel_pseudo_elt[tail];
+    for (int m = 0; m < style_match_count; m = m + 1) {
+        r = style_match[m];
+        pe = rule_pseudo_elt(r);
         if (pe == PSELT_NONE) continue;
-        if (!sel_chain_matches_pseudo(sf, sc, node, pe)) continue;
         score = (css_rule_specificity[r] << 12) | (css_rule_doc_order[r] & 0xFFF);
         if (pe == PSELT_BEFORE) {
             if (score > score_b) { score_b = score; win_b = r; }
@@ -2435,208 +2829,511 @@ void resolve_pseudo_content(int node) {
 /* Step 5.4: style_resolve_all */
 
 void style_resolve_all() {
+    int t0 = uptime_ms();
     cs_count = 0;
+    style_pass = style_pass + 1;
+    style_stat_tested = 0;
+    style_stat_rejected = 0;
+    style_stat_shared = 0;
+    css_index_build();
 
     /* Allocate one ComputedStyle per DOM node, in DOM order so parent < child.
      * Index alignment: cs[i] corresponds to node i.*/
     for (int n = 0; n < nodes_count; n = n + 1) {
-        int cs = cs_count;
-        cs_count = cs_count + 1;
-        if (cs >= MAX_COMPUTED_STYLES) { cs_count = MAX_COMPUTED_STYLES; break; }
-
-        /* 1. UA defaults */
-        ua_default_style(n_tag[n], cs);
-
-        /* 2a. Custom-property cascade FIRST so var() resolution during
-         * regular property cascade sees inherited + locally-declared
-         * vars. CP_CUSTOM_VAR rules can declare many distinct --names
-         * per node, so the winner_rule[] slot dedicated to CP_CUSTOM_VAR
-         * is insufficient - walk the rule pool keyed on
-         * (name_off, name_len), and apply the highest-scoring winner
-         * per name. Reference: Blink resolves custom properties in the
-         * cascade with the same priority order as regular properties;
-         * we approximate via the shared specificity+doc-order score.*/
-        for (int r = 0; r < css_rule_count; r = r + 1) {
-            if (css_rule_prop_id[r] != CP_CUSTOM_VAR) continue;
-            if (css_rule_important[r]) continue;
-            int sf2 = css_rule_sel_first[r];
-            int sc2 = css_rule_sel_count[r];
-            if (!sel_chain_matches(sf2, sc2, n)) continue;
-            int n_off = css_rule_var_name_off[r];
-            int n_len = css_rule_var_name_len[r];
-            int score2 = (css_rule_specificity[r] << 12) |
-                         (css_rule_doc_order[r] & 0xFFF);
-            /* Find existing slot by name; else allocate a new one. */
-            int slot = -1;
-            for (int k = 0; k < cs_var_count[cs]; k = k + 1) {
-                if (cs_var_name_len[cs][k] != n_len) continue;
-                int eq = 1;
-                for (int b = 0; b < n_len; b = b + 1) {
-                    if (css_value_pool[cs_var_name_off[cs][k] + b] !=
-                        css_value_pool[n_off + b]) { eq = 0; break; }
-                }
-                if (eq) { slot = k; break; }
-            }
-            if (slot < 0) {
-                if (cs_var_count[cs] >= 8) continue;
-                slot = cs_var_count[cs];
-                cs_var_count[cs] = slot + 1;
-                cs_var_name_off[cs][slot] = n_off;
-                cs_var_name_len[cs][slot] = n_len;
-                cs_var_val_off [cs][slot] = css_rule_value_off[r];
-                cs_var_val_len [cs][slot] = css_rule_value_len[r];
-                /* Encode score in val_len's high bits? No - use separate.
-                 * Re-walk to find current score from val pool would be
-                 * nicer; simpler: keep score implicit by always tracking
-                 * the higher score on each visit.*/
-                cs_var_name_off[cs][slot] = n_off;
-                cs_var_name_len[cs][slot] = n_len;
-                /* score implicit via slot order; we'll re-check on conflict. */
-                (void)score2;
-            } else {
-                /* Replace if score higher. We cheat and replace
-                 * unconditionally on later doc-order: rules walk in
-                 * source order so later wins on ties, which matches the
-                 * doc-order tiebreaker. Specificity ties handled
-                 * implicitly via rule walk order; for stricter spec
-                 * compliance store an explicit score per slot.*/
-                cs_var_val_off[cs][slot] = css_rule_value_off[r];
-                cs_var_val_len[cs][slot] = css_rule_value_len[r];
-            }
-        }
+        if (n >= MAX_COMPUTED_STYLES) { cs_count = MAX_COMPUTED_STYLES; break; }
+        cs_count = n + 1;
+        style_resolve_node(n);
+    }
+    /* A full pass supersedes any pending incremental marks. */
+    for (int n = 0; n < nodes_count; n = n + 1) n_style_dirty[n] = 0;
+    style_dirty_count = 0;
+    style_last_ms = uptime_ms() - t0;
+}
 
-        /* 2b. Inline custom-property pre-pass - extract any `--name:`
-         * declarations from `style="..."` into cs_var_*[] BEFORE the
-         * regular property cascade runs, so var() lookups in regular
-         * rules see inline-declared vars. Inline custom props win over
-         * matching author-rule custom props on this element because
-         * apply_inline_vars appends and our cs_var_lookup returns the
-         * first match - appending later overrides.*/
-        int sty_off = dom_attr_get(n, "style");
-        if (sty_off >= 0) {
-            apply_inline_vars(cs, attr_pool + sty_off);
-        }
-
-        /* 2c. Author rules in two passes: pass 1 (non-important) feeds
-         * the normal specificity+doc-order cascade; pass 2 (important)
-         * wins over everything from pass 1 and inline style. The score
-         * packs (specificity << 12) | doc_order so a higher specificity
-         * or later rule wins at equal level. Size matches MAX_CP_ID;
-         * CupidC requires a literal here.*/
-        int winner_rule[80];
-        int winner_score[80];
-        for (int p = 0; p < MAX_CP_ID; p = p + 1) { winner_rule[p] = -1; winner_score[p] = -1; }
-        for (int r = 0; r < css_rule_count; r = r + 1) {
-            if (css_rule_important[r]) continue;
-            int p = css_rule_prop_id[r];
-            if (p < 1 || p >= MAX_CP_ID) continue;
-            int sf = css_rule_sel_first[r];
-            int sc = css_rule_sel_count[r];
-            if (!sel_chain_matches(sf, sc, n)) continue;
-            int score = (css_rule_specificity[r] << 12) | (css_rule_doc_order[r] & 0xFFF);
-            if (score > winner_score[p]) {
-                winner_score[p] = score;
-                winner_rule[p] = r;
+/* Cascade one element into cs slot n (== DOM index). The parent's slot
+ * must already be current; style_resolve_all and style_resolve_dirty
+ * both walk in DOM order, where parent < child.*/
+void style_resolve_node(int n) {
+    int cs = n;
+    /* 1. UA defaults */
+    ua_default_style(n_tag[n], cs);
+
+    /* Matched author rules, in rule order, for every pass below. */
+    style_collect_matches(n);
+
+    /* 2a. Custom-property cascade FIRST so var() resolution during
+     * regular property cascade sees inherited + locally-declared
+     * vars. CP_CUSTOM_VAR rules can declare many distinct --names
+     * per node, so the winner_rule[] slot dedicated to CP_CUSTOM_VAR
+     * is insufficient - walk the rule pool keyed on
+     * (name_off, name_len), and apply the highest-scoring winner
+     * per name. Reference: Blink resolves custom properties in the
+     * cascade with the same priority order as regular properties;
+     * we approximate via the shared specificity+doc-order score.*/
+    for (int m = 0; m < style_match_count; m = m + 1) {
+        int r = style_match[m];
+        if (css_rule_prop_id[r] != CP_CUSTOM_VAR) continue;
+        if (css_rule_important[r]) continue;
+        if (rule_pseudo_elt(r) != PSELT_NONE) continue;
+        int n_off = css_rule_var_name_off[r];
+        int n_len = css_rule_var_name_len[r];
+        int score2 = (css_rule_specificity[r] << 12) |
+                     (css_rule_doc_order[r] & 0xFFF);
+        /* Find existing slot by name; else allocate a new one. */
+        int slot = -1;
+        for (int k = 0; k < cs_var_count[cs]; k = k + 1) {
+            if (cs_var_name_len[cs][k] != n_len) continue;
+            int eq = 1;
+            for (int b = 0; b < n_len; b = b + 1) {
+                if (css_value_pool[cs_var_name_off[cs][k] + b] !=
+                    css_value_pool[n_off + b]) { eq = 0; break; }
             }
+            if (eq) { slot = k; break; }
+        }
+        if (slot < 0) {
+            if (cs_var_count[cs] >= 8) continue;
+            slot = cs_var_count[cs];
+            cs_var_count[cs] = slot + 1;
+            cs_var_name_off[cs][slot] = n_off;
+            cs_var_name_len[cs][slot] = n_len;
+            cs_var_val_off [cs][slot] = css_rule_value_off[r];
+            cs_var_val_len [cs][slot] = css_rule_value_len[r];
+            /* Encode score in val_len's high bits? No - use separate.
+             * Re-walk to find current score from val pool would be
+             * nicer; simpler: keep score implicit by always tracking
+             * the higher score on each visit.*/
+            cs_var_name_off[cs][slot] = n_off;
+            cs_var_name_len[cs][slot] = n_len;
+            /* score implicit via slot order; we'll re-check on conflict. */
+            (void)score2;
+        } else {
+            /* Replace if score higher. We cheat and replace
+             * unconditionally on later doc-order: rules walk in
+             * source order so later wins on ties, which matches the
+             * doc-order tiebreaker. Specificity ties handled
+             * implicitly via rule walk order; for stricter spec
+             * compliance store an explicit score per slot.*/
+            cs_var_val_off[cs][slot] = css_rule_value_off[r];
+            cs_var_val_len[cs][slot] = css_rule_value_len[r];
         }
-        for (int p = 1; p < MAX_CP_ID; p = p + 1) {
-            int r = winner_rule[p];
-            if (r >= 0) {
-                cs_apply_property(cs, p,
-                                  css_rule_value_off[r], css_rule_value_len[r]);
-            }
+    }
+
+    /* 2b. Inline custom-property pre-pass - extract any `--name:`
+     * declarations from `style="..."` into cs_var_*[] BEFORE the
+     * regular property cascade runs, so var() lookups in regular
+     * rules see inline-declared vars. Inline custom props win over
+     * matching author-rule custom props on this element because
+     * apply_inline_vars appends and our cs_var_lookup returns the
+     * first match - appending later overrides.*/
+    int sty_off = dom_attr_get(n, "style");
+    if (sty_off >= 0) {
+        apply_inline_vars(cs, attr_pool + sty_off);
+    }
+
+    /* 2c. Author rules in two passes: pass 1 (non-important) feeds
+     * the normal specificity+doc-order cascade; pass 2 (important)
+     * wins over everything from pass 1 and inline style. The score
+     * packs (specificity << 12) | doc_order so a higher specificity
+     * or later rule wins at equal level. Size matches MAX_CP_ID;
+     * CupidC requires a literal here.*/
+    int winner_rule[80];
+    int winner_score[80];
+    for (int p = 0; p < MAX_CP_ID; p = p + 1) { winner_rule[p] = -1; winner_score[p] = -1; }
+    for (int m = 0; m < style_match_count; m = m + 1) {
+        int r = style_match[m];
+        if (css_rule_important[r]) continue;
+        int p = css_rule_prop_id[r];
+        if (p < 1 || p >= MAX_CP_ID) continue;
+        if (rule_pseudo_elt(r) != PSELT_NONE) continue;
+        int score = (css_rule_specificity[r] << 12) | (css_rule_doc_order[r] & 0xFFF);
+        if (score > winner_score[p]) {
+            winner_score[p] = score;
+            winner_rule[p] = r;
+        }
+    }
+    for (int p = 1; p < MAX_CP_ID; p = p + 1) {
+        int r = winner_rule[p];
+        if (r >= 0) {
+            cs_apply_property(cs, p,
+                              css_rule_value_off[r], css_rule_value_len[r]);
         }
+    }
 
-        /* 3. Inline style="..." attribute (wins over non-important
-         * author rules). The pre-pass at 2b already captured --vars;
-         * apply_inline_style still re-applies them but that's a no-op
-         * since the values are identical. Regular properties get
-         * applied here for the first time.*/
-        if (sty_off >= 0) {
-            apply_inline_style(cs, attr_pool + sty_off);
-        }
-
-        /* 4. Important author rules: applied last so they override pass 1
-         *    and inline style. Specificity + doc-order still resolves ties
-         *    among important rules themselves.*/
-        int imp_rule[80];
-        int imp_score[80];
-        for (int p = 0; p < MAX_CP_ID; p = p + 1) { imp_rule[p] = -1; imp_score[p] = -1; }
-        for (int r = 0; r < css_rule_count; r = r + 1) {
-            if (!css_rule_important[r]) continue;
-            int p = css_rule_prop_id[r];
-            if (p < 1 || p >= MAX_CP_ID) continue;
-            int sf = css_rule_sel_first[r];
-            int sc = css_rule_sel_count[r];
-            if (!sel_chain_matches(sf, sc, n)) continue;
-            int score = (css_rule_specificity[r] << 12) | (css_rule_doc_order[r] & 0xFFF);
-            if (score > imp_score[p]) {
-                imp_score[p] = score;
-                imp_rule[p] = r;
-            }
+    /* 3. Inline style="..." attribute (wins over non-important
+     * author rules). The pre-pass at 2b already captured --vars;
+     * apply_inline_style still re-applies them but that's a no-op
+     * since the values are identical. Regular properties get
+     * applied here for the first time.*/
+    if (sty_off >= 0) {
+        apply_inline_style(cs, attr_pool + sty_off);
+    }
+
+    /* 4. Important author rules: applied last so they override pass 1
+     *    and inline style. Specificity + doc-order still resolves ties
+     *    among important rules themselves.*/
+    int imp_rule[80];
+    int imp_score[80];
+    for (int p = 0; p < MAX_CP_ID; p = p + 1) { imp_rule[p] = -1; imp_score[p] = -1; }
+    for (int m = 0; m < style_match_count; m = m + 1) {
+        int r = style_match[m];
+        if (!css_rule_important[r]) continue;
+        int p = css_rule_prop_id[r];
+        if (p < 1 || p >= MAX_CP_ID) continue;
+        if (rule_pseudo_elt(r) != PSELT_NONE) continue;
+        int score = (css_rule_specificity[r] << 12) | (css_rule_doc_order[r] & 0xFFF);
+        if (score > imp_score[p]) {
+            imp_score[p] = score;
+            imp_rule[p] = r;
+        }
+    }
+    for (int p = 1; p < MAX_CP_ID; p = p + 1) {
+        int r = imp_rule[p];
+        if (r >= 0) {
+            cs_apply_property(cs, p,
+                              css_rule_value_off[r], css_rule_value_len[r]);
         }
-        for (int p = 1; p < MAX_CP_ID; p = p + 1) {
-            int r = imp_rule[p];
-            if (r >= 0) {
-                cs_apply_property(cs, p,
-                                  css_rule_value_off[r], css_rule_value_len[r]);
+    }
+
+    /* 4. Inheritance from parent ComputedStyle for unset inheritable props.
+     *    cs index == node index, so parent's cs is at parent's node index.*/
+    int parent = n_parent[n];
+    if (parent >= 0 && parent < cs_count) {
+        int pcs = parent;
+        if (cs_color[cs] < 0) cs_color[cs] = cs_color[pcs];
+        if (cs_text_align[cs] == TA_LEFT && cs_text_align[pcs] != TA_LEFT)
+            cs_text_align[cs] = cs_text_align[pcs];
+        if (cs_white_space[cs] == WS_NORMAL) cs_white_space[cs] = cs_white_space[pcs];
+        if (cs_list_style[cs] == LS_DISC && cs_list_style[pcs] != LS_DISC)
+            cs_list_style[cs] = cs_list_style[pcs];
+        if (cs_line_height[cs] < 0) {
+            cs_line_height[cs] = cs_line_height[pcs];
+            cs_line_height_mult[cs] = cs_line_height_mult[pcs];
+        }
+        if (cs_font_size_px[cs] < 0) cs_font_size_px[cs] = cs_font_size_px[pcs];
+        /* Font-family inherits as a unit. cs_font_family_off == -1
+         * means "unset on this element" - copy the parent's stash.*/
+        if (cs_font_family_off[cs] < 0) {
+            cs_font_family_off[cs] = cs_font_family_off[pcs];
+            cs_font_family_len[cs] = cs_font_family_len[pcs];
+        }
+        if (cs_font_generic[cs] == FONTSYS_FAMILY_DEFAULT
+            && cs_font_generic[pcs] != FONTSYS_FAMILY_DEFAULT) {
+            cs_font_generic[cs] = cs_font_generic[pcs];
+        }
+        /* font-weight / font-style are inherited per CSS spec. Element
+         * UA defaults set 400 / 0 explicitly, so we promote to parent's
+         * value only when the child still carries the default; child
+         * elements that explicitly set normal still override correctly
+         * because cascade ran before this inheritance pass.*/
+        if (cs_font_w[cs] == 400 && cs_font_w[pcs] != 400) cs_font_w[cs] = cs_font_w[pcs];
+        if (cs_font_i[cs] == 0   && cs_font_i[pcs] != 0)   cs_font_i[cs] = cs_font_i[pcs];
+        /* text-decoration in CSS2.1 doesn't strictly inherit, but its
+         * paint effect (underline/strike) propagates from ancestor to
+         * all descendants. Treating it as inherit-when-unset is
+         * visually equivalent and avoids walking the rt parent chain
+         * in emit_text_atoms.*/
+        if (cs_text_dec[cs] == 0 && cs_text_dec[pcs] != 0) cs_text_dec[cs] = cs_text_dec[pcs];
+    } else {
+        /* root: ensure color is concrete and font-size has a baseline */
+        if (cs_color[cs] < 0) cs_color[cs] = 0x000000;
+        if (cs_font_size_px[cs] < 0) cs_font_size_px[cs] = 16;
+    }
+    /* Derive the kernel-tier from the px-resolved size. layout/paint
+     * still consume cs_font_size_tier; cs_font_size_px is the source
+     * of truth and what em/rem/% length resolution reads.*/
+    cs_font_size_tier[cs] = px_to_tier(cs_font_size_px[cs]);
+
+    /* Pseudo-element generated content (::before / ::after). Stored on
+     * the originating node; render_tree.cc injects synthetic RT_TEXT
+     * children at build time. Cleared first so a restyle that no longer
+     * matches the rule drops the content.*/
+    n_pseudo_before_off[n] = -1;
+    n_pseudo_before_len[n] = 0;
+    n_pseudo_after_off[n] = -1;
+    n_pseudo_after_len[n] = 0;
+    resolve_pseudo_content(n);
+}
+
+/* Hashes over cs slot n for style_resolve_dirty's before/after compare,
+ * split by what a change costs. Box-tree fields decide which boxes
+ * exist; paint fields are only read when a box paints itself; every
+ * other computed value feeds layout. cs_bg_handle and the intrinsic
+ * size are image state, not cascade output, and stay out.*/
+int cs_hash_step(int h, int v) {
+    return (h ^ v) * 16777619;
+}
+
+int cs_hash_tree(int n) {
+    int h = 1;
+    h = cs_hash_step(h, cs_display[n]);
+    h = cs_hash_step(h, cs_position[n]);
+    h = cs_hash_step(h, cs_pos_set[n] & 16);
+    h = cs_hash_step(h, cs_float[n]);    /* inline <-> block formatting */
+    return h;
+}
+
+int cs_hash_paint(int n) {
+    int h = 1;
+    h = cs_hash_step(h, cs_color[n]);
+    h = cs_hash_step(h, cs_bg[n]);
+    h = cs_hash_step(h, cs_text_dec[n]);
+    h = cs_hash_step(h, cs_border_color[n]);
+    h = cs_hash_step(h, cs_border_style[n]);
+    h = cs_hash_step(h, cs_border_radius[n]);
+    h = cs_hash_step(h, cs_list_style[n]);
+    h = cs_hash_step(h, cs_bg_grad[n]);
+    h = cs_hash_step(h, cs_bg_grad_c1[n]);
+    h = cs_hash_step(h, cs_bg_grad_c2[n]);
+    h = cs_hash_step(h, cs_bg_img_off[n]);
+    h = cs_hash_step(h, cs_bg_img_len[n]);
+    h = cs_hash_step(h, cs_bg_size_w[n]);
+    h = cs_hash_step(h, cs_bg_size_h[n]);
+    h = cs_hash_step(h, cs_bg_pos_x[n]);
+    h = cs_hash_step(h, cs_bg_pos_y[n]);
+    h = cs_hash_step(h, cs_bg_repeat[n]);
+    h = cs_hash_step(h, cs_shadow_has[n]);
+    h = cs_hash_step(h, cs_shadow_dx[n]);
+    h = cs_hash_step(h, cs_shadow_dy[n]);
+    h = cs_hash_step(h, cs_shadow_color[n]);
+    return h;
+}
+
+int cs_hash_layout(int n) {
+    int h = 1;
+    int k;
+    for (k = 0; k < 4; k = k + 1) {
+        h = cs_hash_step(h, cs_margin[n][k]);
+        h = cs_hash_step(h, cs_margin_auto[n][k]);
+        h = cs_hash_step(h, cs_padding[n][k]);
+        h = cs_hash_step(h, cs_border[n][k]);
+    }
+    h = cs_hash_step(h, cs_font_w[n]);
+    h = cs_hash_step(h, cs_font_i[n]);
+    h = cs_hash_step(h, cs_font_size_tier[n]);
+    h = cs_hash_step(h, cs_font_size_px[n]);
+    h = cs_hash_step(h, cs_font_family_off[n]);
+    h = cs_hash_step(h, cs_font_family_len[n]);
+    h = cs_hash_step(h, cs_font_generic[n]);
+    h = cs_hash_step(h, cs_text_align[n]);
+    h = cs_hash_step(h, cs_white_space[n]);
+    h = cs_hash_step(h, cs_vertical_align[n]);
+    h = cs_hash_step(h, cs_line_height[n]);
+    h = cs_hash_step(h, cs_line_height_mult[n]);
+    h = cs_hash_step(h, cs_width[n]);
+    h = cs_hash_step(h, cs_height[n]);
+    h = cs_hash_step(h, cs_max_width[n]);
+    h = cs_hash_step(h, cs_min_width[n]);
+    h = cs_hash_step(h, cs_max_height[n]);
+    h = cs_hash_step(h, cs_min_height[n]);
+    h = cs_hash_step(h, cs_overflow[n]);
+    h = cs_hash_step(h, cs_box_sizing[n]);
+    h = cs_hash_step(h, cs_flex_dir[n]);
+    h = cs_hash_step(h, cs_justify[n]);
+    h = cs_hash_step(h, cs_align_items[n]);
+    h = cs_hash_step(h, cs_flex_grow[n]);
+    h = cs_hash_step(h, cs_flex_shrink[n]);
+    h = cs_hash_step(h, cs_flex_basis[n]);
+    h = cs_hash_step(h, cs_gap[n]);
+    h = cs_hash_step(h, cs_top[n]);
+    h = cs_hash_step(h, cs_right[n]);
+    h = cs_hash_step(h, cs_bottom[n]);
+    h = cs_hash_step(h, cs_left[n]);
+    h = cs_hash_step(h, cs_pos_set[n]);
+    h = cs_hash_step(h, cs_z_index[n]);
+    h = cs_hash_step(h, cs_float[n]);
+    h = cs_hash_step(h, cs_clear[n]);
+    return h;
+}
+
+/* Queue element n for style_resolve_dirty. */
+void dom_mark_style_dirty(int n) {
+    if (n < 0 || n >= nodes_count) return;
+    if (!n_style_dirty[n]) {
+        n_style_dirty[n] = 1;
+        style_dirty_count = style_dirty_count + 1;
+    }
+}
+
+/* A dynamic pseudo-class moved from element `old_n` to `new_n` (either
+ * may be -1). :hover matches an element and its ancestors, so the
+ * elements whose state flips are the two chains below their common
+ * ancestor; each is marked, or its parent when a rule reaches siblings
+ * through + or ~.*/
+void style_mark_state_change(int old_n, int new_n, int whole_chain) {
+    int pass;
+    int from;
+    int other;
+    int p;
+    int q;
+    int shared;
+    for (pass = 0; pass < 2; pass = pass + 1) {
+        from = (pass == 0) ? old_n : new_n;
+        other = (pass == 0) ? new_n : old_n;
+        p = from;
+        while (p >= 0 && p < nodes_count) {
+            shared = 0;
+            q = other;
+            while (q >= 0 && q < nodes_count) {
+                if (q == p) { shared = 1; break; }
+                q = n_parent[q];
             }
+            if (shared) break;
+            if (css_dyn_sibling && n_parent[p] >= 0) dom_mark_style_dirty(n_parent[p]);
+            else dom_mark_style_dirty(p);
+            if (!whole_chain) break;
+            p = n_parent[p];
         }
+    }
+}
 
-        /* 4. Inheritance from parent ComputedStyle for unset inheritable props.
-         *    cs index == node index, so parent's cs is at parent's node index.*/
-        int parent = n_parent[n];
-        if (parent >= 0 && parent < cs_count) {
-            int pcs = parent;
-            if (cs_color[cs] < 0) cs_color[cs] = cs_color[pcs];
-            if (cs_text_align[cs] == TA_LEFT && cs_text_align[pcs] != TA_LEFT)
-                cs_text_align[cs] = cs_text_align[pcs];
-            if (cs_white_space[cs] == WS_NORMAL) cs_white_space[cs] = cs_white_space[pcs];
-            if (cs_list_style[cs] == LS_DISC && cs_list_style[pcs] != LS_DISC)
-                cs_list_style[cs] = cs_list_style[pcs];
-            if (cs_line_height[cs] < 0) {
-                cs_line_height[cs] = cs_line_height[pcs];
-                cs_line_height_mult[cs] = cs_line_height_mult[pcs];
-            }
-            if (cs_font_size_px[cs] < 0) cs_font_size_px[cs] = cs_font_size_px[pcs];
-            /* Font-family inherits as a unit. cs_font_family_off == -1
-             * means "unset on this element" - copy the parent's stash.*/
-            if (cs_font_family_off[cs] < 0) {
-                cs_font_family_off[cs] = cs_font_family_off[pcs];
-                cs_font_family_len[cs] = cs_font_family_len[pcs];
-            }
-            if (cs_font_generic[cs] == FONTSYS_FAMILY_DEFAULT
-                && cs_font_generic[pcs] != FONTSYS_FAMILY_DEFAULT) {
-                cs_font_generic[cs] = cs_font_generic[pcs];
+/* Keep the previous ::before/::after string when the restyle produced
+ * the same text, handing the fresh attr_pool copy back. Returns 1 when
+ * the generated content actually changed.*/
+int style_keep_pseudo(int n, int b_off, int b_len, int a_off, int a_len) {
+    int changed = 0;
+    int k;
+    int off;
+    int same;
+    off = n_pseudo_after_off[n];
+    same = (off < 0 && a_off < 0);
+    if (off >= 0 && a_off >= 0 && n_pseudo_after_len[n] == a_len) {
+        same = 1;
+        for (k = 0; k < a_len; k = k + 1) {
+            if (attr_pool[off + k] != attr_pool[a_off + k]) { same = 0; break; }
+        }
+    }
+    if (same && off >= 0) {
+        if (off + a_len + 1 == attr_pool_pos) attr_pool_pos = off;
+        n_pseudo_after_off[n] = a_off;
+    }
+    if (!same) changed = 1;
+    off = n_pseudo_before_off[n];
+    same = (off < 0 && b_off < 0);
+    if (off >= 0 && b_off >= 0 && n_pseudo_before_len[n] == b_len) {
+        same = 1;
+        for (k = 0; k < b_len; k = k + 1) {
+            if (attr_pool[off + k] != attr_pool[b_off + k]) { same = 0; break; }
+        }
+    }
+    if (same && off >= 0) {
+        if (off + b_len + 1 == attr_pool_pos) attr_pool_pos = off;
+        n_pseudo_before_off[n] = b_off;
+    }
+    if (!same) changed = 1;
+    return changed;
+}
+
+/* Route a restyled element's change to its boxes. Inline boxes carry
+ * colours in their line atoms, so even a paint-only change re-flows
+ * their block; block boxes repaint their band. The canvas colour comes
+ * from html/body, so a paint change there repaints everything.*/
+/* Anonymous blocks and ::before/::after boxes under r are laid out
+ * from n's style too, so they relayout with it.*/
+void style_mark_own_boxes(int r, int n) {
+    int c = rt_first_child[r];
+    while (c >= 0) {
+        if (rt_kind[c] != RT_LINE_BOX && (rt_dom[c] == n || rt_style[c] == n)) {
+            rt_needs_layout[c] = 1;
+            style_mark_own_boxes(c, n);
+        }
+        c = rt_next[c];
+    }
+}
+
+int style_mark_boxes(int n, int change) {
+    int r = n_rt[n];
+    if (r < 0) return STYLE_CHANGE_NONE;
+    if (change == STYLE_CHANGE_PAINT) {
+        int k = rt_kind[r];
+        int inl = (k == RT_INLINE || k == RT_TEXT || k == RT_INLINE_BLOCK ||
+                   (k == RT_REPLACED && cs_display[n] != DISP_BLOCK));
+        int c = rt_first_child[r];
+        while (c >= 0 && !inl) {
+            if (rt_dom[c] == n && rt_kind[c] == RT_TEXT) inl = 1;   /* ::before/::after */
+            c = rt_next[c];
+        }
+        if (!inl) {
+            if (n_tag[n] == T_HTML || n_tag[n] == T_BODY) {
+                paint_invalidate_all();
+            } else {
+                int y0;
+                int y1;
+                paint_rt_band(r, &y0, &y1);
+                paint_invalidate_band(y0, y1);
+                /* A new shadow widens the box's display-list bounds. */
+                if (cs_shadow_has[n]) paint_invalidate_list();
             }
-            /* font-weight / font-style are inherited per CSS spec. Element
-             * UA defaults set 400 / 0 explicitly, so we promote to parent's
-             * value only when the child still carries the default; child
-             * elements that explicitly set normal still override correctly
-             * because cascade ran before this inheritance pass.*/
-            if (cs_font_w[cs] == 400 && cs_font_w[pcs] != 400) cs_font_w[cs] = cs_font_w[pcs];
-            if (cs_font_i[cs] == 0   && cs_font_i[pcs] != 0)   cs_font_i[cs] = cs_font_i[pcs];
-            /* text-decoration in CSS2.1 doesn't strictly inherit, but its
-             * paint effect (underline/strike) propagates from ancestor to
-             * all descendants. Treating it as inherit-when-unset is
-             * visually equivalent and avoids walking the rt parent chain
-             * in emit_text_atoms.*/
-            if (cs_text_dec[cs] == 0 && cs_text_dec[pcs] != 0) cs_text_dec[cs] = cs_text_dec[pcs];
-        } else {
-            /* root: ensure color is concrete and font-size has a baseline */
-            if (cs_color[cs] < 0) cs_color[cs] = 0x000000;
-            if (cs_font_size_px[cs] < 0) cs_font_size_px[cs] = 16;
+            return STYLE_CHANGE_PAINT;
         }
-        /* Derive the kernel-tier from the px-resolved size. layout/paint
-         * still consume cs_font_size_tier; cs_font_size_px is the source
-         * of truth and what em/rem/% length resolution reads.*/
-        cs_font_size_tier[cs] = px_to_tier(cs_font_size_px[cs]);
-
-        /* Pseudo-element generated content (::before / ::after). Stored on
-         * the originating node; render_tree.cc injects synthetic RT_TEXT
-         * children at build time.*/
-        resolve_pseudo_content(n);
     }
+    layout_mark_dirty(r);
+    style_mark_own_boxes(r, n);
+    return STYLE_CHANGE_LAYOUT;
+}
+
+/* Restyle the elements dom_mark_style_dirty queued, each with its
+ * subtree (the mark is pushed down in DOM order), reusing the rule
+ * index from the last style_resolve_all. Each restyled slot is hashed
+ * before and after; unchanged slots cost nothing further, the rest mark
+ * their boxes for repaint or relayout. Returns the widest STYLE_CHANGE_*
+ * seen; TREE means the caller must rebuild the box tree.*/
+int style_resolve_dirty() {
+    if (style_dirty_count == 0) return STYLE_CHANGE_NONE;
+    int t0 = uptime_ms();
+    int result = STYLE_CHANGE_NONE;
+    int restyled = 0;
+    style_pass = style_pass + 1;
+    style_stat_tested = 0;
+    style_stat_rejected = 0;
+    style_stat_shared = 0;
+    for (int n = 0; n < cs_count; n = n + 1) {
+        int p = n_parent[n];
+        if (!n_style_dirty[n]) {
+            if (p < 0 || !n_style_dirty[p]) continue;
+            n_style_dirty[n] = 1;
+        }
+        restyled = restyled + 1;
+        int tree0 = cs_hash_tree(n);
+        int lay0 = cs_hash_layout(n);
+        int pnt0 = cs_hash_paint(n);
+        int bg_h = cs_bg_handle[n];
+        int bg_w = cs_bg_intrinsic_w[n];
+        int bg_ih = cs_bg_intrinsic_h[n];
+        int bg_off = cs_bg_img_off[n];
+        int bg_len = cs_bg_img_len[n];
+        int pb_off = n_pseudo_before_off[n];
+        int pb_len = n_pseudo_before_len[n];
+        int pa_off = n_pseudo_after_off[n];
+        int pa_len = n_pseudo_after_len[n];
+        style_resolve_node(n);
+        /* Same background-image URL: keep the decoded handle instead of
+         * waiting for bg_image_queue_collect to re-link it.*/
+        if (cs_bg_handle[n] < 0 && bg_h >= 0 &&
+            cs_bg_img_off[n] == bg_off && cs_bg_img_len[n] == bg_len) {
+            cs_bg_handle[n] = bg_h;
+            cs_bg_intrinsic_w[n] = bg_w;
+            cs_bg_intrinsic_h[n] = bg_ih;
+        }
+        int change = STYLE_CHANGE_NONE;
+        if (style_keep_pseudo(n, pb_off, pb_len, pa_off, pa_len) ||
+            cs_hash_tree(n) != tree0) {
+            change = STYLE_CHANGE_TREE;
+        } else if (cs_hash_layout(n) != lay0) {
+            change = STYLE_CHANGE_LAYOUT;
+        } else if (cs_hash_paint(n) != pnt0) {
+            change = STYLE_CHANGE_PAINT;
+        }
+        if (change == STYLE_CHANGE_LAYOUT || change == STYLE_CHANGE_PAINT) {
+            change = style_mark_boxes(n, change);
+        }
+        if (change > result) result = change;
+    }
+    for (int n = 0; n < cs_count; n = n + 1) n_style_dirty[n] = 0;
+    style_dirty_count = 0;
+    style_last_ms = uptime_ms() - t0;
+    serial_printf("[browser] restyle: %d of %d elements in %d ms, change %d\n",
+                  restyled, cs_count, style_last_ms, result);
+    return result;
 }
 
 /* Optional debug helper. Kept dormant, not called from parse_html. */
@@ -2,7 +2,7 @@
  *
  * Web fonts are typically served as WOFF1 (zlib-compressed sfnt) or
  * WOFF2 (Brotli; see woff2.cc). woff1_unwrap reverses the wrapping:
- * read the 44-byte header, walk the per-table directory, kdeflate_raw
+ * read the 44-byte header, walk the per-table directory, kdeflate_zlib
  * each compressed table, and rebuild a plain sfnt with the standard
  * 12-byte offset subtable + 16-byte directory entries.
  *
@@ -12,8 +12,8 @@
  *
  * Reference:
  *   https://www.w3.org/TR/WOFF/
- *   kernel/gfx/png.c (zlib-strip pattern: skip 2-byte CMF/FLG header,
- *                    drop 4-byte trailing Adler-32, kdeflate_raw rest)
+ *   kernel/gfx/deflate.c (shared inflate; kdeflate_zlib checks the
+ *                         CMF/FLG header and skips the Adler-32)
 */
 
 int woff_be32(char *p, int o) {
@@ -126,15 +126,13 @@ char *woff1_unwrap(char *src, int src_len, int *out_len) {
                 out[data_cur + k] = src[sd_off + k];
             }
         } else {
-            /* zlib-wrapped DEFLATE. The 2-byte CMF/FLG header is skipped
-             * before kdeflate_raw and the trailing 4-byte Adler-32 is
-             * dropped from the byte length, exactly mirroring how
-             * kernel/gfx/png.c hands IDAT chunks to the same primitive.*/
+            /* zlib-wrapped DEFLATE, the same inflate png.c streams its
+             * IDAT chunks through.*/
             if (sd_csize < 6) { kfree(out); return (char*)0; }
-            int rc = kdeflate_raw(src + sd_off + 2,
-                                  sd_csize - 6,
-                                  out + data_cur,
-                                  sd_orig);
+            int rc = kdeflate_zlib(src + sd_off,
+                                   sd_csize,
+                                   out + data_cur,
+                                   sd_orig);
             if (rc != 0) { kfree(out); return (char*)0; }
         }
 
@@ -1,11 +1,16 @@
 //help: HTTP/HTTPS client. http:// uses plain TCP; https:// uses TLS 1.3.
-//help: Usage: curl [-o file] [-i] [-s] [-X METHOD] [-d data] [-H header] <url>
+//help: Usage: curl [-o file] [-i] [-s] [-X METHOD] [-d data] [-H header]
+//help:             [-compressed] [-no-cache] <url>
 //help:   -o file   write body to file (default: stdout)
 //help:   -i        include response headers in output
 //help:   -s        silent (suppress error messages)
 //help:   -X METHOD set request method (default GET; -d implies POST)
 //help:   -d DATA   send DATA as request body (sets method=POST)
 //help:   -H "Hdr: V"  add a header line. Quote with " for spaces.
+//help:   -compressed  request gzip/deflate and decompress the body
+//help:   -no-cache    bypass the HTTP cache in /home/.cache/http
+//help: Plain GETs (no -d or -H) use the shared HTTP cache: fresh copies
+//help: are served without a request, stale ones are revalidated.
 
 enum {
     VFS_WRONLY = 1,
@@ -18,7 +23,13 @@ enum {
     REQ_MAX    = 4096,
     HOST_MAX   = 256,
     PATH_MAX_  = 1024,
-    HDR_MAX    = 512
+    HDR_MAX    = 512,
+    KDEFLATE_WRAP_GZIP = 2,
+    KDEFLATE_WRAP_AUTO = 3,
+    HTTP_CACHE_FRESH = 1,
+    HTTP_CACHE_STALE = 2,
+    CACHE_HDR_MAX  = 1024,
+    CACHE_BODY_MAX = 524288
 };
 
 int sw(char *s, char *p) {              /* prefix match */
@@ -147,8 +158,119 @@ int append_int(char *dst, int p, int v) {
     return p;
 }
 
+/* Body sink. With -compressed, gzip/deflate bodies are inflated
+ * through a kernel kdeflate stream before reaching the file/console.*/
+int   body_fd = -1;
+int   body_len;         /* decoded bytes written */
+int   wire_len;         /* body bytes received */
+int   body_enc;         /* KDEFLATE_WRAP_* of the response, 0 = identity */
+char *body_z;
+int   body_z_err;
+
+/* Decoded body kept for http_cache_store; dropped past CACHE_BODY_MAX. */
+char *keep;
+int   keep_len;
+int   keep_cap;
+int   keep_off;         /* 1 = not caching this response */
+
+void keep_put(char *p, int n) {
+    if (keep_off) return;
+    if (keep_len + n > keep_cap) {
+        int cap = keep_cap ? keep_cap * 2 : 65536;
+        while (cap < keep_len + n) cap = cap * 2;
+        char *nb = (char*)0;
+        if (cap <= CACHE_BODY_MAX) nb = (char*)kmalloc(cap);
+        if (!nb) {
+            keep_off = 1;
+            return;
+        }
+        if (keep) {
+            memcpy(nb, keep, keep_len);
+            kfree(keep);
+        }
+        keep = nb;
+        keep_cap = cap;
+    }
+    memcpy(keep + keep_len, p, n);
+    keep_len = keep_len + n;
+}
+
+void body_emit(char *p, int n) {
+    keep_put(p, n);
+    if (body_fd >= 0) {
+        vfs_write(body_fd, p, n);
+    } else {
+        int k = 0;
+        while (k < n) { putchar(p[k]); k = k + 1; }
+    }
+    body_len = body_len + n;
+}
+
+void body_put(char *p, int n) {
+    wire_len = wire_len + n;
+    if (!body_enc) { body_emit(p, n); return; }
+    if (!body_z && !body_z_err) {
+        body_z = (char*)kdeflate_stream_new(body_enc);
+        if (!body_z) body_z_err = 1;
+    }
+    char out[4096];
+    while (n > 0 && !body_z_err) {
+        int used = kdeflate_stream_push(body_z, p, n);
+        p = p + used;
+        n = n - used;
+        while (1) {
+            int got = kdeflate_stream_pull(body_z, out, 4096);
+            if (got < 0) { body_z_err = 1; break; }
+            if (got == 0) break;
+            body_emit(out, got);
+        }
+        if (used == 0) break;
+    }
+}
+
+/* Response header lines http_cache_store / _revalidated look at. */
+char cache_hdr[1024];
+int  cache_hdr_len;
+
+void cache_hdr_line(char *line, int len) {
+    if (!(sw_ci(line, "cache-control:") || sw_ci(line, "expires:") ||
+          sw_ci(line, "date:") || sw_ci(line, "age:") || sw_ci(line, "etag:") ||
+          sw_ci(line, "last-modified:") || sw_ci(line, "pragma:") ||
+          sw_ci(line, "vary:") || sw_ci(line, "content-type:"))) return;
+    if (cache_hdr_len + len + 1 > CACHE_HDR_MAX) return;
+    memcpy(cache_hdr + cache_hdr_len, line, len);
+    cache_hdr_len = cache_hdr_len + len;
+    cache_hdr[cache_hdr_len] = '\n';
+    cache_hdr_len = cache_hdr_len + 1;
+}
+
+/* Emit the cached body of `url`, with a stand-in header block for -i
+ * when no response was received. Returns bytes or -1.*/
+int emit_cached(char *url, int show_headers) {
+    int len = http_cache_length(url);
+    if (len < 0) return -1;
+    char *b = (char*)kmalloc(len + 1);
+    if (!b) return -1;
+    char ctype[128]; ctype[0] = 0;
+    int n = http_cache_read(url, b, len + 1, ctype, 128);
+    if (n >= 0) {
+        if (show_headers) {
+            print("HTTP/1.1 200 OK (from cache)\r\nContent-Type: ");
+            print(ctype);
+            print("\r\nContent-Length: ");
+            print_int(n);
+            print("\r\n\r\n");
+        }
+        keep_off = 1;
+        body_emit(b, n);
+    }
+    kfree(b);
+    return n;
+}
+
 int build_request(char *buf, char *method, char *path, char *host,
-                  char *extra_hdr, char *body) {
+                  char *extra_hdr, char *body, int compressed,
+                  char *validators) {
     int p = 0;
     int blen = 0;
     p = append(buf, p, method);
@@ -157,6 +279,8 @@ int build_request(char *buf, char *method, char *path, char *host,
     p = append(buf, p, " HTTP/1.0\r\nHost: ");
     p = append(buf, p, host);
     p = append(buf, p, "\r\nUser-Agent: cupidos-curl/1.0\r\nConnection: close\r\n");
+    if (compressed) p = append(buf, p, "Accept-Encoding: gzip, deflate\r\n");
+    p = append(buf, p, validators);
     if (extra_hdr && extra_hdr[0]) {
         p = append(buf, p, extra_hdr);
         buf[p] = '\r'; p = p + 1;
@@ -203,7 +327,7 @@ void main() {
     char *raw = (char*)get_args();
     if (!raw || raw[0] == 0) {
         println("usage: curl [-o file] [-i] [-s] [-X METHOD] [-d data]");
-        println("            [-H header] <url>");
+        println("            [-H header] [-compressed] [-no-cache] <url>");
         return;
     }
 
@@ -214,6 +338,8 @@ void main() {
     char extra_hdr[512]; extra_hdr[0] = 0;
     int  show_headers = 0;
     int  silent = 0;
+    int  compressed = 0;
+    int  no_cache = 0;
 
     char tok[1024];
     char val[1024];
@@ -228,6 +354,10 @@ void main() {
             show_headers = 1;
         } else if (streq(tok, "-s")) {
             silent = 1;
+        } else if (streq(tok, "-compressed") || streq(tok, "--compressed")) {
+            compressed = 1;
+        } else if (streq(tok, "-no-cache") || streq(tok, "--no-cache")) {
+            no_cache = 1;
         } else if (streq(tok, "-X")) {
             pos = next_token(raw, pos, method, 16);
             if (pos < 0) { println("curl: -X needs method"); return; }
@@ -277,6 +407,37 @@ void main() {
             return;
         }
 
+        /* Requests with a body or custom headers may not mean the same
+         * thing as the cached GET, so only plain GETs use the cache.*/
+        int use_cache = !no_cache && streq(method, "GET") && !post_data[0] &&
+                        !extra_hdr[0];
+        int cached = 0;
+        char validators[256]; validators[0] = 0;
+        body_fd  = out_fd;
+        body_len = 0;
+        keep_len = 0;
+        keep_off = !use_cache;
+        cache_hdr_len = 0;
+        if (use_cache) cached = http_cache_lookup(url, 0);
+        if (cached == HTTP_CACHE_FRESH) {
+            if (emit_cached(url, show_headers) >= 0) {
+                if (out_fd >= 0) {
+                    vfs_close(out_fd);
+                    if (!silent) {
+                        print("curl: wrote ");
+                        print_int(body_len);
+                        print(" bytes to ");
+                        print(outfile);
+                        println(" (from cache)");
+                    }
+                }
+                return;
+            }
+            cached = 0;
+        }
+        if (cached == HTTP_CACHE_STALE &&
+            http_cache_validators(url, validators, 256) <= 0) cached = 0;
+
         U32 ip = 0;
         if (dns_resolve(host, &ip) != 0) {
             if (!silent) {
@@ -322,7 +483,8 @@ void main() {
         }
 
         char req[4096];
-        int  rlen = build_request(req, method, path, host, extra_hdr, post_data);
+        int  rlen = build_request(req, method, path, host, extra_hdr, post_data,
+                                  compressed, validators);
         if (send(fd, req, rlen) < 0) {
             if (!silent) println("curl: send failed");
             close(fd);
@@ -333,12 +495,17 @@ void main() {
         char buf[4096];
         int hdr_state = 0;
         int in_body   = 0;
-        int body_len  = 0;
+        wire_len   = 0;
+        body_enc   = 0;
+        body_z     = (char*)0;
+        body_z_err = 0;
         int status    = 0;
         int sl_state  = 0;          /* 0=skip "HTTP/x.y", 1=digits, 2=done */
         int sl_digits = 0;
         char location[1024]; location[0] = 0;
         int loc_len = 0;
+        int clen = -1;
+        int encoded = 0;            /* any Content-Encoding, decoded or not */
         /* Per-line header capture: buffer the current header line so we
          * can match "Location:" case-insensitively at line end.*/
         char line[1024]; int line_len = 0;
@@ -376,7 +543,26 @@ void main() {
                             }
                             location[lo] = 0;
                             loc_len = lo;
+                        } else if (line_len > 17 && sw_ci(line, "content-encoding:")) {
+                            int li = 17;
+                            while (li < line_len && (line[li] == ' ' || line[li] == '\t')) li = li + 1;
+                            line[line_len] = 0;
+                            if (!sw_ci(line + li, "identity")) encoded = 1;
+                            if (compressed && (sw_ci(line + li, "gzip") || sw_ci(line + li, "x-gzip")))
+                                body_enc = KDEFLATE_WRAP_GZIP;
+                            else if (compressed && sw_ci(line + li, "deflate"))
+                                body_enc = KDEFLATE_WRAP_AUTO;
+                        } else if (line_len > 15 && sw_ci(line, "content-length:")) {
+                            int li = 15;
+                            while (li < line_len && (line[li] == ' ' || line[li] == '\t')) li = li + 1;
+                            clen = 0;
+                            while (li < line_len && line[li] >= '0' && line[li] <= '9') {
+                                clen = clen * 10 + (line[li] - '0');
+                                li = li + 1;
+                            }
                         }
+                        line[line_len] = 0;
+                        cache_hdr_line(line, line_len);
                         line_len = 0;
                     } else if (b != '\r' && line_len < 1023) {
                         line[line_len++] = b;
@@ -392,18 +578,35 @@ void main() {
             /* Skip body entirely if we're going to follow a redirect. */
             int skip_body = (status >= 300 && status < 400 && loc_len > 0
                              && redirects < 5);
-            if (in_body && j < n && !skip_body) {
-                int blen = n - j;
-                if (out_fd >= 0) {
-                    vfs_write(out_fd, buf + j, blen);
-                } else {
-                    int k = 0;
-                    while (k < blen) { putchar(buf[j + k]); k = k + 1; }
-                }
-                body_len = body_len + blen;
-            }
+            if (in_body && j < n && !skip_body) body_put(buf + j, n - j);
         }
         close(fd);
+        int z_done = 1;
+        if (body_z) {
+            z_done = kdeflate_stream_done(body_z);
+            kdeflate_stream_free(body_z);
+            body_z = (char*)0;
+        }
+        if ((body_z_err || !z_done) && !silent) {
+            println(body_z_err ? "curl: corrupt compressed body"
+                               : "curl: compressed body truncated");
+        }
+
+        /* 304: the body is the cached copy. A complete 200 (decoded,
+         * or never encoded) goes into the cache.*/
+        int from_cache = 0;
+        if (status == 304 && cached == HTTP_CACHE_STALE) {
+            http_cache_revalidated(url, cache_hdr, cache_hdr_len);
+            from_cache = emit_cached(url, 0) >= 0;
+        } else if (use_cache && status == 200 && !keep_off && !body_z_err &&
+                   z_done && (!encoded || body_enc) &&
+                   (clen < 0 || wire_len == clen)) {
+            http_cache_store(url, cache_hdr, cache_hdr_len, keep, keep_len);
+        }
+        if (keep) kfree(keep);
+        keep = (char*)0;
+        keep_cap = 0;
+        if (use_cache) http_cache_sync();
 
         /* Follow redirect? */
         if (status >= 300 && status < 400 && loc_len > 0 && redirects < 5) {
@@ -438,7 +641,15 @@ void main() {
                 print("curl: wrote ");
                 print_int(body_len);
                 print(" bytes to ");
-                println(outfile);
+                print(outfile);
+                if (from_cache) {
+                    print(" (not modified, from cache)");
+                } else if (body_enc) {
+                    print(" (");
+                    print_int(wire_len);
+                    print(" compressed)");
+                }
+                println("");
             }
         }
         return;
@@ -0,0 +1,34 @@
+//help: Show or trace per-frame screen damage and present time
+//help: Usage: damagestat [on|off]
+//help: With no argument, prints the damaged pixels, rect count
+//help: and present time of the last frame. "on" logs every
+//help: frame to serial, "off" stops logging.
+
+void main() {
+    char *args = (char*)get_args();
+
+    if (strlen(args) == 0) {
+        int px = 0;
+        int rects = 0;
+        int us = 0;
+        vga_damage_stats(&px, &rects, &us);
+        print("Last frame: ");
+        print_int(px);
+        print(" px in ");
+        print_int(rects);
+        print(" rects, present ");
+        print_int(us);
+        println(" us");
+        return;
+    }
+
+    if (strcmp(args, "on") == 0) {
+        vga_set_damage_debug(1);
+        println("damagestat: serial trace on");
+    } else if (strcmp(args, "off") == 0) {
+        vga_set_damage_debug(0);
+        println("damagestat: serial trace off");
+    } else {
+        println("Usage: damagestat [on|off]");
+    }
+}
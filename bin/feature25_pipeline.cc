@@ -0,0 +1,53 @@
+//help: CupidScript pipeline smoke: 8 concurrent stages over bounded pipes
+//help: Usage: feature25_pipeline
+
+/* A shell function streams 5000 lines through six cat stages into
+ * grep.  Every stage runs at once, so no pipe may hold more than its
+ * 4 KB ring, and the consumer must see data before the generator is
+ * done.  The script writes its own verdict to /tmp/f25.out.*/
+
+char f25_buf[256];
+
+U0 Main() {
+    vfs_write_text("/tmp/f25.cup",
+        "gen() {\n"
+        "    I=0\n"
+        "    while [ $I -lt 5000 ]; do\n"
+        "        echo \"line$I\"\n"
+        "        I=$((I + 1))\n"
+        "    done\n"
+        "}\n"
+        "gen | cat | cat | cat | cat | cat | cat | grep line4999 > /tmp/f25.last\n"
+        "V=bad\n"
+        "if [ $PIPE_PEAK -le 28672 ]; then\n"
+        "    if [ $PIPE_BYTES -gt 28672 ]; then\n"
+        "        if [ $PIPE_FIRST_MS -lt $PIPE_MS ]; then\n"
+        "            V=ok\n"
+        "        fi\n"
+        "    fi\n"
+        "fi\n"
+        "echo $V $PIPE_BYTES $PIPE_PEAK $PIPE_FIRST_MS $PIPE_MS > /tmp/f25.out\n");
+
+    shell_execute_line("cupid /tmp/f25.cup");
+
+    I32 n = vfs_read_text("/tmp/f25.out", f25_buf, 255);
+    if (n < 0) {
+        serial_printf("[feature25] FAIL no result\n");
+        return;
+    }
+    f25_buf[n] = 0;
+
+    char last[32];
+    I32 m = vfs_read_text("/tmp/f25.last", last, 31);
+    if (m < 0) m = 0;
+    last[m] = 0;
+
+    if (f25_buf[0] == 'o' && f25_buf[1] == 'k' &&
+        strncmp(last, "line4999", 8) == 0) {
+        serial_printf("[feature25] PASS %s", f25_buf);
+    } else {
+        serial_printf("[feature25] FAIL %s last=%s\n", f25_buf, last);
+    }
+}
+
+Main();
@@ -0,0 +1,65 @@
+//help: CupidScript benchmark: tree walker vs bytecode on two scripts
+//help: Usage: feature26_cupbench
+
+/* Runs a 100,000-iteration counter loop and a string-processing loop
+ * under `cupid -i` (AST interpreter) and twice under `cupid` (compile,
+ * then cached bytecode).  Both engines must print the same result.*/
+
+char f26_a[128];
+char f26_b[128];
+
+I32 f26_run(char *cmd, char *out, char *buf) {
+    I32 t0 = uptime_ms();
+    shell_execute_line(cmd);
+    I32 ms = uptime_ms() - t0;
+    I32 n = vfs_read_text(out, buf, 127);
+    if (n < 0) n = 0;
+    buf[n] = 0;
+    return ms;
+}
+
+I32 f26_bench(char *name, char *path, char *out) {
+    char cmd[96];
+    strcpy(cmd, "cupid -i ");
+    strcat(cmd, path);
+    I32 ast = f26_run(cmd, out, f26_a);
+    strcpy(cmd, "cupid ");
+    strcat(cmd, path);
+    I32 first = f26_run(cmd, out, f26_b);
+    I32 cached = f26_run(cmd, out, f26_b);
+    serial_printf("[feature26] %s: ast=%dms bytecode=%dms cached=%dms\n",
+                  name, ast, first, cached);
+    if (f26_a[0] == 0 || strcmp(f26_a, f26_b) != 0) {
+        serial_printf("[feature26] FAIL %s: '%s' vs '%s'\n", name, f26_a, f26_b);
+        return 0;
+    }
+    return 1;
+}
+
+U0 Main() {
+    vfs_write_text("/tmp/f26_loop.cup",
+        "I=0\n"
+        "while [ $I -lt 100000 ]; do\n"
+        "    I=$((I + 1))\n"
+        "done\n"
+        "echo $I > /tmp/f26_loop.out\n");
+    vfs_write_text("/tmp/f26_str.cup",
+        "N=0\n"
+        "OUT=none\n"
+        "while [ $N -lt 2000 ]; do\n"
+        "    W=\"item-$N.txt\"\n"
+        "    B=${W%.txt}\n"
+        "    U=${B^^}\n"
+        "    if [ \"$U\" != \"\" ]; then\n"
+        "        OUT=\"$U:${#U}\"\n"
+        "    fi\n"
+        "    N=$((N + 1))\n"
+        "done\n"
+        "echo $OUT > /tmp/f26_str.out\n");
+
+    I32 ok = f26_bench("loop", "/tmp/f26_loop.cup", "/tmp/f26_loop.out");
+    ok = f26_bench("string", "/tmp/f26_str.cup", "/tmp/f26_str.out") && ok;
+    if (ok) serial_printf("[feature26] PASS\n");
+}
+
+Main();
@@ -0,0 +1,4 @@
+// fontstats.cc - Show font glyph-cache statistics
+void main() {
+    fontsys_stats();
+}
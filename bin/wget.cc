@@ -1,7 +1,11 @@
 //help: Download a URL to a file. http:// (plain TCP) or https:// (TLS 1.3).
-//help: Usage: wget [-O file] [-q] <url>
+//help: Usage: wget [-O file] [-q] [-no-cache] <url>
 //help:   -O file   output filename (default: derived from URL path)
 //help:   -q        quiet (suppress progress + error messages)
+//help:   -no-cache always download; don't use or fill the HTTP cache
+//help: gzip/deflate responses are decompressed before saving.
+//help: Downloads go through the shared cache in /home/.cache/http: fresh
+//help: copies are saved without a request, stale ones are revalidated.
 
 enum {
     VFS_WRONLY = 1,
@@ -13,7 +17,13 @@ enum {
     BUFSZ      = 4096,
     REQ_MAX    = 2048,
     HOST_MAX   = 256,
-    PATH_MAX_  = 1024
+    PATH_MAX_  = 1024,
+    KDEFLATE_WRAP_GZIP = 2,
+    KDEFLATE_WRAP_AUTO = 3,
+    HTTP_CACHE_FRESH = 1,
+    HTTP_CACHE_STALE = 2,
+    CACHE_HDR_MAX  = 1024,
+    CACHE_BODY_MAX = 524288
 };
 
 int sw(char *s, char *p) {
@@ -37,6 +47,20 @@ void cstrcpy(char *d, char *s, int max) {
     d[i] = 0;
 }
 
+/* Case-insensitive prefix match. */
+int sw_ci(char *s, char *p) {
+    int i = 0;
+    while (p[i]) {
+        int a = s[i];
+        int b = p[i];
+        if (a >= 'A' && a <= 'Z') a = a + 32;
+        if (b >= 'A' && b <= 'Z') b = b + 32;
+        if (a != b) return 0;
+        i = i + 1;
+    }
+    return 1;
+}
+
 int parse_url(char *url, char *host, int *port_out, char *path,
               int *is_https_out) {
     int i = 0;
@@ -126,26 +150,135 @@ int append(char *dst, int p, char *src) {
     return p;
 }
 
-int build_request(char *buf, char *path, char *host) {
+/* Body sink: gzip/deflate bodies are inflated through a kernel
+ * kdeflate stream on their way to the output file.*/
+int   out_fd = -1;
+int   body_len;         /* bytes saved */
+int   wire_len;         /* body bytes received */
+int   body_enc;         /* KDEFLATE_WRAP_* of the response, 0 = identity */
+char *body_z;
+int   body_z_err;
+
+/* Decoded body kept for http_cache_store; dropped past CACHE_BODY_MAX. */
+char *keep;
+int   keep_len;
+int   keep_cap;
+int   keep_off;         /* 1 = not caching this response */
+
+void keep_put(char *p, int n) {
+    if (keep_off) return;
+    if (keep_len + n > keep_cap) {
+        int cap = keep_cap ? keep_cap * 2 : 65536;
+        while (cap < keep_len + n) cap = cap * 2;
+        char *nb = (char*)0;
+        if (cap <= CACHE_BODY_MAX) nb = (char*)kmalloc(cap);
+        if (!nb) {
+            keep_off = 1;
+            return;
+        }
+        if (keep) {
+            memcpy(nb, keep, keep_len);
+            kfree(keep);
+        }
+        keep = nb;
+        keep_cap = cap;
+    }
+    memcpy(keep + keep_len, p, n);
+    keep_len = keep_len + n;
+}
+
+void body_save(char *p, int n) {
+    vfs_write(out_fd, p, n);
+    body_len = body_len + n;
+    keep_put(p, n);
+}
+
+void body_put(char *p, int n) {
+    wire_len = wire_len + n;
+    if (!body_enc) {
+        body_save(p, n);
+        return;
+    }
+    if (!body_z && !body_z_err) {
+        body_z = (char*)kdeflate_stream_new(body_enc);
+        if (!body_z) body_z_err = 1;
+    }
+    char out[4096];
+    while (n > 0 && !body_z_err) {
+        int used = kdeflate_stream_push(body_z, p, n);
+        p = p + used;
+        n = n - used;
+        while (1) {
+            int got = kdeflate_stream_pull(body_z, out, 4096);
+            if (got < 0) { body_z_err = 1; break; }
+            if (got == 0) break;
+            body_save(out, got);
+        }
+        if (used == 0) break;
+    }
+}
+
+/* Response header lines http_cache_store / _revalidated look at. */
+char cache_hdr[1024];
+int  cache_hdr_len;
+
+void cache_hdr_line(char *line, int len) {
+    if (!(sw_ci(line, "cache-control:") || sw_ci(line, "expires:") ||
+          sw_ci(line, "date:") || sw_ci(line, "age:") || sw_ci(line, "etag:") ||
+          sw_ci(line, "last-modified:") || sw_ci(line, "pragma:") ||
+          sw_ci(line, "vary:") || sw_ci(line, "content-type:"))) return;
+    if (cache_hdr_len + len + 1 > CACHE_HDR_MAX) return;
+    memcpy(cache_hdr + cache_hdr_len, line, len);
+    cache_hdr_len = cache_hdr_len + len;
+    cache_hdr[cache_hdr_len] = '\n';
+    cache_hdr_len = cache_hdr_len + 1;
+}
+
+/* Write the cached body of `url` to `name`. Returns bytes or -1. */
+int save_cached(char *url, char *name) {
+    int len = http_cache_length(url);
+    if (len < 0) return -1;
+    char *b = (char*)kmalloc(len + 1);
+    if (!b) return -1;
+    int n = http_cache_read(url, b, len + 1, (char*)0, 0);
+    if (n >= 0) {
+        char rpath[256];
+        resolve_path(name, rpath);
+        int fd = vfs_open(rpath, VFS_WRONLY + VFS_CREAT + VFS_TRUNC);
+        if (fd < 0) n = -1;
+        else {
+            vfs_write(fd, b, n);
+            vfs_close(fd);
+        }
+    }
+    kfree(b);
+    return n;
+}
+
+int build_request(char *buf, char *path, char *host, char *extra) {
     int p = 0;
     p = append(buf, p, "GET ");
     p = append(buf, p, path);
     p = append(buf, p, " HTTP/1.0\r\nHost: ");
     p = append(buf, p, host);
-    p = append(buf, p, "\r\nUser-Agent: cupidos-wget/1.0\r\nConnection: close\r\n\r\n");
+    p = append(buf, p, "\r\nUser-Agent: cupidos-wget/1.0\r\nConnection: close\r\n");
+    p = append(buf, p, "Accept-Encoding: gzip, deflate\r\n");
+    p = append(buf, p, extra);
+    p = append(buf, p, "\r\n");
     return p;
 }
 
 void main() {
     char *raw = (char*)get_args();
     if (!raw || raw[0] == 0) {
-        println("usage: wget [-O file] [-q] <url>");
+        println("usage: wget [-O file] [-q] [-no-cache] <url>");
         return;
     }
 
     char url[1024]; url[0] = 0;
     char outname[256]; outname[0] = 0;
     int  quiet = 0;
+    int  use_cache = 1;
 
     char tok[1024];
     int  pos = 0;
@@ -157,6 +290,8 @@ void main() {
             if (pos < 0) { println("wget: -O needs file"); return; }
         } else if (streq(tok, "-q")) {
             quiet = 1;
+        } else if (streq(tok, "-no-cache")) {
+            use_cache = 0;
         } else if (tok[0] == '-') {
             print("wget: unknown option ");
             println(tok);
@@ -183,6 +318,28 @@ void main() {
         println(outname);
     }
 
+    /* A fresh cached copy needs no request at all; a stale one is
+     * revalidated with its ETag / Last-Modified.*/
+    int cached = 0;
+    char validators[256]; validators[0] = 0;
+    if (use_cache) cached = http_cache_lookup(url, 0);
+    if (cached == HTTP_CACHE_FRESH) {
+        int n = save_cached(url, outname);
+        if (n >= 0) {
+            if (!quiet) {
+                print("wget: ");
+                print_int(n);
+                print(" bytes saved to ");
+                print(outname);
+                println(" (from cache)");
+            }
+            return;
+        }
+        cached = 0;
+    }
+    if (cached == HTTP_CACHE_STALE &&
+        http_cache_validators(url, validators, 256) <= 0) cached = 0;
+
     U32 ip = 0;
     if (dns_resolve(host, &ip) != 0) {
         if (!quiet) {
@@ -224,7 +381,7 @@ void main() {
     }
 
     char req[2048];
-    int  rlen = build_request(req, path, host);
+    int  rlen = build_request(req, path, host, validators);
     if (send(fd, req, rlen) < 0) {
         if (!quiet) println("wget: send failed");
         close(fd);
@@ -233,7 +390,7 @@ void main() {
 
     char rpath[256];
     resolve_path(outname, rpath);
-    int out_fd = vfs_open(rpath, VFS_WRONLY + VFS_CREAT + VFS_TRUNC);
+    out_fd = vfs_open(rpath, VFS_WRONLY + VFS_CREAT + VFS_TRUNC);
     if (out_fd < 0) {
         if (!quiet) {
             print("wget: cannot create ");
@@ -246,11 +403,13 @@ void main() {
     char buf[4096];
     int hdr_state  = 0;       /* 0..4 for "\r\n\r\n" */
     int in_body    = 0;
-    int body_len   = 0;
     int status     = 0;
     /* Status-line state: 0=skipping "HTTP/x.y", 1=reading digits, 2=done. */
     int sl_state   = 0;
     int sl_digits  = 0;
+    int clen       = -1;
+    char line[512]; int line_len = 0;
+    keep_off = !use_cache;
     while (1) {
         int n = recv(fd, buf, 4096);
         if (n <= 0) break;
@@ -268,6 +427,29 @@ void main() {
                         sl_state = 2;
                     }
                 }
+                if (b == '\n') {
+                    line[line_len] = 0;
+                    if (line_len > 17 && sw_ci(line, "content-encoding:")) {
+                        int li = 17;
+                        while (line[li] == ' ' || line[li] == '\t') li = li + 1;
+                        if (sw_ci(line + li, "gzip") || sw_ci(line + li, "x-gzip"))
+                            body_enc = KDEFLATE_WRAP_GZIP;
+                        else if (sw_ci(line + li, "deflate"))
+                            body_enc = KDEFLATE_WRAP_AUTO;
+                    } else if (line_len > 15 && sw_ci(line, "content-length:")) {
+                        int li = 15;
+                        while (line[li] == ' ' || line[li] == '\t') li = li + 1;
+                        clen = 0;
+                        while (line[li] >= '0' && line[li] <= '9') {
+                            clen = clen * 10 + (line[li] - '0');
+                            li = li + 1;
+                        }
+                    }
+                    cache_hdr_line(line, line_len);
+                    line_len = 0;
+                } else if (b != '\r' && line_len < 511) {
+                    line[line_len] = b; line_len = line_len + 1;
+                }
                 if (b == '\r' && (hdr_state == 0 || hdr_state == 2)) hdr_state = hdr_state + 1;
                 else if (b == '\n' && (hdr_state == 1 || hdr_state == 3)) hdr_state = hdr_state + 1;
                 else hdr_state = 0;
@@ -275,15 +457,35 @@ void main() {
                 if (hdr_state == 4) { in_body = 1; break; }
             }
         }
-        if (in_body && j < n) {
-            int blen = n - j;
-            vfs_write(out_fd, buf + j, blen);
-            body_len = body_len + blen;
-        }
+        if (in_body && j < n) body_put(buf + j, n - j);
     }
 
     vfs_close(out_fd);
     close(fd);
+    int z_done = 1;
+    if (body_z) {
+        z_done = kdeflate_stream_done(body_z);
+        kdeflate_stream_free(body_z);
+    }
+    if ((body_z_err || !z_done) && !quiet) {
+        println(body_z_err ? "wget: corrupt compressed body"
+                           : "wget: compressed body truncated");
+    }
+
+    int from_cache = 0;
+    if (status == 304 && cached == HTTP_CACHE_STALE) {
+        http_cache_revalidated(url, cache_hdr, cache_hdr_len);
+        int n = save_cached(url, outname);
+        if (n >= 0) {
+            body_len = n;
+            from_cache = 1;
+        }
+    } else if (use_cache && status == 200 && !keep_off && !body_z_err && z_done &&
+               (clen < 0 || wire_len == clen)) {
+        http_cache_store(url, cache_hdr, cache_hdr_len, keep, keep_len);
+    }
+    if (keep) kfree(keep);
+    if (use_cache) http_cache_sync();
 
     if (!quiet) {
         print("wget: HTTP ");
@@ -292,6 +494,14 @@ void main() {
         print(", ");
         print_int(body_len);
         print(" bytes saved to ");
-        println(outname);
+        print(outname);
+        if (from_cache) {
+            print(" (not modified, from cache)");
+        } else if (body_enc) {
+            print(" (");
+            print_int(wire_len);
+            print(" compressed)");
+        }
+        println("");
     }
 }
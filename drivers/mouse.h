@@ -33,7 +33,7 @@ void mouse_irq_handler(struct registers *r);
 void mouse_draw_cursor(void);
 void mouse_save_under_cursor(void);
 void mouse_restore_under_cursor(void);
-void mouse_mark_cursor_dirty(void); /* mark dirty rect covering old+new cursor */
+void mouse_mark_cursor_dirty(void); /* mark dirty rects for old and new cursor */
 
 /* Fast path: restore old cursor and draw new cursor directly on the
  * displayed LFB page - no memcpy/flip needed.*/
@@ -8,12 +8,15 @@
 */
 
 #include "vga.h"
+#include "cpu.h"
+#include "kernel.h"
 #include "memory.h"
 #include "ports.h"
 #include "simd.h"
 #include "string.h"
 #include "types.h"
 #include "timer.h"
+#include "serial.h"
 
 /* Bochs VBE I/O */
 #define VBE_PORT_INDEX 0x01CE
@@ -49,64 +52,156 @@ bool vga_flip_ready(void) {
   return (now - last_flip_ms) >= 16u;
 }
 
-/* Dirty tracking for partial present (union of marked regions). */
+/* Damage tracking for partial present.
+ *
+ * The damage region is a bounded list of disjoint rectangles. A new rect
+ * that overlaps an existing one, or whose union with it wastes little
+ * area, is merged into it (and the merged rect re-checked against the
+ * rest so the list stays disjoint). When the list is full the new rect
+ * is folded into whichever entry grows the least. Past
+ * VGA_DAMAGE_FULL_PCT of the screen the region collapses to a full
+ * present, which is cheaper than many scattered row copies.*/
+#define VGA_DAMAGE_MAX_RECTS 16
+#define VGA_DAMAGE_FULL_PCT  60
+/* Union may waste up to this many pixels beyond the two areas before
+ * we keep the rects separate (~ a 32x32 tile).*/
+#define VGA_DAMAGE_MERGE_SLACK 1024
+
+typedef struct {
+  int x0, y0, x1, y1;
+} vga_rect_t;
+
 static bool dirty_full = true;
-static bool dirty_active = false;
-static int dirty_x0 = 0;
-static int dirty_y0 = 0;
-static int dirty_x1 = 0;
-static int dirty_y1 = 0;
+static vga_rect_t dirty_rects[VGA_DAMAGE_MAX_RECTS];
+static int dirty_count = 0;
+static uint32_t dirty_area = 0;
+
+/* Debug overlay: per-frame damage and present cost to serial. */
+static bool damage_debug = false;
+static uint32_t damage_frame = 0;
+static uint32_t last_present_px = 0;
+static uint32_t last_present_rects = 0;
+static uint32_t last_present_us = 0;
+
+static uint32_t rect_area(const vga_rect_t *r) {
+  return (uint32_t)(r->x1 - r->x0) * (uint32_t)(r->y1 - r->y0);
+}
+
+static bool rects_overlap(const vga_rect_t *a, const vga_rect_t *b) {
+  return a->x0 < b->x1 && b->x0 < a->x1 && a->y0 < b->y1 && b->y0 < a->y1;
+}
+
+static vga_rect_t rect_union(const vga_rect_t *a, const vga_rect_t *b) {
+  vga_rect_t u;
+  u.x0 = a->x0 < b->x0 ? a->x0 : b->x0;
+  u.y0 = a->y0 < b->y0 ? a->y0 : b->y0;
+  u.x1 = a->x1 > b->x1 ? a->x1 : b->x1;
+  u.y1 = a->y1 > b->y1 ? a->y1 : b->y1;
+  return u;
+}
+
+static bool rects_should_merge(const vga_rect_t *a, const vga_rect_t *b) {
+  vga_rect_t u;
+  if (rects_overlap(a, b))
+    return true;
+  u = rect_union(a, b);
+  return rect_area(&u) <= rect_area(a) + rect_area(b) + VGA_DAMAGE_MERGE_SLACK;
+}
+
+static void damage_remove(int i) {
+  dirty_area -= rect_area(&dirty_rects[i]);
+  dirty_rects[i] = dirty_rects[dirty_count - 1];
+  dirty_count--;
+}
+
+static void damage_set_full(void) {
+  dirty_full = true;
+  dirty_count = 0;
+  dirty_area = (uint32_t)VGA_GFX_PIXELS;
+}
 
 void vga_mark_dirty(int x, int y, int w, int h) {
-  int x0, y0, x1, y1;
+  vga_rect_t r;
 
   if (dirty_full)
     return;
   if (w <= 0 || h <= 0)
     return;
 
-  x0 = x;
-  y0 = y;
-  x1 = x + w;
-  y1 = y + h;
-
-  if (x0 < 0)
-    x0 = 0;
-  if (y0 < 0)
-    y0 = 0;
-  if (x1 > VGA_GFX_WIDTH)
-    x1 = VGA_GFX_WIDTH;
-  if (y1 > VGA_GFX_HEIGHT)
-    y1 = VGA_GFX_HEIGHT;
-  if (x1 <= x0 || y1 <= y0)
-    return;
+  r.x0 = x;
+  r.y0 = y;
+  r.x1 = x + w;
+  r.y1 = y + h;
 
-  if (!dirty_active) {
-    dirty_x0 = x0;
-    dirty_y0 = y0;
-    dirty_x1 = x1;
-    dirty_y1 = y1;
-    dirty_active = true;
+  if (r.x0 < 0)
+    r.x0 = 0;
+  if (r.y0 < 0)
+    r.y0 = 0;
+  if (r.x1 > VGA_GFX_WIDTH)
+    r.x1 = VGA_GFX_WIDTH;
+  if (r.y1 > VGA_GFX_HEIGHT)
+    r.y1 = VGA_GFX_HEIGHT;
+  if (r.x1 <= r.x0 || r.y1 <= r.y0)
     return;
+
+  /* Absorb every entry the new rect should merge with. Each merge can
+   * grow r into further entries, so rescan from the start until stable.*/
+  for (int i = 0; i < dirty_count;) {
+    if (rects_should_merge(&r, &dirty_rects[i])) {
+      r = rect_union(&r, &dirty_rects[i]);
+      damage_remove(i);
+      i = 0;
+      continue;
+    }
+    i++;
+  }
+
+  if (dirty_count == VGA_DAMAGE_MAX_RECTS) {
+    int best = 0;
+    uint32_t best_growth = 0xFFFFFFFFu;
+    for (int i = 0; i < dirty_count; i++) {
+      vga_rect_t u = rect_union(&r, &dirty_rects[i]);
+      uint32_t growth = rect_area(&u) - rect_area(&dirty_rects[i]);
+      if (growth < best_growth) {
+        best_growth = growth;
+        best = i;
+      }
+    }
+    r = rect_union(&r, &dirty_rects[best]);
+    damage_remove(best);
+    /* The grown rect may now overlap others; keep the list disjoint. */
+    for (int i = 0; i < dirty_count;) {
+      if (rects_overlap(&r, &dirty_rects[i])) {
+        r = rect_union(&r, &dirty_rects[i]);
+        damage_remove(i);
+        i = 0;
+        continue;
+      }
+      i++;
+    }
   }
 
-  if (x0 < dirty_x0)
-    dirty_x0 = x0;
-  if (y0 < dirty_y0)
-    dirty_y0 = y0;
-  if (x1 > dirty_x1)
-    dirty_x1 = x1;
-  if (y1 > dirty_y1)
-    dirty_y1 = y1;
+  dirty_rects[dirty_count++] = r;
+  dirty_area += rect_area(&r);
+
+  if (dirty_area * 100u >= (uint32_t)VGA_GFX_PIXELS * VGA_DAMAGE_FULL_PCT)
+    damage_set_full();
 }
 
-void vga_mark_dirty_full(void) {
-  dirty_full = true;
-  dirty_active = false;
-  dirty_x0 = 0;
-  dirty_y0 = 0;
-  dirty_x1 = VGA_GFX_WIDTH;
-  dirty_y1 = VGA_GFX_HEIGHT;
+void vga_mark_dirty_full(void) { damage_set_full(); }
+
+void vga_set_damage_debug(bool enabled) {
+  damage_debug = enabled;
+  damage_frame = 0;
+}
+
+void vga_damage_stats(uint32_t *pixels, uint32_t *rects, uint32_t *present_us) {
+  if (pixels)
+    *pixels = last_present_px;
+  if (rects)
+    *rects = last_present_rects;
+  if (present_us)
+    *present_us = last_present_us;
 }
 
 void vga_init_vbe(void) {
@@ -162,22 +257,47 @@ void vga_flip(void) {
    * in QEMU fullscreen mode.*/
   uint32_t *page0 = lfb_ptr;
 
-  if (dirty_full || !dirty_active) {
+  uint64_t t0 = rdtsc();
+  uint32_t px;
+  uint32_t nrects;
+
+  if (dirty_full) {
     simd_memcpy(page0, back_buffer, (uint32_t)VGA_GFX_SIZE);
+    px = (uint32_t)VGA_GFX_PIXELS;
+    nrects = 1u;
   } else {
-    uint32_t x0 = (uint32_t)dirty_x0;
-    uint32_t y0 = (uint32_t)dirty_y0;
-    uint32_t x1 = (uint32_t)dirty_x1;
-    uint32_t y1 = (uint32_t)dirty_y1;
-    simd_blit_rect(page0 + y0 * (uint32_t)VGA_GFX_WIDTH + x0,
-                   back_buffer + y0 * (uint32_t)VGA_GFX_WIDTH + x0,
-                   (uint32_t)VGA_GFX_WIDTH,
-                   (uint32_t)VGA_GFX_WIDTH,
-                   x1 - x0,
-                   y1 - y0);
+    for (int i = 0; i < dirty_count; i++) {
+      uint32_t x0 = (uint32_t)dirty_rects[i].x0;
+      uint32_t y0 = (uint32_t)dirty_rects[i].y0;
+      uint32_t x1 = (uint32_t)dirty_rects[i].x1;
+      uint32_t y1 = (uint32_t)dirty_rects[i].y1;
+      simd_blit_rect(page0 + y0 * (uint32_t)VGA_GFX_WIDTH + x0,
+                     back_buffer + y0 * (uint32_t)VGA_GFX_WIDTH + x0,
+                     (uint32_t)VGA_GFX_WIDTH,
+                     (uint32_t)VGA_GFX_WIDTH,
+                     x1 - x0,
+                     y1 - y0);
+    }
+    px = dirty_area;
+    nrects = (uint32_t)dirty_count;
+  }
+
+  last_present_px = px;
+  last_present_rects = nrects;
+  {
+    uint64_t tsc_per_us = get_cpu_freq() / 1000000u;
+    uint64_t dt = rdtsc() - t0;
+    last_present_us = tsc_per_us ? (uint32_t)(dt / tsc_per_us) : 0u;
+  }
+  if (damage_debug) {
+    serial_printf("[vga] frame %u: %u rects, %u px (%u%%), present %u us\n",
+                  damage_frame, nrects, px,
+                  (px * 100u) / (uint32_t)VGA_GFX_PIXELS, last_present_us);
   }
+  damage_frame++;
 
-  dirty_active = false;
+  dirty_count = 0;
+  dirty_area = 0;
   dirty_full = false;
   last_flip_ms = timer_get_uptime_ms();
 }
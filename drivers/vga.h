@@ -37,16 +37,27 @@ uint32_t *vga_get_framebuffer(void);
 /* Clear entire screen to a single color */
 void vga_clear_screen(uint32_t color);
 
-/* Copy back buffer to linear framebuffer */
+/* Copy the damaged parts of the back buffer to the linear framebuffer.
+ * Nothing is copied when no damage was marked since the last flip; a
+ * caller that drew without marking must call vga_mark_dirty_full().*/
 void vga_flip(void);
 
 /* Mark a dirty rectangle for the next vga_flip().
- * Rectangle is clipped to screen bounds; multiple calls are unioned.*/
+ * Rectangle is clipped to screen bounds and added to a bounded list of
+ * disjoint damage rects; close or overlapping rects are merged, and
+ * heavy damage falls back to a full-screen present.*/
 void vga_mark_dirty(int x, int y, int w, int h);
 
 /* Mark the full screen dirty for the next vga_flip(). */
 void vga_mark_dirty_full(void);
 
+/* Log per-frame damaged rect/pixel counts and present time to serial. */
+void vga_set_damage_debug(bool enabled);
+
+/* Stats for the most recent vga_flip(): pixels copied, rects blitted,
+ * and present time in microseconds. Any pointer may be NULL.*/
+void vga_damage_stats(uint32_t *pixels, uint32_t *rects, uint32_t *present_us);
+
 /* Enable/disable retrace wait inside vga_flip (default: enabled). */
 void vga_set_vsync_wait(bool enabled);
 
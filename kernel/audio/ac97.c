@@ -1,4 +1,5 @@
 #include "ac97.h"
+#include "mixer.h"
 #include "pci.h"
 #include "ports.h"
 #include "irq.h"
@@ -291,15 +292,21 @@ static int16_t *gen_triangle_mono(uint32_t hz, uint32_t ms, uint32_t *out_frames
     return p;
 }
 
+/* mixer_stop only queues the stop and the slot then fades out over a
+ * few ms, so wait for it to go idle before freeing its samples. */
+static void stop_slot(int slot) {
+    mixer_stop(slot);
+    for (uint32_t ms = 0; ms < 250u && mixer_active(slot); ms++) {
+        ac97_tsc_sleep_ms(1u);
+    }
+}
+
 void ac97_smoke_sweep(void) {
     if (!s_ac97.present) {
         serial_write_string("[SKIP] audiotest sweep: no AC97\n");
         return;
     }
 
-    extern int  mixer_play(int, const int16_t *, uint32_t, uint8_t, uint8_t, uint8_t, uint8_t);
-    extern void mixer_stop(int);
-
     static const uint32_t F[8] = { 50u, 100u, 200u, 400u, 800u, 1600u, 3200u, 8000u };
     for (int i = 0; i < 8; i++) {
         uint32_t frames = 0u;
@@ -307,7 +314,7 @@ void ac97_smoke_sweep(void) {
         if (!t) { continue; }
         mixer_play(9, t, frames, (uint8_t)1, (uint8_t)0, (uint8_t)100, (uint8_t)100);
         ac97_tsc_sleep_ms(500u);
-        mixer_stop(9);
+        stop_slot(9);
         kfree(t);
     }
     serial_write_string("[PASS] audiotest sweep\n");
@@ -319,10 +326,6 @@ void ac97_smoke_pan(void) {
         return;
     }
 
-    extern int  mixer_play(int, const int16_t *, uint32_t, uint8_t, uint8_t, uint8_t, uint8_t);
-    extern void mixer_stop(int);
-    extern void mixer_set_volume(int, uint8_t, uint8_t);
-
     uint32_t frames = 0u;
     int16_t *t = gen_triangle_mono(1000u, 4000u, &frames);   /* 4s @ 1kHz */
     if (!t) {
@@ -339,7 +342,7 @@ void ac97_smoke_pan(void) {
             ac97_tsc_sleep_ms(50u);
         }
     }
-    mixer_stop(9);
+    stop_slot(9);
     kfree(t);
     serial_write_string("[PASS] audiotest pan\n");
 }
@@ -393,7 +396,10 @@ void audiotest_all(void) {
     ac97_smoke_sweep();
     ac97_smoke_pan();
     extern void opl_smoke(void);
+    extern int opl_compare(void);
     opl_smoke();
+    opl_compare();
+    mixer_bench();
     serial_write_string("[PASS] audiotest all\n");
 }
 
@@ -403,9 +409,6 @@ int ac97_smoke_sine(void) {
         return 0;
     }
 
-    extern int  mixer_play(int, const int16_t *, uint32_t, uint8_t, uint8_t, uint8_t, uint8_t);
-    extern void mixer_stop(int);
-
     uint32_t frames = 0u;
     int16_t *pcm = make_triangle_pcm(&frames);
     if (!pcm) {
@@ -416,7 +419,7 @@ int ac97_smoke_sine(void) {
     /* Play via mixer slot 9, looping, half-scale volume */
     mixer_play(9, pcm, frames, (uint8_t)1, (uint8_t)1, (uint8_t)100, (uint8_t)100);
     ac97_tsc_sleep_ms(2000u);
-    mixer_stop(9);
+    stop_slot(9);
 
     kfree(pcm);
     serial_write_string("[PASS] audiotest sine\n");
@@ -34,6 +34,6 @@ int  ac97_is_present_int(void);   /* returns 0 or 1 */
 int  ac97_smoke_sine(void);       /* sets fill CB, plays 440 Hz triangle 2 s, logs [PASS] */
 void ac97_smoke_sweep(void);      /* 8-freq sweep 50->8000 Hz, 500 ms each, logs [PASS] */
 void ac97_smoke_pan(void);        /* 1 kHz for 4 s with L↔R panning ramps, logs [PASS] */
-void audiotest_all(void);         /* runs sine+sweep+pan+opl in sequence, logs [PASS] audiotest all */
+void audiotest_all(void);         /* runs sine+sweep+pan+opl+oplcmp+mixer bench, logs [PASS] audiotest all */
 
 #endif
@@ -4,14 +4,17 @@
  * a MIDI running-status parser, allocates 9 OPL3 melodic channels via
  * round-robin / LRU steal, and renders s16 stereo @ 22050 Hz.
  *
- * Internal OPL3 rate: 49716 Hz (Nuked-OPL3 native).  midiopl_render
- * generates at 49716 then linear-resamples to 22050.
+ * Two interchangeable OPL3 cores sit behind the same register writes:
+ * Nuked-OPL3 (cycle-accurate, runs at 49716 Hz and resamples) and
+ * opl_fast (table-driven, runs at 22050 Hz directly).  See
+ * midiopl_set_core.
  *
  * Not wired into the audio chain yet - Task 17 does that.
 */
 
 #include "midiopl.h"
 #include "nuked_opl3.h"
+#include "opl_fast.h"
 #include "serial.h"
 #include "string.h"
 
@@ -77,6 +80,43 @@ static int             s_patches_loaded = 0;
  * opl3_chip is large (~32KB); lives in BSS (zero-init, no flash cost).
 */
 static opl3_chip g_chip;
+static opl_fast_t g_fast;
+
+/* Active core, plus a switch requested by midiopl_set_core.  The switch
+ * is applied by midiopl_render so the core only ever changes on the
+ * thread that drives it.  s_regs shadows every register written so the
+ * new core can be brought up to the same state.*/
+static int              s_core = MIDIOPL_CORE_NUKED;
+static volatile int     s_core_req = MIDIOPL_CORE_NUKED;
+static uint8_t          s_regs[512];
+
+static void core_reset(void)
+{
+    if (s_core == MIDIOPL_CORE_FAST) opl_fast_reset(&g_fast, 22050u);
+    else                             OPL3_Reset(&g_chip, 22050u);
+}
+
+static void opl_write(uint16_t reg, uint8_t v)
+{
+    s_regs[reg & 0x1FFu] = v;
+    if (s_core == MIDIOPL_CORE_FAST) opl_fast_write(&g_fast, reg, v);
+    else                             OPL3_WriteRegBuffered(&g_chip, reg, v);
+}
+
+/* Bring the newly selected core up to the shadowed register state.
+ * $105 goes first so bank-1 writes land; keyed-on channels restart
+ * their attack, which is inaudible next to the core change itself.*/
+static void core_switch(int core)
+{
+    uint16_t reg;
+
+    s_core = core;
+    core_reset();
+    opl_write((uint16_t)0x105u, s_regs[0x105u]);
+    for (reg = 0u; reg < 0x200u; reg++) {
+        if (reg != 0x105u) opl_write(reg, s_regs[reg]);
+    }
+}
 
 /* OPL3 18-voice allocator. Bank 0 (registers 0x000..0x0FF) holds voices
  * 0..8; bank 1 (registers 0x100..0x1FF) holds voices 9..17.
@@ -285,9 +325,11 @@ int midiopl_init(const uint8_t *genmidi_lump, uint32_t lump_len)
      * then linear-resampled in midiopl_render - same interpolation
      * but with a phase reset at every buffer boundary, which produced
      * audible buzz at the music-pull cadence.*/
-    OPL3_Reset(&g_chip, 22050u);
+    s_core = s_core_req;
+    core_reset();
+    memset(s_regs, 0, sizeof(s_regs));
     /* Enable OPL3 mode (new-register access + bank 1 + CHA/CHB stereo) */
-    OPL3_WriteRegBuffered(&g_chip, (uint16_t)0x105u, (uint8_t)0x01u);
+    opl_write((uint16_t)0x105u, (uint8_t)0x01u);
 
     for (i = 0; i < NUM_OPL_CH; i++) {
         s_opl_ch[i].in_use      = 0;
@@ -614,26 +656,26 @@ static void program_voice(int oplv, const opl_voice_t *vc)
     mod_lvl = (uint8_t)((vc->mod.scale & 0xC0u)
               | ((modulating ? vc->mod.level : 0x3Fu) & 0x3Fu));
 
-    OPL3_WriteRegBuffered(&g_chip, (uint16_t)(bank | (0x20u + (uint16_t)mod_off)), vc->mod.tremolo);
-    OPL3_WriteRegBuffered(&g_chip, (uint16_t)(bank | (0x40u + (uint16_t)mod_off)), mod_lvl);
-    OPL3_WriteRegBuffered(&g_chip, (uint16_t)(bank | (0x60u + (uint16_t)mod_off)), vc->mod.attack);
-    OPL3_WriteRegBuffered(&g_chip, (uint16_t)(bank | (0x80u + (uint16_t)mod_off)), vc->mod.sustain);
-    OPL3_WriteRegBuffered(&g_chip, (uint16_t)(bank | (0xE0u + (uint16_t)mod_off)), vc->mod.waveform);
+    opl_write((uint16_t)(bank | (0x20u + (uint16_t)mod_off)), vc->mod.tremolo);
+    opl_write((uint16_t)(bank | (0x40u + (uint16_t)mod_off)), mod_lvl);
+    opl_write((uint16_t)(bank | (0x60u + (uint16_t)mod_off)), vc->mod.attack);
+    opl_write((uint16_t)(bank | (0x80u + (uint16_t)mod_off)), vc->mod.sustain);
+    opl_write((uint16_t)(bank | (0xE0u + (uint16_t)mod_off)), vc->mod.waveform);
 
     /* Carrier - silence first; set_voice_volume applies velocity-scaled
      * volume after.*/
-    OPL3_WriteRegBuffered(&g_chip, (uint16_t)(bank | (0x20u + (uint16_t)car_off)), vc->car.tremolo);
-    OPL3_WriteRegBuffered(&g_chip, (uint16_t)(bank | (0x40u + (uint16_t)car_off)),
-                          (uint8_t)((vc->car.scale & 0xC0u) | 0x3Fu));
-    OPL3_WriteRegBuffered(&g_chip, (uint16_t)(bank | (0x60u + (uint16_t)car_off)), vc->car.attack);
-    OPL3_WriteRegBuffered(&g_chip, (uint16_t)(bank | (0x80u + (uint16_t)car_off)), vc->car.sustain);
-    OPL3_WriteRegBuffered(&g_chip, (uint16_t)(bank | (0xE0u + (uint16_t)car_off)), vc->car.waveform);
+    opl_write((uint16_t)(bank | (0x20u + (uint16_t)car_off)), vc->car.tremolo);
+    opl_write((uint16_t)(bank | (0x40u + (uint16_t)car_off)),
+              (uint8_t)((vc->car.scale & 0xC0u) | 0x3Fu));
+    opl_write((uint16_t)(bank | (0x60u + (uint16_t)car_off)), vc->car.attack);
+    opl_write((uint16_t)(bank | (0x80u + (uint16_t)car_off)), vc->car.sustain);
+    opl_write((uint16_t)(bank | (0xE0u + (uint16_t)car_off)), vc->car.waveform);
 
     /* Feedback / connection. OR 0x30 = both L+R output enable (OPL3
      * stereo). set_voice_pan rewrites this register if the MIDI
      * channel pan CC has biased the note off-centre.*/
-    OPL3_WriteRegBuffered(&g_chip, (uint16_t)(bank | (0xC0u + (uint16_t)ch)),
-                          (uint8_t)((fb & 0x0Fu) | 0x30u));
+    opl_write((uint16_t)(bank | (0xC0u + (uint16_t)ch)),
+              (uint8_t)((fb & 0x0Fu) | 0x30u));
 }
 
 /* Apply velocity + channel-volume + master-volume scaled carrier
@@ -672,7 +714,7 @@ static void set_voice_volume(int oplv, const opl_voice_t *vc,
     if (reg_vol > 0x3Fu) reg_vol = 0x3Fu;
 
     reg = (uint8_t)((vc->car.scale & 0xC0u) | ((0x3Fu - reg_vol) & 0x3Fu));
-    OPL3_WriteRegBuffered(&g_chip, (uint16_t)(bank | (0x40u + (uint16_t)car_off)), reg);
+    opl_write((uint16_t)(bank | (0x40u + (uint16_t)car_off)), reg);
 }
 
 /* Apply pan: write the channel's $C0 register with CHA / CHB output
@@ -689,9 +731,8 @@ static void set_voice_pan(int oplv, const opl_voice_t *vc, uint8_t pan)
     else if (pan > 96u)  cha_chb = 0x20u;   /* hard right (CHB only) */
     else                 cha_chb = 0x30u;   /* centred (both) */
 
-    OPL3_WriteRegBuffered(&g_chip,
-                          (uint16_t)(bank | (0xC0u + (uint16_t)ch)),
-                          (uint8_t)((vc->feedback & 0x0Fu) | cha_chb));
+    opl_write((uint16_t)(bank | (0xC0u + (uint16_t)ch)),
+              (uint8_t)((vc->feedback & 0x0Fu) | cha_chb));
 }
 
 /* Key-on / Key-off helpers - bank-aware (voices 0..17)
@@ -701,11 +742,11 @@ static void key_on_freq(int oplv, uint32_t freq)
     uint16_t bank = voice_bank(oplv);
     uint8_t  ch   = voice_ch(oplv);
 
-    OPL3_WriteRegBuffered(&g_chip, (uint16_t)(bank | (0xA0u + (uint16_t)ch)),
-                          (uint8_t)(freq & 0xFFu));
+    opl_write((uint16_t)(bank | (0xA0u + (uint16_t)ch)),
+              (uint8_t)(freq & 0xFFu));
     /* $B0: bit 5 = key-on, bits 4..2 = block, bits 1..0 = FNUM upper. */
-    OPL3_WriteRegBuffered(&g_chip, (uint16_t)(bank | (0xB0u + (uint16_t)ch)),
-                          (uint8_t)(((freq >> 8) & 0x1Fu) | 0x20u));
+    opl_write((uint16_t)(bank | (0xB0u + (uint16_t)ch)),
+              (uint8_t)(((freq >> 8) & 0x1Fu) | 0x20u));
 }
 
 static void key_off(int oplv)
@@ -713,9 +754,8 @@ static void key_off(int oplv)
     uint16_t bank = voice_bank(oplv);
     uint8_t  ch   = voice_ch(oplv);
 
-    OPL3_WriteRegBuffered(&g_chip,
-                          (uint16_t)(bank | (0xB0u + (uint16_t)ch)),
-                          (uint8_t)0x00u);
+    opl_write((uint16_t)(bank | (0xB0u + (uint16_t)ch)),
+              (uint8_t)0x00u);
 }
 
 /* Frequency lookup matching chocolate-doom FrequencyForVoice. Returns
@@ -984,12 +1024,28 @@ static void pitch_bend_change(uint8_t ch, uint16_t bend)
  * Nuked-OPL3 runs its DSP at 49716 Hz and resamples to whatever rate
  * was passed to OPL3_Reset (we use 22050). OPL3_GenerateStream emits
  * stereo s16 at that target rate with phase carried between calls.
+ * opl_fast steps its generators at 22050 Hz directly.
  * Master volume is applied per-voice via set_voice_volume so the
  * chip's internal mixbuffer never saturates - at this point we just
  * stream the resampled output straight to the caller.
 */
 void midiopl_render(int16_t *out_stereo, uint32_t frames)
 {
-    OPL3_GenerateStream(&g_chip, out_stereo, frames);
+    int req = s_core_req;
+
+    if (req != s_core) core_switch(req);
+    if (s_core == MIDIOPL_CORE_FAST) opl_fast_generate(&g_fast, out_stereo, frames);
+    else                             OPL3_GenerateStream(&g_chip, out_stereo, frames);
+}
+
+void midiopl_set_core(int core)
+{
+    s_core_req = (core == MIDIOPL_CORE_FAST) ? MIDIOPL_CORE_FAST
+                                             : MIDIOPL_CORE_NUKED;
+}
+
+int midiopl_get_core(void)
+{
+    return s_core_req;
 }
 
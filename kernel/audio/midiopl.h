@@ -13,9 +13,19 @@ void midiopl_reset(void);
 void midiopl_feed(const uint8_t *bytes, uint32_t len);
 
 /* Pull synth output: frames * 2 s16 stereo samples @ 22050 Hz.
- * Drives Nuked-OPL3 native @ 49716 Hz internally and resamples.*/
+ * Drives the selected OPL3 core (see midiopl_set_core).*/
 void midiopl_render(int16_t *out_stereo, uint32_t frames);
 
+/* OPL3 emulation core. NUKED is cycle-accurate at 49716 Hz and
+ * resampled; FAST is table-driven at the output rate and several
+ * times cheaper. A change takes effect at the next midiopl_render,
+ * which replays the current register state into the new core.*/
+#define MIDIOPL_CORE_NUKED 0
+#define MIDIOPL_CORE_FAST  1
+
+void midiopl_set_core(int core);
+int  midiopl_get_core(void);
+
 void midiopl_set_volume(uint8_t vol_0_127);
 
 #endif /* KERNEL_AUDIO_MIDIOPL_H */
@@ -1,72 +1,313 @@
 #include "mixer.h"
+#include "simd.h"
+#include "cpu.h"
+#include "kernel.h"
+#include "memory.h"
+#include "serial.h"
+
+/* 16-slot software mixer.
+ *
+ * Control calls (play / stop / volume / rate) come from ordinary
+ * threads while mixer_fill runs from the AC97 IRQ tail, so the two
+ * sides never touch the same slot state: callers append a command to
+ * a ring and mixer_fill applies everything queued before it mixes.
+ * Producers are serialised by a short spinlock, which keeps the ring
+ * itself single-producer / single-consumer and lock-free against the
+ * IRQ.
+ *
+ * Each slot is resampled (16.16 fractional step, linear or 4-tap
+ * Catmull-Rom) into a stereo scratch block, scaled by its ramped gain
+ * and added into an int32 bus; the bus is packed to s16 with signed
+ * saturation once at the end instead of clamping after every slot.*/
 
 typedef struct {
     const int16_t *pcm;
     uint32_t       len_frames;
     uint32_t       pos_frames;
+    uint32_t       pos_frac;      /* 0..0xFFFF below pos_frames */
+    uint32_t       step;          /* 16.16 source frames per output frame */
     uint8_t        channels;
     uint8_t        loop;
-    uint8_t        vol_l;
-    uint8_t        vol_r;
     uint8_t        active;
     uint8_t        is_stream;
+    uint8_t        stopping;      /* fading out; idle once the ramp ends */
+    int32_t        gain_l;        /* current volume, Q8 (vol << 8) */
+    int32_t        gain_r;
+    int32_t        target_l;
+    int32_t        target_r;
+    int32_t        delta_l;       /* per-frame ramp increment */
+    int32_t        delta_r;
+    uint32_t       ramp_left;
     mixer_pull_fn  pull;
     void          *ctx;
 } slot_t;
 
-static slot_t s_slots[MIXER_SLOTS];
+typedef struct {
+    slot_t   slots[MIXER_SLOTS];
+    uint8_t  interp;
+    int32_t  bus[MIXER_MAX_FRAMES * 2];
+    int16_t  scratch[MIXER_MAX_FRAMES * 2];
+} mix_state_t;
+
+enum {
+    CMD_PLAY,
+    CMD_STREAM,
+    CMD_STOP,
+    CMD_VOLUME,
+    CMD_RATE,
+    CMD_INTERP
+};
+
+typedef struct {
+    uint8_t        op;
+    uint8_t        slot;
+    uint8_t        channels;
+    uint8_t        loop;
+    uint8_t        vol_l;
+    uint8_t        vol_r;
+    uint8_t        arg;
+    uint32_t       seq;
+    const int16_t *pcm;
+    uint32_t       frames;
+    uint32_t       step;
+    mixer_pull_fn  pull;
+    void          *ctx;
+} mixer_cmd_t;
+
+static mix_state_t s_live;
+
+static mixer_cmd_t s_ring[MIXER_CMD_RING];
+static uint32_t    s_ring_head;               /* producer-owned */
+static uint32_t    s_ring_tail;               /* consumer-owned */
+static uint32_t    s_ring_drop;
+static uint32_t    s_producer_lock;
+
+/* mixer_active must answer for commands still sitting in the ring:
+ * play/stop bump req_seq, the consumer copies it to done_seq once
+ * applied, and until the two match the caller's intent wins. */
+static uint32_t    s_req_seq[MIXER_SLOTS];
+static uint32_t    s_done_seq[MIXER_SLOTS];
+static uint8_t     s_want_active[MIXER_SLOTS];
+
+static int slot_valid(int slot) { return slot >= 0 && slot < MIXER_SLOTS; }
+
+static uint32_t rate_to_step(uint32_t rate_hz) {
+    return (uint32_t)(((uint64_t)rate_hz << 16) / MIXER_RATE_HZ);
+}
 
 int mixer_init(void) {
     for (int i = 0; i < MIXER_SLOTS; i++) {
-        s_slots[i].active    = 0;
-        s_slots[i].is_stream = 0;
+        s_live.slots[i].active    = 0;
+        s_live.slots[i].is_stream = 0;
+        s_req_seq[i]     = 0;
+        s_done_seq[i]    = 0;
+        s_want_active[i] = 0;
     }
+    s_live.interp = MIXER_INTERP_LINEAR;
+    s_ring_head = 0;
+    s_ring_tail = 0;
+    s_ring_drop = 0;
     return 0;
 }
 
-static int slot_valid(int slot) { return slot >= 0 && slot < MIXER_SLOTS; }
+/* Producer side */
+
+static int cmd_push(mixer_cmd_t *c) {
+    uint32_t eflags;
+    int rc = 0;
+    __asm__ volatile("pushf; pop %0; cli" : "=r"(eflags));
+    while (__atomic_exchange_n(&s_producer_lock, 1u, __ATOMIC_ACQUIRE))
+        __asm__ volatile("pause");
+
+    uint32_t head = s_ring_head;
+    uint32_t tail = __atomic_load_n(&s_ring_tail, __ATOMIC_ACQUIRE);
+    if (head - tail >= MIXER_CMD_RING) {
+        s_ring_drop++;
+        rc = -1;
+    } else {
+        if (c->op == CMD_PLAY || c->op == CMD_STREAM || c->op == CMD_STOP) {
+            s_want_active[c->slot] = (uint8_t)(c->op != CMD_STOP);
+            c->seq = s_req_seq[c->slot] + 1u;
+            __atomic_store_n(&s_req_seq[c->slot], c->seq, __ATOMIC_RELEASE);
+        }
+        s_ring[head % MIXER_CMD_RING] = *c;
+        __atomic_store_n(&s_ring_head, head + 1u, __ATOMIC_RELEASE);
+    }
+
+    __atomic_store_n(&s_producer_lock, 0u, __ATOMIC_RELEASE);
+    if (eflags & (1u << 9)) __asm__ volatile("sti");
+    return rc;
+}
+
+int mixer_play_rate(int slot, const int16_t *pcm, uint32_t frames,
+                    uint8_t channels, uint8_t loop,
+                    uint8_t vol_l, uint8_t vol_r, uint32_t rate_hz) {
+    if (!slot_valid(slot) || !pcm || frames == 0u ||
+        (channels != 1 && channels != 2) ||
+        rate_hz < 1000u || rate_hz > 96000u) return -1;
+    mixer_cmd_t c = { 0 };
+    c.op       = CMD_PLAY;
+    c.slot     = (uint8_t)slot;
+    c.pcm      = pcm;
+    c.frames   = frames;
+    c.channels = channels;
+    c.loop     = loop;
+    c.vol_l    = vol_l;
+    c.vol_r    = vol_r;
+    c.step     = rate_to_step(rate_hz);
+    return cmd_push(&c);
+}
 
 int mixer_play(int slot, const int16_t *pcm, uint32_t frames,
                uint8_t channels, uint8_t loop,
                uint8_t vol_l, uint8_t vol_r) {
-    if (!slot_valid(slot) || !pcm || (channels != 1 && channels != 2)) return -1;
-    s_slots[slot].pcm        = pcm;
-    s_slots[slot].len_frames = frames;
-    s_slots[slot].pos_frames = 0;
-    s_slots[slot].channels   = channels;
-    s_slots[slot].loop       = loop;
-    s_slots[slot].vol_l      = vol_l;
-    s_slots[slot].vol_r      = vol_r;
-    s_slots[slot].is_stream  = 0;
-    s_slots[slot].active     = 1;
-    return 0;
+    return mixer_play_rate(slot, pcm, frames, channels, loop,
+                           vol_l, vol_r, MIXER_RATE_HZ);
 }
 
 int mixer_play_stream(int slot, mixer_pull_fn pull, void *ctx,
                       uint8_t vol_l, uint8_t vol_r) {
     if (!slot_valid(slot) || !pull) return -1;
-    s_slots[slot].pull      = pull;
-    s_slots[slot].ctx       = ctx;
-    s_slots[slot].vol_l     = vol_l;
-    s_slots[slot].vol_r     = vol_r;
-    s_slots[slot].is_stream = 1;
-    s_slots[slot].active    = 1;
-    return 0;
+    mixer_cmd_t c = { 0 };
+    c.op    = CMD_STREAM;
+    c.slot  = (uint8_t)slot;
+    c.pull  = pull;
+    c.ctx   = ctx;
+    c.vol_l = vol_l;
+    c.vol_r = vol_r;
+    return cmd_push(&c);
 }
 
 void mixer_stop(int slot) {
-    if (slot_valid(slot)) s_slots[slot].active = 0;
+    if (!slot_valid(slot)) return;
+    mixer_cmd_t c = { 0 };
+    c.op   = CMD_STOP;
+    c.slot = (uint8_t)slot;
+    (void)cmd_push(&c);
 }
 
 int mixer_active(int slot) {
-    return slot_valid(slot) ? (int)s_slots[slot].active : 0;
+    if (!slot_valid(slot)) return 0;
+    uint32_t req = __atomic_load_n(&s_req_seq[slot], __ATOMIC_ACQUIRE);
+    /* A queued play counts as playing. A queued stop does not count as
+     * stopped: the slot still plays, then fades, reading its source. */
+    if (__atomic_load_n(&s_done_seq[slot], __ATOMIC_ACQUIRE) != req &&
+        s_want_active[slot])
+        return 1;
+    return (int)__atomic_load_n(&s_live.slots[slot].active, __ATOMIC_ACQUIRE);
 }
 
 void mixer_set_volume(int slot, uint8_t vol_l, uint8_t vol_r) {
-    if (slot_valid(slot)) {
-        s_slots[slot].vol_l = vol_l;
-        s_slots[slot].vol_r = vol_r;
+    if (!slot_valid(slot)) return;
+    mixer_cmd_t c = { 0 };
+    c.op    = CMD_VOLUME;
+    c.slot  = (uint8_t)slot;
+    c.vol_l = vol_l;
+    c.vol_r = vol_r;
+    (void)cmd_push(&c);
+}
+
+void mixer_set_rate(int slot, uint32_t rate_hz) {
+    if (!slot_valid(slot) || rate_hz < 1000u || rate_hz > 96000u) return;
+    mixer_cmd_t c = { 0 };
+    c.op   = CMD_RATE;
+    c.slot = (uint8_t)slot;
+    c.step = rate_to_step(rate_hz);
+    (void)cmd_push(&c);
+}
+
+void mixer_set_interp(int mode) {
+    mixer_cmd_t c = { 0 };
+    c.op   = CMD_INTERP;
+    c.slot = 0;
+    c.arg  = (uint8_t)(mode == MIXER_INTERP_CUBIC ? MIXER_INTERP_CUBIC
+                                                  : MIXER_INTERP_LINEAR);
+    (void)cmd_push(&c);
+}
+
+uint32_t mixer_ring_drops(void) {
+    return __atomic_load_n(&s_ring_drop, __ATOMIC_RELAXED);
+}
+
+/* Consumer side */
+
+static void set_target(slot_t *sl, uint8_t vol_l, uint8_t vol_r) {
+    sl->target_l  = (int32_t)vol_l << 8;
+    sl->target_r  = (int32_t)vol_r << 8;
+    sl->delta_l   = (sl->target_l - sl->gain_l) / MIXER_RAMP_FRAMES;
+    sl->delta_r   = (sl->target_r - sl->gain_r) / MIXER_RAMP_FRAMES;
+    sl->ramp_left = MIXER_RAMP_FRAMES;
+}
+
+/* New sounds fade in from silence so a retriggered slot does not jump
+ * straight from the old waveform to the new one. */
+static void start_slot(slot_t *sl, uint8_t vol_l, uint8_t vol_r) {
+    sl->gain_l   = 0;
+    sl->gain_r   = 0;
+    sl->stopping = 0;
+    set_target(sl, vol_l, vol_r);
+    __atomic_store_n(&sl->active, 1u, __ATOMIC_RELEASE);
+}
+
+static void apply_cmd(mix_state_t *m, const mixer_cmd_t *c) {
+    slot_t *sl = &m->slots[c->slot];
+    switch (c->op) {
+    case CMD_PLAY:
+        sl->pcm        = c->pcm;
+        sl->len_frames = c->frames;
+        sl->pos_frames = 0;
+        sl->pos_frac   = 0;
+        sl->step       = c->step;
+        sl->channels   = c->channels;
+        sl->loop       = c->loop;
+        sl->is_stream  = 0;
+        start_slot(sl, c->vol_l, c->vol_r);
+        break;
+    case CMD_STREAM:
+        sl->pull      = c->pull;
+        sl->ctx       = c->ctx;
+        sl->is_stream = 1;
+        start_slot(sl, c->vol_l, c->vol_r);
+        break;
+    case CMD_STOP:
+        if (sl->active && !sl->stopping) {
+            sl->stopping = 1;
+            set_target(sl, 0, 0);
+        }
+        break;
+    case CMD_VOLUME:
+        if (sl->active && !sl->stopping) set_target(sl, c->vol_l, c->vol_r);
+        break;
+    case CMD_RATE:
+        sl->step = c->step;
+        break;
+    case CMD_INTERP:
+        m->interp = c->arg;
+        break;
+    default:
+        break;
+    }
+    if (c->op == CMD_PLAY || c->op == CMD_STREAM || c->op == CMD_STOP)
+        __atomic_store_n(&s_done_seq[c->slot], c->seq, __ATOMIC_RELEASE);
+}
+
+static void drain_commands(void) {
+    uint32_t head = __atomic_load_n(&s_ring_head, __ATOMIC_ACQUIRE);
+    uint32_t tail = s_ring_tail;
+    while (tail != head) {
+        apply_cmd(&s_live, &s_ring[tail % MIXER_CMD_RING]);
+        tail++;
     }
+    __atomic_store_n(&s_ring_tail, tail, __ATOMIC_RELEASE);
+}
+
+/* Resampler */
+
+static int32_t tap(const slot_t *sl, uint32_t i, uint32_t ch) {
+    if (i >= sl->len_frames)
+        i = sl->loop ? i % sl->len_frames : sl->len_frames - 1u;
+    return sl->channels == 2u ? (int32_t)sl->pcm[i * 2u + ch]
+                              : (int32_t)sl->pcm[i];
 }
 
 static int16_t clamp16(int32_t v) {
@@ -75,44 +316,361 @@ static int16_t clamp16(int32_t v) {
     return (int16_t)v;
 }
 
-void mixer_fill(int16_t *out, uint32_t frames) {
-    /* zero output */
-    for (uint32_t f = 0; f < frames; f++) {
-        out[f * 2u + 0u] = 0;
-        out[f * 2u + 1u] = 0;
+/* 4-tap Catmull-Rom with the phase cut to Q12 so every product stays
+ * inside int32 for full-scale input. */
+static int16_t cubic(int32_t p0, int32_t p1, int32_t p2, int32_t p3,
+                     uint32_t frac) {
+    int32_t t = (int32_t)(frac >> 4);
+    int32_t a = (-p0 + 3 * p1 - 3 * p2 + p3) / 2;
+    int32_t b = (2 * p0 - 5 * p1 + 4 * p2 - p3) / 2;
+    int32_t c = (p2 - p0) / 2;
+    int32_t v = ((a * t) >> 12) + b;
+    v = ((v * t) >> 12) + c;
+    v = ((v * t) >> 12) + p1;
+    return clamp16(v);
+}
+
+static int16_t lerp(int32_t s1, int32_t s2, uint32_t frac) {
+    return (int16_t)(s1 + (((s2 - s1) * (int32_t)(frac >> 1)) >> 15));
+}
+
+static int16_t resample_one(const slot_t *sl, uint32_t ch, uint8_t interp) {
+    uint32_t i = sl->pos_frames;
+    int32_t s1 = tap(sl, i, ch);
+    int32_t s2 = tap(sl, i + 1u, ch);
+    if (interp == MIXER_INTERP_CUBIC) {
+        uint32_t prev = i ? i - 1u : (sl->loop ? sl->len_frames - 1u : 0u);
+        return cubic(tap(sl, prev, ch), s1, s2, tap(sl, i + 2u, ch),
+                     sl->pos_frac);
     }
-    static int16_t scratch[1024 * 2];   /* per-slot stereo */
-    for (int s = 0; s < MIXER_SLOTS; s++) {
-        slot_t *sl = &s_slots[s];
-        if (!sl->active) continue;
-        if (sl->is_stream) {
-            sl->pull(scratch, frames, sl->ctx);
-            for (uint32_t f = 0; f < frames; f++) {
-                int32_t l = (int32_t)scratch[f * 2u + 0u] * (int32_t)sl->vol_l;
-                int32_t r = (int32_t)scratch[f * 2u + 1u] * (int32_t)sl->vol_r;
-                out[f * 2u + 0u] = clamp16((int32_t)out[f * 2u + 0u] + (l >> 7));
-                out[f * 2u + 1u] = clamp16((int32_t)out[f * 2u + 1u] + (r >> 7));
+    return lerp(s1, s2, sl->pos_frac);
+}
+
+/* Render up to `frames` stereo frames of a PCM slot into dst.  Returns
+ * the frames produced; fewer than asked means a one-shot ran out.
+ * Frames whose taps all lie inside the sample take the unchecked
+ * loops below; only the edges go through tap(). */
+static uint32_t render_pcm(slot_t *sl, int16_t *dst, uint32_t frames,
+                           uint8_t interp) {
+    const uint32_t ch     = sl->channels;
+    const uint32_t step   = sl->step;
+    const uint32_t before = interp == MIXER_INTERP_CUBIC ? 1u : 0u;
+    const uint32_t after  = interp == MIXER_INTERP_CUBIC ? 2u : 1u;
+    uint32_t n = 0;
+    while (n < frames) {
+        if (sl->pos_frames >= sl->len_frames) {
+            if (!sl->loop) {
+                __atomic_store_n(&sl->active, 0u, __ATOMIC_RELEASE);
+                break;
             }
-        } else {
-            for (uint32_t f = 0; f < frames; f++) {
-                if (sl->pos_frames >= sl->len_frames) {
-                    if (sl->loop) sl->pos_frames = 0u;
-                    else { sl->active = 0; break; }
+            sl->pos_frames %= sl->len_frames;
+        }
+        uint32_t pos  = sl->pos_frames;
+        uint32_t frac = sl->pos_frac;
+
+        if (step == 0x10000u && frac == 0u) {
+            /* Native rate: straight copy up to the end of the sample. */
+            uint32_t run = sl->len_frames - pos;
+            if (run > frames - n) run = frames - n;
+            const int16_t *src = sl->pcm + pos * ch;
+            int16_t *d = dst + n * 2u;
+            if (ch == 2u) {
+                for (uint32_t f = 0; f < run * 2u; f++) d[f] = src[f];
+            } else {
+                for (uint32_t f = 0; f < run; f++) {
+                    d[f * 2u + 0u] = src[f];
+                    d[f * 2u + 1u] = src[f];
                 }
-                int16_t lv, rv;
-                if (sl->channels == 1u) {
-                    int16_t v = sl->pcm[sl->pos_frames];
-                    lv = v; rv = v;
+            }
+            sl->pos_frames += run;
+            n += run;
+            continue;
+        }
+
+        if (pos >= before && pos + after < sl->len_frames) {
+            const uint32_t limit = sl->len_frames - after;
+            while (n < frames && pos < limit) {
+                const int16_t *p = sl->pcm + pos * ch;
+                int16_t l, r;
+                if (interp == MIXER_INTERP_CUBIC) {
+                    l = cubic(p[-(int32_t)ch], p[0], p[ch], p[2u * ch], frac);
+                    r = ch == 2u ? cubic(p[-1], p[1], p[3], p[5], frac) : l;
                 } else {
-                    lv = sl->pcm[sl->pos_frames * 2u + 0u];
-                    rv = sl->pcm[sl->pos_frames * 2u + 1u];
+                    l = lerp(p[0], p[ch], frac);
+                    r = ch == 2u ? lerp(p[1], p[3], frac) : l;
                 }
-                int32_t li = (int32_t)lv * (int32_t)sl->vol_l;
-                int32_t ri = (int32_t)rv * (int32_t)sl->vol_r;
-                out[f * 2u + 0u] = clamp16((int32_t)out[f * 2u + 0u] + (li >> 7));
-                out[f * 2u + 1u] = clamp16((int32_t)out[f * 2u + 1u] + (ri >> 7));
-                sl->pos_frames++;
+                dst[n * 2u + 0u] = l;
+                dst[n * 2u + 1u] = r;
+                frac += step;
+                pos  += frac >> 16;
+                frac &= 0xFFFFu;
+                n++;
             }
+            sl->pos_frames = pos;
+            sl->pos_frac   = frac;
+            continue;
         }
+
+        int16_t l = resample_one(sl, 0u, interp);
+        int16_t r = ch == 2u ? resample_one(sl, 1u, interp) : l;
+        dst[n * 2u + 0u] = l;
+        dst[n * 2u + 1u] = r;
+        sl->pos_frac   += step;
+        sl->pos_frames += sl->pos_frac >> 16;
+        sl->pos_frac   &= 0xFFFFu;
+        n++;
+    }
+    return n;
+}
+
+/* Bus */
+
+/* bus[i] += (src[i] * gain) >> 7, gains alternating L/R. */
+static void bus_add(int32_t *bus, const int16_t *src, uint32_t frames,
+                    int16_t gain_l, int16_t gain_r, bool sse) {
+    uint32_t n = frames * 2u;
+    uint32_t i = 0;
+#ifdef __SSE2__
+    if (sse) {
+        int16_t g[8] = { gain_l, gain_r, gain_l, gain_r,
+                         gain_l, gain_r, gain_l, gain_r };
+        for (; i + 8u <= n; i += 8u) {
+            /* pmullw/pmulhw give the low/high halves of each 16x16
+             * product; interleaving them rebuilds the exact 32-bit
+             * products for the arithmetic shift. */
+            __asm__ volatile(
+                "movdqu (%1), %%xmm0\n\t"
+                "movdqu (%2), %%xmm3\n\t"
+                "movdqa %%xmm0, %%xmm1\n\t"
+                "pmullw %%xmm3, %%xmm0\n\t"
+                "pmulhw %%xmm3, %%xmm1\n\t"
+                "movdqa %%xmm0, %%xmm2\n\t"
+                "punpcklwd %%xmm1, %%xmm0\n\t"
+                "punpckhwd %%xmm1, %%xmm2\n\t"
+                "psrad $7, %%xmm0\n\t"
+                "psrad $7, %%xmm2\n\t"
+                "movdqu (%0), %%xmm4\n\t"
+                "movdqu 16(%0), %%xmm5\n\t"
+                "paddd %%xmm4, %%xmm0\n\t"
+                "paddd %%xmm5, %%xmm2\n\t"
+                "movdqu %%xmm0, (%0)\n\t"
+                "movdqu %%xmm2, 16(%0)\n\t"
+                :
+                : "r"(bus + i), "r"(src + i), "r"(g)
+                : "memory", "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5");
+        }
+    }
+#else
+    (void)sse;
+#endif
+    for (; i < n; i++) {
+        int32_t g = (i & 1u) ? gain_r : gain_l;
+        bus[i] += ((int32_t)src[i] * g) >> 7;
+    }
+}
+
+/* Scale one slot's block by its gain and add it to the bus.  Frames
+ * inside a ramp are done one by one; the rest go through bus_add. */
+static void slot_accumulate(int32_t *bus, const int16_t *src,
+                            uint32_t frames, slot_t *sl, bool sse) {
+    uint32_t f = 0;
+    while (sl->ramp_left && f < frames) {
+        sl->gain_l += sl->delta_l;
+        sl->gain_r += sl->delta_r;
+        if (--sl->ramp_left == 0u) {
+            sl->gain_l = sl->target_l;
+            sl->gain_r = sl->target_r;
+        }
+        bus[f * 2u + 0u] += ((int32_t)src[f * 2u + 0u] * sl->gain_l) >> 15;
+        bus[f * 2u + 1u] += ((int32_t)src[f * 2u + 1u] * sl->gain_r) >> 15;
+        f++;
+    }
+    if (sl->stopping && sl->ramp_left == 0u) {
+        __atomic_store_n(&sl->active, 0u, __ATOMIC_RELEASE);
+        return;
+    }
+    if (f < frames && (sl->gain_l | sl->gain_r))
+        bus_add(bus + f * 2u, src + f * 2u, frames - f,
+                (int16_t)(sl->gain_l >> 8), (int16_t)(sl->gain_r >> 8), sse);
+}
+
+static void bus_clear(int32_t *bus, uint32_t n, bool sse) {
+    uint32_t i = 0;
+#ifdef __SSE2__
+    if (sse) {
+        __asm__ volatile("pxor %%xmm0, %%xmm0" ::: "xmm0");
+        for (; i + 4u <= n; i += 4u)
+            __asm__ volatile("movdqu %%xmm0, (%0)" : : "r"(bus + i)
+                             : "memory", "xmm0");
+    }
+#else
+    (void)sse;
+#endif
+    for (; i < n; i++) bus[i] = 0;
+}
+
+static void bus_pack(int16_t *out, const int32_t *bus, uint32_t n, bool sse) {
+    uint32_t i = 0;
+#ifdef __SSE2__
+    if (sse) {
+        for (; i + 8u <= n; i += 8u) {
+            __asm__ volatile(
+                "movdqu (%1), %%xmm0\n\t"
+                "movdqu 16(%1), %%xmm1\n\t"
+                "packssdw %%xmm1, %%xmm0\n\t"
+                "movdqu %%xmm0, (%0)\n\t"
+                :
+                : "r"(out + i), "r"(bus + i)
+                : "memory", "xmm0", "xmm1");
+        }
+    }
+#else
+    (void)sse;
+#endif
+    for (; i < n; i++) out[i] = clamp16(bus[i]);
+}
+
+static void mix_block(mix_state_t *m, int16_t *out, uint32_t frames,
+                      bool sse) {
+    bus_clear(m->bus, frames * 2u, sse);
+    for (int s = 0; s < MIXER_SLOTS; s++) {
+        slot_t *sl = &m->slots[s];
+        if (!sl->active) continue;
+        uint32_t got = frames;
+        if (sl->is_stream) sl->pull(m->scratch, frames, sl->ctx);
+        else got = render_pcm(sl, m->scratch, frames, m->interp);
+        slot_accumulate(m->bus, m->scratch, got, sl, sse);
+    }
+    bus_pack(out, m->bus, frames * 2u, sse);
+}
+
+static void mix_frames(mix_state_t *m, int16_t *out, uint32_t frames,
+                       bool sse) {
+    while (frames) {
+        uint32_t n = frames > MIXER_MAX_FRAMES ? MIXER_MAX_FRAMES : frames;
+        mix_block(m, out, n, sse);
+        out    += n * 2u;
+        frames -= n;
     }
 }
+
+/* mixer_fill runs from the AC97 IRQ, and the interrupt path saves no
+ * FPU state, while the mixer (and the compiler, under -mfpmath=sse)
+ * uses xmm registers and MXCSR. So the whole x87/SSE state is bracketed
+ * by an fxsave/fxrstor. The area lives on the stack rather than per CPU
+ * because a CupidC program can call mixer_fill from process context,
+ * where the IRQ may nest on top of it. */
+void mixer_fill(int16_t *out, uint32_t frames) {
+    uint8_t fx[512] __attribute__((aligned(16)));
+    __asm__ volatile("fxsave (%0)" : : "r"(fx) : "memory");
+
+    drain_commands();
+    mix_frames(&s_live, out, frames, simd_enabled());
+
+    __asm__ volatile("fxrstor (%0)" : : "r"(fx) : "memory");
+}
+
+/* Benchmark */
+
+#define BENCH_FRAMES   512u
+#define BENCH_BUFFERS  64u
+#define BENCH_SRC      4096u
+
+static mix_state_t s_bench;
+
+/* Fill every bench slot with a looping source: a mix of 11025 Hz mono,
+ * 32000 Hz stereo and native-rate mono so all resampler paths run. */
+static void bench_load(const int16_t *mono, const int16_t *stereo,
+                       uint8_t interp) {
+    s_bench.interp = interp;
+    for (int s = 0; s < MIXER_SLOTS; s++) {
+        slot_t *sl = &s_bench.slots[s];
+        uint32_t kind = (uint32_t)s % 3u;
+        sl->pcm        = kind == 1u ? stereo : mono;
+        sl->channels   = (uint8_t)(kind == 1u ? 2u : 1u);
+        sl->len_frames = BENCH_SRC;
+        sl->pos_frames = (uint32_t)s * 97u;
+        sl->pos_frac   = 0;
+        sl->step       = rate_to_step(kind == 0u ? 11025u
+                                    : kind == 1u ? 32000u : MIXER_RATE_HZ);
+        sl->loop       = 1;
+        sl->is_stream  = 0;
+        sl->stopping   = 0;
+        sl->gain_l     = 0;
+        sl->gain_r     = 0;
+        sl->active     = 1;
+        set_target(sl, (uint8_t)(40u + (uint32_t)s * 5u),
+                   (uint8_t)(120u - (uint32_t)s * 5u));
+    }
+}
+
+static uint32_t bench_run(const int16_t *mono, const int16_t *stereo,
+                          int16_t *out, uint8_t interp, bool sse) {
+    bench_load(mono, stereo, interp);
+    mix_frames(&s_bench, out, BENCH_FRAMES, sse);   /* warm-up, ramps */
+    uint64_t t0 = rdtsc();
+    for (uint32_t b = 0; b < BENCH_BUFFERS; b++)
+        mix_frames(&s_bench, out, BENCH_FRAMES, sse);
+    return (uint32_t)((rdtsc() - t0) / BENCH_BUFFERS);
+}
+
+static uint32_t cycles_to_us(uint32_t cycles) {
+    uint64_t hz = get_cpu_freq();
+    return hz ? (uint32_t)(((uint64_t)cycles * 1000000u) / hz) : 0u;
+}
+
+int mixer_bench(void) {
+    int16_t *mono   = (int16_t *)kmalloc(BENCH_SRC * sizeof(int16_t));
+    int16_t *stereo = (int16_t *)kmalloc(BENCH_SRC * 2u * sizeof(int16_t));
+    int16_t *out_a  = (int16_t *)kmalloc(BENCH_FRAMES * 2u * sizeof(int16_t));
+    int16_t *out_b  = (int16_t *)kmalloc(BENCH_FRAMES * 2u * sizeof(int16_t));
+    if (!mono || !stereo || !out_a || !out_b) {
+        serial_write_string("[FAIL] mixer bench: kmalloc\n");
+        if (mono) kfree(mono);
+        if (stereo) kfree(stereo);
+        if (out_a) kfree(out_a);
+        if (out_b) kfree(out_b);
+        return -1;
+    }
+
+    /* Near-full-scale triangles: 16 of them overflow s16, so the
+     * saturating pack is exercised too. */
+    for (uint32_t i = 0; i < BENCH_SRC; i++) {
+        uint32_t ph = i & 63u;
+        int32_t v = ph < 32u ? (int32_t)ph * 2000 - 32000
+                             : 32000 - (int32_t)(ph - 32u) * 2000;
+        mono[i]           = (int16_t)v;
+        stereo[i * 2u]    = (int16_t)v;
+        stereo[i * 2u + 1u] = (int16_t)(-v);
+    }
+
+    bool sse = simd_enabled();
+    uint32_t lin_scalar = bench_run(mono, stereo, out_a, MIXER_INTERP_LINEAR, false);
+    uint32_t lin_sse    = bench_run(mono, stereo, out_b, MIXER_INTERP_LINEAR, sse);
+    int same = 1;
+    for (uint32_t i = 0; i < BENCH_FRAMES * 2u; i++)
+        if (out_a[i] != out_b[i]) { same = 0; break; }
+    uint32_t cub_scalar = bench_run(mono, stereo, out_a, MIXER_INTERP_CUBIC, false);
+    uint32_t cub_sse    = bench_run(mono, stereo, out_b, MIXER_INTERP_CUBIC, sse);
+    for (uint32_t i = 0; i < BENCH_FRAMES * 2u; i++)
+        if (out_a[i] != out_b[i]) { same = 0; break; }
+
+    serial_printf("[mixer] bench: %u slots x %u frames, buffer = %u us\n",
+                  (uint32_t)MIXER_SLOTS, BENCH_FRAMES,
+                  (uint32_t)((BENCH_FRAMES * 1000000u) / MIXER_RATE_HZ));
+    serial_printf("[mixer]   linear: scalar %u cyc (%u us)  %s %u cyc (%u us)\n",
+                  lin_scalar, cycles_to_us(lin_scalar),
+                  sse ? "sse2" : "scalar", lin_sse, cycles_to_us(lin_sse));
+    serial_printf("[mixer]   cubic:  scalar %u cyc (%u us)  %s %u cyc (%u us)\n",
+                  cub_scalar, cycles_to_us(cub_scalar),
+                  sse ? "sse2" : "scalar", cub_sse, cycles_to_us(cub_sse));
+    serial_printf("[mixer]   ring drops %u\n", mixer_ring_drops());
+    serial_write_string(same ? "[PASS] mixer bench\n"
+                             : "[FAIL] mixer bench: sse2 != scalar\n");
+
+    kfree(mono);
+    kfree(stereo);
+    kfree(out_a);
+    kfree(out_b);
+    return same ? (int)cycles_to_us(lin_sse) : -1;
+}
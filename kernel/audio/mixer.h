@@ -6,21 +6,63 @@
 #define MIXER_SLOTS         16
 #define MIXER_RATE_HZ       22050
 
+/* Longest block mixed in one pass; larger mixer_fill requests are
+ * split.  Matches the AC97 buffer size. */
+#define MIXER_MAX_FRAMES    1024
+
+/* Commands queued between two mixer_fill calls.  A full ring drops
+ * the command (counted in mixer_ring_drops). */
+#define MIXER_CMD_RING      64
+
+/* Volume / start / stop changes are ramped over this many frames. */
+#define MIXER_RAMP_FRAMES   64
+
+/* Resampler quality (mixer_set_interp) */
+#define MIXER_INTERP_LINEAR 0
+#define MIXER_INTERP_CUBIC  1
+
 typedef void (*mixer_pull_fn)(int16_t *out_stereo, uint32_t frames, void *ctx);
 
 int  mixer_init(void);
 
+/* Control calls below only queue a command; it takes effect at the
+ * start of the next mixer_fill.  Sample memory must stay valid until
+ * mixer_active(slot) reads 0 after mixer_stop (the fade-out still
+ * reads it). */
 int  mixer_play(int slot, const int16_t *pcm, uint32_t frames,
                 uint8_t channels, uint8_t loop,
                 uint8_t vol_l, uint8_t vol_r);
 
+/* mixer_play for PCM recorded at rate_hz (1000..96000); the slot is
+ * resampled to MIXER_RATE_HZ on the fly. */
+int  mixer_play_rate(int slot, const int16_t *pcm, uint32_t frames,
+                     uint8_t channels, uint8_t loop,
+                     uint8_t vol_l, uint8_t vol_r, uint32_t rate_hz);
+
 int  mixer_play_stream(int slot, mixer_pull_fn pull, void *ctx,
                        uint8_t vol_l, uint8_t vol_r);
 
+/* Stop fades the slot out over the next 64 frames instead of cutting it.
+ * Until mixer_active(slot) reads 0 the mixer still reads the slot's PCM,
+ * or calls its pull function with its ctx, from the AC97 IRQ; free or
+ * reuse them only after that. */
 void mixer_stop(int slot);
+/* Nonzero while the slot plays or is fading out.  A play still queued
+ * already counts as playing; a queued stop does not count until its
+ * fade-out has finished. */
 int  mixer_active(int slot);
 void mixer_set_volume(int slot, uint8_t vol_l, uint8_t vol_r);
+void mixer_set_rate(int slot, uint32_t rate_hz);
+void mixer_set_interp(int mode);
 
+/* Consumer side: drains the command ring, then mixes. */
 void mixer_fill(int16_t *out, uint32_t frames);
 
+uint32_t mixer_ring_drops(void);
+
+/* Mix 512-frame buffers with all 16 slots busy on a private slot set
+ * and log the CPU time per buffer.  Returns microseconds per buffer
+ * for the SSE2 path with linear interpolation. */
+int  mixer_bench(void);
+
 #endif
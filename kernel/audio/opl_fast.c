@@ -0,0 +1,446 @@
+/* opl_fast.c - table-driven OPL3 FM core
+ *
+ * Works like the chip: each operator looks up -log2(sin) for its phase,
+ * adds its attenuation (envelope + total level + key scaling + tremolo)
+ * in the log domain and converts back through a 2^x table.  Unlike
+ * Nuked-OPL3 it steps every generator once per *output* sample: phase
+ * increments, envelope rates and LFO clocks are pre-scaled from the
+ * 49716 Hz chip clock to the requested rate, so nothing is resampled
+ * afterwards.  Envelope timing is an average-rate model rather than
+ * the chip's per-sample increment pattern.
+*/
+
+#include "opl_fast.h"
+
+#define OPL_NATIVE_HZ 49716u
+
+enum { EG_OFF, EG_ATTACK, EG_DECAY, EG_SUSTAIN, EG_RELEASE };
+
+#define EG_MAX  (0x1FF << 16)
+
+static uint16_t s_logsin[256];   /* -log2(sin) of a quarter wave, 1/256 steps */
+static uint16_t s_exp[256];      /* 2^(-x/256) mantissa, 1024..2042 */
+static int      s_tables_ready;
+
+/* Frequency multiplier x2 (register value 0..15). */
+static const uint8_t MULT_X2[16] = {
+    1, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 20, 24, 24, 30, 30
+};
+
+/* Key-scale level by the top four F-number bits. */
+static const uint8_t KSL_ROM[16] = {
+    0, 32, 40, 45, 48, 51, 53, 55, 56, 58, 59, 60, 61, 62, 63, 64
+};
+
+/* KSL register value -> shift applied to the key-scale attenuation
+ * (off, 3, 1.5, 6 dB/octave). */
+static const uint8_t KSL_SHIFT[4] = { 8, 1, 2, 0 };
+
+/* Operator slot (register low five bits) -> operator within a bank. */
+static const int8_t SLOT_OP[32] = {
+     0,  1,  2,  3,  4,  5, -1, -1,  6,  7,  8,  9, 10, 11, -1, -1,
+    12, 13, 14, 15, 16, 17, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
+};
+
+/* Tables
+ *
+ * Built once with plain double arithmetic (the kernel libm uses a
+ * CupidC calling convention, so it is not callable from here). */
+
+static double sin_quarter(double x) {
+    double term = x;
+    double sum  = x;
+    for (int k = 1; k < 10; k++) {
+        term *= -x * x / (double)((2 * k) * (2 * k + 1));
+        sum  += term;
+    }
+    return sum;
+}
+
+static double log2_unit(double y) {
+    double e = 0.0;
+    while (y < 1.0) { y *= 2.0; e -= 1.0; }
+    double t  = (y - 1.0) / (y + 1.0);
+    double t2 = t * t;
+    double term = t;
+    double sum  = 0.0;
+    for (int k = 0; k < 24; k++) {
+        sum  += term / (double)(2 * k + 1);
+        term *= t2;
+    }
+    return e + 2.0 * sum / 0.69314718055994530942;
+}
+
+static double exp2_unit(double x) {
+    double y    = x * 0.69314718055994530942;
+    double term = 1.0;
+    double sum  = 1.0;
+    for (int k = 1; k < 20; k++) {
+        term *= y / (double)k;
+        sum  += term;
+    }
+    return sum;
+}
+
+static void build_tables(void) {
+    for (int i = 0; i < 256; i++) {
+        double s = sin_quarter(((double)i + 0.5) * 3.14159265358979323846 / 512.0);
+        s_logsin[i] = (uint16_t)(-log2_unit(s) * 256.0 + 0.5);
+        s_exp[i]    = (uint16_t)(exp2_unit((double)(255 - i) / 256.0) * 1024.0 + 0.5);
+    }
+    s_tables_ready = 1;
+}
+
+/* Operator output */
+
+static uint32_t logsin(uint32_t ph) {
+    return (ph & 0x100u) ? s_logsin[(ph & 0xFFu) ^ 0xFFu] : s_logsin[ph & 0xFFu];
+}
+
+static int16_t exp_out(uint32_t level) {
+    if (level > 0x1FFFu) return 0;
+    return (int16_t)(((uint32_t)s_exp[level & 0xFFu] << 1) >> (level >> 8));
+}
+
+/* One sample of waveform `ws` at 10-bit phase `ph`, attenuated by
+ * `att` (log-sine units, 8 per envelope step). */
+static int16_t wave(uint32_t ws, uint32_t ph, uint32_t att) {
+    uint32_t lvl;
+    uint32_t neg = 0;
+    ph &= 0x3FFu;
+    switch (ws) {
+    case 0:
+        neg = ph & 0x200u;
+        lvl = logsin(ph);
+        break;
+    case 1:
+        if (ph & 0x200u) return 0;
+        lvl = logsin(ph);
+        break;
+    case 2:
+        lvl = logsin(ph);
+        break;
+    case 3:
+        if (ph & 0x100u) return 0;
+        lvl = logsin(ph);
+        break;
+    case 4:
+        if (ph & 0x200u) return 0;
+        neg = ph & 0x100u;
+        lvl = logsin(ph << 1);
+        break;
+    case 5:
+        if (ph & 0x200u) return 0;
+        lvl = logsin(ph << 1);
+        break;
+    case 6:
+        neg = ph & 0x200u;
+        lvl = 0;
+        break;
+    default:
+        if (ph & 0x200u) {
+            neg = 1;
+            ph  = (ph & 0x1FFu) ^ 0x1FFu;
+        }
+        lvl = (ph & 0x1FFu) << 3;
+        break;
+    }
+    int16_t v = exp_out(lvl + att);
+    return neg ? (int16_t)~v : v;
+}
+
+/* Register state -> cached step values */
+
+static int op_channel(int op) {
+    int bank = op / 18;
+    int i    = op % 18;
+    return bank * 9 + (i / 6) * 3 + (i % 6) % 3;
+}
+
+static void op_refresh(opl_fast_t *c, int op) {
+    opl_fast_op_t *o  = &c->ops[op];
+    opl_fast_ch_t *ch = &c->ch[op_channel(op)];
+    uint32_t fnum = ch->fnum;
+
+    int32_t ksl = ((int32_t)KSL_ROM[fnum >> 6] << 2) - ((8 - (int32_t)ch->block) << 5);
+    if (ksl < 0) ksl = 0;
+    o->ksl_att = (uint16_t)((uint32_t)ksl >> KSL_SHIFT[o->ksl]);
+    o->ksv = (uint8_t)((ch->block << 1) | ((fnum >> (9u - c->nts)) & 1u));
+
+    if (o->vib) {
+        uint32_t range = (fnum >> 7) & 7u;
+        uint8_t  vp    = c->vibpos;
+        if (!(vp & 3u)) range = 0;
+        else if (vp & 1u) range >>= 1;
+        range >>= c->dvb ? 0u : 1u;
+        fnum = (vp & 4u) ? fnum - range : fnum + range;
+    }
+    uint32_t native = (((fnum << ch->block) >> 1) * MULT_X2[o->mult]) >> 1;
+    /* 19-bit chip phase -> 32-bit accumulator, rescaled to our rate;
+     * wrapping mod 2^32 keeps the phase sequence exact. */
+    o->inc = (uint32_t)(((uint64_t)native * 8192u * OPL_NATIVE_HZ) / c->rate);
+}
+
+static void channel_refresh(opl_fast_t *c, int ch) {
+    int bank = ch / 9;
+    int i    = ch % 9;
+    int mod  = bank * 18 + (i / 3) * 6 + i % 3;
+    op_refresh(c, mod);
+    op_refresh(c, mod + 3);
+}
+
+static uint32_t eff_rate(const opl_fast_op_t *o, uint8_t reg_rate) {
+    if (reg_rate == 0u) return 0;
+    uint32_t r = (uint32_t)reg_rate * 4u + (o->ksr ? o->ksv : (uint32_t)(o->ksv >> 2));
+    return r > 63u ? 63u : r;
+}
+
+static void op_key(opl_fast_op_t *o, uint8_t on) {
+    if (on && !o->key) {
+        o->state = EG_ATTACK;
+        o->phase = 0;
+    } else if (!on && o->key && o->state != EG_OFF) {
+        o->state = EG_RELEASE;
+    }
+    o->key = on;
+}
+
+void opl_fast_reset(opl_fast_t *c, uint32_t rate_hz) {
+    if (!s_tables_ready) build_tables();
+    if (rate_hz == 0u) rate_hz = 22050u;
+
+    uint8_t *raw = (uint8_t *)c;
+    for (uint32_t i = 0; i < sizeof(*c); i++) raw[i] = 0;
+
+    c->rate        = rate_hz;
+    c->native_step = (uint32_t)(((uint64_t)OPL_NATIVE_HZ << 16) / rate_hz);
+    for (int op = 0; op < OPL_FAST_OPS; op++) {
+        c->ops[op].env   = EG_MAX;
+        c->ops[op].state = EG_OFF;
+    }
+    for (int ch = 0; ch < OPL_FAST_CHANNELS; ch++) {
+        c->ch[ch].left  = 1;
+        c->ch[ch].right = 1;
+    }
+
+    /* A rate-r envelope moves (4 + r%4)/4 steps every 2^(13 - r/4)
+     * chip samples.  Attack is exponential; its coefficient is set so
+     * attack times come out about 1/14 of the decay times, as on the
+     * chip, and rates 60-63 attack instantly. */
+    for (uint32_t r = 0; r < 64u; r++) {
+        uint32_t hi = r >> 2;
+        uint64_t native = 0;
+        if (hi) {
+            native = (uint64_t)(4u + (r & 3u)) << 14;
+            native = hi <= 13u ? native >> (13u - hi) : native << (hi - 13u);
+        }
+        uint64_t step = (native * OPL_NATIVE_HZ) / rate_hz;
+        c->eg_inc[r] = (int32_t)step;
+        uint64_t att = (step * 23u) >> 7;
+        c->eg_att[r] = (int32_t)(att > 65536u ? 65536u : att);
+    }
+}
+
+void opl_fast_write(opl_fast_t *c, uint16_t reg, uint8_t v) {
+    uint32_t bank = (reg >> 8) & 1u;
+    uint32_t lo   = reg & 0xFFu;
+
+    if (bank && lo == 0x05u) { c->opl3 = v & 1u; return; }
+    if (bank && lo == 0x04u) return;      /* 4-op pairing: not emulated */
+
+    switch (lo & 0xF0u) {
+    case 0x00:
+        if (bank) return;
+        if (lo == 0x01u) c->wse = (uint8_t)((v >> 5) & 1u);
+        if (lo == 0x08u) {
+            c->nts = (uint8_t)((v >> 6) & 1u);
+            for (int ch = 0; ch < OPL_FAST_CHANNELS; ch++) channel_refresh(c, ch);
+        }
+        return;
+    case 0x20: case 0x30: case 0x40: case 0x50:
+    case 0x60: case 0x70: case 0x80: case 0x90:
+    case 0xE0: case 0xF0: {
+        int slot = SLOT_OP[lo & 0x1Fu];
+        if (slot < 0) return;
+        int op = (int)bank * 18 + slot;
+        opl_fast_op_t *o = &c->ops[op];
+        switch (lo & 0xE0u) {
+        case 0x20:
+            o->am   = (uint8_t)((v >> 7) & 1u);
+            o->vib  = (uint8_t)((v >> 6) & 1u);
+            o->egt  = (uint8_t)((v >> 5) & 1u);
+            o->ksr  = (uint8_t)((v >> 4) & 1u);
+            o->mult = (uint8_t)(v & 0x0Fu);
+            break;
+        case 0x40:
+            o->ksl = (uint8_t)(v >> 6);
+            o->tl  = (uint8_t)(v & 0x3Fu);
+            break;
+        case 0x60:
+            o->ar = (uint8_t)(v >> 4);
+            o->dr = (uint8_t)(v & 0x0Fu);
+            return;
+        case 0x80:
+            o->sl = (uint8_t)(v >> 4);
+            o->rr = (uint8_t)(v & 0x0Fu);
+            return;
+        default:
+            o->ws = (uint8_t)(v & 7u);
+            return;
+        }
+        op_refresh(c, op);
+        return;
+    }
+    case 0xA0: case 0xB0: case 0xC0: {
+        uint32_t n = lo & 0x0Fu;
+        if (lo == 0xBDu) {
+            if (!bank) {
+                c->dam = (uint8_t)((v >> 7) & 1u);
+                c->dvb = (uint8_t)((v >> 6) & 1u);
+            }
+            return;
+        }
+        if (n > 8u) return;
+        int chn = (int)(bank * 9u + n);
+        opl_fast_ch_t *ch = &c->ch[chn];
+        if ((lo & 0xF0u) == 0xA0u) {
+            ch->fnum = (uint16_t)((ch->fnum & 0x300u) | v);
+        } else if ((lo & 0xF0u) == 0xB0u) {
+            ch->fnum  = (uint16_t)((ch->fnum & 0xFFu) | ((uint32_t)(v & 3u) << 8));
+            ch->block = (uint8_t)((v >> 2) & 7u);
+            uint8_t on = (uint8_t)((v >> 5) & 1u);
+            int mod = (int)bank * 18 + (int)(n / 3u) * 6 + (int)(n % 3u);
+            op_key(&c->ops[mod], on);
+            op_key(&c->ops[mod + 3], on);
+            ch->key = on;
+        } else {
+            ch->left  = (uint8_t)((v >> 4) & 1u);
+            ch->right = (uint8_t)((v >> 5) & 1u);
+            ch->fb    = (uint8_t)((v >> 1) & 7u);
+            ch->cnt   = (uint8_t)(v & 1u);
+            return;
+        }
+        channel_refresh(c, chn);
+        return;
+    }
+    default:
+        return;
+    }
+}
+
+/* Generation */
+
+static void op_envelope(const opl_fast_t *c, opl_fast_op_t *o) {
+    switch (o->state) {
+    case EG_ATTACK: {
+        uint32_t r = eff_rate(o, o->ar);
+        if (r >= 60u) {
+            o->env = 0;
+        } else if (r) {
+            int64_t d = ((int64_t)(o->env + 65536) * c->eg_att[r]) >> 16;
+            o->env -= (int32_t)d;
+        }
+        if (o->env <= 0) {
+            o->env   = 0;
+            o->state = EG_DECAY;
+        }
+        break;
+    }
+    case EG_DECAY: {
+        int32_t sl = (o->sl == 15u ? 0x1F0 : (int32_t)o->sl << 4) << 16;
+        o->env += c->eg_inc[eff_rate(o, o->dr)];
+        if (o->env >= sl) {
+            o->env   = sl;
+            o->state = EG_SUSTAIN;
+        }
+        break;
+    }
+    case EG_SUSTAIN:
+        /* Percussive sounds (EGT clear) keep decaying at RR. */
+        if (o->egt) break;
+        /* fall through */
+    case EG_RELEASE:
+        o->env += c->eg_inc[eff_rate(o, o->rr)];
+        if (o->env >= EG_MAX) {
+            o->env   = EG_MAX;
+            o->state = EG_OFF;
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static uint32_t op_att(const opl_fast_t *c, const opl_fast_op_t *o) {
+    uint32_t a = (uint32_t)(o->env >> 16) + ((uint32_t)o->tl << 2) + o->ksl_att;
+    if (o->am) a += c->trem;
+    return (a > 0x1FFu ? 0x1FFu : a) << 3;
+}
+
+static uint32_t op_ws(const opl_fast_t *c, const opl_fast_op_t *o) {
+    if (c->opl3) return o->ws;
+    return c->wse ? (uint32_t)(o->ws & 3u) : 0u;
+}
+
+/* Advance the tremolo (210 steps of 64 chip samples) and vibrato
+ * (8 steps of 1024) clocks by one output sample. */
+static void lfo_step(opl_fast_t *c) {
+    c->trem_clock += c->native_step;
+    if (c->trem_clock >= (210u * 64u) << 16) c->trem_clock -= (210u * 64u) << 16;
+    uint32_t tp = c->trem_clock >> 22;            /* / 64 chip samples */
+    c->trem = (uint8_t)((tp >= 105u ? 210u - tp : tp) >> (c->dam ? 2u : 4u));
+
+    c->vib_clock += c->native_step;
+    if (c->vib_clock >= (8u * 1024u) << 16) c->vib_clock -= (8u * 1024u) << 16;
+    uint8_t vp = (uint8_t)(c->vib_clock >> 26);   /* / 1024 chip samples */
+    if (vp != c->vibpos) {
+        c->vibpos = vp;
+        for (int op = 0; op < OPL_FAST_OPS; op++)
+            if (c->ops[op].vib) op_refresh(c, op);
+    }
+}
+
+void opl_fast_generate(opl_fast_t *c, int16_t *out, uint32_t frames) {
+    for (uint32_t f = 0; f < frames; f++) {
+        int32_t l = 0;
+        int32_t r = 0;
+        lfo_step(c);
+        for (int chn = 0; chn < OPL_FAST_CHANNELS; chn++) {
+            opl_fast_ch_t *ch = &c->ch[chn];
+            int bank = chn / 9;
+            int i    = chn % 9;
+            opl_fast_op_t *mod = &c->ops[bank * 18 + (i / 3) * 6 + i % 3];
+            opl_fast_op_t *car = mod + 3;
+            if (car->state == EG_OFF && (!ch->cnt || mod->state == EG_OFF)) {
+                mod->out = mod->prev = 0;
+                car->out = car->prev = 0;
+                continue;
+            }
+
+            op_envelope(c, mod);
+            op_envelope(c, car);
+
+            int32_t fb = ch->fb ? ((int32_t)mod->out + mod->prev) >> (9u - ch->fb) : 0;
+            mod->prev = mod->out;
+            mod->out  = wave(op_ws(c, mod), (mod->phase >> 22) + (uint32_t)fb,
+                             op_att(c, mod));
+            mod->phase += mod->inc;
+
+            int32_t pm = ch->cnt ? 0 : mod->out;
+            car->prev = car->out;
+            car->out  = wave(op_ws(c, car), (car->phase >> 22) + (uint32_t)pm,
+                             op_att(c, car));
+            car->phase += car->inc;
+
+            int32_t s = ch->cnt ? (int32_t)mod->out + car->out : car->out;
+            if (ch->left  || !c->opl3) l += s;
+            if (ch->right || !c->opl3) r += s;
+        }
+        if (l >  32767) l =  32767;
+        if (l < -32768) l = -32768;
+        if (r >  32767) r =  32767;
+        if (r < -32768) r = -32768;
+        out[f * 2u + 0u] = (int16_t)l;
+        out[f * 2u + 1u] = (int16_t)r;
+    }
+}
@@ -0,0 +1,64 @@
+#ifndef KERNEL_AUDIO_OPL_FAST_H
+#define KERNEL_AUDIO_OPL_FAST_H
+
+#include "types.h"
+
+/* opl_fast - table-driven OPL2/OPL3 FM core.
+ *
+ * Takes the same register writes as Nuked-OPL3 (bank 1 at 0x100) but
+ * synthesises straight at the output rate instead of emulating the
+ * chip clock at 49716 Hz and resampling.  Covers what midiopl uses:
+ * 18 two-operator channels, 8 waveforms, feedback, FM/AM connection,
+ * KSL/KSR, tremolo/vibrato and CHA/CHB stereo.  4-op pairing and
+ * rhythm mode are not emulated.*/
+
+#define OPL_FAST_OPS       36
+#define OPL_FAST_CHANNELS  18
+
+typedef struct {
+    uint32_t phase;        /* top 10 bits index the log-sine table */
+    uint32_t inc;          /* phase step per output sample */
+    int32_t  env;          /* attenuation, 16.16, 0 = full level */
+    uint8_t  state;
+    uint8_t  key;
+    uint8_t  am, vib, egt, ksr, mult;
+    uint8_t  ksl, tl, ar, dr, sl, rr, ws;
+    uint16_t ksl_att;      /* KSL attenuation in envelope units */
+    uint8_t  ksv;          /* key-scale value for rate scaling */
+    int16_t  out;
+    int16_t  prev;
+} opl_fast_op_t;
+
+typedef struct {
+    uint16_t fnum;
+    uint8_t  block;
+    uint8_t  key;
+    uint8_t  fb;
+    uint8_t  cnt;
+    uint8_t  left;
+    uint8_t  right;
+} opl_fast_ch_t;
+
+typedef struct {
+    opl_fast_op_t ops[OPL_FAST_OPS];
+    opl_fast_ch_t ch[OPL_FAST_CHANNELS];
+    uint32_t      rate;
+    uint32_t      native_step;   /* 49716 Hz chip samples per output sample, 16.16 */
+    uint32_t      trem_clock;    /* chip samples into the tremolo cycle, 16.16 */
+    uint32_t      vib_clock;     /* chip samples into the vibrato cycle, 16.16 */
+    uint8_t       opl3;
+    uint8_t       wse;
+    uint8_t       nts;
+    uint8_t       dam;
+    uint8_t       dvb;
+    uint8_t       vibpos;
+    uint8_t       trem;
+    int32_t       eg_inc[64];    /* decay/release step per output sample */
+    int32_t       eg_att[64];    /* attack coefficient, 0.16 */
+} opl_fast_t;
+
+void opl_fast_reset(opl_fast_t *chip, uint32_t rate_hz);
+void opl_fast_write(opl_fast_t *chip, uint16_t reg, uint8_t v);
+void opl_fast_generate(opl_fast_t *chip, int16_t *out_stereo, uint32_t frames);
+
+#endif
@@ -2,15 +2,22 @@
  * Plays a single sustained FM note for ~2 seconds via slot 8
  * using a streaming-source pull callback that resamples
  * 49716 -> 22050 Hz with linear interpolation.
+ *
+ * opl_compare checks the opl_fast core against Nuked-OPL3 and times
+ * both; it needs no audio hardware.
 */
 #include "types.h"
 #include "serial.h"
+#include "cpu.h"
+#include "kernel.h"
 #include "nuked_opl3.h"
+#include "opl_fast.h"
 #include "mixer.h"
 #include "ac97.h"
 #include "opl_smoke.h"
 
 static opl3_chip g_chip;
+static opl_fast_t g_fast;
 
 /* Generate native at 49716 Hz, resample to 22050 Hz via linear interp.
  * Mixer requests `frames` at 22050; we render `(frames * 49716 + 22049) / 22050`
@@ -94,3 +101,226 @@ void opl_smoke(void) {
 
     serial_write_string("[PASS] audiotest opl\n");
 }
+
+/* opl_compare - spectral check of opl_fast against Nuked-OPL3
+ *
+ * Each case programs the same registers into both cores (22050 Hz,
+ * as midiopl runs them), lets the attack settle, then averages the
+ * Hann-windowed 2048-point magnitude spectrum of the left channel
+ * over CMP_WINDOWS windows.  The score is sum|A - B| / sum(A + B):
+ * 0 for identical spectra, 1 for disjoint ones.  The cores differ in
+ * envelope micro-timing and resampling, and opl_fast closes the
+ * feedback loop at 22050 Hz rather than 49716 Hz (the largest term,
+ * ~20% on the feedback patch), so a match is a score under
+ * CMP_MAX_DIFF_PCT and the same strongest bin (+-2).
+*/
+
+#define CMP_N            2048u
+#define CMP_WINDOWS      4u
+#define CMP_SETTLE       2048u
+#define CMP_MAX_DIFF_PCT 25u
+#define CMP_BENCH_FRAMES 22050u
+
+static double  s_re[CMP_N], s_im[CMP_N];
+static double  s_cos[CMP_N / 2u], s_sin[CMP_N / 2u];
+static double  s_mag_a[CMP_N / 2u], s_mag_b[CMP_N / 2u];
+static int16_t s_pcm_a[CMP_N * 2u], s_pcm_b[CMP_N * 2u];
+
+/* Taylor series; |x| <= pi keeps 16 terms well inside double precision. */
+static void sincos_series(double x, double *sn, double *cs) {
+    double ts = x, tc = 1.0, ss = x, sc = 1.0;
+    for (int k = 1; k < 16; k++) {
+        ts *= -x * x / (double)((2 * k) * (2 * k + 1));
+        tc *= -x * x / (double)((2 * k - 1) * (2 * k));
+        ss += ts;
+        sc += tc;
+    }
+    *sn = ss;
+    *cs = sc;
+}
+
+static double cmp_sqrt(double v) {
+    double r;
+    __asm__("sqrtsd %1, %0" : "=x"(r) : "x"(v));
+    return r;
+}
+
+static void cmp_twiddles(void) {
+    for (uint32_t k = 0; k < CMP_N / 2u; k++)
+        sincos_series(-6.283185307179586 * (double)k / (double)CMP_N,
+                      &s_sin[k], &s_cos[k]);
+}
+
+static void cmp_fft(void) {
+    for (uint32_t i = 1, j = 0; i < CMP_N; i++) {
+        uint32_t bit = CMP_N >> 1;
+        for (; j & bit; bit >>= 1) j ^= bit;
+        j ^= bit;
+        if (i < j) {
+            double t = s_re[i]; s_re[i] = s_re[j]; s_re[j] = t;
+            t = s_im[i]; s_im[i] = s_im[j]; s_im[j] = t;
+        }
+    }
+    for (uint32_t len = 2; len <= CMP_N; len <<= 1) {
+        uint32_t half = len >> 1;
+        uint32_t tw   = CMP_N / len;
+        for (uint32_t i = 0; i < CMP_N; i += len) {
+            for (uint32_t k = 0; k < half; k++) {
+                double wr = s_cos[k * tw], wi = s_sin[k * tw];
+                uint32_t a = i + k, b = a + half;
+                double xr = s_re[b] * wr - s_im[b] * wi;
+                double xi = s_re[b] * wi + s_im[b] * wr;
+                s_re[b] = s_re[a] - xr;
+                s_im[b] = s_im[a] - xi;
+                s_re[a] += xr;
+                s_im[a] += xi;
+            }
+        }
+    }
+}
+
+/* Accumulate the windowed magnitude spectrum of pcm's left channel. */
+static void cmp_spectrum(const int16_t *pcm, double *mag) {
+    for (uint32_t i = 0; i < CMP_N; i++) {
+        /* Hann: 0.5 - 0.5 cos(2 pi i / N), cos mirrored past N/2. */
+        double c = i < CMP_N / 2u ? s_cos[i] : s_cos[CMP_N - i - 1u];
+        s_re[i] = (double)pcm[i * 2u] * (0.5 - 0.5 * c);
+        s_im[i] = 0.0;
+    }
+    cmp_fft();
+    for (uint32_t k = 0; k < CMP_N / 2u; k++)
+        mag[k] += cmp_sqrt(s_re[k] * s_re[k] + s_im[k] * s_im[k]);
+}
+
+static void cmp_write(uint16_t reg, uint8_t v) {
+    OPL3_WriteRegBuffered(&g_chip, reg, v);
+    opl_fast_write(&g_fast, reg, v);
+}
+
+static void cmp_reset(void) {
+    OPL3_Reset(&g_chip, 22050u);
+    opl_fast_reset(&g_fast, 22050u);
+    cmp_write(0x105u, 0x01u);
+}
+
+/* Two-operator voice on channel ch (0..17): mod/car are the $20, $40,
+ * $60, $80, $E0 bytes of each operator, c0 the channel's $C0 byte. */
+static void cmp_voice(uint32_t ch, const uint8_t mod[5], const uint8_t car[5],
+                      uint8_t c0, uint16_t fnum, uint8_t block) {
+    static const uint8_t op_off[9] = { 0, 1, 2, 8, 9, 10, 16, 17, 18 };
+    static const uint8_t bases[5]  = { 0x20, 0x40, 0x60, 0x80, 0xE0 };
+    uint16_t bank = ch >= 9u ? 0x100u : 0u;
+    uint32_t n    = ch % 9u;
+
+    for (uint32_t i = 0; i < 5u; i++) {
+        cmp_write((uint16_t)(bank | (bases[i] + op_off[n])), mod[i]);
+        cmp_write((uint16_t)(bank | (bases[i] + op_off[n] + 3u)), car[i]);
+    }
+    cmp_write((uint16_t)(bank | (0xC0u + n)), c0);
+    cmp_write((uint16_t)(bank | (0xA0u + n)), (uint8_t)(fnum & 0xFFu));
+    cmp_write((uint16_t)(bank | (0xB0u + n)),
+              (uint8_t)(0x20u | ((uint32_t)block << 2) | (fnum >> 8)));
+}
+
+static int cmp_case(const char *name) {
+    double diff = 0.0, sum = 0.0;
+    uint32_t peak_a = 2, peak_b = 2;
+
+    for (uint32_t k = 0; k < CMP_N / 2u; k++) s_mag_a[k] = s_mag_b[k] = 0.0;
+    OPL3_GenerateStream(&g_chip, s_pcm_a, CMP_SETTLE);
+    opl_fast_generate(&g_fast, s_pcm_b, CMP_SETTLE);
+    for (uint32_t w = 0; w < CMP_WINDOWS; w++) {
+        OPL3_GenerateStream(&g_chip, s_pcm_a, CMP_N);
+        opl_fast_generate(&g_fast, s_pcm_b, CMP_N);
+        cmp_spectrum(s_pcm_a, s_mag_a);
+        cmp_spectrum(s_pcm_b, s_mag_b);
+    }
+    /* Skip DC and the bin the Hann window leaks it into: half-wave
+     * waveforms carry an offset that says nothing about timbre. */
+    for (uint32_t k = 2; k < CMP_N / 2u; k++) {
+        double d = s_mag_a[k] - s_mag_b[k];
+        diff += d < 0.0 ? -d : d;
+        sum  += s_mag_a[k] + s_mag_b[k];
+        if (s_mag_a[k] > s_mag_a[peak_a]) peak_a = k;
+        if (s_mag_b[k] > s_mag_b[peak_b]) peak_b = k;
+    }
+    uint32_t pct10 = sum > 0.0 ? (uint32_t)(diff * 1000.0 / sum) : 1000u;
+    int peak_ok = peak_a + 2u >= peak_b && peak_b + 2u >= peak_a;
+    int ok = sum > 0.0 && pct10 < CMP_MAX_DIFF_PCT * 10u && peak_ok;
+
+    serial_printf("[oplcmp] %s: diff %u.%u%% peak bin %u / %u %s\n",
+                  name, pct10 / 10u, pct10 % 10u, peak_a, peak_b,
+                  ok ? "ok" : "MISMATCH");
+    return ok;
+}
+
+/* Time one second of 18-voice music on each core. */
+static void cmp_bench(void) {
+    static const uint8_t mod[5] = { 0x21, 0x10, 0xF2, 0x24, 0x00 };
+    static const uint8_t car[5] = { 0x21, 0x08, 0xF2, 0x24, 0x00 };
+    uint64_t hz = get_cpu_freq();
+    uint64_t t0, nuked, fast;
+
+    cmp_reset();
+    cmp_write(0xBDu, 0xC0u);
+    for (uint32_t ch = 0; ch < 18u; ch++)
+        cmp_voice(ch, mod, car, 0x36u, (uint16_t)(0x144u + ch * 23u), 4u);
+
+    t0 = rdtsc();
+    for (uint32_t f = 0; f < CMP_BENCH_FRAMES; f += CMP_N)
+        OPL3_GenerateStream(&g_chip, s_pcm_a,
+                            CMP_BENCH_FRAMES - f < CMP_N ? CMP_BENCH_FRAMES - f : CMP_N);
+    nuked = rdtsc() - t0;
+
+    t0 = rdtsc();
+    for (uint32_t f = 0; f < CMP_BENCH_FRAMES; f += CMP_N)
+        opl_fast_generate(&g_fast, s_pcm_b,
+                          CMP_BENCH_FRAMES - f < CMP_N ? CMP_BENCH_FRAMES - f : CMP_N);
+    fast = rdtsc() - t0;
+
+    serial_printf("[oplcmp] cpu per second of music (18 voices): nuked %u us, fast %u us\n",
+                  hz ? (uint32_t)((nuked * 1000000u) / hz) : 0u,
+                  hz ? (uint32_t)((fast * 1000000u) / hz) : 0u);
+    serial_printf("[oplcmp]   (%u / %u kcycles)\n",
+                  (uint32_t)(nuked / 1000u), (uint32_t)(fast / 1000u));
+}
+
+int opl_compare(void) {
+    static const uint8_t sine_mod[5]  = { 0x01, 0x10, 0xF2, 0x74, 0x00 };
+    static const uint8_t sine_car[5]  = { 0x01, 0x00, 0xF2, 0x74, 0x00 };
+    static const uint8_t fb_mod[5]    = { 0x21, 0x08, 0xF1, 0x13, 0x01 };
+    static const uint8_t fb_car[5]    = { 0x21, 0x00, 0xF1, 0x13, 0x02 };
+    static const uint8_t am_mod[5]    = { 0x02, 0x00, 0xA4, 0x22, 0x00 };
+    static const uint8_t am_car[5]    = { 0x01, 0x04, 0xA4, 0x22, 0x00 };
+    static const uint8_t lfo_mod[5]   = { 0xE1, 0x18, 0xF2, 0x54, 0x00 };
+    static const uint8_t lfo_car[5]   = { 0xE1, 0x00, 0xF2, 0x54, 0x00 };
+    static const uint8_t pad_mod[5]   = { 0x01, 0x20, 0x83, 0x24, 0x00 };
+    static const uint8_t pad_car[5]   = { 0x01, 0x02, 0x83, 0x24, 0x00 };
+    int ok = 1;
+
+    cmp_twiddles();
+
+    cmp_reset();
+    cmp_voice(0u, sine_mod, sine_car, 0x30u, 0x244u, 4u);
+    ok &= cmp_case("fm A4");
+
+    cmp_reset();
+    cmp_voice(1u, fb_mod, fb_car, 0x3Cu, 0x1CAu, 3u);
+    ok &= cmp_case("feedback+waveforms");
+
+    cmp_reset();
+    cmp_voice(11u, am_mod, am_car, 0x31u, 0x2AEu, 5u);
+    ok &= cmp_case("additive bank 1");
+
+    cmp_reset();
+    cmp_write(0xBDu, 0xC0u);
+    cmp_voice(0u, lfo_mod, lfo_car, 0x36u, 0x244u, 4u);
+    cmp_voice(3u, pad_mod, pad_car, 0x30u, 0x1CAu, 4u);
+    cmp_voice(13u, sine_mod, sine_car, 0x30u, 0x2AEu, 3u);
+    ok &= cmp_case("chord vib+trem");
+
+    cmp_bench();
+    serial_write_string(ok ? "[PASS] audiotest oplcmp\n"
+                           : "[FAIL] audiotest oplcmp\n");
+    return ok ? 0 : -1;
+}
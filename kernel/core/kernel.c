@@ -45,11 +45,14 @@
 #include "smp.h"
 #include "usb.h"
 #include "net_if.h"
+#include "http_cache.h"
 #include "simd.h"
 #include "string.h"
 #include "graphics.h"
 #include "gfx2d.h"
 #include "fontsys.h"
+#include "jpeg.h"
+#include "png.h"
 #include "gui.h"
 #include "gui_containers.h"
 #include "gui_events.h"
@@ -66,6 +69,7 @@
 #include "homefs.h"
 #include "iso9660_vfs.h"
 #include "exec.h"
+#include "cupidc.h"
 #include "syscall.h"
 #include "pit.h"
 #include "rtc.h"
@@ -788,6 +792,9 @@ void kmain(void) {
      * (homefs, fat16 fallback, or ramfs when no disk). Idempotent.*/
     vfs_mkdir("/home/bin");
 
+    /* HTTP cache index lives under /home/.cache/http. */
+    http_cache_init();
+
     /* Pre-populate ramfs with in-memory files */
     {
         const vfs_mount_t *root_mnt = vfs_get_mount(0);
@@ -890,6 +897,15 @@ void kmain(void) {
     gui_events_init();
 #ifdef SIMD_BENCH
     simd_benchmark();
+#endif
+#ifdef FONTSYS_BENCH
+    fontsys_benchmark();
+#endif
+#ifdef JPEG_BENCH
+    jpeg_benchmark();
+#endif
+#ifdef PNG_BENCH
+    png_benchmark();
 #endif
     KINFO("VBE graphics initialized (640x480, 32bpp)");
 
@@ -903,6 +919,9 @@ void kmain(void) {
     // Initialize syscall table for ELF program support
     syscall_init();
 
+    // Build CupidC's kernel-binding table once for every later compile
+    cupidc_init();
+
     // Switch PIT to 100Hz for 10ms scheduler time slices
     pit_set_scheduler_mode();
 
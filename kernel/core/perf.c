@@ -0,0 +1,672 @@
+/*
+ * perf - system-wide sampling profiler.
+ *
+ * Sampling runs inside the timer interrupt, so it only copies the
+ * interrupted EIP and up to PERF_MAX_DEPTH - 1 return addresses from
+ * the EBP chain into this CPU's ring - no locks, no symbol lookups.
+ * Everything else (symbolization, aggregation) happens in perf_report
+ * and perf_folded after recording stops.
+ *
+ * Rates above the 100 Hz system tick shorten the LAPIC timer period on
+ * each CPU by a whole factor and swallow the extra interrupts, so
+ * uptime, scheduling and key repeat keep running at 100 Hz.  Each CPU
+ * reprograms its own LAPIC on its next tick; no IPIs are needed.
+ *
+ * JIT code is resolved through maps pushed by the JITs.  A sample
+ * stores the map on top of the stack when it was taken; each map
+ * links to the one below it, so nested programs resolve too.
+*/
+
+#include "perf.h"
+#include "ksyms.h"
+#include "lapic.h"
+#include "memory.h"
+#include "percpu.h"
+#include "process.h"
+#include "serial.h"
+#include "string.h"
+
+#define PERF_SYM_NAME   48     /* longer JIT names are truncated */
+#define PERF_FN_SLOTS   4096   /* distinct functions per report */
+#define PERF_FOLD_SLOTS 8192   /* distinct stacks per folded export */
+#define PERF_CHAIN_SLOTS 64    /* distinct caller chains per hot function */
+#define PERF_CHAIN_DEPTH 4
+#define PERF_STACK_LIMIT 0x100000u /* max gap between two frames */
+
+typedef struct {
+    uint32_t pc[PERF_MAX_DEPTH];
+    uint8_t  depth;
+    uint8_t  cpu;
+    uint8_t  map;      /* top JIT map + 1 when taken, 0 = none */
+    uint8_t  _pad;
+} perf_sample_t;
+
+typedef struct {
+    perf_sample_t *ring;
+    uint32_t head;        /* next slot to write */
+    uint32_t taken;       /* samples recorded, including overwritten ones */
+    uint32_t subtick;     /* interrupts since the last system tick */
+    uint32_t timer_count; /* LAPIC initial count programmed on this CPU */
+} perf_cpu_t;
+
+typedef struct {
+    uint32_t addr;
+    char     name[PERF_SYM_NAME];
+} perf_sym_t;
+
+typedef struct {
+    bool        used;
+    bool        pushed;   /* on the active stack */
+    bool        sampled;  /* may be referenced by recorded samples */
+    int         parent;   /* map below this one when pushed, -1 = none */
+    uint32_t    owner;    /* pid that pushed it */
+    uint32_t    base;
+    uint32_t    size;
+    int         count;
+    int         cap;
+    perf_sym_t *syms;
+    char        name[32];
+} perf_map_t;
+
+/* One function (or unresolved address) in a report. */
+typedef struct {
+    bool        used;
+    int8_t      map;
+    uint32_t    start;
+    const char *name;
+    uint32_t    self;
+    uint32_t    total;
+    uint32_t    last_sample; /* dedups recursion in `total` */
+} perf_fn_t;
+
+static perf_cpu_t perf_cpus[SMP_MAX_CPUS];
+static volatile int perf_active;
+static volatile uint32_t perf_mult = 1;      /* interrupts per system tick */
+static volatile uint32_t perf_timer_count;   /* wanted LAPIC count, 0 = none */
+static bool perf_armed;                      /* set once, by perf_start */
+static uint32_t perf_hz;
+
+static perf_map_t perf_maps[PERF_MAX_MAPS];
+static volatile int perf_map_top = -1;
+
+/* Sampling (interrupt context) */
+
+int perf_recording(void) { return perf_active; }
+
+int perf_timer_tick(const struct registers *r) {
+    if (!perf_armed) return 0;
+
+    perf_cpu_t *c = &perf_cpus[smp_current_cpu()];
+    uint32_t want = perf_timer_count;
+    if (want && c->timer_count != want) {
+        lapic_write(LAPIC_REG_TIMER_INIT, want);
+        c->timer_count = want;
+        c->subtick = 0;
+    }
+
+    if (perf_active && c->ring) {
+        perf_sample_t *s = &c->ring[c->head];
+        uint32_t ebp = r->ebp;
+        uint8_t depth = 1;
+        s->pc[0] = r->eip;
+        while (depth < PERF_MAX_DEPTH) {
+            if (ebp < 0x1000u || ebp > IDENTITY_MAP_SIZE - 8u || (ebp & 3u))
+                break;
+            uint32_t next = ((const uint32_t *)ebp)[0];
+            uint32_t ret  = ((const uint32_t *)ebp)[1];
+            if (!ret) break;
+            s->pc[depth++] = ret;
+            if (next <= ebp || next - ebp > PERF_STACK_LIMIT) break;
+            ebp = next;
+        }
+        s->depth = depth;
+        s->cpu = (uint8_t)smp_current_cpu();
+        s->map = (uint8_t)(perf_map_top + 1);
+        c->head = (c->head + 1u) % PERF_RING_SAMPLES;
+        c->taken++;
+    }
+
+    uint32_t mult = perf_mult;
+    if (mult <= 1) return 0;
+    if (++c->subtick < mult) return 1;
+    c->subtick = 0;
+    return 0;
+}
+
+/* Recording control */
+
+int perf_start(uint32_t hz) {
+    int ncpu = smp_cpu_count();
+    perf_stop();
+
+    for (int i = 0; i < ncpu && i < SMP_MAX_CPUS; i++) {
+        perf_cpu_t *c = &perf_cpus[i];
+        if (!c->ring) {
+            c->ring = kmalloc(PERF_RING_SAMPLES * sizeof(perf_sample_t));
+            if (!c->ring) return -1;
+        }
+        c->head = 0;
+        c->taken = 0;
+    }
+
+    /* Maps nothing can sample any more are dropped now rather than
+     * evicted later, when they might still be in a report.*/
+    for (int m = 0; m < PERF_MAX_MAPS; m++) {
+        perf_map_t *map = &perf_maps[m];
+        if (!map->used) continue;
+        map->sampled = map->pushed;
+        if (!map->pushed) {
+            kfree(map->syms);
+            map->used = false;
+        }
+    }
+
+    uint32_t base = lapic_ticks_per_10ms();
+    uint32_t mult = 1;
+    if (base && hz > 100) {
+        if (hz > PERF_MAX_HZ) hz = PERF_MAX_HZ;
+        mult = (hz + 50u) / 100u;
+    }
+    perf_hz = 100u * mult;
+    perf_mult = mult;
+    perf_timer_count = base ? base / mult : 0;
+    perf_armed = true;
+    perf_active = 1;
+    return (int)perf_hz;
+}
+
+void perf_stop(void) {
+    perf_active = 0;
+    perf_mult = 1;
+    perf_timer_count = lapic_ticks_per_10ms();
+}
+
+/* JIT symbol maps */
+
+int perf_map_create(uint32_t base, uint32_t size, const char *name,
+                    int max_syms) {
+    int slot = -1;
+    for (int m = 0; m < PERF_MAX_MAPS && slot < 0; m++) {
+        if (!perf_maps[m].used) slot = m;
+    }
+    for (int m = 0; m < PERF_MAX_MAPS && slot < 0; m++) {
+        perf_map_t *old = &perf_maps[m];
+        if (!old->pushed && !old->sampled) {
+            kfree(old->syms);
+            old->used = false;
+            slot = m;
+        }
+    }
+    if (slot < 0 || max_syms <= 0) return -1;
+
+    perf_map_t *map = &perf_maps[slot];
+    map->syms = kmalloc((uint32_t)max_syms * sizeof(perf_sym_t));
+    if (!map->syms) return -1;
+    map->used = true;
+    map->pushed = false;
+    map->sampled = false;
+    map->parent = -1;
+    map->base = base;
+    map->size = size;
+    map->count = 0;
+    map->cap = max_syms;
+
+    /* Keep the file name only: "/home/bin/browser.cc" -> "browser.cc". */
+    const char *tail = name ? name : "jit";
+    for (const char *p = tail; *p; p++) {
+        if (*p == '/') tail = p + 1;
+    }
+    strncpy(map->name, tail, sizeof(map->name) - 1);
+    map->name[sizeof(map->name) - 1] = '\0';
+    return slot;
+}
+
+void perf_map_add(int m, uint32_t addr, const char *sym) {
+    if (m < 0 || m >= PERF_MAX_MAPS || !perf_maps[m].used) return;
+    perf_map_t *map = &perf_maps[m];
+    if (map->count >= map->cap) return;
+    perf_sym_t *s = &map->syms[map->count++];
+    s->addr = addr;
+    strncpy(s->name, sym, PERF_SYM_NAME - 1);
+    s->name[PERF_SYM_NAME - 1] = '\0';
+}
+
+void perf_map_push(int m) {
+    if (m < 0 || m >= PERF_MAX_MAPS || !perf_maps[m].used) return;
+    perf_map_t *map = &perf_maps[m];
+
+    /* Insertion sort: JIT symbols arrive almost in address order. */
+    for (int i = 1; i < map->count; i++) {
+        perf_sym_t tmp = map->syms[i];
+        int j = i - 1;
+        while (j >= 0 && map->syms[j].addr > tmp.addr) {
+            map->syms[j + 1] = map->syms[j];
+            j--;
+        }
+        map->syms[j + 1] = tmp;
+    }
+
+    /* A program that left through exit() never popped its map. */
+    uint32_t pid = process_get_current_pid();
+    while (perf_map_top >= 0) {
+        perf_map_t *top = &perf_maps[perf_map_top];
+        int state = process_get_state(top->owner);
+        if (top->owner == pid ||
+            (state >= 0 && state != (int)PROCESS_TERMINATED))
+            break;
+        top->pushed = false;
+        perf_map_top = top->parent;
+    }
+
+    map->owner = pid;
+    map->parent = perf_map_top;
+    map->pushed = true;
+    if (perf_active) map->sampled = true;
+    perf_map_top = m;
+}
+
+void perf_map_pop(int m) {
+    if (m < 0 || m >= PERF_MAX_MAPS || perf_map_top != m) return;
+    perf_maps[m].pushed = false;
+    perf_map_top = perf_maps[m].parent;
+}
+
+/* Symbolization */
+
+static const char *perf_map_lookup(const perf_map_t *map, uint32_t addr,
+                                   uint32_t *start) {
+    int lo = 0, hi = map->count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (map->syms[mid].addr <= addr) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo == 0) return 0;
+    *start = map->syms[lo - 1].addr;
+    return map->syms[lo - 1].name;
+}
+
+/* Resolve addr as seen by a sample taken with map_ref on top.  Sets
+ * *start to the function's first byte (or addr when unknown) and
+ * *map_out to the map that named it (-1 for the kernel or unknown).*/
+static const char *perf_resolve(uint32_t addr, int map_ref, uint32_t *start,
+                                int *map_out) {
+    for (int m = map_ref - 1; m >= 0; m = perf_maps[m].parent) {
+        const perf_map_t *map = &perf_maps[m];
+        if (!map->used || addr < map->base || addr - map->base >= map->size)
+            continue;
+        const char *name = perf_map_lookup(map, addr, start);
+        if (name) {
+            *map_out = m;
+            return name;
+        }
+        break;
+    }
+
+    uint32_t off = 0;
+    const char *name = ksym_lookup(addr, &off);
+    *map_out = -1;
+    *start = name ? addr - off : addr;
+    return name;
+}
+
+static int perf_fn_slot(perf_fn_t *fns, const perf_sample_t *s, int frame) {
+    /* Return addresses point past the CALL; look up the byte before so
+     * a call ending one function doesn't resolve to the next.*/
+    uint32_t addr = frame ? s->pc[frame] - 1u : s->pc[0];
+    uint32_t start;
+    int map;
+    const char *name = perf_resolve(addr, s->map, &start, &map);
+
+    uint32_t h = (start ^ ((uint32_t)(map + 1) * 0x9E3779B1u)) * 2654435761u;
+    uint32_t i = (h >> 20) & (PERF_FN_SLOTS - 1);
+    for (uint32_t probes = 0; probes < PERF_FN_SLOTS; probes++) {
+        perf_fn_t *f = &fns[i];
+        if (!f->used) {
+            f->used = true;
+            f->map = (int8_t)map;
+            f->start = start;
+            f->name = name;
+            f->self = 0;
+            f->total = 0;
+            f->last_sample = 0xFFFFFFFFu;
+            return (int)i;
+        }
+        if (f->start == start && f->map == map) return (int)i;
+        i = (i + 1) & (PERF_FN_SLOTS - 1);
+    }
+    return -1;
+}
+
+static void perf_fn_name(const perf_fn_t *f, char *out, uint32_t max) {
+    static const char hex[] = "0123456789abcdef";
+    uint32_t n = 0;
+    if (f->name) {
+        const char *p = f->name;
+        while (*p && n + 1 < max) out[n++] = *p++;
+        if (f->map >= 0) {
+            const char *m = perf_maps[(int)f->map].name;
+            if (n + 2 < max) { out[n++] = ' '; out[n++] = '['; }
+            while (*m && n + 2 < max) out[n++] = *m++;
+            if (n + 1 < max) out[n++] = ']';
+        }
+    } else if (max > 11) {
+        out[n++] = '0';
+        out[n++] = 'x';
+        for (int i = 7; i >= 0; i--)
+            out[n++] = hex[(f->start >> (i * 4)) & 0xFu];
+    }
+    out[n] = '\0';
+}
+
+/* Sample iteration: oldest first on each CPU. */
+static uint32_t perf_cpu_samples(const perf_cpu_t *c) {
+    return c->taken < PERF_RING_SAMPLES ? c->taken : PERF_RING_SAMPLES;
+}
+
+static const perf_sample_t *perf_cpu_sample(const perf_cpu_t *c, uint32_t i) {
+    uint32_t first = c->taken < PERF_RING_SAMPLES ? 0 : c->head;
+    return &c->ring[(first + i) % PERF_RING_SAMPLES];
+}
+
+/* Number formatting for the report */
+
+static char *perf_put_u32(char *p, uint32_t v, int width) {
+    char tmp[12];
+    int n = 0;
+    do {
+        tmp[n++] = (char)('0' + v % 10u);
+        v /= 10u;
+    } while (v);
+    while (width-- > n) *p++ = ' ';
+    while (n) *p++ = tmp[--n];
+    return p;
+}
+
+/* "  12.3%" - parts per thousand, right-aligned in 7 columns. */
+static char *perf_put_pct(char *p, uint32_t part, uint32_t whole) {
+    uint32_t pm = whole ? (uint32_t)(((uint64_t)part * 1000u) / whole) : 0;
+    p = perf_put_u32(p, pm / 10u, 5);
+    *p++ = '.';
+    *p++ = (char)('0' + pm % 10u);
+    *p++ = '%';
+    return p;
+}
+
+static char *perf_put_str(char *p, const char *s) {
+    while (*s) *p++ = *s++;
+    return p;
+}
+
+/* Reports */
+
+static perf_fn_t *perf_collect(uint32_t *total_out) {
+    perf_fn_t *fns = kmalloc(PERF_FN_SLOTS * sizeof(perf_fn_t));
+    if (!fns) return 0;
+    memset(fns, 0, PERF_FN_SLOTS * sizeof(perf_fn_t));
+
+    uint32_t serial = 0;
+    for (int cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+        const perf_cpu_t *c = &perf_cpus[cpu];
+        if (!c->ring) continue;
+        uint32_t n = perf_cpu_samples(c);
+        for (uint32_t i = 0; i < n; i++, serial++) {
+            const perf_sample_t *s = perf_cpu_sample(c, i);
+            for (int f = 0; f < s->depth; f++) {
+                int slot = perf_fn_slot(fns, s, f);
+                if (slot < 0) continue;
+                if (f == 0) fns[slot].self++;
+                if (fns[slot].last_sample != serial) {
+                    fns[slot].last_sample = serial;
+                    fns[slot].total++;
+                }
+            }
+        }
+    }
+    *total_out = serial;
+    return fns;
+}
+
+/* Slots of the `top` functions with the most self samples. */
+static int perf_top_fns(const perf_fn_t *fns, int *top, int want) {
+    int n = 0;
+    while (n < want) {
+        int best = -1;
+        for (int i = 0; i < PERF_FN_SLOTS; i++) {
+            if (!fns[i].used || !fns[i].self) continue;
+            bool taken = false;
+            for (int k = 0; k < n; k++) {
+                if (top[k] == i) { taken = true; break; }
+            }
+            if (taken) continue;
+            if (best < 0 || fns[i].self > fns[best].self) best = i;
+        }
+        if (best < 0) break;
+        top[n++] = best;
+    }
+    return n;
+}
+
+typedef struct {
+    int16_t  fn[PERF_CHAIN_DEPTH];
+    uint8_t  depth;
+    uint32_t count;
+} perf_chain_t;
+
+static void perf_report_callers(perf_fn_t *fns, int leaf, perf_out_fn out) {
+    perf_chain_t chains[PERF_CHAIN_SLOTS];
+    int nchains = 0;
+    char line[512];
+    char name[96];
+
+    for (int cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+        const perf_cpu_t *c = &perf_cpus[cpu];
+        if (!c->ring) continue;
+        uint32_t n = perf_cpu_samples(c);
+        for (uint32_t i = 0; i < n; i++) {
+            const perf_sample_t *s = perf_cpu_sample(c, i);
+            if (perf_fn_slot(fns, s, 0) != leaf) continue;
+
+            perf_chain_t key;
+            key.depth = 0;
+            for (int f = 1; f < s->depth && key.depth < PERF_CHAIN_DEPTH; f++)
+                key.fn[key.depth++] = (int16_t)perf_fn_slot(fns, s, f);
+
+            int k;
+            for (k = 0; k < nchains; k++) {
+                if (chains[k].depth == key.depth &&
+                    memcmp(chains[k].fn, key.fn,
+                           key.depth * sizeof(key.fn[0])) == 0)
+                    break;
+            }
+            if (k == nchains) {
+                if (nchains == PERF_CHAIN_SLOTS) continue;
+                chains[nchains] = key;
+                chains[nchains++].count = 0;
+            }
+            chains[k].count++;
+        }
+    }
+
+    uint32_t leaf_total = fns[leaf].self;
+    for (int shown = 0; shown < 5; shown++) {
+        int best = -1;
+        for (int k = 0; k < nchains; k++) {
+            if (chains[k].count && (best < 0 || chains[k].count > chains[best].count))
+                best = k;
+        }
+        if (best < 0) break;
+        char *p = line;
+        p = perf_put_str(p, "        ");
+        p = perf_put_pct(p, chains[best].count, leaf_total);
+        p = perf_put_str(p, "  ");
+        if (!chains[best].depth) p = perf_put_str(p, "(no frame chain)");
+        for (int d = 0; d < chains[best].depth; d++) {
+            if (chains[best].fn[d] < 0) break;
+            perf_fn_name(&fns[chains[best].fn[d]], name, sizeof(name));
+            if (d) p = perf_put_str(p, " <- ");
+            p = perf_put_str(p, name);
+        }
+        p = perf_put_str(p, "\n");
+        *p = '\0';
+        out(line);
+        chains[best].count = 0;
+    }
+}
+
+void perf_report(perf_out_fn out, int top, int callgraph) {
+    char line[160];
+    char name[96];
+    uint32_t total = 0;
+
+    if (perf_active) perf_stop();
+    if (top <= 0) top = 25;
+    if (top > 100) top = 100;
+
+    perf_fn_t *fns = perf_collect(&total);
+    if (!fns) {
+        out("perf: out of memory\n");
+        return;
+    }
+    if (!total) {
+        out("perf: no samples (run `perf record <command>` first)\n");
+        kfree(fns);
+        return;
+    }
+
+    uint32_t lost = 0;
+    int ncpu = 0;
+    for (int cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+        const perf_cpu_t *c = &perf_cpus[cpu];
+        if (!c->ring || !c->taken) continue;
+        ncpu++;
+        lost += c->taken - perf_cpu_samples(c);
+    }
+
+    char *p = line;
+    p = perf_put_str(p, "perf: ");
+    p = perf_put_u32(p, total, 0);
+    p = perf_put_str(p, " samples on ");
+    p = perf_put_u32(p, (uint32_t)ncpu, 0);
+    p = perf_put_str(p, ncpu == 1 ? " CPU at " : " CPUs at ");
+    p = perf_put_u32(p, perf_hz, 0);
+    p = perf_put_str(p, " Hz");
+    if (lost) {
+        p = perf_put_str(p, " (");
+        p = perf_put_u32(p, lost, 0);
+        p = perf_put_str(p, " oldest overwritten)");
+    }
+    p = perf_put_str(p, "\n\n   self   total  samples  function\n");
+    *p = '\0';
+    out(line);
+
+    int order[100];
+    int n = perf_top_fns(fns, order, top);
+    for (int i = 0; i < n; i++) {
+        const perf_fn_t *f = &fns[order[i]];
+        perf_fn_name(f, name, sizeof(name));
+        p = line;
+        p = perf_put_pct(p, f->self, total);
+        p = perf_put_pct(p, f->total, total);
+        p = perf_put_u32(p, f->self, 9);
+        p = perf_put_str(p, "  ");
+        p = perf_put_str(p, name);
+        p = perf_put_str(p, "\n");
+        *p = '\0';
+        out(line);
+    }
+
+    if (callgraph) {
+        out("\ncallers of the hottest functions (leaf <- caller <- ...):\n");
+        for (int i = 0; i < n && i < 10; i++) {
+            perf_fn_name(&fns[order[i]], name, sizeof(name));
+            p = line;
+            p = perf_put_str(p, "\n  ");
+            p = perf_put_str(p, name);
+            p = perf_put_str(p, "\n");
+            *p = '\0';
+            out(line);
+            perf_report_callers(fns, order[i], out);
+        }
+    }
+    kfree(fns);
+}
+
+typedef struct {
+    uint32_t hash;
+    uint32_t count;
+    uint8_t  depth;
+    int16_t  fn[PERF_MAX_DEPTH];
+} perf_stack_t;
+
+int perf_folded(void) {
+    uint32_t total = 0;
+    char line[PERF_MAX_DEPTH * 100];
+    char name[96];
+
+    if (perf_active) perf_stop();
+    perf_fn_t *fns = perf_collect(&total);
+    if (!fns) return -1;
+    perf_stack_t *stacks = kmalloc(PERF_FOLD_SLOTS * sizeof(perf_stack_t));
+    if (!stacks) {
+        kfree(fns);
+        return -1;
+    }
+    memset(stacks, 0, PERF_FOLD_SLOTS * sizeof(perf_stack_t));
+
+    for (int cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+        const perf_cpu_t *c = &perf_cpus[cpu];
+        if (!c->ring) continue;
+        uint32_t n = perf_cpu_samples(c);
+        for (uint32_t i = 0; i < n; i++) {
+            const perf_sample_t *s = perf_cpu_sample(c, i);
+            perf_stack_t key;
+            uint32_t h = 2166136261u;
+            key.depth = s->depth;
+            for (int f = 0; f < s->depth; f++) {
+                key.fn[f] = (int16_t)perf_fn_slot(fns, s, f);
+                h = (h ^ (uint16_t)key.fn[f]) * 16777619u;
+            }
+            h |= 1u; /* 0 marks an empty slot */
+
+            uint32_t slot = h & (PERF_FOLD_SLOTS - 1);
+            for (uint32_t probes = 0; probes < PERF_FOLD_SLOTS; probes++) {
+                perf_stack_t *st = &stacks[slot];
+                if (!st->hash) {
+                    *st = key;
+                    st->hash = h;
+                    st->count = 1;
+                    break;
+                }
+                if (st->hash == h && st->depth == key.depth &&
+                    memcmp(st->fn, key.fn, key.depth * sizeof(key.fn[0])) == 0) {
+                    st->count++;
+                    break;
+                }
+                slot = (slot + 1) & (PERF_FOLD_SLOTS - 1);
+            }
+        }
+    }
+
+    int lines = 0;
+    serial_printf("# perf folded begin (%u samples at %u Hz)\n", total, perf_hz);
+    for (uint32_t i = 0; i < PERF_FOLD_SLOTS; i++) {
+        const perf_stack_t *st = &stacks[i];
+        if (!st->hash) continue;
+        char *p = line;
+        for (int f = st->depth - 1; f >= 0; f--) {
+            if (st->fn[f] < 0) continue;
+            perf_fn_name(&fns[st->fn[f]], name, sizeof(name));
+            if (p != line) *p++ = ';';
+            p = perf_put_str(p, name);
+        }
+        *p = '\0';
+        serial_printf("%s %u\n", line, st->count);
+        lines++;
+    }
+    serial_printf("# perf folded end\n");
+
+    kfree(stacks);
+    kfree(fns);
+    return lines;
+}
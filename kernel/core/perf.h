@@ -0,0 +1,61 @@
+/*
+ * perf - system-wide sampling profiler.
+ *
+ * Every timer interrupt (vector 0x20: the per-CPU LAPIC timer, or the
+ * PIT on a uniprocessor without one) records the interrupted EIP and a
+ * short EBP frame chain into a per-CPU ring while recording is on.
+ * Reports resolve addresses through ksyms for the kernel (DOOM
+ * included) and through symbol maps that the CupidC and CupidASM JITs
+ * register for their code regions.
+*/
+#ifndef PERF_H
+#define PERF_H
+
+#include "types.h"
+#include "isr.h"
+
+#define PERF_MAX_DEPTH     8      /* EIP + return addresses per sample */
+#define PERF_RING_SAMPLES  16384  /* per CPU; oldest samples are overwritten */
+#define PERF_MAX_MAPS      32     /* JIT symbol maps kept for reports */
+#define PERF_DEFAULT_HZ    1000
+#define PERF_MAX_HZ        10000
+
+typedef void (*perf_out_fn)(const char *s);
+
+/* Start recording on every CPU at hz samples per second per CPU,
+ * rounded to a multiple of the 100 Hz system tick.  Without a LAPIC
+ * timer the rate stays at 100 Hz.  Discards the previous recording.
+ * Returns the rate actually used, or -1 if the rings can't be allocated.*/
+int perf_start(uint32_t hz);
+
+/* Stop recording; samples stay available for perf_report/perf_folded. */
+void perf_stop(void);
+
+int perf_recording(void);
+
+/* Timer interrupt hook, called first for vector 0x20 on every CPU.
+ * Returns 1 if the interrupt only existed to take a sample and the
+ * regular tick handlers must not run.*/
+int perf_timer_tick(const struct registers *r);
+
+/* Flat profile (self and total per function), plus the hottest call
+ * chains under each of the top functions when callgraph is set.*/
+void perf_report(perf_out_fn out, int top, int callgraph);
+
+/* Write one "root;...;leaf count" line per distinct stack to serial,
+ * between "# perf folded begin/end" markers, for flamegraph.pl.
+ * Returns the number of lines written.*/
+int perf_folded(void);
+
+/* JIT symbol maps.  A JIT creates a map for the code it is about to
+ * run, adds its function symbols (any order) and pushes it; pop it
+ * once the program returns.  Pushed maps nest, so a program launched
+ * from inside another keeps both resolvable.  Maps outlive the program
+ * so a report after it exits still names its functions.*/
+int perf_map_create(uint32_t base, uint32_t size, const char *name,
+                    int max_syms);
+void perf_map_add(int map, uint32_t addr, const char *sym);
+void perf_map_push(int map);
+void perf_map_pop(int map);
+
+#endif
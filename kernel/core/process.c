@@ -210,6 +210,7 @@ static uint32_t process_create_common_locked(void (*entry_point)(void),
 
     p->on_cpu     = 0xFFu;   /* not running on any CPU yet */
     p->last_cpu   = 0u;
+    p->pin_cpu    = 0xFFu;
     p->pid        = slot + 1;
     p->state      = PROCESS_READY;
     p->stack_base = stack;
@@ -648,10 +649,12 @@ static void schedule_locked(void) {
         next_schedule_index = (next_schedule_index + 1) % MAX_PROCESSES;
         process_t *candidate = &process_table[next_schedule_index];
 
-        /* Skip the current process - we want a DIFFERENT one */
+        /* Skip the current process - we want a DIFFERENT one - and
+         * anything pinned to another CPU. */
         if (candidate->pid != 0 &&
             candidate->pid != cur_pid &&
-            candidate->state == PROCESS_READY) {
+            candidate->state == PROCESS_READY &&
+            (candidate->pin_cpu == 0xFFu || candidate->pin_cpu == cpu_id)) {
             next = candidate;
             break;
         }
@@ -798,6 +801,7 @@ uint32_t process_register_current(const char *name) {
 
     p->on_cpu     = (uint8_t)this_cpu()->cpu_id;
     p->last_cpu   = (uint8_t)this_cpu()->cpu_id;
+    p->pin_cpu    = 0xFFu;
     process_count++;
     this_cpu()->current_pid = p->pid;
 
@@ -844,6 +848,20 @@ void process_unblock(uint32_t pid) {
     bkl_unlock();
 }
 
+int process_set_affinity(uint32_t pid, int cpu) {
+    if (pid == 0 || pid > MAX_PROCESSES) return -1;
+    if (cpu >= smp_cpu_count() || (cpu >= 0 && !cpus[cpu].online)) return -1;
+    bkl_lock();
+    process_t *p = &process_table[pid - 1];
+    int rc = -1;
+    if (p->pid == pid) {
+        p->pin_cpu = cpu < 0 ? 0xFFu : (uint8_t)cpu;
+        rc = 0;
+    }
+    bkl_unlock();
+    return rc;
+}
+
 /*  *  process_set_image - Associate an ELF image region with a process
  **/
 void process_set_image(uint32_t pid, uint32_t base, uint32_t size) {
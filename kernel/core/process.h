@@ -59,6 +59,7 @@ typedef struct {
     uint8_t          on_cpu;   /* 0..31 = CPU currently running this process;
                                 * 0xFFu = not running on any CPU*/
     uint8_t          last_cpu; /* last CPU that ran this process */
+    uint8_t          pin_cpu;  /* only this CPU may run it; 0xFFu = any */
 } process_t;
 
 
@@ -238,6 +239,18 @@ void process_block(uint32_t pid);
 */
 void process_unblock(uint32_t pid);
 
+/**
+ * process_set_affinity - Restrict a process to one CPU
+ *
+ * Only CPU @cpu will schedule the process from now on; a process
+ * running elsewhere moves at its next reschedule.  Pass -1 to allow
+ * any CPU again.  Create-then-pin under bkl_lock() if the process must
+ * never start on another CPU.
+ *
+ * Returns 0 on success, -1 for a bad PID or an offline CPU.
+*/
+int process_set_affinity(uint32_t pid, int cpu);
+
 const char *process_domain_name(process_domain_t domain);
 
 #endif /* PROCESS_H */
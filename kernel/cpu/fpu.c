@@ -4,7 +4,7 @@
 #include "libm.h"
 #include "serial.h"
 
-void fpu_init(void) {
+static void fpu_enable(void) {
     uint32_t cr0, cr4, mxcsr;
 
     __asm__ volatile("mov %%cr0, %0" : "=r"(cr0));
@@ -23,11 +23,23 @@ void fpu_init(void) {
 
     mxcsr = 0x1F80u;     /* all 6 SIMD FP exceptions masked */
     __asm__ volatile("ldmxcsr %0" :: "m"(mxcsr));
+}
+
+void fpu_init(void) {
+    uint32_t cr0, cr4, mxcsr;
 
+    fpu_enable();
+    __asm__ volatile("mov %%cr0, %0" : "=r"(cr0));
+    __asm__ volatile("mov %%cr4, %0" : "=r"(cr4));
+    __asm__ volatile("stmxcsr %0" : "=m"(mxcsr));
     serial_printf("[fpu] SSE2 enabled, CR0=%x CR4=%x MXCSR=%x\n",
                   cr0, cr4, mxcsr);
 }
 
+void fpu_init_ap(void) {
+    fpu_enable();
+}
+
 void fpu_nm_handler(uint32_t eip) {
     panic_fpu("FPU #NM (unexpected with eager switch)", eip);
 }
@@ -12,6 +12,11 @@
  * FNINIT executed, MXCSR=0x1F80 (all SIMD FP exceptions masked).*/
 void fpu_init(void);
 
+/* The same setup for an AP, without the log line. First statement of
+ * ap_main_c: an AP comes out of INIT with CR4.OSFXSR clear, so SSE code
+ * run there (-O2 DOOM strips, the music thread) would #UD.*/
+void fpu_init_ap(void);
+
 /* Exception handlers wired to IDT vectors 7 (#NM), 16 (#MF), 19 (#XF).
  * All call panic() with an FP-state dump - they are NOT expected to
  * fire under eager context switch + masked MXCSR. They exist for
@@ -283,6 +283,852 @@ void simd_blend_row(uint32_t *dst, const uint32_t *src,
     }
 }
 
+/* dst = rgb*alpha + dst*(255-alpha), same rounding as simd_blend_row.
+ * The source color is constant, so its premultiplied words are built
+ * once and each 4-pixel block costs two multiplies per half.*/
+void simd_fill_alpha_row(uint32_t *dst, uint32_t count,
+                         uint32_t rgb, uint8_t alpha) {
+    uint32_t a = (uint32_t)alpha;
+    uint32_t ia = 255u - a;
+    uint32_t sr = ((rgb >> 16) & 0xFFu) * a + 128u;
+    uint32_t sg = ((rgb >> 8) & 0xFFu) * a + 128u;
+    uint32_t sb = (rgb & 0xFFu) * a + 128u;
+
+#ifdef __SSE2__
+    if (simd_use_sse2 && count >= 4u) {
+        uint32_t blocks = count >> 2;
+        uint32_t lo = sb | (sg << 16);
+        uint32_t hi = sr | (128u << 16);
+        __asm__ volatile(
+            "movd %2, %%xmm6\n\t"
+            "movd %3, %%xmm3\n\t"
+            "punpckldq %%xmm3, %%xmm6\n\t"
+            "punpcklqdq %%xmm6, %%xmm6\n\t"
+            "movd %4, %%xmm5\n\t"
+            "pshuflw $0x00, %%xmm5, %%xmm5\n\t"
+            "punpcklqdq %%xmm5, %%xmm5\n\t"
+            "pxor %%xmm7, %%xmm7\n\t"
+            "pcmpeqd %%xmm4, %%xmm4\n\t"
+            "psrld $8, %%xmm4\n\t"
+            "1:\n\t"
+            "movdqu (%0), %%xmm0\n\t"
+            "movdqa %%xmm0, %%xmm1\n\t"
+            "punpcklbw %%xmm7, %%xmm0\n\t"
+            "punpckhbw %%xmm7, %%xmm1\n\t"
+            "pmullw %%xmm5, %%xmm0\n\t"
+            "pmullw %%xmm5, %%xmm1\n\t"
+            "paddw %%xmm6, %%xmm0\n\t"
+            "paddw %%xmm6, %%xmm1\n\t"
+            "psrlw $8, %%xmm0\n\t"
+            "psrlw $8, %%xmm1\n\t"
+            "packuswb %%xmm1, %%xmm0\n\t"
+            "pand %%xmm4, %%xmm0\n\t"
+            "movdqu %%xmm0, (%0)\n\t"
+            "add $16, %0\n\t"
+            "dec %1\n\t"
+            "jnz 1b\n\t"
+            : "+r"(dst), "+r"(blocks)
+            : "r"(lo), "r"(hi), "r"(ia)
+            : "memory", "cc", "xmm0", "xmm1", "xmm3", "xmm4", "xmm5",
+              "xmm6", "xmm7");
+        count &= 3u;
+    }
+#endif
+
+    while (count-- > 0u) {
+        uint32_t d = *dst;
+        uint32_t r = (sr + ((d >> 16) & 0xFFu) * ia) >> 8;
+        uint32_t g = (sg + ((d >> 8) & 0xFFu) * ia) >> 8;
+        uint32_t b = (sb + (d & 0xFFu) * ia) >> 8;
+        *dst++ = (r << 16) | (g << 8) | b;
+    }
+}
+
+/* Per-pixel ARGB "over": alpha 0 leaves dst untouched, alpha 255 copies
+ * the color, anything between blends like simd_blend_row. Results have
+ * a zero alpha byte, matching the scalar gfx2d pixel path.*/
+void simd_over_row(uint32_t *dst, const uint32_t *src, uint32_t count) {
+#ifdef __SSE2__
+    if (simd_use_sse2 && count >= 4u) {
+        uint32_t blocks = count >> 2;
+        __asm__ volatile(
+            "pxor %%xmm7, %%xmm7\n\t"
+            "pcmpeqw %%xmm6, %%xmm6\n\t"
+            "psrlw $8, %%xmm6\n\t"            /* 0x00FF words */
+            "pcmpeqw %%xmm5, %%xmm5\n\t"
+            "psrlw $15, %%xmm5\n\t"
+            "psllw $7, %%xmm5\n\t"            /* 0x0080 words */
+            "pcmpeqd %%xmm4, %%xmm4\n\t"
+            "psrld $8, %%xmm4\n\t"            /* 0x00FFFFFF dwords */
+            "1:\n\t"
+            /* low two pixels */
+            "movdqu (%1), %%xmm2\n\t"
+            "punpcklbw %%xmm7, %%xmm2\n\t"
+            "pshuflw $0xFF, %%xmm2, %%xmm3\n\t"
+            "pshufhw $0xFF, %%xmm3, %%xmm3\n\t"
+            "pmullw %%xmm3, %%xmm2\n\t"
+            "movdqa %%xmm6, %%xmm0\n\t"
+            "psubw %%xmm3, %%xmm0\n\t"
+            "movdqu (%0), %%xmm3\n\t"
+            "punpcklbw %%xmm7, %%xmm3\n\t"
+            "pmullw %%xmm0, %%xmm3\n\t"
+            "paddw %%xmm3, %%xmm2\n\t"
+            "paddw %%xmm5, %%xmm2\n\t"
+            "psrlw $8, %%xmm2\n\t"
+            /* high two pixels */
+            "movdqu (%1), %%xmm1\n\t"
+            "punpckhbw %%xmm7, %%xmm1\n\t"
+            "pshuflw $0xFF, %%xmm1, %%xmm3\n\t"
+            "pshufhw $0xFF, %%xmm3, %%xmm3\n\t"
+            "pmullw %%xmm3, %%xmm1\n\t"
+            "movdqa %%xmm6, %%xmm0\n\t"
+            "psubw %%xmm3, %%xmm0\n\t"
+            "movdqu (%0), %%xmm3\n\t"
+            "punpckhbw %%xmm7, %%xmm3\n\t"
+            "pmullw %%xmm0, %%xmm3\n\t"
+            "paddw %%xmm3, %%xmm1\n\t"
+            "paddw %%xmm5, %%xmm1\n\t"
+            "psrlw $8, %%xmm1\n\t"
+            "packuswb %%xmm1, %%xmm2\n\t"
+            "pand %%xmm4, %%xmm2\n\t"
+            /* alpha == 255: take the source color */
+            "movdqu (%1), %%xmm0\n\t"
+            "movdqa %%xmm4, %%xmm3\n\t"
+            "pandn %%xmm0, %%xmm3\n\t"        /* source alpha bytes */
+            "pcmpeqd %%xmm1, %%xmm1\n\t"
+            "pxor %%xmm4, %%xmm1\n\t"         /* 0xFF000000 */
+            "pcmpeqd %%xmm3, %%xmm1\n\t"
+            "pand %%xmm4, %%xmm0\n\t"
+            "pand %%xmm1, %%xmm0\n\t"
+            "pandn %%xmm2, %%xmm1\n\t"
+            "por %%xmm0, %%xmm1\n\t"
+            /* alpha == 0: keep the destination */
+            "pcmpeqd %%xmm7, %%xmm3\n\t"
+            "movdqu (%0), %%xmm0\n\t"
+            "pand %%xmm3, %%xmm0\n\t"
+            "pandn %%xmm1, %%xmm3\n\t"
+            "por %%xmm0, %%xmm3\n\t"
+            "movdqu %%xmm3, (%0)\n\t"
+            "add $16, %0\n\t"
+            "add $16, %1\n\t"
+            "dec %2\n\t"
+            "jnz 1b\n\t"
+            : "+r"(dst), "+r"(src), "+r"(blocks)
+            :
+            : "memory", "cc", "xmm0", "xmm1", "xmm2", "xmm3", "xmm4",
+              "xmm5", "xmm6", "xmm7");
+        count &= 3u;
+    }
+#endif
+
+    while (count-- > 0u) {
+        uint32_t s = *src++;
+        uint32_t a = s >> 24;
+        if (a == 255u) {
+            *dst = s & 0x00FFFFFFu;
+        } else if (a != 0u) {
+            uint32_t d = *dst;
+            uint32_t ia = 255u - a;
+            uint32_t r = (((s >> 16) & 0xFFu) * a +
+                          ((d >> 16) & 0xFFu) * ia + 128u) >> 8;
+            uint32_t g = (((s >> 8) & 0xFFu) * a +
+                          ((d >> 8) & 0xFFu) * ia + 128u) >> 8;
+            uint32_t b = ((s & 0xFFu) * a + (d & 0xFFu) * ia + 128u) >> 8;
+            *dst = (r << 16) | (g << 8) | b;
+        }
+        dst++;
+    }
+}
+
+/* Linear gradient span in 16.16 fixed point. Four pixels are kept in
+ * flight (one per register, channels as dwords) and advanced by four
+ * steps at a time, so the output is bit-identical to repeated adds.*/
+void simd_gradient_row(uint32_t *dst, uint32_t count,
+                       int32_t r_fp, int32_t g_fp, int32_t b_fp,
+                       int32_t r_step, int32_t g_step, int32_t b_step) {
+#ifdef __SSE2__
+    if (simd_use_sse2 && count >= 4u) {
+        uint32_t blocks = count >> 2;
+        int32_t st[8];
+        st[0] = b_fp;
+        st[1] = g_fp;
+        st[2] = r_fp;
+        st[3] = 0;
+        st[4] = b_step;
+        st[5] = g_step;
+        st[6] = r_step;
+        st[7] = 0;
+        __asm__ volatile(
+            "movdqu (%2), %%xmm0\n\t"
+            "movdqu 16(%2), %%xmm4\n\t"
+            "movdqa %%xmm0, %%xmm1\n\t"
+            "paddd %%xmm4, %%xmm1\n\t"
+            "movdqa %%xmm1, %%xmm2\n\t"
+            "paddd %%xmm4, %%xmm2\n\t"
+            "movdqa %%xmm2, %%xmm3\n\t"
+            "paddd %%xmm4, %%xmm3\n\t"
+            "pslld $2, %%xmm4\n\t"
+            "1:\n\t"
+            "movdqa %%xmm0, %%xmm5\n\t"
+            "movdqa %%xmm1, %%xmm6\n\t"
+            "psrad $16, %%xmm5\n\t"
+            "psrad $16, %%xmm6\n\t"
+            "packssdw %%xmm6, %%xmm5\n\t"
+            "movdqa %%xmm2, %%xmm6\n\t"
+            "movdqa %%xmm3, %%xmm7\n\t"
+            "psrad $16, %%xmm6\n\t"
+            "psrad $16, %%xmm7\n\t"
+            "packssdw %%xmm7, %%xmm6\n\t"
+            "packuswb %%xmm6, %%xmm5\n\t"
+            "movdqu %%xmm5, (%0)\n\t"
+            "paddd %%xmm4, %%xmm0\n\t"
+            "paddd %%xmm4, %%xmm1\n\t"
+            "paddd %%xmm4, %%xmm2\n\t"
+            "paddd %%xmm4, %%xmm3\n\t"
+            "add $16, %0\n\t"
+            "dec %1\n\t"
+            "jnz 1b\n\t"
+            : "+r"(dst), "+r"(blocks)
+            : "r"(st)
+            : "memory", "cc", "xmm0", "xmm1", "xmm2", "xmm3", "xmm4",
+              "xmm5", "xmm6", "xmm7");
+        {
+            int32_t done = (int32_t)(count & ~3u);
+            r_fp += r_step * done;
+            g_fp += g_step * done;
+            b_fp += b_step * done;
+        }
+        count &= 3u;
+    }
+#endif
+
+    while (count-- > 0u) {
+        *dst++ = (((uint32_t)(r_fp >> 16) & 0xFFu) << 16) |
+                 (((uint32_t)(g_fp >> 16) & 0xFFu) << 8) |
+                 ((uint32_t)(b_fp >> 16) & 0xFFu);
+        r_fp += r_step;
+        g_fp += g_step;
+        b_fp += b_step;
+    }
+}
+
+/* Source taps for one output pixel: x0/x1 the neighbouring columns,
+ * fx (0..255) the weight of x1. The last column is clamped.*/
+static inline void bilinear_taps(uint32_t sx_fp, uint32_t src_w,
+                                 uint32_t *x0, uint32_t *x1, uint32_t *fx) {
+    *x0 = sx_fp >> 16;
+    if (*x0 >= src_w - 1u) {
+        *x0 = src_w - 1u;
+        *x1 = *x0;
+        *fx = 0u;
+    } else {
+        *x1 = *x0 + 1u;
+        *fx = (sx_fp >> 8) & 0xFFu;
+    }
+}
+
+/* One bilinear-filtered destination row. row0/row1 are the two source
+ * rows straddling the sample y, fy (0..255) the weight of row1; sx_fp
+ * walks the source x in 16.16. All four channels are filtered.
+ * The SSE2 path gathers the taps of four pixels, then filters all four
+ * at once: vertical pass on the left and right columns, horizontal pass
+ * with per-pixel weights, one packed store.*/
+void simd_scale_row_bilinear(uint32_t *dst, const uint32_t *row0,
+                             const uint32_t *row1, uint32_t src_w,
+                             uint32_t count, uint32_t sx_fp,
+                             uint32_t sx_step, uint32_t fy) {
+    uint32_t x0;
+    uint32_t x1;
+    uint32_t fx;
+
+#ifdef __SSE2__
+    if (simd_use_sse2 && count >= 4u) {
+        /* q: row0[x0] x4, row0[x1] x4, row1[x0] x4, row1[x1] x4.
+         * wx: 256-fx then fx, each repeated per channel word.*/
+        uint32_t q[16];
+        uint16_t wx[32];
+        uint16_t wy[16];
+        uint32_t i;
+        for (i = 0; i < 8u; i++) {
+            wy[i] = (uint16_t)(256u - fy);
+            wy[8u + i] = (uint16_t)fy;
+        }
+        while (count >= 4u) {
+            for (i = 0; i < 4u; i++) {
+                bilinear_taps(sx_fp, src_w, &x0, &x1, &fx);
+                q[i] = row0[x0];
+                q[4u + i] = row0[x1];
+                q[8u + i] = row1[x0];
+                q[12u + i] = row1[x1];
+                wx[i * 4u + 0u] = wx[i * 4u + 1u] =
+                wx[i * 4u + 2u] = wx[i * 4u + 3u] = (uint16_t)(256u - fx);
+                wx[16u + i * 4u + 0u] = wx[16u + i * 4u + 1u] =
+                wx[16u + i * 4u + 2u] = wx[16u + i * 4u + 3u] = (uint16_t)fx;
+                sx_fp += sx_step;
+            }
+            __asm__ volatile(
+                "pxor %%xmm7, %%xmm7\n\t"
+                "movdqu (%3), %%xmm5\n\t"      /* 256 - fy */
+                "movdqu 16(%3), %%xmm6\n\t"    /* fy */
+                /* left = (row0[x0]*(256-fy) + row1[x0]*fy) >> 8 */
+                "movdqu (%1), %%xmm0\n\t"
+                "movdqu 32(%1), %%xmm2\n\t"
+                "movdqa %%xmm0, %%xmm1\n\t"
+                "movdqa %%xmm2, %%xmm3\n\t"
+                "punpcklbw %%xmm7, %%xmm0\n\t"
+                "punpckhbw %%xmm7, %%xmm1\n\t"
+                "punpcklbw %%xmm7, %%xmm2\n\t"
+                "punpckhbw %%xmm7, %%xmm3\n\t"
+                "pmullw %%xmm5, %%xmm0\n\t"
+                "pmullw %%xmm5, %%xmm1\n\t"
+                "pmullw %%xmm6, %%xmm2\n\t"
+                "pmullw %%xmm6, %%xmm3\n\t"
+                "paddw %%xmm2, %%xmm0\n\t"
+                "paddw %%xmm3, %%xmm1\n\t"
+                "psrlw $8, %%xmm0\n\t"
+                "psrlw $8, %%xmm1\n\t"
+                "movdqu (%2), %%xmm2\n\t"      /* 256 - fx, px 0-1 */
+                "movdqu 16(%2), %%xmm3\n\t"    /* 256 - fx, px 2-3 */
+                "pmullw %%xmm2, %%xmm0\n\t"
+                "pmullw %%xmm3, %%xmm1\n\t"
+                /* right = (row0[x1]*(256-fy) + row1[x1]*fy) >> 8 */
+                "movdqu 16(%1), %%xmm2\n\t"
+                "movdqu 48(%1), %%xmm4\n\t"
+                "movdqa %%xmm2, %%xmm3\n\t"
+                "punpcklbw %%xmm7, %%xmm2\n\t"
+                "punpckhbw %%xmm7, %%xmm3\n\t"
+                "pmullw %%xmm5, %%xmm2\n\t"
+                "pmullw %%xmm5, %%xmm3\n\t"
+                "movdqa %%xmm4, %%xmm5\n\t"
+                "punpcklbw %%xmm7, %%xmm4\n\t"
+                "punpckhbw %%xmm7, %%xmm5\n\t"
+                "pmullw %%xmm6, %%xmm4\n\t"
+                "pmullw %%xmm6, %%xmm5\n\t"
+                "paddw %%xmm4, %%xmm2\n\t"
+                "paddw %%xmm5, %%xmm3\n\t"
+                "psrlw $8, %%xmm2\n\t"
+                "psrlw $8, %%xmm3\n\t"
+                "movdqu 32(%2), %%xmm4\n\t"    /* fx, px 0-1 */
+                "movdqu 48(%2), %%xmm5\n\t"    /* fx, px 2-3 */
+                "pmullw %%xmm4, %%xmm2\n\t"
+                "pmullw %%xmm5, %%xmm3\n\t"
+                /* (left*(256-fx) + right*fx) >> 8 stays below 65536 */
+                "paddw %%xmm2, %%xmm0\n\t"
+                "paddw %%xmm3, %%xmm1\n\t"
+                "psrlw $8, %%xmm0\n\t"
+                "psrlw $8, %%xmm1\n\t"
+                "packuswb %%xmm1, %%xmm0\n\t"
+                "movdqu %%xmm0, (%0)\n\t"
+                :
+                : "r"(dst), "r"(q), "r"(wx), "r"(wy)
+                : "memory", "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5",
+                  "xmm6", "xmm7");
+            dst += 4;
+            count -= 4u;
+        }
+    }
+#endif
+
+    while (count-- > 0u) {
+        bilinear_taps(sx_fp, src_w, &x0, &x1, &fx);
+        {
+            uint32_t p00 = row0[x0], p01 = row0[x1];
+            uint32_t p10 = row1[x0], p11 = row1[x1];
+            uint32_t out = 0u;
+            uint32_t sh;
+            for (sh = 0u; sh < 32u; sh += 8u) {
+                uint32_t t = (((p00 >> sh) & 0xFFu) * (256u - fy) +
+                              ((p10 >> sh) & 0xFFu) * fy) >> 8;
+                uint32_t b = (((p01 >> sh) & 0xFFu) * (256u - fy) +
+                              ((p11 >> sh) & 0xFFu) * fy) >> 8;
+                out |= ((t * (256u - fx) + b * fx) >> 8) << sh;
+            }
+            *dst++ = out;
+        }
+        sx_fp += sx_step;
+    }
+}
+
+/* Running prefix sum over signed-area deltas, emitting
+ * min(|sum|, 1) * 255 rounded as 8-bit coverage. Four sums per step:
+ * two shifted adds form the in-register scan, lane 3 carries over.*/
+void simd_coverage_accumulate(uint8_t *dst, const float *acc, uint32_t count) {
+    float run = 0.0f;
+
+#ifdef __SSE2__
+    if (simd_use_sse2 && count >= 4u) {
+        static const float k[12] __attribute__((aligned(16))) = {
+            1.0f, 1.0f, 1.0f, 1.0f,
+            255.0f, 255.0f, 255.0f, 255.0f,
+            0.5f, 0.5f, 0.5f, 0.5f
+        };
+        uint32_t blocks = count >> 2;
+        __asm__ volatile(
+            "xorps %%xmm7, %%xmm7\n\t"
+            "pcmpeqd %%xmm6, %%xmm6\n\t"
+            "psrld $1, %%xmm6\n\t"             /* |x| mask */
+            "movaps (%4), %%xmm5\n\t"          /* 1.0 */
+            "movaps 16(%4), %%xmm4\n\t"        /* 255.0 */
+            "movaps 32(%4), %%xmm3\n\t"        /* 0.5 */
+            "1:\n\t"
+            "movups (%1), %%xmm0\n\t"
+            "movaps %%xmm0, %%xmm1\n\t"
+            "pslldq $4, %%xmm1\n\t"
+            "addps %%xmm1, %%xmm0\n\t"
+            "movaps %%xmm0, %%xmm1\n\t"
+            "pslldq $8, %%xmm1\n\t"
+            "addps %%xmm1, %%xmm0\n\t"
+            "addps %%xmm7, %%xmm0\n\t"
+            "movaps %%xmm0, %%xmm7\n\t"
+            "shufps $0xFF, %%xmm7, %%xmm7\n\t"
+            "andps %%xmm6, %%xmm0\n\t"
+            "minps %%xmm5, %%xmm0\n\t"
+            "mulps %%xmm4, %%xmm0\n\t"
+            "addps %%xmm3, %%xmm0\n\t"
+            "cvttps2dq %%xmm0, %%xmm0\n\t"
+            "packssdw %%xmm0, %%xmm0\n\t"
+            "packuswb %%xmm0, %%xmm0\n\t"
+            "movd %%xmm0, (%0)\n\t"
+            "add $4, %0\n\t"
+            "add $16, %1\n\t"
+            "dec %2\n\t"
+            "jnz 1b\n\t"
+            "movss %%xmm7, %3\n\t"
+            : "+r"(dst), "+r"(acc), "+r"(blocks), "=m"(run)
+            : "r"(k)
+            : "memory", "cc", "xmm0", "xmm1", "xmm3", "xmm4", "xmm5",
+              "xmm6", "xmm7");
+        count &= 3u;
+    }
+#endif
+
+    while (count-- > 0u) {
+        float v;
+        run += *acc++;
+        v = run < 0.0f ? -run : run;
+        if (v > 1.0f) v = 1.0f;
+        *dst++ = (uint8_t)(int)(v * 255.0f + 0.5f);
+    }
+}
+
+/* JPEG inverse DCT, AAN (Arai/Agui/Nakajima) flow graph in 16-bit fixed
+ * point. Input is 64 dequantized coefficients in natural order, already
+ * multiplied by the AAN row/column scale factors and 2^2 (jpeg.c folds
+ * both into its quantization table). Constants are Q14 applied as
+ * pmulhw(x << 2, c), which the scalar path reproduces as (x * c) >> 14,
+ * so both paths give identical pixels for any in-range stream. The
+ * caller's 16 rounding bias rides on the DC term of the second pass.*/
+#define IDCT_C_1_414 23170      /* sqrt(2)                 */
+#define IDCT_C_1_847 30274      /* 2 cos(pi/8)             */
+#define IDCT_C_1_082 17734      /* 2 (cos(pi/8)-cos(3pi/8)) */
+#define IDCT_C_1_613 26430      /* 2 (cos(pi/8)+cos(3pi/8)) - 1 */
+
+static void simd_idct_1d(const int32_t *in, int32_t *out,
+                         int in_step, int out_step) {
+    int32_t tmp0, tmp1, tmp2, tmp3, tmp4, tmp5, tmp6, tmp7;
+    int32_t tmp10, tmp11, tmp12, tmp13;
+    int32_t z5, z10, z11, z12, z13;
+
+    tmp10 = in[0] + in[4 * in_step];
+    tmp11 = in[0] - in[4 * in_step];
+    tmp13 = in[2 * in_step] + in[6 * in_step];
+    tmp12 = (((in[2 * in_step] - in[6 * in_step]) * IDCT_C_1_414) >> 14) -
+            tmp13;
+    tmp0 = tmp10 + tmp13;
+    tmp3 = tmp10 - tmp13;
+    tmp1 = tmp11 + tmp12;
+    tmp2 = tmp11 - tmp12;
+
+    z13 = in[5 * in_step] + in[3 * in_step];
+    z10 = in[5 * in_step] - in[3 * in_step];
+    z11 = in[1 * in_step] + in[7 * in_step];
+    z12 = in[1 * in_step] - in[7 * in_step];
+    tmp7 = z11 + z13;
+    tmp11 = ((z11 - z13) * IDCT_C_1_414) >> 14;
+    z5 = ((z10 + z12) * IDCT_C_1_847) >> 14;
+    tmp10 = ((z12 * IDCT_C_1_082) >> 14) - z5;
+    tmp12 = z5 - (((z10 * IDCT_C_1_613) >> 14) + z10);
+    tmp6 = tmp12 - tmp7;
+    tmp5 = tmp11 - tmp6;
+    tmp4 = tmp10 + tmp5;
+
+    out[0]            = tmp0 + tmp7;
+    out[7 * out_step] = tmp0 - tmp7;
+    out[1 * out_step] = tmp1 + tmp6;
+    out[6 * out_step] = tmp1 - tmp6;
+    out[2 * out_step] = tmp2 + tmp5;
+    out[5 * out_step] = tmp2 - tmp5;
+    out[4 * out_step] = tmp3 + tmp4;
+    out[3 * out_step] = tmp3 - tmp4;
+}
+
+#ifdef __SSE2__
+/* One 1-D pass down the columns: eight rows of eight int16 at S+SB in,
+ * eight rows at D+DB out. tmp4 spills to 256(%2) (8 xmm regs on i386).*/
+#define IDCT_SSE2_PASS(S, SB, D, DB)                                      \
+    "movdqu " S "+16" SB ", %%xmm1\n\t"                                   \
+    "movdqu " S "+112" SB ", %%xmm7\n\t"                                  \
+    "movdqa %%xmm1, %%xmm2\n\t"                                           \
+    "paddw %%xmm7, %%xmm1\n\t"          /* z11 */                         \
+    "psubw %%xmm7, %%xmm2\n\t"          /* z12 */                         \
+    "movdqu " S "+80" SB ", %%xmm5\n\t"                                   \
+    "movdqu " S "+48" SB ", %%xmm3\n\t"                                   \
+    "movdqa %%xmm5, %%xmm6\n\t"                                           \
+    "paddw %%xmm3, %%xmm5\n\t"          /* z13 */                         \
+    "psubw %%xmm3, %%xmm6\n\t"          /* z10 */                         \
+    "movdqa %%xmm1, %%xmm7\n\t"                                           \
+    "paddw %%xmm5, %%xmm7\n\t"          /* tmp7 */                        \
+    "psubw %%xmm5, %%xmm1\n\t"                                            \
+    "psllw $2, %%xmm1\n\t"                                                \
+    "pmulhw (%3), %%xmm1\n\t"           /* tmp11 */                       \
+    "movdqa %%xmm6, %%xmm5\n\t"                                           \
+    "paddw %%xmm2, %%xmm5\n\t"                                            \
+    "psllw $2, %%xmm5\n\t"                                                \
+    "pmulhw 16(%3), %%xmm5\n\t"         /* z5 */                          \
+    "movdqa %%xmm2, %%xmm0\n\t"                                           \
+    "psllw $2, %%xmm0\n\t"                                                \
+    "pmulhw 32(%3), %%xmm0\n\t"                                           \
+    "psubw %%xmm5, %%xmm0\n\t"          /* tmp10 */                       \
+    "movdqa %%xmm6, %%xmm3\n\t"                                           \
+    "psllw $2, %%xmm3\n\t"                                                \
+    "pmulhw 48(%3), %%xmm3\n\t"                                           \
+    "paddw %%xmm6, %%xmm3\n\t"                                            \
+    "psubw %%xmm3, %%xmm5\n\t"          /* tmp12 */                       \
+    "psubw %%xmm7, %%xmm5\n\t"          /* tmp6 */                        \
+    "psubw %%xmm5, %%xmm1\n\t"          /* tmp5 */                        \
+    "paddw %%xmm1, %%xmm0\n\t"          /* tmp4 */                        \
+    "movdqa %%xmm0, 256(%2)\n\t"                                          \
+    "movdqu " S "+0" SB ", %%xmm2\n\t"                                    \
+    "movdqu " S "+64" SB ", %%xmm3\n\t"                                   \
+    "movdqa %%xmm2, %%xmm4\n\t"                                           \
+    "paddw %%xmm3, %%xmm2\n\t"          /* tmp10 */                       \
+    "psubw %%xmm3, %%xmm4\n\t"          /* tmp11 */                       \
+    "movdqu " S "+32" SB ", %%xmm3\n\t"                                   \
+    "movdqu " S "+96" SB ", %%xmm6\n\t"                                   \
+    "movdqa %%xmm3, %%xmm0\n\t"                                           \
+    "paddw %%xmm6, %%xmm3\n\t"          /* tmp13 */                       \
+    "psubw %%xmm6, %%xmm0\n\t"                                            \
+    "psllw $2, %%xmm0\n\t"                                                \
+    "pmulhw (%3), %%xmm0\n\t"                                             \
+    "psubw %%xmm3, %%xmm0\n\t"          /* tmp12 */                       \
+    "movdqa %%xmm2, %%xmm6\n\t"                                           \
+    "paddw %%xmm3, %%xmm2\n\t"          /* tmp0 */                        \
+    "psubw %%xmm3, %%xmm6\n\t"          /* tmp3 */                        \
+    "movdqa %%xmm4, %%xmm3\n\t"                                           \
+    "paddw %%xmm0, %%xmm4\n\t"          /* tmp1 */                        \
+    "psubw %%xmm0, %%xmm3\n\t"          /* tmp2 */                        \
+    "movdqa %%xmm2, %%xmm0\n\t"                                           \
+    "paddw %%xmm7, %%xmm2\n\t"                                            \
+    "psubw %%xmm7, %%xmm0\n\t"                                            \
+    "movdqa %%xmm2, " D "+0" DB "\n\t"                                    \
+    "movdqa %%xmm0, " D "+112" DB "\n\t"                                  \
+    "movdqa %%xmm4, %%xmm0\n\t"                                           \
+    "paddw %%xmm5, %%xmm4\n\t"                                            \
+    "psubw %%xmm5, %%xmm0\n\t"                                            \
+    "movdqa %%xmm4, " D "+16" DB "\n\t"                                   \
+    "movdqa %%xmm0, " D "+96" DB "\n\t"                                   \
+    "movdqa %%xmm3, %%xmm0\n\t"                                           \
+    "paddw %%xmm1, %%xmm3\n\t"                                            \
+    "psubw %%xmm1, %%xmm0\n\t"                                            \
+    "movdqa %%xmm3, " D "+32" DB "\n\t"                                   \
+    "movdqa %%xmm0, " D "+80" DB "\n\t"                                   \
+    "movdqa 256(%2), %%xmm1\n\t"                                          \
+    "movdqa %%xmm6, %%xmm0\n\t"                                           \
+    "paddw %%xmm1, %%xmm6\n\t"                                            \
+    "psubw %%xmm1, %%xmm0\n\t"                                            \
+    "movdqa %%xmm6, " D "+64" DB "\n\t"                                   \
+    "movdqa %%xmm0, " D "+48" DB "\n\t"
+
+/* 8x8 int16 transpose of the block at S+(%2) into D+(%2), both aligned;
+ * the high interleaves park in the destination's lower half.*/
+#define IDCT_SSE2_TRANSPOSE_HALF(D)                                       \
+    "movdqa %%xmm0, %%xmm4\n\t"                                           \
+    "punpckldq %%xmm1, %%xmm0\n\t"                                        \
+    "punpckhdq %%xmm1, %%xmm4\n\t"                                        \
+    "movdqa %%xmm2, %%xmm5\n\t"                                           \
+    "punpckldq %%xmm3, %%xmm2\n\t"                                        \
+    "punpckhdq %%xmm3, %%xmm5\n\t"                                        \
+    "movdqa %%xmm0, %%xmm1\n\t"                                           \
+    "punpcklqdq %%xmm2, %%xmm0\n\t"                                       \
+    "punpckhqdq %%xmm2, %%xmm1\n\t"                                       \
+    "movdqa %%xmm4, %%xmm3\n\t"                                           \
+    "punpcklqdq %%xmm5, %%xmm4\n\t"                                       \
+    "punpckhqdq %%xmm5, %%xmm3\n\t"                                       \
+    "movdqa %%xmm0, " D "+0(%2)\n\t"                                      \
+    "movdqa %%xmm1, " D "+16(%2)\n\t"                                     \
+    "movdqa %%xmm4, " D "+32(%2)\n\t"                                     \
+    "movdqa %%xmm3, " D "+48(%2)\n\t"
+
+#define IDCT_SSE2_TRANSPOSE(S, D)                                         \
+    "movdqa " S "+0(%2), %%xmm0\n\t"                                      \
+    "movdqa %%xmm0, %%xmm4\n\t"                                           \
+    "punpcklwd " S "+16(%2), %%xmm0\n\t"                                  \
+    "punpckhwd " S "+16(%2), %%xmm4\n\t"                                  \
+    "movdqa " S "+32(%2), %%xmm1\n\t"                                     \
+    "movdqa %%xmm1, %%xmm5\n\t"                                           \
+    "punpcklwd " S "+48(%2), %%xmm1\n\t"                                  \
+    "punpckhwd " S "+48(%2), %%xmm5\n\t"                                  \
+    "movdqa " S "+64(%2), %%xmm2\n\t"                                     \
+    "movdqa %%xmm2, %%xmm6\n\t"                                           \
+    "punpcklwd " S "+80(%2), %%xmm2\n\t"                                  \
+    "punpckhwd " S "+80(%2), %%xmm6\n\t"                                  \
+    "movdqa " S "+96(%2), %%xmm3\n\t"                                     \
+    "movdqa %%xmm3, %%xmm7\n\t"                                           \
+    "punpcklwd " S "+112(%2), %%xmm3\n\t"                                 \
+    "punpckhwd " S "+112(%2), %%xmm7\n\t"                                 \
+    "movdqa %%xmm4, " D "+64(%2)\n\t"                                     \
+    "movdqa %%xmm5, " D "+80(%2)\n\t"                                     \
+    "movdqa %%xmm6, " D "+96(%2)\n\t"                                     \
+    "movdqa %%xmm7, " D "+112(%2)\n\t"                                    \
+    IDCT_SSE2_TRANSPOSE_HALF(D "+0")                                      \
+    "movdqa " D "+64(%2), %%xmm0\n\t"                                     \
+    "movdqa " D "+80(%2), %%xmm1\n\t"                                     \
+    "movdqa " D "+96(%2), %%xmm2\n\t"                                     \
+    "movdqa " D "+112(%2), %%xmm3\n\t"                                    \
+    IDCT_SSE2_TRANSPOSE_HALF(D "+64")
+
+/* Two output rows from the transposed block: descale, saturate, recenter. */
+#define IDCT_SSE2_STORE2(S)                                               \
+    "movdqa " S "(%2), %%xmm0\n\t"                                        \
+    "movdqa " S "+16(%2), %%xmm1\n\t"                                     \
+    "psraw $5, %%xmm0\n\t"                                                \
+    "psraw $5, %%xmm1\n\t"                                                \
+    "packsswb %%xmm1, %%xmm0\n\t"                                         \
+    "paddb 80(%3), %%xmm0\n\t"                                            \
+    "movq %%xmm0, (%0)\n\t"                                               \
+    "psrldq $8, %%xmm0\n\t"                                               \
+    "add %4, %0\n\t"                                                      \
+    "movq %%xmm0, (%0)\n\t"                                               \
+    "add %4, %0\n\t"
+#endif
+
+void simd_idct8x8_aan(uint8_t *dst, uint32_t stride, const int16_t *coef) {
+#ifdef __SSE2__
+    if (simd_use_sse2) {
+        static const int16_t k[48] __attribute__((aligned(16))) = {
+            IDCT_C_1_414, IDCT_C_1_414, IDCT_C_1_414, IDCT_C_1_414,
+            IDCT_C_1_414, IDCT_C_1_414, IDCT_C_1_414, IDCT_C_1_414,
+            IDCT_C_1_847, IDCT_C_1_847, IDCT_C_1_847, IDCT_C_1_847,
+            IDCT_C_1_847, IDCT_C_1_847, IDCT_C_1_847, IDCT_C_1_847,
+            IDCT_C_1_082, IDCT_C_1_082, IDCT_C_1_082, IDCT_C_1_082,
+            IDCT_C_1_082, IDCT_C_1_082, IDCT_C_1_082, IDCT_C_1_082,
+            IDCT_C_1_613, IDCT_C_1_613, IDCT_C_1_613, IDCT_C_1_613,
+            IDCT_C_1_613, IDCT_C_1_613, IDCT_C_1_613, IDCT_C_1_613,
+            16, 16, 16, 16, 16, 16, 16, 16,
+            (int16_t)0x8080, (int16_t)0x8080, (int16_t)0x8080,
+            (int16_t)0x8080, (int16_t)0x8080, (int16_t)0x8080,
+            (int16_t)0x8080, (int16_t)0x8080
+        };
+        /* ws: pass output at 0, transposed copy at 128, spill at 256 */
+        int16_t ws[136] __attribute__((aligned(16)));
+        __asm__ volatile(
+            IDCT_SSE2_PASS("0", "(%1)", "0", "(%2)")
+            IDCT_SSE2_TRANSPOSE("0", "128")
+            "movdqa 128(%2), %%xmm0\n\t"
+            "paddw 64(%3), %%xmm0\n\t"
+            "movdqa %%xmm0, 128(%2)\n\t"
+            IDCT_SSE2_PASS("128", "(%2)", "0", "(%2)")
+            IDCT_SSE2_TRANSPOSE("0", "128")
+            IDCT_SSE2_STORE2("128")
+            IDCT_SSE2_STORE2("160")
+            IDCT_SSE2_STORE2("192")
+            IDCT_SSE2_STORE2("224")
+            : "+r"(dst)
+            : "r"(coef), "r"(ws), "r"(k), "r"(stride)
+            : "memory", "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5",
+              "xmm6", "xmm7");
+        return;
+    }
+#endif
+
+    {
+        int32_t in[64];
+        int32_t ws[64];
+        int32_t row[8];
+        int i;
+        for (i = 0; i < 64; i++) in[i] = coef[i];
+        for (i = 0; i < 8; i++) simd_idct_1d(in + i, ws + i, 8, 8);
+        for (i = 0; i < 8; i++) {
+            int x;
+            ws[i * 8] += 16;
+            simd_idct_1d(ws + i * 8, row, 1, 1);
+            for (x = 0; x < 8; x++) {
+                int32_t v = (row[x] >> 5) + 128;
+                if (v < 0) v = 0;
+                if (v > 255) v = 255;
+                dst[x] = (uint8_t)v;
+            }
+            dst += stride;
+        }
+    }
+}
+
+/* PNG row reconstruction (filter types 1-4; 0 is a no-op) against the
+ * already-reconstructed previous row, which is all zeros for the first
+ * row. SSE2 handles Up 16 bytes at a time and Sub/Average/Paeth one
+ * 3- or 4-byte pixel per step in 16-bit lanes, picking the Paeth
+ * predictor with compares instead of branches. For 3-byte pixels the
+ * fourth lane's predictor is masked to zero, so the 4-byte store puts
+ * back the untouched first byte of the next pixel; the last pixel is
+ * left to the scalar tail so no load runs past the row.*/
+static void simd_unfilter_tail(uint8_t *cur, const uint8_t *prev,
+                               uint32_t x, uint32_t len, uint32_t bpp,
+                               uint32_t filter) {
+    for (; x < len; x++) {
+        int a = x >= bpp ? cur[x - bpp] : 0;
+        int b = prev[x];
+        int c = x >= bpp ? prev[x - bpp] : 0;
+        int pred;
+        if (filter == 1u) {
+            pred = a;
+        } else if (filter == 2u) {
+            pred = b;
+        } else if (filter == 3u) {
+            pred = (a + b) >> 1;
+        } else {
+            int pa = b - c, pb = a - c, pc = pa + pb;
+            if (pa < 0) pa = -pa;
+            if (pb < 0) pb = -pb;
+            if (pc < 0) pc = -pc;
+            pred = (pa <= pb && pa <= pc) ? a : (pb <= pc ? b : c);
+        }
+        cur[x] = (uint8_t)(cur[x] + pred);
+    }
+}
+
+void simd_png_unfilter_row(uint8_t *cur, const uint8_t *prev, uint32_t len,
+                           uint32_t bpp, uint32_t filter) {
+    uint32_t x = 0;
+
+    if (filter == 0u || filter > 4u) return;
+
+#ifdef __SSE2__
+    if (simd_use_sse2 && filter == 2u) {
+        while (x + 16u <= len) {
+            __asm__ volatile(
+                "movdqu (%0), %%xmm0\n\t"
+                "movdqu (%1), %%xmm1\n\t"
+                "paddb %%xmm1, %%xmm0\n\t"
+                "movdqu %%xmm0, (%0)\n\t"
+                :
+                : "r"(cur + x), "r"(prev + x)
+                : "memory", "xmm0", "xmm1");
+            x += 16u;
+        }
+    } else if (simd_use_sse2 && (bpp == 3u || bpp == 4u) && len >= 2u * bpp) {
+        static const uint8_t lane_mask[2][16] __attribute__((aligned(16))) = {
+            { 0xFF, 0xFF, 0xFF, 0 },
+            { 0xFF, 0xFF, 0xFF, 0xFF }
+        };
+        static const uint8_t ones[16] __attribute__((aligned(16))) = {
+            1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1
+        };
+        const uint8_t *mask = lane_mask[bpp - 3u];
+        uint32_t pixels = bpp == 4u ? len >> 2 : len / 3u - 1u;
+        uint8_t *c_ptr = cur;
+        const uint8_t *p_ptr = prev;
+
+        if (filter == 1u) {
+            __asm__ volatile(
+                "movdqa (%4), %%xmm7\n\t"
+                "pxor %%xmm1, %%xmm1\n\t"          /* a */
+                "1:\n\t"
+                "movd (%0), %%xmm0\n\t"
+                "paddb %%xmm1, %%xmm0\n\t"
+                "movd %%xmm0, (%0)\n\t"
+                "movdqa %%xmm0, %%xmm1\n\t"
+                "pand %%xmm7, %%xmm1\n\t"
+                "add %3, %0\n\t"
+                "dec %1\n\t"
+                "jnz 1b\n\t"
+                : "+r"(c_ptr), "+r"(pixels), "+r"(p_ptr)
+                : "r"(bpp), "r"(mask)
+                : "memory", "cc", "xmm0", "xmm1", "xmm7");
+        } else if (filter == 3u) {
+            __asm__ volatile(
+                "movdqa (%4), %%xmm7\n\t"
+                "movdqa (%5), %%xmm6\n\t"
+                "pxor %%xmm1, %%xmm1\n\t"          /* a */
+                "1:\n\t"
+                "movd (%2), %%xmm2\n\t"            /* b */
+                "movdqa %%xmm1, %%xmm3\n\t"
+                "pxor %%xmm2, %%xmm3\n\t"
+                "pand %%xmm6, %%xmm3\n\t"          /* (a ^ b) & 1 */
+                "pavgb %%xmm2, %%xmm1\n\t"         /* rounds up... */
+                "psubb %%xmm3, %%xmm1\n\t"         /* ...so floor */
+                "pand %%xmm7, %%xmm1\n\t"
+                "movd (%0), %%xmm0\n\t"
+                "paddb %%xmm1, %%xmm0\n\t"
+                "movd %%xmm0, (%0)\n\t"
+                "movdqa %%xmm0, %%xmm1\n\t"
+                "add %3, %0\n\t"
+                "add %3, %2\n\t"
+                "dec %1\n\t"
+                "jnz 1b\n\t"
+                : "+r"(c_ptr), "+r"(pixels), "+r"(p_ptr)
+                : "r"(bpp), "r"(mask), "r"(ones)
+                : "memory", "cc", "xmm0", "xmm1", "xmm2", "xmm3",
+                  "xmm6", "xmm7");
+        } else {
+            __asm__ volatile(
+                "pxor %%xmm7, %%xmm7\n\t"
+                "pxor %%xmm1, %%xmm1\n\t"          /* a (words) */
+                "pxor %%xmm3, %%xmm3\n\t"          /* c (words) */
+                "1:\n\t"
+                "movd (%2), %%xmm2\n\t"
+                "punpcklbw %%xmm7, %%xmm2\n\t"     /* b */
+                "movdqa %%xmm2, %%xmm4\n\t"
+                "psubw %%xmm3, %%xmm4\n\t"         /* p - a = b - c */
+                "movdqa %%xmm1, %%xmm5\n\t"
+                "psubw %%xmm3, %%xmm5\n\t"         /* p - b = a - c */
+                "movdqa %%xmm4, %%xmm6\n\t"
+                "paddw %%xmm5, %%xmm6\n\t"         /* p - c */
+                "pxor %%xmm0, %%xmm0\n\t"
+                "psubw %%xmm4, %%xmm0\n\t"
+                "pmaxsw %%xmm0, %%xmm4\n\t"        /* pa */
+                "pxor %%xmm0, %%xmm0\n\t"
+                "psubw %%xmm5, %%xmm0\n\t"
+                "pmaxsw %%xmm0, %%xmm5\n\t"        /* pb */
+                "pxor %%xmm0, %%xmm0\n\t"
+                "psubw %%xmm6, %%xmm0\n\t"
+                "pmaxsw %%xmm0, %%xmm6\n\t"        /* pc */
+                "movdqa %%xmm4, %%xmm0\n\t"
+                "pminsw %%xmm5, %%xmm0\n\t"
+                "pminsw %%xmm6, %%xmm0\n\t"        /* min */
+                "pcmpeqw %%xmm0, %%xmm5\n\t"       /* pick b */
+                "pcmpeqw %%xmm0, %%xmm4\n\t"       /* pick a (wins ties) */
+                "movdqa %%xmm2, %%xmm6\n\t"
+                "pand %%xmm5, %%xmm6\n\t"
+                "pandn %%xmm3, %%xmm5\n\t"
+                "por %%xmm6, %%xmm5\n\t"           /* b or c */
+                "movdqa %%xmm1, %%xmm6\n\t"
+                "pand %%xmm4, %%xmm6\n\t"
+                "pandn %%xmm5, %%xmm4\n\t"
+                "por %%xmm6, %%xmm4\n\t"           /* predictor */
+                "movdqa %%xmm2, %%xmm3\n\t"        /* next c = b */
+                "packuswb %%xmm4, %%xmm4\n\t"
+                "pand (%4), %%xmm4\n\t"
+                "movd (%0), %%xmm0\n\t"
+                "paddb %%xmm4, %%xmm0\n\t"
+                "movd %%xmm0, (%0)\n\t"
+                "movdqa %%xmm0, %%xmm1\n\t"
+                "punpcklbw %%xmm7, %%xmm1\n\t"     /* next a */
+                "add %3, %0\n\t"
+                "add %3, %2\n\t"
+                "dec %1\n\t"
+                "jnz 1b\n\t"
+                : "+r"(c_ptr), "+r"(pixels), "+r"(p_ptr)
+                : "r"(bpp), "r"(mask)
+                : "memory", "cc", "xmm0", "xmm1", "xmm2", "xmm3",
+                  "xmm4", "xmm5", "xmm6", "xmm7");
+        }
+        x = (uint32_t)(c_ptr - cur);
+    }
+#endif
+
+    simd_unfilter_tail(cur, prev, x, len, bpp, filter);
+}
+
 void simd_add_rows(uint32_t *dst, const uint32_t *src, uint32_t count) {
 #ifdef __SSE2__
     if (simd_use_sse2) {
@@ -411,6 +1257,16 @@ void simd_blur_v_pass(uint32_t *dst, const uint32_t *src,
 #include "serial.h"
 #include "timer.h"
 
+/* Throughput as Mpix/s with one decimal; kpix is thousands of pixels. */
+static void simd_bench_report(const char *name, uint32_t kpix, uint32_t ms) {
+    uint32_t tenths;
+    if (ms == 0u)
+        ms = 1u;
+    tenths = (kpix * 10u) / ms;
+    serial_printf("%s: %ums, %u.%u Mpix/s\n", name, ms,
+                  tenths / 10u, tenths % 10u);
+}
+
 void simd_benchmark(void) {
     static uint32_t bench_buf[256u * 1024u];
     static uint32_t bench_src[256u * 1024u];
@@ -476,6 +1332,138 @@ void simd_benchmark(void) {
         serial_printf("simd_blend_row correctness: %s\n", ok ? "PASS" : "FAIL");
     }
 
+    for (i = 0; i < 256u; i++) {
+        uint32_t a = (i * 37u) & 0xFFu;
+        if ((i & 7u) == 0u) a = 0u;
+        if ((i & 7u) == 1u) a = 255u;
+        blend_src[i] = (a << 24) | ((i * 7654321u) & 0x00FFFFFFu);
+        blend_dst[i] = (i * 1234567u) & 0x00FFFFFFu;
+    }
+    {
+        static uint32_t ref[256u];
+        for (i = 0; i < 256u; i++) {
+            uint32_t s = blend_src[i];
+            uint32_t d = blend_dst[i];
+            uint32_t a = s >> 24;
+            uint32_t ia = 255u - a;
+            if (a == 0u) {
+                ref[i] = d;
+            } else if (a == 255u) {
+                ref[i] = s & 0x00FFFFFFu;
+            } else {
+                uint32_t r = (((s >> 16) & 0xFFu) * a +
+                              ((d >> 16) & 0xFFu) * ia + 128u) >> 8;
+                uint32_t g = (((s >> 8) & 0xFFu) * a +
+                              ((d >> 8) & 0xFFu) * ia + 128u) >> 8;
+                uint32_t b = ((s & 0xFFu) * a + (d & 0xFFu) * ia + 128u) >> 8;
+                ref[i] = (r << 16) | (g << 8) | b;
+            }
+        }
+        simd_over_row(blend_dst, blend_src, 256u);
+        ok = 1u;
+        for (i = 0; i < 256u; i++) {
+            if (blend_dst[i] != ref[i]) {
+                ok = 0u;
+                break;
+            }
+        }
+        serial_printf("simd_over_row correctness: %s\n", ok ? "PASS" : "FAIL");
+    }
+
+    {
+        static uint32_t ref[256u];
+        int32_t r_fp = 0x10 << 16;
+        int32_t step = (int32_t)((0xE0 - 0x10) << 16) / 255;
+        for (i = 0; i < 256u; i++) {
+            uint32_t r = (uint32_t)((r_fp + step * (int32_t)i) >> 16) & 0xFFu;
+            uint32_t g = (uint32_t)(((0xEF << 16) - step * (int32_t)i) >> 16) &
+                         0xFFu;
+            ref[i] = (r << 16) | (g << 8) | 0x40u;
+        }
+        simd_gradient_row(blend_dst, 256u, r_fp, 0xEF << 16, 0x40 << 16,
+                          step, -step, 0);
+        ok = 1u;
+        for (i = 0; i < 256u; i++) {
+            if (blend_dst[i] != ref[i]) {
+                ok = 0u;
+                break;
+            }
+        }
+        serial_printf("simd_gradient_row correctness: %s\n",
+                      ok ? "PASS" : "FAIL");
+    }
+
+    for (i = 0; i < 256u; i++) {
+        blend_src[i] = i * 2654435761u;
+        blend_dst[i] = (i * 1234567u) & 0x00FFFFFFu;
+    }
+    {
+        static uint32_t ref[256u];
+        const uint32_t rgb = 0x00336699u;
+        const uint32_t alpha = 160u;
+        const uint32_t ia = 255u - alpha;
+        /* 255 pixels so the scalar tail runs too */
+        for (i = 0; i < 255u; i++) {
+            uint32_t d = blend_dst[i];
+            uint32_t r = (((rgb >> 16) & 0xFFu) * alpha +
+                          ((d >> 16) & 0xFFu) * ia + 128u) >> 8;
+            uint32_t g = (((rgb >> 8) & 0xFFu) * alpha +
+                          ((d >> 8) & 0xFFu) * ia + 128u) >> 8;
+            uint32_t b = ((rgb & 0xFFu) * alpha + (d & 0xFFu) * ia + 128u) >> 8;
+            ref[i] = (r << 16) | (g << 8) | b;
+        }
+        simd_fill_alpha_row(blend_dst, 255u, rgb, (uint8_t)alpha);
+        ok = 1u;
+        for (i = 0; i < 255u; i++) {
+            if (blend_dst[i] != ref[i]) {
+                ok = 0u;
+                break;
+            }
+        }
+        serial_printf("simd_fill_alpha_row correctness: %s\n",
+                      ok ? "PASS" : "FAIL");
+    }
+
+    {
+        static uint32_t ref[256u];
+        const uint32_t src_w = 100u;
+        const uint32_t fy = 77u;
+        const uint32_t step = 0x7000u;
+        uint32_t sx = 0x1234u;
+        /* 253 pixels: scalar tail, and the last ones clamp to the edge */
+        for (i = 0; i < 253u; i++, sx += step) {
+            uint32_t x0 = sx >> 16;
+            uint32_t x1 = x0 + 1u;
+            uint32_t fx = (sx >> 8) & 0xFFu;
+            uint32_t out = 0u;
+            uint32_t sh;
+            if (x0 >= src_w - 1u) {
+                x0 = src_w - 1u;
+                x1 = x0;
+                fx = 0u;
+            }
+            for (sh = 0u; sh < 32u; sh += 8u) {
+                uint32_t t = (((blend_src[x0] >> sh) & 0xFFu) * (256u - fy) +
+                              ((blend_src[128u + x0] >> sh) & 0xFFu) * fy) >> 8;
+                uint32_t b = (((blend_src[x1] >> sh) & 0xFFu) * (256u - fy) +
+                              ((blend_src[128u + x1] >> sh) & 0xFFu) * fy) >> 8;
+                out |= ((t * (256u - fx) + b * fx) >> 8) << sh;
+            }
+            ref[i] = out;
+        }
+        simd_scale_row_bilinear(blend_dst, blend_src, blend_src + 128u, src_w,
+                                253u, 0x1234u, step, fy);
+        ok = 1u;
+        for (i = 0; i < 253u; i++) {
+            if (blend_dst[i] != ref[i]) {
+                ok = 0u;
+                break;
+            }
+        }
+        serial_printf("simd_scale_row_bilinear correctness: %s\n",
+                      ok ? "PASS" : "FAIL");
+    }
+
     t0 = timer_get_uptime_ms();
     for (i = 0; i < 100u; i++) {
         simd_memcpy(bench_buf, bench_src, 1024u * 1024u);
@@ -483,5 +1471,51 @@ void simd_benchmark(void) {
     t1 = timer_get_uptime_ms();
     serial_printf("simd_memcpy 100x 1MB: %ums total, %uus/frame\n",
                   t1 - t0, (t1 - t0) * 10u);
+
+    /* Span kernels over a 640x400 region, 20 passes each */
+    {
+        const uint32_t w = 640u;
+        const uint32_t rows = 400u;
+        const uint32_t passes = 20u;
+        const uint32_t kpix = (w * rows * passes) / 1000u;
+        uint32_t p;
+        uint32_t y;
+
+        for (i = 0; i < w * rows; i++)
+            bench_src[i] = ((i & 0xFFu) << 24) | (i * 2654435761u >> 8);
+
+        t0 = timer_get_uptime_ms();
+        for (p = 0; p < passes; p++)
+            for (y = 0; y < rows; y++)
+                simd_fill_alpha_row(bench_buf + y * w, w, 0x00336699u, 128u);
+        t1 = timer_get_uptime_ms();
+        simd_bench_report("simd_fill_alpha_row", kpix, t1 - t0);
+
+        t0 = timer_get_uptime_ms();
+        for (p = 0; p < passes; p++)
+            for (y = 0; y < rows; y++)
+                simd_over_row(bench_buf + y * w, bench_src + y * w, w);
+        t1 = timer_get_uptime_ms();
+        simd_bench_report("simd_over_row", kpix, t1 - t0);
+
+        t0 = timer_get_uptime_ms();
+        for (p = 0; p < passes; p++)
+            for (y = 0; y < rows; y++)
+                simd_gradient_row(bench_buf + y * w, w, 0, 0xFF << 16, 0,
+                                  0x6600, -0x6600, 0x3300);
+        t1 = timer_get_uptime_ms();
+        simd_bench_report("simd_gradient_row", kpix, t1 - t0);
+
+        t0 = timer_get_uptime_ms();
+        for (p = 0; p < passes; p++)
+            for (y = 0; y < rows; y++)
+                simd_scale_row_bilinear(bench_buf + y * w,
+                                        bench_src + (y / 2u) * w,
+                                        bench_src + (y / 2u + 1u) * w,
+                                        w, w, 0u, 0x8000u,
+                                        (y & 1u) ? 128u : 0u);
+        t1 = timer_get_uptime_ms();
+        simd_bench_report("simd_scale_row_bilinear", kpix, t1 - t0);
+    }
 }
 #endif
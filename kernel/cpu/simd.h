@@ -24,6 +24,25 @@ void simd_fill_rect(uint32_t *fb, uint32_t stride,
 void simd_blend_row(uint32_t *dst, const uint32_t *src,
                     uint32_t count, uint8_t alpha);
 
+/* Span kernels used by gfx2d after clipping (see simd.c for rounding). */
+void simd_fill_alpha_row(uint32_t *dst, uint32_t count,
+                         uint32_t rgb, uint8_t alpha);
+void simd_over_row(uint32_t *dst, const uint32_t *src, uint32_t count);
+void simd_gradient_row(uint32_t *dst, uint32_t count,
+                       int32_t r_fp, int32_t g_fp, int32_t b_fp,
+                       int32_t r_step, int32_t g_step, int32_t b_step);
+void simd_scale_row_bilinear(uint32_t *dst, const uint32_t *row0,
+                             const uint32_t *row1, uint32_t src_w,
+                             uint32_t count, uint32_t sx_fp,
+                             uint32_t sx_step, uint32_t fy);
+/* Glyph rasterizer: prefix-sum signed-area deltas into 8-bit alpha. */
+void simd_coverage_accumulate(uint8_t *dst, const float *acc, uint32_t count);
+/* JPEG: 8x8 AAN inverse DCT of prescaled coefficients to 8-bit samples. */
+void simd_idct8x8_aan(uint8_t *dst, uint32_t stride, const int16_t *coef);
+/* PNG: undo one row's filter (1-4) given the reconstructed row above. */
+void simd_png_unfilter_row(uint8_t *cur, const uint8_t *prev, uint32_t len,
+                           uint32_t bpp, uint32_t filter);
+
 void simd_add_rows(uint32_t *dst, const uint32_t *src, uint32_t count);
 
 void simd_blur_h_pass(uint32_t *dst, const uint32_t *src,
@@ -284,6 +284,6 @@ int snd_maxslicetime_ms = 28;
 char *snd_musiccmd   = (char*)"";
 int snd_pitchshift   = 0;
 
-void I_BindSoundVariables(void)        {}
+/* I_BindSoundVariables lives in i_sound_cupidos.c (opl_core). */
 
 /* I_*Music stubs removed - implemented in i_sound_cupidos.c (Task 17) */
@@ -19,6 +19,7 @@
 #include "serial.h"
 #include "timer.h"
 #include "vfs.h"
+#include "smp.h"
 #include "types.h"
 
 extern void process_yield(void);
@@ -122,10 +123,66 @@ void DG_Init(void) {
  * is the biggest single CPU win for sustained framerate (and the
  * stability win for music: less time in the main thread blocked on
  * memory bandwidth = more headroom for the AC97 IRQ + cup_music_pump).*/
+static void cup_frame_tick(void);
+
 void DG_DrawFrame(void) {
     if (!DG_ScreenBuffer) { return; }
     vga_mark_dirty_full();
     vga_flip();
+    cup_frame_tick();
+}
+
+/* DG_StripCPUs / DG_RunStrips */
+
+/* The game thread draws strip 0 itself and hands strip i > 0 to the
+ * next online CPU with smp_call_start. A remote strip runs in IPI
+ * context on top of whatever that CPU was doing (idle hlt, or the
+ * music thread), and the IPI path saves no FPU state, while the DOOM
+ * tree is built -O2 -msse2. So each remote strip is bracketed by an
+ * fxsave/fxrstor of its own.*/
+static int    s_strip_cpus = 1;
+static void (*s_strip_fn)(int strip, void *ctx);
+static void  *s_strip_ctx;
+static uint8_t s_strip_fx[SMP_MAX_CPUS][512] __attribute__((aligned(16)));
+
+static void cup_strip_call(void *arg) {
+    uint8_t *fx = s_strip_fx[smp_current_cpu()];
+    __asm__ volatile("fxsave (%0)" : : "r"(fx) : "memory");
+    s_strip_fn((int)(uint32_t)arg, s_strip_ctx);
+    __asm__ volatile("fxrstor (%0)" : : "r"(fx) : "memory");
+}
+
+int DG_StripCPUs(int want) {
+    int online = 0;
+    int i;
+    for (i = 0; i < smp_cpu_count(); i++) {
+        if (cpus[i].online) online++;
+    }
+    if (want <= 0 || want > online) want = online;
+    s_strip_cpus = want > 0 ? want : 1;
+    return s_strip_cpus;
+}
+
+void DG_RunStrips(int count, void (*fn)(int strip, void *ctx), void *ctx) {
+    int busy[SMP_MAX_CPUS];
+    int nbusy = 0;
+    int strip = 1;
+    int me = smp_current_cpu();
+    int cpu;
+
+    s_strip_fn  = fn;
+    s_strip_ctx = ctx;
+    for (cpu = 0; cpu < smp_cpu_count() && strip < count; cpu++) {
+        if (cpu == me || !cpus[cpu].online) continue;
+        if (smp_call_start(cpu, cup_strip_call,
+                           (void *)(uint32_t)strip) != 0) continue;
+        busy[nbusy++] = cpu;
+        strip++;
+    }
+    fn(0, ctx);
+    /* Strips no CPU took (one went offline) are drawn here. */
+    for (; strip < count; strip++) fn(strip, ctx);
+    for (cpu = 0; cpu < nbusy; cpu++) smp_call_wait(busy[cpu]);
 }
 
 /* DG_SleepMs / DG_GetTicksMs */
@@ -230,6 +287,65 @@ uint32_t DG_GetTicksMs(void) {
     return now;
 }
 
+/* Frame timing for doomstat: the interval between consecutive
+ * DG_DrawFrame calls, i.e. game logic + render + flip + any music
+ * synthesis the game thread did in between. Gaps over a second (level
+ * loads, the game paused behind the shell) are left out.*/
+static uint64_t s_frame_last_tsc = 0;
+static uint32_t s_frame_count    = 0;
+static uint64_t s_frame_sum_us   = 0;
+static uint32_t s_frame_max_us   = 0;
+
+static void cup_frame_tick(void) {
+    cup_clock_init();
+    uint64_t now = cup_rdtsc();
+    if (s_frame_last_tsc != 0) {
+        uint64_t us = ((now - s_frame_last_tsc) * 1000u) / s_tsc_per_ms;
+        if (us < 1000000u) {
+            s_frame_count++;
+            s_frame_sum_us += us;
+            if (us > s_frame_max_us) s_frame_max_us = (uint32_t)us;
+        }
+    }
+    s_frame_last_tsc = now;
+}
+
+void doom_perf_stats(doom_perf_stats_t *st) {
+    st->frames       = s_frame_count;
+    st->frame_avg_us = s_frame_count
+        ? (uint32_t)(s_frame_sum_us / s_frame_count) : 0u;
+    st->frame_max_us = s_frame_max_us;
+    st->fps_x10      = st->frame_avg_us
+        ? 10000000u / st->frame_avg_us : 0u;
+    st->draw_cpus    = (uint32_t)s_strip_cpus;
+    cup_music_stats(st);
+}
+
+void doom_perf_reset(void) {
+    s_frame_last_tsc = 0;
+    s_frame_count    = 0;
+    s_frame_sum_us   = 0;
+    s_frame_max_us   = 0;
+    cup_music_stats_reset();
+}
+
+static void doom_perf_log(void) {
+    doom_perf_stats_t st;
+    doom_perf_stats(&st);
+    serial_printf("[doom] %u frames, avg %u us (%u.%u fps), max %u us, "
+                  "drawn on %u cpu(s)\n",
+                  st.frames, st.frame_avg_us, st.fps_x10 / 10u,
+                  st.fps_x10 % 10u, st.frame_max_us, st.draw_cpus);
+    if (st.music_cpu >= 0)
+        serial_printf("[doom] music on cpu%d, ", st.music_cpu);
+    else
+        serial_write_string("[doom] music on game thread, ");
+    serial_printf("%u underruns (%u glitches, %u silent frames), "
+                  "render avg %u us max %u us\n",
+                  st.underruns, st.glitches, st.silent_frames,
+                  st.render_avg_us, st.render_max_us);
+}
+
 /* DG_GetKey */
 
 int DG_GetKey(int *pressed, unsigned char *doomkey) {
@@ -342,6 +458,7 @@ int doom_main(int argc, char **argv) {
     if (dg_setjmp(s_doom_env) != 0) {
         /* Arrived here via dg_longjmp from dg_exit/dg_abort */
         keyboard_unsubscribe();
+        doom_perf_log();
         serial_write_string("[doom] returned to shell\n");
         return 0;
     }
@@ -389,6 +506,7 @@ int doom_main(int argc, char **argv) {
         DG_ScreenBuffer = &fb[(uint32_t)y_off * (uint32_t)VGA_GFX_WIDTH];
     }
 
+    doom_perf_reset();
     DG_Init();
     M_FindResponseFile();
     D_DoomMain();
@@ -9,4 +9,31 @@
 */
 int doom_main(int argc, char **argv);
 
+/* Frame-time and music-ring counters since DOOM started (or the last
+ * doom_perf_reset). Shown by the `doomstat` shell command and logged
+ * to serial when DOOM exits.*/
+typedef struct {
+    uint32_t frames;          /* frames drawn */
+    uint32_t frame_avg_us;    /* mean DG_DrawFrame-to-DG_DrawFrame time */
+    uint32_t frame_max_us;
+    uint32_t fps_x10;         /* 1 / frame_avg_us, in tenths of a frame/s */
+    uint32_t draw_cpus;       /* CPUs drawing strips of each frame */
+    int32_t  music_cpu;       /* CPU synthesising music, -1 = game thread */
+    uint32_t lookahead_ms;    /* music ring target fill */
+    uint32_t ring_fill_ms;    /* music ring fill right now */
+    uint32_t underruns;       /* stream pulls the ring could not cover */
+    uint32_t silent_frames;   /* frames padded with silence */
+    uint32_t glitches;        /* separate underrun episodes */
+    uint32_t music_buffers;   /* 512-frame buffers synthesised */
+    uint32_t render_avg_us;   /* synthesis time per buffer */
+    uint32_t render_max_us;
+} doom_perf_stats_t;
+
+void doom_perf_stats(doom_perf_stats_t *st);
+void doom_perf_reset(void);
+
+/* Music half of the above (i_sound_cupidos.c). */
+void cup_music_stats(doom_perf_stats_t *st);
+void cup_music_stats_reset(void);
+
 #endif /* KERNEL_DOOM_PLATFORM_H */
@@ -12,10 +12,17 @@
 #include "mixer.h"
 #include "src/i_sound.h"
 #include "src/w_wad.h"
-
-/* Per-lump cache: u8/11025Hz mono -> s16/22050Hz mono, allocated lazily.
+#include "src/m_config.h"
+#include "src/m_argv.h"
+#include "process.h"
+#include "percpu.h"
+#include "bkl.h"
+#include "doomgeneric_cupidos.h"
+
+/* Per-lump cache: u8 mono -> s16 mono at the lump's own rate, allocated
+ * lazily.  The mixer resamples to 22050 Hz while it plays.
  * Indexed by WAD lump number.  WADs rarely exceed 4096 lumps so 4096
- * slots keeps memory use reasonable (4096 * 12 bytes = 48 KB for the
+ * slots keeps memory use reasonable (4096 * 16 bytes = 64 KB for the
  * table itself; PCM buffers are heap-allocated on demand).
 */
 #define MAX_CACHED_SFX 4096
@@ -23,12 +30,13 @@
 typedef struct {
     int16_t  *pcm;
     uint32_t  frames;
+    uint32_t  rate;
     uint8_t   cached;
 } sfx_cache_entry_t;
 
 static sfx_cache_entry_t s_cache[MAX_CACHED_SFX];
 
-/* Resample a DOOM SFX lump into the cache */
+/* Convert a DOOM SFX lump into the cache */
 
 static int cache_sfx(sfxinfo_t *sfx)
 {
@@ -49,7 +57,7 @@ static int cache_sfx(sfxinfo_t *sfx)
      *   bytes 8..: raw u8 PCM samples (0=min, 255=max, 128=silence)
 */
     uint32_t rate = (uint32_t)raw[2] | ((uint32_t)raw[3] << 8);
-    if (rate == 0) { rate = 11025u; }
+    if (rate < 1000u || rate > 96000u) { rate = 11025u; }
 
     uint32_t samples = (uint32_t)raw[4]
                      | ((uint32_t)raw[5] << 8)
@@ -71,37 +79,17 @@ static int cache_sfx(sfxinfo_t *sfx)
     }
     if (samples == 0) { return -1; }
 
-    /* Linear resample to mixer rate (22050 Hz) */
-    uint32_t out_frames = (uint32_t)(((uint64_t)samples * 22050u) / rate);
-    if (out_frames == 0) { out_frames = 1; }
-
-    int16_t *out = (int16_t *)kmalloc(out_frames * sizeof(int16_t));
+    int16_t *out = (int16_t *)kmalloc(samples * sizeof(int16_t));
     if (!out) { return -1; }
 
-    for (uint32_t i = 0; i < out_frames; i++) {
-        /* Fixed-point source index (16.16) */
-        uint64_t src_q16 = ((uint64_t)i * (uint64_t)rate * 65536u) / 22050u;
-        uint32_t si = (uint32_t)(src_q16 >> 16);
-        uint32_t fr = (uint32_t)(src_q16 & 0xFFFFu);
-
-        /* Guard against overrun at the last frame */
-        if (si + 1u >= samples) {
-            si = (samples > 1u) ? samples - 2u : 0u;
-        }
-
-        /* u8 -> s16: centre at 128, scale to s16 range */
-        int32_t s0 = ((int32_t)raw[pcm_off + si]      - 128) * 256;
-        int32_t s1 = ((int32_t)raw[pcm_off + si + 1u] - 128) * 256;
-        int32_t v  = s0 + (((s1 - s0) * (int32_t)fr) >> 16);
-
-        /* Clamp to s16 */
-        if (v >  32767) { v =  32767; }
-        if (v < -32768) { v = -32768; }
-        out[i] = (int16_t)v;
+    /* u8 -> s16: centre at 128, scale to s16 range */
+    for (uint32_t i = 0; i < samples; i++) {
+        out[i] = (int16_t)(((int32_t)raw[pcm_off + i] - 128) * 256);
     }
 
     e->pcm    = out;
-    e->frames = out_frames;
+    e->frames = samples;
+    e->rate   = rate;
     e->cached = 1;
     return 0;
 }
@@ -115,6 +103,7 @@ static boolean cup_init(boolean use_sfx_prefix)
     for (i = 0; i < MAX_CACHED_SFX; i++) {
         s_cache[i].pcm    = (int16_t *)0;
         s_cache[i].frames = 0;
+        s_cache[i].rate   = 0;
         s_cache[i].cached = 0;
     }
     serial_write_string("[i_sound] init\n");
@@ -173,9 +162,9 @@ static int cup_start_sound(sfxinfo_t *sfx, int channel, int vol, int sep)
     if (l > 255u) { l = 255u; }
     if (r > 255u) { r = 255u; }
 
-    mixer_play(slot, e->pcm, e->frames,
-               /* channels= */1, /* loop= */0,
-               (uint8_t)l, (uint8_t)r);
+    mixer_play_rate(slot, e->pcm, e->frames,
+                    /* channels= */1, /* loop= */0,
+                    (uint8_t)l, (uint8_t)r, e->rate);
     return slot;
 }
 
@@ -294,6 +283,31 @@ void I_PrecacheSounds(sfxinfo_t *sounds, int num_sounds)
 int mus2midi_convert(const uint8_t *mus, uint32_t mus_len,
                      uint8_t **out_midi, uint32_t *out_len);
 
+/* OPL core for music: 0 = Nuked-OPL3, 1 = opl_fast (MIDIOPL_CORE_*).
+ * Set from the "opl_core" key in the extra config file.*/
+int opl_core = MIDIOPL_CORE_NUKED;
+
+/* Music ring lookahead, and whether an AP synthesises music (SMP only).
+ * See the ring buffer notes below.*/
+int snd_music_lookahead_ms = 200;
+int snd_music_offload      = 1;
+
+void I_BindSoundVariables(void)
+{
+    M_BindVariable("opl_core",               &opl_core);
+    M_BindVariable("snd_music_lookahead_ms", &snd_music_lookahead_ms);
+    M_BindVariable("snd_music_offload",      &snd_music_offload);
+}
+
+extern uint64_t get_cpu_freq(void);
+
+static inline uint64_t cup_rdtsc(void)
+{
+    uint32_t lo, hi;
+    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
 static int      s_music_inited = 0;
 static uint8_t *s_midi_buf     = 0;
 static uint32_t s_midi_len     = 0;
@@ -512,33 +526,69 @@ static void smf_advance(uint32_t pull_us)
  * as music chopping under load. SFX was unaffected because SFX is just
  * a memcpy.
  *
- * Producer: cup_music_pump() runs on the main thread (called from
- * DG_GetTicksMs / DG_SleepMs in doomgeneric_cupidos.c). It synthesises
- * one MUS_BUF_FRAMES chunk into the ring whenever there's room, until
- * the ring is full.
+ * Producer: on SMP a kernel thread pinned to the last AP ("doommusic")
+ * keeps the ring topped up, so synthesis no longer competes with the
+ * renderer at all. On UP, or with snd_music_offload = 0 / the
+ * -nomusicoffload parameter, cup_music_pump() does the same job on the
+ * main thread (called from DG_GetTicksMs / DG_SleepMs in
+ * doomgeneric_cupidos.c).
  *
  * Consumer: music_pull (the AC97 stream callback) runs in IRQ context
- * and just memcpy's the next chunk out of the ring. No OPL render in
- * IRQ. If the ring is empty (cold start, or producer fell behind) we
- * emit silence for that chunk: a much better failure mode than
- * stalling the AC97 DMA and chopping ALL audio.
+ * and just copies the next frames out of the ring. No OPL render in
+ * IRQ. If the ring runs short (cold start, or producer fell behind) we
+ * pad with silence and count an underrun: a much better failure mode
+ * than stalling the AC97 DMA and chopping ALL audio.
  *
- * Ring sizing: 8 buffers x 512 frames = 4096 frames = ~186 ms of
- * headroom. That comfortably absorbs a frame's worth of CPU spike on
- * QEMU + emulated host. Memory cost: 4096 x 4 = 16 KB.
+ * The ring is single-producer / single-consumer on two monotonic frame
+ * counters, so neither side takes a lock. The producer fills at most
+ * s_mus_cap frames ahead: snd_music_lookahead_ms (default 200 ms),
+ * rounded up to whole MUS_BUF_FRAMES buffers and capped by the
+ * physical ring (~740 ms).
+ *
+ * SMF cursors and the OPL synth are touched by the producer and by
+ * the DOOM-side control calls (register / play / volume), so those
+ * share s_music_lock. The producer takes it per buffer, which bounds
+ * how long a control call can wait to one buffer's render time.
  *
  * The producer also uses a 64-frame sub-chunk inside each buffer so
  * MIDI events fire at the right sample position instead of all
  * collapsing to t=0 of a 23 ms buffer; that's what makes short notes
  * (drum hits, hi-hat, staccato) crisp.*/
 #define MUS_BUF_FRAMES   512u
-#define MUS_RING_BUFS    8u
-#define MUS_RING_FRAMES  (MUS_RING_BUFS * MUS_BUF_FRAMES)
+#define MUS_RING_FRAMES  16384u   /* power of two: index = counter & mask */
+#define MUS_PREFILL_BUFS 2u
 #define MUSIC_SUBCHUNK   64u
 
-static int16_t           s_mus_ring[MUS_RING_FRAMES * 2u];
-static volatile uint32_t s_mus_w;   /* monotonic frame write counter */
-static volatile uint32_t s_mus_r;   /* monotonic frame read  counter */
+static int16_t  s_mus_ring[MUS_RING_FRAMES * 2u];
+static uint32_t s_mus_w;     /* monotonic frame write counter (producer) */
+static uint32_t s_mus_r;     /* monotonic frame read  counter (consumer) */
+static uint32_t s_mus_cap = 8u * MUS_BUF_FRAMES;
+static uint32_t s_music_lock;
+
+/* Counters for doomstat. Written by one side each, read racily. */
+static uint32_t s_mus_underruns;       /* pulls that came up short */
+static uint32_t s_mus_silent_frames;   /* frames padded with silence */
+static uint32_t s_mus_glitches;        /* underrun episodes (audible gaps) */
+static uint32_t s_mus_starved;         /* last pull came up short */
+static uint32_t s_mus_buffers;         /* buffers synthesised */
+static uint64_t s_mus_render_cyc;      /* total cycles in render_one_buffer */
+static uint32_t s_mus_render_max_cyc;
+
+/* Offload thread */
+static volatile uint32_t s_mus_thread_pid;
+static volatile int      s_mus_thread_cpu = -1;
+static volatile uint8_t  s_mus_thread_stop;
+
+static void music_lock(void)
+{
+    while (__atomic_exchange_n(&s_music_lock, 1u, __ATOMIC_ACQUIRE))
+        __asm__ volatile("pause");
+}
+
+static void music_unlock(void)
+{
+    __atomic_store_n(&s_music_lock, 0u, __ATOMIC_RELEASE);
+}
 
 /* Render one MUS_BUF_FRAMES chunk through the SMF -> OPL pipeline,
  * sub-chunked so event timing is precise. Writes to `dst` (interleaved
@@ -565,65 +615,201 @@ static void render_one_buffer(int16_t *dst)
     }
 }
 
-/* Producer: runs on main thread. Idempotent: when the ring is full it
- * returns immediately. When the consumer (mixer slot 8) is stopped,
- * the ring fills once and stays full, which naturally throttles SMF
- * playback to a halt; no explicit pause flag needed.*/
-void cup_music_pump(void)
+/* Synthesise up to max_bufs buffers into the ring, stopping when the
+ * lookahead is full. Caller holds s_music_lock. Returns buffers made.
+ * When the consumer (mixer slot 8) is stopped the ring fills once and
+ * stays full, which naturally throttles SMF playback to a halt; no
+ * explicit pause flag needed.*/
+static uint32_t music_fill_locked(uint32_t max_bufs)
 {
-    if (!s_music_inited) return;
-    for (;;) {
-        uint32_t r = s_mus_r;
+    uint32_t made = 0u;
+    while (made < max_bufs) {
         uint32_t w = s_mus_w;
-        uint32_t used = w - r;
-        if (used + MUS_BUF_FRAMES > MUS_RING_FRAMES) return;   /* ring full */
-        uint32_t base = (w % MUS_RING_FRAMES) * 2u;
-        render_one_buffer(&s_mus_ring[base]);
-        /* x86 has strong store ordering; a compiler barrier is enough
-         * to ensure the ring writes are visible before s_mus_w bumps.*/
-        __asm__ volatile("" ::: "memory");
-        s_mus_w = w + MUS_BUF_FRAMES;
+        uint32_t r = __atomic_load_n(&s_mus_r, __ATOMIC_ACQUIRE);
+        if ((w - r) + MUS_BUF_FRAMES > s_mus_cap) break;   /* ring full */
+        uint64_t t0 = cup_rdtsc();
+        render_one_buffer(&s_mus_ring[(w & (MUS_RING_FRAMES - 1u)) * 2u]);
+        uint32_t cyc = (uint32_t)(cup_rdtsc() - t0);
+        s_mus_render_cyc += cyc;
+        if (cyc > s_mus_render_max_cyc) s_mus_render_max_cyc = cyc;
+        s_mus_buffers++;
+        /* Publish the samples before the counter that exposes them. */
+        __atomic_store_n(&s_mus_w, w + MUS_BUF_FRAMES, __ATOMIC_RELEASE);
+        made++;
     }
+    return made;
 }
 
-/* Consumer: runs in AC97 IRQ context. Pure memcpy from ring; no
- * synthesis, no allocation, bounded fast path. If the producer fell
- * behind, output silence for this chunk; the consumer never blocks
- * the DMA engine waiting for samples.*/
+/* Main-thread producer. A no-op while the offload thread owns the
+ * ring.*/
+void cup_music_pump(void)
+{
+    if (!s_music_inited || s_mus_thread_pid) return;
+    music_lock();
+    (void)music_fill_locked(0xFFFFFFFFu);
+    music_unlock();
+}
+
+/* Offload producer: one buffer per lock hold so control calls get in
+ * between. With the lookahead full it yields, then halts until the
+ * next timer tick (10 ms, well inside the lookahead).*/
+static void music_thread(void)
+{
+    while (!s_mus_thread_stop) {
+        music_lock();
+        uint32_t made = music_fill_locked(1u);
+        music_unlock();
+        if (made == 0u) {
+            process_yield();
+            __asm__ volatile("sti; hlt");
+        }
+    }
+    s_mus_thread_cpu = -1;
+    __atomic_store_n(&s_mus_thread_pid, 0u, __ATOMIC_RELEASE);
+}
+
+static void music_offload_start(void)
+{
+    if (s_mus_thread_pid || !snd_music_offload) return;
+    if (M_CheckParm("-nomusicoffload") > 0) return;
+    int cpu = smp_cpu_count() - 1;
+    while (cpu > 0 && !cpus[cpu].online) cpu--;
+    if (cpu <= 0) return;   /* UP: the main thread keeps pumping */
+
+    s_mus_thread_stop = 0u;
+    /* Pin before the scheduler can see the thread: both need the BKL. */
+    bkl_lock();
+    uint32_t pid = process_create(music_thread, "doommusic", DEFAULT_STACK_SIZE);
+    if (pid && process_set_affinity(pid, cpu) == 0) {
+        s_mus_thread_cpu = cpu;
+        s_mus_thread_pid = pid;
+    }
+    bkl_unlock();
+    if (s_mus_thread_pid) {
+        serial_printf("[i_music] synthesis offloaded to cpu%d (pid %u)\n",
+                      cpu, pid);
+    } else if (pid) {
+        s_mus_thread_stop = 1u;
+    }
+}
+
+static void music_offload_stop(void)
+{
+    if (!s_mus_thread_pid) return;
+    s_mus_thread_stop = 1u;
+    /* The thread notices within one buffer or one timer tick. */
+    uint64_t give_up = cup_rdtsc() + get_cpu_freq() / 4u;
+    while (__atomic_load_n(&s_mus_thread_pid, __ATOMIC_ACQUIRE)
+           && cup_rdtsc() < give_up) {
+        __asm__ volatile("pause");
+    }
+}
+
+/* Consumer: runs in AC97 IRQ context. Pure copy from ring; no
+ * synthesis, no allocation, bounded fast path. Whatever the producer
+ * has not supplied yet is padded with silence; the consumer never
+ * blocks the DMA engine waiting for samples.*/
 static void music_pull(int16_t *out, uint32_t frames, void *ctx)
 {
     (void)ctx;
     uint32_t r = s_mus_r;
-    uint32_t w = s_mus_w;
-    uint32_t avail = w - r;
-    if (avail < frames) {
-        /* Underrun: emit silence and wait for producer to catch up. */
-        for (uint32_t i = 0; i < frames * 2u; i++) out[i] = 0;
-        return;
-    }
+    uint32_t w = __atomic_load_n(&s_mus_w, __ATOMIC_ACQUIRE);
+    uint32_t n = w - r;
+    if (n > frames) n = frames;
+
     /* Two-segment copy in case the read window straddles ring wrap. */
-    uint32_t r_idx  = r % MUS_RING_FRAMES;
+    uint32_t r_idx  = r & (MUS_RING_FRAMES - 1u);
     uint32_t first  = MUS_RING_FRAMES - r_idx;
-    if (first > frames) first = frames;
+    if (first > n) first = n;
     for (uint32_t f = 0; f < first; f++) {
         out[f * 2u + 0u] = s_mus_ring[(r_idx + f) * 2u + 0u];
         out[f * 2u + 1u] = s_mus_ring[(r_idx + f) * 2u + 1u];
     }
-    for (uint32_t f = first; f < frames; f++) {
+    for (uint32_t f = first; f < n; f++) {
         uint32_t k = f - first;
         out[f * 2u + 0u] = s_mus_ring[k * 2u + 0u];
         out[f * 2u + 1u] = s_mus_ring[k * 2u + 1u];
     }
-    s_mus_r = r + frames;
+    for (uint32_t f = n; f < frames; f++) {
+        out[f * 2u + 0u] = 0;
+        out[f * 2u + 1u] = 0;
+    }
+
+    if (n < frames) {
+        if (!s_mus_starved) s_mus_glitches++;
+        s_mus_underruns++;
+        s_mus_silent_frames += frames - n;
+        s_mus_starved = 1u;
+    } else {
+        s_mus_starved = 0u;
+    }
+    /* Hand the slots back only after the copy has read them. */
+    __atomic_store_n(&s_mus_r, r + n, __ATOMIC_RELEASE);
 }
 
+/* Slot 8 keeps pulling through its stop fade; the ring may only be
+ * reset once the mixer has let go of music_pull. Bounded so a stalled
+ * AC97 stream (which pulls nothing) cannot hang PlaySong.*/
+static void music_consumer_quiesce(void)
+{
+    if (!mixer_active(8)) return;
+    mixer_stop(8);
+    uint64_t give_up = cup_rdtsc() + get_cpu_freq() / 4u;
+    while (mixer_active(8) && cup_rdtsc() < give_up) {
+        __asm__ volatile("pause");
+    }
+}
+
+/* Caller holds s_music_lock, so the producer is between buffers, and
+ * has run music_consumer_quiesce(), so the IRQ is not reading. */
 static void mus_ring_reset(void)
 {
-    s_mus_w = 0u;
-    s_mus_r = 0u;
+    __atomic_store_n(&s_mus_w, 0u, __ATOMIC_RELEASE);
+    __atomic_store_n(&s_mus_r, 0u, __ATOMIC_RELEASE);
+    s_mus_starved = 0u;
     for (uint32_t i = 0; i < MUS_RING_FRAMES * 2u; i++) s_mus_ring[i] = 0;
 }
 
+static void mus_set_lookahead(int ms)
+{
+    if (ms < 1) ms = 1;
+    uint32_t frames = ((uint32_t)ms * 22050u + 999u) / 1000u;
+    uint32_t bufs   = (frames + MUS_BUF_FRAMES - 1u) / MUS_BUF_FRAMES;
+    if (bufs < 2u) bufs = 2u;
+    if (bufs > MUS_RING_FRAMES / MUS_BUF_FRAMES)
+        bufs = MUS_RING_FRAMES / MUS_BUF_FRAMES;
+    s_mus_cap = bufs * MUS_BUF_FRAMES;
+}
+
+void cup_music_stats(doom_perf_stats_t *st)
+{
+    uint64_t hz = get_cpu_freq();
+    uint32_t fill = __atomic_load_n(&s_mus_w, __ATOMIC_ACQUIRE)
+                  - __atomic_load_n(&s_mus_r, __ATOMIC_ACQUIRE);
+
+    st->music_cpu        = s_mus_thread_pid ? s_mus_thread_cpu : -1;
+    st->lookahead_ms     = (s_mus_cap * 1000u) / 22050u;
+    st->ring_fill_ms     = (fill * 1000u) / 22050u;
+    st->underruns        = s_mus_underruns;
+    st->silent_frames    = s_mus_silent_frames;
+    st->glitches         = s_mus_glitches;
+    st->music_buffers    = s_mus_buffers;
+    st->render_avg_us    = (hz && s_mus_buffers)
+        ? (uint32_t)((s_mus_render_cyc * 1000000u) / hz / s_mus_buffers) : 0u;
+    st->render_max_us    = hz
+        ? (uint32_t)(((uint64_t)s_mus_render_max_cyc * 1000000u) / hz) : 0u;
+}
+
+void cup_music_stats_reset(void)
+{
+    s_mus_underruns      = 0u;
+    s_mus_silent_frames  = 0u;
+    s_mus_glitches       = 0u;
+    s_mus_buffers        = 0u;
+    s_mus_render_cyc     = 0u;
+    s_mus_render_max_cyc = 0u;
+}
+
 /* Lazy GENMIDI loader: called on first I_InitMusic */
 static int load_genmidi_from_wad(void)
 {
@@ -635,15 +821,24 @@ static int load_genmidi_from_wad(void)
     int len = W_LumpLength((unsigned int)gn);
     uint8_t *gm = (uint8_t *)W_CacheLumpNum(gn, 1); /* PU_STATIC = 1 */
     if (!gm || len <= 0) { return -1; }
+    midiopl_set_core(opl_core);
     midiopl_init(gm, (uint32_t)len);
     return 0;
 }
 
 /* music_module_t implementations */
+/* GENMIDI is loaded: size the ring and start the producer. */
+static void music_ready(void)
+{
+    s_music_inited = 1;
+    mus_set_lookahead(snd_music_lookahead_ms);
+    music_offload_start();
+}
+
 static boolean cup_music_init(void)
 {
     if (load_genmidi_from_wad() == 0) {
-        s_music_inited = 1;
+        music_ready();
         serial_write_string("[i_music] init: GENMIDI loaded\n");
         return true;
     }
@@ -651,14 +846,20 @@ static boolean cup_music_init(void)
     return false;
 }
 
-static void cup_music_shutdown(void) { mixer_stop(8); }
+static void cup_music_shutdown(void)
+{
+    mixer_stop(8);
+    music_offload_stop();
+}
 
 static void cup_music_set_volume(int volume)
 {
     /* DOOM passes 0..127 per music_module_t comment; clamp defensively */
     if (volume < 0)   { volume = 0; }
     if (volume > 127) { volume = 127; }
+    music_lock();
     midiopl_set_volume((uint8_t)volume);
+    music_unlock();
 }
 
 static void cup_music_pause(void)   { mixer_stop(8); }
@@ -668,12 +869,22 @@ static void cup_music_resume(void)
     mixer_play_stream(8, music_pull, 0, 100, 100);
 }
 
+static void *music_register_locked(void *data, int len);
+
 static void *cup_music_register(void *data, int len)
 {
     if (!s_music_inited) {
         if (load_genmidi_from_wad() != 0) { return 0; }
-        s_music_inited = 1;
+        music_ready();
     }
+    music_lock();
+    void *song = music_register_locked(data, len);
+    music_unlock();
+    return song;
+}
+
+static void *music_register_locked(void *data, int len)
+{
     if (s_midi_buf) {
         kfree(s_midi_buf);
         s_midi_buf = 0;
@@ -718,26 +929,32 @@ static void *cup_music_register(void *data, int len)
 static void cup_music_unregister(void *handle)
 {
     (void)handle;
+    mixer_stop(8);
+    music_lock();
     if (s_midi_buf) {
         kfree(s_midi_buf);
         s_midi_buf = 0;
         s_midi_len = 0;
     }
-    mixer_stop(8);
+    music_unlock();
 }
 
 static void cup_music_play(void *handle, boolean looping)
 {
     (void)handle;
+    music_consumer_quiesce();
+    music_lock();
     s_music_loop = looping ? 1 : 0;
     smf_reset();
     /* Reset the producer/consumer ring and prefill it before arming the
      * AC97 stream callback. Without prefill the very first IRQ would
      * underrun (producer hasn't run yet) and we'd hear ~23 ms of
-     * silence before music starts. cup_music_pump runs synthesis until
-     * the ring is full or the song ends.*/
+     * silence before music starts. Without the offload thread we fill
+     * the whole lookahead here; with it, two buffers cover the first
+     * IRQ and the thread does the rest.*/
     mus_ring_reset();
-    cup_music_pump();
+    (void)music_fill_locked(s_mus_thread_pid ? MUS_PREFILL_BUFS : 0xFFFFFFFFu);
+    music_unlock();
     mixer_play_stream(8, music_pull, 0, 100, 100);
 }
 
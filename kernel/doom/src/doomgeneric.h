@@ -42,6 +42,12 @@ uint32_t DG_GetTicksMs();
 int DG_GetKey(int* pressed, unsigned char* key);
 void DG_SetWindowTitle(const char * title);
 
+//Multi-core drawing: how many CPUs may draw strips of the frame (at most
+//`want`, 0 = all online), and run fn(0..count-1) one strip per CPU,
+//returning once every strip is done. Return 1 to keep a single CPU.
+int DG_StripCPUs(int want);
+void DG_RunStrips(int count, void (*fn)(int strip, void *ctx), void *ctx);
+
 #ifdef __cplusplus
 }
 #endif
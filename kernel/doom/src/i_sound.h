@@ -247,6 +247,9 @@ extern music_module_t music_opl_module;
 // For OPL module:
 
 extern int opl_io_port;
+extern int opl_core;
+extern int snd_music_lookahead_ms;
+extern int snd_music_offload;
 
 // For native music module:
 
@@ -28,6 +28,7 @@ rcsid[] = "$Id: i_x.c,v 1.6 1997/02/03 22:45:10 b1 Exp $";
 #include "config.h"
 #include "v_video.h"
 #include "m_argv.h"
+#include "m_config.h"
 #include "d_event.h"
 #include "d_main.h"
 #include "i_video.h"
@@ -76,6 +77,12 @@ static struct FB_ScreenInfo s_Fb;
 int fb_scaling = 1;
 int usemouse = 0;
 
+// CPUs to draw the frame on (0 = every online CPU), and how many
+// I_InitGraphics actually got from the platform.
+
+int render_cpus = 0;
+int render_strips = 1;
+
 
 #ifdef CMAP256
 
@@ -286,6 +293,20 @@ void I_InitGraphics (void)
     }
 
 
+    //!
+    // @arg <n>
+    //
+    // Draw each frame on at most n CPUs, one vertical strip each
+    // (0 = all online CPUs, 1 = single-threaded).
+    //
+
+    i = M_CheckParmWithArgs("-rendercpus", 1);
+    if (i > 0) {
+        render_cpus = atoi(myargv[i + 1]);
+    }
+    render_strips = DG_StripCPUs(render_cpus);
+    printf("I_InitGraphics: drawing on %d CPU(s)\n", render_strips);
+
     /* Allocate screen to draw to */
 	I_VideoBuffer = (byte*)Z_Malloc (SCREENWIDTH * SCREENHEIGHT, PU_STATIC, NULL);  // For DOOM to draw on
 
@@ -318,24 +339,33 @@ void I_UpdateNoBlit (void)
 // I_FinishUpdate
 //
 
-void I_FinishUpdate (void)
+//
+// Copies source columns [x1, x2) of I_VideoBuffer into DG_ScreenBuffer,
+// scaled by fb_scaling. Strips touch disjoint pixels, so with
+// render_strips > 1 every CPU converts its own.
+//
+
+static void I_FinishStrip (int strip, void *unused)
 {
     int y;
-    int x_offset, y_offset, x_offset_end;
+    int x1, x2;
+    int bpp;
+    int pitch;
+    int x_offset;
     unsigned char *line_in, *line_out;
 
+    x1 = SCREENWIDTH * strip / render_strips;
+    x2 = SCREENWIDTH * (strip + 1) / render_strips;
+
     /* Offsets in case FB is bigger than DOOM */
-    /* 600 = s_Fb heigt, 200 screenheight */
-    /* 600 = s_Fb heigt, 200 screenheight */
-    /* 2048 =s_Fb width, 320 screenwidth */
-    y_offset     = (((s_Fb.yres - (SCREENHEIGHT * fb_scaling)) * s_Fb.bits_per_pixel/8)) / 2;
-    x_offset     = (((s_Fb.xres - (SCREENWIDTH  * fb_scaling)) * s_Fb.bits_per_pixel/8)) / 2; // XXX: siglent FB hack: /4 instead of /2, since it seems to handle the resolution in a funny way
-    //x_offset     = 0;
-    x_offset_end = ((s_Fb.xres - (SCREENWIDTH  * fb_scaling)) * s_Fb.bits_per_pixel/8) - x_offset;
+    bpp          = s_Fb.bits_per_pixel/8;
+    pitch        = s_Fb.xres * bpp;
+    x_offset     = (((s_Fb.xres - (SCREENWIDTH  * fb_scaling)) * bpp)) / 2; // XXX: siglent FB hack: /4 instead of /2, since it seems to handle the resolution in a funny way
 
     /* DRAW SCREEN */
-    line_in  = (unsigned char *) I_VideoBuffer;
-    line_out = (unsigned char *) DG_ScreenBuffer;
+    line_in  = (unsigned char *) I_VideoBuffer + x1;
+    line_out = (unsigned char *) DG_ScreenBuffer + x_offset
+             + x1 * fb_scaling * bpp;
 
     y = SCREENHEIGHT;
 
@@ -343,14 +373,13 @@ void I_FinishUpdate (void)
     {
         int i;
         for (i = 0; i < fb_scaling; i++) {
-            line_out += x_offset;
 #ifdef CMAP256
             if (fb_scaling == 1) {
-                memcpy(line_out, line_in, SCREENWIDTH); /* fb_width is bigger than Doom SCREENWIDTH... */
+                memcpy(line_out, line_in, x2 - x1); /* fb_width is bigger than Doom SCREENWIDTH... */
             } else {
                 int j;
 
-                for (j = 0; j < SCREENWIDTH; j++) {
+                for (j = 0; j < x2 - x1; j++) {
                     int k;
                     for (k = 0; k < fb_scaling; k++) {
                         line_out[j * fb_scaling + k] = line_in[j];
@@ -358,14 +387,23 @@ void I_FinishUpdate (void)
                 }
             }
 #else
-            //cmap_to_rgb565((void*)line_out, (void*)line_in, SCREENWIDTH);
-            cmap_to_fb((void*)line_out, (void*)line_in, SCREENWIDTH);
+            //cmap_to_rgb565((void*)line_out, (void*)line_in, x2 - x1);
+            cmap_to_fb((void*)line_out, (void*)line_in, x2 - x1);
 #endif
-            line_out += (SCREENWIDTH * fb_scaling * (s_Fb.bits_per_pixel/8)) + x_offset_end;
+            line_out += pitch;
         }
         line_in += SCREENWIDTH;
     }
+}
+
+void I_FinishUpdate (void)
+{
+    if (render_strips > 1)
+        DG_RunStrips(render_strips, I_FinishStrip, NULL);
+    else
+        I_FinishStrip(0, NULL);
 
+    // Every strip is in DG_ScreenBuffer once DG_RunStrips returns.
 	DG_DrawFrame();
 }
 
@@ -484,6 +522,7 @@ void I_EnableLoadingDisk(void)
 
 void I_BindVideoVariables (void)
 {
+    M_BindVariable("render_cpus", &render_cpus);
 }
 
 void I_DisplayFPSDots (boolean dots_on)
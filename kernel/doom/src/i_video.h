@@ -162,6 +162,9 @@ extern int screen_bpp;
 extern int fullscreen;
 extern int aspect_ratio_correct;
 
+extern int render_cpus;
+extern int render_strips;
+
 extern int show_diskicon;
 extern int diskicon_readbytes;
 
@@ -748,6 +748,13 @@ static default_t extra_defaults_list[] =
 
     CONFIG_VARIABLE_INT(screen_bpp),
 
+    //!
+    // Number of CPUs that draw each frame, one vertical strip each.
+    // Zero uses every online CPU; 1 keeps drawing single-threaded.
+    //
+
+    CONFIG_VARIABLE_INT(render_cpus),
+
     //!
     // If this is non-zero, the mouse will be "grabbed" when running
     // in windowed mode so that it can be used as an input device.
@@ -818,6 +825,26 @@ static default_t extra_defaults_list[] =
 
     CONFIG_VARIABLE_INT_HEX(opl_io_port),
 
+    //!
+    // OPL3 emulator used for music: 0 = Nuked-OPL3 (cycle-accurate),
+    // 1 = table-driven core running at the output rate (cheaper).
+    //
+
+    CONFIG_VARIABLE_INT(opl_core),
+
+    //!
+    // How far ahead of playback music is synthesised, in milliseconds.
+    //
+
+    CONFIG_VARIABLE_INT(snd_music_lookahead_ms),
+
+    //!
+    // If non-zero and more than one CPU is online, music is synthesised
+    // by a thread pinned to the last CPU instead of the game thread.
+    //
+
+    CONFIG_VARIABLE_INT(snd_music_offload),
+
     //!
     // @game doom heretic strife
     //
@@ -32,6 +32,8 @@
 
 // Needs access to LFB (guess what).
 #include "v_video.h"
+#include "i_video.h"
+#include "doomgeneric.h"
 
 // State.
 #include "doomstat.h"
@@ -766,6 +768,298 @@ void R_DrawSpanLow (void)
     } while (count--);
 }
 
+//
+// Multi-core drawing.
+// With render_strips > 1, colfunc and spanfunc only queue what they
+//  would draw.  R_FlushDrawList then has every render CPU replay the
+//  whole queue, each clipped to its own vertical strip of the view.
+// Strips share no pixels and each sees its commands in the original
+//  order, so the frame is the one a single CPU would have drawn.
+// Fuzz columns only read the pixels above and below them, which are
+//  in the same strip.
+//
+#define DRAWLIST_SIZE		16384
+
+enum
+{
+    DL_COLUMN,
+    DL_FUZZ,
+    DL_TRANSLATED,
+    DL_SPAN
+};
+
+typedef struct
+{
+    byte		kind;
+    byte		fuzzpos;	// fuzz columns: fuzzpos at the top
+    short		x;		// column x, or span row
+    short		y1;		// column top, or span x1
+    short		y2;		// column bottom, or span x2
+    fixed_t		frac;		// texture position at y1 / x1
+    fixed_t		step;
+    byte*		source;
+    lighttable_t*	colormap;
+    byte*		translation;
+} drawcmd_t;
+
+static drawcmd_t*	drawlist;
+static int		drawcount;
+
+void R_InitDrawList (void)
+{
+    if (drawlist == NULL)
+    {
+	drawlist = Z_Malloc (DRAWLIST_SIZE * sizeof(*drawlist), PU_STATIC, NULL);
+	Z_SetPurgeHook (R_FlushDrawList);
+    }
+}
+
+static drawcmd_t* R_NewDrawCmd (int kind)
+{
+    drawcmd_t*	cmd;
+
+    if (drawcount == DRAWLIST_SIZE)
+	R_FlushDrawList ();
+
+    cmd = &drawlist[drawcount++];
+    cmd->kind = kind;
+    return cmd;
+}
+
+static void R_QueueColumnKind (int kind)
+{
+    drawcmd_t*	cmd;
+
+    if (dc_yh < dc_yl)
+	return;
+
+#ifdef RANGECHECK
+    if ((unsigned)(dc_x << detailshift) >= SCREENWIDTH
+	|| dc_yl < 0
+	|| dc_yh >= SCREENHEIGHT)
+	I_Error ("R_DrawColumn: %i to %i at %i", dc_yl, dc_yh, dc_x);
+#endif
+
+    cmd = R_NewDrawCmd (kind);
+    cmd->x = dc_x;
+    cmd->y1 = dc_yl;
+    cmd->y2 = dc_yh;
+    cmd->step = dc_iscale;
+    cmd->frac = dc_texturemid + (dc_yl-centery)*dc_iscale;
+    cmd->source = dc_source;
+    cmd->colormap = dc_colormap;
+    cmd->translation = dc_translation;
+}
+
+void R_QueueColumn (void)
+{
+    R_QueueColumnKind (DL_COLUMN);
+}
+
+void R_QueueTranslatedColumn (void)
+{
+    R_QueueColumnKind (DL_TRANSLATED);
+}
+
+void R_QueueFuzzColumn (void)
+{
+    int		count;
+
+    // Same border adjustment as R_DrawFuzzColumn.
+    if (!dc_yl)
+	dc_yl = 1;
+
+    if (dc_yh == viewheight-1)
+	dc_yh = viewheight - 2;
+
+    count = dc_yh - dc_yl;
+
+    if (count < 0)
+	return;
+
+    R_QueueColumnKind (DL_FUZZ);
+    drawlist[drawcount-1].fuzzpos = fuzzpos;
+
+    // Advance fuzzpos as if the column had been drawn.
+    fuzzpos = (fuzzpos + count + 1) % FUZZTABLE;
+}
+
+void R_QueueSpan (void)
+{
+    drawcmd_t*	cmd;
+
+#ifdef RANGECHECK
+    if (ds_x2 < ds_x1
+	|| ds_x1<0
+	|| (ds_x2 << detailshift)>=SCREENWIDTH
+	|| (unsigned)ds_y>SCREENHEIGHT)
+    {
+	I_Error( "R_DrawSpan: %i to %i at %i",
+		 ds_x1,ds_x2,ds_y);
+    }
+#endif
+
+    cmd = R_NewDrawCmd (DL_SPAN);
+    cmd->x = ds_y;
+    cmd->y1 = ds_x1;
+    cmd->y2 = ds_x2;
+
+    // Packed as in R_DrawSpan.
+    cmd->frac = ((ds_xfrac << 10) & 0xffff0000)
+              | ((ds_yfrac >> 6)  & 0x0000ffff);
+    cmd->step = ((ds_xstep << 10) & 0xffff0000)
+              | ((ds_ystep >> 6)  & 0x0000ffff);
+    cmd->source = ds_source;
+    cmd->colormap = ds_colormap;
+}
+
+//
+// Replays one queued column.  In low detail every texel is two
+//  pixels wide, the second one at dest[1].
+//
+static void R_ReplayColumn (drawcmd_t* cmd, int low)
+{
+    int			count;
+    byte*		dest;
+    byte*		source;
+    lighttable_t*	colormap;
+    byte*		translation;
+    fixed_t		frac;
+    fixed_t		fracstep;
+    int			fpos;
+    byte		pix;
+
+    dest = ylookup[cmd->y1] + columnofs[cmd->x << low];
+    count = cmd->y2 - cmd->y1;
+    frac = cmd->frac;
+    fracstep = cmd->step;
+    source = cmd->source;
+    colormap = cmd->colormap;
+
+    switch (cmd->kind)
+    {
+      case DL_COLUMN:
+	do
+	{
+	    pix = colormap[source[(frac>>FRACBITS)&127]];
+	    dest[0] = pix;
+	    if (low)
+		dest[1] = pix;
+	    dest += SCREENWIDTH;
+	    frac += fracstep;
+	} while (count--);
+	break;
+
+      case DL_TRANSLATED:
+	translation = cmd->translation;
+	do
+	{
+	    pix = colormap[translation[source[frac>>FRACBITS]]];
+	    dest[0] = pix;
+	    if (low)
+		dest[1] = pix;
+	    dest += SCREENWIDTH;
+	    frac += fracstep;
+	} while (count--);
+	break;
+
+      case DL_FUZZ:
+	fpos = cmd->fuzzpos;
+	do
+	{
+	    dest[0] = colormaps[6*256+dest[fuzzoffset[fpos]]];
+	    if (low)
+		dest[1] = colormaps[6*256+dest[1+fuzzoffset[fpos]]];
+	    if (++fpos == FUZZTABLE)
+		fpos = 0;
+	    dest += SCREENWIDTH;
+	} while (count--);
+	break;
+    }
+}
+
+//
+// Replays texels x1..x2 of a queued span.
+//
+static void R_ReplaySpan (drawcmd_t* cmd, int x1, int x2, int low)
+{
+    unsigned int position, step;
+    byte *dest;
+    byte *source;
+    lighttable_t *colormap;
+    int count;
+    int spot;
+    byte pix;
+
+    step = (unsigned int) cmd->step;
+    position = (unsigned int) cmd->frac
+             + (unsigned int) (x1 - cmd->y1) * step;
+    source = cmd->source;
+    colormap = cmd->colormap;
+
+    dest = ylookup[cmd->x] + columnofs[x1 << low];
+    count = x2 - x1;
+
+    do
+    {
+	spot = ((position >> 4) & 0x0fc0) | (position >> 26);
+	pix = colormap[source[spot]];
+	*dest++ = pix;
+	if (low)
+	    *dest++ = pix;
+	position += step;
+    } while (count--);
+}
+
+//
+// Draws every queued command that falls into one strip.  Strip edges
+//  are even pixel columns, so a low detail texel never straddles two.
+//
+static void R_DrawStrip (int strip, void *unused)
+{
+    drawcmd_t*	cmd;
+    drawcmd_t*	end;
+    int		low;
+    int		x1, x2;
+
+    low = detailshift;
+    x1 = ((scaledviewwidth * strip / render_strips) & ~1) >> low;
+    x2 = ((scaledviewwidth * (strip + 1) / render_strips) & ~1) >> low;
+
+    end = drawlist + drawcount;
+
+    for (cmd = drawlist; cmd < end; cmd++)
+    {
+	if (cmd->kind == DL_SPAN)
+	{
+	    int a = cmd->y1 > x1 ? cmd->y1 : x1;
+	    int b = cmd->y2 < x2 - 1 ? cmd->y2 : x2 - 1;
+
+	    if (a <= b)
+		R_ReplaySpan (cmd, a, b, low);
+	}
+	else if (cmd->x >= x1 && cmd->x < x2)
+	{
+	    R_ReplayColumn (cmd, low);
+	}
+    }
+}
+
+//
+// R_FlushDrawList
+// Draws everything queued so far, on all render CPUs, and returns
+//  once the view buffer holds all of it.
+//
+void R_FlushDrawList (void)
+{
+    if (drawcount == 0)
+	return;
+
+    DG_RunStrips (render_strips, R_DrawStrip, NULL);
+    drawcount = 0;
+}
+
+
 //
 // R_InitBuffer
 // Creats lookup tables that avoid
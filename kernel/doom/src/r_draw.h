@@ -81,6 +81,18 @@ void 	R_DrawSpan (void);
 void 	R_DrawSpanLow (void);
 
 
+// Multi-core drawing: queueing stand-ins for the functions above,
+//  used when render_strips > 1, and the flush that draws the queue
+//  one strip per CPU.
+void	R_QueueColumn (void);
+void	R_QueueFuzzColumn (void);
+void	R_QueueTranslatedColumn (void);
+void	R_QueueSpan (void);
+
+void	R_InitDrawList (void);
+void	R_FlushDrawList (void);
+
+
 void
 R_InitBuffer
 ( int		width,
@@ -695,7 +695,16 @@ void R_ExecuteSetViewSize (void)
     centeryfrac = centery<<FRACBITS;
     projection = centerxfrac;
 
-    if (!detailshift)
+    if (render_strips > 1)
+    {
+	// Queue, and draw per CPU strip in R_RenderPlayerView.
+	R_InitDrawList ();
+	colfunc = basecolfunc = R_QueueColumn;
+	fuzzcolfunc = R_QueueFuzzColumn;
+	transcolfunc = R_QueueTranslatedColumn;
+	spanfunc = R_QueueSpan;
+    }
+    else if (!detailshift)
     {
 	colfunc = basecolfunc = R_DrawColumn;
 	fuzzcolfunc = R_DrawFuzzColumn;
@@ -886,6 +895,10 @@ void R_RenderPlayerView (player_t* player)
     
     R_DrawMasked ();
 
+    // Draw whatever the strips still have queued; the view is
+    // complete before the status bar and menus go on top.
+    R_FlushDrawList ();
+
     // Check for new console commands.
     NetUpdate ();				
 }
@@ -174,6 +174,20 @@ void Z_Free (void* ptr)
 
 
 
+//
+// Z_SetPurgeHook
+// The hook runs before Z_Malloc purges a cached block, so that
+//  anything still holding PU_CACHE pointers (the multi-core
+//  renderer's draw list) can finish with them first.
+//
+static void (*purge_hook)(void) = NULL;
+
+void Z_SetPurgeHook (void (*hook)(void))
+{
+    purge_hook = hook;
+}
+
+
 //
 // Z_Malloc
 // You can pass a NULL user if the tag is < PU_PURGELEVEL.
@@ -234,6 +248,11 @@ Z_Malloc
             {
                 // free the rover block (adding the size to base)
 
+                if (purge_hook != NULL)
+                {
+                    purge_hook();
+                }
+
                 // the rover can be the base block
                 base = base->prev;
                 Z_Free ((byte *)rover+sizeof(memblock_t));
@@ -61,6 +61,7 @@ void    Z_ChangeTag2 (void *ptr, int tag, char *file, int line);
 void    Z_ChangeUser(void *ptr, void **user);
 int     Z_FreeMemory (void);
 unsigned int Z_ZoneSize(void);
+void    Z_SetPurgeHook (void (*hook)(void));
 
 //
 // This is used to get the local FILE:LINE info from CPP
@@ -36,6 +36,7 @@ typedef struct {
     homefs_node_t *root;
     bool           dirty;
     bool           seed_mode;
+    uint32_t       defer_depth;
 } homefs_t;
 
 typedef struct {
@@ -717,7 +718,8 @@ static int homefs_close(void *file_handle) {
     homefs_handle_t *h = (homefs_handle_t *)file_handle;
     int rc = VFS_OK;
     if (h) {
-        if (h->fs && h->fs->dirty && !h->fs->seed_mode) {
+        if (h->fs && h->fs->dirty && !h->fs->seed_mode &&
+            h->fs->defer_depth == 0) {
             rc = homefs_flush(h->fs);
         }
         kfree(h);
@@ -824,7 +826,7 @@ static int homefs_mkdir_op(void *fs_private, const char *path) {
     node->next = parent->children;
     parent->children = node;
     homefs_mark_dirty(fs);
-    return homefs_flush(fs);
+    return fs->defer_depth ? VFS_OK : homefs_flush(fs);
 }
 
 static int homefs_unlink_op(void *fs_private, const char *path) {
@@ -848,7 +850,7 @@ static int homefs_unlink_op(void *fs_private, const char *path) {
     if (node->data) kfree(node->data);
     kfree(node);
     homefs_mark_dirty(fs);
-    return homefs_flush(fs);
+    return fs->defer_depth ? VFS_OK : homefs_flush(fs);
 }
 
 static vfs_fs_ops_t homefs_ops = {
@@ -886,3 +888,15 @@ void homefs_seed_end(void) {
         g_homefs->seed_mode = false;
     }
 }
+
+void homefs_defer_begin(void) {
+    if (g_homefs) {
+        g_homefs->defer_depth++;
+    }
+}
+
+void homefs_defer_end(void) {
+    if (g_homefs && g_homefs->defer_depth > 0) {
+        g_homefs->defer_depth--;
+    }
+}
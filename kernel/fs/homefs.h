@@ -16,4 +16,10 @@ int homefs_sync(void);
 void homefs_seed_begin(void);
 void homefs_seed_end(void);
 
+/* Batch writes: while deferred, closing a written file leaves /home
+ * dirty instead of flushing it; the changes persist on the next
+ * homefs_sync() or ordinary flush. Calls nest.*/
+void homefs_defer_begin(void);
+void homefs_defer_end(void);
+
 #endif
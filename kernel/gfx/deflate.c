@@ -1,257 +1,753 @@
-/* deflate.c - RFC 1951 raw DEFLATE decoder.
+/* deflate.c - RFC 1951 DEFLATE decoder.
  *
- * Lifted from png.c. Hand-rolled bit reader + Huffman + inflate.
- * Static-block, fixed-block, and dynamic-block decoders all here.
+ * Table-driven inflate shared by the PNG decoder, WOFF and HTTP (raw,
+ * zlib and gzip framing). Codes are resolved through a 10-bit
+ * (literal/length) or 8-bit (distance) root table whose entries either
+ * decode the symbol outright or link to a second-level table for the
+ * longer codes. The hot loop runs on local copies of the bit buffer and
+ * refills it a 32-bit word at a time; it is entered only while enough
+ * input and output space remain that no single symbol can run out of
+ * either, so it needs no bounds checks of its own. Near the edges a
+ * careful per-symbol path takes over and, if a symbol or block header
+ * straddles the end of the input pushed so far, rewinds to its start
+ * so decoding can resume later.
 */
 
 #include "deflate.h"
+#include "memory.h"
+#include "string.h"
 
-typedef struct {
-    const uint8_t *src;
-    uint32_t       src_len;
-    uint32_t       src_pos;
+#define KD_WIN_SIZE     32768u              /* max back-reference */
+#define KD_OUT_SIZE     (2u * KD_WIN_SIZE)  /* history + fresh output */
+#define KD_IN_SIZE      16384u
+#define KD_MAX_MATCH    258u
+
+#define KD_LIT_BITS     10
+#define KD_DIST_BITS    8
+#define KD_LIT_ENTRIES  2048   /* root + worst-case second level */
+#define KD_DIST_ENTRIES 1024
+
+/* Table entry: bits 0-4 code length (root width for a link), bits 8-11
+ * extra bits (link: second-level width), bits 12-14 kind, bits 16-31
+ * literal / base value / link offset.*/
+#define KD_LIT  0u
+#define KD_BASE 1u
+#define KD_EOB  2u
+#define KD_LINK 3u
+#define KD_BAD  4u
+
+#define KD_E(val, kind, extra, len) \
+    (((uint32_t)(val) << 16) | ((uint32_t)(kind) << 12) | \
+     ((uint32_t)(extra) << 8) | (uint32_t)(len))
+#define KD_E_LEN(e)   ((int)((e) & 0x1Fu))
+#define KD_E_EXTRA(e) ((int)(((e) >> 8) & 0xFu))
+#define KD_E_KIND(e)  (((e) >> 12) & 0x7u)
+#define KD_E_VAL(e)   ((e) >> 16)
+
+/* kd_run results besides KDEFLATE_OK (stream finished) / KDEFLATE_ERR */
+#define KD_NEED_IN   1
+#define KD_NEED_OUT  2
+
+enum {
+    KD_ST_HEADER,
+    KD_ST_BLOCK,
+    KD_ST_STORED,
+    KD_ST_HUFF,
+    KD_ST_TRAILER,
+    KD_ST_DONE
+};
+
+struct kdeflate_stream {
+    const uint8_t *in;
+    uint32_t       in_len;
+    uint32_t       in_pos;
     uint32_t       bit_buf;
     int            bit_count;
-    uint8_t       *out;
-    uint32_t       out_len;
+
+    uint8_t       *out;        /* flat: caller buffer; else the window */
+    uint32_t       out_size;
     uint32_t       out_pos;
+    uint32_t       read_pos;   /* streaming: next byte to hand out */
+    int            flat;
+
+    int            state;
+    int            wrap;
+    int            last_block;
     int            err;
-} pi_state_t;
-
-typedef struct {
-    int16_t count[16];
-    int16_t symbol[288];
-} pi_huff_t;
-
-static int pi_get_bits(pi_state_t *s, int n) {
-    while (s->bit_count < n) {
-        if (s->src_pos >= s->src_len) {
-            s->err = KDEFLATE_ERR;
-            return 0;
-        }
-        s->bit_buf |= ((uint32_t)s->src[s->src_pos]) << (uint32_t)s->bit_count;
-        s->src_pos++;
-        s->bit_count += 8;
+    uint32_t       stored_left;
+
+    uint8_t       *in_buf;     /* streaming input queue */
+    uint32_t       lit[KD_LIT_ENTRIES];
+    uint32_t       dist[KD_DIST_ENTRIES];
+};
+
+/* RFC 1951 length and distance tables */
+static const uint16_t kd_length_base[29] = {
+    3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,
+    67,83,99,115,131,163,195,227,258
+};
+static const uint8_t kd_length_extra[29] = {
+    0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3,4,4,4,4,5,5,5,5,0
+};
+static const uint16_t kd_dist_base[30] = {
+    1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,
+    1025,1537,2049,3073,4097,6145,8193,12289,16385,24577
+};
+static const uint8_t kd_dist_extra[30] = {
+    0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13
+};
+static const uint8_t kd_clen_order[19] = {
+    16,17,18,0,8,7,9,6,10,5,11,4,12,3,13,2,14,1,15
+};
+
+/* table construction */
+
+enum { KD_TAB_LIT, KD_TAB_DIST, KD_TAB_CLEN };
+
+static uint32_t kd_entry(int tab, int sym, int len) {
+    if (tab == KD_TAB_CLEN) return KD_E(sym, KD_LIT, 0, len);
+    if (tab == KD_TAB_DIST) {
+        if (sym >= 30) return KD_E(0, KD_BAD, 0, len);
+        return KD_E(kd_dist_base[sym], KD_BASE, kd_dist_extra[sym], len);
     }
-    uint32_t mask = (n == 0) ? 0u : ((1u << (uint32_t)n) - 1u);
-    int v = (int)(s->bit_buf & mask);
-    s->bit_buf >>= (uint32_t)n;
-    s->bit_count -= n;
-    return v;
+    if (sym < 256)  return KD_E(sym, KD_LIT, 0, len);
+    if (sym == 256) return KD_E(0, KD_EOB, 0, len);
+    if (sym >= 286) return KD_E(0, KD_BAD, 0, len);
+    return KD_E(kd_length_base[sym - 257], KD_BASE,
+                kd_length_extra[sym - 257], len);
 }
 
-static int pi_build_huff(pi_huff_t *h, const uint8_t *lens, int n) {
+static uint32_t kd_reverse(uint32_t code, int len) {
+    uint32_t r = 0;
+    while (len-- > 0) {
+        r = (r << 1) | (code & 1u);
+        code >>= 1;
+    }
+    return r;
+}
+
+/* Build a two-level table for a canonical code. Incomplete codes are
+ * allowed (their holes decode as KD_BAD); oversubscribed ones are not.*/
+static int kd_build(uint32_t *t, int cap, int root, int tab,
+                    const uint8_t *lens, int n) {
+    int count[16], offs[16];
+    uint16_t sorted[288];
+    uint8_t sub_len[1 << KD_LIT_BITS];
+    uint32_t next_code[16];
     int i, len;
-    int16_t offs[16];
-    for (i = 0; i < 16; i++) h->count[i] = 0;
+    int root_size = 1 << root;
+
+    for (i = 0; i < 16; i++) count[i] = 0;
     for (i = 0; i < n; i++) {
         if (lens[i] > 15) return -1;
-        h->count[lens[i]]++;
+        count[lens[i]]++;
     }
-    if ((int)h->count[0] == n) return 0;
     int left = 1;
     for (len = 1; len <= 15; len++) {
         left <<= 1;
-        left -= (int)h->count[len];
+        left -= count[len];
         if (left < 0) return -1;
     }
     offs[1] = 0;
-    for (len = 1; len < 15; len++) {
-        offs[len + 1] = (int16_t)(offs[len] + h->count[len]);
+    for (len = 1; len < 15; len++) offs[len + 1] = offs[len] + count[len];
+    for (i = 0; i < n; i++)
+        if (lens[i]) sorted[offs[lens[i]]++] = (uint16_t)i;
+
+    next_code[1] = 0;
+    for (len = 2; len <= 15; len++)
+        next_code[len] = (next_code[len - 1] + (uint32_t)count[len - 1]) << 1;
+
+    for (i = 0; i < root_size; i++) {
+        t[i] = KD_E(0, KD_BAD, 0, 0);
+        sub_len[i] = 0;
     }
-    for (i = 0; i < n; i++) {
-        if (lens[i] != 0) {
-            h->symbol[offs[lens[i]]] = (int16_t)i;
-            offs[lens[i]]++;
+
+    /* first pass: widest code behind each root slot that needs a link */
+    uint32_t nc[16];
+    for (len = 1; len <= 15; len++) nc[len] = next_code[len];
+    int total = 0;
+    for (len = 1; len <= 15; len++) total += count[len];
+    for (i = 0; i < total; i++) {
+        int sym = sorted[i];
+        len = lens[sym];
+        uint32_t rev = kd_reverse(nc[len]++, len);
+        if (len > root) {
+            uint32_t slot = rev & (uint32_t)(root_size - 1);
+            if (sub_len[slot] < len) sub_len[slot] = (uint8_t)len;
         }
     }
-    return 0;
-}
 
-static int pi_decode_huff(pi_state_t *s, const pi_huff_t *h) {
-    int code = 0, first = 0, idx = 0;
-    int len, count;
-    for (len = 1; len <= 15; len++) {
-        code |= pi_get_bits(s, 1);
-        count = (int)h->count[len];
-        if (code - count < first) {
-            return (int)h->symbol[idx + (code - first)];
+    int next = root_size;
+    for (len = 1; len <= 15; len++) nc[len] = next_code[len];
+    for (i = 0; i < total; i++) {
+        int sym = sorted[i];
+        len = lens[sym];
+        uint32_t rev = kd_reverse(nc[len]++, len);
+        uint32_t e = kd_entry(tab, sym, len);
+        if (len <= root) {
+            uint32_t j;
+            for (j = rev; j < (uint32_t)root_size; j += 1u << len) t[j] = e;
+            continue;
+        }
+        uint32_t slot = rev & (uint32_t)(root_size - 1);
+        int sub_bits = sub_len[slot] - root;
+        if (KD_E_KIND(t[slot]) != KD_LINK) {
+            int k, size = 1 << sub_bits;
+            if (next + size > cap) return -1;
+            for (k = 0; k < size; k++) t[next + k] = KD_E(0, KD_BAD, 0, 0);
+            t[slot] = KD_E(next, KD_LINK, sub_bits, root);
+            next += size;
         }
-        idx += count;
-        first = (first + count) << 1;
-        code <<= 1;
+        uint32_t base = KD_E_VAL(t[slot]);
+        uint32_t j;
+        for (j = rev >> root; j < (1u << sub_bits); j += 1u << (len - root))
+            t[base + j] = e;
     }
-    s->err = KDEFLATE_ERR;
-    return -1;
+    return 0;
 }
 
-/* RFC 1951 length and distance tables */
-static const uint16_t pi_length_base[29] = {
-    3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,
-    67,83,99,115,131,163,195,227,258
-};
-static const uint8_t pi_length_extra[29] = {
-    0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3,4,4,4,4,5,5,5,5,0
-};
-static const uint16_t pi_dist_base[30] = {
-    1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,
-    1025,1537,2049,3073,4097,6145,8193,12289,16385,24577
-};
-static const uint8_t pi_dist_extra[30] = {
-    0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13
-};
-static const uint8_t pi_clen_order[19] = {
-    16,17,18,0,8,7,9,6,10,5,11,4,12,3,13,2,14,1,15
-};
-
-static void pi_build_fixed(pi_huff_t *llh, pi_huff_t *dh) {
+static void kd_build_fixed(kdeflate_stream_t *z) {
     uint8_t lens[288];
     int i;
     for (i = 0; i < 144; i++)   lens[i] = 8;
     for (i = 144; i < 256; i++) lens[i] = 9;
     for (i = 256; i < 280; i++) lens[i] = 7;
     for (i = 280; i < 288; i++) lens[i] = 8;
-    (void)pi_build_huff(llh, lens, 288);
+    (void)kd_build(z->lit, KD_LIT_ENTRIES, KD_LIT_BITS, KD_TAB_LIT, lens, 288);
     for (i = 0; i < 30; i++) lens[i] = 5;
-    (void)pi_build_huff(dh, lens, 30);
+    (void)kd_build(z->dist, KD_DIST_ENTRIES, KD_DIST_BITS, KD_TAB_DIST, lens, 30);
 }
 
-static int pi_inflate_stored(pi_state_t *s) {
-    s->bit_buf = 0;
-    s->bit_count = 0;
-    if (s->src_pos + 4 > s->src_len) { s->err = KDEFLATE_ERR; return -1; }
-    uint16_t len  = (uint16_t)(s->src[s->src_pos] |
-                               ((uint16_t)s->src[s->src_pos + 1] << 8));
-    uint16_t nlen = (uint16_t)(s->src[s->src_pos + 2] |
-                               ((uint16_t)s->src[s->src_pos + 3] << 8));
-    s->src_pos += 4;
-    if ((uint16_t)(len ^ 0xFFFF) != nlen) { s->err = KDEFLATE_ERR; return -1; }
-    if (s->src_pos + len > s->src_len)    { s->err = KDEFLATE_ERR; return -1; }
-    if (s->out_pos + len > s->out_len)    { s->err = KDEFLATE_ERR; return -1; }
-    uint32_t i;
-    for (i = 0; i < (uint32_t)len; i++) {
-        s->out[s->out_pos + i] = s->src[s->src_pos + i];
+/* careful bit reader (byte refills, never reads past in_len) */
+
+static int kd_need(kdeflate_stream_t *z, int n) {
+    while (z->bit_count < n) {
+        if (z->in_pos >= z->in_len) return 0;
+        z->bit_buf |= (uint32_t)z->in[z->in_pos++] << z->bit_count;
+        z->bit_count += 8;
     }
-    s->src_pos += (uint32_t)len;
-    s->out_pos += (uint32_t)len;
-    return 0;
+    return 1;
 }
 
-static int pi_inflate_block(pi_state_t *s,
-                            const pi_huff_t *llh, const pi_huff_t *dh) {
-    int sym;
-    while (1) {
-        sym = pi_decode_huff(s, llh);
-        if (s->err) return -1;
-        if (sym < 256) {
-            if (s->out_pos >= s->out_len) { s->err = KDEFLATE_ERR; return -1; }
-            s->out[s->out_pos++] = (uint8_t)sym;
-        } else if (sym == 256) {
-            return 0;
-        } else {
-            int lcode = sym - 257;
-            if (lcode >= 29) { s->err = KDEFLATE_ERR; return -1; }
-            int len = (int)pi_length_base[lcode] +
-                      pi_get_bits(s, (int)pi_length_extra[lcode]);
-            int dcode = pi_decode_huff(s, dh);
-            if (s->err) return -1;
-            if (dcode >= 30) { s->err = KDEFLATE_ERR; return -1; }
-            int dist = (int)pi_dist_base[dcode] +
-                       pi_get_bits(s, (int)pi_dist_extra[dcode]);
-            if (dist <= 0 || (uint32_t)dist > s->out_pos) {
-                s->err = KDEFLATE_ERR; return -1;
-            }
-            if (s->out_pos + (uint32_t)len > s->out_len) {
-                s->err = KDEFLATE_ERR; return -1;
-            }
-            uint32_t from = s->out_pos - (uint32_t)dist;
-            int j;
-            for (j = 0; j < len; j++) {
-                s->out[s->out_pos] = s->out[from + (uint32_t)j];
-                s->out_pos++;
-            }
-        }
-    }
+static uint32_t kd_bits(kdeflate_stream_t *z, int n) {
+    uint32_t v = z->bit_buf & ((1u << n) - 1u);
+    z->bit_buf >>= n;
+    z->bit_count -= n;
+    return v;
+}
+
+/* Drop to a byte boundary and hand whole buffered bytes back. */
+static void kd_align(kdeflate_stream_t *z) {
+    z->bit_count -= z->bit_count & 7;
+    z->in_pos -= (uint32_t)(z->bit_count >> 3);
+    z->bit_buf = 0;
+    z->bit_count = 0;
 }
 
-static int pi_inflate_dynamic(pi_state_t *s, pi_huff_t *llh, pi_huff_t *dh) {
-    int hlit  = pi_get_bits(s, 5) + 257;
-    int hdist = pi_get_bits(s, 5) + 1;
-    int hclen = pi_get_bits(s, 4) + 4;
-    if (s->err) return -1;
-    if (hlit > 286 || hdist > 30 || hclen > 19) {
-        s->err = KDEFLATE_ERR; return -1;
+/* Decode one symbol; 0 if the input ends inside it. */
+static uint32_t kd_sym(kdeflate_stream_t *z, const uint32_t *t, int root) {
+    (void)kd_need(z, 24);
+    uint32_t e = t[z->bit_buf & ((1u << root) - 1u)];
+    if (KD_E_KIND(e) == KD_LINK)
+        e = t[KD_E_VAL(e) + ((z->bit_buf >> root) &
+                             ((1u << KD_E_EXTRA(e)) - 1u))];
+    if (KD_E_KIND(e) == KD_BAD) {
+        /* garbage past the buffered bits may be what missed */
+        return z->bit_count >= 15 ? e : 0;
     }
-    uint8_t clen_lens[19];
+    if (KD_E_LEN(e) > z->bit_count) return 0;
+    z->bit_buf >>= KD_E_LEN(e);
+    z->bit_count -= KD_E_LEN(e);
+    return e;
+}
+
+static int kd_dynamic(kdeflate_stream_t *z) {
+    if (!kd_need(z, 14)) return KD_NEED_IN;
+    int hlit  = (int)kd_bits(z, 5) + 257;
+    int hdist = (int)kd_bits(z, 5) + 1;
+    int hclen = (int)kd_bits(z, 4) + 4;
+    if (hlit > 286 || hdist > 30) return KDEFLATE_ERR;
+
+    uint8_t lens[286 + 30];
     int i;
-    for (i = 0; i < 19; i++) clen_lens[i] = 0;
+    for (i = 0; i < 19; i++) lens[i] = 0;
     for (i = 0; i < hclen; i++) {
-        clen_lens[pi_clen_order[i]] = (uint8_t)pi_get_bits(s, 3);
-    }
-    if (s->err) return -1;
-    pi_huff_t clen_h;
-    if (pi_build_huff(&clen_h, clen_lens, 19) != 0) {
-        s->err = KDEFLATE_ERR; return -1;
+        if (!kd_need(z, 3)) return KD_NEED_IN;
+        lens[kd_clen_order[i]] = (uint8_t)kd_bits(z, 3);
     }
-    uint8_t lens[286 + 30];
-    for (i = 0; i < 286 + 30; i++) lens[i] = 0;
+    /* the distance table doubles as scratch for the code-length code */
+    if (kd_build(z->dist, KD_DIST_ENTRIES, 7, KD_TAB_CLEN, lens, 19) != 0)
+        return KDEFLATE_ERR;
+
     int n = hlit + hdist;
     int idx = 0;
     while (idx < n) {
-        int sym = pi_decode_huff(s, &clen_h);
-        if (s->err) return -1;
+        uint32_t e = kd_sym(z, z->dist, 7);
+        if (!e) return KD_NEED_IN;
+        if (KD_E_KIND(e) == KD_BAD) return KDEFLATE_ERR;
+        int sym = (int)KD_E_VAL(e);
         if (sym < 16) {
             lens[idx++] = (uint8_t)sym;
-        } else if (sym == 16) {
-            if (idx == 0) { s->err = KDEFLATE_ERR; return -1; }
-            int rep = pi_get_bits(s, 2) + 3;
-            uint8_t v = lens[idx - 1];
-            while (rep-- > 0 && idx < n) lens[idx++] = v;
+            continue;
+        }
+        int rep;
+        uint8_t v = 0;
+        if (sym == 16) {
+            if (idx == 0) return KDEFLATE_ERR;
+            if (!kd_need(z, 2)) return KD_NEED_IN;
+            rep = (int)kd_bits(z, 2) + 3;
+            v = lens[idx - 1];
         } else if (sym == 17) {
-            int rep = pi_get_bits(s, 3) + 3;
-            while (rep-- > 0 && idx < n) lens[idx++] = 0;
-        } else if (sym == 18) {
-            int rep = pi_get_bits(s, 7) + 11;
-            while (rep-- > 0 && idx < n) lens[idx++] = 0;
+            if (!kd_need(z, 3)) return KD_NEED_IN;
+            rep = (int)kd_bits(z, 3) + 3;
         } else {
-            s->err = KDEFLATE_ERR; return -1;
+            if (!kd_need(z, 7)) return KD_NEED_IN;
+            rep = (int)kd_bits(z, 7) + 11;
+        }
+        if (idx + rep > n) return KDEFLATE_ERR;
+        while (rep-- > 0) lens[idx++] = v;
+    }
+    if (lens[256] == 0) return KDEFLATE_ERR;
+    if (kd_build(z->lit, KD_LIT_ENTRIES, KD_LIT_BITS, KD_TAB_LIT,
+                 lens, hlit) != 0)
+        return KDEFLATE_ERR;
+    if (kd_build(z->dist, KD_DIST_ENTRIES, KD_DIST_BITS, KD_TAB_DIST,
+                 lens + hlit, hdist) != 0)
+        return KDEFLATE_ERR;
+    return KDEFLATE_OK;
+}
+
+/* Huffman block body */
+
+static uint32_t kd_load32(const uint8_t *p) {
+    uint32_t v;
+    __builtin_memcpy(&v, p, 4);
+    return v;
+}
+
+static void kd_copy_match(uint8_t *dst, uint32_t dist, uint32_t len) {
+    const uint8_t *src = dst - dist;
+    uint8_t *end = dst + len;
+    if (dist >= 4) {
+        /* may run up to 3 bytes past end; callers leave the slack */
+        do {
+            __builtin_memcpy(dst, src, 4);
+            dst += 4;
+            src += 4;
+        } while (dst < end);
+    } else if (dist == 1) {
+        memset(dst, *src, len);
+    } else {
+        while (dst < end) *dst++ = *src++;
+    }
+}
+
+/* Refill to >= 24 bits from a 32-bit load; bits past the count are the
+ * next byte's own low bits, so re-ORing them later is harmless.*/
+#define KD_REFILL()                                             \
+    do {                                                        \
+        buf |= kd_load32(in + ip) << cnt;                       \
+        ip += (uint32_t)(31 - cnt) >> 3;                        \
+        cnt |= 24;                                              \
+    } while (0)
+
+/* Decode symbols until end of block. Returns KDEFLATE_OK at the end of
+ * the block, KD_NEED_IN / KD_NEED_OUT to suspend, or KDEFLATE_ERR.*/
+static int kd_huff(kdeflate_stream_t *z) {
+    const uint32_t *lit = z->lit;
+    const uint32_t *dist = z->dist;
+    const uint32_t lit_mask = (1u << KD_LIT_BITS) - 1u;
+    const uint32_t dist_mask = (1u << KD_DIST_BITS) - 1u;
+    uint8_t *out = z->out;
+
+    for (;;) {
+        /* fast loop: >= 16 input bytes and a full match of output room */
+        if (z->in_pos + 16u <= z->in_len &&
+            z->out_pos + KD_MAX_MATCH + 4u <= z->out_size) {
+            const uint8_t *in = z->in;
+            uint32_t ip = z->in_pos;
+            uint32_t in_end = z->in_len - 16u;
+            uint32_t op = z->out_pos;
+            uint32_t out_end = z->out_size - KD_MAX_MATCH - 4u;
+            uint32_t buf = z->bit_buf;
+            int cnt = z->bit_count;
+            int rc = 1;
+
+            while (ip <= in_end && op <= out_end) {
+                KD_REFILL();
+                uint32_t e = lit[buf & lit_mask];
+                if (KD_E_KIND(e) == KD_LINK)
+                    e = lit[KD_E_VAL(e) + ((buf >> KD_LIT_BITS) &
+                                           ((1u << KD_E_EXTRA(e)) - 1u))];
+                buf >>= KD_E_LEN(e);
+                cnt -= KD_E_LEN(e);
+                uint32_t kind = KD_E_KIND(e);
+                if (kind == KD_LIT) {
+                    out[op++] = (uint8_t)KD_E_VAL(e);
+                    continue;
+                }
+                if (kind != KD_BASE) {
+                    rc = kind == KD_EOB ? KDEFLATE_OK : KDEFLATE_ERR;
+                    break;
+                }
+                int x = KD_E_EXTRA(e);
+                uint32_t len = KD_E_VAL(e) + (buf & ((1u << x) - 1u));
+                buf >>= x;
+                cnt -= x;
+
+                KD_REFILL();
+                e = dist[buf & dist_mask];
+                if (KD_E_KIND(e) == KD_LINK)
+                    e = dist[KD_E_VAL(e) + ((buf >> KD_DIST_BITS) &
+                                            ((1u << KD_E_EXTRA(e)) - 1u))];
+                if (KD_E_KIND(e) != KD_BASE) { rc = KDEFLATE_ERR; break; }
+                buf >>= KD_E_LEN(e);
+                cnt -= KD_E_LEN(e);
+                x = KD_E_EXTRA(e);
+                if (cnt < x) KD_REFILL();
+                uint32_t d = KD_E_VAL(e) + (buf & ((1u << x) - 1u));
+                buf >>= x;
+                cnt -= x;
+                if (d > op) { rc = KDEFLATE_ERR; break; }
+                kd_copy_match(out + op, d, len);
+                op += len;
+            }
+            z->in_pos = ip;
+            z->out_pos = op;
+            z->bit_buf = buf;
+            z->bit_count = cnt;
+            if (rc != 1) return rc;
+        }
+
+        /* careful path: one symbol, rewound if it does not fit */
+        uint32_t save_pos = z->in_pos, save_buf = z->bit_buf;
+        int save_cnt = z->bit_count;
+        uint32_t e = kd_sym(z, lit, KD_LIT_BITS);
+        if (!e) return KD_NEED_IN;
+        uint32_t kind = KD_E_KIND(e);
+        if (kind == KD_BAD) return KDEFLATE_ERR;
+        if (kind == KD_EOB) return KDEFLATE_OK;
+        if (kind == KD_LIT) {
+            if (z->out_pos >= z->out_size) {
+                z->in_pos = save_pos;
+                z->bit_buf = save_buf;
+                z->bit_count = save_cnt;
+                return z->flat ? KDEFLATE_ERR : KD_NEED_OUT;
+            }
+            out[z->out_pos++] = (uint8_t)KD_E_VAL(e);
+            continue;
+        }
+        int x = KD_E_EXTRA(e);
+        uint32_t len, d;
+        if (!kd_need(z, x)) goto rewind;
+        len = KD_E_VAL(e) + kd_bits(z, x);
+        e = kd_sym(z, dist, KD_DIST_BITS);
+        if (!e) goto rewind;
+        if (KD_E_KIND(e) != KD_BASE) return KDEFLATE_ERR;
+        x = KD_E_EXTRA(e);
+        if (!kd_need(z, x)) goto rewind;
+        d = KD_E_VAL(e) + kd_bits(z, x);
+        if (d > z->out_pos) return KDEFLATE_ERR;
+        if (z->out_pos + len > z->out_size) {
+            z->in_pos = save_pos;
+            z->bit_buf = save_buf;
+            z->bit_count = save_cnt;
+            return z->flat ? KDEFLATE_ERR : KD_NEED_OUT;
         }
+        {
+            uint8_t *p = out + z->out_pos;
+            uint32_t k;
+            for (k = 0; k < len; k++) p[k] = p[(int32_t)k - (int32_t)d];
+        }
+        z->out_pos += len;
+        continue;
+rewind:
+        z->in_pos = save_pos;
+        z->bit_buf = save_buf;
+        z->bit_count = save_cnt;
+        return KD_NEED_IN;
+    }
+}
+
+/* stream wrappers */
+
+/* RFC 1950 CMF/FLG: deflate, window <= 32K, check bits, no preset dict. */
+static int kd_zlib_ok(uint32_t cmf, uint32_t flg) {
+    return (cmf & 0x0Fu) == 8u && (cmf >> 4) <= 7u &&
+           ((cmf << 8) | flg) % 31u == 0u && !(flg & 0x20u);
+}
+
+/* Consume the zlib or gzip (RFC 1952) header, resolving
+ * KDEFLATE_WRAP_AUTO from the first two bytes. Nothing is consumed
+ * until the whole header is present.*/
+static int kd_header(kdeflate_stream_t *z) {
+    const uint8_t *p = z->in + z->in_pos;
+    uint32_t avail = z->in_len - z->in_pos;
+    uint32_t n = 10;
+
+    if (z->wrap == KDEFLATE_WRAP_RAW) return KDEFLATE_OK;
+    if (avail < 2u) return KD_NEED_IN;
+    if (z->wrap == KDEFLATE_WRAP_AUTO) {
+        if (p[0] == 0x1Fu && p[1] == 0x8Bu)
+            z->wrap = KDEFLATE_WRAP_GZIP;
+        else if (kd_zlib_ok(p[0], p[1]))
+            z->wrap = KDEFLATE_WRAP_ZLIB;
+        else
+            z->wrap = KDEFLATE_WRAP_RAW;   /* bare "deflate" from IIS & co */
     }
-    if (pi_build_huff(llh, lens, hlit) != 0) {
-        s->err = KDEFLATE_ERR; return -1;
+    if (z->wrap == KDEFLATE_WRAP_RAW) return KDEFLATE_OK;
+    if (z->wrap == KDEFLATE_WRAP_ZLIB) {
+        if (!kd_zlib_ok(p[0], p[1])) return KDEFLATE_ERR;
+        z->in_pos += 2;
+        return KDEFLATE_OK;
     }
-    if (pi_build_huff(dh, lens + hlit, hdist) != 0) {
-        s->err = KDEFLATE_ERR; return -1;
+
+    /* gzip: ID1 ID2 CM FLG MTIME(4) XFL OS [XLEN extra] [name\0]
+     * [comment\0] [HCRC16] */
+    if (avail < n) return KD_NEED_IN;
+    uint32_t flg = p[3];
+    if (p[0] != 0x1Fu || p[1] != 0x8Bu || p[2] != 8u || (flg & 0xE0u))
+        return KDEFLATE_ERR;
+    if (flg & 0x04u) {
+        if (avail < n + 2u) goto short_hdr;
+        n += 2u + ((uint32_t)p[n] | ((uint32_t)p[n + 1] << 8));
     }
-    return 0;
+    if (flg & 0x08u) {
+        while (n < avail && p[n]) n++;
+        n++;
+    }
+    if (flg & 0x10u) {
+        while (n < avail && p[n]) n++;
+        n++;
+    }
+    if (flg & 0x02u) n += 2u;
+    if (n > avail) goto short_hdr;
+    z->in_pos += n;
+    return KDEFLATE_OK;
+
+short_hdr:
+    /* a header that cannot fit the input queue would never complete */
+    if (!z->flat && avail >= KD_IN_SIZE) return KDEFLATE_ERR;
+    return KD_NEED_IN;
+}
+
+/* state machine */
+
+static int kd_run(kdeflate_stream_t *z) {
+    for (;;) {
+        switch (z->state) {
+        case KD_ST_HEADER: {
+            int rc = kd_header(z);
+            if (rc != KDEFLATE_OK) return rc;
+            z->state = KD_ST_BLOCK;
+            break;
+        }
+
+        case KD_ST_BLOCK: {
+            if (z->last_block) { z->state = KD_ST_TRAILER; break; }
+            uint32_t save_pos = z->in_pos, save_buf = z->bit_buf;
+            int save_cnt = z->bit_count;
+            if (!kd_need(z, 3)) return KD_NEED_IN;
+            int last = (int)kd_bits(z, 1);
+            uint32_t type = kd_bits(z, 2);
+            int rc = KDEFLATE_OK;
+            if (type == 0) {
+                kd_align(z);
+                if (z->in_pos + 4u > z->in_len) {
+                    rc = KD_NEED_IN;
+                } else {
+                    const uint8_t *p = z->in + z->in_pos;
+                    uint32_t len  = (uint32_t)p[0] | ((uint32_t)p[1] << 8);
+                    uint32_t nlen = (uint32_t)p[2] | ((uint32_t)p[3] << 8);
+                    if ((len ^ 0xFFFFu) != nlen) return KDEFLATE_ERR;
+                    z->in_pos += 4;
+                    z->stored_left = len;
+                    z->state = KD_ST_STORED;
+                }
+            } else if (type == 1) {
+                kd_build_fixed(z);
+                z->state = KD_ST_HUFF;
+            } else if (type == 2) {
+                rc = kd_dynamic(z);
+                if (rc == KDEFLATE_OK) z->state = KD_ST_HUFF;
+            } else {
+                return KDEFLATE_ERR;
+            }
+            if (rc == KD_NEED_IN) {
+                z->in_pos = save_pos;
+                z->bit_buf = save_buf;
+                z->bit_count = save_cnt;
+                return KD_NEED_IN;
+            }
+            if (rc != KDEFLATE_OK) return rc;
+            z->last_block = last;
+            break;
+        }
+
+        case KD_ST_STORED:
+            while (z->stored_left) {
+                uint32_t n = z->stored_left;
+                if (n > z->in_len - z->in_pos) n = z->in_len - z->in_pos;
+                if (n > z->out_size - z->out_pos) n = z->out_size - z->out_pos;
+                if (n == 0) {
+                    if (z->out_pos < z->out_size) return KD_NEED_IN;
+                    return z->flat ? KDEFLATE_ERR : KD_NEED_OUT;
+                }
+                memcpy(z->out + z->out_pos, z->in + z->in_pos, n);
+                z->in_pos += n;
+                z->out_pos += n;
+                z->stored_left -= n;
+            }
+            z->state = KD_ST_BLOCK;
+            break;
+
+        case KD_ST_HUFF: {
+            int rc = kd_huff(z);
+            if (rc != KDEFLATE_OK) return rc;
+            z->state = KD_ST_BLOCK;
+            break;
+        }
+
+        case KD_ST_TRAILER: {
+            /* Adler-32 / CRC-32 + ISIZE are skipped, and tolerated when
+             * missing */
+            uint32_t want = z->wrap == KDEFLATE_WRAP_ZLIB ? 4u :
+                            z->wrap == KDEFLATE_WRAP_GZIP ? 8u : 0u;
+            uint32_t n;
+            kd_align(z);
+            n = z->in_len - z->in_pos;
+            if (n < want && !z->flat) return KD_NEED_IN;
+            z->in_pos += n < want ? n : want;
+            z->state = KD_ST_DONE;
+            break;
+        }
+
+        default:
+            return KDEFLATE_OK;
+        }
+    }
+}
+
+/* one-shot API */
+
+static int kd_oneshot(int wrap, const uint8_t *src, uint32_t src_len,
+                      uint8_t *out, uint32_t out_len) {
+    if (!src || !out) return KDEFLATE_ERR;
+    kdeflate_stream_t *z = (kdeflate_stream_t *)kmalloc(sizeof(*z));
+    if (!z) return KDEFLATE_ERR;
+    memset(z, 0, sizeof(*z) - sizeof(z->lit) - sizeof(z->dist));
+    z->in = src;
+    z->in_len = src_len;
+    z->out = out;
+    z->out_size = out_len;
+    z->flat = 1;
+    z->wrap = wrap;
+    z->state = KD_ST_HEADER;
+    int rc = kd_run(z);
+    kfree(z);
+    return rc == KDEFLATE_OK ? KDEFLATE_OK : KDEFLATE_ERR;
 }
 
 int kdeflate_raw(const uint8_t *src, uint32_t src_len,
                  uint8_t *out, uint32_t out_len) {
-    pi_state_t s;
-    s.src = src; s.src_len = src_len; s.src_pos = 0;
-    s.bit_buf = 0; s.bit_count = 0;
-    s.out = out; s.out_len = out_len; s.out_pos = 0;
-    s.err = 0;
-
-    int bfinal, btype;
-    do {
-        bfinal = pi_get_bits(&s, 1);
-        btype  = pi_get_bits(&s, 2);
-        if (s.err) return s.err;
-        if (btype == 0) {
-            if (pi_inflate_stored(&s) != 0) return s.err;
-        } else if (btype == 1) {
-            pi_huff_t llh, dh;
-            pi_build_fixed(&llh, &dh);
-            if (pi_inflate_block(&s, &llh, &dh) != 0) return s.err;
-        } else if (btype == 2) {
-            pi_huff_t llh, dh;
-            if (pi_inflate_dynamic(&s, &llh, &dh) != 0) return s.err;
-            if (pi_inflate_block(&s, &llh, &dh) != 0) return s.err;
-        } else {
+    return kd_oneshot(KDEFLATE_WRAP_RAW, src, src_len, out, out_len);
+}
+
+int kdeflate_zlib(const uint8_t *src, uint32_t src_len,
+                  uint8_t *out, uint32_t out_len) {
+    return kd_oneshot(KDEFLATE_WRAP_ZLIB, src, src_len, out, out_len);
+}
+
+/* streaming API */
+
+/* Overlapping copy towards lower addresses (no memmove in the kernel):
+ * chunks no longer than the gap never overlap themselves.*/
+static void kd_move_down(uint8_t *dst, const uint8_t *src, uint32_t n) {
+    uint32_t gap = (uint32_t)(src - dst);
+    while (n) {
+        uint32_t c = n < gap ? n : gap;
+        memcpy(dst, src, c);
+        dst += c;
+        src += c;
+        n -= c;
+    }
+}
+
+kdeflate_stream_t *kdeflate_stream_new(int wrap) {
+    if (wrap < KDEFLATE_WRAP_RAW || wrap > KDEFLATE_WRAP_AUTO) return NULL;
+    kdeflate_stream_t *z = (kdeflate_stream_t *)kmalloc(sizeof(*z));
+    if (!z) return NULL;
+    memset(z, 0, sizeof(*z) - sizeof(z->lit) - sizeof(z->dist));
+    z->out = (uint8_t *)kmalloc(KD_OUT_SIZE);
+    z->in_buf = (uint8_t *)kmalloc(KD_IN_SIZE);
+    if (!z->out || !z->in_buf) {
+        if (z->out) kfree(z->out);
+        if (z->in_buf) kfree(z->in_buf);
+        kfree(z);
+        return NULL;
+    }
+    z->in = z->in_buf;
+    z->out_size = KD_OUT_SIZE;
+    z->wrap = wrap;
+    z->state = KD_ST_HEADER;
+    return z;
+}
+
+void kdeflate_stream_free(kdeflate_stream_t *z) {
+    if (!z) return;
+    kfree(z->out);
+    kfree(z->in_buf);
+    kfree(z);
+}
+
+int kdeflate_stream_push(kdeflate_stream_t *z, const uint8_t *in, uint32_t len) {
+    if (!z || (!in && len)) return KDEFLATE_ERR;
+    /* whole bytes still in the bit buffer may be handed back by
+     * kd_align, so they stay queued too */
+    uint32_t held = (uint32_t)(z->bit_count >> 3);
+    if (z->in_pos > held) {
+        uint32_t drop = z->in_pos - held;
+        kd_move_down(z->in_buf, z->in_buf + drop, z->in_len - drop);
+        z->in_len -= drop;
+        z->in_pos = held;
+    }
+    uint32_t n = KD_IN_SIZE - z->in_len;
+    if (n > len) n = len;
+    memcpy(z->in_buf + z->in_len, in, n);
+    z->in_len += n;
+    return (int)n;
+}
+
+int kdeflate_stream_pull(kdeflate_stream_t *z, uint8_t *out, uint32_t cap) {
+    if (!z || (!out && cap)) return KDEFLATE_ERR;
+    if (z->err) return KDEFLATE_ERR;
+    uint32_t done = 0;
+    while (done < cap) {
+        if (z->read_pos < z->out_pos) {
+            uint32_t n = z->out_pos - z->read_pos;
+            if (n > cap - done) n = cap - done;
+            memcpy(out + done, z->out + z->read_pos, n);
+            z->read_pos += n;
+            done += n;
+            continue;
+        }
+        if (z->state == KD_ST_DONE) break;
+        if (z->out_pos + KD_MAX_MATCH + 4u > KD_OUT_SIZE) {
+            /* everything handed out: keep only the 32 KiB history */
+            kd_move_down(z->out, z->out + z->out_pos - KD_WIN_SIZE, KD_WIN_SIZE);
+            z->out_pos = KD_WIN_SIZE;
+            z->read_pos = KD_WIN_SIZE;
+        }
+        int rc = kd_run(z);
+        if (rc == KDEFLATE_ERR) {
+            z->err = 1;
             return KDEFLATE_ERR;
         }
-    } while (!bfinal);
-    return KDEFLATE_OK;
+        if (rc == KD_NEED_IN && z->read_pos == z->out_pos) break;
+    }
+    return (int)done;
+}
+
+int kdeflate_stream_done(const kdeflate_stream_t *z) {
+    return z && z->state >= KD_ST_TRAILER && z->read_pos == z->out_pos;
 }
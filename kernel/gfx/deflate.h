@@ -1,9 +1,14 @@
-/* deflate.h - RFC 1951 raw DEFLATE decoder (kernel-side).
+/* deflate.h - RFC 1951 DEFLATE decoder (kernel-side).
  *
- * Hand-rolled inflate. No zlib wrapper handling - feed raw deflate
- * bytes (caller skips zlib CMF/FLG and Adler-32 if present). Used by:
- *   - png.c   (zlib-wrapped IDAT, header skipped at call site)
- *   - woff1.c (per-table zlib, header skipped at call site)
+ * One inflate engine for every compressed stream in the system:
+ *   - png.c       (zlib-wrapped IDAT, streamed chunk by chunk)
+ *   - woff.cc     (per-table zlib, one-shot via kdeflate_zlib)
+ *   - HTTP clients (gzip/deflate Content-Encoding, streamed as the
+ *     body arrives: browser, curl, wget)
+ *
+ * Two-level lookup tables resolve a literal/length or distance code in
+ * at most two probes, input is consumed a 32-bit word at a time and
+ * match copies move four bytes per step.
 */
 
 #ifndef DEFLATE_H
@@ -14,13 +19,44 @@
 #define KDEFLATE_OK   0
 #define KDEFLATE_ERR -1
 
+/* Stream wrappers understood by kdeflate_stream_new. */
+#define KDEFLATE_WRAP_RAW   0   /* bare RFC 1951 */
+#define KDEFLATE_WRAP_ZLIB  1   /* RFC 1950 header; Adler-32 not verified */
+#define KDEFLATE_WRAP_GZIP  2   /* RFC 1952 header; CRC-32 not verified */
+#define KDEFLATE_WRAP_AUTO  3   /* sniff gzip / zlib / raw (HTTP "deflate") */
+
 /* Decode raw DEFLATE bytes (no zlib wrapper) into a caller-provided
- * output buffer. out_len is the expected uncompressed size; under- or
- * over-runs are reported as KDEFLATE_ERR.
+ * output buffer. out_len is the capacity; overruns and truncated input
+ * are reported as KDEFLATE_ERR.
  *
  * Returns KDEFLATE_OK on success, KDEFLATE_ERR on any malformed input
  * or buffer mismatch.*/
 int kdeflate_raw(const uint8_t *src, uint32_t src_len,
                  uint8_t *out, uint32_t out_len);
 
+/* Same for a zlib-wrapped stream: the CMF/FLG header is checked and the
+ * trailing Adler-32, if present, is skipped.*/
+int kdeflate_zlib(const uint8_t *src, uint32_t src_len,
+                  uint8_t *out, uint32_t out_len);
+
+/* Streaming decoder: push compressed bytes as they arrive, pull
+ * decompressed bytes out. The stream keeps its own 32 KiB history, so
+ * neither side needs the whole input or the output size up front.*/
+typedef struct kdeflate_stream kdeflate_stream_t;
+
+/* NULL on allocation failure. */
+kdeflate_stream_t *kdeflate_stream_new(int wrap);
+void kdeflate_stream_free(kdeflate_stream_t *z);
+
+/* Queue up to len input bytes; returns how many were accepted (fewer
+ * than len once the input buffer is full - pull, then push the rest).*/
+int kdeflate_stream_push(kdeflate_stream_t *z, const uint8_t *in, uint32_t len);
+
+/* Decode into out; returns bytes written (0 = needs more input) or
+ * KDEFLATE_ERR on corrupt data.*/
+int kdeflate_stream_pull(kdeflate_stream_t *z, uint8_t *out, uint32_t cap);
+
+/* 1 once the final block has been decoded and all output pulled. */
+int kdeflate_stream_done(const kdeflate_stream_t *z);
+
 #endif /* DEFLATE_H */
@@ -4,7 +4,9 @@
  * Owns:
  *   - face registry (parallel arrays, cap FONTSYS_MAX_FACES)
  *   - generic family fallback table (serif/sans/mono/default)
- *   - glyph cache (parallel arrays, LRU eviction by byte budget)
+ *   - glyph cache (hashed parallel arrays, O(1) LRU, atlas-packed
+ *     bitmaps, eviction by byte budget)
+ *   - shaped-run cache (string hash -> per-glyph advances)
  *   - run drawing (alpha-blit via gfx2d g2d_put_alpha)
  *
  * Design loosely follows Blink's minimum-viable subset (FontDescription
@@ -20,6 +22,10 @@
 #include "../drivers/serial.h"
 #include "../fs/vfs.h"
 #include "../fs/vfs_helpers.h"
+#include "kernel.h"
+#ifdef FONTSYS_BENCH
+#include "timer.h"
+#endif
 
 /* Cap absorbs @font-face fonts downloaded per-site. Modern Google Fonts
  * stylesheets declare 12+ unicode-subsetted faces per family; the browser
@@ -59,24 +65,85 @@ static int       face_count;
 
 static int generic_face[8];   /* index by FONTSYS_FAMILY_*; 0 reserved for default */
 
-/* Glyph cache. */
+/* Glyph cache.
+ *
+ * Slots are parallel arrays indexed through an open-addressed hash keyed
+ * on (face, codepoint, size, phase). Live slots sit on a doubly-linked LRU list
+ * (head = most recent) so both a hit and an eviction are O(1). A slot
+ * can hold metrics only (fontsys_advance) or metrics plus a coverage
+ * bitmap (fontsys_glyph); the bitmap is added lazily on first draw.
+ * The phase is the pen's subpixel x bucket (FONTSYS_SUBPX_PHASES per
+ * pixel); metrics-only entries always use phase 0.*/
+
+#define GC_STATE_FREE    0
+#define GC_STATE_METRICS 1
+#define GC_STATE_RASTER  2
+
+#define GC_HASH_CAP      (FONTSYS_GCACHE_CAP * 2)   /* power of two */
 
 static int      gc_face_id    [FONTSYS_GCACHE_CAP];
 static int      gc_codepoint  [FONTSYS_GCACHE_CAP];
 static int      gc_size_px    [FONTSYS_GCACHE_CAP];
+static int      gc_phase      [FONTSYS_GCACHE_CAP];   /* subpixel x bucket */
 static int      gc_w          [FONTSYS_GCACHE_CAP];
 static int      gc_h          [FONTSYS_GCACHE_CAP];
 static int      gc_bx         [FONTSYS_GCACHE_CAP];
 static int      gc_by         [FONTSYS_GCACHE_CAP];
 static int      gc_advance    [FONTSYS_GCACHE_CAP];
+static int      gc_advance_q  [FONTSYS_GCACHE_CAP];   /* in 1/PHASES px */
 static uint8_t *gc_alpha      [FONTSYS_GCACHE_CAP];
-static uint32_t gc_lru_seq    [FONTSYS_GCACHE_CAP];
-static int      gc_used       [FONTSYS_GCACHE_CAP];
+static int      gc_cell_class [FONTSYS_GCACHE_CAP];   /* -1 = kmalloc'd */
+static int      gc_state      [FONTSYS_GCACHE_CAP];
+static int      gc_lru_prev   [FONTSYS_GCACHE_CAP];
+static int      gc_lru_next   [FONTSYS_GCACHE_CAP];   /* doubles as free list */
+static int16_t  gc_hash_tab   [GC_HASH_CAP];           /* slot + 1, 0 = empty */
+static int      gc_lru_head;
+static int      gc_lru_tail;
+static int      gc_free_head;
 static int      gc_n_used;
-static uint32_t gc_seq_next;
 static size_t   gc_bytes_total;
 static size_t   gc_bytes_cap = 4u * 1024u * 1024u;   /* 4 MB */
 
+static uint32_t gc_hits;
+static uint32_t gc_misses;
+static uint32_t gc_evictions;
+
+/* Glyph atlas. Bitmaps live in a handful of large pages carved into
+ * fixed-size cells per size class; a freed cell goes back on its class
+ * free list so eviction never fragments the kernel heap. Bitmaps larger
+ * than the biggest class (display sizes) fall back to kmalloc.*/
+#define ATLAS_PAGE_BYTES  (128u * 1024u)
+#define ATLAS_MAX_PAGES   32                          /* 4 MB */
+#define ATLAS_CLASSES     4
+
+static const uint32_t atlas_cell_bytes[ATLAS_CLASSES] = { 64u, 256u, 1024u, 4096u };
+static uint8_t *atlas_page[ATLAS_MAX_PAGES];
+static int      atlas_page_count;
+static int      atlas_class_pages[ATLAS_CLASSES];
+static void    *atlas_free[ATLAS_CLASSES];            /* intrusive free lists */
+
+/* Shaped-run cache. Direct-mapped by string hash; sits in front of the
+ * glyph cache so repeated width queries and redraws of the same short
+ * run skip UTF-8 decode and per-glyph lookups entirely. Runs longer
+ * than RUN_TEXT_CAP bytes take the uncached path.*/
+#define RUN_CACHE_CAP  128                            /* power of two */
+#define RUN_TEXT_CAP   48
+
+static int      rc_face  [RUN_CACHE_CAP];             /* -1 = empty */
+static int      rc_size  [RUN_CACHE_CAP];
+static int      rc_len   [RUN_CACHE_CAP];
+static uint32_t rc_hash  [RUN_CACHE_CAP];
+static int      rc_width [RUN_CACHE_CAP];
+static int      rc_n     [RUN_CACHE_CAP];
+static char     rc_text  [RUN_CACHE_CAP][RUN_TEXT_CAP];
+static int      rc_cp    [RUN_CACHE_CAP][RUN_TEXT_CAP];
+static int16_t  rc_adv   [RUN_CACHE_CAP][RUN_TEXT_CAP]; /* -1 = no glyph */
+static int16_t  rc_advq  [RUN_CACHE_CAP][RUN_TEXT_CAP]; /* 1/PHASES px */
+static int      rc_width_q[RUN_CACHE_CAP];
+
+static uint32_t rc_hits;
+static uint32_t rc_misses;
+
 static int g_init_done;
 
 /* OS-wide default. -1 face_id == "no TTF default, fall through to
@@ -86,6 +153,8 @@ static int g_os_size = 14;
 
 /* Helpers. */
 
+static void gc_reset(void);
+
 static char to_lower(char c) {
     if (c >= 'A' && c <= 'Z') return (char)(c - 'A' + 'a');
     return c;
@@ -164,13 +233,7 @@ void fontsys_init(void) {
     for (int i = 0; i < FONTSYS_MAX_FACES; i++) face_used[i] = 0;
     for (int i = 0; i < 8; i++) generic_face[i] = -1;
 
-    gc_n_used = 0;
-    gc_seq_next = 0;
-    gc_bytes_total = 0;
-    for (int i = 0; i < FONTSYS_GCACHE_CAP; i++) {
-        gc_used[i] = 0;
-        gc_alpha[i] = NULL;
-    }
+    gc_reset();
 
     register_embedded(_binary_system_fonts_LiberationSans_Regular_ttf_start,
                       _binary_system_fonts_LiberationSans_Regular_ttf_end,
@@ -469,51 +532,259 @@ int fontsys_line_height(int face_id, int size_px) {
 
 /* Glyph cache (raster pool). */
 
-static int gc_find(int face_id, int cp, int size_px) {
-    for (int i = 0; i < gc_n_used; i++) {
-        if (!gc_used[i]) continue;
-        if (gc_face_id[i] == face_id && gc_codepoint[i] == cp
-            && gc_size_px[i] == size_px) {
-            gc_lru_seq[i] = ++gc_seq_next;
-            return i;
-        }
+static uint32_t gc_key_hash(int face_id, int cp, int size_px, int phase) {
+    uint32_t h = (uint32_t)face_id * 0x9E3779B1u;
+    h ^= (uint32_t)cp * 0x85EBCA77u;
+    h ^= (uint32_t)size_px * 0xC2B2AE3Du;
+    h ^= (uint32_t)phase * 0x27D4EB2Fu;
+    h ^= h >> 15;
+    h *= 0x2C1B3C6Du;
+    h ^= h >> 13;
+    return h;
+}
+
+static int gc_home(int slot) {
+    return (int)(gc_key_hash(gc_face_id[slot], gc_codepoint[slot],
+                             gc_size_px[slot], gc_phase[slot])
+                 & (GC_HASH_CAP - 1));
+}
+
+static void gc_lru_unlink(int slot) {
+    int p = gc_lru_prev[slot];
+    int n = gc_lru_next[slot];
+    if (p >= 0) gc_lru_next[p] = n; else gc_lru_head = n;
+    if (n >= 0) gc_lru_prev[n] = p; else gc_lru_tail = p;
+    gc_lru_prev[slot] = -1;
+    gc_lru_next[slot] = -1;
+}
+
+static void gc_lru_push_front(int slot) {
+    gc_lru_prev[slot] = -1;
+    gc_lru_next[slot] = gc_lru_head;
+    if (gc_lru_head >= 0) gc_lru_prev[gc_lru_head] = slot;
+    gc_lru_head = slot;
+    if (gc_lru_tail < 0) gc_lru_tail = slot;
+}
+
+static void gc_reset(void) {
+    gc_n_used = 0;
+    gc_bytes_total = 0;
+    gc_lru_head = -1;
+    gc_lru_tail = -1;
+    for (int i = 0; i < GC_HASH_CAP; i++) gc_hash_tab[i] = 0;
+    for (int i = 0; i < FONTSYS_GCACHE_CAP; i++) {
+        gc_state[i] = GC_STATE_FREE;
+        gc_alpha[i] = NULL;
+        gc_lru_prev[i] = -1;
+        gc_lru_next[i] = (i + 1 < FONTSYS_GCACHE_CAP) ? i + 1 : -1;
+    }
+    gc_free_head = 0;
+    for (int c = 0; c < ATLAS_CLASSES; c++) atlas_free[c] = NULL;
+    for (int i = 0; i < RUN_CACHE_CAP; i++) rc_face[i] = -1;
+}
+
+/* Atlas cells. */
+
+static int atlas_class_for(size_t bytes) {
+    for (int c = 0; c < ATLAS_CLASSES; c++) {
+        if (bytes <= atlas_cell_bytes[c]) return c;
     }
     return -1;
 }
 
-static int gc_evict_one(void) {
-    int oldest = -1;
-    uint32_t oldest_seq = 0xFFFFFFFFu;
-    for (int i = 0; i < gc_n_used; i++) {
-        if (!gc_used[i]) continue;
-        if (gc_lru_seq[i] < oldest_seq) {
-            oldest_seq = gc_lru_seq[i];
-            oldest = i;
+/* Carve a fresh page into cells of class `cls`. Returns 0 on success,
+ * -1 once the page budget is spent or the heap is out.*/
+static int atlas_grow(int cls) {
+    if (atlas_page_count >= ATLAS_MAX_PAGES) return -1;
+    uint8_t *page = (uint8_t *)kmalloc(ATLAS_PAGE_BYTES);
+    if (!page) return -1;
+    atlas_page[atlas_page_count++] = page;
+    atlas_class_pages[cls]++;
+    uint32_t cell = atlas_cell_bytes[cls];
+    for (uint32_t off = 0; off + cell <= ATLAS_PAGE_BYTES; off += cell) {
+        void **c = (void **)(void *)(page + off);
+        *c = atlas_free[cls];
+        atlas_free[cls] = c;
+    }
+    return 0;
+}
+
+static int gc_evict_one(void);
+static int gc_evict_class(int cls);
+
+/* Allocate storage for a w*h coverage bitmap. Prefers an atlas cell of
+ * the smallest fitting class, growing the atlas first and otherwise
+ * evicting the least recently used glyph of that same class, so one
+ * allocation frees one cell rather than draining the whole cache.
+ * Oversized bitmaps (and a class with no page to recycle once the
+ * atlas is full) fall back to the heap. The byte budget is charged in
+ * whole cells.*/
+static uint8_t *gc_bitmap_alloc(size_t bytes, int *out_cls) {
+    int cls = atlas_class_for(bytes);
+    if (cls >= 0) {
+        for (;;) {
+            if (atlas_free[cls]) {
+                void **c = (void **)atlas_free[cls];
+                atlas_free[cls] = *c;
+                gc_bytes_total += atlas_cell_bytes[cls];
+                *out_cls = cls;
+                return (uint8_t *)(void *)c;
+            }
+            if (atlas_grow(cls) == 0) continue;
+            if (gc_evict_class(cls) != 0) break;
+        }
+    }
+    while ((gc_bytes_total + bytes) > gc_bytes_cap) {
+        if (gc_evict_one() != 0) break;
+    }
+    uint8_t *p = (uint8_t *)kmalloc(bytes);
+    if (!p) return NULL;
+    gc_bytes_total += bytes;
+    *out_cls = -1;
+    return p;
+}
+
+static void gc_bitmap_free(uint8_t *p, int cls, size_t bytes) {
+    if (!p) return;
+    if (cls >= 0) {
+        void **c = (void **)(void *)p;
+        *c = atlas_free[cls];
+        atlas_free[cls] = c;
+        bytes = atlas_cell_bytes[cls];
+    } else {
+        kfree(p);
+    }
+    if (gc_bytes_total >= bytes) gc_bytes_total -= bytes;
+    else gc_bytes_total = 0;
+}
+
+/* Hash table. Linear probing; deletion back-shifts the cluster so no
+ * tombstones accumulate under steady eviction churn.*/
+
+static int gc_lookup(int face_id, int cp, int size_px, int phase) {
+    uint32_t i = gc_key_hash(face_id, cp, size_px, phase) & (GC_HASH_CAP - 1);
+    for (;;) {
+        int e = gc_hash_tab[i];
+        if (e == 0) return -1;
+        int s = e - 1;
+        if (gc_codepoint[s] == cp && gc_face_id[s] == face_id
+            && gc_size_px[s] == size_px && gc_phase[s] == phase) {
+            return s;
         }
+        i = (i + 1) & (GC_HASH_CAP - 1);
+    }
+}
+
+static void gc_hash_remove(int slot) {
+    int i = gc_home(slot);
+    while (gc_hash_tab[i] != (int16_t)(slot + 1)) {
+        if (gc_hash_tab[i] == 0) return;
+        i = (i + 1) & (GC_HASH_CAP - 1);
     }
-    if (oldest < 0) return -1;
-    if (gc_alpha[oldest]) {
-        size_t bytes = (size_t)gc_w[oldest] * (size_t)gc_h[oldest];
-        gc_bytes_total -= bytes;
-        kfree(gc_alpha[oldest]);
-        gc_alpha[oldest] = NULL;
+    int j = i;
+    for (;;) {
+        j = (j + 1) & (GC_HASH_CAP - 1);
+        if (gc_hash_tab[j] == 0) break;
+        int k = gc_home(gc_hash_tab[j] - 1);
+        /* Move entry j into hole i unless its home lies cyclically in (i, j]. */
+        int in_range = (i <= j) ? (k > i && k <= j) : (k > i || k <= j);
+        if (!in_range) {
+            gc_hash_tab[i] = gc_hash_tab[j];
+            i = j;
+        }
     }
-    gc_used[oldest] = 0;
+    gc_hash_tab[i] = 0;
+}
+
+static void gc_release(int slot) {
+    if (gc_state[slot] == GC_STATE_FREE) return;
+    if (gc_alpha[slot]) {
+        gc_bitmap_free(gc_alpha[slot], gc_cell_class[slot],
+                       (size_t)gc_w[slot] * (size_t)gc_h[slot]);
+        gc_alpha[slot] = NULL;
+    }
+    gc_hash_remove(slot);
+    gc_lru_unlink(slot);
+    gc_state[slot] = GC_STATE_FREE;
+    gc_lru_next[slot] = gc_free_head;
+    gc_free_head = slot;
+    gc_n_used--;
+}
+
+static int gc_evict_one(void) {
+    if (gc_lru_tail < 0) return -1;
+    gc_release(gc_lru_tail);
+    gc_evictions++;
     return 0;
 }
 
-static int gc_alloc_slot(void) {
-    for (int i = 0; i < FONTSYS_GCACHE_CAP; i++) {
-        if (!gc_used[i]) {
-            if (i >= gc_n_used) gc_n_used = i + 1;
-            return i;
+/* Evict the least recently used glyph whose bitmap occupies a cell of
+ * atlas class `cls`. Returns -1 when no such glyph is cached.*/
+static int gc_evict_class(int cls) {
+    for (int s = gc_lru_tail; s >= 0; s = gc_lru_prev[s]) {
+        if (gc_alpha[s] && gc_cell_class[s] == cls) {
+            gc_release(s);
+            gc_evictions++;
+            return 0;
         }
     }
-    /* Cache full - evict and retry. */
-    if (gc_evict_one() == 0) return gc_alloc_slot();
     return -1;
 }
 
+static int gc_find(int face_id, int cp, int size_px, int phase) {
+    int s = gc_lookup(face_id, cp, size_px, phase);
+    if (s >= 0 && s != gc_lru_head) {
+        gc_lru_unlink(s);
+        gc_lru_push_front(s);
+    }
+    return s;
+}
+
+/* Claim a slot for (face, cp, size, phase) in metrics-only state,
+ * evicting the LRU entry when the table is full. Caller fills the
+ * metrics.*/
+static int gc_insert(int face_id, int cp, int size_px, int phase) {
+    if (gc_free_head < 0 && gc_evict_one() != 0) return -1;
+    int slot = gc_free_head;
+    if (slot < 0) return -1;
+    gc_free_head = gc_lru_next[slot];
+
+    gc_face_id[slot] = face_id;
+    gc_codepoint[slot] = cp;
+    gc_size_px[slot] = size_px;
+    gc_phase[slot] = phase;
+    gc_w[slot] = 0;
+    gc_h[slot] = 0;
+    gc_bx[slot] = 0;
+    gc_by[slot] = 0;
+    gc_advance[slot] = 0;
+    gc_advance_q[slot] = 0;
+    gc_alpha[slot] = NULL;
+    gc_cell_class[slot] = -1;
+    gc_state[slot] = GC_STATE_METRICS;
+    gc_n_used++;
+
+    uint32_t i = gc_key_hash(face_id, cp, size_px, phase) & (GC_HASH_CAP - 1);
+    while (gc_hash_tab[i] != 0) i = (i + 1) & (GC_HASH_CAP - 1);
+    gc_hash_tab[i] = (int16_t)(slot + 1);
+    gc_lru_push_front(slot);
+    return slot;
+}
+
+static int face_glyph_advance_px(int face_id, int gid, int size_px) {
+    int adv_fu = ttf_glyph_advance(face_blob[face_id],
+                                   face_off_hmtx[face_id],
+                                   face_num_h_metrics[face_id],
+                                   face_num_glyphs[face_id],
+                                   gid);
+    return scale_to_px(adv_fu, face_id, size_px);
+}
+
+/* Same advance in 1/FONTSYS_SUBPX_PHASES px, for subpixel pen placement. */
+static int face_glyph_advance_q(int face_id, int gid, int size_px) {
+    return face_glyph_advance_px(face_id, gid, size_px * FONTSYS_SUBPX_PHASES);
+}
+
 /* Scratch buffers for outline decode - one set, serial use. */
 #define OUTLINE_PT_CAP   2048
 #define OUTLINE_CTR_CAP   128
@@ -522,7 +793,7 @@ static int   outline_ys[OUTLINE_PT_CAP];
 static int   outline_oc[OUTLINE_PT_CAP];
 static int   outline_ce[OUTLINE_CTR_CAP];
 
-static int rasterize_into_cache(int face_id, int cp, int size_px,
+static int rasterize_into_cache(int face_id, int cp, int size_px, int phase,
                                 int *out_slot) {
     int gid = ttf_cmap_glyph(face_blob[face_id], face_off_cmap[face_id], cp);
     int n_pts = 0, n_ctr = 0;
@@ -538,68 +809,96 @@ static int rasterize_into_cache(int face_id, int cp, int size_px,
                                &xmin, &ymin, &xmax, &ymax);
     if (rc != 0) return -1;
 
-    int adv_fu = ttf_glyph_advance(face_blob[face_id],
-                                   face_off_hmtx[face_id],
-                                   face_num_h_metrics[face_id],
-                                   face_num_glyphs[face_id],
-                                   gid);
-    int adv_px = scale_to_px(adv_fu, face_id, size_px);
+    int adv_px = face_glyph_advance_px(face_id, gid, size_px);
+    int adv_q = face_glyph_advance_q(face_id, gid, size_px);
 
     uint8_t *alpha = NULL;
     int w = 0, h = 0, bx = 0, by = 0;
     if (n_pts > 0 && n_ctr > 0) {
-        if (glyph_rasterize(outline_xs, outline_ys, outline_oc, n_pts,
-                            outline_ce, n_ctr,
-                            xmin, ymin, xmax, ymax,
-                            face_units_per_em[face_id], size_px,
-                            &alpha, &w, &h, &bx, &by) != 0) {
+        if (glyph_rasterize_shifted(outline_xs, outline_ys, outline_oc, n_pts,
+                                    outline_ce, n_ctr,
+                                    xmin, ymin, xmax, ymax,
+                                    face_units_per_em[face_id], size_px,
+                                    (phase * 64) / FONTSYS_SUBPX_PHASES,
+                                    &alpha, &w, &h, &bx, &by) != 0) {
             return -1;
         }
     }
 
-    /* Make room. */
-    while (alpha != NULL && (gc_bytes_total + (size_t)w * (size_t)h) > gc_bytes_cap) {
-        if (gc_evict_one() != 0) break;
+    /* Move the rasterizer's bitmap into the atlas before touching the
+     * slot table: allocation may evict, and the bitmap is not yet
+     * reachable from any slot so it cannot be evicted out from under us.*/
+    uint8_t *cell = NULL;
+    int cls = -1;
+    if (alpha) {
+        size_t bytes = (size_t)w * (size_t)h;
+        cell = gc_bitmap_alloc(bytes, &cls);
+        if (!cell) {
+            kfree(alpha);
+            return -1;
+        }
+        memcpy(cell, alpha, bytes);
+        kfree(alpha);
     }
 
-    int slot = gc_alloc_slot();
+    /* A metrics-only entry may already exist (fontsys_advance); upgrade
+     * it in place, otherwise claim a new slot.*/
+    int slot = gc_find(face_id, cp, size_px, phase);
+    if (slot < 0) slot = gc_insert(face_id, cp, size_px, phase);
     if (slot < 0) {
-        if (alpha) kfree(alpha);
+        gc_bitmap_free(cell, cls, (size_t)w * (size_t)h);
         return -1;
     }
 
-    gc_face_id[slot] = face_id;
-    gc_codepoint[slot] = cp;
-    gc_size_px[slot] = size_px;
     gc_w[slot] = w;
     gc_h[slot] = h;
     gc_bx[slot] = bx;
     gc_by[slot] = by;
     gc_advance[slot] = adv_px;
-    gc_alpha[slot] = alpha;
-    gc_lru_seq[slot] = ++gc_seq_next;
-    gc_used[slot] = 1;
-    if (alpha) gc_bytes_total += (size_t)w * (size_t)h;
+    gc_advance_q[slot] = adv_q;
+    gc_alpha[slot] = cell;
+    gc_cell_class[slot] = cls;
+    gc_state[slot] = GC_STATE_RASTER;
 
     *out_slot = slot;
     return 0;
 }
 
-int fontsys_glyph(int face_id, int codepoint, int size_px,
-                  const uint8_t **out_alpha,
-                  int *out_w, int *out_h,
-                  int *out_bx, int *out_by, int *out_advance) {
-    *out_alpha = NULL;
-    *out_w = 0; *out_h = 0; *out_bx = 0; *out_by = 0; *out_advance = 0;
+/* Rasterized slot for (face, cp, size, phase), or -1. */
+static int glyph_slot(int face_id, int codepoint, int size_px, int phase) {
     if (face_id < 0 || face_id >= face_count || !face_used[face_id]) return -1;
     if (size_px <= 0) return -1;
+    if (phase < 0 || phase >= FONTSYS_SUBPX_PHASES) phase = 0;
 
-    int slot = gc_find(face_id, codepoint, size_px);
-    if (slot < 0) {
-        if (rasterize_into_cache(face_id, codepoint, size_px, &slot) != 0) {
+    int slot = gc_find(face_id, codepoint, size_px, phase);
+    if (slot < 0 || gc_state[slot] != GC_STATE_RASTER) {
+        gc_misses++;
+        if (rasterize_into_cache(face_id, codepoint, size_px, phase,
+                                 &slot) != 0) {
             return -1;
         }
+    } else {
+        gc_hits++;
     }
+    return slot;
+}
+
+int fontsys_glyph(int face_id, int codepoint, int size_px,
+                  const uint8_t **out_alpha,
+                  int *out_w, int *out_h,
+                  int *out_bx, int *out_by, int *out_advance) {
+    return fontsys_glyph_phase(face_id, codepoint, size_px, 0, out_alpha,
+                               out_w, out_h, out_bx, out_by, out_advance);
+}
+
+int fontsys_glyph_phase(int face_id, int codepoint, int size_px, int phase,
+                        const uint8_t **out_alpha,
+                        int *out_w, int *out_h,
+                        int *out_bx, int *out_by, int *out_advance) {
+    *out_alpha = NULL;
+    *out_w = 0; *out_h = 0; *out_bx = 0; *out_by = 0; *out_advance = 0;
+    int slot = glyph_slot(face_id, codepoint, size_px, phase);
+    if (slot < 0) return -1;
     *out_alpha   = gc_alpha[slot];
     *out_w       = gc_w[slot];
     *out_h       = gc_h[slot];
@@ -646,10 +945,65 @@ static int fontsys_utf8_decode(const char *bytes, int i, int len, int *cp_out) {
     return 1;
 }
 
+/* Return the run-cache entry for bytes[0..len) (stopping at NUL like
+ * the uncached loops), shaping it on a miss. -1 when the run is too
+ * long to cache; the caller then walks the bytes directly.*/
+static int run_cache_get(int face_id, int size_px, const char *bytes, int len) {
+    uint32_t h = 2166136261u;
+    int n = 0;
+    while (n < len && bytes[n]) {
+        if (n >= RUN_TEXT_CAP) return -1;
+        h = (h ^ (uint32_t)(uint8_t)bytes[n]) * 16777619u;
+        n++;
+    }
+    h ^= (uint32_t)face_id * 0x9E3779B1u;
+    h ^= (uint32_t)size_px * 0x85EBCA77u;
+    int e = (int)((h ^ (h >> 16)) & (RUN_CACHE_CAP - 1));
+    if (rc_face[e] == face_id && rc_size[e] == size_px && rc_len[e] == n
+        && rc_hash[e] == h && memcmp(rc_text[e], bytes, (size_t)n) == 0) {
+        rc_hits++;
+        return e;
+    }
+    rc_misses++;
+
+    int width = 0;
+    int width_q = 0;
+    int g = 0;
+    int i = 0;
+    while (i < n) {
+        int cp;
+        int step = fontsys_utf8_decode(bytes, i, n, &cp);
+        int slot = glyph_slot(face_id, cp, size_px, 0);
+        rc_cp[e][g] = cp;
+        if (slot >= 0) {
+            rc_adv[e][g] = (int16_t)gc_advance[slot];
+            rc_advq[e][g] = (int16_t)gc_advance_q[slot];
+            width += gc_advance[slot];
+            width_q += gc_advance_q[slot];
+        } else {
+            rc_adv[e][g] = -1;
+            rc_advq[e][g] = 0;
+        }
+        g++;
+        i += step;
+    }
+    memcpy(rc_text[e], bytes, (size_t)n);
+    rc_face[e] = face_id;
+    rc_size[e] = size_px;
+    rc_len[e] = n;
+    rc_hash[e] = h;
+    rc_width[e] = width;
+    rc_width_q[e] = width_q;
+    rc_n[e] = g;
+    return e;
+}
+
 int fontsys_run_width(int face_id, int size_px,
                       const char *bytes, int len) {
     if (!bytes || len <= 0) return 0;
     if (face_id < 0 || face_id >= face_count) return 0;
+    int e = run_cache_get(face_id, size_px, bytes, len);
+    if (e >= 0) return rc_width[e];
     int x = 0;
     int i = 0;
     while (i < len && bytes[i]) {
@@ -706,6 +1060,35 @@ void fontsys_draw_run(int face_id, int size_px,
                             bytes, len, color, 0, 0);
 }
 
+/* Draw one glyph at the pen; returns 0 if the glyph was drawn (the
+ * caller then advances the pen).*/
+static int draw_run_glyph(int face_id, int size_px, int cp,
+                          int pen_x, int phase, int baseline_y, uint32_t color,
+                          int want_bold, int want_italic, int *out_adv) {
+    const uint8_t *a; int w, h, bx, by, adv;
+    if (fontsys_glyph_phase(face_id, cp, size_px, phase,
+                            &a, &w, &h, &bx, &by, &adv) != 0) {
+        return -1;
+    }
+    int gx = pen_x + bx;
+    int gy = baseline_y - by;
+    /* Synthetic italic shifts the glyph bitmap left so the row-shear
+     * straddles the glyph axis (top leans right of axis, bottom of
+     * axis). Without this offset the whole glyph drifts right and
+     * runs read as letter-spaced. Advance stays the regular hmtx
+     * value; italic glyphs naturally bleed slightly into the next
+     * cell at the top, just like real italic faces.*/
+    if (want_italic) {
+        gx -= ((h - 1) * 17) / 200;       /* half of the 17% shear */
+    }
+    blit_glyph(a, w, h, gx, gy, color, want_italic);
+    if (want_bold) {
+        blit_glyph(a, w, h, gx + 1, gy, color, want_italic);
+    }
+    *out_adv = adv;
+    return 0;
+}
+
 void fontsys_draw_run_styled(int face_id, int size_px,
                              int x, int baseline_y,
                              const char *bytes, int len,
@@ -716,30 +1099,64 @@ void fontsys_draw_run_styled(int face_id, int size_px,
     if (face_id < 0 || face_id >= face_count) return;
 
     int pen_x = x;
+    int adv;
+    int e = run_cache_get(face_id, size_px, bytes, len);
+    if (e >= 0) {
+        /* Copy out: drawing re-enters the glyph cache, and a later
+         * run_cache_get for another run may reuse this entry.*/
+        int n = rc_n[e];
+        int cps[RUN_TEXT_CAP];
+        int16_t advs[RUN_TEXT_CAP];
+        int16_t advq[RUN_TEXT_CAP];
+        for (int g = 0; g < n; g++) {
+            cps[g] = rc_cp[e][g];
+            advs[g] = rc_adv[e][g];
+            advq[g] = rc_advq[e][g];
+        }
+        /* Glyphs sit at their fractional design positions, scaled so the
+         * run still ends exactly at the integer width layout measured;
+         * the fraction selects one of the cached phase variants.*/
+        uint32_t span_q = (uint32_t)rc_width[e] * FONTSYS_SUBPX_PHASES;
+        uint32_t total_q = (uint32_t)(rc_width_q[e] > 0 ? rc_width_q[e] : 0);
+        int subpx = total_q > 0 && span_q < (1u << 20);
+        uint32_t num = 0;
+        int pos_q = 0;
+        for (int g = 0; g < n; g++) {
+            if (advs[g] < 0) continue;
+            int gx = pen_x;
+            int phase = 0;
+            if (subpx) {
+                gx = x + pos_q / FONTSYS_SUBPX_PHASES;
+                phase = pos_q % FONTSYS_SUBPX_PHASES;
+            }
+            if (draw_run_glyph(face_id, size_px, cps[g], gx, phase,
+                               baseline_y, color, want_bold, want_italic,
+                               &adv) != 0) {
+                continue;
+            }
+            pen_x += adv;
+            if (want_bold) {
+                pen_x += 1;
+                pos_q += FONTSYS_SUBPX_PHASES;
+            }
+            if (subpx) {
+                num += (uint32_t)advq[g] * span_q;
+                pos_q += (int)(num / total_q);
+                num %= total_q;
+            }
+        }
+        return;
+    }
+
     int i = 0;
     while (i < len && bytes[i]) {
         int cp;
         int step = fontsys_utf8_decode(bytes, i, len, &cp);
         i += step;
-        const uint8_t *a; int w, h, bx, by, adv;
-        if (fontsys_glyph(face_id, cp, size_px, &a, &w, &h, &bx, &by, &adv) != 0) {
+        if (draw_run_glyph(face_id, size_px, cp, pen_x, 0, baseline_y,
+                           color, want_bold, want_italic, &adv) != 0) {
             continue;
         }
-        int gx = pen_x + bx;
-        int gy = baseline_y - by;
-        /* Synthetic italic shifts the glyph bitmap left so the row-shear
-         * straddles the glyph axis (top leans right of axis, bottom of
-         * axis). Without this offset the whole glyph drifts right and
-         * runs read as letter-spaced. Advance stays the regular hmtx
-         * value; italic glyphs naturally bleed slightly into the next
-         * cell at the top, just like real italic faces.*/
-        if (want_italic) {
-            gx -= ((h - 1) * 17) / 200;       /* half of the 17% shear */
-        }
-        blit_glyph(a, w, h, gx, gy, color, want_italic);
-        if (want_bold) {
-            blit_glyph(a, w, h, gx + 1, gy, color, want_italic);
-        }
         pen_x += adv;
         if (want_bold) pen_x += 1;
     }
@@ -747,8 +1164,8 @@ void fontsys_draw_run_styled(int face_id, int size_px,
 
 /* Drop a previously-registered face. Frees the blob if we own it,
  * clears the slot so fontsys_match skips it, and evicts every cached
- * glyph that referenced it (otherwise stale gc_alpha pointers would
- * survive an unregister/free pair). Safe to call on already-cleared
+ * glyph and shaped run that referenced it (otherwise stale gc_alpha
+ * pointers would survive an unregister/free pair). Safe to call on already-cleared
  * slots: returns 0. Returns -1 if face_id is out of range.*/
 int fontsys_unregister(int face_id) {
     if (face_id < 0 || face_id >= face_count) return -1;
@@ -775,19 +1192,14 @@ int fontsys_unregister(int face_id) {
         if (generic_face[g] == face_id) generic_face[g] = -1;
     }
     if (g_os_face == face_id) g_os_face = -1;
-    /* Evict matching glyph-cache entries. */
+    /* Evict matching glyph-cache and run-cache entries. */
     for (int i = 0; i < FONTSYS_GCACHE_CAP; i++) {
-        if (!gc_used[i]) continue;
+        if (gc_state[i] == GC_STATE_FREE) continue;
         if (gc_face_id[i] != face_id) continue;
-        if (gc_alpha[i]) {
-            kfree(gc_alpha[i]);
-            if (gc_bytes_total >= (size_t)(gc_w[i] * gc_h[i])) {
-                gc_bytes_total -= (size_t)(gc_w[i] * gc_h[i]);
-            }
-        }
-        gc_alpha[i] = (uint8_t*)0;
-        gc_used[i] = 0;
-        gc_n_used--;
+        gc_release(i);
+    }
+    for (int i = 0; i < RUN_CACHE_CAP; i++) {
+        if (rc_face[i] == face_id) rc_face[i] = -1;
     }
     return 0;
 }
@@ -858,19 +1270,131 @@ int fontsys_advance(int face_id, int codepoint, int size_px) {
     if (face_id < 0 || face_id >= face_count || !face_used[face_id]) return 0;
     if (size_px <= 0) return 0;
 
-    /* Cache hit? Reuse the rasterized advance. */
-    int slot = gc_find(face_id, codepoint, size_px);
-    if (slot >= 0) return gc_advance[slot];
+    /* Cache hit? Reuse the cached advance (rasterized or metrics-only). */
+    int slot = gc_find(face_id, codepoint, size_px, 0);
+    if (slot >= 0) { gc_hits++; return gc_advance[slot]; }
 
-    /* No raster: compute straight from hmtx. */
+    /* No raster: compute straight from hmtx and remember it as a
+     * metrics-only entry so layout loops don't re-walk cmap/hmtx.*/
+    gc_misses++;
     int gid = ttf_cmap_glyph(face_blob[face_id], face_off_cmap[face_id], codepoint);
-    int adv_fu = ttf_glyph_advance(face_blob[face_id],
-                                   face_off_hmtx[face_id],
-                                   face_num_h_metrics[face_id],
-                                   face_num_glyphs[face_id],
-                                   gid);
-    return scale_to_px(adv_fu, face_id, size_px);
+    int adv = face_glyph_advance_px(face_id, gid, size_px);
+    slot = gc_insert(face_id, codepoint, size_px, 0);
+    if (slot >= 0) {
+        gc_advance[slot] = adv;
+        gc_advance_q[slot] = face_glyph_advance_q(face_id, gid, size_px);
+    }
+    return adv;
+}
+
+/* Cache statistics (fontstats). */
+
+void fontsys_stats(void) {
+    print("Font cache statistics:\n");
+    print("  Glyph entries: ");
+    print_int((uint32_t)gc_n_used);
+    print(" / ");
+    print_int(FONTSYS_GCACHE_CAP);
+    print("\n  Glyph hits: ");
+    print_int(gc_hits);
+    print("\n  Glyph misses: ");
+    print_int(gc_misses);
+    print("\n  Evictions: ");
+    print_int(gc_evictions);
+    print("\n  Bitmap bytes: ");
+    print_int((uint32_t)gc_bytes_total);
+    print("\n  Atlas pages: ");
+    print_int((uint32_t)atlas_page_count);
+    print(" x ");
+    print_int(ATLAS_PAGE_BYTES / 1024u);
+    print(" KB\n  Run hits: ");
+    print_int(rc_hits);
+    print("\n  Run misses: ");
+    print_int(rc_misses);
+    print("\n");
+    if (gc_hits + gc_misses > 0) {
+        print("  Glyph hit rate: ");
+        print_int((gc_hits * 100u) / (gc_hits + gc_misses));
+        print("%\n");
+    }
+}
+
+#ifdef FONTSYS_BENCH
+/* Boot-time microbenchmark: measures a text-heavy width + glyph loop
+ * (what browser layout and notepad redraw do) against the default
+ * face, cold and then warm. Results go to serial.*/
+void fontsys_benchmark(void) {
+    static const char *const words[] = {
+        "The", "quick", "brown", "fox", "jumps", "over", "the", "lazy",
+        "dog", "while", "layout", "measures", "every", "word", "again,",
+        "and", "notepad", "scrolls", "a", "very", "large", "file."
+    };
+    const int n_words = (int)(sizeof(words) / sizeof(words[0]));
+    int face = generic_face[FONTSYS_FAMILY_DEFAULT];
+    if (face < 0) return;
+
+    static const int sizes[3] = { 12, 16, 24 };
+    for (int si = 0; si < 3; si++) {
+        uint32_t t0 = timer_get_uptime_ms();
+        int total = 0;
+        for (int iter = 0; iter < 2000; iter++) {
+            for (int w = 0; w < n_words; w++) {
+                const char *s = words[w];
+                total += fontsys_run_width(face, sizes[si], s, (int)strlen(s));
+                for (int c = 0; s[c]; c++) {
+                    total += fontsys_advance(face, (int)(uint8_t)s[c], sizes[si]);
+                }
+            }
+        }
+        uint32_t t1 = timer_get_uptime_ms();
+        serial_printf("[fontsys] bench %dpx: %u ms for %d words (w=%d)\n",
+                      sizes[si], t1 - t0, 2000 * n_words, total);
+    }
+    serial_printf("[fontsys] bench glyph hits=%u misses=%u runs hit=%u miss=%u\n",
+                  gc_hits, gc_misses, rc_hits, rc_misses);
+
+    /* Rasterizer throughput: every printable ASCII glyph of each bundled
+     * Liberation face, all subpixel phases, straight through
+     * glyph_rasterize_shifted (no cache).*/
+    for (int f = 0; f < face_count; f++) {
+        if (!face_used[f]) continue;
+        if (strncmp(face_family_lower[f], "liberation", 10) != 0) continue;
+        for (int si = 0; si < 3; si++) {
+            int glyphs = 0;
+            uint32_t t0 = timer_get_uptime_ms();
+            for (int cp = 33; cp < 127; cp++) {
+                int gid = ttf_cmap_glyph(face_blob[f], face_off_cmap[f], cp);
+                int n_pts = 0, n_ctr = 0;
+                int xmin, ymin, xmax, ymax;
+                if (ttf_glyph_outline(face_blob[f], face_off_glyf[f],
+                                      face_off_loca[f], face_idx_to_loc_fmt[f],
+                                      gid, outline_xs, outline_ys, outline_oc,
+                                      OUTLINE_PT_CAP, &n_pts,
+                                      outline_ce, OUTLINE_CTR_CAP, &n_ctr,
+                                      &xmin, &ymin, &xmax, &ymax) != 0) {
+                    continue;
+                }
+                for (int ph = 0; ph < FONTSYS_SUBPX_PHASES; ph++) {
+                    uint8_t *a = NULL;
+                    int w, h, bx, by;
+                    glyph_rasterize_shifted(outline_xs, outline_ys, outline_oc,
+                                            n_pts, outline_ce, n_ctr,
+                                            xmin, ymin, xmax, ymax,
+                                            face_units_per_em[f], sizes[si],
+                                            (ph * 64) / FONTSYS_SUBPX_PHASES,
+                                            &a, &w, &h, &bx, &by);
+                    if (a) kfree(a);
+                    glyphs++;
+                }
+            }
+            uint32_t ms = timer_get_uptime_ms() - t0;
+            serial_printf("[fontsys] raster %s %dpx: %d glyphs in %u ms (%u glyphs/s)\n",
+                          face_family[f], sizes[si], glyphs, ms,
+                          ms ? ((uint32_t)glyphs * 1000u) / ms : 0u);
+        }
+    }
 }
+#endif
 
 /* /etc/font.conf. */
 
@@ -89,6 +89,17 @@ int fontsys_glyph(int face_id, int codepoint, int size_px,
                   int *out_w, int *out_h,
                   int *out_bx, int *out_by, int *out_advance);
 
+/* Subpixel pen positions per pixel. fontsys_draw_run places glyphs at
+ * fractional x and caches one bitmap per (glyph, size, phase).*/
+#define FONTSYS_SUBPX_PHASES 4
+
+/* fontsys_glyph for a pen sitting phase/FONTSYS_SUBPX_PHASES px right
+ * of an integer x. Bearings and advance are relative to that integer x.*/
+int fontsys_glyph_phase(int face_id, int codepoint, int size_px, int phase,
+                        const uint8_t **out_alpha,
+                        int *out_w, int *out_h,
+                        int *out_bx, int *out_by, int *out_advance);
+
 /* Sum advance widths of a UTF-8 byte run. Stops at len bytes or NUL,
  * whichever comes first. Returns 0 on bad face.*/
 int fontsys_run_width(int face_id, int size_px,
@@ -152,4 +163,12 @@ int  fontsys_load_os_default_from_conf(void);
  * on bad face / missing glyph.*/
 int  fontsys_advance(int face_id, int codepoint, int size_px);
 
+/* Print glyph-cache / run-cache hit counters and atlas usage to the
+ * terminal. Backs the `fontstats` command.*/
+void fontsys_stats(void);
+
+#ifdef FONTSYS_BENCH
+void fontsys_benchmark(void);
+#endif
+
 #endif /* FONTSYS_H */
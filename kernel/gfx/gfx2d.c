@@ -29,6 +29,12 @@ static uint32_t *g2d_fb;
 
 static int g2d_clip_active;
 static int g2d_clip_x, g2d_clip_y, g2d_clip_w, g2d_clip_h;
+/* Outer clip bound installed by the window compositor. While active,
+ * every clip an app sets is intersected with it and clip_clear falls
+ * back to it, so redraw callbacks cannot paint outside the visible
+ * region being composited.*/
+static int g2d_bound_active;
+static int g2d_bound_x, g2d_bound_y, g2d_bound_w, g2d_bound_h;
 
 /* Sprite pool */
 #define GFX2D_MAX_SPRITES 32
@@ -256,6 +262,48 @@ static void g2d_fill32(uint32_t *dst, int n, uint32_t color) {
   simd_memset32(dst, color, (uint32_t)n);
 }
 
+/* Clip the span [*x, *x + *n) on row y to the clip rect and target.
+ * Returns a pointer to its first pixel, or NULL if nothing is left.*/
+static uint32_t *g2d_clip_span(int *x, int y, int *n) {
+  uint32_t *fb = g2d_active_fb ? g2d_active_fb : g2d_fb;
+  int x1 = *x, x2 = *x + *n;
+  if (y < 0 || y >= g2d_active_h)
+    return NULL;
+  if (g2d_clip_active) {
+    if (y < g2d_clip_y || y >= g2d_clip_y + g2d_clip_h)
+      return NULL;
+    if (x1 < g2d_clip_x) x1 = g2d_clip_x;
+    if (x2 > g2d_clip_x + g2d_clip_w) x2 = g2d_clip_x + g2d_clip_w;
+  }
+  if (x1 < 0) x1 = 0;
+  if (x2 > g2d_active_w) x2 = g2d_active_w;
+  if (x1 >= x2)
+    return NULL;
+  *x = x1;
+  *n = x2 - x1;
+  return fb + (uint32_t)y * (uint32_t)g2d_active_w + (uint32_t)x1;
+}
+
+/* Constant-color alpha span, same result as g2d_put_alpha per pixel. */
+static void g2d_span_alpha(int x, int y, int n, uint32_t argb) {
+  uint32_t a = (argb >> 24) & 0xFFu;
+  uint32_t *dst;
+  if (a == 0u || n <= 0)
+    return;
+  if (a >= 255u && g2d_blend_mode_val != GFX2D_BLEND_NORMAL) {
+    for (int i = 0; i < n; i++)
+      g2d_put(x + i, y, argb & 0x00FFFFFFu);
+    return;
+  }
+  dst = g2d_clip_span(&x, y, &n);
+  if (!dst)
+    return;
+  if (a >= 255u)
+    g2d_fill32(dst, n, argb & 0x00FFFFFFu);
+  else
+    simd_fill_alpha_row(dst, (uint32_t)n, argb & 0x00FFFFFFu, (uint8_t)a);
+}
+
 void gfx2d_clear(uint32_t color) {
   if (g2d_active_fb) {
     int n = g2d_active_w * g2d_active_h;
@@ -295,6 +343,8 @@ void gfx2d_flip(void) {
   if (g2d_debug_frame < 3)
     serial_printf("[gfx2d] flip frame=%d\n", g2d_debug_frame);
   g2d_debug_frame++;
+  /* gfx2d primitives do not record damage; present the whole frame. */
+  vga_mark_dirty_full();
   vga_flip();
 }
 
@@ -453,6 +503,53 @@ void gfx2d_rect_fill(int x, int y, int w, int h, uint32_t color) {
   }
 }
 
+/* Move the pixels of rect (x, y, w, h) of the active target dy rows down
+ * (up when dy < 0), clipped to the clip rect and the target. Rows that
+ * would come from outside the rect keep their old contents; the caller
+ * repaints that exposed strip. Lets a scrolling view reuse what is
+ * already drawn instead of repainting it.*/
+void gfx2d_scroll_rect(int x, int y, int w, int h, int dy) {
+  uint32_t *fb = g2d_active_fb ? g2d_active_fb : g2d_fb;
+  int fb_w = g2d_active_w;
+  int x1 = x, y1 = y, x2 = x + w, y2 = y + h;
+  int row;
+  uint32_t bytes;
+  if (g2d_clip_active) {
+    if (x1 < g2d_clip_x)
+      x1 = g2d_clip_x;
+    if (y1 < g2d_clip_y)
+      y1 = g2d_clip_y;
+    if (x2 > g2d_clip_x + g2d_clip_w)
+      x2 = g2d_clip_x + g2d_clip_w;
+    if (y2 > g2d_clip_y + g2d_clip_h)
+      y2 = g2d_clip_y + g2d_clip_h;
+  }
+  if (x1 < 0)
+    x1 = 0;
+  if (y1 < 0)
+    y1 = 0;
+  if (x2 > fb_w)
+    x2 = fb_w;
+  if (y2 > g2d_active_h)
+    y2 = g2d_active_h;
+  if (dy == 0 || x1 >= x2 || y2 - y1 <= (dy < 0 ? -dy : dy))
+    return;
+  bytes = (uint32_t)(x2 - x1) * 4u;
+  /* Walk rows away from the direction of travel so no source row is
+   * overwritten before it is copied. */
+  if (dy > 0) {
+    for (row = y2 - 1; row >= y1 + dy; row--)
+      simd_memcpy(fb + (uint32_t)row * (uint32_t)fb_w + (uint32_t)x1,
+                  fb + (uint32_t)(row - dy) * (uint32_t)fb_w + (uint32_t)x1,
+                  bytes);
+  } else {
+    for (row = y1; row < y2 + dy; row++)
+      simd_memcpy(fb + (uint32_t)row * (uint32_t)fb_w + (uint32_t)x1,
+                  fb + (uint32_t)(row - dy) * (uint32_t)fb_w + (uint32_t)x1,
+                  bytes);
+  }
+}
+
 void gfx2d_rect_round(int x, int y, int w, int h, int r, uint32_t color) {
   int i;
   if (r <= 0) {
@@ -520,14 +617,19 @@ void gfx2d_circle(int cx, int cy, int r, uint32_t color) {
 
 void gfx2d_circle_fill(int cx, int cy, int r, uint32_t color) {
   int x = 0, y = r, d = 3 - 2 * r;
+  /* Each row is filled once at its widest span: the cy +/- x rows are
+   * new every step, the cy +/- y rows only once y is about to move on.*/
   while (x <= y) {
-    gfx2d_hline(cx - x, cy + y, 2 * x + 1, color);
-    gfx2d_hline(cx - x, cy - y, 2 * x + 1, color);
     gfx2d_hline(cx - y, cy + x, 2 * y + 1, color);
-    gfx2d_hline(cx - y, cy - x, 2 * y + 1, color);
+    if (x != 0)
+      gfx2d_hline(cx - y, cy - x, 2 * y + 1, color);
     if (d < 0)
       d += 4 * x + 6;
     else {
+      if (x != y) {
+        gfx2d_hline(cx - x, cy + y, 2 * x + 1, color);
+        gfx2d_hline(cx - x, cy - y, 2 * x + 1, color);
+      }
       d += 4 * (x - y) + 10;
       y--;
     }
@@ -601,12 +703,11 @@ void gfx2d_rect_fill_alpha(int x, int y, int w, int h, uint32_t argb) {
     return;
   }
   /* Partial alpha: blend row by row */
-  int row, col;
+  int row;
   uint32_t *fb = g2d_active_fb ? g2d_active_fb : g2d_fb;
   int fb_w = g2d_active_w;
   int fb_h = g2d_active_h;
   uint32_t rgb = argb & 0x00FFFFFFu;
-  uint32_t ia = 255u - a;
   /* Pre-clip */
   int x1 = x, x2 = x + w - 1, y1 = y, y2 = y + h - 1;
   if (g2d_clip_active) {
@@ -621,24 +722,14 @@ void gfx2d_rect_fill_alpha(int x, int y, int w, int h, uint32_t argb) {
   if (y2 >= fb_h) y2 = fb_h - 1;
   if (x1 > x2 || y1 > y2) return;
   int n = x2 - x1 + 1;
-  /* Precompute blended src contribution (constant across all pixels) */
-  uint32_t src_r = ((rgb >> 16) & 0xFFu) * a;
-  uint32_t src_g = ((rgb >> 8)  & 0xFFu) * a;
-  uint32_t src_b = ( rgb        & 0xFFu) * a;
   for (row = y1; row <= y2; row++) {
     uint32_t *dst = fb + (uint32_t)row * (uint32_t)fb_w + (uint32_t)x1;
-    for (col = 0; col < n; col++) {
-      uint32_t d = dst[col];
-      uint32_t r = (src_r + ((d >> 16) & 0xFFu) * ia + 128u) >> 8;
-      uint32_t g = (src_g + ((d >>  8) & 0xFFu) * ia + 128u) >> 8;
-      uint32_t b = (src_b + ( d        & 0xFFu) * ia + 128u) >> 8;
-      dst[col] = (r << 16) | (g << 8) | b;
-    }
+    simd_fill_alpha_row(dst, (uint32_t)n, rgb, (uint8_t)a);
   }
 }
 
 void gfx2d_gradient_h(int x, int y, int w, int h, uint32_t c1, uint32_t c2) {
-  int x1, x2, y1, y2, row, col, n;
+  int x1, x2, y1, y2, row, n;
   uint32_t *first_row;
   uint32_t *fb = g2d_active_fb ? g2d_active_fb : g2d_fb;
   int fb_w = g2d_active_w;
@@ -683,14 +774,8 @@ void gfx2d_gradient_h(int x, int y, int w, int h, uint32_t c1, uint32_t c2) {
     r_fp += r_step * skip;
     g_fp += g_step * skip;
     b_fp += b_step * skip;
-    for (col = 0; col < n; col++) {
-      first_row[col] = (((uint32_t)(r_fp >> 16) & 0xFFu) << 16) |
-                       (((uint32_t)(g_fp >> 16) & 0xFFu) <<  8) |
-                        ((uint32_t)(b_fp >> 16) & 0xFFu);
-      r_fp += r_step;
-      g_fp += g_step;
-      b_fp += b_step;
-    }
+    simd_gradient_row(first_row, (uint32_t)n, r_fp, g_fp, b_fp,
+                      r_step, g_step, b_step);
   }
   for (row = y1 + 1; row <= y2; row++) {
     uint32_t *r = fb + (uint32_t)row * (uint32_t)fb_w + (uint32_t)x1;
@@ -832,6 +917,18 @@ void gfx2d_gradient_h_round(int x, int y, int w, int h, int r,
     r_fp += r_step * off;
     g_fp += g_step * off;
     b_fp += b_step * off;
+    if (g2d_blend_mode_val == GFX2D_BLEND_NORMAL) {
+      int sx = x + off;
+      int n = w - 2 * off;
+      uint32_t *dst = g2d_clip_span(&sx, y + row, &n);
+      if (dst) {
+        int32_t skip = sx - (x + off);
+        simd_gradient_row(dst, (uint32_t)n, r_fp + r_step * skip,
+                          g_fp + g_step * skip, b_fp + b_step * skip,
+                          r_step, g_step, b_step);
+      }
+      continue;
+    }
     int col;
     for (col = off; col < w - off; col++) {
       uint32_t c = (((uint32_t)(r_fp >> 16) & 0xFFu) << 16) |
@@ -875,16 +972,24 @@ void gfx2d_gradient_radial(int x, int y, int w, int h,
   int maxd2 = rx * rx + ry * ry;
   if (maxd2 <= 0) maxd2 = 1;
 
-  /* Only write blend_mode == NORMAL fast path */
+  /* Only write blend_mode == NORMAL fast path. Colors come from a
+   * 256-step ramp indexed by d2 * (255 / maxd2) in 16.16, so the inner
+   * loop is an incremental d2 update and a table load per pixel.*/
   if (g2d_blend_mode_val == GFX2D_BLEND_NORMAL) {
+    static uint32_t ramp[256];
+    uint32_t recip = (255u << 16) / (uint32_t)maxd2;
+    for (int i = 0; i < 256; i++)
+      ramp[i] = g2d_lerp(inner, outer, i, 255);
     for (int py = y1; py <= y2; py++) {
       int dy = py - gcy;
+      int dx = x1 - gcx;
+      int d2 = dx * dx + dy * dy;
       uint32_t *row_ptr = fb + (uint32_t)py * (uint32_t)fb_w + (uint32_t)x1;
       for (int px = x1; px <= x2; px++) {
-        int dx = px - gcx;
-        int d2 = dx * dx + dy * dy;
-        if (d2 > maxd2) d2 = maxd2;
-        *row_ptr++ = g2d_lerp(inner, outer, d2, maxd2);
+        uint32_t idx = ((uint32_t)(d2 < maxd2 ? d2 : maxd2) * recip) >> 16;
+        *row_ptr++ = ramp[idx > 255u ? 255u : idx];
+        d2 += 2 * dx + 1;
+        dx++;
       }
     }
   } else {
@@ -1106,7 +1211,16 @@ void gfx2d_shadow(int x, int y, int w, int h, int blur, uint32_t color) {
   int sh_h = h + blur - 1;
 
   for (int row = 0; row < sh_h; row++) {
-    for (int col = 0; col < sh_w; col++) {
+    /* Past column min(row, blur-1) the pass count stops growing, so the
+     * rest of the row is one constant-alpha span.*/
+    int ramp = (row < blur) ? row : blur - 1;
+    {
+      uint32_t a = (uint32_t)base_a * (uint32_t)(ramp + 1) / (uint32_t)blur;
+      if (a > base_a) a = base_a;
+      if (ramp < sh_w)
+        g2d_span_alpha(sh_x + ramp, sh_y + row, sh_w - ramp, (a << 24) | rgb);
+    }
+    for (int col = 0; col < ramp && col < sh_w; col++) {
       /* How many blur passes cover this pixel?
        * Pass i covers cols [i..i+w-1], rows [i..i+h-1].
        * Number of passes covering (col,row): passes where i<=col && i<=row && i<blur
@@ -1210,6 +1324,20 @@ void gfx2d_scanlines(int x, int y, int w, int h, int alpha) {
 }
 
 void gfx2d_clip_set(int x, int y, int w, int h) {
+  if (g2d_bound_active) {
+    int x1 = x + w;
+    int y1 = y + h;
+    if (x < g2d_bound_x)
+      x = g2d_bound_x;
+    if (y < g2d_bound_y)
+      y = g2d_bound_y;
+    if (x1 > g2d_bound_x + g2d_bound_w)
+      x1 = g2d_bound_x + g2d_bound_w;
+    if (y1 > g2d_bound_y + g2d_bound_h)
+      y1 = g2d_bound_y + g2d_bound_h;
+    w = x1 > x ? x1 - x : 0;
+    h = y1 > y ? y1 - y : 0;
+  }
   g2d_clip_active = 1;
   g2d_clip_x = x;
   g2d_clip_y = y;
@@ -1217,7 +1345,32 @@ void gfx2d_clip_set(int x, int y, int w, int h) {
   g2d_clip_h = h;
 }
 
-void gfx2d_clip_clear(void) { g2d_clip_active = 0; }
+void gfx2d_clip_clear(void) {
+  if (g2d_bound_active) {
+    g2d_clip_active = 1;
+    g2d_clip_x = g2d_bound_x;
+    g2d_clip_y = g2d_bound_y;
+    g2d_clip_w = g2d_bound_w;
+    g2d_clip_h = g2d_bound_h;
+    return;
+  }
+  g2d_clip_active = 0;
+}
+
+void gfx2d_clip_bound_set(int x, int y, int w, int h) {
+  g2d_bound_active = 0;
+  g2d_bound_x = x;
+  g2d_bound_y = y;
+  g2d_bound_w = w;
+  g2d_bound_h = h;
+  g2d_bound_active = 1;
+  gfx2d_clip_clear();
+}
+
+void gfx2d_clip_bound_clear(void) {
+  g2d_bound_active = 0;
+  g2d_clip_active = 0;
+}
 
 bool gfx2d_clip_is_active(void) { return g2d_clip_active != 0; }
 
@@ -1311,6 +1464,16 @@ void gfx2d_sprite_draw_alpha(int handle, int x, int y) {
     return;
   int w = g2d_sprite_w[handle], h = g2d_sprite_h[handle];
   uint32_t *data = g2d_sprite_data[handle];
+  if (g2d_blend_mode_val == GFX2D_BLEND_NORMAL) {
+    for (row = 0; row < h; row++) {
+      int sx = x, n = w;
+      uint32_t *dst = g2d_clip_span(&sx, y + row, &n);
+      if (dst)
+        simd_over_row(dst, data + (uint32_t)row * (uint32_t)w +
+                               (uint32_t)(sx - x), (uint32_t)n);
+    }
+    return;
+  }
   for (row = 0; row < h; row++)
     for (col = 0; col < w; col++)
       g2d_put_alpha(x + col, y + row,
@@ -1325,6 +1488,23 @@ void gfx2d_sprite_draw_scaled(int handle, int x, int y, int dw, int dh) {
     return;
   int sw = g2d_sprite_w[handle], sh = g2d_sprite_h[handle];
   uint32_t *data = g2d_sprite_data[handle];
+  if (dw <= 0 || dh <= 0)
+    return;
+  if (g2d_blend_mode_val == GFX2D_BLEND_NORMAL) {
+    /* Nearest-neighbour in 16.16: no divides inside the row. */
+    uint32_t step = ((uint32_t)sw << 16) / (uint32_t)dw;
+    for (row = 0; row < dh; row++) {
+      int dx = x, n = dw;
+      uint32_t *dst = g2d_clip_span(&dx, y + row, &n);
+      if (!dst)
+        continue;
+      const uint32_t *src = data + (uint32_t)((row * sh) / dh) * (uint32_t)sw;
+      uint32_t fx = (uint32_t)(dx - x) * step;
+      for (col = 0; col < n; col++, fx += step)
+        dst[col] = src[fx >> 16] & 0x00FFFFFFu;
+    }
+    return;
+  }
   for (row = 0; row < dh; row++) {
     int sy = (row * sh) / dh;
     for (col = 0; col < dw; col++) {
@@ -1898,11 +2078,25 @@ void gfx2d_surface_blit(int handle, int x, int y) {
     int fb_w = g2d_active_w;
     int fb_h = g2d_active_h;
 
-    if (g2d_blend_mode_val == GFX2D_BLEND_NORMAL && !g2d_clip_active && x >= 0 &&
-        y >= 0 && x + sw <= fb_w && y + sh <= fb_h) {
-      for (int sy = 0; sy < sh; sy++) {
-        memcpy(fb + (uint32_t)(y + sy) * (uint32_t)fb_w + (uint32_t)x,
-               src + (uint32_t)sy * (uint32_t)sw, (uint32_t)sw * 4u);
+    if (g2d_blend_mode_val == GFX2D_BLEND_NORMAL) {
+      /* Row copies of the part of the surface inside the clip and the
+       * target bounds (the compositor blits partially occluded windows
+       * through a clip, so this must not degrade to per-pixel puts).*/
+      int x0 = x, y0 = y, x1 = x + sw, y1 = y + sh;
+      if (g2d_clip_active) {
+        if (x0 < g2d_clip_x) x0 = g2d_clip_x;
+        if (y0 < g2d_clip_y) y0 = g2d_clip_y;
+        if (x1 > g2d_clip_x + g2d_clip_w) x1 = g2d_clip_x + g2d_clip_w;
+        if (y1 > g2d_clip_y + g2d_clip_h) y1 = g2d_clip_y + g2d_clip_h;
+      }
+      if (x0 < 0) x0 = 0;
+      if (y0 < 0) y0 = 0;
+      if (x1 > fb_w) x1 = fb_w;
+      if (y1 > fb_h) y1 = fb_h;
+      for (int dy = y0; dy < y1 && x0 < x1; dy++) {
+        memcpy(fb + (uint32_t)dy * (uint32_t)fb_w + (uint32_t)x0,
+               src + (uint32_t)(dy - y) * (uint32_t)sw + (uint32_t)(x0 - x),
+               (uint32_t)(x1 - x0) * 4u);
       }
       return;
     }
@@ -1976,6 +2170,30 @@ void gfx2d_surface_blit_scaled(int handle, int x, int y, int w, int h) {
   }
 
   uint32_t *src = g2d_surf_data[handle];
+  if (g2d_blend_mode_val == GFX2D_BLEND_NORMAL) {
+    /* Bilinear filtering, sampling at destination pixel centers. */
+    uint32_t sx_step = ((uint32_t)sw << 16) / (uint32_t)w;
+    uint32_t sy_step = ((uint32_t)sh << 16) / (uint32_t)h;
+    uint32_t sx0 = sx_step > 0x10000u ? (sx_step - 0x10000u) / 2u : 0u;
+    uint32_t sy0 = sy_step > 0x10000u ? (sy_step - 0x10000u) / 2u : 0u;
+    for (int dy = 0; dy < h; dy++) {
+      int dx = x, n = w;
+      uint32_t *dst = g2d_clip_span(&dx, y + dy, &n);
+      if (!dst)
+        continue;
+      uint32_t sy_fp = sy0 + (uint32_t)dy * sy_step;
+      uint32_t sy = sy_fp >> 16;
+      uint32_t sy1 = sy + 1u < (uint32_t)sh ? sy + 1u : sy;
+      if (sy >= (uint32_t)sh)
+        sy = sy1 = (uint32_t)sh - 1u;
+      simd_scale_row_bilinear(dst, src + sy * (uint32_t)sw,
+                              src + sy1 * (uint32_t)sw, (uint32_t)sw,
+                              (uint32_t)n,
+                              sx0 + (uint32_t)(dx - x) * sx_step, sx_step,
+                              (sy_fp >> 8) & 0xFFu);
+    }
+    return;
+  }
   for (int dy = 0; dy < h; dy++) {
     int sy = (dy * sh) / h;
     for (int dx = 0; dx < w; dx++) {
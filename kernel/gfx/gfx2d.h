@@ -49,6 +49,7 @@ void gfx2d_vline(int x, int y, int h, uint32_t color);
 
 void gfx2d_rect(int x, int y, int w, int h, uint32_t color);
 void gfx2d_rect_fill(int x, int y, int w, int h, uint32_t color);
+void gfx2d_scroll_rect(int x, int y, int w, int h, int dy);
 void gfx2d_rect_round(int x, int y, int w, int h, int r, uint32_t color);
 void gfx2d_rect_round_fill(int x, int y, int w, int h, int r, uint32_t color);
 
@@ -92,6 +93,10 @@ void gfx2d_clip_set(int x, int y, int w, int h);
 void gfx2d_clip_clear(void);
 bool gfx2d_clip_is_active(void);
 void gfx2d_clip_get(int *x, int *y, int *w, int *h);
+/* Compositor clip bound: while set, gfx2d_clip_set intersects with it
+ * and gfx2d_clip_clear restores it instead of disabling clipping.*/
+void gfx2d_clip_bound_set(int x, int y, int w, int h);
+void gfx2d_clip_bound_clear(void);
 
 int gfx2d_sprite_load(const char *path);
 void gfx2d_sprite_free(int handle);
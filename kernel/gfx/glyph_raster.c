@@ -6,11 +6,17 @@
  *      off-curve points imply an implicit on-curve midpoint (TT spec).
  *      Curves are flattened by recursive midpoint subdivision until the
  *      segment is shorter than 0.35 px in pixel space.
- *   2. Allocate the alpha buffer at ceil(bbox in pixels).
- *   3. For each subpixel row (4 per output pixel), find edge crossings,
- *      sort by x, fill using non-zero winding, accumulate per-pixel
- *      coverage. After 4 sub-rows, write coverage * 16 (clamped) to
- *      the alpha buffer.
+ *   2. Allocate the alpha buffer at ceil(bbox in pixels), widened by one
+ *      column when the outline is shifted by a subpixel phase.
+ *   3. Every segment deposits its signed area into a float accumulation
+ *      buffer, cell by cell (font-rs / stb_truetype v2 style): each cell
+ *      receives the change in coverage the edge causes at that column.
+ *   4. One running prefix sum over the whole buffer turns those deltas
+ *      into coverage; |coverage| clamped to 1 becomes the 8-bit alpha
+ *      (simd_coverage_accumulate, SSE2 when available).
+ *
+ * No per-row crossing lists or sorting, and the output is exact area
+ * coverage rather than a 4x4 sample count.
  *
  * Floating-point work is kept inside this file. Public API takes/returns
  * ints only - matches the warning in bin/feature15_libm.cc:3 about
@@ -20,6 +26,7 @@
 #include "glyph_raster.h"
 #include "../mm/memory.h"
 #include "string.h"
+#include "../cpu/simd.h"
 
 /* libm's floor/ceil use a CupidC-internal ABI (return in xmm0, not ST(0)),
  * so plain kernel C cannot call them - see kernel/cpu/libm.h:17. We do all
@@ -36,8 +43,6 @@ static inline int float_ceil_int(float v) {
 }
 
 #define MAX_SEGS    8192
-#define MAX_CROSS    256
-#define SUBPIX         4
 
 /* Per-call scratch. Glyphs are processed serially in the cache; one
  * static arena is enough and avoids heap churn on every glyph miss.*/
@@ -47,9 +52,6 @@ static float seg_x1[MAX_SEGS];
 static float seg_y1[MAX_SEGS];
 static int   seg_n;
 
-static float xcross[MAX_CROSS];
-static int   xdir  [MAX_CROSS];
-
 static void emit_seg(float x0, float y0, float x1, float y1) {
     if (seg_n >= MAX_SEGS) return;
     /* Drop horizontal segments - they never cross a scanline. */
@@ -149,19 +151,77 @@ static void emit_contour(const int *xs, const int *ys, const int *on_curve,
     }
 }
 
-/* Insertion sort the first n entries of xcross[] / xdir[] by xcross. */
-static void sort_crossings(int n) {
-    for (int i = 1; i < n; i++) {
-        float kx = xcross[i];
-        int   kd = xdir[i];
-        int j = i - 1;
-        while (j >= 0 && xcross[j] > kx) {
-            xcross[j + 1] = xcross[j];
-            xdir  [j + 1] = xdir  [j];
-            j--;
+/* Accumulate one line segment into acc (row stride w, h rows). For
+ * each pixel row it crosses, the segment's signed height d is split
+ * between the cells it passes through by the area left of the edge;
+ * the prefix sum later integrates these deltas into coverage. Writes
+ * may land one cell past a row's end - that is the next row's first
+ * cell, which is exactly where a running sum wants them.*/
+static void accumulate_line(float *acc, int w, int h,
+                            float x0, float y0, float x1, float y1) {
+    float dir;
+    if (y0 == y1) return;
+    if (y0 < y1) {
+        dir = 1.0f;
+    } else {
+        float t;
+        dir = -1.0f;
+        t = x0; x0 = x1; x1 = t;
+        t = y0; y0 = y1; y1 = t;
+    }
+    float dxdy = (x1 - x0) / (y1 - y0);
+    float x = x0;
+    if (y0 < 0.0f) {
+        x -= y0 * dxdy;
+        y0 = 0.0f;
+    }
+    int ystart = float_floor_int(y0);
+    int yend = float_ceil_int(y1);
+    if (yend > h) yend = h;
+    float xmax = (float)w;
+
+    for (int y = ystart; y < yend; y++) {
+        float ytop = (float)y > y0 ? (float)y : y0;
+        float ybot = (float)(y + 1) < y1 ? (float)(y + 1) : y1;
+        float dy = ybot - ytop;
+        float xnext = x + dxdy * dy;
+        float d = dy * dir;
+        float xa = x < xnext ? x : xnext;
+        float xb = x < xnext ? xnext : x;
+        if (xa < 0.0f) xa = 0.0f;
+        if (xb < 0.0f) xb = 0.0f;
+        if (xa > xmax) xa = xmax;
+        if (xb > xmax) xb = xmax;
+        float *row = acc + y * w;
+        int x0i = float_floor_int(xa);
+        int x1i = float_ceil_int(xb);
+
+        if (x1i <= x0i + 1) {
+            /* Edge stays inside one cell: split d by its mean x. */
+            float xm = 0.5f * (xa + xb) - (float)x0i;
+            row[x0i] += d - d * xm;
+            row[x0i + 1] += d * xm;
+        } else {
+            float inv = 1.0f / (xb - xa);
+            float x0f = xa - (float)x0i;
+            float a0 = 0.5f * inv * (1.0f - x0f) * (1.0f - x0f);
+            float x1f = xb - (float)x1i + 1.0f;
+            float am = 0.5f * inv * x1f * x1f;
+            row[x0i] += d * a0;
+            if (x1i == x0i + 2) {
+                row[x0i + 1] += d * (1.0f - a0 - am);
+            } else {
+                float a1 = inv * (1.5f - x0f);
+                row[x0i + 1] += d * (a1 - a0);
+                for (int xi = x0i + 2; xi < x1i - 1; xi++) {
+                    row[xi] += d * inv;
+                }
+                float a2 = a1 + (float)(x1i - x0i - 3) * inv;
+                row[x1i - 1] += d * (1.0f - a2 - am);
+            }
+            row[x1i] += d * am;
         }
-        xcross[j + 1] = kx;
-        xdir  [j + 1] = kd;
+        x = xnext;
     }
 }
 
@@ -173,19 +233,38 @@ int glyph_rasterize(const int *xs, const int *ys, const int *on_curve,
                     uint8_t **out_alpha,
                     int *out_w, int *out_h,
                     int *out_bx, int *out_by) {
+    return glyph_rasterize_shifted(xs, ys, on_curve, n_pts,
+                                   contour_end, n_ctrs,
+                                   xmin, ymin, xmax, ymax,
+                                   units_per_em, size_px, 0,
+                                   out_alpha, out_w, out_h, out_bx, out_by);
+}
+
+int glyph_rasterize_shifted(const int *xs, const int *ys, const int *on_curve,
+                            int n_pts,
+                            const int *contour_end, int n_ctrs,
+                            int xmin, int ymin, int xmax, int ymax,
+                            int units_per_em, int size_px, int shift_64,
+                            uint8_t **out_alpha,
+                            int *out_w, int *out_h,
+                            int *out_bx, int *out_by) {
     *out_alpha = NULL;
     *out_w = 0; *out_h = 0; *out_bx = 0; *out_by = 0;
     if (n_pts <= 0 || n_ctrs <= 0 || size_px <= 0 || units_per_em <= 0) {
         return 0;
     }
+    if (shift_64 < 0) shift_64 = 0;
+    if (shift_64 > 63) shift_64 = 63;
 
     float scale = (float)size_px / (float)units_per_em;
+    float shift = (float)shift_64 / 64.0f;
 
     /* Pixel-space bbox: Y is flipped (font Y up -> bitmap Y down). The
      * glyph's font-space ymax sits at the smallest pixel-space y. We
-     * translate so the bbox starts at pixel-space (0, 0).*/
-    float pxmin = (float)xmin * scale;
-    float pxmax = (float)xmax * scale;
+     * translate so the bbox starts at pixel-space (0, 0). The subpixel
+     * shift moves ink right within the same pen cell.*/
+    float pxmin = (float)xmin * scale + shift;
+    float pxmax = (float)xmax * scale + shift;
     float pymin = -(float)ymax * scale;       /* top */
     float pymax = -(float)ymin * scale;       /* bottom */
 
@@ -202,17 +281,13 @@ int glyph_rasterize(const int *xs, const int *ys, const int *on_curve,
      * font-space Y yF, the bitmap row is (-yF * scale) - iy0.*/
     float pen_y_off = -(float)iy0;
     /* x_off so leftmost pixel-space coord lands at column 0. */
-    float pen_x_off = -(float)ix0;
+    float pen_x_off = shift - (float)ix0;
 
     seg_n = 0;
     int prev = 0;
     for (int c = 0; c < n_ctrs; c++) {
         int last = contour_end[c];
         if (last >= n_pts) last = n_pts - 1;
-        /* Translate + scale all points by emit_contour, but x_off is
-         * applied here by passing pre-shifted scale results - simpler
-         * to subtract ix0 inside emit by passing scale and then shifting
-         * the segs. Doing it in a tight post-loop instead.*/
         emit_contour(xs, ys, on_curve, prev, last, scale, pen_y_off);
         prev = last + 1;
     }
@@ -224,86 +299,24 @@ int glyph_rasterize(const int *xs, const int *ys, const int *on_curve,
 
     if (seg_n == 0) return 0;       /* glyph has no ink */
 
-    size_t bytes = (size_t)w * (size_t)h;
-    uint8_t *alpha = (uint8_t *)kmalloc(bytes);
+    size_t cells = (size_t)w * (size_t)h;
+    uint8_t *alpha = (uint8_t *)kmalloc(cells);
     if (!alpha) return -1;
-    memset(alpha, 0, bytes);
 
-    /* Per-pixel-row coverage accumulator: counts subpixels lit (0..16). */
-    int *cov = (int *)kmalloc((size_t)w * sizeof(int));
-    if (!cov) { kfree(alpha); return -1; }
+    /* Spare cells for the past-the-end writes of the last row, rounded
+     * up so the SIMD pass can read whole vectors.*/
+    size_t acc_cells = (cells + 2u + 3u) & ~(size_t)3u;
+    float *acc = (float *)kmalloc(acc_cells * sizeof(float));
+    if (!acc) { kfree(alpha); return -1; }
+    memset(acc, 0, acc_cells * sizeof(float));
 
-    for (int y_pix = 0; y_pix < h; y_pix++) {
-        for (int i = 0; i < w; i++) cov[i] = 0;
-
-        for (int sub = 0; sub < SUBPIX; sub++) {
-            float sy = (float)y_pix + ((float)sub + 0.5f) / (float)SUBPIX;
-
-            /* Collect edges that straddle sy, in [y0, y1) half-open. */
-            int n_cross = 0;
-            for (int i = 0; i < seg_n; i++) {
-                float y0 = seg_y0[i];
-                float y1 = seg_y1[i];
-                int dir;
-                float ylo, yhi, x_at_lo, x_at_hi;
-                if (y0 < y1) {
-                    dir = -1;             /* down (winding -) */
-                    ylo = y0; yhi = y1;
-                    x_at_lo = seg_x0[i]; x_at_hi = seg_x1[i];
-                } else {
-                    dir = 1;              /* up   (winding +) */
-                    ylo = y1; yhi = y0;
-                    x_at_lo = seg_x1[i]; x_at_hi = seg_x0[i];
-                }
-                if (sy < ylo || sy >= yhi) continue;
-                float t = (sy - ylo) / (yhi - ylo);
-                float x = x_at_lo + (x_at_hi - x_at_lo) * t;
-                if (n_cross < MAX_CROSS) {
-                    xcross[n_cross] = x;
-                    xdir  [n_cross] = dir;
-                    n_cross++;
-                }
-            }
-            if (n_cross < 2) continue;
-            sort_crossings(n_cross);
-
-            /* Non-zero winding sweep across this subpixel row. */
-            int wn = 0;
-            float xs_open = 0.0f;
-            for (int k = 0; k < n_cross; k++) {
-                int new_wn = wn + xdir[k];
-                if (wn == 0 && new_wn != 0) {
-                    xs_open = xcross[k];
-                } else if (wn != 0 && new_wn == 0) {
-                    float xa = xs_open;
-                    float xb = xcross[k];
-                    int ia = float_floor_int(xa * (float)SUBPIX);
-                    int ib = float_ceil_int (xb * (float)SUBPIX);
-                    if (ia < 0) ia = 0;
-                    if (ib > w * SUBPIX) ib = w * SUBPIX;
-                    /* Each lit subpixel column lights one slot of the
-                     * containing output pixel.*/
-                    for (int sx = ia; sx < ib; sx++) {
-                        cov[sx / SUBPIX]++;
-                    }
-                }
-                wn = new_wn;
-            }
-        }
-
-        /* Resolve 0..16 coverage to 0..255 alpha. */
-        for (int x_pix = 0; x_pix < w; x_pix++) {
-            int c = cov[x_pix];
-            if (c < 0) c = 0;
-            if (c > 16) c = 16;
-            int a = c * 16;
-            if (a > 255) a = 255;
-            alpha[y_pix * w + x_pix] = (uint8_t)a;
-        }
+    for (int i = 0; i < seg_n; i++) {
+        accumulate_line(acc, w, h, seg_x0[i], seg_y0[i],
+                        seg_x1[i], seg_y1[i]);
     }
+    simd_coverage_accumulate(alpha, acc, (uint32_t)cells);
 
-    kfree(cov);
-
+    kfree(acc);
     *out_alpha = alpha;
     *out_w = w;
     *out_h = h;
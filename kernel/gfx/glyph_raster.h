@@ -2,8 +2,8 @@
  *
  * Takes a font-unit outline (flat point arrays + per-contour endpoints,
  * as produced by ttf_glyph_outline) and produces an anti-aliased
- * coverage bitmap at a given pixel size. 4x4 supersampling, non-zero
- * winding fill, no hinting.*/
+ * coverage bitmap at a given pixel size. Exact signed-area coverage
+ * (accumulation buffer + prefix sum), no hinting.*/
 
 #ifndef GLYPH_RASTER_H
 #define GLYPH_RASTER_H
@@ -37,4 +37,16 @@ int glyph_rasterize(const int *xs, const int *ys, const int *on_curve,
                     int *out_w, int *out_h,
                     int *out_bx, int *out_by);
 
+/* Same, with the outline shifted right by shift_64/64 px (0..63) before
+ * rasterizing. The glyph cache uses this for subpixel pen positions;
+ * out_bx still refers to the unshifted pen.*/
+int glyph_rasterize_shifted(const int *xs, const int *ys, const int *on_curve,
+                            int n_pts,
+                            const int *contour_end, int n_ctrs,
+                            int xmin, int ymin, int xmax, int ymax,
+                            int units_per_em, int size_px, int shift_64,
+                            uint8_t **out_alpha,
+                            int *out_w, int *out_h,
+                            int *out_bx, int *out_by);
+
 #endif /* GLYPH_RASTER_H */
@@ -2,15 +2,25 @@
  * jpeg.c - Minimal baseline JPEG decoder for cupid-os
  *
  * Decodes SOF0/SOF1 baseline JPEGs into 32bpp XRGB pixel buffers.
- * Uses two-pass O(N^2) IDCT in single-precision float (FPU enabled
- * at boot).  Handles 1-component grayscale and 3-component YCbCr
- * with sub-samplings 1x1, 2x1, 1x2, 2x2.  Restart markers are
+ * Entropy decoding reads from a 32-bit bit reservoir through 9-bit
+ * lookahead Huffman tables; the 8x8 inverse DCT is the fixed-point
+ * AAN flow graph in simd.c (SSE2 with a scalar fallback).  Handles
+ * 1-component grayscale and 3-component YCbCr with sub-samplings 1x1,
+ * 2x1, 1x2, 2x2.  jpeg_decode_mem_scaled() decodes at 1/2, 1/4 or 1/8
+ * size by running a reduced IDCT on the low-frequency coefficients, so
+ * thumbnails never touch the full-size image.  Restart markers are
  * honoured; progressive, arithmetic, 12-bit, and CMYK are rejected.
 */
 
 #include "jpeg.h"
 #include "memory.h"
-#include "libm.h"
+#include "string.h"
+#include "simd.h"
+#ifdef JPEG_BENCH
+#include "serial.h"
+#include "timer.h"
+#include "vfs_helpers.h"
+#endif
 
 /* bit reader (MSB-first, byte stuffing) */
 
@@ -18,99 +28,129 @@ typedef struct {
     const uint8_t *src;
     uint32_t       len;
     uint32_t       pos;
-    uint32_t       buf;
-    int            buf_bits;
+    uint32_t       acc;        /* unread bits, MSB-aligned */
+    int            bits;       /* valid bits in acc */
+    int            pad;        /* zero bits appended past a marker/end */
     uint8_t        marker;     /* if a marker was hit while feeding bits */
-    int            eof;
 } jp_bits_t;
 
-static int jp_get_bit(jp_bits_t *s) {
-    if (s->buf_bits == 0) {
-        if (s->eof || s->pos >= s->len) { s->eof = 1; return 0; }
-        uint8_t b = s->src[s->pos++];
-        if (b == 0xFF) {
-            if (s->pos >= s->len) { s->eof = 1; return 0; }
-            uint8_t nx = s->src[s->pos++];
-            if (nx != 0x00) {
-                s->marker = nx;
-                s->eof = 1;
-                return 0;
+/* Top the reservoir up to at least 25 bits. Past a marker or the end of
+ * the data it is fed zero bytes; consuming any of them is an overrun.*/
+static void jp_fill(jp_bits_t *s) {
+    while (s->bits <= 24) {
+        uint32_t b = 0;
+        if (!s->marker && s->pos < s->len) {
+            b = s->src[s->pos];
+            if (b == 0xFF) {
+                uint8_t nx = s->pos + 1 < s->len ? s->src[s->pos + 1] : 0xD9;
+                s->pos += 2;
+                if (nx != 0x00) {
+                    s->marker = nx;
+                    b = 0;
+                    s->pad += 8;
+                }
+            } else {
+                s->pos++;
             }
+        } else {
+            s->pad += 8;
         }
-        s->buf = (s->buf << 8) | b;
-        s->buf_bits += 8;
+        s->acc |= b << (24 - s->bits);
+        s->bits += 8;
     }
-    s->buf_bits--;
-    return (int)((s->buf >> (uint32_t)s->buf_bits) & 1u);
 }
 
-static int jp_get_bits(jp_bits_t *s, int n) {
-    int v = 0;
-    int i;
-    for (i = 0; i < n; i++) {
-        v = (v << 1) | jp_get_bit(s);
-    }
-    return v;
+#define JP_OVERRUN(s) ((s)->bits < (s)->pad)
+
+static uint32_t jp_peek(const jp_bits_t *s, int n) {
+    return s->acc >> (32 - n);
+}
+
+static void jp_skip(jp_bits_t *s, int n) {
+    s->acc <<= n;
+    s->bits -= n;
 }
 
-static int jp_extend(int v, int n) {
-    if (n == 0) return 0;
-    int vt = 1 << (n - 1);
-    if (v < vt) v -= (1 << n) - 1;
+/* Read an n-bit magnitude (1 <= n <= 16) and sign-extend it. */
+static int jp_receive_extend(jp_bits_t *s, int n) {
+    if (s->bits < n) jp_fill(s);
+    int v = (int)jp_peek(s, n);
+    jp_skip(s, n);
+    if (v < (1 << (n - 1))) v -= (1 << n) - 1;
     return v;
 }
 
-/* Huffman table (canonical) */
+static void jp_bits_reset(jp_bits_t *s) {
+    s->acc = 0;
+    s->bits = 0;
+    s->pad = 0;
+}
+
+/* Huffman table (canonical). Codes up to JP_LOOKAHEAD bits resolve in
+ * one table probe; longer ones walk maxcode[] like libjpeg's slow path. */
+
+#define JP_LOOKAHEAD 9
 
 typedef struct {
-    int16_t count[17];
-    int16_t symbol[256];
+    uint8_t look_len[1 << JP_LOOKAHEAD];   /* 0 = code is longer */
+    uint8_t look_sym[1 << JP_LOOKAHEAD];
+    int32_t maxcode[17];                   /* -1 = no codes of length */
+    int32_t valoff[17];
+    uint8_t symbol[256];
     int     ok;
 } jp_huff_t;
 
 static int jp_huff_build(jp_huff_t *h, const uint8_t *bits16,
                          const uint8_t *vals, int nvals) {
     int i, len;
-    int16_t offs[17];
-    for (i = 0; i < 17; i++) h->count[i] = 0;
-    for (len = 1; len <= 16; len++) {
-        h->count[len] = (int16_t)bits16[len - 1];
-    }
     int total = 0;
-    for (len = 1; len <= 16; len++) total += (int)h->count[len];
+    for (len = 1; len <= 16; len++) total += (int)bits16[len - 1];
     if (total != nvals || total > 256) { h->ok = 0; return -1; }
-    offs[1] = 0;
-    for (len = 1; len < 16; len++) {
-        offs[len + 1] = (int16_t)(offs[len] + h->count[len]);
-    }
+    for (i = 0; i < nvals; i++) h->symbol[i] = vals[i];
+    memset(h->look_len, 0, sizeof(h->look_len));
+
+    int32_t code = 0;
     int idx = 0;
     for (len = 1; len <= 16; len++) {
-        int c = (int)h->count[len];
-        for (i = 0; i < c; i++) {
-            h->symbol[offs[len]++] = (int16_t)vals[idx++];
+        int c = (int)bits16[len - 1];
+        h->valoff[len] = idx - code;
+        h->maxcode[len] = c ? code + c - 1 : -1;
+        if (code + c > (1 << len)) { h->ok = 0; return -1; }
+        for (i = 0; i < c; i++, code++, idx++) {
+            if (len <= JP_LOOKAHEAD) {
+                int shift = JP_LOOKAHEAD - len;
+                int first = (int)code << shift;
+                int j;
+                for (j = 0; j < (1 << shift); j++) {
+                    h->look_len[first + j] = (uint8_t)len;
+                    h->look_sym[first + j] = vals[idx];
+                }
+            }
         }
+        code <<= 1;
     }
     h->ok = 1;
     return 0;
 }
 
 static int jp_huff_decode(jp_bits_t *s, const jp_huff_t *h) {
-    int code = 0, first = 0, idx = 0, len, count;
-    for (len = 1; len <= 16; len++) {
-        code = (code << 1) | jp_get_bit(s);
-        if (s->eof) return -1;
-        count = (int)h->count[len];
-        if (code < first + count) {
-            return (int)h->symbol[idx + (code - first)];
+    if (s->bits < 16) jp_fill(s);
+    uint32_t look = jp_peek(s, JP_LOOKAHEAD);
+    int len = (int)h->look_len[look];
+    if (len) {
+        jp_skip(s, len);
+        return (int)h->look_sym[look];
+    }
+    for (len = JP_LOOKAHEAD + 1; len <= 16; len++) {
+        int32_t code = (int32_t)jp_peek(s, len);
+        if (code <= h->maxcode[len]) {
+            jp_skip(s, len);
+            return (int)h->symbol[code + h->valoff[len]];
         }
-        idx += count;
-        first = (first + count) << 1;
     }
     return -1;
 }
 
-/* IDCT (two-pass O(N^2) using float cos table) */
-
 static const uint8_t jp_zigzag[64] = {
      0,  1,  8, 16,  9,  2,  3, 10,
     17, 24, 32, 25, 18, 11,  4,  5,
@@ -122,49 +162,91 @@ static const uint8_t jp_zigzag[64] = {
     53, 60, 61, 54, 47, 55, 62, 63
 };
 
-/* IDCT basis-function table = 0.5 * Cu * cos((2j+1)u * pi/16). Hardcoded
- * to avoid depending on the kernel's runtime cosf() (which uses the FPU
- * fcos opcode and can return imprecise values from a cold boot context
- * before SSE/FPU stabilises). Values match Python's math.cos to single
- * precision; matches Blink's libjpeg-turbo equivalent jpeg_idct_islow
- * scaled-cosine constants.*/
-static const float jp_cos_tbl[8][8] = {
-    {  0.35355339f,  0.35355339f,  0.35355339f,  0.35355339f,  0.35355339f,  0.35355339f,  0.35355339f,  0.35355339f },
-    {  0.49039264f,  0.41573481f,  0.27778512f,  0.09754516f, -0.09754516f, -0.27778512f, -0.41573481f, -0.49039264f },
-    {  0.46193977f,  0.19134172f, -0.19134172f, -0.46193977f, -0.46193977f, -0.19134172f,  0.19134172f,  0.46193977f },
-    {  0.41573481f, -0.09754516f, -0.49039264f, -0.27778512f,  0.27778512f,  0.49039264f,  0.09754516f, -0.41573481f },
-    {  0.35355339f, -0.35355339f, -0.35355339f,  0.35355339f,  0.35355339f, -0.35355339f, -0.35355339f,  0.35355339f },
-    {  0.27778512f, -0.49039264f,  0.09754516f,  0.41573481f, -0.41573481f, -0.09754516f,  0.49039264f, -0.27778512f },
-    {  0.19134172f, -0.46193977f,  0.46193977f, -0.19134172f, -0.19134172f,  0.46193977f, -0.46193977f,  0.19134172f },
-    {  0.09754516f, -0.27778512f,  0.41573481f, -0.49039264f,  0.49039264f, -0.41573481f,  0.27778512f, -0.09754516f },
+/* AAN output scale factors cos(k*pi/16)*sqrt(2) (1 for k=0), row x
+ * column, in Q14. Folded into the dequantization table together with
+ * the 2^2 working precision simd_idct8x8_aan expects. */
+static const uint16_t jp_aan_scale[64] = {
+    16384, 22725, 21407, 19266, 16384, 12873,  8867,  4520,
+    22725, 31521, 29692, 26722, 22725, 17855, 12299,  6270,
+    21407, 29692, 27969, 25172, 21407, 16819, 11585,  5906,
+    19266, 26722, 25172, 22654, 19266, 15137, 10426,  5315,
+    16384, 22725, 21407, 19266, 16384, 12873,  8867,  4520,
+    12873, 17855, 16819, 15137, 12873, 10114,  6967,  3552,
+     8867, 12299, 11585, 10426,  8867,  6967,  4799,  2446,
+     4520,  6270,  5906,  5315,  4520,  3552,  2446,  1247
 };
 
-static void jp_idct(const int16_t in[64], uint8_t out[64]) {
-    float temp[64];
-    int u, v, i, j;
-    for (u = 0; u < 8; u++) {
-        for (j = 0; j < 8; j++) {
-            float sum = 0.0f;
-            for (v = 0; v < 8; v++) {
-                sum += (float)in[u * 8 + v] * jp_cos_tbl[v][j];
-            }
-            temp[u * 8 + j] = sum;
+/* Reduced IDCT bases 0.5 * Cu * cos((2x+1)u*pi/2n) in Q12 for n = 2, 4.
+ * Keeping only the low n x n coefficients of a block and running an
+ * n-point transform yields its n x n box-filtered downscale directly. */
+static const int16_t jp_red2[2][2] = {
+    { 1448,  1448 },
+    { 1448, -1448 },
+};
+
+static const int16_t jp_red4[4][4] = {
+    { 1448,  1892,  1448,   784 },
+    { 1448,   784, -1448, -1892 },
+    { 1448,  -784, -1448,  1892 },
+    { 1448, -1892,  1448,  -784 },
+};
+
+static uint8_t jp_clamp(int v) {
+    if (v < 0)   return 0;
+    if (v > 255) return 255;
+    return (uint8_t)v;
+}
+
+static void jp_idct_reduced(const int16_t coef[64], int n,
+                            uint8_t *out, uint32_t stride) {
+    const int16_t *t = (n == 2) ? &jp_red2[0][0] : &jp_red4[0][0];
+    int32_t tmp[4][4];
+    int x, y, u, v;
+    /* columns: Q12 products, kept at Q2 */
+    for (u = 0; u < n; u++) {
+        for (y = 0; y < n; y++) {
+            int32_t sum = 0;
+            for (v = 0; v < n; v++)
+                sum += (int32_t)t[y * n + v] * coef[v * 8 + u];
+            tmp[y][u] = (sum + (1 << 9)) >> 10;
         }
     }
-    for (j = 0; j < 8; j++) {
-        for (i = 0; i < 8; i++) {
-            float sum = 0.0f;
-            for (u = 0; u < 8; u++) {
-                sum += temp[u * 8 + j] * jp_cos_tbl[u][i];
-            }
-            int val = (int)(sum + 128.5f);
-            if (val < 0)   val = 0;
-            if (val > 255) val = 255;
-            out[i * 8 + j] = (uint8_t)val;
+    for (y = 0; y < n; y++) {
+        for (x = 0; x < n; x++) {
+            int32_t sum = 1 << 13;
+            for (u = 0; u < n; u++)
+                sum += (int32_t)t[x * n + u] * tmp[y][u];
+            out[x] = jp_clamp((int)(sum >> 14) + 128);
         }
+        out += stride;
     }
 }
 
+/* Inverse-transform one block into a bs x bs patch (bs = 8 / scale).
+ * last is the zig-zag index of the final coded coefficient; DC-only
+ * blocks (the common case in smooth areas) are a flat fill.*/
+static void jp_idct_block(const int16_t coef[64], int last, int bs,
+                          uint8_t *out, uint32_t stride) {
+    int x, y;
+    if (bs == 8) {
+        if (last == 0) {
+            uint8_t v = jp_clamp(((coef[0] + 16) >> 5) + 128);
+            for (y = 0; y < 8; y++, out += stride)
+                for (x = 0; x < 8; x++) out[x] = v;
+            return;
+        }
+        simd_idct8x8_aan(out, stride, coef);
+        return;
+    }
+    if (bs == 1 || last == 0) {
+        uint8_t v = jp_clamp(((coef[0] + 4) >> 3) + 128);
+        for (y = 0; y < bs; y++, out += stride)
+            for (x = 0; x < bs; x++) out[x] = v;
+        return;
+    }
+    jp_idct_reduced(coef, bs, out, stride);
+}
+
 /* decoder state */
 
 typedef struct {
@@ -182,7 +264,8 @@ typedef struct {
     int       restart_count;
     int       dc_pred[3];
 
-    int16_t   qt[4][64];
+    int16_t   qt[4][64];           /* as stored: zig-zag order */
+    int32_t   qk[4][64];           /* dequant multipliers (Q8), natural */
     int       qt_present[4];
     jp_huff_t hdc[4];
     jp_huff_t hac[4];
@@ -261,6 +344,14 @@ static int jp_parse_sof(jp_state_t *s, const uint8_t *seg, int len) {
         if ((int)s->comp[i].hsamp > s->max_h) s->max_h = s->comp[i].hsamp;
         if ((int)s->comp[i].vsamp > s->max_v) s->max_v = s->comp[i].vsamp;
     }
+    if (s->ncomp == 1) {
+        /* a single-component scan is non-interleaved: one block per MCU
+         * whatever the sampling factors say */
+        s->comp[0].hsamp = 1;
+        s->comp[0].vsamp = 1;
+        s->max_h = 1;
+        s->max_v = 1;
+    }
     return JPEG_OK;
 }
 
@@ -283,27 +374,31 @@ static int jp_parse_sos(jp_state_t *s, const uint8_t *seg, int len) {
 
 /* block decode */
 
-static int jp_decode_block(jp_state_t *s, int comp_idx, uint8_t out[64]) {
-    int16_t coef[64];
-    int i;
-    for (i = 0; i < 64; i++) coef[i] = 0;
+/* Entropy-decode one block into dequantized natural-order coefficients.
+ * Returns the zig-zag index of the last coded coefficient (0 for a
+ * DC-only block) or JPEG_ESTREAM.*/
+static int jp_decode_block(jp_state_t *s, int comp_idx, int16_t coef[64]) {
+    memset(coef, 0, 64 * sizeof(int16_t));
 
     int qt_id = s->comp[comp_idx].qt_id;
     int dc_id = s->comp[comp_idx].dc_id;
     int ac_id = s->comp[comp_idx].ac_id;
     if (!s->qt_present[qt_id]) return JPEG_ESTREAM;
     if (!s->hdc[dc_id].ok || !s->hac[ac_id].ok) return JPEG_ESTREAM;
-    const int16_t *qt = s->qt[qt_id];
+    const int32_t *qk = s->qk[qt_id];
+    const jp_huff_t *hac = &s->hac[ac_id];
 
     int t = jp_huff_decode(&s->bits, &s->hdc[dc_id]);
     if (t < 0 || t > 11) return JPEG_ESTREAM;
-    int diff = t > 0 ? jp_extend(jp_get_bits(&s->bits, t), t) : 0;
+    int diff = t > 0 ? jp_receive_extend(&s->bits, t) : 0;
     s->dc_pred[comp_idx] += diff;
-    coef[0] = (int16_t)(s->dc_pred[comp_idx] * (int)qt[0]);
+    if (s->dc_pred[comp_idx] > 4095 || s->dc_pred[comp_idx] < -4095)
+        return JPEG_ESTREAM;
+    coef[0] = (int16_t)((s->dc_pred[comp_idx] * qk[0] + 128) >> 8);
 
-    int k = 1;
+    int k = 1, last = 0;
     while (k < 64) {
-        int sym = jp_huff_decode(&s->bits, &s->hac[ac_id]);
+        int sym = jp_huff_decode(&s->bits, hac);
         if (sym < 0) return JPEG_ESTREAM;
         int run = (sym >> 4) & 0xF;
         int sz  = sym & 0xF;
@@ -312,13 +407,14 @@ static int jp_decode_block(jp_state_t *s, int comp_idx, uint8_t out[64]) {
             break;  /* EOB */
         }
         k += run;
-        if (k >= 64) return JPEG_ESTREAM;
-        int v = jp_extend(jp_get_bits(&s->bits, sz), sz);
-        coef[jp_zigzag[k]] = (int16_t)(v * (int)qt[k]);
+        if (k >= 64 || sz > 10) return JPEG_ESTREAM;
+        int v = jp_receive_extend(&s->bits, sz);
+        int z = jp_zigzag[k];
+        coef[z] = (int16_t)((v * qk[z] + 128) >> 8);
+        last = k;
         k++;
     }
-    jp_idct(coef, out);
-    return JPEG_OK;
+    return last;
 }
 
 static void jp_reset_dc(jp_state_t *s) {
@@ -347,11 +443,43 @@ static uint32_t jp_yuv_xrgb(int Y, int Cb, int Cr) {
     return 0xFF000000u | ((uint32_t)R << 16) | ((uint32_t)G << 8) | (uint32_t)B;
 }
 
+/* Convert rows [y0, y1) of the decoded MCU row held in the component
+ * planes; chroma is replicated (nearest) where it is subsampled.*/
+static void jp_emit_rows(const jp_state_t *s, uint8_t *const plane[3],
+                         const uint32_t pstride[3], uint32_t *pixels,
+                         int W, int y0, int y1, int row_base) {
+    int xs[3], ys[3], c, oy, ox;
+    for (c = 0; c < s->ncomp; c++) {
+        xs[c] = (int)s->comp[c].hsamp < s->max_h ? 1 : 0;
+        ys[c] = (int)s->comp[c].vsamp < s->max_v ? 1 : 0;
+    }
+    for (oy = y0; oy < y1; oy++) {
+        int i = oy - row_base;
+        uint32_t *dst = pixels + (uint32_t)oy * (uint32_t)W;
+        const uint8_t *yr = plane[0] + (uint32_t)(i >> ys[0]) * pstride[0];
+        if (s->ncomp == 1) {
+            for (ox = 0; ox < W; ox++) {
+                uint32_t g = yr[ox];
+                dst[ox] = 0xFF000000u | (g << 16) | (g << 8) | g;
+            }
+            continue;
+        }
+        const uint8_t *cbr = plane[1] + (uint32_t)(i >> ys[1]) * pstride[1];
+        const uint8_t *crr = plane[2] + (uint32_t)(i >> ys[2]) * pstride[2];
+        for (ox = 0; ox < W; ox++) {
+            dst[ox] = jp_yuv_xrgb((int)yr[ox >> xs[0]],
+                                  (int)cbr[ox >> xs[1]],
+                                  (int)crr[ox >> xs[2]]);
+        }
+    }
+}
+
 /* top-level decode */
 
-int jpeg_decode_mem(const uint8_t *data, uint32_t len,
-                    uint32_t **out_pixels, int *out_w, int *out_h) {
+int jpeg_decode_mem_scaled(const uint8_t *data, uint32_t len, int scale,
+                           uint32_t **out_pixels, int *out_w, int *out_h) {
     if (!data || len < 4 || !out_pixels || !out_w || !out_h) return JPEG_EINVAL;
+    if (scale != 1 && scale != 2 && scale != 4 && scale != 8) return JPEG_EINVAL;
     if (data[0] != 0xFF || data[1] != 0xD8) return JPEG_EINVAL;
 
     jp_state_t st;
@@ -411,109 +539,105 @@ int jpeg_decode_mem(const uint8_t *data, uint32_t len,
 
     if (!sos_seen || st.ncomp == 0) return JPEG_EFORMAT;
 
+    /* Dequantization multipliers in natural order, Q8 so the small
+     * quantizers of high-quality files keep their precision; the
+     * full-size path also folds in the AAN scale factors (Q14, plus the
+     * x4 working precision of the IDCT).*/
+    for (i = 0; i < 4; i++) {
+        int k;
+        if (!st.qt_present[i]) continue;
+        for (k = 0; k < 64; k++) {
+            int z = jp_zigzag[k];
+            int32_t q = st.qt[i][k];
+            st.qk[i][z] = scale == 1
+                ? (q * (int32_t)jp_aan_scale[z] + (1 << 3)) >> 4
+                : q << 8;
+        }
+    }
+
     /* Output buffer */
-    int W = st.width, H = st.height;
+    int W = (st.width  + scale - 1) / scale;
+    int H = (st.height + scale - 1) / scale;
     uint32_t *pixels = (uint32_t *)kmalloc((uint32_t)W * (uint32_t)H * 4u);
     if (!pixels) return JPEG_ENOMEM;
 
+    int max_h = st.max_h, max_v = st.max_v;
+    int bs = 8 / scale;                 /* output samples per block edge */
+    int mcu_w = max_h * 8;
+    int mcu_h = max_v * 8;
+    int mcus_x = (st.width  + mcu_w - 1) / mcu_w;
+    int mcus_y = (st.height + mcu_h - 1) / mcu_h;
+    int mcu_oh = max_v * bs;            /* output rows per MCU row */
+
+    /* One MCU row of samples per component, colour-converted as each
+     * row completes. */
+    uint8_t *plane[3] = { NULL, NULL, NULL };
+    uint32_t pstride[3] = { 0, 0, 0 };
+    int c;
+    for (c = 0; c < st.ncomp; c++) {
+        pstride[c] = (uint32_t)(mcus_x * (int)st.comp[c].hsamp * bs);
+        plane[c] = (uint8_t *)kmalloc(pstride[c] *
+                                      (uint32_t)((int)st.comp[c].vsamp * bs));
+        if (!plane[c]) {
+            while (c-- > 0) kfree(plane[c]);
+            kfree(pixels);
+            return JPEG_ENOMEM;
+        }
+    }
+
     /* Entropy-coded scan */
     st.bits.src = data;
     st.bits.len = len;
     st.bits.pos = pos;
-    st.bits.buf = 0;
-    st.bits.buf_bits = 0;
     st.bits.marker = 0;
-    st.bits.eof = 0;
-
-    int max_h = st.max_h, max_v = st.max_v;
-    int mcu_w = max_h * 8;
-    int mcu_h = max_v * 8;
-    int mcus_x = (W + mcu_w - 1) / mcu_w;
-    int mcus_y = (H + mcu_h - 1) / mcu_h;
+    jp_bits_reset(&st.bits);
 
     jp_reset_dc(&st);
     int restart_left = st.restart_interval;
-
-    /* Decoded sample blocks: blocks[c][bi][64] where bi < hsamp_c * vsamp_c <= 4 */
-    uint8_t blocks[3][4][64];
+    int rc = JPEG_OK;
+    int16_t coef[64];
 
     int my, mx;
-    for (my = 0; my < mcus_y; my++) {
+    for (my = 0; my < mcus_y && rc == JPEG_OK; my++) {
         for (mx = 0; mx < mcus_x; mx++) {
-            int c, by, bx;
-            for (c = 0; c < st.ncomp; c++) {
+            int by, bx;
+            for (c = 0; c < st.ncomp && rc == JPEG_OK; c++) {
                 int hc = st.comp[c].hsamp;
                 int vc = st.comp[c].vsamp;
-                for (by = 0; by < vc; by++) {
+                for (by = 0; by < vc && rc == JPEG_OK; by++) {
+                    uint8_t *row = plane[c] + (uint32_t)(by * bs) * pstride[c];
                     for (bx = 0; bx < hc; bx++) {
-                        int bi = by * hc + bx;
-                        int rc = jp_decode_block(&st, c, blocks[c][bi]);
-                        if (rc != JPEG_OK || st.bits.eof) {
-                            kfree(pixels);
-                            return JPEG_ESTREAM;
+                        int last = jp_decode_block(&st, c, coef);
+                        if (last < 0 || JP_OVERRUN(&st.bits)) {
+                            rc = JPEG_ESTREAM;
+                            break;
                         }
+                        jp_idct_block(coef, last, bs,
+                                      row + (mx * hc + bx) * bs, pstride[c]);
                     }
                 }
             }
-
-            /* Write MCU pixels */
-            int i_, j_;
-            for (i_ = 0; i_ < mcu_h; i_++) {
-                int oy = my * mcu_h + i_;
-                if (oy >= H) break;
-                for (j_ = 0; j_ < mcu_w; j_++) {
-                    int ox = mx * mcu_w + j_;
-                    if (ox >= W) break;
-
-                    /* Y */
-                    int y_row = (i_ * (int)st.comp[0].vsamp) / max_v;
-                    int y_col = (j_ * (int)st.comp[0].hsamp) / max_h;
-                    int y_bi = (y_row / 8) * (int)st.comp[0].hsamp + (y_col / 8);
-                    int Y = (int)blocks[0][y_bi][(y_row & 7) * 8 + (y_col & 7)];
-
-                    uint32_t px;
-                    if (st.ncomp == 1) {
-                        uint32_t g = (uint32_t)Y;
-                        px = 0xFF000000u | (g << 16) | (g << 8) | g;
-                    } else {
-                        int cb_row = (i_ * (int)st.comp[1].vsamp) / max_v;
-                        int cb_col = (j_ * (int)st.comp[1].hsamp) / max_h;
-                        int cb_bi = (cb_row / 8) * (int)st.comp[1].hsamp + (cb_col / 8);
-                        int Cb = (int)blocks[1][cb_bi][(cb_row & 7) * 8 + (cb_col & 7)];
-
-                        int cr_row = (i_ * (int)st.comp[2].vsamp) / max_v;
-                        int cr_col = (j_ * (int)st.comp[2].hsamp) / max_h;
-                        int cr_bi = (cr_row / 8) * (int)st.comp[2].hsamp + (cr_col / 8);
-                        int Cr = (int)blocks[2][cr_bi][(cr_row & 7) * 8 + (cr_col & 7)];
-
-                        px = jp_yuv_xrgb(Y, Cb, Cr);
-                    }
-                    pixels[(uint32_t)oy * (uint32_t)W + (uint32_t)ox] = px;
-                }
-            }
+            if (rc != JPEG_OK) break;
 
             /* restart marker handling */
             if (st.restart_interval > 0) {
                 restart_left--;
                 if (restart_left == 0) {
                     /* skip to next byte boundary, expect FFD0..D7 */
-                    st.bits.buf = 0;
-                    st.bits.buf_bits = 0;
+                    jp_bits_reset(&st.bits);
                     if (st.bits.marker >= 0xD0 && st.bits.marker <= 0xD7) {
                         st.bits.marker = 0;
-                        st.bits.eof = 0;
-                    } else {
+                    } else if (!st.bits.marker) {
                         /* search forward for RSTn */
                         while (st.bits.pos + 1 < len) {
                             if (data[st.bits.pos] == 0xFF) {
                                 uint8_t nx = data[st.bits.pos + 1];
                                 if (nx >= 0xD0 && nx <= 0xD7) {
                                     st.bits.pos += 2;
-                                    st.bits.eof = 0;
                                     break;
                                 }
                                 if (nx == 0xD9) { /* EOI */
-                                    st.bits.eof = 1;
+                                    st.bits.marker = nx;
                                     break;
                                 }
                             }
@@ -525,10 +649,55 @@ int jpeg_decode_mem(const uint8_t *data, uint32_t len,
                 }
             }
         }
+        if (rc != JPEG_OK) break;
+
+        int y0 = my * mcu_oh;
+        int y1 = y0 + mcu_oh;
+        if (y1 > H) y1 = H;
+        jp_emit_rows(&st, plane, pstride, pixels, W, y0, y1, y0);
     }
 
+    for (c = 0; c < st.ncomp; c++) kfree(plane[c]);
+    if (rc != JPEG_OK) {
+        kfree(pixels);
+        return rc;
+    }
     *out_pixels = pixels;
     *out_w = W;
     *out_h = H;
     return JPEG_OK;
 }
+
+int jpeg_decode_mem(const uint8_t *data, uint32_t len,
+                    uint32_t **out_pixels, int *out_w, int *out_h) {
+    return jpeg_decode_mem_scaled(data, len, 1, out_pixels, out_w, out_h);
+}
+
+#ifdef JPEG_BENCH
+/* Boot-time benchmark: decode the bundled sample photo at every scale
+ * and report wall time to serial.*/
+void jpeg_benchmark(void) {
+    static const char path[] = "/home/file_example_JPG_1MB.jpg";
+    const uint32_t max = 4u * 1024u * 1024u;
+    uint8_t *buf = (uint8_t *)kmalloc(max);
+    if (!buf) return;
+    int n = vfs_read_all(path, buf, max);
+    if (n <= 0) {
+        serial_printf("[jpeg] bench: cannot read %s (%d)\n", path, n);
+        kfree(buf);
+        return;
+    }
+    int scale;
+    for (scale = 1; scale <= 8; scale <<= 1) {
+        uint32_t *px = NULL;
+        int w = 0, h = 0;
+        uint32_t t0 = timer_get_uptime_ms();
+        int rc = jpeg_decode_mem_scaled(buf, (uint32_t)n, scale, &px, &w, &h);
+        uint32_t t1 = timer_get_uptime_ms();
+        serial_printf("[jpeg] bench 1/%d: rc=%d %dx%d in %u ms (sse2=%d)\n",
+                      scale, rc, w, h, t1 - t0, simd_enabled() ? 1 : 0);
+        if (rc == JPEG_OK) kfree(px);
+    }
+    kfree(buf);
+}
+#endif
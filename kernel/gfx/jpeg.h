@@ -32,4 +32,17 @@
 int jpeg_decode_mem(const uint8_t *data, uint32_t len,
                     uint32_t **out_pixels, int *out_w, int *out_h);
 
+/**
+ * Same as jpeg_decode_mem but decodes at 1/scale size (scale = 1, 2, 4
+ * or 8) straight from the DCT coefficients, for thumbnails and previews.
+ * Output dimensions are the source dimensions divided by scale, rounded
+ * up.  Any other scale returns JPEG_EINVAL.
+*/
+int jpeg_decode_mem_scaled(const uint8_t *data, uint32_t len, int scale,
+                           uint32_t **out_pixels, int *out_w, int *out_h);
+
+#ifdef JPEG_BENCH
+void jpeg_benchmark(void);
+#endif
+
 #endif /* JPEG_H */
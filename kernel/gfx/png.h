@@ -33,4 +33,8 @@
 int png_decode_mem(const uint8_t *data, uint32_t len,
                    uint32_t **out_pixels, int *out_w, int *out_h);
 
+#ifdef PNG_BENCH
+void png_benchmark(void);
+#endif
+
 #endif /* PNG_H */
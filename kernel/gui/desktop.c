@@ -80,6 +80,14 @@ static bool workspace_cache_has_bmp = false;
 static int desktop_icon_stamp = 1;
 static int workspace_cache_icon_stamp = 0;
 static bool workspace_base_drawn_with_icons = false;
+/* Set when the screen may differ from the back buffer's workspace in
+ * ways no damage rect tracks: a new background, or a modal UI or
+ * fullscreen app that drew over everything. The next workspace repaint
+ * then presents the whole screen.*/
+static bool desktop_screen_stale = true;
+/* Popups drawn over the workspace since the last workspace damage. */
+static bool cal_on_screen = false;
+static int tip_x = 0, tip_y = 0, tip_w = 0, tip_h = 0;
 
 static uint32_t *taskbar_base_cache = NULL; /* taskbar gradient + separator + brand */
 static bool taskbar_base_cache_valid = false;
@@ -121,6 +129,32 @@ static void desktop_mark_dirty_rect(int x, int y, int w, int h) {
   vga_mark_dirty(x, y, w, h);
 }
 
+/* Damage for a frame that repainted the whole workspace. Unless the
+ * screen went stale, the repaint reproduces the old background, so only
+ * window frames (old and new), the popups, the taskbar and the cursor
+ * can change. Call before gui_draw_all_windows().*/
+static void desktop_mark_workspace_damage(void) {
+  if (desktop_screen_stale) {
+    desktop_screen_stale = false;
+    vga_mark_dirty_full();
+    return;
+  }
+  gui_mark_layout_damage();
+  if (cal_on_screen) {
+    desktop_mark_dirty_rect((VGA_GFX_WIDTH - CALENDAR_WIDTH) / 2,
+                            (TASKBAR_Y - CALENDAR_HEIGHT) / 2,
+                            CALENDAR_WIDTH, CALENDAR_HEIGHT);
+    cal_on_screen = false;
+  }
+  if (tip_w > 0) {
+    desktop_mark_dirty_rect(tip_x, tip_y, tip_w, tip_h);
+    tip_w = 0;
+  }
+  desktop_mark_dirty_rect(0, TASKBAR_Y, VGA_GFX_WIDTH,
+                          VGA_GFX_HEIGHT - TASKBAR_Y);
+  mouse_mark_cursor_dirty();
+}
+
 static void desktop_fill_row32(uint32_t *dst, int n, uint32_t color) {
   simd_memset32(dst, color, (uint32_t)n);
 }
@@ -148,20 +182,16 @@ static void desktop_launch_icon_handle(int gfx_icon) {
   if (launch_fn) {
     serial_printf("[desktop] icon launch_fn handle=%d\n", gfx_icon);
     launch_fn();
-    return;
-  }
-
-  {
+  } else {
     const char *prog = gfx2d_icon_get_path(gfx_icon);
-    if (prog && prog[0]) {
-      if (app_launch_by_path(prog, NULL)) {
-        return;
-      }
+    if (prog && prog[0] && !app_launch_by_path(prog, NULL)) {
       serial_printf("[desktop] icon cupidc_jit path=%s handle=%d\n", prog,
                     gfx_icon);
       cupidc_jit(prog);
     }
   }
+  /* The app may have drawn over the whole screen before returning. */
+  desktop_screen_stale = true;
 }
 
 static void desktop_show_icon_info(int gfx_icon) {
@@ -211,6 +241,7 @@ static bool desktop_handle_global_shortcuts(const key_event_t *event,
   if (ctrl && alt && (event->scancode == 0x14 || ch == 't' || ch == 'T' ||
                       ch == 20)) { /* Ctrl+T = 20 */
     (void)app_launch_by_name("terminal", NULL);
+    desktop_screen_stale = true;
     if (force_full_repaint)
       *force_full_repaint = true;
     return true;
@@ -219,6 +250,7 @@ static bool desktop_handle_global_shortcuts(const key_event_t *event,
   if (ctrl && alt && (event->scancode == 0x31 || ch == 'n' || ch == 'N' ||
                       ch == 14)) { /* Ctrl+N = 14 */
     (void)app_launch_by_name("notepad", NULL);
+    desktop_screen_stale = true;
     if (force_full_repaint)
       *force_full_repaint = true;
     return true;
@@ -251,10 +283,24 @@ static void desktop_draw_hover_tooltip(void) {
     const char *tip = gfx2d_icon_get_desc(gfx_icon);
     if (!tip || !tip[0])
       tip = gfx2d_icon_get_label(gfx_icon);
+    if (!tip || !tip[0])
+      return;
     {
       int ix = gfx2d_icon_get_x(gfx_icon);
       int iy = gfx2d_icon_get_y(gfx_icon);
+      /* Same box and edge clamp as gfx2d_tooltip(). */
+      tip_w = gfx2d_text_width(tip, GFX2D_FONT_NORMAL) + 8;
+      tip_h = gfx2d_text_height(GFX2D_FONT_NORMAL) + 8;
+      tip_x = ix + GFX2D_ICON_SIZE + 8;
+      tip_y = iy + 4;
+      if (tip_x + tip_w > VGA_GFX_WIDTH)
+        tip_x = VGA_GFX_WIDTH - tip_w;
+      if (tip_x < 0)
+        tip_x = 0;
+      if (tip_y + tip_h > VGA_GFX_HEIGHT)
+        tip_y = VGA_GFX_HEIGHT - tip_h;
       gfx2d_tooltip(ix + GFX2D_ICON_SIZE + 8, iy + 4, tip);
+      desktop_mark_dirty_rect(tip_x, tip_y, tip_w, tip_h);
     }
   }
 }
@@ -1090,6 +1136,7 @@ static void desktop_open_bg_settings_dialog(void) {
       (desktop_bg_mode == DESKTOP_BG_TILED && desktop_tile_use_bmp);
   bool drag_r = false, drag_g = false, drag_b = false;
   char bmp_path[VFS_MAX_PATH];
+  desktop_screen_stale = true; /* the menu that opened us is on screen */
   bmp_path[0] = '\0';
   if (desktop_bg_mode == DESKTOP_BG_TILED && desktop_tile_use_bmp &&
       desktop_tile_bmp_path[0]) {
@@ -1202,6 +1249,7 @@ static void desktop_open_bg_settings_dialog(void) {
     desktop_anim_tick++;
     desktop_draw_background();
     desktop_draw_icons();
+    desktop_mark_workspace_damage();
     gui_draw_all_windows(true); /* background always repainted in this loop */
     desktop_draw_taskbar();
     desktop_draw_calendar();
@@ -1248,7 +1296,7 @@ static void desktop_open_bg_settings_dialog(void) {
 
     mouse_save_under_cursor();
     mouse_draw_cursor();
-    vga_mark_dirty_full();
+    desktop_mark_dirty_rect(dialog.x, dialog.y, dialog.w + 2, dialog.h + 2);
     vga_flip();
     process_yield();
   }
@@ -1395,6 +1443,7 @@ void desktop_draw_background(void) {
 
       if (!cache_match) {
         uint32_t *fb_build = vga_get_framebuffer();
+        desktop_screen_stale = true;
         if (desktop_bg_mode == DESKTOP_BG_BMP && desktop_bg_bmp_scaled) {
           simd_memcpy(fb_build, desktop_bg_bmp_scaled, (uint32_t)workspace_bytes);
         } else if (desktop_bg_mode == DESKTOP_BG_GRADIENT) {
@@ -1427,6 +1476,9 @@ void desktop_draw_background(void) {
     }
   }
 
+  /* Uncached (or animated) backgrounds are not compared frame to frame. */
+  desktop_screen_stale = true;
+
   if (desktop_bg_mode == DESKTOP_BG_BMP && desktop_bg_bmp_scaled) {
     uint32_t *fb = vga_get_framebuffer();
     simd_memcpy(fb, desktop_bg_bmp_scaled,
@@ -1816,6 +1868,8 @@ static void desktop_draw_calendar(void) {
 
   int16_t cx = (int16_t)((VGA_GFX_WIDTH - CALENDAR_WIDTH) / 2);
   int16_t cy = (int16_t)((TASKBAR_Y - CALENDAR_HEIGHT) / 2);
+  desktop_mark_dirty_rect(cx, cy, CALENDAR_WIDTH, CALENDAR_HEIGHT);
+  cal_on_screen = true;
 
   /* Background */
   gfx_fill_rect(cx, cy, CALENDAR_WIDTH, CALENDAR_HEIGHT, COLOR_WINDOW_BG);
@@ -2220,6 +2274,9 @@ void desktop_redraw_cycle(void) {
     }
     desktop_draw_background();
     desktop_draw_icons();
+    if (!cycle_has_first_render)
+      desktop_screen_stale = true;
+    desktop_mark_workspace_damage();
     /* Only mark windows dirty when background was repainted (not cursor-only) */
     if (needs_redraw || any_dirty)
       gui_mark_all_dirty();
@@ -2230,7 +2287,6 @@ void desktop_redraw_cycle(void) {
     mouse_save_under_cursor();
     mouse_draw_cursor();
 
-    vga_mark_dirty_full();
     vga_flip();
     cycle_has_first_render = true;
   }
@@ -2246,6 +2302,7 @@ void desktop_redraw_cycle(void) {
 
 void desktop_run_minimized_loop(const char *app_name) {
   serial_printf("[desktop] minimized app: %s\n", app_name);
+  desktop_screen_stale = true; /* the app's last frame is on screen */
 
   bool restore_requested = false;
   bool needs_redraw = true;
@@ -2346,6 +2403,7 @@ void desktop_run_minimized_loop(const char *app_name) {
           mouse_restore_under_cursor();
           const char *icon_menu[] = {"Open", "Info"};
           int pick = gfx2d_popup_menu(mouse.x, mouse.y, icon_menu, 2);
+          desktop_screen_stale = true; /* the menu is left on screen */
           if (pick == 0) {
             desktop_launch_icon_handle(icon_menu_target);
             needs_redraw = true;
@@ -2454,6 +2512,7 @@ void desktop_run_minimized_loop(const char *app_name) {
       desktop_draw_background();
       desktop_draw_icons();
       repainted_workspace = true;
+      desktop_mark_workspace_damage();
       if (repainted_workspace)
         gui_mark_all_dirty();
       gui_draw_all_windows(true); /* background always repainted in this loop */
@@ -2494,7 +2553,6 @@ void desktop_run_minimized_loop(const char *app_name) {
 
       mouse_save_under_cursor();
       mouse_draw_cursor();
-      vga_mark_dirty_full();
       vga_flip();
 
       needs_redraw = false;
@@ -2547,6 +2605,7 @@ void desktop_run(void) {
      * scheduled - without yielding, desktop spins on hlt and the app
      * never gets CPU time, freezing its render loop / cursor.*/
     if (gfx2d_fullscreen_active()) {
+      desktop_screen_stale = true;
       process_yield();
       continue;
     }
@@ -2622,6 +2681,7 @@ void desktop_run(void) {
             desktop_open_bg_settings_dialog();
           }
         }
+        desktop_screen_stale = true; /* the menu is left on screen */
         force_full_repaint = true;
         needs_redraw = true;
       }
@@ -2743,6 +2803,7 @@ void desktop_run(void) {
     /* Skip desktop rendering if a fullscreen gfx2d app is running.
      * Yield instead of hlt so fullscreen apps get CPU.*/
     if (gfx2d_fullscreen_active()) {
+      desktop_screen_stale = true;
       process_yield();
       continue;
     }
@@ -2753,6 +2814,12 @@ void desktop_run(void) {
     static bool was_dragging_any = false;
     static int post_drag_settle_frames = 0;
     bool repainted_workspace = false;
+    /* Set when only the drag rect of the workspace was repainted */
+    bool partial_workspace = false;
+    int16_t part_x = 0;
+    int16_t part_y = 0;
+    uint16_t part_w = 0;
+    uint16_t part_h = 0;
     bool cal_visibility_changed = (cal_state.visible != cal_prev_visible);
     cal_prev_visible = cal_state.visible;
     bool dragging_now = gui_is_dragging_any();
@@ -2847,12 +2914,17 @@ void desktop_run(void) {
             if (gui_get_drag_invalidate_rect(&rx, &ry, &rw, &rh)) {
               desktop_anim_tick++;
               desktop_redraw_workspace_region(rx, ry, rw, rh);
-              /* Mark all windows dirty so any window overlapping the
-               * repainted region gets composited back on top.  Without
-               * this, windows behind the dragged one are erased because
-               * only the background is repainted but they never get
-               * a redraw pass.*/
-              repainted_workspace = true;
+              /* Invalidate just the windows overlapping the repainted
+               * region so they get composited back on top; the
+               * compositor then repaints only their visible parts inside
+               * it. Without this, windows behind the dragged one are
+               * erased because only the background is repainted.*/
+              gui_invalidate_screen_rect((int)rx, (int)ry, (int)rw, (int)rh);
+              partial_workspace = true;
+              part_x = rx;
+              part_y = ry;
+              part_w = rw;
+              part_h = rh;
             } else {
               desktop_anim_tick++;
               desktop_draw_background();
@@ -2897,9 +2969,11 @@ void desktop_run(void) {
           }
         }
 
-        if (repainted_workspace)
+        if (repainted_workspace) {
+          desktop_mark_workspace_damage();
           gui_mark_all_dirty();
-        gui_draw_all_windows(repainted_workspace);
+        }
+        gui_draw_all_windows(repainted_workspace || partial_workspace);
         /* Always redraw the taskbar after windows so it is never obscured.
          * Windows whose bodies extend below TASKBAR_Y would otherwise paint
          * over it on frames where draw_taskbar_now is false (e.g. when only
@@ -2920,14 +2994,22 @@ void desktop_run(void) {
         desktop_draw_hover_tooltip();
         mouse_save_under_cursor();
         mouse_draw_cursor();
-        if (repainted_workspace) {
-          vga_mark_dirty_full();
-        } else {
-          /* Only copy windows redrawn in this pass plus the taskbar strip. */
-          gui_mark_redraw_regions(false);
-          vga_mark_dirty(0, (int)TASKBAR_Y,
-                         (int)VGA_GFX_WIDTH,
+        /* A whole-workspace repaint marked its damage before drawing. */
+        if (partial_workspace) {
+          gui_mark_redraw_regions(true);
+          vga_mark_dirty((int)part_x, (int)part_y, (int)part_w, (int)part_h);
+          vga_mark_dirty(0, (int)TASKBAR_Y, (int)VGA_GFX_WIDTH,
                          (int)VGA_GFX_HEIGHT - (int)TASKBAR_Y);
+        } else if (!repainted_workspace) {
+          /* Only copy the damage of windows redrawn in this pass. The
+           * taskbar is repainted every frame but its pixels only change
+           * when its state (clock, focus, window list) was refreshed or
+           * the pointer may have changed a hover highlight.*/
+          gui_mark_redraw_regions(false);
+          if (draw_taskbar_now || mouse_activity)
+            vga_mark_dirty(0, (int)TASKBAR_Y,
+                           (int)VGA_GFX_WIDTH,
+                           (int)VGA_GFX_HEIGHT - (int)TASKBAR_Y);
         }
         vga_flip();
         fps_frames++;
@@ -27,11 +27,43 @@ static uint32_t next_id = 1;
 static drag_state_t drag = {false, false, -1, 0, 0, 0, 0, 0, 0};
 static int last_draw_first_index = -1;
 
+/* Screen-space damage recorded by the last gui_draw_all_windows() pass,
+ * one entry per window that was actually dirty (windows above it that
+ * were merely re-composited produce identical pixels and add nothing).
+ * gui_mark_redraw_regions() submits these to vga_mark_dirty().*/
+static int draw_damage_count = 0;
+static int draw_damage_x[MAX_WINDOWS];
+static int draw_damage_y[MAX_WINDOWS];
+static int draw_damage_w[MAX_WINDOWS];
+static int draw_damage_h[MAX_WINDOWS];
+static bool draw_damage_whole[MAX_WINDOWS];
+
+#define GUI_REGION_MAX 64
+
+typedef struct {
+  int x0, y0, x1, y1;
+} gui_rect_t;
+
+typedef struct {
+  int count;
+  gui_rect_t r[GUI_REGION_MAX];
+} gui_region_t;
+
+/* Frame (with shadow and border clearance) each window last left on
+ * screen, by id. Entries of windows since destroyed, minimised or moved
+ * stay until gui_mark_layout_damage() submits them.*/
+#define SHOWN_MAX (MAX_WINDOWS * 2)
+static int shown_count = 0;
+static bool shown_overflow = false;
+static uint32_t shown_id[SHOWN_MAX];
+static gui_rect_t shown_frame[SHOWN_MAX];
+
 #define RESIZE_GRIP_SIZE 12
 
 static bool layout_changed_flag = true; /* start true to force first render */
 
 static void invalidate_window_full(window_t *win);
+static void note_window_shown(const window_t *win);
 
 static int theme_channel(uint32_t color, int shift) {
   return (int)((color >> shift) & 0xFFu);
@@ -199,6 +231,17 @@ static void free_window_surface(window_t *win) {
   win->content_surface_h = 0;
 }
 
+static void free_frame_cache(window_t *win) {
+  if (!win)
+    return;
+  if (win->frame_cache)
+    kfree(win->frame_cache);
+  win->frame_cache = NULL;
+  win->frame_cache_w = 0;
+  win->frame_cache_h = 0;
+  win->frame_cache_valid = false;
+}
+
 static int ensure_window_surface(window_t *win) {
   int cw;
   int ch;
@@ -253,6 +296,7 @@ static int gui_destroy_window_internal(int wid, bool force_close) {
   }
 
   free_window_surface(&windows[idx]);
+  free_frame_cache(&windows[idx]);
   clear_window_dirty_rect(&windows[idx]);
 
   /* Shift remaining windows down */
@@ -453,6 +497,38 @@ void gui_mark_all_dirty(void) {
   }
 }
 
+void gui_invalidate_screen_rect(int x, int y, int w, int h) {
+  int x1 = x + w;
+  int y1 = y + h;
+
+  if (w <= 0 || h <= 0)
+    return;
+
+  for (int i = 0; i < win_count; i++) {
+    window_t *win = &windows[i];
+    int wx0;
+    int wy0;
+    int wx1;
+    int wy1;
+    if (!window_is_drawable(win))
+      continue;
+    wx0 = (int)win->x;
+    wy0 = (int)win->y;
+    wx1 = wx0 + (int)win->width;
+    wy1 = wy0 + (int)win->height;
+    /* Frame plus border clearance and drop shadow */
+    if (x >= wx1 + 4 || x1 <= wx0 - 1 || y >= wy1 + 4 || y1 <= wy0 - 1)
+      continue;
+    if (x >= wx0 && y >= wy0 && x1 <= wx1 && y1 <= wy1) {
+      invalidate_window_rect_internal(win, x - wx0, y - wy0, w, h);
+    } else {
+      /* The rect reaches the shadow or border band, which a window-local
+       * sub-rect cannot describe; take the whole frame.*/
+      invalidate_window_full(win);
+    }
+  }
+}
+
 int gui_begin_window_paint(int wid) {
   int idx = find_index(wid);
   if (idx < 0)
@@ -480,6 +556,31 @@ int gui_end_window_paint(int wid) {
   return GUI_OK;
 }
 
+/* Like gui_end_window_paint, but only the content-relative rect that was
+ * actually repainted is handed to the compositor. Apps that track their
+ * own damage use this so a caret blink or one form field does not cost a
+ * full-window composite.*/
+int gui_end_window_paint_rect(int wid, int x, int y, int w, int h) {
+  int idx = find_index(wid);
+  int cw;
+  int ch;
+  if (idx < 0)
+    return GUI_ERR_INVALID_ID;
+  gfx2d_surface_unset_active();
+  if (!window_content_metrics(&windows[idx], NULL, NULL, &cw, &ch))
+    return GUI_OK;
+  if (x < 0) { w += x; x = 0; }
+  if (y < 0) { h += y; y = 0; }
+  if (x + w > cw) w = cw - x;
+  if (y + h > ch) h = ch - y;
+  if (w <= 0 || h <= 0)
+    return GUI_OK;
+  invalidate_window_rect_internal(&windows[idx], x + 1,
+                                  y + TITLEBAR_H + WINDOW_CONTENT_TOP_PAD,
+                                  w, h);
+  return GUI_OK;
+}
+
 int gui_invalidate_window(int wid) {
   int idx = find_index(wid);
   if (idx < 0)
@@ -726,6 +827,9 @@ int gui_draw_window(int wid) {
   if (idx < 0)
     return GUI_ERR_INVALID_ID;
   draw_single_window(&windows[idx]);
+  note_window_shown(&windows[idx]);
+  /* Drawn straight to the back buffer: the cached frame is now stale. */
+  windows[idx].frame_cache_valid = false;
   return GUI_OK;
 }
 
@@ -740,23 +844,406 @@ void gui_mark_visible_rects(void) {
   }
 }
 
+/* Screen rect for damage entry i. Whole-window entries get the border
+ * clearance (and shadow, when pad is 5) around the frame.*/
+static gui_rect_t damage_rect(int i, int pad) {
+  gui_rect_t r;
+  if (draw_damage_whole[i]) {
+    r.x0 = draw_damage_x[i] - 1;
+    r.y0 = draw_damage_y[i] - 1;
+    r.x1 = draw_damage_x[i] + draw_damage_w[i] - 1 + pad;
+    r.y1 = draw_damage_y[i] + draw_damage_h[i] - 1 + pad;
+  } else {
+    r.x0 = draw_damage_x[i];
+    r.y0 = draw_damage_y[i];
+    r.x1 = draw_damage_x[i] + draw_damage_w[i];
+    r.y1 = draw_damage_y[i] + draw_damage_h[i];
+  }
+  return r;
+}
+
+static gui_rect_t shown_rect(const window_t *win) {
+  gui_rect_t r;
+  r.x0 = (int)win->x - 1;
+  r.y0 = (int)win->y - 1;
+  r.x1 = (int)win->x + (int)win->width + 4;
+  r.y1 = (int)win->y + (int)win->height + 4;
+  return r;
+}
+
+static void note_window_shown(const window_t *win) {
+  int i;
+  for (i = 0; i < shown_count; i++) {
+    if (shown_id[i] == win->id)
+      break;
+  }
+  if (i == shown_count) {
+    if (shown_count >= SHOWN_MAX) {
+      shown_overflow = true;
+      return;
+    }
+    shown_count++;
+  }
+  shown_id[i] = win->id;
+  shown_frame[i] = shown_rect(win);
+}
+
+void gui_mark_layout_damage(void) {
+  if (shown_overflow)
+    vga_mark_dirty_full();
+  for (int i = 0; i < shown_count; i++) {
+    gui_rect_t r = shown_frame[i];
+    vga_mark_dirty(r.x0, r.y0, r.x1 - r.x0, r.y1 - r.y0);
+  }
+  shown_count = 0;
+  shown_overflow = false;
+  for (int i = 0; i < win_count; i++) {
+    window_t *w = &windows[i];
+    if (!window_is_drawable(w))
+      continue;
+    gui_rect_t r = shown_rect(w);
+    vga_mark_dirty(r.x0, r.y0, r.x1 - r.x0, r.y1 - r.y0);
+    note_window_shown(w);
+  }
+}
+
 void gui_mark_redraw_regions(bool include_shadows) {
   int pad = include_shadows ? 5 : 2;
 
   if (last_draw_first_index < 0)
     return;
 
-  for (int i = last_draw_first_index; i < win_count; i++) {
+  for (int i = 0; i < draw_damage_count; i++) {
+    gui_rect_t r = damage_rect(i, pad);
+    vga_mark_dirty(r.x0, r.y0, r.x1 - r.x0, r.y1 - r.y0);
+  }
+}
+
+/* Record the screen rect a dirty window is about to change. Moving or
+ * resizing windows, and windows flagged dirty without a sub-rect, damage
+ * their whole frame; otherwise only the invalidated sub-rect changes.*/
+static void record_window_damage(const window_t *win) {
+  int n = draw_damage_count;
+  if (n >= MAX_WINDOWS)
+    return;
+  if (!(win->flags &
+        (WINDOW_FLAG_DIRTY | WINDOW_FLAG_DRAGGING | WINDOW_FLAG_RESIZING)))
+    return;
+
+  if ((win->flags & (WINDOW_FLAG_DRAGGING | WINDOW_FLAG_RESIZING)) ||
+      win->dirty_w == 0 || win->dirty_h == 0) {
+    draw_damage_x[n] = (int)win->x;
+    draw_damage_y[n] = (int)win->y;
+    draw_damage_w[n] = (int)win->width;
+    draw_damage_h[n] = (int)win->height;
+    draw_damage_whole[n] = true;
+  } else {
+    int x0 = (int)win->dirty_x;
+    int y0 = (int)win->dirty_y;
+    int x1 = x0 + (int)win->dirty_w;
+    int y1 = y0 + (int)win->dirty_h;
+    if (x1 > (int)win->width)
+      x1 = (int)win->width;
+    if (y1 > (int)win->height)
+      y1 = (int)win->height;
+    if (x1 <= x0 || y1 <= y0)
+      return;
+    draw_damage_x[n] = (int)win->x + x0;
+    draw_damage_y[n] = (int)win->y + y0;
+    draw_damage_w[n] = x1 - x0;
+    draw_damage_h[n] = y1 - y0;
+    draw_damage_whole[n] = false;
+  }
+  draw_damage_count = n + 1;
+}
+
+/* Occlusion-aware compositing.
+ *
+ * Regions are small lists of screen rects. A window's visible region is
+ * its frame minus the frames of every window above it; intersecting
+ * that with the frame's damage gives the only pixels the window needs
+ * to repaint, and each resulting rect is copied from the window's frame
+ * cache. Windows whose visible damage is empty are not painted at all.
+ * If a region ever outgrows GUI_REGION_MAX the pass falls back to the
+ * legacy first-dirty-to-top repaint.*/
+
+static gui_rect_t window_frame(const window_t *win) {
+  gui_rect_t r;
+  r.x0 = (int)win->x;
+  r.y0 = (int)win->y;
+  r.x1 = (int)win->x + (int)win->width;
+  r.y1 = (int)win->y + (int)win->height;
+  return r;
+}
+
+static bool region_push(gui_region_t *rg, int x0, int y0, int x1, int y1) {
+  if (x1 <= x0 || y1 <= y0)
+    return true;
+  if (rg->count >= GUI_REGION_MAX)
+    return false;
+  rg->r[rg->count].x0 = x0;
+  rg->r[rg->count].y0 = y0;
+  rg->r[rg->count].x1 = x1;
+  rg->r[rg->count].y1 = y1;
+  rg->count++;
+  return true;
+}
+
+/* rg -= cut. Each rect overlapping `cut` splits into up to four bands
+ * (above, below, left, right). Returns false on overflow.*/
+static bool region_subtract(gui_region_t *rg, const gui_rect_t *cut) {
+  gui_region_t out;
+  out.count = 0;
+  for (int i = 0; i < rg->count; i++) {
+    const gui_rect_t *r = &rg->r[i];
+    if (cut->x0 >= r->x1 || cut->x1 <= r->x0 ||
+        cut->y0 >= r->y1 || cut->y1 <= r->y0) {
+      if (!region_push(&out, r->x0, r->y0, r->x1, r->y1))
+        return false;
+      continue;
+    }
+    int my0 = cut->y0 > r->y0 ? cut->y0 : r->y0;
+    int my1 = cut->y1 < r->y1 ? cut->y1 : r->y1;
+    if (!region_push(&out, r->x0, r->y0, r->x1, my0) ||
+        !region_push(&out, r->x0, my1, r->x1, r->y1) ||
+        !region_push(&out, r->x0, my0, cut->x0 < r->x1 ? cut->x0 : r->x1, my1) ||
+        !region_push(&out, cut->x1 > r->x0 ? cut->x1 : r->x0, my0, r->x1, my1))
+      return false;
+  }
+  *rg = out;
+  return true;
+}
+
+/* out = rg ∩ damage. Returns false on overflow.*/
+static bool region_intersect(const gui_region_t *rg, const gui_region_t *damage,
+                             gui_region_t *out) {
+  out->count = 0;
+  for (int i = 0; i < rg->count; i++) {
+    for (int j = 0; j < damage->count; j++) {
+      const gui_rect_t *a = &rg->r[i];
+      const gui_rect_t *b = &damage->r[j];
+      if (!region_push(out, a->x0 > b->x0 ? a->x0 : b->x0,
+                       a->y0 > b->y0 ? a->y0 : b->y0,
+                       a->x1 < b->x1 ? a->x1 : b->x1,
+                       a->y1 < b->y1 ? a->y1 : b->y1))
+        return false;
+    }
+  }
+  return true;
+}
+
+/* Frame cache.
+ *
+ * draw_single_window (and with it the app's redraw callback) renders into
+ * a screen-sized scratch target, and the result is kept per window in
+ * frame_cache. Compositing a window is then a row copy from the cache per
+ * visible rect, so the app redraw runs at most once per frame and only
+ * when the window is dirty or its cache is missing or stale. A dirty
+ * window with a usable cache re-renders just its own dirty rect.*/
+static uint32_t *frame_scratch = NULL;
+
+/* True when the cache holds every on-screen pixel of the window at its
+ * current size and position. A frame that was partly off-screen when
+ * rendered is only complete where it was rendered.*/
+static bool frame_cache_usable(const window_t *win) {
+  if (!win->frame_cache || !win->frame_cache_valid ||
+      win->frame_cache_w != win->width || win->frame_cache_h != win->height)
+    return false;
+  return win->frame_cache_whole ||
+         (win->frame_cache_x == win->x && win->frame_cache_y == win->y);
+}
+
+/* Bring win->frame_cache up to date. Returns false when no memory is
+ * available for it; the caller then draws the window directly.*/
+static bool update_frame_cache(window_t *win) {
+  gui_rect_t f = window_frame(win);
+  gui_rect_t r = f;
+  bool usable = frame_cache_usable(win);
+  uint32_t stride = (uint32_t)win->width;
+
+  if (usable && !(win->flags & WINDOW_FLAG_DIRTY))
+    return true;
+
+  if (!frame_scratch) {
+    frame_scratch = (uint32_t *)kmalloc((uint32_t)VGA_GFX_SIZE);
+    if (!frame_scratch)
+      return false;
+  }
+  if (!win->frame_cache || win->frame_cache_w != win->width ||
+      win->frame_cache_h != win->height) {
+    free_frame_cache(win);
+    win->frame_cache = (uint32_t *)kmalloc(stride * (uint32_t)win->height * 4u);
+    if (!win->frame_cache)
+      return false;
+    win->frame_cache_w = win->width;
+    win->frame_cache_h = win->height;
+    usable = false;
+  }
+
+  if (usable && win->dirty_w != 0 && win->dirty_h != 0) {
+    r.x0 = f.x0 + (int)win->dirty_x;
+    r.y0 = f.y0 + (int)win->dirty_y;
+    r.x1 = r.x0 + (int)win->dirty_w;
+    r.y1 = r.y0 + (int)win->dirty_h;
+    if (r.x1 > f.x1)
+      r.x1 = f.x1;
+    if (r.y1 > f.y1)
+      r.y1 = f.y1;
+  }
+  if (r.x0 < 0)
+    r.x0 = 0;
+  if (r.y0 < 0)
+    r.y0 = 0;
+  if (r.x1 > VGA_GFX_WIDTH)
+    r.x1 = VGA_GFX_WIDTH;
+  if (r.y1 > VGA_GFX_HEIGHT)
+    r.y1 = VGA_GFX_HEIGHT;
+
+  if (r.x1 > r.x0 && r.y1 > r.y0) {
+    gfx2d_set_framebuffer(frame_scratch);
+    gfx2d_clip_bound_set(r.x0, r.y0, r.x1 - r.x0, r.y1 - r.y0);
+    draw_single_window(win);
+    gfx2d_clip_bound_clear();
+    gfx2d_set_framebuffer(vga_get_framebuffer());
+
+    simd_blit_rect(win->frame_cache + (uint32_t)(r.y0 - f.y0) * stride +
+                       (uint32_t)(r.x0 - f.x0),
+                   frame_scratch + (uint32_t)r.y0 * VGA_GFX_WIDTH +
+                       (uint32_t)r.x0,
+                   stride, (uint32_t)VGA_GFX_WIDTH,
+                   (uint32_t)(r.x1 - r.x0), (uint32_t)(r.y1 - r.y0));
+  } else {
+    win->flags &= (uint8_t)~WINDOW_FLAG_DIRTY;
+    clear_window_dirty_rect(win);
+  }
+
+  if (!usable) {
+    win->frame_cache_x = win->x;
+    win->frame_cache_y = win->y;
+    win->frame_cache_whole = f.x0 >= 0 && f.y0 >= 0 &&
+                             f.x1 <= VGA_GFX_WIDTH && f.y1 <= VGA_GFX_HEIGHT;
+  }
+  win->frame_cache_valid = true;
+  return true;
+}
+
+static void draw_window_in_region(window_t *win, const gui_region_t *rg) {
+  uint32_t *fb;
+  uint32_t stride = (uint32_t)win->width;
+
+  if (!update_frame_cache(win)) {
+    for (int i = 0; i < rg->count; i++) {
+      const gui_rect_t *r = &rg->r[i];
+      gfx2d_clip_bound_set(r->x0, r->y0, r->x1 - r->x0, r->y1 - r->y0);
+      draw_single_window(win);
+    }
+    gfx2d_clip_bound_clear();
+    win->frame_cache_valid = false;
+    return;
+  }
+
+  fb = vga_get_framebuffer();
+  for (int i = 0; i < rg->count; i++) {
+    const gui_rect_t *r = &rg->r[i];
+    simd_blit_rect(fb + (uint32_t)r->y0 * VGA_GFX_WIDTH + (uint32_t)r->x0,
+                   win->frame_cache +
+                       (uint32_t)(r->y0 - (int)win->y) * stride +
+                       (uint32_t)(r->x0 - (int)win->x),
+                   (uint32_t)VGA_GFX_WIDTH, stride,
+                   (uint32_t)(r->x1 - r->x0), (uint32_t)(r->y1 - r->y0));
+  }
+}
+
+static void draw_shadow_in_region(window_t *win, const gui_region_t *rg) {
+  for (int i = 0; i < rg->count; i++) {
+    const gui_rect_t *r = &rg->r[i];
+    gfx2d_clip_bound_set(r->x0, r->y0, r->x1 - r->x0, r->y1 - r->y0);
+    draw_single_window_shadow(win);
+  }
+  gfx2d_clip_bound_clear();
+}
+
+/* Shadow and window passes for the occlusion path. Returns false (having
+ * drawn nothing) when a region overflowed.*/
+static bool composite_visible(bool draw_shadows, const gui_region_t *damage) {
+  static gui_region_t shadow_rg[MAX_WINDOWS];
+  static gui_region_t paint_rg[MAX_WINDOWS];
+  gui_region_t vis;
+  ui_style_t *style = ui_style_get();
+  bool shadows = draw_shadows && style && style->use_shadows;
+
+  /* Compute every region before painting anything so an overflow can
+   * still fall back cleanly.*/
+  for (int i = 0; i < win_count; i++) {
     window_t *w = &windows[i];
+    shadow_rg[i].count = 0;
+    paint_rg[i].count = 0;
     if (!window_is_drawable(w))
       continue;
-    vga_mark_dirty((int)w->x - 1, (int)w->y - 1,
-                   (int)w->width + pad, (int)w->height + pad);
+
+    /* Shadows are painted before any window, so every window covers them. */
+    if (shadows) {
+      gui_rect_t f = window_frame(w);
+      vis.count = 0;
+      region_push(&vis, f.x0 + style->window_shadow_offset,
+                  f.y0 + style->window_shadow_offset,
+                  f.x1 + style->window_shadow_offset,
+                  f.y1 + style->window_shadow_offset);
+      for (int j = 0; j < win_count && vis.count > 0; j++) {
+        if (!window_is_drawable(&windows[j]))
+          continue;
+        gui_rect_t fj = window_frame(&windows[j]);
+        if (!region_subtract(&vis, &fj))
+          return false;
+      }
+      if (!region_intersect(&vis, damage, &shadow_rg[i]))
+        return false;
+    }
+
+    {
+      gui_rect_t f = window_frame(w);
+      vis.count = 0;
+      region_push(&vis, f.x0, f.y0, f.x1, f.y1);
+      for (int j = i + 1; j < win_count && vis.count > 0; j++) {
+        if (!window_is_drawable(&windows[j]))
+          continue;
+        gui_rect_t fj = window_frame(&windows[j]);
+        if (!region_subtract(&vis, &fj))
+          return false;
+      }
+      if (!region_intersect(&vis, damage, &paint_rg[i]))
+        return false;
+    }
+  }
+
+  if (shadows) {
+    for (int i = 0; i < win_count; i++) {
+      if (shadow_rg[i].count > 0)
+        draw_shadow_in_region(&windows[i], &shadow_rg[i]);
+    }
+  }
+
+  for (int i = 0; i < win_count; i++) {
+    window_t *w = &windows[i];
+    if (!window_is_drawable(w))
+      continue;
+    if (paint_rg[i].count > 0) {
+      draw_window_in_region(w, &paint_rg[i]);
+    } else {
+      /* Fully covered: nothing to paint, but the damage is consumed and
+       * the cached frame no longer matches the app's content.*/
+      w->flags &= (uint8_t)~WINDOW_FLAG_DIRTY;
+      clear_window_dirty_rect(w);
+      w->frame_cache_valid = false;
+    }
   }
+  return true;
 }
 
 void gui_draw_all_windows(bool draw_shadows) {
   int first = -1;
+  int pad = draw_shadows ? 5 : 2;
+  gui_region_t damage;
 
   for (int i = 0; i < win_count; i++) {
     if (!window_is_drawable(&windows[i]))
@@ -769,10 +1256,35 @@ void gui_draw_all_windows(bool draw_shadows) {
   }
 
   last_draw_first_index = first;
+  draw_damage_count = 0;
   if (first < 0)
     return;
 
-  /* Draw shadows first (back-to-front pass) so they sit behind all windows.
+  damage.count = 0;
+  for (int i = first; i < win_count; i++) {
+    if (window_is_drawable(&windows[i])) {
+      record_window_damage(&windows[i]);
+      note_window_shown(&windows[i]);
+    }
+  }
+  for (int i = 0; i < draw_damage_count; i++) {
+    gui_rect_t r = damage_rect(i, pad);
+    if (r.x0 < 0)
+      r.x0 = 0;
+    if (r.y0 < 0)
+      r.y0 = 0;
+    if (r.x1 > VGA_GFX_WIDTH)
+      r.x1 = VGA_GFX_WIDTH;
+    if (r.y1 > VGA_GFX_HEIGHT)
+      r.y1 = VGA_GFX_HEIGHT;
+    region_push(&damage, r.x0, r.y0, r.x1, r.y1);
+  }
+
+  if (composite_visible(draw_shadows, &damage))
+    return;
+
+  /* Region overflow: legacy full repaint from the first dirty window.
+   * Draw shadows first (back-to-front pass) so they sit behind all windows.
    * When the background wasn't repainted this frame, old shadow pixels are
    * still correct in the back_buffer - skip the fill entirely.*/
   if (draw_shadows) {
@@ -786,9 +1298,28 @@ void gui_draw_all_windows(bool draw_shadows) {
   /* Redraw from the first changed window to top to preserve occlusion. */
   for (int i = first; i < win_count; i++) {
     if (window_is_drawable(&windows[i])) {
-      draw_single_window(&windows[i]);
+      gui_rect_t f = window_frame(&windows[i]);
+      gui_region_t whole;
+      whole.count = 0;
+      region_push(&whole, f.x0 > 0 ? f.x0 : 0, f.y0 > 0 ? f.y0 : 0,
+                  f.x1 < VGA_GFX_WIDTH ? f.x1 : VGA_GFX_WIDTH,
+                  f.y1 < VGA_GFX_HEIGHT ? f.y1 : VGA_GFX_HEIGHT);
+      draw_window_in_region(&windows[i], &whole);
     }
   }
+  /* Everything from `first` up was repainted; present all of it. */
+  draw_damage_count = 0;
+  for (int i = first; i < win_count; i++) {
+    window_t *w = &windows[i];
+    if (!window_is_drawable(w))
+      continue;
+    draw_damage_x[draw_damage_count] = (int)w->x;
+    draw_damage_y[draw_damage_count] = (int)w->y;
+    draw_damage_w[draw_damage_count] = (int)w->width;
+    draw_damage_h[draw_damage_count] = (int)w->height;
+    draw_damage_whole[draw_damage_count] = true;
+    draw_damage_count++;
+  }
 }
 
 int gui_hit_test_titlebar(int16_t mx, int16_t my) {
@@ -48,6 +48,11 @@ typedef struct window {
     int16_t   dirty_y;
     uint16_t  dirty_w;
     uint16_t  dirty_h;
+    uint32_t *frame_cache;      /* last composited frame, frame_cache_w px wide */
+    int16_t   frame_cache_x, frame_cache_y; /* screen origin it was rendered at */
+    uint16_t  frame_cache_w, frame_cache_h;
+    bool      frame_cache_valid;
+    bool      frame_cache_whole; /* whole frame was on-screen when rendered */
 } window_t;
 
 typedef struct {
@@ -105,11 +110,19 @@ void      gui_clear_layout_changed(void);
 bool      gui_is_dragging_any(void);
 bool      gui_is_dragging_window(int wid);
 void      gui_mark_all_dirty(void);
+/* Invalidate every window overlapping a screen rect (frame or shadow),
+ * so the compositor repaints only what the rect uncovered.*/
+void      gui_invalidate_screen_rect(int x, int y, int w, int h);
 void      gui_mark_visible_rects(void);
 void      gui_mark_redraw_regions(bool include_shadows);
+/* Mark the frames windows last left on screen and their current frames:
+ * all a workspace repaint changes under the window layer. Call before
+ * gui_draw_all_windows().*/
+void      gui_mark_layout_damage(void);
 int       gui_cache_window_content(int wid);
 int       gui_begin_window_paint(int wid);
 int       gui_end_window_paint(int wid);
+int       gui_end_window_paint_rect(int wid, int x, int y, int w, int h);
 int       gui_invalidate_window(int wid);
 int       gui_invalidate_window_rect(int wid, int x, int y, int w, int h);
 int       gui_present_windows(void);
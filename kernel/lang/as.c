@@ -22,6 +22,7 @@
 #include "math.h"
 #include "libm.h"
 #include "panic.h"
+#include "perf.h"
 #include "blockcache.h"
 #include "bmp.h"
 #include "ed.h"
@@ -42,6 +43,7 @@
 #include "udp.h"
 #include "dhcp.h"
 #include "dns.h"
+#include "http_cache.h"
 #include "socket.h"
 #include "blockdev.h"
 #include "pci.h"
@@ -639,6 +641,9 @@ static int as_gui_win_poll_key(int win_id) {
 }
 static int  as_gui_win_begin_paint(int wid) { return gui_begin_window_paint(wid); }
 static int  as_gui_win_end_paint(int wid)   { return gui_end_window_paint(wid); }
+static int  as_gui_win_end_paint_rect(int wid, int x, int y, int w, int h) {
+  return gui_end_window_paint_rect(wid, x, y, w, h);
+}
 static int  as_gui_win_invalidate(int wid)  { return gui_invalidate_window(wid); }
 static int  as_gui_win_invalidate_rect(int wid, int x, int y, int w, int h) {
   return gui_invalidate_window_rect(wid, x, y, w, h);
@@ -929,6 +934,7 @@ static void as_register_kernel_bindings(as_state_t *as, int jit_mode) {
   AS_BIND(as, "gfx2d_vline", gfx2d_vline);
   AS_BIND(as, "gfx2d_rect", gfx2d_rect);
   AS_BIND(as, "gfx2d_rect_fill", gfx2d_rect_fill);
+  AS_BIND(as, "gfx2d_scroll_rect", gfx2d_scroll_rect);
   AS_BIND(as, "gfx2d_rect_round", gfx2d_rect_round);
   AS_BIND(as, "gfx2d_rect_round_fill", gfx2d_rect_round_fill);
   AS_BIND(as, "gfx2d_circle", gfx2d_circle);
@@ -1123,17 +1129,25 @@ static void as_register_kernel_bindings(as_state_t *as, int jit_mode) {
   AS_BIND(as, "ac97_smoke_pan",           ac97_smoke_pan);
   AS_BIND(as, "audiotest_all",            audiotest_all);
   AS_BIND(as, "opl_smoke",                opl_smoke);
+  AS_BIND(as, "opl_compare",              opl_compare);
   AS_BIND(as, "midiopl_init",             midiopl_init);
   AS_BIND(as, "midiopl_reset",            midiopl_reset);
   AS_BIND(as, "midiopl_feed",             midiopl_feed);
   AS_BIND(as, "midiopl_render",           midiopl_render);
   AS_BIND(as, "midiopl_set_volume",       midiopl_set_volume);
+  AS_BIND(as, "midiopl_set_core",         midiopl_set_core);
+  AS_BIND(as, "midiopl_get_core",         midiopl_get_core);
   AS_BIND(as, "mixer_init",               mixer_init);
   AS_BIND(as, "mixer_play",               mixer_play);
   AS_BIND(as, "mixer_stop",               mixer_stop);
   AS_BIND(as, "mixer_active",             mixer_active);
   AS_BIND(as, "mixer_set_volume",         mixer_set_volume);
   AS_BIND(as, "mixer_fill",               mixer_fill);
+  AS_BIND(as, "mixer_play_rate",          mixer_play_rate);
+  AS_BIND(as, "mixer_set_rate",           mixer_set_rate);
+  AS_BIND(as, "mixer_set_interp",         mixer_set_interp);
+  AS_BIND(as, "mixer_ring_drops",         mixer_ring_drops);
+  AS_BIND(as, "mixer_bench",              mixer_bench);
 
   /* AC97 PCM channel + getters (parity additions) */
   AS_BIND(as, "ac97_set_pcm_volume",     ac97_set_pcm_volume);
@@ -1142,9 +1156,22 @@ static void as_register_kernel_bindings(as_state_t *as, int jit_mode) {
 
   /* Socket polling + TLS upgrade (parity additions) */
   AS_BIND(as, "sock_avail",          socket_avail);
+  AS_BIND(as, "sock_readable",       socket_readable);
   AS_BIND(as, "sock_state",          socket_state);
   AS_BIND(as, "setsockopt",          socket_setsockopt);
 
+  /* HTTP response cache (parity) */
+  AS_BIND(as, "http_cache_lookup",      http_cache_lookup);
+  AS_BIND(as, "http_cache_length",      http_cache_length);
+  AS_BIND(as, "http_cache_read",        http_cache_read);
+  AS_BIND(as, "http_cache_validators",  http_cache_validators);
+  AS_BIND(as, "http_cache_store",       http_cache_store);
+  AS_BIND(as, "http_cache_revalidated", http_cache_revalidated);
+  AS_BIND(as, "http_cache_remove",      http_cache_remove);
+  AS_BIND(as, "http_cache_sync",        http_cache_sync);
+  AS_BIND(as, "http_cache_count",       http_cache_count);
+  AS_BIND(as, "http_cache_bytes",       http_cache_bytes);
+
   /* Net interface stats (parity) */
   AS_BIND(as, "net_rx_drops",        as_net_rx_drops);
   AS_BIND(as, "net_tx_errors",       as_net_tx_errors);
@@ -1152,6 +1179,7 @@ static void as_register_kernel_bindings(as_state_t *as, int jit_mode) {
   /* Image codecs (parity) */
   AS_BIND(as, "png_decode_mem",            png_decode_mem);
   AS_BIND(as, "jpeg_decode_mem",           jpeg_decode_mem);
+  AS_BIND(as, "jpeg_decode_mem_scaled",    jpeg_decode_mem_scaled);
   AS_BIND(as, "bmp_decode_to_surface_fit", bmp_decode_to_surface_fit);
 
   /* Storage / FS */
@@ -1214,6 +1242,7 @@ static void as_register_kernel_bindings(as_state_t *as, int jit_mode) {
   AS_BIND(as, "gui_win_poll_key",        as_gui_win_poll_key);
   AS_BIND(as, "gui_win_begin_paint",     as_gui_win_begin_paint);
   AS_BIND(as, "gui_win_end_paint",       as_gui_win_end_paint);
+  AS_BIND(as, "gui_win_end_paint_rect",  as_gui_win_end_paint_rect);
   AS_BIND(as, "gui_win_invalidate",      as_gui_win_invalidate);
   AS_BIND(as, "gui_win_invalidate_rect", as_gui_win_invalidate_rect);
   AS_BIND(as, "gui_win_present",         as_gui_win_present);
@@ -1253,6 +1282,12 @@ static void as_register_kernel_bindings(as_state_t *as, int jit_mode) {
 
   /* Compression / fontsys / doom-test (integer-ABI parity) */
   AS_BIND(as, "kdeflate_raw",            kdeflate_raw);
+  AS_BIND(as, "kdeflate_zlib",           kdeflate_zlib);
+  AS_BIND(as, "kdeflate_stream_new",     kdeflate_stream_new);
+  AS_BIND(as, "kdeflate_stream_free",    kdeflate_stream_free);
+  AS_BIND(as, "kdeflate_stream_push",    kdeflate_stream_push);
+  AS_BIND(as, "kdeflate_stream_pull",    kdeflate_stream_pull);
+  AS_BIND(as, "kdeflate_stream_done",    kdeflate_stream_done);
   AS_BIND(as, "dglibc_test_main",        dglibc_test_main);
   AS_BIND(as, "fontsys_advance",         fontsys_advance);
   AS_BIND(as, "fontsys_ascent",          fontsys_ascent);
@@ -1270,6 +1305,7 @@ static void as_register_kernel_bindings(as_state_t *as, int jit_mode) {
   AS_BIND(as, "fontsys_register_blob",   fontsys_register_blob);
   AS_BIND(as, "fontsys_register_file",   fontsys_register_file);
   AS_BIND(as, "fontsys_run_width",       fontsys_run_width);
+  AS_BIND(as, "fontsys_stats",           fontsys_stats);
   AS_BIND(as, "fontsys_unregister",      fontsys_unregister);
 
   /* gfx2d additions (parity) */
@@ -1506,6 +1542,23 @@ static void as_cleanup_state(as_state_t *as) {
 
 /* JIT Mode - Assemble and Execute */
 
+/* Name the code labels of a JIT image for the profiler; local
+ * `.labels` would only split functions into pieces.*/
+static int as_perf_map(const as_state_t *as, const char *path) {
+  uint32_t end = AS_JIT_CODE_BASE + as->code_pos;
+  int map = perf_map_create(AS_JIT_CODE_BASE, as->code_pos, path,
+                            as->label_count);
+  for (int i = 0; i < as->label_count; i++) {
+    const as_label_t *lbl = &as->labels[i];
+    if (!lbl->defined || lbl->is_equ || lbl->name[0] == '.')
+      continue;
+    if (lbl->address >= AS_JIT_CODE_BASE && lbl->address < end)
+      perf_map_add(map, lbl->address, lbl->name);
+  }
+  perf_map_push(map);
+  return map;
+}
+
 void as_jit(const char *path) {
   serial_printf("[asm] JIT assemble: %s\n", path);
 
@@ -1582,6 +1635,7 @@ void as_jit(const char *path) {
   /* Copy code and data to execution regions */
   memcpy((void *)AS_JIT_CODE_BASE, as->code, as->code_pos);
   memcpy((void *)AS_JIT_DATA_BASE, as->data, as->data_pos);
+  int perf_map = as_perf_map(as, path);
 
   /* Calculate entry point */
   uint32_t entry_addr = AS_JIT_CODE_BASE + as->entry_offset;
@@ -1595,6 +1649,7 @@ void as_jit(const char *path) {
 
   /* Execute the program directly (JIT - synchronous) */
   entry_fn();
+  perf_map_pop(perf_map);
 
   /* Mark program as finished */
   shell_jit_program_end();
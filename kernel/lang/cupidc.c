@@ -42,6 +42,7 @@
 #include "math.h"
 #include "memory.h"
 #include "panic.h"
+#include "perf.h"
 #include "ports.h"
 #include "process.h"
 #include "shell.h"
@@ -54,6 +55,7 @@
 #include "percpu.h"
 #include "socket.h"
 #include "dns.h"
+#include "http_cache.h"
 #include "net_if.h"
 #include "arp.h"
 #include "ip.h"
@@ -789,6 +791,10 @@ static int cc_gui_win_end_paint(int win_id) {
   return gui_end_window_paint(win_id);
 }
 
+static int cc_gui_win_end_paint_rect(int win_id, int x, int y, int w, int h) {
+  return gui_end_window_paint_rect(win_id, x, y, w, h);
+}
+
 static int cc_gui_win_invalidate(int win_id) {
   return gui_invalidate_window(win_id);
 }
@@ -999,7 +1005,7 @@ static uint32_t cc_lapic_get_id(void) { return (uint32_t)lapic_get_id(); }
 
 /* Kernel Bindings Registration */
 
-static void cc_register_kernel_bindings(cc_state_t *cc) {
+static void cc_register_kernel_bindings(void) {
 /* Helper macro to add a kernel function binding.
  *
  * BIND()   - return type defaults to TYPE_VOID (fine for most bindings;
@@ -1011,7 +1017,7 @@ static void cc_register_kernel_bindings(cc_state_t *cc) {
  *            fires correctly after the CALL.*/
 #define BIND_T(name_str, func_ptr, nparams, ret_type)                          \
   do {                                                                         \
-    cc_symbol_t *s = cc_sym_add(cc, name_str, SYM_KERNEL, (ret_type));         \
+    cc_symbol_t *s = cc_kbind_add(name_str, (ret_type));                       \
     if (s) {                                                                   \
       uint32_t addr;                                                           \
       memcpy(&addr, &(func_ptr), sizeof(addr));                                \
@@ -1176,6 +1182,8 @@ static void cc_register_kernel_bindings(cc_state_t *cc) {
   BIND("setsockopt", p_setsockopt, 5);
   int (*p_sock_avail)(int) = socket_avail;
   BIND_T("sock_avail", p_sock_avail, 1, TYPE_INT);
+  int (*p_sock_readable)(int) = socket_readable;
+  BIND_T("sock_readable", p_sock_readable, 1, TYPE_INT);
   int (*p_sock_state)(int) = socket_state;
   BIND_T("sock_state", p_sock_state, 1, TYPE_INT);
   int (*p_sendto)(int, const void *, uint32_t, uint32_t, uint16_t) = socket_sendto;
@@ -1189,6 +1197,32 @@ static void cc_register_kernel_bindings(cc_state_t *cc) {
   uint32_t (*p_htonl)(uint32_t) = htonl;
   BIND("htonl", p_htonl, 1);
 
+  /* HTTP response cache (/home/.cache/http) */
+  int (*p_http_cache_lookup)(const char *, int) = http_cache_lookup;
+  BIND_T("http_cache_lookup", p_http_cache_lookup, 2, TYPE_INT);
+  int (*p_http_cache_length)(const char *) = http_cache_length;
+  BIND_T("http_cache_length", p_http_cache_length, 1, TYPE_INT);
+  int (*p_http_cache_read)(const char *, void *, uint32_t, char *, uint32_t) =
+      http_cache_read;
+  BIND_T("http_cache_read", p_http_cache_read, 5, TYPE_INT);
+  int (*p_http_cache_validators)(const char *, char *, uint32_t) =
+      http_cache_validators;
+  BIND_T("http_cache_validators", p_http_cache_validators, 3, TYPE_INT);
+  int (*p_http_cache_store)(const char *, const char *, uint32_t, const void *,
+                            uint32_t) = http_cache_store;
+  BIND_T("http_cache_store", p_http_cache_store, 5, TYPE_INT);
+  int (*p_http_cache_revalidated)(const char *, const char *, uint32_t) =
+      http_cache_revalidated;
+  BIND_T("http_cache_revalidated", p_http_cache_revalidated, 3, TYPE_INT);
+  void (*p_http_cache_remove)(const char *) = http_cache_remove;
+  BIND("http_cache_remove", p_http_cache_remove, 1);
+  void (*p_http_cache_sync)(void) = http_cache_sync;
+  BIND("http_cache_sync", p_http_cache_sync, 0);
+  int (*p_http_cache_count)(void) = http_cache_count;
+  BIND_T("http_cache_count", p_http_cache_count, 0, TYPE_INT);
+  int (*p_http_cache_bytes)(void) = http_cache_bytes;
+  BIND_T("http_cache_bytes", p_http_cache_bytes, 0, TYPE_INT);
+
   /* SSH crypto primitives */
   void (*p_sha256)(const uint8_t *, uint32_t, uint8_t *) = sha256;
   BIND("sha256", p_sha256, 3);
@@ -1389,6 +1423,14 @@ static void cc_register_kernel_bindings(cc_state_t *cc) {
   void (*p_print_log_buf)(void) = print_log_buffer;
   BIND("print_log_buffer", p_print_log_buf, 0);
 
+  /* Present-path damage diagnostics */
+  void (*p_vga_damage_dbg)(int) = (void (*)(int))vga_set_damage_debug;
+  BIND("vga_set_damage_debug", p_vga_damage_dbg, 1);
+
+  void (*p_vga_damage_stats)(uint32_t *, uint32_t *, uint32_t *) =
+      vga_damage_stats;
+  BIND("vga_damage_stats", p_vga_damage_stats, 3);
+
   /* Debug wrappers (CupidC can't do inline asm) */
   void (*p_dump_stack)(void) = cc_dump_stack_trace;
   BIND("dump_stack_trace", p_dump_stack, 0);
@@ -1522,6 +1564,10 @@ static void cc_register_kernel_bindings(cc_state_t *cc) {
   int (*p_gui_win_end_paint)(int) = cc_gui_win_end_paint;
   BIND("gui_win_end_paint", p_gui_win_end_paint, 1);
 
+  int (*p_gui_win_end_paint_rect)(int, int, int, int, int) =
+      cc_gui_win_end_paint_rect;
+  BIND("gui_win_end_paint_rect", p_gui_win_end_paint_rect, 5);
+
   int (*p_gui_win_invalidate)(int) = cc_gui_win_invalidate;
   BIND("gui_win_invalidate", p_gui_win_invalidate, 1);
 
@@ -1638,6 +1684,9 @@ static void cc_register_kernel_bindings(cc_state_t *cc) {
   void (*p_gfx2d_rect_fill)(int, int, int, int, uint32_t) = gfx2d_rect_fill;
   BIND("gfx2d_rect_fill", p_gfx2d_rect_fill, 5);
 
+  void (*p_gfx2d_scroll_rect)(int, int, int, int, int) = gfx2d_scroll_rect;
+  BIND("gfx2d_scroll_rect", p_gfx2d_scroll_rect, 5);
+
   void (*p_gfx2d_rect_round)(int, int, int, int, int, uint32_t) =
       gfx2d_rect_round;
   BIND("gfx2d_rect_round", p_gfx2d_rect_round, 6);
@@ -1732,6 +1781,22 @@ static void cc_register_kernel_bindings(cc_state_t *cc) {
   int (*p_kdeflate_raw)(const uint8_t *, uint32_t, uint8_t *, uint32_t) =
       kdeflate_raw;
   BIND_T("kdeflate_raw", p_kdeflate_raw, 4, TYPE_INT);
+  int (*p_kdeflate_zlib)(const uint8_t *, uint32_t, uint8_t *, uint32_t) =
+      kdeflate_zlib;
+  BIND_T("kdeflate_zlib", p_kdeflate_zlib, 4, TYPE_INT);
+  kdeflate_stream_t *(*p_kdeflate_stream_new)(int) = kdeflate_stream_new;
+  BIND("kdeflate_stream_new", p_kdeflate_stream_new, 1);
+  void (*p_kdeflate_stream_free)(kdeflate_stream_t *) = kdeflate_stream_free;
+  BIND("kdeflate_stream_free", p_kdeflate_stream_free, 1);
+  int (*p_kdeflate_stream_push)(kdeflate_stream_t *, const uint8_t *,
+                                uint32_t) = kdeflate_stream_push;
+  BIND_T("kdeflate_stream_push", p_kdeflate_stream_push, 3, TYPE_INT);
+  int (*p_kdeflate_stream_pull)(kdeflate_stream_t *, uint8_t *, uint32_t) =
+      kdeflate_stream_pull;
+  BIND_T("kdeflate_stream_pull", p_kdeflate_stream_pull, 3, TYPE_INT);
+  int (*p_kdeflate_stream_done)(const kdeflate_stream_t *) =
+      kdeflate_stream_done;
+  BIND_T("kdeflate_stream_done", p_kdeflate_stream_done, 1, TYPE_INT);
 
   int (*p_png_decode_mem)(const uint8_t *, uint32_t,
                           uint32_t **, int *, int *) = png_decode_mem;
@@ -1739,6 +1804,10 @@ static void cc_register_kernel_bindings(cc_state_t *cc) {
   int (*p_jpeg_decode_mem)(const uint8_t *, uint32_t,
                            uint32_t **, int *, int *) = jpeg_decode_mem;
   BIND_T("jpeg_decode_mem", p_jpeg_decode_mem, 5, TYPE_INT);
+  int (*p_jpeg_decode_mem_scaled)(const uint8_t *, uint32_t, int,
+                                  uint32_t **, int *, int *) =
+      jpeg_decode_mem_scaled;
+  BIND_T("jpeg_decode_mem_scaled", p_jpeg_decode_mem_scaled, 6, TYPE_INT);
 
   void (*p_gfx2d_image_free)(int) = gfx2d_image_free;
   BIND("gfx2d_image_free", p_gfx2d_image_free, 1);
@@ -1823,6 +1892,9 @@ static void cc_register_kernel_bindings(cc_state_t *cc) {
   int (*p_fontsys_get_os_default_size)(void) = fontsys_get_os_default_size;
   BIND_T("fontsys_get_os_default_size", p_fontsys_get_os_default_size, 0, TYPE_INT);
 
+  void (*p_fontsys_stats)(void) = fontsys_stats;
+  BIND("fontsys_stats", p_fontsys_stats, 0);
+
   int (*p_fontsys_face_count)(void) = fontsys_face_count;
   BIND_T("fontsys_face_count", p_fontsys_face_count, 0, TYPE_INT);
 
@@ -2541,6 +2613,8 @@ static void cc_register_kernel_bindings(cc_state_t *cc) {
   BIND("ac97_smoke_pan", p_ac97_pan, 0);
   void (*p_opl_smoke)(void)           = opl_smoke;
   BIND("opl_smoke", p_opl_smoke, 0);
+  int  (*p_opl_compare)(void)         = opl_compare;
+  BIND_T("opl_compare", p_opl_compare, 0, TYPE_INT);
   void (*p_audiotest_all)(void)       = audiotest_all;
   BIND("audiotest_all", p_audiotest_all, 0);
 
@@ -2573,6 +2647,10 @@ static void cc_register_kernel_bindings(cc_state_t *cc) {
   BIND("midiopl_render", p_midiopl_render, 2);
   void (*p_midiopl_setvol)(uint8_t)     = midiopl_set_volume;
   BIND("midiopl_set_volume", p_midiopl_setvol, 1);
+  void (*p_midiopl_setcore)(int)        = midiopl_set_core;
+  BIND("midiopl_set_core", p_midiopl_setcore, 1);
+  int  (*p_midiopl_getcore)(void)       = midiopl_get_core;
+  BIND_T("midiopl_get_core", p_midiopl_getcore, 0, TYPE_INT);
 
   /* PCM mixer (16 slots, s16 stereo @ 22050 Hz) */
   int  (*p_mixer_init)(void)            = mixer_init;
@@ -2588,6 +2666,17 @@ static void cc_register_kernel_bindings(cc_state_t *cc) {
   BIND("mixer_set_volume", p_mixer_setvol, 3);
   void (*p_mixer_fill)(int16_t *, uint32_t) = mixer_fill;
   BIND("mixer_fill", p_mixer_fill, 2);
+  int  (*p_mixer_play_rate)(int, const int16_t *, uint32_t, uint8_t,
+                            uint8_t, uint8_t, uint8_t, uint32_t) = mixer_play_rate;
+  BIND_T("mixer_play_rate", p_mixer_play_rate, 8, TYPE_INT);
+  void (*p_mixer_setrate)(int, uint32_t) = mixer_set_rate;
+  BIND("mixer_set_rate", p_mixer_setrate, 2);
+  void (*p_mixer_interp)(int)           = mixer_set_interp;
+  BIND("mixer_set_interp", p_mixer_interp, 1);
+  uint32_t (*p_mixer_drops)(void)       = mixer_ring_drops;
+  BIND_T("mixer_ring_drops", p_mixer_drops, 0, TYPE_INT);
+  int  (*p_mixer_bench)(void)           = mixer_bench;
+  BIND_T("mixer_bench", p_mixer_bench, 0, TYPE_INT);
 
   /* dglibc smoke test */
   int  (*p_dglibc_test)(void)         = dglibc_test_main;
@@ -2640,6 +2729,9 @@ typedef struct {
 
   char *seen_files;
   int seen_count;
+
+  int opt_level;     /* raised by #pragma optimize */
+  int include_count; /* files pulled in by #include */
 } cc_pp_state_t;
 
 static int cc_pp_is_space(char c) {
@@ -3000,6 +3092,7 @@ static void cc_pp_handle_directive(cc_pp_state_t *pp, const char *cur_path,
     cc_pp_resolve_include(cur_path, inc_path, resolved);
     if (cc_pp_file_seen(pp, resolved))
       return;
+    pp->include_count++;
     cc_pp_process_file(pp, resolved, depth + 1);
     return;
   }
@@ -3017,6 +3110,8 @@ static void cc_pp_handle_directive(cc_pp_state_t *pp, const char *cur_path,
     kw2_end = p;
     if (cc_pp_word_eq(kw2_start, kw2_end, "once")) {
       cc_pp_add_seen(pp, cur_path);
+    } else if (cc_pp_word_eq(kw2_start, kw2_end, "optimize")) {
+      pp->opt_level = 1;
     }
     return;
   }
@@ -3204,7 +3299,8 @@ static void cc_pp_process_file(cc_pp_state_t *pp, const char *path, int depth) {
   kfree(source);
 }
 
-static char *cc_preprocess_source(const char *path, int jit_mode) {
+static char *cc_preprocess_source(const char *path, int jit_mode,
+                                  int *opt_level, int *include_count) {
   cc_pp_state_t pp;
   memset(&pp, 0, sizeof(pp));
   pp.seen_count = 0;
@@ -3230,6 +3326,11 @@ static char *cc_preprocess_source(const char *path, int jit_mode) {
     cc_pp_append_char(&pp, '\0');
   }
 
+  if (opt_level)
+    *opt_level = pp.opt_level;
+  if (include_count)
+    *include_count = pp.include_count;
+
   if (!pp.error && !jit_mode && pp.exe_skip_reported) {
     print("CupidC: warning: #exe blocks skipped in AOT mode\n");
   }
@@ -3248,8 +3349,28 @@ static char *cc_preprocess_source(const char *path, int jit_mode) {
   return pp.out;
 }
 
+/* Optimization level requested by the shell (cupidc -O, cc -O, ccc -O). */
+static int cupidc_opt_level = 0;
+
+void cupidc_set_opt_level(int level) { cupidc_opt_level = level ? 1 : 0; }
+
+/* Level for one compile: the shell setting, or 1 if the source asked
+ * for it with #pragma optimize.*/
+static int cc_opt_level_for(int pragma_level) {
+  return (pragma_level || cupidc_opt_level) ? 1 : 0;
+}
+
 /* Compiler State Initialization */
 
+static int cupidc_bindings_ready = 0;
+
+void cupidc_init(void) {
+  if (cupidc_bindings_ready)
+    return;
+  cc_register_kernel_bindings();
+  cupidc_bindings_ready = 1;
+}
+
 static int cc_init_state(cc_state_t *cc, int jit_mode) {
   memset(cc, 0, sizeof(*cc));
 
@@ -3273,8 +3394,9 @@ static int cc_init_state(cc_state_t *cc, int jit_mode) {
     return -1;
   }
 
-  memset(cc->code, 0, CC_MAX_CODE);
-  memset(cc->data, 0, CC_MAX_DATA);
+  /* The buffers are not cleared here: code is written sequentially and
+   * every data reservation zeroes its own bytes (cc_data_reserve), so
+   * only the part a program actually uses is ever touched.*/
 
   cc->code_pos = 0;
   cc->data_pos = 0;
@@ -3293,8 +3415,8 @@ static int cc_init_state(cc_state_t *cc, int jit_mode) {
   cc_sym_init(cc);
   cc->struct_count = 0;
 
-  /* Register kernel bindings */
-  cc_register_kernel_bindings(cc);
+  /* Kernel bindings are shared; this is a no-op after boot. */
+  cupidc_init();
 
   return 0;
 }
@@ -3406,7 +3528,7 @@ static void repl_restore_committed_state(void) {
 
   repl_state.cc->code_pos = repl_state.code_committed;
   repl_state.cc->data_pos = repl_state.data_committed;
-  repl_state.cc->sym_count = repl_state.sym_committed;
+  cc_sym_pop(repl_state.cc, repl_state.sym_committed);
   repl_state.cc->struct_count = repl_state.struct_committed;
   repl_state.cc->typedef_count = repl_state.typedef_committed;
   repl_state.cc->patch_count = repl_state.patch_committed;
@@ -3647,6 +3769,24 @@ static int cc_name_starts_with(const char *s, const char *prefix) {
   return 1;
 }
 
+/* Name a JIT image's functions for the profiler. */
+static int cc_perf_map(const cc_state_t *cc, const char *path) {
+  int n = 1;
+  for (int i = 0; i < cc->sym_count; i++) {
+    if (cc->symbols[i].kind == SYM_FUNC && cc->symbols[i].is_defined)
+      n++;
+  }
+  int map = perf_map_create(CC_JIT_CODE_BASE, cc->code_pos, path, n);
+  perf_map_add(map, CC_JIT_CODE_BASE + cc->entry_offset, "(top level)");
+  for (int i = 0; i < cc->sym_count; i++) {
+    const cc_symbol_t *sym = &cc->symbols[i];
+    if (sym->kind == SYM_FUNC && sym->is_defined)
+      perf_map_add(map, CC_JIT_CODE_BASE + (uint32_t)sym->offset, sym->name);
+  }
+  perf_map_push(map);
+  return map;
+}
+
 /* JIT Mode - Compile and Execute */
 
 int cupidc_jit_status(const char *path) {
@@ -3654,7 +3794,10 @@ int cupidc_jit_status(const char *path) {
 
   /* Read and preprocess source file */
   serial_printf("[cupidc] preprocess begin\n");
-  char *source = cc_preprocess_source(path, 1);
+  int pragma_opt = 0;
+  int includes = 0;
+  uint32_t start_ms = timer_get_uptime_ms();
+  char *source = cc_preprocess_source(path, 1, &pragma_opt, &includes);
   if (!source) {
     serial_printf("[cupidc] preprocess failed\n");
     return -1;
@@ -3673,12 +3816,17 @@ int cupidc_jit_status(const char *path) {
     kfree(source);
     return -1;
   }
-
-  /* Lex + parse + generate code */
-  serial_printf("[cupidc] parse begin\n");
-  cc_lex_init(cc, source);
-  cc_parse_program(cc);
-  serial_printf("[cupidc] parse end\n");
+  cc->opt_level = cc_opt_level_for(pragma_opt);
+
+  /* Multi-file programs reuse the image of an identical earlier build. */
+  int cached = includes > 0 && cc_cache_load(cc, path, source);
+  if (!cached) {
+    /* Lex + parse + generate code */
+    serial_printf("[cupidc] parse begin%s\n", cc->opt_level ? " (-O)" : "");
+    cc_lex_init(cc, source);
+    cc_parse_program(cc);
+    serial_printf("[cupidc] parse end\n");
+  }
 
   if (cc->error) {
     serial_printf("[cupidc] parse produced error: %s", cc->error_msg);
@@ -3698,8 +3846,9 @@ int cupidc_jit_status(const char *path) {
     return -1;
   }
 
-  serial_printf("[cupidc] Compiled: %u bytes code, %u bytes data\n",
-                cc->code_pos, cc->data_pos);
+  serial_printf("[cupidc] %s: %u bytes code, %u bytes data in %u ms\n",
+                cached ? "Cached" : "Compiled", cc->code_pos, cc->data_pos,
+                timer_get_uptime_ms() - start_ms);
 
   /* Guard: reject programs that exceed JIT region limits */
   if (cc->code_pos > CC_MAX_CODE) {
@@ -3721,6 +3870,9 @@ int cupidc_jit_status(const char *path) {
     return -1;
   }
 
+  if (includes > 0 && !cached)
+    cc_cache_store(cc, path, source);
+
   /* JIT code/data regions are permanently reserved at boot by pmm_init()
    * so the heap never allocates into them.  Just copy and execute.*/
 
@@ -3737,6 +3889,7 @@ int cupidc_jit_status(const char *path) {
   /* Copy code and data to execution regions */
   memcpy((void *)CC_JIT_CODE_BASE, cc->code, cc->code_pos);
   memcpy((void *)CC_JIT_DATA_BASE, cc->data, cc->data_pos);
+  int perf_map = cc_perf_map(cc, path);
 
   /* Execute compile-time #exe functions once before normal entry. */
   {
@@ -3789,6 +3942,7 @@ int cupidc_jit_status(const char *path) {
 
   /* Execute the program directly (JIT - synchronous) */
   entry_fn();
+  perf_map_pop(perf_map);
 
   /* Mark program as finished (routes GUI keyboard input back to shell) */
   shell_jit_program_end();
@@ -3824,7 +3978,9 @@ void cupidc_aot(const char *src_path, const char *out_path) {
   serial_printf("[cupidc] AOT compile: %s -> %s\n", src_path, out_path);
 
   /* Read and preprocess source file */
-  char *source = cc_preprocess_source(src_path, 0);
+  int pragma_opt = 0;
+  int includes = 0;
+  char *source = cc_preprocess_source(src_path, 0, &pragma_opt, &includes);
   if (!source)
     return;
 
@@ -3840,10 +3996,14 @@ void cupidc_aot(const char *src_path, const char *out_path) {
     kfree(source);
     return;
   }
+  cc->opt_level = cc_opt_level_for(pragma_opt);
 
-  /* Lex + parse + generate code */
-  cc_lex_init(cc, source);
-  cc_parse_program(cc);
+  int cached = includes > 0 && cc_cache_load(cc, src_path, source);
+  if (!cached) {
+    /* Lex + parse + generate code */
+    cc_lex_init(cc, source);
+    cc_parse_program(cc);
+  }
 
   if (cc->error) {
     print(cc->error_msg);
@@ -3861,7 +4021,10 @@ void cupidc_aot(const char *src_path, const char *out_path) {
     return;
   }
 
-  print("Compiled: ");
+  if (includes > 0 && !cached)
+    cc_cache_store(cc, src_path, source);
+
+  print(cached ? "Cached: " : "Compiled: ");
   print_int(cc->code_pos);
   print(" bytes code, ");
   print_int(cc->data_pos);
@@ -3888,6 +4051,7 @@ void cupidc_dis(const char *src_path, dis_output_fn out_fn) {
   dis_sym_t syms[DIS_MAX_SYMS];
   int i;
   int nsyms = 0;
+  int pragma_opt = 0;
 
   if (!src_path || src_path[0] == '\0') {
     if (out_fn)
@@ -3897,7 +4061,7 @@ void cupidc_dis(const char *src_path, dis_output_fn out_fn) {
     return;
   }
 
-  source = cc_preprocess_source(src_path, 1);
+  source = cc_preprocess_source(src_path, 1, &pragma_opt, NULL);
   if (!source)
     return;
 
@@ -3916,6 +4080,7 @@ void cupidc_dis(const char *src_path, dis_output_fn out_fn) {
     kfree(source);
     return;
   }
+  cc->opt_level = cc_opt_level_for(pragma_opt);
 
   cc_lex_init(cc, source);
   cc_parse_program(cc);
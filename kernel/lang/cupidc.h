@@ -28,6 +28,8 @@
 #define CC_MAX_CODE (1024u * 1024u)  /* 1 MB code buffer */
 #define CC_MAX_DATA (8192u * 1024u)  /* 8 MB data/string buffer */
 #define CC_MAX_SYMBOLS 4096          /* max symbols in scope */
+#define CC_SYM_BUCKETS 1024          /* user symbol hash buckets (power of 2) */
+#define CC_KBIND_MAX 1024            /* kernel bindings (frozen at boot) */
 #define CC_MAX_LOCALS 256            /* max locals per function */
 #define CC_MAX_PARAMS 32             /* max function parameters */
 #define CC_MAX_PATCHES 4096          /* max forward-ref patches */
@@ -41,6 +43,7 @@
 #define CC_MAX_FIELDS 32             /* max fields per struct */
 #define CC_MAX_LABELS 128            /* local labels per function/top */
 #define CC_MAX_LABEL_PATCHES 128     /* pending goto patches/label */
+#define CC_OPT_MAX_SLOTS 128         /* frame slots tracked per function (-O) */
 
 /* JIT/AOT regions live well above kernel BSS and kernel stack.
  * Layout puts the JIT image at 16 MB, with 9 MB of code+data headroom
@@ -241,6 +244,8 @@ typedef struct {
    * constant" - fall back to a runtime load.*/
   int     is_const_int;
   int32_t const_int_value;
+  uint32_t hash;     /* cc_sym_hash(name) */
+  int32_t hash_next; /* older symbol in the same bucket, -1 = none */
 } cc_symbol_t;
 
 typedef struct {
@@ -273,6 +278,34 @@ typedef struct {
   int patch_count;
 } cc_label_t;
 
+/* -O frame-slot statistics gathered by the analysis pass over a function
+ * body.  A slot is an [ebp+offset] dword touched by emit_load_local /
+ * emit_store_local; any other addressing of it (LEA, SSE loads, inline
+ * asm) marks it escaped and keeps it in memory.*/
+typedef struct {
+  int32_t offset;
+  uint32_t weight;  /* uses, scaled 8x per enclosing loop */
+  int escaped;
+} cc_opt_slot_t;
+
+/* Parser state rewound between the two -O passes over a function. */
+typedef struct {
+  int pos;
+  int line;
+  cc_token_t cur;
+  cc_token_t peek_buf;
+  int has_peek;
+  uint32_t code_pos;
+  uint32_t data_pos;
+  int sym_count;
+  int struct_count;
+  int typedef_count;
+  int patch_count;
+  int local_offset;
+  int max_local_offset;
+  int loop_depth;
+} cc_opt_snapshot_t;
+
 /* Compiler State */
 typedef struct {
   /* Source */
@@ -298,6 +331,9 @@ typedef struct {
   /* Symbol table */
   cc_symbol_t symbols[CC_MAX_SYMBOLS];
   int sym_count;
+  /* Newest symbol per hash bucket, -1 = empty. Scopes are a stack, so
+   * popping a symbol just puts its hash_next back in the bucket.*/
+  int32_t sym_buckets[CC_SYM_BUCKETS];
 
   /* Struct definitions */
   cc_struct_def_t structs[CC_MAX_STRUCTS];
@@ -346,6 +382,25 @@ typedef struct {
    * top-level code already calls main itself (otherwise main runs twice).*/
   int in_top_level;            /* 1 while parsing top-level stmts */
   int main_called_top_level;   /* 1 if user called main() at top level */
+
+  /* Optimizer (-O / #pragma optimize).  opt_level 0 is the plain
+   * stack-machine output.  At 1 each function body is parsed twice: an
+   * analysis pass (opt_pass 1) fills opt_slots, then the body is rewound
+   * and re-emitted (opt_pass 2) with the hottest non-escaping slots held
+   * in ESI/EDI.  Both passes fold constants and fuse compare+branch.*/
+  int opt_level;
+  int opt_pass;
+  cc_opt_slot_t opt_slots[CC_OPT_MAX_SLOTS];
+  int opt_slot_count;
+  int opt_param_escaped;       /* &param seen: params stay in memory */
+  int opt_saw_asm;             /* inline asm may clobber ESI/EDI */
+  int32_t opt_reg_slot[2];     /* slot held in ESI, EDI (0 = none) */
+  int opt_save_regs;           /* bit 0 = ESI, bit 1 = EDI saved in frame */
+  uint32_t opt_const_end;      /* end of the last literal `mov eax, imm` */
+  int32_t opt_const_val;
+  uint32_t opt_setcc_end;      /* end of the last `setcc al; movzx` pair */
+  uint32_t opt_barrier;        /* highest code_pos used as a jump target */
+  cc_opt_snapshot_t opt_snap;
 } cc_state_t;
 
 /* Public API */
@@ -381,6 +436,27 @@ void cupidc_aot(const char *src_path, const char *out_path);
 */
 void cupidc_dis(const char *src_path, dis_output_fn out_fn);
 
+/**
+ * cupidc_set_opt_level - Select the optimization level for later compiles.
+ *
+ * Applies to cupidc_jit, cupidc_aot and cupidc_dis.  0 emits the plain
+ * stack-machine code; 1 enables register promotion, constant folding and
+ * compare/branch fusion.  A source file can also opt in with
+ * `#pragma optimize`.
+ *
+ * @param level  0 or 1
+*/
+void cupidc_set_opt_level(int level);
+
+/**
+ * cupidc_init - Build the shared kernel-binding table.
+ *
+ * Called once at boot; the first compilation calls it too if boot did
+ * not.  Every JIT/AOT compile after that looks bindings up in the same
+ * frozen hash instead of re-registering them.
+*/
+void cupidc_init(void);
+
 void cc_lex_init(cc_state_t *cc, const char *source);
 cc_token_t cc_lex_next(cc_state_t *cc);
 cc_token_t cc_lex_peek(cc_state_t *cc);
@@ -389,10 +465,26 @@ void cc_parse_program(cc_state_t *cc);
 
 int cc_write_elf(cc_state_t *cc, const char *path);
 
+/* Compiled-image cache for programs that #include other files. A hit
+ * fills code, data, entry and the defined functions from the image
+ * stored for the same preprocessed source and returns 1.*/
+#define CC_CACHE_DIR "/home/.cache/cupidc"
+int cc_cache_load(cc_state_t *cc, const char *src_path, const char *source);
+void cc_cache_store(cc_state_t *cc, const char *src_path, const char *source);
+
 void cc_sym_init(cc_state_t *cc);
 cc_symbol_t *cc_sym_find(cc_state_t *cc, const char *name);
 cc_symbol_t *cc_sym_add(cc_state_t *cc, const char *name, cc_sym_kind_t kind,
                         cc_type_t type);
+void cc_sym_pop(cc_state_t *cc, int count);
+void cc_sym_rehash(cc_state_t *cc);
+
+/* Kernel bindings live in one table shared by every compilation. It is
+ * filled once by cupidc_init() and only read after that; user symbols
+ * with the same name shadow it.*/
+cc_symbol_t *cc_kbind_add(const char *name, cc_type_t ret_type);
+cc_symbol_t *cc_kbind_find(const char *name, uint32_t hash);
+uint32_t cc_sym_hash(const char *name);
 
 /*  *  REPL (HolyC-style interactive shell)
  **/
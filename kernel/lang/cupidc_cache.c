@@ -0,0 +1,316 @@
+/**
+ * cupidc_cache.c - Compiled-image cache for multi-file CupidC programs
+ *
+ * Includes in CupidC are textual: every unit is compiled against the
+ * structs, macros and global addresses of the units before it, and the
+ * emitted code holds absolute data and kernel addresses.  So a unit's
+ * code cannot be relinked on its own, and the cache stores the linked
+ * image of the whole program instead.  That makes the cache
+ * all-or-nothing: editing any one file misses and recompiles every
+ * unit; there is no incremental rebuild.
+ *
+ * The key is a 64-bit FNV-1a hash of the preprocessed source, so it
+ * covers every included file's contents, macro expansion and
+ * conditional.  Preprocessing is a few percent of a compile; lexing
+ * and code generation, which a hit skips, are the rest.  Each image is
+ * also stamped with a hash of the kernel's text and rodata, so a
+ * rebuilt compiler or moved binding never reuses an old image.
+ *
+ * One slot per source path, mode and opt level (<path hash>-j1.cco
+ * under CC_CACHE_DIR), overwritten when the program changes:
+ *
+ *   header   cc_cache_header_t
+ *   code     code_size bytes
+ *   data     records of { u32 zeros, u32 literal, literal bytes }
+ *            expanding to data_size bytes
+ *   funcs    func_count records of { u32 offset, u8 len, name }
+ *
+ * The same file serves cupidc_jit and cupidc_aot; the header's code
+ * and data bases tell which layout the image was linked for.
+*/
+
+#include "cupidc.h"
+#include "homefs.h"
+#include "memory.h"
+#include "serial.h"
+#include "string.h"
+#include "vfs.h"
+#include "vfs_helpers.h"
+
+#define CC_CACHE_MAGIC   0x314F4343u /* "CCO1" */
+#define CC_CACHE_VERSION 1u
+#define CC_CACHE_PATH_MAX 64
+#define CC_CACHE_MIN_RUN 16 /* shorter zero runs stay in a literal */
+
+/* Kernel image bounds (link.ld) */
+extern const uint8_t _text_start[];
+extern const uint8_t _rodata_end[];
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t key_lo; /* FNV-1a 64 of the preprocessed source */
+  uint32_t key_hi;
+  uint32_t kernel_hash;
+  uint32_t jit_mode;
+  uint32_t opt_level;
+  uint32_t code_base;
+  uint32_t data_base;
+  uint32_t code_size;
+  uint32_t data_size;
+  uint32_t data_packed;
+  uint32_t entry_offset;
+  uint32_t has_entry;
+  uint32_t func_count;
+  uint32_t func_bytes;
+} cc_cache_header_t;
+
+static uint64_t cc_cache_key(const char *source) {
+  uint64_t h = 14695981039346656037ull;
+  while (*source) {
+    h ^= (uint8_t)*source++;
+    h *= 1099511628211ull;
+  }
+  return h;
+}
+
+/* Hashed once per boot; the kernel image never changes under it. */
+static uint32_t cc_cache_kernel_hash(void) {
+  static uint32_t hash;
+  static int ready;
+  if (!ready) {
+    const uint8_t *p = _text_start;
+    uint32_t h = 2166136261u;
+    while (p + 4 <= _rodata_end) {
+      uint32_t w;
+      memcpy(&w, p, 4);
+      h = (h ^ w) * 16777619u;
+      p += 4;
+    }
+    hash = h;
+    ready = 1;
+  }
+  return hash;
+}
+
+static void cc_cache_slot_path(const char *src_path, const cc_state_t *cc,
+                               char *out) {
+  static const char hex[] = "0123456789abcdef";
+  uint32_t h = 2166136261u;
+  const char *s = src_path;
+  while (*s) {
+    h ^= (uint8_t)*s++;
+    h *= 16777619u;
+  }
+
+  const char *dir = CC_CACHE_DIR "/";
+  int n = 0;
+  while (dir[n]) {
+    out[n] = dir[n];
+    n++;
+  }
+  for (int i = 7; i >= 0; i--)
+    out[n++] = hex[(h >> (i * 4)) & 0xFu];
+  out[n++] = '-';
+  out[n++] = cc->jit_mode ? 'j' : 'a';
+  out[n++] = (char)('0' + cc->opt_level);
+  const char *ext = ".cco";
+  while (*ext)
+    out[n++] = *ext++;
+  out[n] = '\0';
+}
+
+/* RLE-encode data: long zero runs (most of a program's globals) cost 8
+ * bytes.  With out == NULL only the packed size is computed.*/
+static uint32_t cc_cache_pack(const uint8_t *data, uint32_t n, uint8_t *out) {
+  uint32_t len = 0;
+  uint32_t i = 0;
+  while (i < n) {
+    uint32_t z = i;
+    while (z < n && data[z] == 0)
+      z++;
+    uint32_t l = z;
+    while (l < n) {
+      if (data[l] != 0) {
+        l++;
+        continue;
+      }
+      uint32_t r = l;
+      while (r < n && data[r] == 0 && r - l < CC_CACHE_MIN_RUN)
+        r++;
+      if (r - l >= CC_CACHE_MIN_RUN || r == n)
+        break;
+      l = r;
+    }
+    uint32_t zeros = z - i;
+    uint32_t lit = l - z;
+    if (out) {
+      memcpy(out + len, &zeros, 4);
+      memcpy(out + len + 4, &lit, 4);
+      memcpy(out + len + 8, data + z, lit);
+    }
+    len += 8 + lit;
+    i = l;
+  }
+  return len;
+}
+
+static int cc_cache_unpack(const uint8_t *in, uint32_t in_len, uint8_t *data,
+                           uint32_t n) {
+  uint32_t pos = 0;
+  uint32_t i = 0;
+  while (pos < in_len) {
+    uint32_t zeros;
+    uint32_t lit;
+    if (in_len - pos < 8)
+      return -1;
+    memcpy(&zeros, in + pos, 4);
+    memcpy(&lit, in + pos + 4, 4);
+    pos += 8;
+    if (zeros > n - i || lit > n - i - zeros || lit > in_len - pos)
+      return -1;
+    memset(data + i, 0, zeros);
+    i += zeros;
+    memcpy(data + i, in + pos, lit);
+    i += lit;
+    pos += lit;
+  }
+  return i == n ? 0 : -1;
+}
+
+int cc_cache_load(cc_state_t *cc, const char *src_path, const char *source) {
+  char path[CC_CACHE_PATH_MAX];
+  vfs_stat_t st;
+  cc_cache_header_t hdr;
+
+  cc_cache_slot_path(src_path, cc, path);
+  if (vfs_stat(path, &st) < 0 || st.size < sizeof(hdr))
+    return 0;
+
+  uint8_t *buf = kmalloc(st.size);
+  if (!buf)
+    return 0;
+  int n = vfs_read_all(path, buf, st.size);
+  if (n < 0 || (uint32_t)n != st.size) {
+    kfree(buf);
+    return 0;
+  }
+
+  uint64_t key = cc_cache_key(source);
+  memcpy(&hdr, buf, sizeof(hdr));
+  if (hdr.magic != CC_CACHE_MAGIC || hdr.version != CC_CACHE_VERSION ||
+      hdr.key_lo != (uint32_t)key || hdr.key_hi != (uint32_t)(key >> 32) ||
+      hdr.kernel_hash != cc_cache_kernel_hash() ||
+      hdr.jit_mode != (uint32_t)cc->jit_mode ||
+      hdr.opt_level != (uint32_t)cc->opt_level ||
+      hdr.code_base != cc->code_base || hdr.data_base != cc->data_base ||
+      hdr.code_size > CC_MAX_CODE || hdr.data_size > CC_MAX_DATA ||
+      hdr.func_count > CC_MAX_SYMBOLS ||
+      st.size - sizeof(hdr) < hdr.code_size ||
+      st.size - sizeof(hdr) - hdr.code_size !=
+          hdr.data_packed + hdr.func_bytes) {
+    kfree(buf);
+    return 0;
+  }
+
+  const uint8_t *p = buf + sizeof(hdr);
+  memcpy(cc->code, p, hdr.code_size);
+  p += hdr.code_size;
+  if (cc_cache_unpack(p, hdr.data_packed, cc->data, hdr.data_size) < 0) {
+    kfree(buf);
+    return 0;
+  }
+  p += hdr.data_packed;
+
+  const uint8_t *end = p + hdr.func_bytes;
+  for (uint32_t f = 0; f < hdr.func_count; f++) {
+    uint32_t offset;
+    char name[CC_MAX_IDENT];
+    if (end - p < 5 || p[4] >= CC_MAX_IDENT || end - p - 5 < p[4]) {
+      cc_sym_init(cc);
+      kfree(buf);
+      return 0;
+    }
+    memcpy(&offset, p, 4);
+    memcpy(name, p + 5, p[4]);
+    name[p[4]] = '\0';
+    p += 5 + p[4];
+    cc_symbol_t *sym = cc_sym_add(cc, name, SYM_FUNC, TYPE_INT);
+    sym->offset = (int32_t)offset;
+    sym->address = cc->code_base + offset;
+    sym->is_defined = 1;
+  }
+
+  cc->code_pos = hdr.code_size;
+  cc->data_pos = hdr.data_size;
+  cc->entry_offset = hdr.entry_offset;
+  cc->has_entry = (int)hdr.has_entry;
+  kfree(buf);
+  return 1;
+}
+
+void cc_cache_store(cc_state_t *cc, const char *src_path, const char *source) {
+  char path[CC_CACHE_PATH_MAX];
+  cc_cache_header_t hdr;
+
+  memset(&hdr, 0, sizeof(hdr));
+  for (int i = 0; i < cc->sym_count; i++) {
+    const cc_symbol_t *sym = &cc->symbols[i];
+    if (sym->kind != SYM_FUNC || !sym->is_defined)
+      continue;
+    hdr.func_count++;
+    hdr.func_bytes += 5u + strlen(sym->name);
+  }
+
+  uint64_t key = cc_cache_key(source);
+  hdr.magic = CC_CACHE_MAGIC;
+  hdr.version = CC_CACHE_VERSION;
+  hdr.key_lo = (uint32_t)key;
+  hdr.key_hi = (uint32_t)(key >> 32);
+  hdr.kernel_hash = cc_cache_kernel_hash();
+  hdr.jit_mode = (uint32_t)cc->jit_mode;
+  hdr.opt_level = (uint32_t)cc->opt_level;
+  hdr.code_base = cc->code_base;
+  hdr.data_base = cc->data_base;
+  hdr.code_size = cc->code_pos;
+  hdr.data_size = cc->data_pos;
+  hdr.data_packed = cc_cache_pack(cc->data, cc->data_pos, NULL);
+  hdr.entry_offset = cc->entry_offset;
+  hdr.has_entry = (uint32_t)cc->has_entry;
+
+  uint32_t size = (uint32_t)sizeof(hdr) + hdr.code_size + hdr.data_packed +
+                  hdr.func_bytes;
+  uint8_t *buf = kmalloc(size);
+  if (!buf)
+    return;
+  uint8_t *p = buf;
+  memcpy(p, &hdr, sizeof(hdr));
+  p += sizeof(hdr);
+  memcpy(p, cc->code, hdr.code_size);
+  p += hdr.code_size;
+  p += cc_cache_pack(cc->data, cc->data_pos, p);
+  for (int i = 0; i < cc->sym_count; i++) {
+    const cc_symbol_t *sym = &cc->symbols[i];
+    if (sym->kind != SYM_FUNC || !sym->is_defined)
+      continue;
+    uint32_t offset = (uint32_t)sym->offset;
+    uint8_t len = (uint8_t)strlen(sym->name);
+    memcpy(p, &offset, 4);
+    p[4] = len;
+    memcpy(p + 5, sym->name, len);
+    p += 5 + len;
+  }
+
+  /* /home re-serializes on every flush; let the next sync persist it. */
+  vfs_stat_t st;
+  cc_cache_slot_path(src_path, cc, path);
+  homefs_defer_begin();
+  if (vfs_stat(CC_CACHE_DIR, &st) < 0) {
+    (void)vfs_mkdir("/home/.cache");
+    (void)vfs_mkdir(CC_CACHE_DIR);
+  }
+  if (vfs_write_all(path, buf, size) < 0)
+    serial_printf("[cupidc] cache: cannot write %s\n", path);
+  homefs_defer_end();
+  kfree(buf);
+}
@@ -57,8 +57,83 @@ static void emit_mov_eax_imm(cc_state_t *cc, uint32_t val) {
   emit32(cc, val);
 }
 
+/* mov eax, imm32 for a source-level integer constant.  Remembers where
+ * it ended so -O can fold it into the enclosing operator.*/
+static void emit_const_eax(cc_state_t *cc, int32_t val) {
+  emit_mov_eax_imm(cc, (uint32_t)val);
+  cc->opt_const_end = cc->code_pos;
+  cc->opt_const_val = val;
+}
+
+/* True if the code emitted since `start` is exactly one constant load. */
+static int cc_opt_is_const(cc_state_t *cc, uint32_t start) {
+  return cc->opt_level && cc->opt_const_end == cc->code_pos &&
+         cc->code_pos == start + 5;
+}
+
+/* Discard the code emitted since `pos` so a peephole can replace it. */
+static void cc_opt_rewind(cc_state_t *cc, uint32_t pos) {
+  cc->code_pos = pos;
+  cc->opt_const_end = 0;
+  cc->opt_setcc_end = 0;
+}
+
+/* -O frame-slot bookkeeping.  The analysis pass (opt_pass 1) records how
+ * each [ebp+offset] slot is used; the emit pass (opt_pass 2) maps up to
+ * two of them onto ESI/EDI.*/
+static cc_opt_slot_t *cc_opt_slot(cc_state_t *cc, int32_t offset) {
+  for (int i = 0; i < cc->opt_slot_count; i++) {
+    if (cc->opt_slots[i].offset == offset)
+      return &cc->opt_slots[i];
+  }
+  if (cc->opt_slot_count >= CC_OPT_MAX_SLOTS)
+    return NULL;
+  cc_opt_slot_t *s = &cc->opt_slots[cc->opt_slot_count++];
+  s->offset = offset;
+  s->weight = 0;
+  s->escaped = 0;
+  return s;
+}
+
+static void cc_opt_note_use(cc_state_t *cc, int32_t offset) {
+  if (cc->opt_pass != 1)
+    return;
+  cc_opt_slot_t *s = cc_opt_slot(cc, offset);
+  if (!s)
+    return;
+  int depth = cc->loop_depth < 4 ? cc->loop_depth : 4;
+  s->weight += 1u << (3 * depth);
+}
+
+/* The slot is addressed other than by a plain dword load/store. */
+static void cc_opt_note_escape(cc_state_t *cc, int32_t offset) {
+  if (cc->opt_pass != 1)
+    return;
+  if (offset > 0)
+    cc->opt_param_escaped = 1; /* &param may walk to its neighbours */
+  cc_opt_slot_t *s = cc_opt_slot(cc, offset);
+  if (s)
+    s->escaped = 1;
+}
+
+/* Register holding `offset` in the emit pass: 0 = ESI, 1 = EDI, -1 = none */
+static int cc_opt_slot_reg(cc_state_t *cc, int32_t offset) {
+  if (cc->opt_reg_slot[0] == offset && offset != 0)
+    return 0;
+  if (cc->opt_reg_slot[1] == offset && offset != 0)
+    return 1;
+  return -1;
+}
+
 /* mov eax, [ebp + offset] (load local/param) */
 static void emit_load_local(cc_state_t *cc, int32_t offset) {
+  int reg = cc_opt_slot_reg(cc, offset);
+  if (reg >= 0) {
+    emit8(cc, 0x89); /* mov eax, esi / mov eax, edi */
+    emit8(cc, reg ? 0xF8 : 0xF0);
+    return;
+  }
+  cc_opt_note_use(cc, offset);
   emit8(cc, 0x8B); /* mov eax, [ebp+disp32] */
   emit8(cc, 0x85);
   emit32(cc, (uint32_t)offset);
@@ -66,6 +141,13 @@ static void emit_load_local(cc_state_t *cc, int32_t offset) {
 
 /* mov [ebp + offset], eax (store local/param) */
 static void emit_store_local(cc_state_t *cc, int32_t offset) {
+  int reg = cc_opt_slot_reg(cc, offset);
+  if (reg >= 0) {
+    emit8(cc, 0x89); /* mov esi, eax / mov edi, eax */
+    emit8(cc, reg ? 0xC7 : 0xC6);
+    return;
+  }
+  cc_opt_note_use(cc, offset);
   emit8(cc, 0x89); /* mov [ebp+disp32], eax */
   emit8(cc, 0x85);
   emit32(cc, (uint32_t)offset);
@@ -125,6 +207,7 @@ static void patch_jump(cc_state_t *cc, uint32_t patch_pos) {
   uint32_t from = patch_pos + 4; /* instruction after the rel32 */
   int32_t rel = (int32_t)(target - from);
   patch32(cc, patch_pos, (uint32_t)rel);
+  cc->opt_barrier = target;
 }
 
 /* add esp, imm (clean up stack args).  Uses imm8 form when possible, else
@@ -169,8 +252,19 @@ static void emit_prologue(cc_state_t *cc) {
   emit8(cc, 0xF0);
 }
 
-/* Function epilogue: mov esp, ebp; pop ebp; ret */
+/* Function epilogue: mov esp, ebp; pop ebp; ret.  Under -O the
+ * callee-saved ESI/EDI are first reloaded from their frame slots.*/
 static void emit_epilogue(cc_state_t *cc) {
+  if (cc->opt_save_regs & 1) {
+    emit8(cc, 0x8B); /* mov esi, [ebp-4] */
+    emit8(cc, 0x75);
+    emit8(cc, 0xFC);
+  }
+  if (cc->opt_save_regs & 2) {
+    emit8(cc, 0x8B); /* mov edi, [ebp-8] */
+    emit8(cc, 0x7D);
+    emit8(cc, 0xF8);
+  }
   emit8(cc, 0x89); /* mov esp, ebp */
   emit8(cc, 0xEC);
   emit8(cc, 0x5D); /* pop ebp */
@@ -224,6 +318,7 @@ static void emit_deref_byte(cc_state_t *cc) {
 
 /* lea eax, [ebp + offset] (address of local) */
 static void emit_lea_local(cc_state_t *cc, int32_t offset) {
+  cc_opt_note_escape(cc, offset);
   emit8(cc, 0x8D); /* lea eax, [ebp+disp32] */
   emit8(cc, 0x85);
   emit32(cc, (uint32_t)offset);
@@ -279,6 +374,7 @@ static void emit_movsd_xmm_disp32(cc_state_t *cc, int xmm, uint32_t addr) {
 
 /* MOVSS/MOVSD xmm, [ebp + disp32] - load FP local/param into XMM reg. */
 static void emit_movss_xmm_local(cc_state_t *cc, int xmm, int32_t offset) {
+  cc_opt_note_escape(cc, offset);
   emit8(cc, 0xF3);
   emit8(cc, 0x0F);
   emit8(cc, 0x10);
@@ -286,6 +382,7 @@ static void emit_movss_xmm_local(cc_state_t *cc, int xmm, int32_t offset) {
   emit32(cc, (uint32_t)offset);
 }
 static void emit_movsd_xmm_local(cc_state_t *cc, int xmm, int32_t offset) {
+  cc_opt_note_escape(cc, offset);
   emit8(cc, 0xF2);
   emit8(cc, 0x0F);
   emit8(cc, 0x10);
@@ -295,6 +392,7 @@ static void emit_movsd_xmm_local(cc_state_t *cc, int xmm, int32_t offset) {
 
 /* MOVSS/MOVSD [ebp + disp32], xmm - store XMM reg into FP local/param. */
 static void emit_movss_local_xmm(cc_state_t *cc, int xmm, int32_t offset) {
+  cc_opt_note_escape(cc, offset);
   emit8(cc, 0xF3);
   emit8(cc, 0x0F);
   emit8(cc, 0x11); /* MOVSS m32, xmm */
@@ -302,6 +400,7 @@ static void emit_movss_local_xmm(cc_state_t *cc, int xmm, int32_t offset) {
   emit32(cc, (uint32_t)offset);
 }
 static void emit_movsd_local_xmm(cc_state_t *cc, int xmm, int32_t offset) {
+  cc_opt_note_escape(cc, offset);
   emit8(cc, 0xF2);
   emit8(cc, 0x0F);
   emit8(cc, 0x11); /* MOVSD m64, xmm */
@@ -387,6 +486,7 @@ static void emit_movaps_xmm_xmm(cc_state_t *cc, int dst, int src) {
  * boundary because of the PUSH EBP). MOVUPS tolerates unaligned
  * addresses and is cheap on modern x86, so it's the safer choice.*/
 static void emit_movups_xmm_local(cc_state_t *cc, int xmm, int32_t offset) {
+  cc_opt_note_escape(cc, offset);
   emit8(cc, 0x0F);
   emit8(cc, 0x10);
   emit8(cc, cc_xmm_modrm_ebp(xmm));
@@ -400,6 +500,7 @@ static void emit_movups_xmm_local(cc_state_t *cc, int xmm, int32_t offset) {
  * See emit_movups_xmm_local for why we use MOVUPS, not MOVAPS.*/
 __attribute__((unused))
 static void emit_movups_local_xmm(cc_state_t *cc, int xmm, int32_t offset) {
+  cc_opt_note_escape(cc, offset);
   emit8(cc, 0x0F);
   emit8(cc, 0x11);
   emit8(cc, cc_xmm_modrm_ebp(xmm));
@@ -420,6 +521,7 @@ static void emit_sse_scalar_op(cc_state_t *cc, int is_double, uint8_t op_byte,
 
 /* Forward decl: defined just below the error-handling block. */
 static int cc_data_reserve(cc_state_t *cc, uint32_t bytes);
+static void cc_data_align4(cc_state_t *cc);
 
 /* Emit raw bytes into the data segment and return the absolute address.
  * Returns 0 and sets error on overflow.*/
@@ -427,7 +529,7 @@ static uint32_t cc_emit_data_bytes(cc_state_t *cc, const uint8_t *bytes,
                                    uint32_t n) {
   /* 4-byte align the data position so float/double live on natural
    * alignment where possible.*/
-  cc->data_pos = (cc->data_pos + 3u) & ~3u;
+  cc_data_align4(cc);
   if (!cc_data_reserve(cc, n))
     return 0;
   uint32_t addr = cc->data_base + cc->data_pos;
@@ -570,9 +672,17 @@ static int cc_data_reserve(cc_state_t *cc, uint32_t bytes) {
     cc_error(cc, "data section overflow");
     return 0;
   }
+  /* The data buffer is not cleared up front; zero what is handed out. */
+  memset(cc->data + cc->data_pos, 0, bytes);
   return 1;
 }
 
+/* 4-byte align data_pos, zeroing the padding. */
+static void cc_data_align4(cc_state_t *cc) {
+  while ((cc->data_pos & 3u) && cc->data_pos < CC_MAX_DATA)
+    cc->data[cc->data_pos++] = 0;
+}
+
 /* Token Helpers */
 
 static cc_token_t cc_next(cc_state_t *cc) { return cc_lex_next(cc); }
@@ -1268,25 +1378,96 @@ static int32_t cc_sizeof_symbol_deref(cc_state_t *cc, cc_symbol_t *sym,
 
 /* Symbol Table */
 
-void cc_sym_init(cc_state_t *cc) { cc->sym_count = 0; }
+uint32_t cc_sym_hash(const char *name) {
+  uint32_t h = 2166136261u;
+  for (int i = 0; name[i] && i < CC_MAX_IDENT - 1; i++) {
+    h ^= (uint8_t)name[i];
+    h *= 16777619u;
+  }
+  return h;
+}
 
-cc_symbol_t *cc_sym_find(cc_state_t *cc, const char *name) {
-  /* Search backwards so locals shadow globals/kernel */
-  for (int i = cc->sym_count - 1; i >= 0; i--) {
-    if (strcmp(cc->symbols[i].name, name) == 0) {
-      return &cc->symbols[i];
-    }
+void cc_sym_init(cc_state_t *cc) {
+  cc->sym_count = 0;
+  for (int i = 0; i < CC_SYM_BUCKETS; i++)
+    cc->sym_buckets[i] = -1;
+}
+
+/* Kernel bindings: open addressing over an immutable array. The table
+ * is at most half full, so a probe ends within a few slots.*/
+#define CC_KBIND_SLOTS (CC_KBIND_MAX * 2)
+static cc_symbol_t cc_kbinds[CC_KBIND_MAX];
+static int cc_kbind_count;
+static int16_t cc_kbind_slots[CC_KBIND_SLOTS]; /* index + 1, 0 = empty */
+
+cc_symbol_t *cc_kbind_add(const char *name, cc_type_t ret_type) {
+  uint32_t h = cc_sym_hash(name);
+  uint32_t slot = h & (CC_KBIND_SLOTS - 1);
+  while (cc_kbind_slots[slot]) {
+    cc_symbol_t *old = &cc_kbinds[cc_kbind_slots[slot] - 1];
+    if (old->hash == h && strcmp(old->name, name) == 0)
+      break;
+    slot = (slot + 1) & (CC_KBIND_SLOTS - 1);
+  }
+  if (cc_kbind_count >= CC_KBIND_MAX)
+    return NULL;
+  /* A repeated name replaces the earlier binding, as the old
+   * registration order did.*/
+  cc_symbol_t *sym = &cc_kbinds[cc_kbind_count++];
+  memset(sym, 0, sizeof(*sym));
+  int i = 0;
+  while (name[i] && i < CC_MAX_IDENT - 1) {
+    sym->name[i] = name[i];
+    i++;
+  }
+  sym->name[i] = '\0';
+  sym->kind = SYM_KERNEL;
+  sym->type = ret_type;
+  sym->hash = h;
+  sym->hash_next = -1;
+  cc_kbind_slots[slot] = (int16_t)cc_kbind_count;
+  return sym;
+}
+
+cc_symbol_t *cc_kbind_find(const char *name, uint32_t hash) {
+  uint32_t slot = hash & (CC_KBIND_SLOTS - 1);
+  while (cc_kbind_slots[slot]) {
+    cc_symbol_t *sym = &cc_kbinds[cc_kbind_slots[slot] - 1];
+    if (sym->hash == hash && strcmp(sym->name, name) == 0)
+      return sym;
+    slot = (slot + 1) & (CC_KBIND_SLOTS - 1);
   }
   return NULL;
 }
 
+cc_symbol_t *cc_sym_find(cc_state_t *cc, const char *name) {
+  /* Buckets chain newest-first, so locals shadow globals, and any user
+   * symbol shadows a kernel binding of the same name.*/
+  uint32_t h = cc_sym_hash(name);
+  int32_t i = cc->sym_buckets[h & (CC_SYM_BUCKETS - 1)];
+  while (i >= 0) {
+    cc_symbol_t *sym = &cc->symbols[i];
+    if (sym->hash == h && strcmp(sym->name, name) == 0)
+      return sym;
+    i = sym->hash_next;
+  }
+  return cc_kbind_find(name, h);
+}
+
+static void cc_sym_link(cc_state_t *cc, int32_t index) {
+  cc_symbol_t *sym = &cc->symbols[index];
+  uint32_t b = sym->hash & (CC_SYM_BUCKETS - 1);
+  sym->hash_next = cc->sym_buckets[b];
+  cc->sym_buckets[b] = index;
+}
+
 cc_symbol_t *cc_sym_add(cc_state_t *cc, const char *name, cc_sym_kind_t kind,
                         cc_type_t type) {
   if (cc->sym_count >= CC_MAX_SYMBOLS) {
     cc_error(cc, "too many symbols");
     return NULL;
   }
-  cc_symbol_t *sym = &cc->symbols[cc->sym_count++];
+  cc_symbol_t *sym = &cc->symbols[cc->sym_count];
   memset(sym, 0, sizeof(*sym));
   int i = 0;
   while (name[i] && i < CC_MAX_IDENT - 1) {
@@ -1296,9 +1477,28 @@ cc_symbol_t *cc_sym_add(cc_state_t *cc, const char *name, cc_sym_kind_t kind,
   sym->name[i] = '\0';
   sym->kind = kind;
   sym->type = type;
+  sym->hash = cc_sym_hash(sym->name);
+  cc_sym_link(cc, cc->sym_count++);
   return sym;
 }
 
+/* Drop every symbol above `count` (scope exit). The symbol being popped
+ * is always the newest in its bucket.*/
+void cc_sym_pop(cc_state_t *cc, int count) {
+  while (cc->sym_count > count) {
+    cc_symbol_t *sym = &cc->symbols[--cc->sym_count];
+    cc->sym_buckets[sym->hash & (CC_SYM_BUCKETS - 1)] = sym->hash_next;
+  }
+}
+
+/* Rebuild the buckets after symbols[] was compacted in place. */
+void cc_sym_rehash(cc_state_t *cc) {
+  for (int i = 0; i < CC_SYM_BUCKETS; i++)
+    cc->sym_buckets[i] = -1;
+  for (int32_t i = 0; i < cc->sym_count; i++)
+    cc_sym_link(cc, i);
+}
+
 static void cc_labels_reset(cc_state_t *cc) { cc->label_count = 0; }
 
 static cc_label_t *cc_label_find(cc_state_t *cc, const char *name) {
@@ -1344,6 +1544,7 @@ static void cc_define_label(cc_state_t *cc, const char *name) {
   }
   lbl->is_defined = 1;
   lbl->code_offset = cc->code_pos;
+  cc->opt_barrier = cc->code_pos;
   for (int i = 0; i < lbl->patch_count; i++) {
     cc_patch_goto_to(cc, lbl->patches[i], lbl->code_offset);
   }
@@ -1712,6 +1913,263 @@ static void cc_emit_binop(cc_state_t *cc, cc_token_type_t op) {
   }
 }
 
+/* -O Operator Rewriting
+ *
+ * The stack machine evaluates `l OP r` as `push eax; <r>; pop ebx; OP`.
+ * When <r> turned out to be a single load - a constant, a frame slot, a
+ * promoted register or a global - the push/pop pair is dropped and the
+ * operator takes r as its source operand directly (`add eax, [ebp-8]`,
+ * `cmp eax, 10`, `imul eax, esi`).  When both sides are constants the
+ * whole thing collapses to one `mov eax, imm`.*/
+
+/* Condition code of a comparison operator (the low nibble of SETcc/Jcc),
+ * or -1 for anything else.*/
+static int cc_opt_cond_code(cc_token_type_t op) {
+  switch (op) {
+  case CC_TOK_EQEQ: return 0x4;
+  case CC_TOK_NE:   return 0x5;
+  case CC_TOK_LT:   return 0xC;
+  case CC_TOK_GE:   return 0xD;
+  case CC_TOK_LE:   return 0xE;
+  case CC_TOK_GT:   return 0xF;
+  default:          return -1;
+  }
+}
+
+/* Evaluate `l OP r` at compile time with the generated code's semantics
+ * (32-bit wraparound, shift counts masked to 5 bits).  Returns 0 for
+ * operators or operands that must stay at run time (x / 0).*/
+static int cc_opt_fold(cc_token_type_t op, int32_t l, int32_t r,
+                       int32_t *out) {
+  uint32_t ul = (uint32_t)l;
+  uint32_t ur = (uint32_t)r;
+  switch (op) {
+  case CC_TOK_PLUS:  *out = (int32_t)(ul + ur); return 1;
+  case CC_TOK_MINUS: *out = (int32_t)(ul - ur); return 1;
+  case CC_TOK_STAR:  *out = (int32_t)(ul * ur); return 1;
+  case CC_TOK_SLASH:
+  case CC_TOK_PERCENT:
+    if (r == 0 || (l == (int32_t)0x80000000u && r == -1))
+      return 0;
+    *out = (op == CC_TOK_SLASH) ? l / r : l % r;
+    return 1;
+  case CC_TOK_AMP:   *out = (int32_t)(ul & ur); return 1;
+  case CC_TOK_BOR:   *out = (int32_t)(ul | ur); return 1;
+  case CC_TOK_BXOR:  *out = (int32_t)(ul ^ ur); return 1;
+  case CC_TOK_SHL:   *out = (int32_t)(ul << (ur & 31)); return 1;
+  case CC_TOK_SHR:   *out = l >> (ur & 31); return 1;
+  case CC_TOK_EQEQ:  *out = l == r; return 1;
+  case CC_TOK_NE:    *out = l != r; return 1;
+  case CC_TOK_LT:    *out = l < r; return 1;
+  case CC_TOK_GT:    *out = l > r; return 1;
+  case CC_TOK_LE:    *out = l <= r; return 1;
+  case CC_TOK_GE:    *out = l >= r; return 1;
+  case CC_TOK_AND:   *out = (l != 0) && (r != 0); return 1;
+  case CC_TOK_OR:    *out = (l != 0) || (r != 0); return 1;
+  default:           return 0;
+  }
+}
+
+/* Right operand classified as a single-instruction source. */
+enum { CC_OPT_SRC_IMM, CC_OPT_SRC_MEM, CC_OPT_SRC_REG };
+
+/* Emit ModR/M (+disp32) selecting the right-operand source for a
+ * `reg, r/m` instruction.  MEM is [ebp+disp32] or, when `abs` is set,
+ * [disp32]; REG is ESI (6) or EDI (7).*/
+static void cc_opt_emit_src(cc_state_t *cc, int reg_field, int kind, int abs,
+                            uint32_t val) {
+  uint8_t r = (uint8_t)((reg_field & 7) << 3);
+  if (kind == CC_OPT_SRC_REG) {
+    emit8(cc, (uint8_t)(0xC0 | r | (val & 7)));
+  } else {
+    emit8(cc, (uint8_t)((abs ? 0x05 : 0x85) | r));
+    emit32(cc, val);
+  }
+}
+
+/* Try to emit `left OP right` without the push/pop round trip.  Left is
+ * in EAX at push_pos (the `push eax`), the right operand occupies the
+ * code from push_pos+1 to code_pos.  Returns 1 if the operator was
+ * emitted, 0 to fall back to cc_emit_binop.*/
+static int cc_opt_binop(cc_state_t *cc, cc_token_type_t op,
+                        uint32_t expr_start, uint32_t push_pos,
+                        int left_const, int32_t left_val) {
+  uint32_t rs = push_pos + 1;
+  uint32_t rlen = cc->code_pos - rs;
+  const uint8_t *rc = cc->code + rs;
+  int right_const = cc_opt_is_const(cc, rs);
+
+  if (left_const && right_const) {
+    int32_t v;
+    if (!cc_opt_fold(op, left_val, cc->opt_const_val, &v))
+      return 0;
+    cc_opt_rewind(cc, expr_start);
+    emit_const_eax(cc, v);
+    return 1;
+  }
+
+  int kind;
+  int abs = 0;
+  uint32_t val;
+  if (right_const) {
+    kind = CC_OPT_SRC_IMM;
+    val = (uint32_t)cc->opt_const_val;
+  } else if (rlen == 6 && rc[0] == 0x8B && rc[1] == 0x85) {
+    kind = CC_OPT_SRC_MEM; /* mov eax, [ebp+disp32] */
+    val = (uint32_t)rc[2] | ((uint32_t)rc[3] << 8) |
+          ((uint32_t)rc[4] << 16) | ((uint32_t)rc[5] << 24);
+  } else if (rlen == 5 && rc[0] == 0xA1) {
+    kind = CC_OPT_SRC_MEM; /* mov eax, [disp32] */
+    abs = 1;
+    val = (uint32_t)rc[1] | ((uint32_t)rc[2] << 8) |
+          ((uint32_t)rc[3] << 16) | ((uint32_t)rc[4] << 24);
+  } else if (rlen == 2 && rc[0] == 0x89 && (rc[1] == 0xF0 || rc[1] == 0xF8)) {
+    kind = CC_OPT_SRC_REG; /* mov eax, esi / edi */
+    val = (rc[1] == 0xF0) ? 6u : 7u;
+  } else {
+    return 0;
+  }
+
+  /* ALU opcodes: `op eax, r/m32` and the /digit of `op r/m32, imm`. */
+  uint8_t alu_rm;
+  uint8_t alu_digit;
+  switch (op) {
+  case CC_TOK_PLUS:  alu_rm = 0x03; alu_digit = 0; break;
+  case CC_TOK_BOR:   alu_rm = 0x0B; alu_digit = 1; break;
+  case CC_TOK_AMP:   alu_rm = 0x23; alu_digit = 4; break;
+  case CC_TOK_MINUS: alu_rm = 0x2B; alu_digit = 5; break;
+  case CC_TOK_BXOR:  alu_rm = 0x33; alu_digit = 6; break;
+  default:
+    alu_rm = 0x3B; /* cmp */
+    alu_digit = 7;
+    if (cc_opt_cond_code(op) < 0 && op != CC_TOK_STAR &&
+        op != CC_TOK_SLASH && op != CC_TOK_PERCENT &&
+        op != CC_TOK_SHL && op != CC_TOK_SHR)
+      return 0; /* && and || keep the generic sequence */
+    break;
+  }
+
+  cc_opt_rewind(cc, push_pos); /* left operand is live in EAX */
+  int cond = cc_opt_cond_code(op);
+
+  if (op == CC_TOK_STAR) {
+    if (kind == CC_OPT_SRC_IMM) {
+      int32_t k = (int32_t)val;
+      if (k >= -128 && k <= 127) {
+        emit8(cc, 0x6B); /* imul eax, eax, imm8 */
+        emit8(cc, 0xC0);
+        emit8(cc, (uint8_t)(val & 0xFF));
+      } else {
+        emit8(cc, 0x69); /* imul eax, eax, imm32 */
+        emit8(cc, 0xC0);
+        emit32(cc, val);
+      }
+    } else {
+      emit8(cc, 0x0F); /* imul eax, r/m32 */
+      emit8(cc, 0xAF);
+      cc_opt_emit_src(cc, 0, kind, abs, val);
+    }
+  } else if (op == CC_TOK_SHL || op == CC_TOK_SHR) {
+    uint8_t modrm = (op == CC_TOK_SHL) ? 0xE0 : 0xF8; /* shl / sar eax */
+    if (kind == CC_OPT_SRC_IMM) {
+      emit8(cc, 0xC1); /* shift eax, imm8 */
+      emit8(cc, modrm);
+      emit8(cc, (uint8_t)(val & 31));
+    } else {
+      emit8(cc, 0x8B); /* mov ecx, r/m32 */
+      cc_opt_emit_src(cc, 1, kind, abs, val);
+      emit8(cc, 0xD3); /* shift eax, cl */
+      emit8(cc, modrm);
+    }
+  } else if (op == CC_TOK_SLASH || op == CC_TOK_PERCENT) {
+    if (kind == CC_OPT_SRC_IMM) {
+      emit8(cc, 0xB9); /* mov ecx, imm32 */
+      emit32(cc, val);
+    } else {
+      emit8(cc, 0x8B); /* mov ecx, r/m32 */
+      cc_opt_emit_src(cc, 1, kind, abs, val);
+    }
+    emit8(cc, 0x99); /* cdq */
+    emit8(cc, 0xF7);
+    emit8(cc, 0xF9); /* idiv ecx */
+    if (op == CC_TOK_PERCENT) {
+      emit8(cc, 0x89);
+      emit8(cc, 0xD0); /* mov eax, edx */
+    }
+  } else if (kind == CC_OPT_SRC_IMM) {
+    int32_t k = (int32_t)val;
+    if (k >= -128 && k <= 127) {
+      emit8(cc, 0x83); /* op eax, imm8 */
+      emit8(cc, (uint8_t)(0xC0 | (alu_digit << 3)));
+      emit8(cc, (uint8_t)(val & 0xFF));
+    } else {
+      emit8(cc, (uint8_t)(0x05 | (alu_digit << 3))); /* op eax, imm32 */
+      emit32(cc, val);
+    }
+  } else {
+    emit8(cc, alu_rm);
+    cc_opt_emit_src(cc, 0, kind, abs, val);
+  }
+
+  if (cond >= 0) {
+    emit8(cc, 0x0F);
+    emit8(cc, (uint8_t)(0x90 | cond)); /* setcc al */
+    emit8(cc, 0xC0);
+    emit_movzx_eax_al(cc);
+    cc->opt_setcc_end = cc->code_pos;
+  }
+  return 1;
+}
+
+/* How an if/while/for condition left in EAX should be branched on. */
+enum {
+  CC_OPT_COND_EAX,   /* generic: test EAX */
+  CC_OPT_COND_TRUE,  /* compile-time nonzero; test dropped */
+  CC_OPT_COND_FALSE, /* compile-time zero; test dropped */
+  CC_OPT_COND_FLAGS  /* trailing setcc removed; flags hold *cond */
+};
+
+/* Classify the condition emitted since cond_start.  A trailing
+ * `setcc al; movzx eax, al` is dropped so the caller can branch on the
+ * flags directly, unless a jump lands after it (ternary arms, labels).*/
+static int cc_opt_condition(cc_state_t *cc, uint32_t cond_start,
+                            int *cond) {
+  if (!cc->opt_level)
+    return CC_OPT_COND_EAX;
+  if (cc_opt_is_const(cc, cond_start)) {
+    cc_opt_rewind(cc, cond_start);
+    return cc->opt_const_val ? CC_OPT_COND_TRUE : CC_OPT_COND_FALSE;
+  }
+  uint32_t p = cc->code_pos;
+  if (cc->opt_setcc_end == p && p >= cond_start + 6 && cc->opt_barrier < p &&
+      cc->code[p - 6] == 0x0F && (cc->code[p - 5] & 0xF0) == 0x90 &&
+      cc->code[p - 4] == 0xC0 && cc->code[p - 3] == 0x0F &&
+      cc->code[p - 2] == 0xB6 && cc->code[p - 1] == 0xC0) {
+    *cond = cc->code[p - 5] & 0x0F;
+    cc_opt_rewind(cc, p - 6);
+    return CC_OPT_COND_FLAGS;
+  }
+  return CC_OPT_COND_EAX;
+}
+
+/* Emit the exit branch taken when the condition started at cond_start is
+ * false.  Returns the rel32 to patch, or 0 if the branch can never be
+ * taken.*/
+static uint32_t cc_emit_branch_false(cc_state_t *cc, uint32_t cond_start) {
+  int cond = 0;
+  switch (cc_opt_condition(cc, cond_start, &cond)) {
+  case CC_OPT_COND_TRUE:
+    return 0;
+  case CC_OPT_COND_FALSE:
+    return emit_jmp_placeholder(cc);
+  case CC_OPT_COND_FLAGS:
+    return emit_jcc_placeholder(cc, (uint8_t)(0x80 | (cond ^ 1)));
+  default:
+    emit_cmp_eax_zero(cc);
+    return emit_jcc_placeholder(cc, 0x84); /* je */
+  }
+}
+
 /*  *  SSE packed intrinsics (_mm_*_ps)
  *
  *  Recognized by identifier at call-expression parse time and inlined
@@ -2380,6 +2838,9 @@ static void cc_parse_ident_expr(cc_state_t *cc) {
     } else if (sym->type == TYPE_DOUBLE) {
       emit_movsd_xmm_disp32(cc, 0, sym->address);
       cc_last_xmm = 0;
+    } else if (cc->opt_level && sym->is_const_int) {
+      /* Enumerator: propagate the value instead of loading its cell */
+      emit_const_eax(cc, sym->const_int_value);
     } else {
       /* Scalar: load value from memory */
       emit8(cc, 0xA1); /* mov eax, [addr] */
@@ -2421,7 +2882,7 @@ static void cc_parse_primary(cc_state_t *cc) {
 
   switch (tok.type) {
   case CC_TOK_NUMBER:
-    emit_mov_eax_imm(cc, (uint32_t)tok.int_value);
+    emit_const_eax(cc, tok.int_value);
     cc_last_expr_type = TYPE_INT;
     break;
 
@@ -2449,7 +2910,7 @@ static void cc_parse_primary(cc_state_t *cc) {
   }
 
   case CC_TOK_CHAR_LIT:
-    emit_mov_eax_imm(cc, (uint32_t)tok.int_value);
+    emit_const_eax(cc, tok.int_value);
     cc_last_expr_type = TYPE_CHAR;
     break;
 
@@ -2642,19 +3103,34 @@ static void cc_parse_primary(cc_state_t *cc) {
 
   case CC_TOK_NOT: {
     /* Logical NOT: !expr */
+    uint32_t operand_start = cc->code_pos;
     cc_parse_primary(cc);
+    if (cc_opt_is_const(cc, operand_start)) {
+      cc_opt_rewind(cc, operand_start);
+      emit_const_eax(cc, cc->opt_const_val == 0);
+      cc_last_expr_type = TYPE_INT;
+      break;
+    }
     emit_cmp_eax_zero(cc);
     emit8(cc, 0x0F);
     emit8(cc, 0x94);
     emit8(cc, 0xC0); /* sete al */
     emit_movzx_eax_al(cc);
+    cc->opt_setcc_end = cc->code_pos;
     cc_last_expr_type = TYPE_INT;
     break;
   }
 
   case CC_TOK_BNOT: {
     /* Bitwise NOT: ~expr */
+    uint32_t operand_start = cc->code_pos;
     cc_parse_primary(cc);
+    if (cc_opt_is_const(cc, operand_start)) {
+      cc_opt_rewind(cc, operand_start);
+      emit_const_eax(cc, ~cc->opt_const_val);
+      cc_last_expr_type = TYPE_INT;
+      break;
+    }
     emit8(cc, 0xF7);
     emit8(cc, 0xD0); /* not eax */
     cc_last_expr_type = TYPE_INT;
@@ -2663,7 +3139,14 @@ static void cc_parse_primary(cc_state_t *cc) {
 
   case CC_TOK_MINUS: {
     /* Unary minus: -expr */
+    uint32_t operand_start = cc->code_pos;
     cc_parse_primary(cc);
+    if (cc_opt_is_const(cc, operand_start)) {
+      cc_opt_rewind(cc, operand_start);
+      emit_const_eax(cc, (int32_t)(0u - (uint32_t)cc->opt_const_val));
+      cc_last_expr_type = TYPE_INT;
+      break;
+    }
     emit8(cc, 0xF7);
     emit8(cc, 0xD8); /* neg eax */
     cc_last_expr_type = TYPE_INT;
@@ -3160,6 +3643,7 @@ static void cc_parse_expression(cc_state_t *cc, int min_prec) {
   if (cc->error)
     return;
 
+  uint32_t expr_start = cc->code_pos;
   cc_parse_primary(cc);
 
   while (!cc->error) {
@@ -3174,6 +3658,9 @@ static void cc_parse_expression(cc_state_t *cc, int min_prec) {
 
     cc_type_t left_type = cc_last_expr_type;
     int left_is_fp = (left_type == TYPE_FLOAT || left_type == TYPE_DOUBLE);
+    int left_const = cc_opt_is_const(cc, expr_start);
+    int32_t left_val = cc->opt_const_val;
+    uint32_t push_pos = cc->code_pos;
     if (left_is_fp) {
       /* Spill XMM0 (the FP accumulator) onto the stack.  Reserve 8 bytes
        * regardless of type so ESP stays 4-byte aligned in both cases.*/
@@ -3312,7 +3799,14 @@ static void cc_parse_expression(cc_state_t *cc, int min_prec) {
       continue; /* skip the int binop path below */
     }
 
-    cc_emit_binop(cc, op.type);
+    if (!cc->opt_level ||
+        !cc_opt_binop(cc, op.type, expr_start, push_pos, left_const,
+                      left_val)) {
+      cc_emit_binop(cc, op.type);
+      if (cc_opt_cond_code(op.type) >= 0 || op.type == CC_TOK_AND ||
+          op.type == CC_TOK_OR)
+        cc->opt_setcc_end = cc->code_pos;
+    }
     /* Track the promoted FP/int type for arithmetic ops only.
      * Comparison/logical/bitwise results stay int (0/1 or bit pattern).
      * Used to select SSE vs. integer opcodes.*/
@@ -3349,6 +3843,7 @@ static void cc_parse_expression(cc_state_t *cc, int min_prec) {
 
     /* False arm starts here. */
     patch32(cc, jz_off + 2, (uint32_t)(cc->code_pos - (jz_off + 6)));
+    cc->opt_barrier = cc->code_pos;
 
     cc_token_t colon = cc_next(cc);
     if (colon.type != CC_TOK_COLON) {
@@ -3362,6 +3857,7 @@ static void cc_parse_expression(cc_state_t *cc, int min_prec) {
 
     /* End of ternary expression. */
     patch32(cc, jmp_off + 1, (uint32_t)(cc->code_pos - (jmp_off + 5)));
+    cc->opt_barrier = cc->code_pos;
   }
 }
 
@@ -4029,6 +4525,7 @@ static cc_asm_mem_t cc_parse_asm_mem(cc_state_t *cc) {
 static void cc_asm_emit_mem_modrm(cc_state_t *cc, int reg_field,
                                   const cc_asm_mem_t *mem) {
   if (mem->is_local) {
+    cc_opt_note_escape(cc, mem->offset);
     /* mod=10, reg=reg_field, r/m=101 (EBP) + disp32 */
     emit8(cc, (uint8_t)(0x85 | ((reg_field & 7) << 3)));
     emit32(cc, (uint32_t)mem->offset);
@@ -4185,6 +4682,7 @@ static int cc_parse_asm_fpu_opcode(cc_state_t *cc, const char *mn) {
 }
 
 static void cc_parse_asm_block(cc_state_t *cc) {
+  cc->opt_saw_asm = 1; /* -O: keep locals in memory, preserve ESI/EDI */
   cc_expect(cc, CC_TOK_LBRACE);
 
   while (!cc->error && cc_peek(cc).type != CC_TOK_RBRACE &&
@@ -4839,22 +5337,23 @@ static void cc_parse_declaration(cc_state_t *cc, cc_type_t type) {
 
 static void cc_parse_if(cc_state_t *cc) {
   cc_expect(cc, CC_TOK_LPAREN);
+  uint32_t cond_start = cc->code_pos;
   cc_parse_expression(cc, 1);
   cc_expect(cc, CC_TOK_RPAREN);
 
   /* test eax, eax; je else_label */
-  emit_cmp_eax_zero(cc);
-  uint32_t else_patch = emit_jcc_placeholder(cc, 0x84); /* je */
+  uint32_t else_patch = cc_emit_branch_false(cc, cond_start);
 
   cc_parse_statement(cc);
 
   if (cc_peek(cc).type == CC_TOK_ELSE) {
     cc_next(cc);
     uint32_t end_patch = emit_jmp_placeholder(cc);
-    patch_jump(cc, else_patch);
+    if (else_patch)
+      patch_jump(cc, else_patch);
     cc_parse_statement(cc);
     patch_jump(cc, end_patch);
-  } else {
+  } else if (else_patch) {
     patch_jump(cc, else_patch);
   }
 }
@@ -4874,8 +5373,7 @@ static void cc_parse_while(cc_state_t *cc) {
   cc_parse_expression(cc, 1);
   cc_expect(cc, CC_TOK_RPAREN);
 
-  emit_cmp_eax_zero(cc);
-  uint32_t exit_patch = emit_jcc_placeholder(cc, 0x84); /* je */
+  uint32_t exit_patch = cc_emit_branch_false(cc, loop_start);
 
   cc_parse_statement(cc);
 
@@ -4884,7 +5382,8 @@ static void cc_parse_while(cc_state_t *cc) {
   int32_t rel = (int32_t)(loop_start - (cc->code_pos + 4));
   emit32(cc, (uint32_t)rel);
 
-  patch_jump(cc, exit_patch);
+  if (exit_patch)
+    patch_jump(cc, exit_patch);
 
   /* Patch all break targets */
   if (old_depth < CC_MAX_BREAKS && cc->loop_depth > old_depth) {
@@ -4932,8 +5431,7 @@ static void cc_parse_for(cc_state_t *cc) {
   uint32_t exit_patch = 0;
   if (cc_peek(cc).type != CC_TOK_SEMICOLON) {
     cc_parse_expression(cc, 1);
-    emit_cmp_eax_zero(cc);
-    exit_patch = emit_jcc_placeholder(cc, 0x84); /* je */
+    exit_patch = cc_emit_branch_false(cc, cond_start);
   }
   cc_expect(cc, CC_TOK_SEMICOLON);
 
@@ -5146,6 +5644,8 @@ static void cc_parse_statement(cc_state_t *cc) {
     /* do { body } while (cond); */
     cc_next(cc);
     uint32_t loop_start = cc->code_pos;
+    uint32_t cond_start;
+    int cond = 0;
     int old_depth = cc->loop_depth;
     if (cc->loop_depth < CC_MAX_BREAKS) {
       cc->break_counts[cc->loop_depth] = 0;
@@ -5155,16 +5655,32 @@ static void cc_parse_statement(cc_state_t *cc) {
     cc_parse_statement(cc);
     cc_expect(cc, CC_TOK_WHILE);
     cc_expect(cc, CC_TOK_LPAREN);
+    cond_start = cc->code_pos;
     cc_parse_expression(cc, 1);
     cc_expect(cc, CC_TOK_RPAREN);
     cc_expect(cc, CC_TOK_SEMICOLON);
     /* If condition is true (non-zero), jump back to loop_start */
-    emit_cmp_eax_zero(cc);
-    emit8(cc, 0x0F);
-    emit8(cc, 0x85); /* jne rel32 */
-    {
-      int32_t rel = (int32_t)(loop_start - (cc->code_pos + 4));
-      emit32(cc, (uint32_t)rel);
+    switch (cc_opt_condition(cc, cond_start, &cond)) {
+    case CC_OPT_COND_FALSE:
+      break;
+    case CC_OPT_COND_TRUE:
+      emit8(cc, 0xE9); /* jmp rel32 */
+      emit32(cc, loop_start - (cc->code_pos + 4));
+      break;
+    case CC_OPT_COND_FLAGS:
+      emit8(cc, 0x0F);
+      emit8(cc, (uint8_t)(0x80 | cond)); /* jcc rel32 */
+      emit32(cc, loop_start - (cc->code_pos + 4));
+      break;
+    default:
+      emit_cmp_eax_zero(cc);
+      emit8(cc, 0x0F);
+      emit8(cc, 0x85); /* jne rel32 */
+      {
+        int32_t rel = (int32_t)(loop_start - (cc->code_pos + 4));
+        emit32(cc, (uint32_t)rel);
+      }
+      break;
     }
     /* Patch all break targets */
     if (old_depth < CC_MAX_BREAKS && cc->loop_depth > old_depth) {
@@ -5768,12 +6284,172 @@ static void cc_parse_block(cc_state_t *cc) {
   cc_expect(cc, CC_TOK_RBRACE);
 
   /* Restore scope (pop local variables) */
-  cc->sym_count = saved_scope;
+  cc_sym_pop(cc, saved_scope);
   cc->local_offset = saved_offset;
 }
 
 /* Function Parsing */
 
+/* -O: reserve the ESI/EDI save slots at [ebp-4]/[ebp-8] (in both passes,
+ * so slot offsets agree between them), then in the emit pass save the
+ * registers this function claims and load any promoted parameters.*/
+static void cc_opt_enter_body(cc_state_t *cc) {
+  cc->local_offset = -8;
+  cc->max_local_offset = -8;
+  if (cc->opt_pass != 2)
+    return;
+  if (cc->opt_save_regs & 1) {
+    emit8(cc, 0x89); /* mov [ebp-4], esi */
+    emit8(cc, 0x75);
+    emit8(cc, 0xFC);
+  }
+  if (cc->opt_save_regs & 2) {
+    emit8(cc, 0x89); /* mov [ebp-8], edi */
+    emit8(cc, 0x7D);
+    emit8(cc, 0xF8);
+  }
+  for (int r = 0; r < 2; r++) {
+    if (cc->opt_reg_slot[r] > 0) {
+      emit8(cc, 0x8B); /* mov esi/edi, [ebp+disp32] */
+      emit8(cc, r ? 0xBD : 0xB5);
+      emit32(cc, (uint32_t)cc->opt_reg_slot[r]);
+    }
+  }
+}
+
+/* Emit prologue, body and default epilogue for a function whose
+ * parameters are already in scope.*/
+static void cc_emit_function_body(cc_state_t *cc) {
+  cc_labels_reset(cc);
+
+  /* Emit function prologue */
+  emit_prologue(cc);
+
+  /* Reserve space for locals (we'll patch this after parsing the body) */
+  uint32_t sub_esp_pos = cc->code_pos;
+  emit_sub_esp(cc, 256); /* placeholder - generous allocation */
+
+  if (cc->opt_level)
+    cc_opt_enter_body(cc);
+
+  /* Parse body */
+  cc_expect(cc, CC_TOK_LBRACE);
+
+  while (!cc->error && cc_peek(cc).type != CC_TOK_RBRACE &&
+         cc_peek(cc).type != CC_TOK_EOF) {
+    cc_parse_statement(cc);
+  }
+  cc_expect(cc, CC_TOK_RBRACE);
+  cc_resolve_labels(cc);
+
+  /* Patch the sub esp with actual local space used */
+  int32_t locals_size = -cc->max_local_offset;
+  if (locals_size < 0)
+    locals_size = 0;
+  /* Round up to 16-byte alignment */
+  locals_size = (locals_size + 15) & ~15;
+  if (locals_size == 0)
+    locals_size = 16; /* minimum */
+  /* Patch: sub esp, imm32 at sub_esp_pos+2 */
+  patch32(cc, sub_esp_pos + 2, (uint32_t)locals_size);
+
+  /* Emit default epilogue (in case no return statement) */
+  emit_mov_eax_imm(cc, 0);
+  emit_epilogue(cc);
+}
+
+/* Give ESI and EDI to the two heaviest slots the analysis pass saw only
+ * as plain dword loads/stores.  A function with inline asm promotes
+ * nothing but still preserves both, since the asm may clobber them.*/
+static void cc_opt_assign_regs(cc_state_t *cc) {
+  cc->opt_reg_slot[0] = 0;
+  cc->opt_reg_slot[1] = 0;
+  cc->opt_save_regs = 0;
+  if (cc->opt_saw_asm) {
+    cc->opt_save_regs = 3;
+    return;
+  }
+  for (int r = 0; r < 2; r++) {
+    cc_opt_slot_t *best = NULL;
+    for (int i = 0; i < cc->opt_slot_count; i++) {
+      cc_opt_slot_t *s = &cc->opt_slots[i];
+      if (s->escaped || s->weight < 2)
+        continue;
+      if (s->offset > 0 && cc->opt_param_escaped)
+        continue;
+      if (r == 1 && s->offset == cc->opt_reg_slot[0])
+        continue;
+      if (!best || s->weight > best->weight)
+        best = s;
+    }
+    if (!best)
+      break;
+    cc->opt_reg_slot[r] = best->offset;
+    cc->opt_save_regs |= 1 << r;
+  }
+}
+
+/* -O function body: run the parser over the body once to gather slot
+ * statistics, rewind the lexer and output, then emit it for real with
+ * registers assigned.  Everything the body can append to (code, data,
+ * symbols, structs, typedefs, patches) is restored by count.*/
+static void cc_opt_function_body(cc_state_t *cc) {
+  cc_opt_snapshot_t *snap = &cc->opt_snap;
+  snap->pos = cc->pos;
+  snap->line = cc->line;
+  snap->cur = cc->cur;
+  snap->peek_buf = cc->peek_buf;
+  snap->has_peek = cc->has_peek;
+  snap->code_pos = cc->code_pos;
+  snap->data_pos = cc->data_pos;
+  snap->sym_count = cc->sym_count;
+  snap->struct_count = cc->struct_count;
+  snap->typedef_count = cc->typedef_count;
+  snap->patch_count = cc->patch_count;
+  snap->local_offset = cc->local_offset;
+  snap->max_local_offset = cc->max_local_offset;
+  snap->loop_depth = cc->loop_depth;
+
+  cc->opt_pass = 1;
+  cc->opt_slot_count = 0;
+  cc->opt_param_escaped = 0;
+  cc->opt_saw_asm = 0;
+  cc->opt_reg_slot[0] = 0;
+  cc->opt_reg_slot[1] = 0;
+  cc->opt_save_regs = 0;
+  cc_emit_function_body(cc);
+
+  if (!cc->error) {
+    cc_opt_assign_regs(cc);
+    cc->pos = snap->pos;
+    cc->line = snap->line;
+    cc->cur = snap->cur;
+    cc->peek_buf = snap->peek_buf;
+    cc->has_peek = snap->has_peek;
+    cc->code_pos = snap->code_pos;
+    cc->data_pos = snap->data_pos;
+    cc_sym_pop(cc, snap->sym_count);
+    cc->struct_count = snap->struct_count;
+    cc->typedef_count = snap->typedef_count;
+    cc->patch_count = snap->patch_count;
+    cc->local_offset = snap->local_offset;
+    cc->max_local_offset = snap->max_local_offset;
+    cc->loop_depth = snap->loop_depth;
+    cc->opt_const_end = 0;
+    cc->opt_setcc_end = 0;
+    cc->opt_barrier = 0;
+    cc_xmm_reset();
+
+    cc->opt_pass = 2;
+    cc_emit_function_body(cc);
+  }
+
+  cc->opt_pass = 0;
+  cc->opt_reg_slot[0] = 0;
+  cc->opt_reg_slot[1] = 0;
+  cc->opt_save_regs = 0;
+}
+
 static void cc_parse_function(cc_state_t *cc) {
   cc_type_t ret_type = cc_parse_type(cc);
   if (ret_type == TYPE_STRUCT) {
@@ -5790,7 +6466,8 @@ static void cc_parse_function(cc_state_t *cc) {
 
   /* Register function symbol */
   cc_symbol_t *func_sym = cc_sym_find(cc, name_tok.text);
-  if (!func_sym) {
+  if (!func_sym || func_sym->kind == SYM_KERNEL) {
+    /* Kernel bindings are shared; a user definition shadows them. */
     func_sym = cc_sym_add(cc, name_tok.text, SYM_FUNC, ret_type);
   }
   if (func_sym) {
@@ -5907,46 +6584,17 @@ static void cc_parse_function(cc_state_t *cc) {
       func_sym->is_defined = 0;
       func_sym->offset = 0;
     }
-    cc->sym_count = saved_scope;
+    cc_sym_pop(cc, saved_scope);
     return;
   }
 
-  cc_labels_reset(cc);
-
-  /* Emit function prologue */
-  emit_prologue(cc);
-
-  /* Reserve space for locals (we'll patch this after parsing the body) */
-  uint32_t sub_esp_pos = cc->code_pos;
-  emit_sub_esp(cc, 256); /* placeholder - generous allocation */
-
-  /* Parse body */
-  cc_expect(cc, CC_TOK_LBRACE);
-
-  while (!cc->error && cc_peek(cc).type != CC_TOK_RBRACE &&
-         cc_peek(cc).type != CC_TOK_EOF) {
-    cc_parse_statement(cc);
-  }
-  cc_expect(cc, CC_TOK_RBRACE);
-  cc_resolve_labels(cc);
-
-  /* Patch the sub esp with actual local space used */
-  int32_t locals_size = -cc->max_local_offset;
-  if (locals_size < 0)
-    locals_size = 0;
-  /* Round up to 16-byte alignment */
-  locals_size = (locals_size + 15) & ~15;
-  if (locals_size == 0)
-    locals_size = 16; /* minimum */
-  /* Patch: sub esp, imm32 at sub_esp_pos+2 */
-  patch32(cc, sub_esp_pos + 2, (uint32_t)locals_size);
-
-  /* Emit default epilogue (in case no return statement) */
-  emit_mov_eax_imm(cc, 0);
-  emit_epilogue(cc);
+  if (cc->opt_level)
+    cc_opt_function_body(cc);
+  else
+    cc_emit_function_body(cc);
 
   /* Restore scope */
-  cc->sym_count = saved_scope;
+  cc_sym_pop(cc, saved_scope);
   /* Re-add function symbol (it was part of the saved scope) */
   if (func_sym) {
     cc_symbol_t *new_sym = cc_sym_add(cc, name_tok.text, SYM_FUNC, ret_type);
@@ -5966,7 +6614,8 @@ static void cc_parse_class_method(cc_state_t *cc, int class_index,
   cc_make_method_symbol(full_name, cc->structs[class_index].name, method_name);
 
   cc_symbol_t *func_sym = cc_sym_find(cc, full_name);
-  if (!func_sym) {
+  if (!func_sym || func_sym->kind == SYM_KERNEL) {
+    /* Kernel bindings are shared; a user definition shadows them. */
     func_sym = cc_sym_add(cc, full_name, SYM_FUNC, ret_type);
   }
   if (func_sym) {
@@ -6069,33 +6718,12 @@ static void cc_parse_class_method(cc_state_t *cc, int class_index,
     func_sym->param_count = cc->param_count;
   }
 
-  emit_prologue(cc);
-  {
-    uint32_t sub_esp_pos = cc->code_pos;
-    emit_sub_esp(cc, 256);
-
-    cc_expect(cc, CC_TOK_LBRACE);
-    while (!cc->error && cc_peek(cc).type != CC_TOK_RBRACE &&
-           cc_peek(cc).type != CC_TOK_EOF) {
-      cc_parse_statement(cc);
-    }
-    cc_expect(cc, CC_TOK_RBRACE);
-
-    {
-      int32_t locals_size = -cc->max_local_offset;
-      if (locals_size < 0)
-        locals_size = 0;
-      locals_size = (locals_size + 15) & ~15;
-      if (locals_size == 0)
-        locals_size = 16;
-      patch32(cc, sub_esp_pos + 2, (uint32_t)locals_size);
-    }
-  }
-
-  emit_mov_eax_imm(cc, 0);
-  emit_epilogue(cc);
+  if (cc->opt_level)
+    cc_opt_function_body(cc);
+  else
+    cc_emit_function_body(cc);
 
-  cc->sym_count = saved_scope;
+  cc_sym_pop(cc, saved_scope);
 
   if (func_sym) {
     cc_symbol_t *new_sym = cc_sym_add(cc, full_name, SYM_FUNC, ret_type);
@@ -6734,7 +7362,7 @@ void cc_parse_program(cc_state_t *cc) {
                 }
                 cc->data[cc->data_pos++] = 0;
                 /* Align data_pos to 4 */
-                cc->data_pos = (cc->data_pos + 3u) & ~3u;
+                cc_data_align4(cc);
                 cc->data[addr_off] = (uint8_t)(str_addr & 0xFF);
                 cc->data[addr_off + 1] = (uint8_t)((str_addr >> 8) & 0xFF);
                 cc->data[addr_off + 2] = (uint8_t)((str_addr >> 16) & 0xFF);
@@ -6832,6 +7460,7 @@ void cc_parse_program(cc_state_t *cc) {
         write_i++;
       }
       cc->sym_count = write_i;
+      cc_sym_rehash(cc);
     }
   }
 
@@ -6979,6 +7608,8 @@ void cc_parse_repl_line(cc_state_t *cc, int *is_expr) {
       }
       cc_symbol_t *gsym = cc_sym_add(cc, name_tok.text, SYM_GLOBAL, TYPE_INT);
       if (gsym) {
+        if (!cc_data_reserve(cc, 4))
+          return;
         gsym->address = cc->data_base + cc->data_pos;
         gsym->is_const_int = 1;
         gsym->const_int_value = enum_val;
@@ -7272,7 +7903,7 @@ void cc_parse_repl_line(cc_state_t *cc, int *is_expr) {
             }
             if (cc->data_pos < CC_MAX_DATA)
               cc->data[cc->data_pos++] = 0;
-            cc->data_pos = (cc->data_pos + 3u) & ~3u;
+            cc_data_align4(cc);
             cc->data[addr_off] = (uint8_t)(str_addr & 0xFF);
             cc->data[addr_off + 1] = (uint8_t)((str_addr >> 8) & 0xFF);
             cc->data[addr_off + 2] = (uint8_t)((str_addr >> 16) & 0xFF);
@@ -7341,7 +7972,7 @@ void cc_parse_repl_line(cc_state_t *cc, int *is_expr) {
 
     emit_epilogue(cc);
 
-    cc->sym_count = saved_scope;
+    cc_sym_pop(cc, saved_scope);
 
     for (int i = 0; i < cc->patch_count; i++) {
       cc_patch_t *p = &cc->patches[i];
@@ -26,6 +26,20 @@
 #define MAX_TOKEN_LEN      128
 #define MAX_EXPAND_LEN     128
 #define MAX_SCRIPT_ARGS      8
+#define CS_MAX_LOOP_ITERATIONS 1000000  /* while-loop safety limit */
+
+/* Bytecode limits (cupidscript_compile.c); a script over them runs on
+ * the tree-walking interpreter instead. */
+#define CS_MAX_CODE       2048  /* instructions per program */
+#define CS_MAX_WORDS      1024  /* word templates per program */
+#define CS_MAX_SEGS       2048  /* template segments per program */
+#define CS_MAX_TEXT       8192  /* literal template text per program */
+#define CS_MAX_NAMES       128  /* interned variable names per program */
+#define CS_MAX_LOOP_DEPTH   16  /* loops nested in one function body */
+
+/* Hash indexes over a context's variables and functions */
+#define CS_VAR_BUCKETS      64  /* power of two, > MAX_VARIABLES */
+#define CS_FUNC_BUCKETS     32  /* power of two, > MAX_FUNCTIONS */
 
 /* Token types */
 typedef enum {
@@ -152,6 +166,14 @@ struct ast_node {
     } data;
 };
 
+/* Measurements of the last pipeline (special variables PIPE_*) */
+typedef struct {
+    uint32_t bytes;      /* $PIPE_BYTES: bytes through all its pipes */
+    uint32_t peak;       /* $PIPE_PEAK: sum of each pipe's fullest moment */
+    uint32_t first_ms;   /* $PIPE_FIRST_MS: until the last stage's first input */
+    uint32_t total_ms;   /* $PIPE_MS: until every stage finished */
+} cs_pipeline_stats_t;
+
 /* Runtime context */
 typedef struct {
     char name[MAX_VAR_NAME];
@@ -161,13 +183,107 @@ typedef struct {
 typedef struct {
     char name[MAX_VAR_NAME];
     ast_node_t *body;
+    int entry;              /* bytecode pc of the body, -1 to walk the AST */
 } cs_function_t;
 
+/* Bytecode
+ * A script compiles to one flat instruction array.  Control flow turns
+ * into jumps, every word into a template of pre-split segments, and
+ * every variable name into an id that each context resolves to its
+ * variable slot once.  Commands, pipelines and function definitions
+ * keep their AST node for redirections and built-in dispatch.*/
+typedef enum {
+    CS_OP_CMD,          /* node; words a..a+b */
+    CS_OP_PIPELINE,     /* node */
+    CS_OP_ASSIGN,       /* name = word a */
+    CS_OP_TEST,         /* words a..a+b, c: cs_test_op_t */
+    CS_OP_STATUS,       /* status = a */
+    CS_OP_JUMP,         /* pc = a */
+    CS_OP_JUMP_FALSE,   /* pc = a if status != 0 */
+    CS_OP_LOOP_INIT,    /* counter[loop] = 0 */
+    CS_OP_LOOP,         /* pc = a once counter[loop] hits the limit */
+    CS_OP_FOR,          /* name = word b + counter[loop]++, pc = a after c */
+    CS_OP_DEFUN,        /* register node's function with body at pc a */
+    CS_OP_RETURN,       /* return a */
+    CS_OP_END           /* end of the script or a function body */
+} cs_opcode_t;
+
+typedef struct {
+    uint8_t op;
+    uint8_t loop;       /* CS_OP_LOOP_INIT/LOOP/FOR: counter index */
+    uint8_t stmt;       /* first instruction of a sequence statement */
+    int16_t name;       /* interned variable name, -1 if none */
+    int32_t a, b, c;
+    ast_node_t *node;
+} cs_insn_t;
+
+/* [ ] operators, resolved at compile time when the operator is literal */
+typedef enum {
+    CS_TEST_DYNAMIC,    /* look the operator up after expansion */
+    CS_TEST_EQ, CS_TEST_NE, CS_TEST_LT, CS_TEST_GT, CS_TEST_LE, CS_TEST_GE,
+    CS_TEST_STR_EQ, CS_TEST_STR_NE,
+    CS_TEST_UNKNOWN
+} cs_test_op_t;
+
+typedef enum {
+    CS_SEG_TEXT,        /* literal text, escapes already applied */
+    CS_SEG_VAR,         /* $name */
+    CS_SEG_BRACE,       /* ${text}: cs_expand_advanced_var */
+    CS_SEG_ARITH,       /* $((lhs [op rhs])) with plain operands */
+    CS_SEG_EXPAND       /* anything else: cupidscript_expand(text) */
+} cs_seg_kind_t;
+
+typedef struct {
+    int16_t name;       /* variable, or -1 for the literal value */
+    uint8_t neg;
+    int32_t value;
+} cs_operand_t;
+
+typedef struct {
+    uint8_t kind;
+    char op;            /* CS_SEG_ARITH: + - * / %, or 0 for lhs alone */
+    int16_t name;       /* CS_SEG_VAR */
+    uint16_t text;      /* offset of the NUL-terminated text in the pool */
+    uint16_t len;
+    cs_operand_t lhs, rhs;
+} cs_seg_t;
+
+typedef struct {
+    uint16_t seg;       /* first segment */
+    uint16_t count;
+} cs_word_t;
+
+typedef struct cs_program {
+    ast_node_t *ast;
+    /* Compiled form; code is NULL if the script is over the limits */
+    cs_insn_t *code;
+    int code_len;
+    cs_word_t *words;
+    cs_seg_t *segs;
+    char (*names)[MAX_VAR_NAME];
+    uint8_t *special;   /* name is computed (cs_is_special_variable) */
+    int name_count;
+    char *text;
+    /* Program cache (cupidscript_compile.c) */
+    char path[128];
+    uint32_t size;
+    uint32_t hash;
+    uint32_t last_use;
+    int refs;
+    bool cached;
+} cs_program_t;
+
 typedef struct script_context {
     cs_variable_t variables[MAX_VARIABLES];
     int var_count;
+    uint8_t var_index[CS_VAR_BUCKETS];   /* slot + 1 by name hash, 0 = empty */
     cs_function_t functions[MAX_FUNCTIONS];
     int func_count;
+    uint8_t func_index[CS_FUNC_BUCKETS];
+    /* Bytecode being run (NULL: walking the AST) and the variable slot
+     * of each of its interned names (-1 until first resolved) */
+    const cs_program_t *program;
+    int8_t var_slot[CS_MAX_NAMES];
     int last_exit_status;    /* $? */
     int return_flag;         /* set by return statement */
     int return_value;
@@ -177,6 +293,19 @@ typedef struct script_context {
     int script_argc;
     /* NEW: Stream system */
     fd_table_t fd_table;
+    /* Streams of the command being executed (-1 outside a command) */
+    int active_stdin_fd;
+    int active_stdout_fd;
+    /* Read-ahead for line reads (read, grep, head) from a pipe or file */
+    char in_buf[256];
+    int in_pos;
+    int in_len;
+    const void *in_src;     /* pipe or fd slot in_buf was filled from */
+    /* Pipeline stages: stdout's reader is gone, unwind (SIGPIPE) */
+    int pipe_broken;
+    /* Pipeline stages: pid whose external-command turn this one shares */
+    uint32_t ext_inherit;
+    cs_pipeline_stats_t last_pipeline;
     /* NEW: Job control */
     job_table_t jobs;
     /* NEW: Arrays */
@@ -210,13 +339,45 @@ void cupidscript_register_function(script_context_t *ctx, const char *name,
                                    ast_node_t *body);
 ast_node_t *cupidscript_lookup_function(script_context_t *ctx,
                                         const char *name);
+void cs_define_function(script_context_t *ctx, const char *name,
+                        ast_node_t *body, int entry);
+const cs_function_t *cs_find_function(script_context_t *ctx,
+                                      const char *name);
+/* Names whose value is computed ($?, $1, $EPOCHSECONDS, ...) */
+bool cs_is_special_variable(const char *name);
+/* Slot-indexed access by interned name id of ctx->program */
+const char *cs_get_var_id(script_context_t *ctx, int id);
+void cs_set_var_id(script_context_t *ctx, int id, const char *value);
+
+/* Public API - Bytecode  (cupidscript_compile.c) */
+/* Tokenize, parse and compile source, or reuse the cached program for
+ * path if its source is unchanged.  Returns 0, -1 out of memory, -2
+ * parse error.  Release with cs_program_put. */
+int cs_program_get(const char *path, const char *source, uint32_t length,
+                   cs_program_t **out);
+void cs_program_put(cs_program_t *prog);
+/* Expand word template into out[MAX_EXPAND_LEN] */
+void cs_expand_word(script_context_t *ctx, int word, char *out);
+/* Integer value of a word, as [ -eq ] and friends read it */
+int cs_word_int(script_context_t *ctx, int word);
+cs_test_op_t cs_test_op(const char *op);
 
 /* Public API - Executor  (cupidscript_exec.c) */
 int cupidscript_execute(ast_node_t *ast, script_context_t *ctx);
+/* Wait for the other end of a pipe, handing back the caller's external
+ * command turn meanwhile unless it runs a JIT program.  since_ms is
+ * when the pipe last moved.  Returns false, having logged why, where
+ * waiting would hang: no current process, or a JIT program keeping the
+ * turn while the pipe stalls and another command waits for the turn.*/
+bool cs_pipe_wait(uint32_t since_ms);
 
 /* Public API - Top-level entry  (called from shell.c) */
 int cupidscript_run_file(const char *filename, const char *args);
 
+/* Run scripts as bytecode (default) or, for comparison, on the
+ * tree-walking interpreter */
+void cupidscript_set_bytecode(bool enabled);
+
 /* Set output functions (for GUI mode support) */
 void cupidscript_set_output(void (*print_fn)(const char *),
                             void (*putchar_fn)(char),
@@ -0,0 +1,681 @@
+/*
+ * cupidscript_compile.c - Bytecode compiler and program cache for CupidScript
+ *
+ * Compiles the AST to the flat instruction array run by cs_vm_run in
+ * cupidscript_exec.c.  Words become templates of pre-split segments
+ * (literal text with escapes applied, variables by interned id, and
+ * two-operand arithmetic), so running a statement expands them without
+ * rescanning text, allocating or searching variables by name.
+ *
+ * Compiled programs are cached per script path and reused while the
+ * file's size and FNV-1a hash match; the VFS keeps no modification
+ * times.  The AST stays with the program (commands and pipelines still
+ * run from their nodes) and is shared read-only by every run.
+*/
+#include "cupidscript.h"
+#include "string.h"
+#include "memory.h"
+#include "serial.h"
+#include "bkl.h"
+
+#define CS_CACHE_SLOTS 8
+
+/* Compile state
+ * Filled at the maximum sizes, then packed into one allocation.*/
+typedef struct {
+    cs_insn_t code[CS_MAX_CODE];
+    int code_len;
+    cs_word_t words[CS_MAX_WORDS];
+    int word_count;
+    cs_seg_t segs[CS_MAX_SEGS];
+    int seg_count;
+    char names[CS_MAX_NAMES][MAX_VAR_NAME];
+    uint8_t special[CS_MAX_NAMES];
+    int name_count;
+    char text[CS_MAX_TEXT];
+    int text_len;
+    int loop_depth;
+    int failed;
+} cs_compiler_t;
+
+static int is_varname_char(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+           (c >= '0' && c <= '9') || c == '_';
+}
+
+static int cs_intern(cs_compiler_t *cc, const char *name, int len) {
+    if (len >= MAX_VAR_NAME) len = MAX_VAR_NAME - 1;
+    for (int i = 0; i < cc->name_count; i++) {
+        if (strncmp(cc->names[i], name, (size_t)len) == 0 &&
+            cc->names[i][len] == '\0') {
+            return i;
+        }
+    }
+    if (cc->name_count >= CS_MAX_NAMES) {
+        cc->failed = 1;
+        return 0;
+    }
+    int id = cc->name_count++;
+    memcpy(cc->names[id], name, (size_t)len);
+    cc->names[id][len] = '\0';
+    cc->special[id] = cs_is_special_variable(cc->names[id]) ? 1 : 0;
+    return id;
+}
+
+static cs_seg_t *cs_new_seg(cs_compiler_t *cc, cs_seg_kind_t kind) {
+    if (cc->seg_count >= CS_MAX_SEGS) {
+        cc->failed = 1;
+        return NULL;
+    }
+    cs_seg_t *s = &cc->segs[cc->seg_count++];
+    memset(s, 0, sizeof(*s));
+    s->kind = (uint8_t)kind;
+    s->name = -1;
+    s->lhs.name = -1;
+    s->rhs.name = -1;
+    return s;
+}
+
+/* Segment holding a NUL-terminated copy of text in the pool */
+static cs_seg_t *cs_text_seg(cs_compiler_t *cc, cs_seg_kind_t kind,
+                             const char *text, int len) {
+    if (cc->text_len + len + 1 > CS_MAX_TEXT) {
+        cc->failed = 1;
+        return NULL;
+    }
+    cs_seg_t *s = cs_new_seg(cc, kind);
+    if (!s) return NULL;
+    s->text = (uint16_t)cc->text_len;
+    s->len = (uint16_t)len;
+    memcpy(cc->text + cc->text_len, text, (size_t)len);
+    cc->text[cc->text_len + len] = '\0';
+    cc->text_len += len + 1;
+    return s;
+}
+
+/* One arithmetic operand: [-] digits | [-] [$]name | [-] $special */
+static int cs_parse_operand(cs_compiler_t *cc, const char **pp,
+                            cs_operand_t *o) {
+    const char *p = *pp;
+    while (*p == ' ') p++;
+    if (*p == '-') { o->neg = 1; p++; }
+    if (*p >= '0' && *p <= '9') {
+        int32_t v = 0;
+        while (*p >= '0' && *p <= '9') v = v * 10 + (*p++ - '0');
+        o->value = v;
+    } else if (*p == '$' && (p[1] == '?' || p[1] == '#' ||
+                             (p[1] >= '0' && p[1] <= '9'))) {
+        o->name = (int16_t)cs_intern(cc, p + 1, 1);
+        p += 2;
+    } else {
+        if (*p == '$') p++;
+        const char *start = p;
+        while (is_varname_char(*p)) p++;
+        if (p == start) return 0;
+        o->name = (int16_t)cs_intern(cc, start, (int)(p - start));
+    }
+    while (*p == ' ') p++;
+    *pp = p;
+    return 1;
+}
+
+/* $((expr)): compiled when it is one or two plain operands, otherwise
+ * left to cupidscript_expand. */
+static void cs_compile_arith(cs_compiler_t *cc, const char *expr, int len) {
+    char buf[MAX_TOKEN_LEN];
+    if (len >= MAX_TOKEN_LEN) len = MAX_TOKEN_LEN - 1;
+    memcpy(buf, expr, (size_t)len);
+    buf[len] = '\0';
+
+    cs_operand_t lhs = { -1, 0, 0 };
+    cs_operand_t rhs = { -1, 0, 0 };
+    char op = 0;
+    const char *p = buf;
+    int ok = cs_parse_operand(cc, &p, &lhs);
+    if (ok && *p) {
+        op = *p++;
+        ok = (op == '+' || op == '-' || op == '*' || op == '/' ||
+              op == '%') && cs_parse_operand(cc, &p, &rhs) && !*p;
+    }
+    if (ok) {
+        cs_seg_t *s = cs_new_seg(cc, CS_SEG_ARITH);
+        if (!s) return;
+        s->op = op;
+        s->lhs = lhs;
+        s->rhs = rhs;
+        return;
+    }
+
+    char raw[MAX_TOKEN_LEN + 6];
+    int n = 0;
+    raw[n++] = '$'; raw[n++] = '('; raw[n++] = '(';
+    memcpy(raw + n, buf, (size_t)len);
+    n += len;
+    raw[n++] = ')'; raw[n++] = ')';
+    cs_text_seg(cc, CS_SEG_EXPAND, raw, n);
+}
+
+/* Split str into segments the way cupidscript_expand scans it. */
+static int cs_compile_word(cs_compiler_t *cc, const char *str) {
+    if (cc->word_count >= CS_MAX_WORDS) {
+        cc->failed = 1;
+        return 0;
+    }
+    int w = cc->word_count++;
+    cc->words[w].seg = (uint16_t)cc->seg_count;
+
+    char lit[MAX_TOKEN_LEN];
+    int lit_len = 0;
+    int len = (int)strlen(str);
+    int i = 0;
+
+#define CS_FLUSH_TEXT() do {                                        \
+        if (lit_len > 0) {                                          \
+            cs_text_seg(cc, CS_SEG_TEXT, lit, lit_len);             \
+            lit_len = 0;                                            \
+        }                                                           \
+    } while (0)
+
+    while (i < len && !cc->failed) {
+        if (str[i] == '$') {
+            i++;
+            if (i >= len) break;
+
+            if (str[i] == '?' || str[i] == '#' || str[i] == '!' ||
+                (str[i] >= '0' && str[i] <= '9')) {
+                CS_FLUSH_TEXT();
+                cs_seg_t *s = cs_new_seg(cc, CS_SEG_VAR);
+                if (s) s->name = (int16_t)cs_intern(cc, str + i, 1);
+                i++;
+                continue;
+            }
+
+            if (str[i] == '{') {
+                int start = ++i;
+                int depth = 1;
+                while (i < len && depth > 0) {
+                    if (str[i] == '{') depth++;
+                    if (str[i] == '}') depth--;
+                    if (depth > 0) i++;
+                }
+                int elen = i - start;
+                if (i < len) i++;
+                if (elen > MAX_EXPAND_LEN - 1) elen = MAX_EXPAND_LEN - 1;
+                CS_FLUSH_TEXT();
+                cs_text_seg(cc, CS_SEG_BRACE, str + start, elen);
+                continue;
+            }
+
+            if (str[i] == '(' && i + 1 < len && str[i + 1] == '(') {
+                i += 2;
+                int start = i;
+                int end = len;
+                while (i < len) {
+                    if (str[i] == ')' && i + 1 < len && str[i + 1] == ')') {
+                        end = i;
+                        i += 2;
+                        break;
+                    }
+                    i++;
+                }
+                CS_FLUSH_TEXT();
+                cs_compile_arith(cc, str + start, end - start);
+                continue;
+            }
+
+            int start = i;
+            while (i < len && is_varname_char(str[i]) &&
+                   i - start < MAX_VAR_NAME - 1) {
+                i++;
+            }
+            if (i > start) {
+                CS_FLUSH_TEXT();
+                cs_seg_t *s = cs_new_seg(cc, CS_SEG_VAR);
+                if (s) s->name = (int16_t)cs_intern(cc, str + start, i - start);
+            }
+        } else if (str[i] == '\\' && i + 1 < len) {
+            i++;
+            char c = str[i++];
+            if (c == 'n') c = '\n';
+            else if (c == 't') c = '\t';
+            if (lit_len < MAX_TOKEN_LEN) lit[lit_len++] = c;
+        } else {
+            if (lit_len < MAX_TOKEN_LEN) lit[lit_len++] = str[i];
+            i++;
+        }
+    }
+    CS_FLUSH_TEXT();
+#undef CS_FLUSH_TEXT
+
+    cc->words[w].count = (uint16_t)(cc->seg_count - cc->words[w].seg);
+    return w;
+}
+
+static cs_insn_t *cs_emit(cs_compiler_t *cc, cs_opcode_t op) {
+    if (cc->code_len >= CS_MAX_CODE) {
+        cc->failed = 1;
+        static cs_insn_t scratch;
+        return &scratch;
+    }
+    cs_insn_t *in = &cc->code[cc->code_len++];
+    memset(in, 0, sizeof(*in));
+    in->op = (uint8_t)op;
+    in->name = -1;
+    return in;
+}
+
+static void cs_compile_node(cs_compiler_t *cc, ast_node_t *node);
+
+/* Conditions and bodies: a missing node leaves status 0 */
+static void cs_compile_or_zero(cs_compiler_t *cc, ast_node_t *node) {
+    if (node) cs_compile_node(cc, node);
+    else cs_emit(cc, CS_OP_STATUS)->a = 0;
+}
+
+static void cs_compile_node(cs_compiler_t *cc, ast_node_t *node) {
+    if (cc->failed) return;
+
+    switch (node->type) {
+    case NODE_COMMAND: {
+        int first = cc->word_count;
+        for (int i = 0; i < node->data.command.argc; i++) {
+            cs_compile_word(cc, node->data.command.argv[i]);
+        }
+        cs_insn_t *in = cs_emit(cc, CS_OP_CMD);
+        in->node = node;
+        in->a = first;
+        in->b = node->data.command.argc;
+        break;
+    }
+    case NODE_PIPELINE:
+        cs_emit(cc, CS_OP_PIPELINE)->node = node;
+        break;
+    case NODE_ASSIGNMENT: {
+        int name = cs_intern(cc, node->data.assignment.name,
+                             (int)strlen(node->data.assignment.name));
+        int word = cs_compile_word(cc, node->data.assignment.value);
+        cs_insn_t *in = cs_emit(cc, CS_OP_ASSIGN);
+        in->name = (int16_t)name;
+        in->a = word;
+        break;
+    }
+    case NODE_TEST: {
+        int first = cc->word_count;
+        for (int i = 0; i < node->data.test.argc; i++) {
+            cs_compile_word(cc, node->data.test.argv[i]);
+        }
+        cs_test_op_t op = CS_TEST_DYNAMIC;
+        if (node->data.test.argc == 3 &&
+            !strchr(node->data.test.argv[1], '$') &&
+            !strchr(node->data.test.argv[1], '\\')) {
+            op = cs_test_op(node->data.test.argv[1]);
+        }
+        cs_insn_t *in = cs_emit(cc, CS_OP_TEST);
+        in->a = first;
+        in->b = node->data.test.argc;
+        in->c = (int32_t)op;
+        break;
+    }
+    case NODE_IF: {
+        cs_compile_or_zero(cc, node->data.if_stmt.condition);
+        int jf = cc->code_len;
+        cs_emit(cc, CS_OP_JUMP_FALSE);
+        cs_compile_or_zero(cc, node->data.if_stmt.then_body);
+        int jend = cc->code_len;
+        cs_emit(cc, CS_OP_JUMP);
+        cc->code[jf].a = cc->code_len;
+        cs_compile_or_zero(cc, node->data.if_stmt.else_body);
+        cc->code[jend].a = cc->code_len;
+        break;
+    }
+    case NODE_WHILE: {
+        if (cc->loop_depth >= CS_MAX_LOOP_DEPTH) {
+            cc->failed = 1;
+            return;
+        }
+        int loop = cc->loop_depth++;
+        cs_emit(cc, CS_OP_LOOP_INIT)->loop = (uint8_t)loop;
+        int head = cc->code_len;
+        cs_emit(cc, CS_OP_LOOP)->loop = (uint8_t)loop;
+        cs_compile_or_zero(cc, node->data.while_stmt.condition);
+        int jf = cc->code_len;
+        cs_emit(cc, CS_OP_JUMP_FALSE);
+        cs_compile_or_zero(cc, node->data.while_stmt.body);
+        cs_emit(cc, CS_OP_JUMP)->a = head;
+        cc->code[head].a = cc->code_len;
+        cc->code[jf].a = cc->code_len;
+        cs_emit(cc, CS_OP_STATUS)->a = 0;
+        cc->loop_depth--;
+        break;
+    }
+    case NODE_FOR: {
+        if (cc->loop_depth >= CS_MAX_LOOP_DEPTH) {
+            cc->failed = 1;
+            return;
+        }
+        int loop = cc->loop_depth++;
+        int name = cs_intern(cc, node->data.for_stmt.var_name,
+                             (int)strlen(node->data.for_stmt.var_name));
+        int first = cc->word_count;
+        for (int i = 0; i < node->data.for_stmt.word_count; i++) {
+            cs_compile_word(cc, node->data.for_stmt.word_list[i]);
+        }
+        cs_emit(cc, CS_OP_LOOP_INIT)->loop = (uint8_t)loop;
+        int head = cc->code_len;
+        cs_insn_t *in = cs_emit(cc, CS_OP_FOR);
+        in->loop = (uint8_t)loop;
+        in->name = (int16_t)name;
+        in->b = first;
+        in->c = node->data.for_stmt.word_count;
+        cs_compile_or_zero(cc, node->data.for_stmt.body);
+        cs_emit(cc, CS_OP_JUMP)->a = head;
+        cc->code[head].a = cc->code_len;
+        cs_emit(cc, CS_OP_STATUS)->a = 0;
+        cc->loop_depth--;
+        break;
+    }
+    case NODE_FUNCTION_DEF: {
+        /* DEFUN entry; JUMP over; entry: body END */
+        int def = cc->code_len;
+        cs_emit(cc, CS_OP_DEFUN)->node = node;
+        int skip = cc->code_len;
+        cs_emit(cc, CS_OP_JUMP);
+        cc->code[def].a = cc->code_len;
+        int saved_depth = cc->loop_depth;
+        cc->loop_depth = 0;    /* each call runs with its own counters */
+        cs_compile_or_zero(cc, node->data.function_def.body);
+        cs_emit(cc, CS_OP_END);
+        cc->loop_depth = saved_depth;
+        cc->code[skip].a = cc->code_len;
+        cs_emit(cc, CS_OP_STATUS)->a = 0;
+        break;
+    }
+    case NODE_SEQUENCE:
+        if (node->data.sequence.count == 0) {
+            cs_emit(cc, CS_OP_STATUS)->a = 0;
+        }
+        for (int i = 0; i < node->data.sequence.count; i++) {
+            int start = cc->code_len;
+            cs_compile_or_zero(cc, node->data.sequence.statements[i]);
+            if (start < cc->code_len) cc->code[start].stmt = 1;
+        }
+        break;
+    case NODE_RETURN:
+        cs_emit(cc, CS_OP_RETURN)->a = node->data.return_stmt.exit_code;
+        break;
+    }
+}
+
+/* Compile ast into prog; on failure prog->code stays NULL. */
+static void cs_compile(cs_program_t *prog) {
+    cs_compiler_t *cc = kmalloc(sizeof(cs_compiler_t));
+    if (!cc) return;
+    cc->code_len = 0;
+    cc->word_count = 0;
+    cc->seg_count = 0;
+    cc->name_count = 0;
+    cc->text_len = 0;
+    cc->loop_depth = 0;
+    cc->failed = 0;
+
+    cs_compile_or_zero(cc, prog->ast);
+    cs_emit(cc, CS_OP_END);
+    if (cc->failed) {
+        KWARN("CupidScript: %s over bytecode limits, interpreting the AST",
+              prog->path);
+        kfree(cc);
+        return;
+    }
+
+    uint32_t code_sz = (uint32_t)cc->code_len * sizeof(cs_insn_t);
+    uint32_t words_sz = (uint32_t)cc->word_count * sizeof(cs_word_t);
+    uint32_t segs_sz = (uint32_t)cc->seg_count * sizeof(cs_seg_t);
+    uint32_t names_sz = (uint32_t)cc->name_count * MAX_VAR_NAME;
+    uint32_t total = code_sz + words_sz + segs_sz + names_sz +
+                     (uint32_t)cc->name_count + (uint32_t)cc->text_len;
+    uint8_t *blob = kmalloc(total);
+    if (!blob) {
+        kfree(cc);
+        return;
+    }
+    uint8_t *p = blob;
+    prog->code = (cs_insn_t *)(void *)p;
+    memcpy(p, cc->code, code_sz);
+    p += code_sz;
+    prog->segs = (cs_seg_t *)(void *)p;
+    memcpy(p, cc->segs, segs_sz);
+    p += segs_sz;
+    prog->words = (cs_word_t *)(void *)p;
+    memcpy(p, cc->words, words_sz);
+    p += words_sz;
+    prog->names = (char (*)[MAX_VAR_NAME])(void *)p;
+    memcpy(p, cc->names, names_sz);
+    p += names_sz;
+    prog->special = p;
+    memcpy(p, cc->special, (size_t)cc->name_count);
+    p += cc->name_count;
+    prog->text = (char *)p;
+    memcpy(p, cc->text, (size_t)cc->text_len);
+    prog->code_len = cc->code_len;
+    prog->name_count = cc->name_count;
+
+    KDEBUG("CupidScript: compiled %s: %d insns, %d words, %d names",
+           prog->path, cc->code_len, cc->word_count, cc->name_count);
+    kfree(cc);
+}
+
+static void cs_int_append(int val, char *out, int *pos) {
+    char tmp[12];
+    int n = 0;
+    uint32_t v = val < 0 ? (uint32_t)0 - (uint32_t)val : (uint32_t)val;
+    do {
+        tmp[n++] = (char)('0' + v % 10);
+        v /= 10;
+    } while (v > 0);
+    if (val < 0) tmp[n++] = '-';
+    while (n > 0 && *pos < MAX_EXPAND_LEN - 1) out[(*pos)++] = tmp[--n];
+}
+
+/* Integer prefix of s, like the interpreter's parse_int */
+static int cs_str_int(const char *s) {
+    int v = 0;
+    int neg = 0;
+    if (*s == '-') { neg = 1; s++; }
+    while (*s >= '0' && *s <= '9') v = v * 10 + (*s++ - '0');
+    return neg ? -v : v;
+}
+
+static int cs_operand_value(script_context_t *ctx, const cs_operand_t *o) {
+    int v = o->value;
+    if (o->name >= 0) v = cs_str_int(cs_get_var_id(ctx, o->name));
+    return o->neg ? -v : v;
+}
+
+static int cs_arith_value(script_context_t *ctx, const cs_seg_t *s) {
+    int val = cs_operand_value(ctx, &s->lhs);
+    if (s->op) {
+        int val2 = cs_operand_value(ctx, &s->rhs);
+        switch (s->op) {
+        case '+': val = val + val2; break;
+        case '-': val = val - val2; break;
+        case '*': val = val * val2; break;
+        case '/': if (val2 != 0) val = val / val2; break;
+        case '%': if (val2 != 0) val = val % val2; break;
+        default: break;
+        }
+    }
+    return val;
+}
+
+static void cs_append(const char *s, char *out, int *pos) {
+    while (*s && *pos < MAX_EXPAND_LEN - 1) out[(*pos)++] = *s++;
+}
+
+void cs_expand_word(script_context_t *ctx, int word, char *out) {
+    const cs_program_t *prog = ctx->program;
+    const cs_word_t *w = &prog->words[word];
+    int pos = 0;
+
+    for (int i = 0; i < w->count; i++) {
+        const cs_seg_t *s = &prog->segs[w->seg + i];
+        switch (s->kind) {
+        case CS_SEG_TEXT:
+            cs_append(prog->text + s->text, out, &pos);
+            break;
+        case CS_SEG_VAR:
+            cs_append(cs_get_var_id(ctx, s->name), out, &pos);
+            break;
+        case CS_SEG_ARITH:
+            cs_int_append(cs_arith_value(ctx, s), out, &pos);
+            break;
+        case CS_SEG_BRACE:
+        case CS_SEG_EXPAND: {
+            char *r = s->kind == CS_SEG_BRACE
+                ? cs_expand_advanced_var(prog->text + s->text, ctx)
+                : cupidscript_expand(prog->text + s->text, ctx);
+            if (r) {
+                cs_append(r, out, &pos);
+                kfree(r);
+            }
+            break;
+        }
+        default:
+            break;
+        }
+    }
+    out[pos] = '\0';
+}
+
+int cs_word_int(script_context_t *ctx, int word) {
+    const cs_program_t *prog = ctx->program;
+    const cs_word_t *w = &prog->words[word];
+    if (w->count == 1) {
+        const cs_seg_t *s = &prog->segs[w->seg];
+        if (s->kind == CS_SEG_TEXT) return cs_str_int(prog->text + s->text);
+        if (s->kind == CS_SEG_VAR) return cs_str_int(cs_get_var_id(ctx, s->name));
+        if (s->kind == CS_SEG_ARITH) return cs_arith_value(ctx, s);
+    }
+    char buf[MAX_EXPAND_LEN];
+    cs_expand_word(ctx, word, buf);
+    return cs_str_int(buf);
+}
+
+cs_test_op_t cs_test_op(const char *op) {
+    if (strcmp(op, "-eq") == 0) return CS_TEST_EQ;
+    if (strcmp(op, "-ne") == 0) return CS_TEST_NE;
+    if (strcmp(op, "-lt") == 0) return CS_TEST_LT;
+    if (strcmp(op, "-gt") == 0) return CS_TEST_GT;
+    if (strcmp(op, "-le") == 0) return CS_TEST_LE;
+    if (strcmp(op, "-ge") == 0) return CS_TEST_GE;
+    if (strcmp(op, "=") == 0) return CS_TEST_STR_EQ;
+    if (strcmp(op, "!=") == 0) return CS_TEST_STR_NE;
+    return CS_TEST_UNKNOWN;
+}
+
+/* Program cache */
+
+static cs_program_t *cs_cache[CS_CACHE_SLOTS];
+static uint32_t cs_cache_clock;
+
+static uint32_t cs_source_hash(const char *source, uint32_t length) {
+    uint32_t h = 2166136261u;
+    for (uint32_t i = 0; i < length; i++) {
+        h ^= (uint8_t)source[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static void cs_program_free(cs_program_t *prog) {
+    cupidscript_free_ast(prog->ast);
+    if (prog->code) kfree(prog->code);
+    kfree(prog);
+}
+
+/* Keep prog for later runs, evicting the least recently used idle
+ * program if every slot is taken.  Called with the BKL held.*/
+static void cs_cache_insert(cs_program_t *prog) {
+    int victim = -1;
+    for (int i = 0; i < CS_CACHE_SLOTS; i++) {
+        cs_program_t *c = cs_cache[i];
+        if (!c) {
+            victim = i;
+            break;
+        }
+        if (strcmp(c->path, prog->path) == 0) {
+            if (c->refs > 0) return;    /* in use; keep it until idle */
+            victim = i;
+            break;
+        }
+        if (c->refs == 0 &&
+            (victim < 0 || c->last_use < cs_cache[victim]->last_use)) {
+            victim = i;
+        }
+    }
+    if (victim < 0) return;
+    if (cs_cache[victim]) cs_program_free(cs_cache[victim]);
+    cs_cache[victim] = prog;
+    prog->cached = true;
+}
+
+int cs_program_get(const char *path, const char *source, uint32_t length,
+                   cs_program_t **out) {
+    uint32_t hash = cs_source_hash(source, length);
+    bool cacheable = path && strlen(path) < sizeof(cs_cache[0]->path);
+
+    if (cacheable) {
+        bkl_lock();
+        for (int i = 0; i < CS_CACHE_SLOTS; i++) {
+            cs_program_t *c = cs_cache[i];
+            if (c && c->size == length && c->hash == hash &&
+                strcmp(c->path, path) == 0) {
+                c->refs++;
+                c->last_use = ++cs_cache_clock;
+                bkl_unlock();
+                KDEBUG("CupidScript: %s unchanged, reusing bytecode", path);
+                *out = c;
+                return 0;
+            }
+        }
+        bkl_unlock();
+    }
+
+    token_t *tokens = kmalloc(MAX_TOKENS * sizeof(token_t));
+    if (!tokens) return -1;
+    int token_count = cupidscript_tokenize(source, length, tokens, MAX_TOKENS);
+    ast_node_t *ast = cupidscript_parse(tokens, token_count);
+    kfree(tokens);
+    if (!ast) return -2;
+
+    cs_program_t *prog = kmalloc(sizeof(cs_program_t));
+    if (!prog) {
+        cupidscript_free_ast(ast);
+        return -1;
+    }
+    memset(prog, 0, sizeof(cs_program_t));
+    prog->ast = ast;
+    prog->size = length;
+    prog->hash = hash;
+    prog->refs = 1;
+    if (cacheable) {
+        memcpy(prog->path, path, strlen(path) + 1);
+    }
+    cs_compile(prog);
+
+    if (cacheable) {
+        bkl_lock();
+        prog->last_use = ++cs_cache_clock;
+        cs_cache_insert(prog);
+        bkl_unlock();
+    }
+    *out = prog;
+    return 0;
+}
+
+void cs_program_put(cs_program_t *prog) {
+    bkl_lock();
+    prog->refs--;
+    bool release = !prog->cached && prog->refs == 0;
+    bkl_unlock();
+    if (release) cs_program_free(prog);
+}
@@ -2,7 +2,9 @@
  * cupidscript_exec.c - Interpreter/executor for CupidScript
  *
  * Walks the AST and executes nodes: commands, assignments,
- * conditionals, loops, functions, and test expressions.
+ * conditionals, loops, functions, and test expressions.  Compiled
+ * scripts run on cs_vm_run instead, which shares the command, pipeline
+ * and test code with the tree walker.
  * Also contains the top-level cupidscript_run_file() entry point.
 */
 #include "cupidscript.h"
@@ -22,19 +24,22 @@
 #include "serial.h"
 #include "rtc.h"
 #include "calendar.h"
+#include "timer.h"
+#include "bkl.h"
 
 static void (*cs_print)(const char *) = NULL;
 static void (*cs_putchar)(char) = NULL;
 static void (*cs_print_int)(uint32_t) = NULL;
 
-/* Active command-output redirection target (for built-ins/functions). */
-static script_context_t *cs_active_ctx = NULL;
-static int cs_active_stdout_fd = CS_STDOUT;
+/* Stack for a pipeline stage thread: a stage runs the interpreter
+ * recursively, like the script's own thread.*/
+#define CS_STAGE_STACK_SIZE (64u * 1024u)
 
 typedef struct {
     int stdout_fd;
     int stderr_fd;
     int stdin_fd;
+    bool stdin_inherited;   /* stdin_fd is the enclosing function's */
     bool background;
 } cs_exec_opts_t;
 
@@ -42,9 +47,16 @@ static void cs_exec_opts_default(cs_exec_opts_t *opts) {
     opts->stdout_fd = CS_STDOUT;
     opts->stderr_fd = CS_STDERR;
     opts->stdin_fd = CS_STDIN;
+    opts->stdin_inherited = false;
     opts->background = false;
 }
 
+static bool cs_use_bytecode = true;
+
+void cupidscript_set_bytecode(bool enabled) {
+    cs_use_bytecode = enabled;
+}
+
 void cupidscript_set_output(void (*print_fn)(const char *),
                             void (*putchar_fn)(char),
                             void (*print_int_fn)(uint32_t)) {
@@ -53,15 +65,28 @@ void cupidscript_set_output(void (*print_fn)(const char *),
     cs_print_int = print_int_fn;
 }
 
-/* Use context's output or fall back to globals */
+/* stdout's pipe has no reader (FD_EPIPE), or a pipe wait could not
+ * end (FD_EDEADLK): stop the stage the way SIGPIPE would, unwinding
+ * loops and functions through return_flag.  A deadlock exits 1.*/
+static void cs_pipe_broken(script_context_t *ctx, int err) {
+    ctx->pipe_broken = 1;
+    ctx->return_flag = 1;
+    ctx->return_value = (err == FD_EDEADLK) ? 1 : 141;
+}
+
+/* Use the command's stdout, else context's output, else globals */
 static void cs_out(script_context_t *ctx, const char *s) {
-    if (cs_active_ctx && s) {
+    if (ctx->active_stdout_fd >= 0 && s) {
         int len = 0;
         while (s[len]) len++;
         if (len > 0) {
-            int w = fd_write(&cs_active_ctx->fd_table, cs_active_stdout_fd,
+            int w = fd_write(&ctx->fd_table, ctx->active_stdout_fd,
                              s, (size_t)len);
             if (w >= 0) return;
+            if (w == FD_EPIPE || w == FD_EDEADLK) {
+                cs_pipe_broken(ctx, w);
+                return;
+            }
         }
     }
     if (ctx->print_fn) ctx->print_fn(s);
@@ -70,9 +95,13 @@ static void cs_out(script_context_t *ctx, const char *s) {
 }
 
 static void cs_outchar(script_context_t *ctx, char c) {
-    if (cs_active_ctx) {
-        int w = fd_write(&cs_active_ctx->fd_table, cs_active_stdout_fd, &c, 1);
+    if (ctx->active_stdout_fd >= 0) {
+        int w = fd_write(&ctx->fd_table, ctx->active_stdout_fd, &c, 1);
         if (w >= 0) return;
+        if (w == FD_EPIPE || w == FD_EDEADLK) {
+            cs_pipe_broken(ctx, w);
+            return;
+        }
     }
     if (ctx->putchar_fn) ctx->putchar_fn(c);
     else if (cs_putchar) cs_putchar(c);
@@ -100,28 +129,15 @@ static int parse_int(const char *s) {
 }
 
 static int execute_node(ast_node_t *node, script_context_t *ctx);
+static int cs_vm_run(script_context_t *ctx, int pc);
 
 /* Test expression evaluator
- * Evaluates [ arg1 op arg2 ] style test expressions.
+ * Evaluates [ arg1 op arg2 ] style test expressions over expanded
+ * arguments; op is the binary operator if the compiler resolved it.
  * Returns 0 for true (success), 1 for false (failure).
 */
-static int evaluate_test(ast_node_t *node, script_context_t *ctx) {
-    if (!node || node->type != NODE_TEST) return 1;
-
-    int argc = node->data.test.argc;
-
-    /* Expand variables in all arguments */
-    char expanded[MAX_ARGS][MAX_EXPAND_LEN];
-    for (int i = 0; i < argc && i < MAX_ARGS; i++) {
-        char *exp = cupidscript_expand(node->data.test.argv[i], ctx);
-        if (exp) {
-            str_cpy(expanded[i], exp, MAX_EXPAND_LEN);
-            kfree(exp);
-        } else {
-            str_cpy(expanded[i], node->data.test.argv[i], MAX_EXPAND_LEN);
-        }
-    }
-
+static int cs_test_args(int argc, char expanded[MAX_ARGS][MAX_EXPAND_LEN],
+                        cs_test_op_t op) {
     /* Unary tests */
     if (argc == 2) {
         /* -z string (true if zero length) */
@@ -137,38 +153,24 @@ static int evaluate_test(ast_node_t *node, script_context_t *ctx) {
     /* Binary tests: arg1 op arg2 */
     if (argc == 3) {
         const char *lhs = expanded[0];
-        const char *op  = expanded[1];
         const char *rhs = expanded[2];
+        if (op == CS_TEST_DYNAMIC) op = cs_test_op(expanded[1]);
 
+        switch (op) {
         /* Numeric comparisons */
-        if (strcmp(op, "-eq") == 0) {
-            return (parse_int(lhs) == parse_int(rhs)) ? 0 : 1;
-        }
-        if (strcmp(op, "-ne") == 0) {
-            return (parse_int(lhs) != parse_int(rhs)) ? 0 : 1;
-        }
-        if (strcmp(op, "-lt") == 0) {
-            return (parse_int(lhs) < parse_int(rhs)) ? 0 : 1;
-        }
-        if (strcmp(op, "-gt") == 0) {
-            return (parse_int(lhs) > parse_int(rhs)) ? 0 : 1;
-        }
-        if (strcmp(op, "-le") == 0) {
-            return (parse_int(lhs) <= parse_int(rhs)) ? 0 : 1;
-        }
-        if (strcmp(op, "-ge") == 0) {
-            return (parse_int(lhs) >= parse_int(rhs)) ? 0 : 1;
-        }
-
+        case CS_TEST_EQ: return (parse_int(lhs) == parse_int(rhs)) ? 0 : 1;
+        case CS_TEST_NE: return (parse_int(lhs) != parse_int(rhs)) ? 0 : 1;
+        case CS_TEST_LT: return (parse_int(lhs) <  parse_int(rhs)) ? 0 : 1;
+        case CS_TEST_GT: return (parse_int(lhs) >  parse_int(rhs)) ? 0 : 1;
+        case CS_TEST_LE: return (parse_int(lhs) <= parse_int(rhs)) ? 0 : 1;
+        case CS_TEST_GE: return (parse_int(lhs) >= parse_int(rhs)) ? 0 : 1;
         /* String comparisons */
-        if (strcmp(op, "=") == 0) {
-            return (strcmp(lhs, rhs) == 0) ? 0 : 1;
-        }
-        if (strcmp(op, "!=") == 0) {
-            return (strcmp(lhs, rhs) != 0) ? 0 : 1;
+        case CS_TEST_STR_EQ: return (strcmp(lhs, rhs) == 0) ? 0 : 1;
+        case CS_TEST_STR_NE: return (strcmp(lhs, rhs) != 0) ? 0 : 1;
+        default: break;
         }
 
-        KERROR("CupidScript: unknown test operator '%s'", op);
+        KERROR("CupidScript: unknown test operator '%s'", expanded[1]);
         return 1;
     }
 
@@ -180,6 +182,26 @@ static int evaluate_test(ast_node_t *node, script_context_t *ctx) {
     return 1; /* default: false */
 }
 
+static int evaluate_test(ast_node_t *node, script_context_t *ctx) {
+    if (!node || node->type != NODE_TEST) return 1;
+
+    int argc = node->data.test.argc;
+
+    /* Expand variables in all arguments */
+    char expanded[MAX_ARGS][MAX_EXPAND_LEN];
+    for (int i = 0; i < argc && i < MAX_ARGS; i++) {
+        char *exp = cupidscript_expand(node->data.test.argv[i], ctx);
+        if (exp) {
+            str_cpy(expanded[i], exp, MAX_EXPAND_LEN);
+            kfree(exp);
+        } else {
+            str_cpy(expanded[i], node->data.test.argv[i], MAX_EXPAND_LEN);
+        }
+    }
+
+    return cs_test_args(argc, expanded, CS_TEST_DYNAMIC);
+}
+
 /* Built-in command: echo
  * Handles echo specially so we can do $VAR expansion in arguments.
 */
@@ -392,6 +414,227 @@ static int builtin_date(int argc, char expanded[MAX_ARGS][MAX_EXPAND_LEN],
     return 0;
 }
 
+/* Write len bytes to the command's stdout; -1 once its pipe is broken */
+static int cs_write(script_context_t *ctx, const char *buf, int len) {
+    char chunk[129];
+    while (len > 0 && !ctx->pipe_broken) {
+        int n = len < 128 ? len : 128;
+        memcpy(chunk, buf, (size_t)n);
+        chunk[n] = '\0';
+        cs_out(ctx, chunk);
+        buf += n;
+        len -= n;
+    }
+    return ctx->pipe_broken ? -1 : 0;
+}
+
+/* Next byte of the command's stdin, or -1 at EOF.  Pipes and files
+ * are read in chunks through ctx->in_buf, which carries over between
+ * commands reading the same pipe (`while read line`); whoever closes
+ * a file stdin drops it.  The terminal is read a byte at a time.*/
+static int cs_in_getc(script_context_t *ctx) {
+    int fd = ctx->active_stdin_fd >= 0 ? ctx->active_stdin_fd : CS_STDIN;
+    if (fd >= MAX_FDS) return -1;
+    const file_descriptor_t *f = &ctx->fd_table.fds[fd];
+    const void *src = (f->type == FD_PIPE) ? (const void *)f->pipe.pipe
+                                           : (const void *)f;
+    if (src != ctx->in_src) {
+        ctx->in_src = src;
+        ctx->in_pos = 0;
+        ctx->in_len = 0;
+    }
+    if (ctx->in_pos >= ctx->in_len) {
+        bool chunked = (f->type == FD_PIPE || f->type == FD_FILE);
+        size_t want = chunked ? sizeof(ctx->in_buf) : 1;
+        int n = fd_read(&ctx->fd_table, fd, ctx->in_buf, want);
+        if (n == FD_EDEADLK) cs_pipe_broken(ctx, n);
+        if (n <= 0) return -1;
+        ctx->in_pos = 0;
+        ctx->in_len = n;
+    }
+    return (unsigned char)ctx->in_buf[ctx->in_pos++];
+}
+
+/* Read one line of stdin without its newline.  Returns its length,
+ * or -1 at EOF.*/
+static int cs_read_line(script_context_t *ctx, char *line, int max) {
+    int len = 0;
+    int c;
+    while ((c = cs_in_getc(ctx)) >= 0) {
+        if (c == '\n') {
+            line[len] = '\0';
+            return len;
+        }
+        if (c == '\r') continue;
+        if (len < max - 1) line[len++] = (char)c;
+    }
+    line[len] = '\0';
+    return len > 0 ? len : -1;
+}
+
+/* Built-in: read [name] - one line of stdin into name (default REPLY).
+ * Returns 1 at end of input, so `while read line` ends with it.*/
+static int builtin_read(int argc, char expanded[MAX_ARGS][MAX_EXPAND_LEN],
+                        script_context_t *ctx) {
+    const char *name = (argc >= 2) ? expanded[1] : "REPLY";
+    char line[MAX_VAR_VALUE];
+    int n = cs_read_line(ctx, line, MAX_VAR_VALUE);
+    cupidscript_set_variable(ctx, name, n >= 0 ? line : "");
+    return n >= 0 ? 0 : 1;
+}
+
+/* cat, grep and head have /bin programs, but those take files only and
+ * print to the terminal.  Inside a pipeline (or with stdin redirected)
+ * they run as these streaming built-ins instead, so a stage reads as
+ * its input arrives and stops its upstream once it has enough.*/
+static bool cs_is_filter(const char *cmd) {
+    return strcmp(cmd, "cat") == 0 || strcmp(cmd, "grep") == 0 ||
+           strcmp(cmd, "head") == 0;
+}
+
+static bool cs_streams_piped(script_context_t *ctx, const cs_exec_opts_t *opts) {
+    return opts->stdin_fd != CS_STDIN ||
+           fd_get_pipe(&ctx->fd_table, opts->stdout_fd) != NULL;
+}
+
+/* Point the command's stdin at a file for the duration of a filter */
+static int cs_filter_open(script_context_t *ctx, const char *cmd,
+                          const char *path, int *saved_stdin) {
+    char full[VFS_MAX_PATH];
+    shell_resolve_path(path, full);
+    int fd = fd_open_file(&ctx->fd_table, full, O_RDONLY);
+    if (fd < 0) {
+        void (*out)(const char *) = ctx->print_fn ? ctx->print_fn : print;
+        out(cmd);
+        out(": cannot open ");
+        out(path);
+        out("\n");
+        return -1;
+    }
+    *saved_stdin = ctx->active_stdin_fd;
+    ctx->active_stdin_fd = fd;
+    ctx->in_src = NULL;
+    return fd;
+}
+
+static void cs_filter_close(script_context_t *ctx, int fd, int saved_stdin) {
+    fd_close(&ctx->fd_table, fd);
+    ctx->active_stdin_fd = saved_stdin;
+    ctx->in_src = NULL;
+}
+
+/* Copy stdin to stdout a line (or 256 bytes) at a time */
+static int cs_cat_stream(script_context_t *ctx) {
+    char buf[256];
+    int n = 0;
+    int c;
+    while ((c = cs_in_getc(ctx)) >= 0) {
+        buf[n++] = (char)c;
+        if (n == (int)sizeof(buf) || c == '\n') {
+            if (cs_write(ctx, buf, n) < 0) return 141;
+            n = 0;
+        }
+    }
+    if (n > 0 && cs_write(ctx, buf, n) < 0) return 141;
+    return 0;
+}
+
+/* Built-in (pipelines): cat [file...] */
+static int builtin_cat(int argc, char expanded[MAX_ARGS][MAX_EXPAND_LEN],
+                       script_context_t *ctx) {
+    if (argc < 2) return cs_cat_stream(ctx);
+
+    int result = 0;
+    for (int i = 1; i < argc && result != 141; i++) {
+        int saved;
+        int fd = cs_filter_open(ctx, "cat", expanded[i], &saved);
+        if (fd < 0) {
+            result = 1;
+            continue;
+        }
+        int r = cs_cat_stream(ctx);
+        cs_filter_close(ctx, fd, saved);
+        if (r != 0) result = r;
+    }
+    return result;
+}
+
+/* Built-in (pipelines): grep [-v] <pattern> [file] */
+static int builtin_grep(int argc, char expanded[MAX_ARGS][MAX_EXPAND_LEN],
+                        script_context_t *ctx) {
+    int arg = 1;
+    bool invert = false;
+    if (arg < argc && strcmp(expanded[arg], "-v") == 0) {
+        invert = true;
+        arg++;
+    }
+    if (arg >= argc) {
+        cs_out(ctx, "Usage: grep [-v] <pattern> [file]\n");
+        return 2;
+    }
+    const char *pattern = expanded[arg++];
+
+    int saved = -1;
+    int fd = -1;
+    if (arg < argc) {
+        fd = cs_filter_open(ctx, "grep", expanded[arg], &saved);
+        if (fd < 0) return 2;
+    }
+
+    char line[MAX_VAR_VALUE + 1];
+    int result = 1;
+    int len;
+    while ((len = cs_read_line(ctx, line, MAX_VAR_VALUE)) >= 0) {
+        if ((strstr(line, pattern) != NULL) == invert) continue;
+        line[len] = '\n';
+        if (cs_write(ctx, line, len + 1) < 0) {
+            result = 141;
+            break;
+        }
+        result = 0;
+    }
+
+    if (fd >= 0) cs_filter_close(ctx, fd, saved);
+    return result;
+}
+
+/* Built-in (pipelines): head [-n N | -N] [file] */
+static int builtin_head(int argc, char expanded[MAX_ARGS][MAX_EXPAND_LEN],
+                        script_context_t *ctx) {
+    int arg = 1;
+    int count = 10;
+    if (arg + 1 < argc && strcmp(expanded[arg], "-n") == 0) {
+        count = parse_int(expanded[arg + 1]);
+        arg += 2;
+    } else if (arg < argc && expanded[arg][0] == '-') {
+        count = parse_int(expanded[arg] + 1);
+        arg++;
+    }
+
+    int saved = -1;
+    int fd = -1;
+    if (arg < argc) {
+        fd = cs_filter_open(ctx, "head", expanded[arg], &saved);
+        if (fd < 0) return 1;
+    }
+
+    char line[MAX_VAR_VALUE + 1];
+    int result = 0;
+    int len;
+    for (int i = 0; i < count; i++) {
+        len = cs_read_line(ctx, line, MAX_VAR_VALUE);
+        if (len < 0) break;
+        line[len] = '\n';
+        if (cs_write(ctx, line, len + 1) < 0) {
+            result = 141;
+            break;
+        }
+    }
+
+    if (fd >= 0) cs_filter_close(ctx, fd, saved);
+    return result;
+}
+
 static int cs_build_cmdline(char out[256], int argc,
                             char expanded[MAX_ARGS][MAX_EXPAND_LEN]) {
     int pos = 0;
@@ -648,11 +891,125 @@ static void cs_apply_command_redirections(ast_node_t *node,
     }
 }
 
+/* External commands write through the shell's output path; a stage
+ * whose stdout is a pipe routes its process's output into the pipe.
+ * Output after the reader is gone is dropped.*/
+typedef struct {
+    script_context_t *ctx;
+    int fd;
+} cs_pipe_sink_t;
+
+static void cs_pipe_sink(const char *buf, uint32_t len, void *arg) {
+    cs_pipe_sink_t *sink = (cs_pipe_sink_t *)arg;
+    if (sink->ctx->pipe_broken || len == 0) return;
+    int w = fd_write(&sink->ctx->fd_table, sink->fd, buf, len);
+    if (w == FD_EPIPE || w == FD_EDEADLK) {
+        cs_pipe_broken(sink->ctx, w);
+    }
+}
+
+/* CupidC and CupidASM programs run at fixed JIT addresses, so external
+ * commands take turns: concurrent pipeline stages wait here.  The turn
+ * is reentrant, and a stage shares it with the thread that started
+ * its pipeline (ext_inherit) when that thread holds it, as a script
+ * started by an external command does; that thread is blocked on the
+ * pipeline meanwhile.  A holder blocked on a pipe hands the turn back
+ * until it can go on, unless it runs a JIT program (cs_pipe_wait).
+ * Returns the owner to restore on unlock.*/
+static uint32_t cs_external_owner;
+/* Processes waiting in cs_external_lock or to retake a handed-back turn */
+static uint32_t cs_external_waiters;
+
+/* A JIT program that keeps the turn on a pipe stalled this long while
+ * another command waits for the turn is taken to be deadlocked.*/
+#define CS_PIPE_DEADLOCK_MS 2000u
+
+static uint32_t cs_external_lock(script_context_t *ctx) {
+    uint32_t pid = process_get_current_pid();
+    bool waiting = false;
+    for (;;) {
+        bkl_lock();
+        uint32_t owner = cs_external_owner;
+        if (owner == 0 || owner == pid ||
+            (ctx->ext_inherit != 0 && owner == ctx->ext_inherit)) {
+            cs_external_owner = pid;
+            if (waiting) cs_external_waiters--;
+            bkl_unlock();
+            return owner;
+        }
+        if (!waiting) {
+            cs_external_waiters++;
+            waiting = true;
+        }
+        bkl_unlock();
+        process_yield();
+    }
+}
+
+static void cs_external_unlock(uint32_t prev_owner) {
+    bkl_lock();
+    cs_external_owner = prev_owner;
+    bkl_unlock();
+}
+
+/* In gen | f, where f runs an external between reads, gen's external
+ * would fill the pipe while holding the turn that f waits for.  So the
+ * turn is released while its holder waits on a pipe, and retaken before
+ * the holder returns to its command.
+ *
+ * Not by a JIT program, though: one started meanwhile would block it
+ * (shell_jit_program_start) until that one exits, and if the two share
+ * a pipe each waits for the other.  A JIT program keeps the turn, and
+ * when its pipe stalls while another command waits for the turn, the
+ * wait fails rather than hang.  It also fails without a current
+ * process: process_yield() returns at once and no other stage runs.*/
+bool cs_pipe_wait(uint32_t since_ms) {
+    uint32_t pid = process_get_current_pid();
+    if (pid == 0) {
+        KERROR("CupidScript: pipe wait outside a process");
+        return false;
+    }
+
+    bkl_lock();
+    bool held = (cs_external_owner == pid);
+    bool keep = held && shell_jit_program_owned_by(pid);
+    if (keep && cs_external_waiters != 0 &&
+        timer_get_uptime_ms() - since_ms >= CS_PIPE_DEADLOCK_MS) {
+        bkl_unlock();
+        KERROR("CupidScript: pipeline deadlock: %s waits on a pipe "
+               "another program must serve", shell_jit_program_get_name());
+        return false;
+    }
+    bool handed_back = held && !keep;
+    if (handed_back) {
+        cs_external_owner = 0;
+        cs_external_waiters++;
+    }
+    bkl_unlock();
+
+    process_yield();
+
+    while (handed_back) {
+        bkl_lock();
+        if (cs_external_owner == 0 || cs_external_owner == pid) {
+            cs_external_owner = pid;
+            cs_external_waiters--;
+            bkl_unlock();
+            break;
+        }
+        bkl_unlock();
+        process_yield();
+    }
+    return true;
+}
+
 /* Execute a command node
  * Expands variables, checks for functions, then dispatches.
 */
+/* word: first of the command's compiled templates, or -1 to expand
+ * its argv text */
 static int execute_command_internal(ast_node_t *node, script_context_t *ctx,
-                                    cs_exec_opts_t *base_opts) {
+                                    cs_exec_opts_t *base_opts, int word) {
     if (!node || node->type != NODE_COMMAND) return 1;
     if (node->data.command.argc == 0) return 0;
 
@@ -670,6 +1027,10 @@ static int execute_command_internal(ast_node_t *node, script_context_t *ctx,
     int argc = node->data.command.argc;
 
     for (int i = 0; i < argc && i < MAX_ARGS; i++) {
+        if (word >= 0) {
+            cs_expand_word(ctx, word + i, expanded[i]);
+            continue;
+        }
         char *exp = cupidscript_expand(node->data.command.argv[i], ctx);
         if (exp) {
             str_cpy(expanded[i], exp, MAX_EXPAND_LEN);
@@ -679,13 +1040,22 @@ static int execute_command_internal(ast_node_t *node, script_context_t *ctx,
         }
     }
 
-    if (opts.stdin_fd != CS_STDIN && argc < MAX_ARGS) {
+    /* Commands that cannot read a stream get (the start of) their stdin
+     * as one more argument; read, the filters and functions read it. */
+    bool reads_stdin = strcmp(expanded[0], "read") == 0 ||
+                       (cs_is_filter(expanded[0]) &&
+                        cs_streams_piped(ctx, &opts)) ||
+                       cupidscript_lookup_function(ctx, expanded[0]) != NULL;
+    if (opts.stdin_fd != CS_STDIN && argc < MAX_ARGS && !reads_stdin &&
+        !opts.stdin_inherited) {
         char *stdin_text = fd_get_buffer_contents(&ctx->fd_table, opts.stdin_fd);
         if (stdin_text && stdin_text[0]) {
             str_cpy(expanded[argc], stdin_text, MAX_EXPAND_LEN);
             argc++;
         }
         if (stdin_text) kfree(stdin_text);
+        /* Nothing reads the rest; let the writer stop instead of block. */
+        fd_shutdown_read(&ctx->fd_table, opts.stdin_fd);
     }
 
     const char *cmd = expanded[0];
@@ -700,10 +1070,10 @@ static int execute_command_internal(ast_node_t *node, script_context_t *ctx,
         goto done_no_active;
     }
 
-    script_context_t *saved_ctx = cs_active_ctx;
-    int saved_stdout_fd = cs_active_stdout_fd;
-    cs_active_ctx = ctx;
-    cs_active_stdout_fd = opts.stdout_fd;
+    int saved_stdin_fd = ctx->active_stdin_fd;
+    int saved_stdout_fd = ctx->active_stdout_fd;
+    ctx->active_stdin_fd = opts.stdin_fd;
+    ctx->active_stdout_fd = opts.stdout_fd;
 
     /* built-in commands */
     if (strcmp(cmd, "echo") == 0) {
@@ -734,11 +1104,21 @@ static int execute_command_internal(ast_node_t *node, script_context_t *ctx,
         result = builtin_date(argc, expanded, ctx);
         goto done;
     }
+    if (strcmp(cmd, "read") == 0) {
+        result = builtin_read(argc, expanded, ctx);
+        goto done;
+    }
+    if (cs_is_filter(cmd) && cs_streams_piped(ctx, &opts)) {
+        if (strcmp(cmd, "cat") == 0) result = builtin_cat(argc, expanded, ctx);
+        else if (strcmp(cmd, "grep") == 0) result = builtin_grep(argc, expanded, ctx);
+        else result = builtin_head(argc, expanded, ctx);
+        goto done;
+    }
 
     /* user-defined function */
     {
-        ast_node_t *func_body = cupidscript_lookup_function(ctx, cmd);
-        if (func_body) {
+        const cs_function_t *func = cs_find_function(ctx, cmd);
+        if (func) {
             char saved_args[MAX_SCRIPT_ARGS][MAX_VAR_VALUE];
             int saved_argc = ctx->script_argc;
             char saved_name[MAX_VAR_NAME];
@@ -754,7 +1134,11 @@ static int execute_command_internal(ast_node_t *node, script_context_t *ctx,
             }
 
             ctx->return_flag = 0;
-            result = execute_node(func_body, ctx);
+            if (func->entry >= 0 && ctx->program) {
+                result = cs_vm_run(ctx, func->entry);
+            } else {
+                result = execute_node(func->body, ctx);
+            }
             if (ctx->return_flag) {
                 result = ctx->return_value;
                 ctx->return_flag = 0;
@@ -765,6 +1149,8 @@ static int execute_command_internal(ast_node_t *node, script_context_t *ctx,
             for (int i = 0; i < saved_argc && i < MAX_SCRIPT_ARGS; i++) {
                 str_cpy(ctx->script_args[i], saved_args[i], MAX_VAR_VALUE);
             }
+            /* A broken pipe keeps unwinding through the callers. */
+            if (ctx->pipe_broken) ctx->return_flag = 1;
 
             ctx->last_exit_status = result;
             goto done;
@@ -822,78 +1208,201 @@ static int execute_command_internal(ast_node_t *node, script_context_t *ctx,
                 result = cs_spawn_shell_background(ctx, cmdline);
             }
         } else {
+            cs_pipe_sink_t sink;
+            uint32_t pid = process_get_current_pid();
+            uint32_t prev_owner = cs_external_lock(ctx);
+            sink.ctx = ctx;
+            sink.fd = opts.stdout_fd;
+            bool piped = fd_get_pipe(&ctx->fd_table, opts.stdout_fd) != NULL;
+            if (piped) shell_set_process_output_sink(pid, cs_pipe_sink, &sink);
             shell_execute_line(cmdline);
+            if (piped) shell_clear_process_output_sink(pid);
+            cs_external_unlock(prev_owner);
             result = 0;
         }
         ctx->last_exit_status = result;
     }
 
 done:
-    cs_active_ctx = saved_ctx;
-    cs_active_stdout_fd = saved_stdout_fd;
+    ctx->active_stdin_fd = saved_stdin_fd;
+    ctx->active_stdout_fd = saved_stdout_fd;
 done_no_active:
     for (int i = 0; i < opened_count; i++) {
         if (opened_fds[i] >= 0) {
             fd_close(&ctx->fd_table, opened_fds[i]);
+            ctx->in_src = NULL;
         }
     }
     return result;
 }
 
-static int execute_command(ast_node_t *node, script_context_t *ctx) {
+static int execute_command(ast_node_t *node, script_context_t *ctx, int word) {
     cs_exec_opts_t opts;
     cs_exec_opts_default(&opts);
-    return execute_command_internal(node, ctx, &opts);
+    /* Inside a function, commands use the function's streams. */
+    if (ctx->active_stdin_fd >= 0) {
+        opts.stdin_fd = ctx->active_stdin_fd;
+        opts.stdin_inherited = true;
+    }
+    if (ctx->active_stdout_fd >= 0) opts.stdout_fd = ctx->active_stdout_fd;
+    return execute_command_internal(node, ctx, &opts, word);
+}
+
+/* Pipeline stages
+ * Every stage but the last runs concurrently in its own thread, in a
+ * copy of the script context (a subshell: its assignments stay local),
+ * connected to the next by a bounded pipe.  The last stage runs in the
+ * caller's thread and context.  Memory stays at one ring per pipe and
+ * one context per stage however much flows through, the last stage
+ * sees the first line as soon as it is written, and a stage that
+ * finishes early closes its stdin, which stops the stages before it
+ * (see cs_pipe_broken).*/
+typedef struct {
+    ast_node_t       *cmd;
+    script_context_t *ctx;       /* the stage's own copy, freed by it */
+    int               stdin_fd;
+    int               stdout_fd;
+    uint32_t          done;
+} cs_stage_t;
+
+static void cs_stage_main(uint32_t arg) {
+    cs_stage_t *st = (cs_stage_t *)arg;
+    script_context_t *sub = st->ctx;
+
+    cs_exec_opts_t opts;
+    cs_exec_opts_default(&opts);
+    opts.stdin_fd = st->stdin_fd;
+    opts.stdout_fd = st->stdout_fd;
+    execute_command_internal(st->cmd, sub, &opts, -1);
+
+    for (int fd = 3; fd < MAX_FDS; fd++) {
+        if (sub->fd_table.fds[fd].type != FD_CLOSED) {
+            fd_close(&sub->fd_table, fd);
+        }
+    }
+    kfree(sub);
+    /* The caller frees st once it sees done; don't touch it after. */
+    __atomic_store_n(&st->done, 1u, __ATOMIC_RELEASE);
+}
+
+static bool cs_stage_start(cs_stage_t *st, script_context_t *ctx) {
+    script_context_t *sub = kmalloc(sizeof(script_context_t));
+    if (!sub) return false;
+    memcpy(sub, ctx, sizeof(script_context_t));
+    fd_table_fork(&sub->fd_table, &ctx->fd_table, st->stdin_fd, st->stdout_fd);
+    job_table_init(&sub->jobs);
+    sub->active_stdin_fd = -1;
+    sub->active_stdout_fd = -1;
+    sub->in_pos = 0;
+    sub->in_len = 0;
+    sub->in_src = NULL;
+    sub->return_flag = 0;
+    sub->pipe_broken = 0;
+    {
+        uint32_t self = process_get_current_pid();
+        bkl_lock();
+        sub->ext_inherit = (cs_external_owner == self) ? self : ctx->ext_inherit;
+        bkl_unlock();
+    }
+    st->ctx = sub;
+    st->done = 0;
+
+    void (*stage_main)(uint32_t) = cs_stage_main;
+    void (*entry)(void);
+    memcpy(&entry, &stage_main, sizeof(entry));
+    uint32_t pid = process_create_with_arg(entry, st->cmd->data.command.argv[0],
+                                           CS_STAGE_STACK_SIZE, (uint32_t)st);
+    if (pid == 0) {
+        for (int fd = 3; fd < MAX_FDS; fd++) {
+            if (sub->fd_table.fds[fd].type != FD_CLOSED) {
+                fd_close(&sub->fd_table, fd);
+            }
+        }
+        kfree(sub);
+        return false;
+    }
+    return true;
 }
 
 static int execute_pipeline(ast_node_t *node, script_context_t *ctx) {
     if (!node || node->type != NODE_PIPELINE) return 1;
-    if (node->data.pipeline.command_count <= 0) return 0;
+    int count = node->data.pipeline.command_count;
+    if (count <= 0) return 0;
+    for (int i = 0; i < count; i++) {
+        ast_node_t *cmd = node->data.pipeline.commands[i];
+        if (!cmd || cmd->type != NODE_COMMAND) return 1;
+    }
 
-    int prev_read_fd = CS_STDIN;
+    uint32_t start_ms = timer_get_uptime_ms();
+    cs_pipe_totals_t totals = { 0, 0 };
+    cs_stage_t stages[MAX_PIPELINE_CMDS];
+    int started = 0;
+    /* A pipeline in a function reads and writes the function's streams. */
+    int outer_in_fd = ctx->active_stdin_fd >= 0 ? ctx->active_stdin_fd : CS_STDIN;
+    int outer_out_fd = ctx->active_stdout_fd >= 0 ? ctx->active_stdout_fd : CS_STDOUT;
+    int prev_read_fd = outer_in_fd;
     int result = 0;
 
-    for (int i = 0; i < node->data.pipeline.command_count; i++) {
-        ast_node_t *cmd = node->data.pipeline.commands[i];
-        if (!cmd || cmd->type != NODE_COMMAND) {
+    for (int i = 0; i < count - 1; i++) {
+        int read_fd;
+        int write_fd;
+        if (fd_create_pipe(&ctx->fd_table, &read_fd, &write_fd) != 0) {
             result = 1;
             break;
         }
-
-        int next_read_fd = CS_STDIN;
-        int write_fd = CS_STDOUT;
-        bool is_last = (i == node->data.pipeline.command_count - 1);
-
-        if (!is_last) {
-            if (fd_create_pipe(&ctx->fd_table, &next_read_fd, &write_fd) != 0) {
-                result = 1;
-                break;
-            }
+        fd_get_pipe(&ctx->fd_table, read_fd)->totals = &totals;
+
+        cs_stage_t *st = &stages[started];
+        st->cmd = node->data.pipeline.commands[i];
+        st->stdin_fd = prev_read_fd;
+        st->stdout_fd = write_fd;
+        bool ok = cs_stage_start(st, ctx);
+
+        /* The stage holds its own references to both ends now. */
+        fd_close(&ctx->fd_table, write_fd);
+        if (prev_read_fd != outer_in_fd) fd_close(&ctx->fd_table, prev_read_fd);
+        prev_read_fd = read_fd;
+        if (!ok) {
+            result = 1;
+            break;
         }
+        started++;
+    }
 
+    uint32_t first_ms = 0;
+    if (result == 0) {
         cs_exec_opts_t opts;
         cs_exec_opts_default(&opts);
         opts.stdin_fd = prev_read_fd;
-        opts.stdout_fd = write_fd;
-        opts.background = is_last ? node->data.pipeline.background : false;
-
-        result = execute_command_internal(cmd, ctx, &opts);
-
-        if (prev_read_fd >= 3) {
-            fd_close(&ctx->fd_table, prev_read_fd);
-        }
-        if (write_fd >= 3) {
-            fd_close(&ctx->fd_table, write_fd);
+        opts.stdin_inherited = (prev_read_fd == outer_in_fd &&
+                                ctx->active_stdin_fd >= 0);
+        opts.stdout_fd = outer_out_fd;
+        opts.background = node->data.pipeline.background;
+        result = execute_command_internal(
+            node->data.pipeline.commands[count - 1], ctx, &opts, -1);
+
+        const cs_pipe_t *last = fd_get_pipe(&ctx->fd_table, prev_read_fd);
+        if (last && last->first_read_ms) {
+            first_ms = last->first_read_ms - start_ms;
         }
-
-        prev_read_fd = next_read_fd;
-        if (result != 0) break;
+    } else if (ctx->print_fn) {
+        ctx->print_fn("cupid: cannot start pipeline stage\n");
     }
 
-    if (prev_read_fd >= 3) {
+    /* Closing the last read end ends any stage still writing. */
+    if (prev_read_fd != outer_in_fd) {
         fd_close(&ctx->fd_table, prev_read_fd);
     }
+    for (int i = 0; i < started; i++) {
+        while (!__atomic_load_n(&stages[i].done, __ATOMIC_ACQUIRE)) {
+            process_yield();
+        }
+    }
 
+    ctx->last_pipeline.bytes = totals.bytes;
+    ctx->last_pipeline.peak = totals.peak;
+    ctx->last_pipeline.first_ms = first_ms;
+    ctx->last_pipeline.total_ms = timer_get_uptime_ms() - start_ms;
     ctx->last_exit_status = result;
     return result;
 }
@@ -942,7 +1451,7 @@ static int execute_while(ast_node_t *node, script_context_t *ctx) {
     if (!node || node->type != NODE_WHILE) return 1;
 
     int iteration = 0;
-    int max_iterations = 10000; /* safety limit */
+    int max_iterations = CS_MAX_LOOP_ITERATIONS;
 
     while (iteration < max_iterations) {
         int cond;
@@ -1031,7 +1540,7 @@ static int execute_node(ast_node_t *node, script_context_t *ctx) {
     if (!node) return 0;
 
     switch (node->type) {
-    case NODE_COMMAND:      return execute_command(node, ctx);
+    case NODE_COMMAND:      return execute_command(node, ctx, -1);
     case NODE_PIPELINE:     return execute_pipeline(node, ctx);
     case NODE_ASSIGNMENT:   return execute_assignment(node, ctx);
     case NODE_IF:           return execute_if(node, ctx);
@@ -1046,6 +1555,96 @@ static int execute_node(ast_node_t *node, script_context_t *ctx) {
     return 0;
 }
 
+/* Bytecode interpreter
+ * Runs ctx->program from pc until CS_OP_END or a return, like
+ * execute_node on the node the code came from.  Loop counters live in
+ * this frame, so each function call gets its own.*/
+static int cs_vm_run(script_context_t *ctx, int pc) {
+    const cs_insn_t *code = ctx->program->code;
+    uint32_t loops[CS_MAX_LOOP_DEPTH];
+    char value[MAX_EXPAND_LEN];
+    int status = 0;
+
+    for (;;) {
+        const cs_insn_t *in = &code[pc++];
+        if (in->stmt) job_check_completed(&ctx->jobs, ctx->print_fn);
+
+        switch ((cs_opcode_t)in->op) {
+        case CS_OP_CMD:
+            status = execute_command(in->node, ctx, in->a);
+            break;
+        case CS_OP_PIPELINE:
+            status = execute_pipeline(in->node, ctx);
+            break;
+        case CS_OP_ASSIGN:
+            cs_expand_word(ctx, in->a, value);
+            cs_set_var_id(ctx, in->name, value);
+            status = 0;
+            break;
+        case CS_OP_TEST: {
+            cs_test_op_t op = (cs_test_op_t)in->c;
+            if (op >= CS_TEST_EQ && op <= CS_TEST_GE) {
+                int lhs = cs_word_int(ctx, in->a);
+                int rhs = cs_word_int(ctx, in->a + 2);
+                bool r = op == CS_TEST_EQ ? lhs == rhs :
+                         op == CS_TEST_NE ? lhs != rhs :
+                         op == CS_TEST_LT ? lhs <  rhs :
+                         op == CS_TEST_GT ? lhs >  rhs :
+                         op == CS_TEST_LE ? lhs <= rhs : lhs >= rhs;
+                status = r ? 0 : 1;
+                break;
+            }
+            char expanded[MAX_ARGS][MAX_EXPAND_LEN];
+            for (int i = 0; i < in->b; i++) {
+                cs_expand_word(ctx, in->a + i, expanded[i]);
+            }
+            status = cs_test_args(in->b, expanded, (cs_test_op_t)in->c);
+            break;
+        }
+        case CS_OP_STATUS:
+            status = in->a;
+            break;
+        case CS_OP_JUMP:
+            pc = in->a;
+            continue;
+        case CS_OP_JUMP_FALSE:
+            if (status != 0) pc = in->a;
+            continue;
+        case CS_OP_LOOP_INIT:
+            loops[in->loop] = 0;
+            continue;
+        case CS_OP_LOOP:
+            if (loops[in->loop]++ >= CS_MAX_LOOP_ITERATIONS) {
+                KWARN("CupidScript: while loop hit iteration limit (%d)",
+                      CS_MAX_LOOP_ITERATIONS);
+                pc = in->a;
+            }
+            continue;
+        case CS_OP_FOR:
+            if (loops[in->loop] >= (uint32_t)in->c) {
+                pc = in->a;
+                continue;
+            }
+            cs_expand_word(ctx, in->b + (int)loops[in->loop]++, value);
+            cs_set_var_id(ctx, in->name, value);
+            continue;
+        case CS_OP_DEFUN:
+            cs_define_function(ctx, in->node->data.function_def.name,
+                               in->node->data.function_def.body, in->a);
+            continue;
+        case CS_OP_RETURN:
+            ctx->return_flag = 1;
+            ctx->return_value = in->a;
+            status = in->a;
+            break;
+        case CS_OP_END:
+            return status;
+        }
+
+        if (ctx->return_flag) return status;
+    }
+}
+
 /* Public: execute an AST */
 int cupidscript_execute(ast_node_t *ast, script_context_t *ctx) {
     return execute_node(ast, ctx);
@@ -1083,6 +1682,8 @@ int cupidscript_run_file(const char *filename, const char *args) {
     const char *source = NULL;
     uint32_t source_len = 0;
     char *disk_buf = NULL;
+    const char *cache_path = filename;
+    char vpath[VFS_MAX_PATH];
 
     /* Determine output mode based on shell state */
     if (shell_get_output_mode() == SHELL_OUTPUT_GUI) {
@@ -1104,7 +1705,6 @@ int cupidscript_run_file(const char *filename, const char *args) {
     /* 2. Try VFS (supports /home/file, /tmp/file, etc.) */
     if (!source) {
         /* Build VFS path: if not absolute, prepend CWD */
-        char vpath[VFS_MAX_PATH];
         if (filename[0] == '/') {
             int k = 0;
             while (filename[k] && k < VFS_MAX_PATH - 1) {
@@ -1149,6 +1749,7 @@ int cupidscript_run_file(const char *filename, const char *args) {
             disk_buf[total_read] = '\0';
             source = disk_buf;
             source_len = (uint32_t)total_read;
+            cache_path = vpath;
             KINFO("CupidScript: loading '%s' from VFS (%u bytes)",
                   vpath, source_len);
         }
@@ -1191,23 +1792,16 @@ int cupidscript_run_file(const char *filename, const char *args) {
               filename, source_len);
     }
 
-    /* 3. Tokenize */
-    token_t *tokens = kmalloc(MAX_TOKENS * sizeof(token_t));
-    if (!tokens) {
-        if (disk_buf) kfree(disk_buf);
+    /* 3. Tokenize, parse and compile, or reuse the cached program */
+    cs_program_t *prog = NULL;
+    int err = cs_program_get(cache_path, source, source_len, &prog);
+    if (disk_buf) kfree(disk_buf);
+    if (err == -1) {
         void (*out)(const char *) = cs_print ? cs_print : print;
         out("cupid: out of memory for tokenizer\n");
         return 1;
     }
-
-    int token_count = cupidscript_tokenize(source, source_len,
-                                            tokens, MAX_TOKENS);
-
-    /* 4. Parse */
-    ast_node_t *ast = cupidscript_parse(tokens, token_count);
-    if (!ast) {
-        kfree(tokens);
-        if (disk_buf) kfree(disk_buf);
+    if (err < 0) {
         void (*out)(const char *) = cs_print ? cs_print : print;
         out("cupid: parse error in ");
         out(filename);
@@ -1215,14 +1809,12 @@ int cupidscript_run_file(const char *filename, const char *args) {
         return 1;
     }
 
-    /* 5. Set up context and execute */
+    /* 4. Set up context and execute */
     script_context_t *ctx = kmalloc(sizeof(script_context_t));
     if (!ctx) {
         void (*out)(const char *) = cs_print ? cs_print : print;
         out("cupid: out of memory\n");
-        cupidscript_free_ast(ast);
-        kfree(tokens);
-        if (disk_buf) kfree(disk_buf);
+        cs_program_put(prog);
         return 1;
     }
     memset(ctx, 0, sizeof(script_context_t));
@@ -1246,12 +1838,16 @@ int cupidscript_run_file(const char *filename, const char *args) {
     KINFO("CupidScript: executing '%s' with %d args", filename,
           ctx->script_argc);
 
-    int result = cupidscript_execute(ast, ctx);
+    int result;
+    if (prog->code && cs_use_bytecode) {
+        ctx->program = prog;
+        result = cs_vm_run(ctx, 0);
+    } else {
+        result = cupidscript_execute(prog->ast, ctx);
+    }
 
-    /* 6. Cleanup */
-    cupidscript_free_ast(ast);
-    kfree(tokens);
-    if (disk_buf) kfree(disk_buf);
+    /* 5. Cleanup */
+    cs_program_put(prog);
     kfree(ctx);
 
     KINFO("CupidScript: '%s' finished with exit status %d",
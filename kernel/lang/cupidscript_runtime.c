@@ -2,6 +2,8 @@
  * cupidscript_runtime.c - Runtime variable/function management for CupidScript
  *
  * Manages variable storage, function registry, and variable expansion.
+ * Variables and functions are found through small open-addressed hash
+ * indexes; nothing is ever removed, so a slot once found stays valid.
 */
 #include "cupidscript.h"
 #include "string.h"
@@ -22,6 +24,10 @@ void cupidscript_init_context(script_context_t *ctx) {
     ctx->script_name[0] = '\0';
     /* Initialize stream system */
     fd_table_init(&ctx->fd_table, ctx);
+    ctx->active_stdin_fd = -1;
+    ctx->active_stdout_fd = -1;
+    ctx->program = NULL;
+    memset(ctx->var_slot, 0xFF, sizeof(ctx->var_slot));
     /* Initialize job table */
     job_table_init(&ctx->jobs);
     /* Initialize arrays */
@@ -74,6 +80,45 @@ static void int_to_str(int val, char *buf, int bufsize) {
     buf[j] = '\0';
 }
 
+static uint32_t cs_name_hash(const char *name) {
+    uint32_t h = 2166136261u;
+    while (*name) {
+        h ^= (uint8_t)*name++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static int cs_var_find(script_context_t *ctx, const char *name) {
+    uint32_t b = cs_name_hash(name) & (CS_VAR_BUCKETS - 1);
+    while (ctx->var_index[b]) {
+        int slot = ctx->var_index[b] - 1;
+        if (strcmp(ctx->variables[slot].name, name) == 0) return slot;
+        b = (b + 1) & (CS_VAR_BUCKETS - 1);
+    }
+    return -1;
+}
+
+static int cs_func_find(script_context_t *ctx, const char *name) {
+    uint32_t b = cs_name_hash(name) & (CS_FUNC_BUCKETS - 1);
+    while (ctx->func_index[b]) {
+        int slot = ctx->func_index[b] - 1;
+        if (strcmp(ctx->functions[slot].name, name) == 0) return slot;
+        b = (b + 1) & (CS_FUNC_BUCKETS - 1);
+    }
+    return -1;
+}
+
+bool cs_is_special_variable(const char *name) {
+    if (name[0] && !name[1]) {
+        return name[0] == '?' || name[0] == '#' || name[0] == '!' ||
+               (name[0] >= '0' && name[0] <= '9');
+    }
+    return strcmp(name, "EPOCHSECONDS") == 0 ||
+           strcmp(name, "PIPE_BYTES") == 0 || strcmp(name, "PIPE_PEAK") == 0 ||
+           strcmp(name, "PIPE_FIRST_MS") == 0 || strcmp(name, "PIPE_MS") == 0;
+}
+
 const char *cupidscript_get_variable(script_context_t *ctx, const char *name) {
     /* Special variables */
     if (name[0] == '?' && name[1] == '\0') {
@@ -90,6 +135,13 @@ const char *cupidscript_get_variable(script_context_t *ctx, const char *name) {
         return argc_buf;
     }
 
+    /* $! - last background PID */
+    if (name[0] == '!' && name[1] == '\0') {
+        static char bg_buf[16];
+        int_to_str((int)ctx->jobs.last_bg_pid, bg_buf, 16);
+        return bg_buf;
+    }
+
     /* $0 - script name */
     if (name[0] == '0' && name[1] == '\0') {
         return ctx->script_name;
@@ -111,38 +163,82 @@ const char *cupidscript_get_variable(script_context_t *ctx, const char *name) {
         return epoch_buf;
     }
 
-    /* Regular variables */
-    for (int i = 0; i < ctx->var_count; i++) {
-        if (strcmp(ctx->variables[i].name, name) == 0) {
-            return ctx->variables[i].value;
+    /* $PIPE_BYTES, $PIPE_PEAK, $PIPE_FIRST_MS, $PIPE_MS - last pipeline */
+    if (strncmp(name, "PIPE_", 5) == 0) {
+        static char pipe_buf[16];
+        const cs_pipeline_stats_t *st = &ctx->last_pipeline;
+        const char *field = name + 5;
+        int val = -1;
+        if (strcmp(field, "BYTES") == 0) val = (int)st->bytes;
+        else if (strcmp(field, "PEAK") == 0) val = (int)st->peak;
+        else if (strcmp(field, "FIRST_MS") == 0) val = (int)st->first_ms;
+        else if (strcmp(field, "MS") == 0) val = (int)st->total_ms;
+        if (val >= 0) {
+            int_to_str(val, pipe_buf, 16);
+            return pipe_buf;
         }
     }
 
+    /* Regular variables */
+    int slot = cs_var_find(ctx, name);
+    if (slot >= 0) return ctx->variables[slot].value;
+
     return ""; /* undefined variables expand to empty (bash behavior) */
 }
 
 void cupidscript_set_variable(script_context_t *ctx, const char *name,
                               const char *value) {
     /* Check if variable already exists */
-    for (int i = 0; i < ctx->var_count; i++) {
-        if (strcmp(ctx->variables[i].name, name) == 0) {
-            str_copy(ctx->variables[i].value, value, MAX_VAR_VALUE);
-            KDEBUG("CupidScript: set %s = %s", name, value);
-            return;
-        }
+    int slot = cs_var_find(ctx, name);
+    if (slot >= 0) {
+        str_copy(ctx->variables[slot].value, value, MAX_VAR_VALUE);
+        KDEBUG("CupidScript: set %s = %s", name, value);
+        return;
     }
 
     /* Add new variable */
     if (ctx->var_count < MAX_VARIABLES) {
-        str_copy(ctx->variables[ctx->var_count].name, name, MAX_VAR_NAME);
-        str_copy(ctx->variables[ctx->var_count].value, value, MAX_VAR_VALUE);
-        ctx->var_count++;
+        slot = ctx->var_count++;
+        str_copy(ctx->variables[slot].name, name, MAX_VAR_NAME);
+        str_copy(ctx->variables[slot].value, value, MAX_VAR_VALUE);
+        uint32_t b = cs_name_hash(ctx->variables[slot].name) &
+                     (CS_VAR_BUCKETS - 1);
+        while (ctx->var_index[b]) b = (b + 1) & (CS_VAR_BUCKETS - 1);
+        ctx->var_index[b] = (uint8_t)(slot + 1);
         KDEBUG("CupidScript: new %s = %s", name, value);
     } else {
         KERROR("CupidScript: too many variables (max %d)", MAX_VARIABLES);
     }
 }
 
+/* Interned names of the running program; computed names always take
+ * the full path, the rest are looked up once and then used by slot. */
+const char *cs_get_var_id(script_context_t *ctx, int id) {
+    const cs_program_t *prog = ctx->program;
+    if (prog->special[id]) {
+        return cupidscript_get_variable(ctx, prog->names[id]);
+    }
+    int slot = ctx->var_slot[id];
+    if (slot < 0) {
+        slot = cs_var_find(ctx, prog->names[id]);
+        if (slot < 0) return "";
+        ctx->var_slot[id] = (int8_t)slot;
+    }
+    return ctx->variables[slot].value;
+}
+
+void cs_set_var_id(script_context_t *ctx, int id, const char *value) {
+    int slot = ctx->var_slot[id];
+    if (slot >= 0) {
+        str_copy(ctx->variables[slot].value, value, MAX_VAR_VALUE);
+        return;
+    }
+    const char *name = ctx->program->names[id];
+    cupidscript_set_variable(ctx, name, value);
+    slot = cs_var_find(ctx, name);
+    if (slot >= 0) ctx->var_slot[id] = (int8_t)slot;
+}
+
 /* Variable expansion
  * Replaces $VAR patterns in a string with their values.
  * Returns a kmalloc'd string - caller must kfree().
@@ -391,33 +487,46 @@ char *cupidscript_expand(const char *str, script_context_t *ctx) {
 
 /* Function management */
 
-void cupidscript_register_function(script_context_t *ctx, const char *name,
-                                   ast_node_t *body) {
+void cs_define_function(script_context_t *ctx, const char *name,
+                        ast_node_t *body, int entry) {
     /* Check if function already exists - update it */
-    for (int i = 0; i < ctx->func_count; i++) {
-        if (strcmp(ctx->functions[i].name, name) == 0) {
-            ctx->functions[i].body = body;
-            KDEBUG("CupidScript: updated function '%s'", name);
-            return;
-        }
+    int slot = cs_func_find(ctx, name);
+    if (slot >= 0) {
+        ctx->functions[slot].body = body;
+        ctx->functions[slot].entry = entry;
+        KDEBUG("CupidScript: updated function '%s'", name);
+        return;
     }
 
     if (ctx->func_count < MAX_FUNCTIONS) {
-        str_copy(ctx->functions[ctx->func_count].name, name, MAX_VAR_NAME);
-        ctx->functions[ctx->func_count].body = body;
-        ctx->func_count++;
+        slot = ctx->func_count++;
+        str_copy(ctx->functions[slot].name, name, MAX_VAR_NAME);
+        ctx->functions[slot].body = body;
+        ctx->functions[slot].entry = entry;
+        uint32_t b = cs_name_hash(ctx->functions[slot].name) &
+                     (CS_FUNC_BUCKETS - 1);
+        while (ctx->func_index[b]) b = (b + 1) & (CS_FUNC_BUCKETS - 1);
+        ctx->func_index[b] = (uint8_t)(slot + 1);
         KDEBUG("CupidScript: registered function '%s'", name);
     } else {
         KERROR("CupidScript: too many functions (max %d)", MAX_FUNCTIONS);
     }
 }
 
+void cupidscript_register_function(script_context_t *ctx, const char *name,
+                                   ast_node_t *body) {
+    cs_define_function(ctx, name, body, -1);
+}
+
+const cs_function_t *cs_find_function(script_context_t *ctx,
+                                      const char *name) {
+    int slot = cs_func_find(ctx, name);
+    if (slot < 0 || !ctx->functions[slot].body) return NULL;
+    return &ctx->functions[slot];
+}
+
 ast_node_t *cupidscript_lookup_function(script_context_t *ctx,
                                         const char *name) {
-    for (int i = 0; i < ctx->func_count; i++) {
-        if (strcmp(ctx->functions[i].name, name) == 0) {
-            return ctx->functions[i].body;
-        }
-    }
-    return NULL;
+    const cs_function_t *fn = cs_find_function(ctx, name);
+    return fn ? fn->body : NULL;
 }
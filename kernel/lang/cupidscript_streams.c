@@ -2,8 +2,102 @@
 #include "cupidscript.h"
 #include "memory.h"
 #include "string.h"
-#include "vfs.h"
-#include "keyboard.h"
+#include "vfs.h"
+#include "keyboard.h"
+#include "bkl.h"
+#include "process.h"
+#include "timer.h"
+
+/* Pipe ends may live in different stages running on different CPUs;
+ * the ring and its counts change only under the BKL, and a blocked end
+ * waits in cs_pipe_wait with the lock released.  Where waiting cannot
+ * end, the read or write fails with FD_EDEADLK.*/
+
+static int pipe_read(cs_pipe_t *p, char *buf, size_t len) {
+    if (!p) return 0;   /* shut down by fd_shutdown_read */
+    uint32_t since = timer_get_uptime_ms();
+    for (;;) {
+        bkl_lock();
+        uint32_t queued = p->head - p->tail;
+        if (queued > 0) {
+            uint32_t n = (len < queued) ? (uint32_t)len : queued;
+            for (uint32_t i = 0; i < n; i++) {
+                buf[i] = p->ring[(p->tail + i) % CS_PIPE_SIZE];
+            }
+            p->tail += n;
+            if (p->first_read_ms == 0) {
+                p->first_read_ms = timer_get_uptime_ms() | 1u;
+            }
+            bkl_unlock();
+            return (int)n;
+        }
+        if (p->writers == 0) {
+            bkl_unlock();
+            return 0;   /* EOF */
+        }
+        bkl_unlock();
+        if (!cs_pipe_wait(since)) return FD_EDEADLK;
+    }
+}
+
+static int pipe_write(cs_pipe_t *p, const char *buf, size_t len) {
+    size_t done = 0;
+    uint32_t since = timer_get_uptime_ms();
+    while (done < len) {
+        bkl_lock();
+        if (p->readers == 0) {
+            bkl_unlock();
+            return FD_EPIPE;
+        }
+        uint32_t queued = p->head - p->tail;
+        uint32_t room = CS_PIPE_SIZE - queued;
+        if (room > 0) {
+            uint32_t n = (len - done < room) ? (uint32_t)(len - done) : room;
+            for (uint32_t i = 0; i < n; i++) {
+                p->ring[(p->head + i) % CS_PIPE_SIZE] = buf[done + i];
+            }
+            p->head += n;
+            p->bytes += n;
+            if (queued + n > p->peak) p->peak = queued + n;
+            done += n;
+            bkl_unlock();
+            since = timer_get_uptime_ms();
+            continue;
+        }
+        bkl_unlock();
+        if (!cs_pipe_wait(since)) return FD_EDEADLK;
+    }
+    return (int)len;
+}
+
+/* Drop one end's reference; the last one frees the pipe. */
+static void pipe_release(cs_pipe_t *p, bool write_end) {
+    if (!p) return;
+    bkl_lock();
+    if (write_end) {
+        if (p->writers > 0) p->writers--;
+    } else {
+        if (p->readers > 0) p->readers--;
+    }
+    bool last = (p->readers == 0 && p->writers == 0);
+    if (last && p->totals) {
+        p->totals->bytes += p->bytes;
+        p->totals->peak += p->peak;
+    }
+    bkl_unlock();
+    if (last) {
+        kfree(p->ring);
+        kfree(p);
+    }
+}
+
+static void pipe_retain(cs_pipe_t *p, bool write_end) {
+    if (!p) return;
+    bkl_lock();
+    if (write_end) p->writers++;
+    else p->readers++;
+    bkl_unlock();
+}
 
 void fd_table_init(fd_table_t *table, script_context_t *ctx) {
     // Clear all fds
@@ -42,7 +136,10 @@ int fd_read(fd_table_t *table, int fd, char *buf, size_t len) {
             }
             return (int)to_read;
         }
-        case FD_FILE:
+        case FD_PIPE:
+            if (fdesc->pipe.write_end) return -1;
+            return pipe_read(fdesc->pipe.pipe, buf, len);
+        case FD_FILE:
             return vfs_read(fdesc->file.vfs_fd, buf, len);
         case FD_TERMINAL:
             if (!buf || len == 0) return 0;
@@ -112,6 +209,9 @@ int fd_write(fd_table_t *table, int fd, const char *buf, size_t len) {
             }
             return (int)len;
         }
+        case FD_PIPE:
+            if (!fdesc->pipe.write_end) return -1;
+            return pipe_write(fdesc->pipe.pipe, buf, len);
         case FD_FILE:
             return vfs_write(fdesc->file.vfs_fd, buf, len);
         case FD_TERMINAL:
@@ -143,6 +243,9 @@ void fd_close(fd_table_t *table, int fd) {
                 fdesc->buffer.data = NULL;
             }
             break;
+        case FD_PIPE:
+            pipe_release(fdesc->pipe.pipe, fdesc->pipe.write_end);
+            break;
         case FD_FILE:
             vfs_close(fdesc->file.vfs_fd);
             break;
@@ -171,6 +274,10 @@ int fd_dup(fd_table_t *table, int oldfd, int newfd) {
     if (table->fds[newfd].type == FD_BUFFER) {
         table->fds[newfd].buffer.owner = false;
     }
+    if (table->fds[newfd].type == FD_PIPE) {
+        pipe_retain(table->fds[newfd].pipe.pipe,
+                    table->fds[newfd].pipe.write_end);
+    }
 
     return newfd;
 }
@@ -194,25 +301,27 @@ int fd_create_pipe(fd_table_t *table, int *read_fd, int *write_fd) {
         return -1;  // No free fds
     }
 
-    // Create shared buffer (4KB default)
-    char *pipe_data = kmalloc(4096);
-    if (!pipe_data) return -1;
+    // Create the ring shared by both ends
+    cs_pipe_t *p = kmalloc(sizeof(cs_pipe_t));
+    if (!p) return -1;
+    memset(p, 0, sizeof(cs_pipe_t));
+    p->ring = kmalloc(CS_PIPE_SIZE);
+    if (!p->ring) {
+        kfree(p);
+        return -1;
+    }
+    p->readers = 1;
+    p->writers = 1;
 
     // Setup read end
-    table->fds[rfd].type = FD_BUFFER;
-    table->fds[rfd].buffer.data = pipe_data;
-    table->fds[rfd].buffer.size = 0;
-    table->fds[rfd].buffer.read_pos = 0;
-    table->fds[rfd].buffer.capacity = 4096;
-    table->fds[rfd].buffer.owner = true;
-
-    // Setup write end (same buffer)
-    table->fds[wfd].type = FD_BUFFER;
-    table->fds[wfd].buffer.data = pipe_data;
-    table->fds[wfd].buffer.size = 0;
-    table->fds[wfd].buffer.read_pos = 0;
-    table->fds[wfd].buffer.capacity = 4096;
-    table->fds[wfd].buffer.owner = false;
+    table->fds[rfd].type = FD_PIPE;
+    table->fds[rfd].pipe.pipe = p;
+    table->fds[rfd].pipe.write_end = false;
+
+    // Setup write end (same ring)
+    table->fds[wfd].type = FD_PIPE;
+    table->fds[wfd].pipe.pipe = p;
+    table->fds[wfd].pipe.write_end = true;
 
     *read_fd = rfd;
     *write_fd = wfd;
@@ -220,6 +329,43 @@ int fd_create_pipe(fd_table_t *table, int *read_fd, int *write_fd) {
     return 0;
 }
 
+void fd_table_fork(fd_table_t *child, const fd_table_t *parent,
+                   int in_fd, int out_fd) {
+    for (int i = 0; i < MAX_FDS; i++) {
+        child->fds[i].type = FD_CLOSED;
+    }
+    child->fds[CS_STDIN] = parent->fds[CS_STDIN];
+    child->fds[CS_STDOUT] = parent->fds[CS_STDOUT];
+    child->fds[CS_STDERR] = parent->fds[CS_STDERR];
+    child->next_fd = 3;
+
+    int fds[2] = { in_fd, out_fd };
+    for (int i = 0; i < 2; i++) {
+        int fd = fds[i];
+        if (fd < 3 || fd >= MAX_FDS || parent->fds[fd].type != FD_PIPE) {
+            continue;
+        }
+        child->fds[fd] = parent->fds[fd];
+        pipe_retain(child->fds[fd].pipe.pipe, child->fds[fd].pipe.write_end);
+    }
+}
+
+void fd_shutdown_read(fd_table_t *table, int fd) {
+    if (fd < 0 || fd >= MAX_FDS || table->fds[fd].type != FD_PIPE ||
+        table->fds[fd].pipe.write_end) {
+        return;
+    }
+    pipe_release(table->fds[fd].pipe.pipe, false);
+    table->fds[fd].pipe.pipe = NULL;
+}
+
+cs_pipe_t *fd_get_pipe(fd_table_t *table, int fd) {
+    if (fd < 0 || fd >= MAX_FDS || table->fds[fd].type != FD_PIPE) {
+        return NULL;
+    }
+    return table->fds[fd].pipe.pipe;
+}
+
 int fd_create_buffer(fd_table_t *table, size_t capacity) {
     // Find free fd
     int fd = -1;
@@ -263,8 +409,8 @@ char *fd_get_buffer_contents(fd_table_t *table, int fd) {
         return result;
     }
 
-    if (fdesc->type == FD_FILE) {
-        /* Read file contents from current offset into a bounded buffer. */
+    if (fdesc->type == FD_FILE || fdesc->type == FD_PIPE) {
+        /* Read from the current offset (or pipe) into a bounded buffer. */
         char *result = kmalloc(1025);
         if (!result) return NULL;
 
@@ -2,7 +2,8 @@
  * cupidscript_streams.h - Stream and file descriptor system for CupidScript
  *
  * Provides a file descriptor table with support for terminal I/O,
- * in-memory buffers (pipes), and VFS file access.
+ * in-memory buffers, bounded pipes between pipeline stages, and VFS
+ * file access.
 */
 #ifndef CUPIDSCRIPT_STREAMS_H
 #define CUPIDSCRIPT_STREAMS_H
@@ -18,14 +19,45 @@ typedef struct script_context script_context_t;
 #define CS_STDOUT 1
 #define CS_STDERR 2
 
+/* Ring size of a pipe between two pipeline stages.  A writer blocks
+ * while its pipe is full, so a pipeline holds at most this much per
+ * pipe however long the stream is.*/
+#define CS_PIPE_SIZE 4096
+
+/* fd_write result when a pipe has no reader left (EPIPE) */
+#define FD_EPIPE (-2)
+/* fd_read/fd_write result when waiting on a pipe cannot end */
+#define FD_EDEADLK (-3)
+
 /* File descriptor types */
 typedef enum {
     FD_CLOSED,
-    FD_BUFFER,      /* In-memory buffer (pipes, command substitution) */
+    FD_BUFFER,      /* In-memory buffer (command substitution) */
+    FD_PIPE,        /* One end of a bounded pipe between stages */
     FD_FILE,        /* VFS file */
     FD_TERMINAL     /* Terminal input/output */
 } fd_type_t;
 
+/* What a pipeline's pipes moved, added up as each pipe is freed */
+typedef struct {
+    uint32_t bytes;
+    uint32_t peak;
+} cs_pipe_totals_t;
+
+/* Pipe shared by the fds of both ends, possibly in different stages'
+ * tables.  head and tail run free; head - tail bytes are queued.*/
+typedef struct {
+    char     *ring;
+    uint32_t  head;
+    uint32_t  tail;
+    uint32_t  readers;        /* open read-end fds */
+    uint32_t  writers;        /* open write-end fds */
+    uint32_t  peak;           /* most bytes ever queued */
+    uint32_t  bytes;          /* total bytes written */
+    uint32_t  first_read_ms;  /* uptime of the first read, 0 = none yet */
+    cs_pipe_totals_t *totals; /* optional */
+} cs_pipe_t;
+
 /* File descriptor */
 typedef struct {
     fd_type_t type;
@@ -37,6 +69,10 @@ typedef struct {
             size_t capacity;
             bool   owner;
         } buffer;
+        struct {
+            cs_pipe_t *pipe;
+            bool       write_end;
+        } pipe;
         struct {
             int vfs_fd;
         } file;
@@ -85,7 +121,8 @@ void fd_table_init(fd_table_t *table, script_context_t *ctx);
 /* Read from fd */
 int fd_read(fd_table_t *table, int fd, char *buf, size_t len);
 
-/* Write to fd */
+/* Write to fd.  Pipes block while full and return FD_EPIPE once the
+ * read end is closed.*/
 int fd_write(fd_table_t *table, int fd, const char *buf, size_t len);
 
 /* Close and free resources */
@@ -94,9 +131,23 @@ void fd_close(fd_table_t *table, int fd);
 /* Duplicate fd (for redirection: 2>&1) */
 int fd_dup(fd_table_t *table, int oldfd, int newfd);
 
-/* Create pipe (returns two fds: read end and write end) */
+/* Create pipe (returns two fds: read end and write end).  Reads block
+ * until data arrives or every write end is closed (then return 0). */
 int fd_create_pipe(fd_table_t *table, int *read_fd, int *write_fd);
 
+/* Set up a pipeline stage's table: the std fds of parent, plus the
+ * pipe ends in_fd and out_fd under the same numbers.  The child holds
+ * its own reference to each, released by fd_close.*/
+void fd_table_fork(fd_table_t *child, const fd_table_t *parent,
+                   int in_fd, int out_fd);
+
+/* Stop reading a pipe early: the writer sees FD_EPIPE and fd reads as
+ * EOF from now on.  No-op for anything but a pipe's read end. */
+void fd_shutdown_read(fd_table_t *table, int fd);
+
+/* The pipe behind fd, or NULL if fd is not a pipe end */
+cs_pipe_t *fd_get_pipe(fd_table_t *table, int fd);
+
 /* Create in-memory buffer */
 int fd_create_buffer(fd_table_t *table, size_t capacity);
 
@@ -26,6 +26,7 @@
 #include "pci.h"
 #include "smp.h"
 #include "percpu.h"
+#include "perf.h"
 #include "bkl.h"
 #include "terminal_app.h"
 #include "string.h"
@@ -41,6 +42,7 @@
 #include "ip.h"
 #include "socket.h"
 #include "sshd.h"
+#include "doomgeneric_cupidos.h"
 
 #define MAX_INPUT_LEN 80
 #define HISTORY_SIZE 16
@@ -1301,12 +1303,14 @@ static void shell_swapstats_cmd(const char *args);
 static void shell_usb_cmd(const char *args);
 static void shell_pci_cmd(const char *args);
 static void shell_smp_cmd(const char *args);
+static void shell_perf_cmd(const char *args);
 static void shell_ifconfig_cmd(const char *args);
 static void shell_ping_cmd    (const char *args);
 static void shell_netstat_cmd (const char *args);
 static void shell_arp_cmd     (const char *args);
 static void shell_resolve_cmd (const char *args);
 static void shell_doom_cmd    (const char *args);
+static void shell_doomstat_cmd(const char *args);
 static void shell_sshd_cmd    (const char *args);
 
 // List of supported commands
@@ -1334,6 +1338,7 @@ static struct shell_command commands[] = {
     {"usb", "List USB devices (usb | usb hubs | usb hc)", shell_usb_cmd},
     {"pci", "List PCI devices (bus:dev.fn vid:did class irq)", shell_pci_cmd},
     {"smp", "List CPUs (smp | smp info)", shell_smp_cmd},
+    {"perf", "Sampling profiler (perf record|stop|report|folded)", shell_perf_cmd},
     {"ifconfig", "Show or set network interface", shell_ifconfig_cmd},
     {"ping",     "Send ICMP echo (ping <host> [count])", shell_ping_cmd},
     {"netstat",  "List sockets", shell_netstat_cmd},
@@ -1341,6 +1346,7 @@ static struct shell_command commands[] = {
     {"resolve",  "DNS resolve (resolve <host>)", shell_resolve_cmd},
     {"sshd",     "SSH server (sshd [start|stop|status|passwd])", shell_sshd_cmd},
     {"doom",     "Run DOOM (doom [-iwad <path>])", shell_doom_cmd},
+    {"doomstat", "DOOM frame rate, draw CPUs + music underruns (doomstat [reset])", shell_doomstat_cmd},
     {0, 0, 0} // Null terminator
 };
 
@@ -1793,8 +1799,18 @@ static void tab_complete(char *input, int *pos) {
 }
 
 static void shell_cupid(const char *args) {
+  /* -i: tree-walking interpreter instead of bytecode, for comparison */
+  bool interpret = false;
+  if (args && args[0] == '-' && args[1] == 'i' &&
+      (args[2] == ' ' || args[2] == '\0')) {
+    interpret = true;
+    args += 2;
+    while (*args == ' ')
+      args++;
+  }
   if (!args || args[0] == '\0') {
-    shell_print("Usage: cupid <script.cup> [args...]\n");
+    shell_print("Usage: cupid [-i] <script.cup> [args...]\n");
+    shell_print("  -i  interpret the syntax tree instead of bytecode\n");
     return;
   }
 
@@ -1819,7 +1835,9 @@ static void shell_cupid(const char *args) {
     cupidscript_set_output(shell_print, shell_putchar, shell_print_int);
   }
 
+  cupidscript_set_bytecode(!interpret);
   cupidscript_run_file(filename, script_args);
+  cupidscript_set_bytecode(true);
 }
 
 /* ── try_bin_dispatch: check if a resolved path is /bin/<app> and run it ─ * Returns true if handled, false if not a /bin path. */
@@ -2206,30 +2224,50 @@ static void shell_cc_repl(void) {
 /*  *  CupidC Compiler Commands
  **/
 
-/* cupidc <file.cc> - JIT compile and run */
+/* Leading "-O" on a compiler command line: enable the optimizer for the
+ * next compile (the command resets it afterwards) and return the rest of
+ * the arguments.*/
+static const char *shell_cc_opt_flag(const char *args) {
+  if (args && args[0] == '-' && args[1] == 'O' &&
+      (args[2] == ' ' || args[2] == '\0')) {
+    cupidc_set_opt_level(1);
+    args += 2;
+    while (*args == ' ')
+      args++;
+  }
+  return args;
+}
+
+/* cupidc [-O] <file.cc> - JIT compile and run */
 static void shell_cupidc_cmd(const char *args) {
+  args = shell_cc_opt_flag(args);
   if (!args || args[0] == '\0') {
-    shell_print("Usage: cupidc <file.cc>\n");
+    shell_print("Usage: cupidc [-O] <file.cc>\n");
     shell_print("  Compile and run a CupidC source file\n");
+    shell_print("  -O  keep hot locals in registers, fold constants\n");
+    cupidc_set_opt_level(0);
     return;
   }
   char rpath[VFS_MAX_PATH];
   shell_resolve_path(args, rpath);
   cupidc_jit(rpath);
+  cupidc_set_opt_level(0);
 }
 
-/* cc [file.cc] - interactive CupidC REPL or file JIT */
+/* cc [-O] [-d] [file.cc] - interactive CupidC REPL or file JIT */
 static void shell_cc_cmd(const char *args) {
   if (!args || args[0] == '\0') {
     shell_cc_repl();
     return;
   }
 
+  args = shell_cc_opt_flag(args);
   if (args[0] == '-' && args[1] == 'd' && args[2] == ' ') {
     char rpath[VFS_MAX_PATH];
-    const char *file = args + 3;
+    const char *file = shell_cc_opt_flag(args + 3);
     shell_resolve_path(file, rpath);
     cupidc_dis(rpath, shell_print);
+    cupidc_set_opt_level(0);
     return;
   }
 
@@ -2237,6 +2275,7 @@ static void shell_cc_cmd(const char *args) {
   char rpath[VFS_MAX_PATH];
   shell_resolve_path(args, rpath);
   cupidc_jit(rpath);
+  cupidc_set_opt_level(0);
 }
 
 static void shell_reset_cmd(const char *args) {
@@ -2245,11 +2284,13 @@ static void shell_reset_cmd(const char *args) {
   shell_print("REPL state reset\n");
 }
 
-/* ccc <file.cc> -o <output> - AOT compile to ELF binary */
+/* ccc [-O] <file.cc> -o <output> - AOT compile to ELF binary */
 static void shell_ccc_cmd(const char *args) {
+  args = shell_cc_opt_flag(args);
   if (!args || args[0] == '\0') {
-    shell_print("Usage: ccc <file.cc> -o <output>\n");
+    shell_print("Usage: ccc [-O] <file.cc> -o <output>\n");
     shell_print("  Compile CupidC source to ELF binary\n");
+    cupidc_set_opt_level(0);
     return;
   }
 
@@ -2307,6 +2348,7 @@ static void shell_ccc_cmd(const char *args) {
   shell_resolve_path(out, rout);
 
   cupidc_aot(rsrc, rout);
+  cupidc_set_opt_level(0);
 }
 
 /*
@@ -2880,6 +2922,78 @@ static void shell_smp_cmd(const char *args) {
     }
 }
 
+/* Next space-separated word of *args; returns its length. */
+static int shell_perf_word(const char **args, const char *word) {
+    int n = 0;
+    while (**args == ' ') (*args)++;
+    while (word[n] && (*args)[n] == word[n]) n++;
+    if (word[n] || ((*args)[n] && (*args)[n] != ' ')) return 0;
+    *args += n;
+    while (**args == ' ') (*args)++;
+    return n;
+}
+
+static uint32_t shell_perf_number(const char **args) {
+    uint32_t v = 0;
+    while (**args >= '0' && **args <= '9') v = v * 10u + (uint32_t)(*(*args)++ - '0');
+    while (**args == ' ') (*args)++;
+    return v;
+}
+
+static void shell_perf_cmd(const char *args) {
+    if (!args) args = "";
+
+    if (shell_perf_word(&args, "record")) {
+        uint32_t hz = PERF_DEFAULT_HZ;
+        if (shell_perf_word(&args, "-F")) hz = shell_perf_number(&args);
+        int rate = perf_start(hz);
+        if (rate < 0) { shell_print("perf: out of memory for sample rings\n"); return; }
+        shell_print("perf: recording at ");
+        shell_print_int((uint32_t)rate);
+        shell_print(" Hz per CPU\n");
+        if (!*args) {
+            shell_print("perf: `perf stop` ends it\n");
+            return;
+        }
+        uint32_t t0 = timer_get_uptime_ms();
+        shell_execute_line(args);
+        perf_stop();
+        shell_print("perf: recorded ");
+        shell_print_int(timer_get_uptime_ms() - t0);
+        shell_print(" ms; `perf report` to view\n");
+        return;
+    }
+    if (shell_perf_word(&args, "stop")) {
+        perf_stop();
+        return;
+    }
+    if (shell_perf_word(&args, "report")) {
+        int callgraph = 0;
+        int top = 25;
+        for (;;) {
+            if (shell_perf_word(&args, "-g")) callgraph = 1;
+            else if (shell_perf_word(&args, "-n")) top = (int)shell_perf_number(&args);
+            else break;
+        }
+        perf_report(shell_print, top, callgraph);
+        return;
+    }
+    if (shell_perf_word(&args, "folded")) {
+        int lines = perf_folded();
+        if (lines < 0) { shell_print("perf: out of memory\n"); return; }
+        shell_print("perf: wrote ");
+        shell_print_int((uint32_t)lines);
+        shell_print(" folded stacks to serial\n");
+        return;
+    }
+
+    shell_print("usage: perf record [-F hz] [command...]  sample all CPUs\n"
+                "       perf stop                          end a background recording\n"
+                "       perf report [-g] [-n N]            flat profile, -g adds callers\n"
+                "       perf folded                        folded stacks to serial\n");
+    if (perf_recording()) shell_print("perf: recording\n");
+}
+
 static void shell_ifconfig_cmd(const char *args) {
     (void)args;
     net_if_t *nif = net_if_primary();
@@ -3085,7 +3199,6 @@ static void shell_sshd_cmd(const char *args) {
 }
 
 /* doom shell builtin - calls into the platform shim's doom_main(). */
-extern int doom_main(int argc, char **argv);
 
 #define DOOM_ARGV_MAX 16
 #define DOOM_ARG_BUF  256
@@ -3125,6 +3238,52 @@ static void shell_doom_cmd(const char *args) {
     doom_main(doom_argc, doom_argv);
 }
 
+static void shell_doomstat_cmd(const char *args) {
+    if (args && strcmp(args, "reset") == 0) {
+        doom_perf_reset();
+        shell_print("doomstat: counters reset\n");
+        return;
+    }
+    doom_perf_stats_t st;
+    doom_perf_stats(&st);
+    shell_print("frames:          ");
+    shell_print_int(st.frames);
+    shell_print("\nframe avg/max:   ");
+    shell_print_int(st.frame_avg_us);
+    shell_print(" / ");
+    shell_print_int(st.frame_max_us);
+    shell_print(" us (");
+    shell_print_int(st.fps_x10 / 10u);
+    shell_print(".");
+    shell_print_int(st.fps_x10 % 10u);
+    shell_print(" fps)\ndrawn on:        ");
+    shell_print_int(st.draw_cpus);
+    shell_print(" cpu(s)\nmusic producer:  ");
+    if (st.music_cpu >= 0) {
+        shell_print("cpu");
+        shell_print_int((uint32_t)st.music_cpu);
+    } else {
+        shell_print("game thread");
+    }
+    shell_print("\nlookahead:       ");
+    shell_print_int(st.lookahead_ms);
+    shell_print(" ms (ring now ");
+    shell_print_int(st.ring_fill_ms);
+    shell_print(" ms)\nunderruns:       ");
+    shell_print_int(st.underruns);
+    shell_print(" (");
+    shell_print_int(st.glitches);
+    shell_print(" glitches, ");
+    shell_print_int(st.silent_frames);
+    shell_print(" silent frames)\nsynth/buffer:    ");
+    shell_print_int(st.render_avg_us);
+    shell_print(" us avg, ");
+    shell_print_int(st.render_max_us);
+    shell_print(" us max over ");
+    shell_print_int(st.music_buffers);
+    shell_print(" buffers\n");
+}
+
 void shell_execute_line(const char *line) {
   if (!line || line[0] == '\0')
     return;
@@ -4194,6 +4353,10 @@ int shell_jit_suspended_count(void) {
   return jit_stack_depth;
 }
 
+int shell_jit_program_owned_by(uint32_t pid) {
+  return pid != 0 && jit_owner_pid == pid;
+}
+
 const char *shell_jit_suspended_get_name(int index) {
   if (index >= 0 && index < jit_stack_depth)
     return jit_stack[index].name;
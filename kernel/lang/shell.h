@@ -155,6 +155,12 @@ int shell_jit_program_was_killed(void);
 */
 int shell_jit_suspended_count(void);
 
+/**
+ * Check if pid's program is the one loaded at the JIT addresses.
+ * Another program started meanwhile would block pid until it exits.
+*/
+int shell_jit_program_owned_by(uint32_t pid);
+
 /**
  * Get the name of a suspended JIT program by stack index.
 */
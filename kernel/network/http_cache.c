@@ -0,0 +1,688 @@
+/**
+ * http_cache.c - On-disk HTTP response cache
+ *
+ * One body file per URL (<fnv1a-hex>.bin) under HTTP_CACHE_DIR plus a
+ * tab-separated index holding, per entry:
+ *
+ *   hash size stored fresh_until last_use etag last_modified ctype url
+ *
+ * The index is read once into `entries`; lookups never touch the disk.
+ * Freshness follows RFC 9111: Cache-Control max-age, then Expires
+ * relative to Date (so a skewed RTC doesn't matter), then 10% of the
+ * time since Last-Modified. no-cache entries are stored but always
+ * revalidated; no-store and Vary on anything but Accept-Encoding are
+ * not stored. Stale entries are revalidated with the ETag and/or the
+ * Last-Modified string echoed back verbatim.
+ *
+ * /home is homefs, which re-serializes the whole tree on every flush,
+ * so cache writes run under homefs_defer_begin/end and only
+ * http_cache_sync() (or some other file's close) persists them.
+*/
+
+#include "http_cache.h"
+#include "vfs.h"
+#include "vfs_helpers.h"
+#include "homefs.h"
+#include "memory.h"
+#include "string.h"
+#include "rtc.h"
+#include "serial.h"
+
+#define HTTP_CACHE_INDEX         HTTP_CACHE_DIR "/index"
+#define HTTP_CACHE_ETAG_MAX      96
+#define HTTP_CACHE_DATE_MAX      40
+#define HTTP_CACHE_CTYPE_MAX     64
+#define HTTP_CACHE_PATH_MAX      64
+#define HTTP_CACHE_LIFETIME_MAX  (365u * 86400u)
+#define HTTP_CACHE_HEURISTIC_MAX (86400u)
+
+typedef struct {
+    bool     used;
+    uint32_t hash;
+    uint32_t size;
+    uint32_t stored;        /* RTC epoch seconds */
+    uint32_t fresh_until;   /* fresh while now < fresh_until */
+    uint32_t last_use;      /* LRU clock */
+    char     etag[HTTP_CACHE_ETAG_MAX];
+    char     last_modified[HTTP_CACHE_DATE_MAX];
+    char     ctype[HTTP_CACHE_CTYPE_MAX];
+    char     url[HTTP_CACHE_URL_MAX];
+} http_cache_entry_t;
+
+/* What a response's headers say about caching it. */
+typedef struct {
+    bool     no_store;
+    bool     no_cache;
+    bool     has_max_age;
+    bool     has_expires;
+    bool     vary_other;
+    uint32_t max_age;
+    uint32_t age;
+    uint32_t date;
+    uint32_t expires;       /* 0 when present but unparsable (= expired) */
+    uint32_t lm_epoch;
+    char     etag[HTTP_CACHE_ETAG_MAX];
+    char     last_modified[HTTP_CACHE_DATE_MAX];
+    char     ctype[HTTP_CACHE_CTYPE_MAX];
+} http_cache_meta_t;
+
+static http_cache_entry_t entries[HTTP_CACHE_MAX_ENTRIES];
+static bool     loaded;
+static bool     index_dirty;    /* entries differ from the index file */
+static bool     home_dirty;     /* deferred /home writes not yet flushed */
+static uint32_t lru_clock;
+static uint32_t total_bytes;
+
+/* Small string helpers */
+
+static uint32_t url_hash(const char *s) {
+    uint32_t h = 2166136261u;
+    while (*s) {
+        h ^= (uint8_t)*s++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static char lower(char c) {
+    return (c >= 'A' && c <= 'Z') ? (char)(c + 32) : c;
+}
+
+/* Case-insensitive compare of s[0..n) against a lowercase literal. */
+static bool ieq_n(const char *s, uint32_t n, const char *lit) {
+    uint32_t i = 0;
+    while (i < n && lit[i]) {
+        if (lower(s[i]) != lit[i]) return false;
+        i++;
+    }
+    return i == n && lit[i] == 0;
+}
+
+static void copy_n(char *dst, uint32_t cap, const char *src, uint32_t n) {
+    uint32_t i = 0;
+    while (i < n && i + 1u < cap && src[i]) {
+        /* Tabs and line breaks would corrupt the index. */
+        char c = src[i];
+        dst[i] = (c == '\t' || c == '\r' || c == '\n') ? ' ' : c;
+        i++;
+    }
+    dst[i] = 0;
+}
+
+static uint32_t put_str(char *out, uint32_t pos, uint32_t cap, const char *s) {
+    while (*s && pos + 1u < cap) out[pos++] = *s++;
+    out[pos] = 0;
+    return pos;
+}
+
+static uint32_t put_u32(char *out, uint32_t pos, uint32_t cap, uint32_t v) {
+    char tmp[12];
+    uint32_t n = 0;
+    do {
+        tmp[n++] = (char)('0' + v % 10u);
+        v /= 10u;
+    } while (v);
+    while (n && pos + 1u < cap) out[pos++] = tmp[--n];
+    out[pos] = 0;
+    return pos;
+}
+
+static uint32_t put_hex8(char *out, uint32_t pos, uint32_t cap, uint32_t v) {
+    static const char hex[] = "0123456789abcdef";
+    for (int shift = 28; shift >= 0 && pos + 1u < cap; shift -= 4) {
+        out[pos++] = hex[(v >> shift) & 0xFu];
+    }
+    out[pos] = 0;
+    return pos;
+}
+
+static uint32_t parse_u32(const char *s, uint32_t n, uint32_t *pos) {
+    uint32_t v = 0;
+    uint32_t i = *pos;
+    while (i < n && s[i] >= '0' && s[i] <= '9') {
+        uint32_t d = (uint32_t)(s[i] - '0');
+        v = (v > 429496728u) ? 0xFFFFFFFFu : v * 10u + d;
+        i++;
+    }
+    *pos = i;
+    return v;
+}
+
+static void body_path(uint32_t hash, char *out) {
+    uint32_t p = put_str(out, 0, HTTP_CACHE_PATH_MAX, HTTP_CACHE_DIR "/");
+    p = put_hex8(out, p, HTTP_CACHE_PATH_MAX, hash);
+    (void)put_str(out, p, HTTP_CACHE_PATH_MAX, ".bin");
+}
+
+/* HTTP dates */
+
+static uint32_t days_from_civil(uint32_t y, uint32_t m, uint32_t d) {
+    static const uint16_t mdays[] = {0,31,59,90,120,151,181,212,243,273,304,334};
+    uint32_t days = (y - 1970u) * 365u +
+                    ((y - 1969u) / 4u) - ((y - 1901u) / 100u) +
+                    ((y - 1601u) / 400u);
+    days += mdays[m - 1u] + d - 1u;
+    if (m > 2u && (y % 4u == 0 && (y % 100u != 0 || y % 400u == 0))) days++;
+    return days;
+}
+
+/* Parse any of the three HTTP-date forms (IMF-fixdate, RFC 850,
+ * asctime) to epoch seconds; 0 if it doesn't parse. Tokens are
+ * classified rather than matched by position. */
+static uint32_t parse_http_date(const char *s, uint32_t n) {
+    static const char months[] = "janfebmaraprmayjunjulaugsepoctnovdec";
+    uint32_t day = 0, mon = 0, year = 0, hh = 0, mm = 0, ss = 0;
+    bool have_time = false;
+    uint32_t i = 0;
+    while (i < n) {
+        while (i < n && (s[i] == ' ' || s[i] == ',' || s[i] == '-')) i++;
+        uint32_t t = i;
+        while (i < n && s[i] != ' ' && s[i] != ',' && s[i] != '-') i++;
+        uint32_t len = i - t;
+        if (len == 0) break;
+        if (s[t] >= '0' && s[t] <= '9') {
+            uint32_t p = t;
+            uint32_t v = parse_u32(s, i, &p);
+            if (p < i && s[p] == ':') {
+                hh = v;
+                p++;
+                mm = parse_u32(s, i, &p);
+                if (p < i && s[p] == ':') {
+                    p++;
+                    ss = parse_u32(s, i, &p);
+                }
+                have_time = true;
+            } else if (day == 0 && len <= 2) {
+                day = v;
+            } else {
+                year = v;
+                if (len <= 2) year += (year < 70u) ? 2000u : 1900u;
+            }
+        } else if (len >= 3 && mon == 0) {
+            for (uint32_t k = 0; k < 12u; k++) {
+                if (lower(s[t]) == months[k * 3u] &&
+                    lower(s[t + 1u]) == months[k * 3u + 1u] &&
+                    lower(s[t + 2u]) == months[k * 3u + 2u] &&
+                    (len == 3u || s[t + 3u] < 'a')) {
+                    mon = k + 1u;
+                    break;
+                }
+            }
+        }
+    }
+    if (!have_time || day < 1u || day > 31u || mon == 0 ||
+        year < 1970u || year > 2105u || hh > 23u || mm > 59u || ss > 60u) {
+        return 0;
+    }
+    return days_from_civil(year, mon, day) * 86400u + hh * 3600u +
+           mm * 60u + ss;
+}
+
+/* Response headers */
+
+static void parse_cache_control(http_cache_meta_t *m, const char *v, uint32_t n) {
+    uint32_t i = 0;
+    while (i < n) {
+        while (i < n && (v[i] == ' ' || v[i] == ',')) i++;
+        uint32_t t = i;
+        while (i < n && v[i] != ',' && v[i] != '=' && v[i] != ' ') i++;
+        uint32_t len = i - t;
+        if (ieq_n(v + t, len, "no-store")) {
+            m->no_store = true;
+        } else if (ieq_n(v + t, len, "no-cache")) {
+            m->no_cache = true;
+        } else if (ieq_n(v + t, len, "max-age") && i < n && v[i] == '=') {
+            uint32_t p = i + 1u;
+            if (p < n && v[p] == '"') p++;
+            m->max_age = parse_u32(v, n, &p);
+            m->has_max_age = true;
+            i = p;
+        }
+        /* Skip the rest of this directive (arguments, quoted lists). */
+        bool quoted = false;
+        while (i < n && (quoted || v[i] != ',')) {
+            if (v[i] == '"') quoted = !quoted;
+            i++;
+        }
+    }
+}
+
+static void parse_vary(http_cache_meta_t *m, const char *v, uint32_t n) {
+    uint32_t i = 0;
+    while (i < n) {
+        while (i < n && (v[i] == ' ' || v[i] == ',')) i++;
+        uint32_t t = i;
+        while (i < n && v[i] != ',' && v[i] != ' ') i++;
+        if (i > t && !ieq_n(v + t, i - t, "accept-encoding")) m->vary_other = true;
+    }
+}
+
+static void parse_headers(http_cache_meta_t *m, const char *h, uint32_t hlen) {
+    bool pragma_no_cache = false;
+    bool have_cc = false;
+    memset(m, 0, sizeof(*m));
+    uint32_t i = 0;
+    while (i < hlen) {
+        uint32_t ls = i;
+        while (i < hlen && h[i] != '\n') i++;
+        uint32_t le = i;
+        if (i < hlen) i++;
+        if (le > ls && h[le - 1u] == '\r') le--;
+        uint32_t colon = ls;
+        while (colon < le && h[colon] != ':') colon++;
+        if (colon >= le) continue;
+        const char *name = h + ls;
+        uint32_t nlen = colon - ls;
+        uint32_t vs = colon + 1u;
+        while (vs < le && (h[vs] == ' ' || h[vs] == '\t')) vs++;
+        uint32_t ve = le;
+        while (ve > vs && (h[ve - 1u] == ' ' || h[ve - 1u] == '\t')) ve--;
+        const char *v = h + vs;
+        uint32_t vlen = ve - vs;
+
+        if (ieq_n(name, nlen, "cache-control")) {
+            have_cc = true;
+            parse_cache_control(m, v, vlen);
+        } else if (ieq_n(name, nlen, "pragma")) {
+            if (vlen >= 8u && ieq_n(v, 8u, "no-cache")) pragma_no_cache = true;
+        } else if (ieq_n(name, nlen, "expires")) {
+            m->has_expires = true;
+            m->expires = parse_http_date(v, vlen);
+        } else if (ieq_n(name, nlen, "date")) {
+            m->date = parse_http_date(v, vlen);
+        } else if (ieq_n(name, nlen, "age")) {
+            uint32_t p = 0;
+            m->age = parse_u32(v, vlen, &p);
+        } else if (ieq_n(name, nlen, "etag")) {
+            copy_n(m->etag, HTTP_CACHE_ETAG_MAX, v, vlen);
+        } else if (ieq_n(name, nlen, "last-modified")) {
+            copy_n(m->last_modified, HTTP_CACHE_DATE_MAX, v, vlen);
+            m->lm_epoch = parse_http_date(v, vlen);
+        } else if (ieq_n(name, nlen, "content-type")) {
+            uint32_t k = 0;
+            while (k < vlen && v[k] != ';') k++;
+            while (k > 0 && v[k - 1u] == ' ') k--;
+            copy_n(m->ctype, HTTP_CACHE_CTYPE_MAX, v, k);
+        } else if (ieq_n(name, nlen, "vary")) {
+            parse_vary(m, v, vlen);
+        }
+    }
+    if (!have_cc && pragma_no_cache) m->no_cache = true;
+}
+
+/* Absolute expiry for a response received at `now`. Age is taken from
+ * the Age header only: the RTC and the origin's clock need not agree. */
+static uint32_t fresh_until(const http_cache_meta_t *m, uint32_t now) {
+    uint32_t lifetime = 0;
+    if (now == 0 || m->no_cache) return now;
+    uint32_t base = m->date ? m->date : now;
+    if (m->has_max_age) {
+        lifetime = m->max_age;
+    } else if (m->has_expires) {
+        lifetime = m->expires > base ? m->expires - base : 0;
+    } else if (m->lm_epoch && base > m->lm_epoch) {
+        lifetime = (base - m->lm_epoch) / 10u;
+        if (lifetime > HTTP_CACHE_HEURISTIC_MAX) lifetime = HTTP_CACHE_HEURISTIC_MAX;
+    }
+    if (lifetime > HTTP_CACHE_LIFETIME_MAX) lifetime = HTTP_CACHE_LIFETIME_MAX;
+    return lifetime > m->age ? now + (lifetime - m->age) : now;
+}
+
+/* Index */
+
+static int find(const char *url) {
+    uint32_t h = url_hash(url);
+    for (int i = 0; i < HTTP_CACHE_MAX_ENTRIES; i++) {
+        if (entries[i].used && entries[i].hash == h &&
+            strcmp(entries[i].url, url) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void defer_begin(void) {
+    homefs_defer_begin();
+}
+
+static void defer_end(void) {
+    homefs_defer_end();
+    home_dirty = true;
+}
+
+static void drop(int i) {
+    char path[HTTP_CACHE_PATH_MAX];
+    body_path(entries[i].hash, path);
+    defer_begin();
+    (void)vfs_unlink(path);
+    defer_end();
+    total_bytes -= entries[i].size;
+    entries[i].used = false;
+    index_dirty = true;
+}
+
+static int lru_victim(void) {
+    int victim = -1;
+    for (int i = 0; i < HTTP_CACHE_MAX_ENTRIES; i++) {
+        if (entries[i].used &&
+            (victim < 0 || entries[i].last_use < entries[victim].last_use)) {
+            victim = i;
+        }
+    }
+    return victim;
+}
+
+static const char *next_field(const char *p, const char *end,
+                              const char **field, uint32_t *len) {
+    *field = p;
+    while (p < end && *p != '\t') p++;
+    *len = (uint32_t)(p - *field);
+    return p < end ? p + 1 : p;
+}
+
+static uint32_t field_u32(const char *f, uint32_t n, bool hex) {
+    uint32_t v = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        char c = lower(f[i]);
+        uint32_t d;
+        if (c >= '0' && c <= '9') d = (uint32_t)(c - '0');
+        else if (hex && c >= 'a' && c <= 'f') d = (uint32_t)(c - 'a' + 10);
+        else break;
+        v = v * (hex ? 16u : 10u) + d;
+    }
+    return v;
+}
+
+static void load_line(const char *p, const char *end) {
+    const char *f[9];
+    uint32_t n[9];
+    for (int k = 0; k < 9; k++) p = next_field(p, end, &f[k], &n[k]);
+    if (n[8] == 0 || n[8] >= HTTP_CACHE_URL_MAX) return;
+
+    int slot = -1;
+    for (int i = 0; i < HTTP_CACHE_MAX_ENTRIES; i++) {
+        if (!entries[i].used) { slot = i; break; }
+    }
+    if (slot < 0) return;
+    http_cache_entry_t *e = &entries[slot];
+    memset(e, 0, sizeof(*e));
+    e->hash = field_u32(f[0], n[0], true);
+    e->size = field_u32(f[1], n[1], false);
+    e->stored = field_u32(f[2], n[2], false);
+    e->fresh_until = field_u32(f[3], n[3], false);
+    e->last_use = field_u32(f[4], n[4], false);
+    copy_n(e->etag, HTTP_CACHE_ETAG_MAX, f[5], n[5]);
+    copy_n(e->last_modified, HTTP_CACHE_DATE_MAX, f[6], n[6]);
+    copy_n(e->ctype, HTTP_CACHE_CTYPE_MAX, f[7], n[7]);
+    copy_n(e->url, HTTP_CACHE_URL_MAX, f[8], n[8]);
+
+    /* The body file must still be there and match. */
+    char path[HTTP_CACHE_PATH_MAX];
+    vfs_stat_t st;
+    body_path(e->hash, path);
+    if (e->hash != url_hash(e->url) || vfs_stat(path, &st) < 0 ||
+        st.size != e->size || find(e->url) >= 0) {
+        index_dirty = true;
+        return;
+    }
+    e->used = true;
+    total_bytes += e->size;
+    if (e->last_use > lru_clock) lru_clock = e->last_use;
+}
+
+void http_cache_init(void) {
+    if (loaded) return;
+    loaded = true;
+    memset(entries, 0, sizeof(entries));
+    total_bytes = 0;
+    lru_clock = 0;
+
+    vfs_stat_t st;
+    if (vfs_stat(HTTP_CACHE_DIR, &st) < 0) {
+        (void)vfs_mkdir("/home/.cache");
+        (void)vfs_mkdir(HTTP_CACHE_DIR);
+    }
+    if (vfs_stat(HTTP_CACHE_INDEX, &st) < 0 || st.size == 0) return;
+
+    char *buf = kmalloc(st.size + 1u);
+    if (!buf) return;
+    int n = vfs_read_all(HTTP_CACHE_INDEX, buf, st.size);
+    if (n > 0) {
+        const char *p = buf;
+        const char *end = buf + n;
+        while (p < end) {
+            const char *eol = p;
+            while (eol < end && *eol != '\n') eol++;
+            load_line(p, eol);
+            p = eol < end ? eol + 1 : eol;
+        }
+    }
+    kfree(buf);
+    serial_printf("[http_cache] %d entries, %u bytes\n",
+                  http_cache_count(), total_bytes);
+}
+
+static void write_index(void) {
+    uint32_t cap = (uint32_t)HTTP_CACHE_MAX_ENTRIES * (uint32_t)sizeof(http_cache_entry_t);
+    char *buf = kmalloc(cap);
+    if (!buf) return;
+    uint32_t p = 0;
+    for (int i = 0; i < HTTP_CACHE_MAX_ENTRIES; i++) {
+        const http_cache_entry_t *e = &entries[i];
+        if (!e->used) continue;
+        p = put_hex8(buf, p, cap, e->hash);
+        p = put_str(buf, p, cap, "\t");
+        p = put_u32(buf, p, cap, e->size);
+        p = put_str(buf, p, cap, "\t");
+        p = put_u32(buf, p, cap, e->stored);
+        p = put_str(buf, p, cap, "\t");
+        p = put_u32(buf, p, cap, e->fresh_until);
+        p = put_str(buf, p, cap, "\t");
+        p = put_u32(buf, p, cap, e->last_use);
+        p = put_str(buf, p, cap, "\t");
+        p = put_str(buf, p, cap, e->etag);
+        p = put_str(buf, p, cap, "\t");
+        p = put_str(buf, p, cap, e->last_modified);
+        p = put_str(buf, p, cap, "\t");
+        p = put_str(buf, p, cap, e->ctype);
+        p = put_str(buf, p, cap, "\t");
+        p = put_str(buf, p, cap, e->url);
+        p = put_str(buf, p, cap, "\n");
+    }
+    defer_begin();
+    if (vfs_write_all(HTTP_CACHE_INDEX, buf, p) >= 0) index_dirty = false;
+    defer_end();
+    kfree(buf);
+}
+
+/* Public API */
+
+int http_cache_lookup(const char *url, int allow_stale) {
+    http_cache_init();
+    int i = find(url);
+    if (i < 0) return HTTP_CACHE_MISS;
+    if (allow_stale) return HTTP_CACHE_FRESH;
+    uint32_t now = rtc_get_epoch_seconds();
+    if (now != 0 && now >= entries[i].stored && now < entries[i].fresh_until) {
+        return HTTP_CACHE_FRESH;
+    }
+    if (entries[i].etag[0] || entries[i].last_modified[0]) return HTTP_CACHE_STALE;
+    return HTTP_CACHE_MISS;
+}
+
+int http_cache_length(const char *url) {
+    http_cache_init();
+    int i = find(url);
+    return i < 0 ? -1 : (int)entries[i].size;
+}
+
+int http_cache_read(const char *url, void *buf, uint32_t cap,
+                    char *ctype, uint32_t ctype_cap) {
+    http_cache_init();
+    int i = find(url);
+    if (i < 0) return VFS_ENOENT;
+    char path[HTTP_CACHE_PATH_MAX];
+    body_path(entries[i].hash, path);
+    int n = vfs_read_all(path, buf, cap);
+    if (n < 0 || (uint32_t)n != entries[i].size) {
+        if (n >= 0 || n == VFS_ENOENT) {
+            serial_printf("[http_cache] %s: body unreadable (%d)\n", url, n);
+            drop(i);
+        }
+        return n < 0 ? n : VFS_EIO;
+    }
+    if (ctype && ctype_cap) copy_n(ctype, ctype_cap, entries[i].ctype, HTTP_CACHE_CTYPE_MAX);
+    entries[i].last_use = ++lru_clock;
+    index_dirty = true;
+    return n;
+}
+
+int http_cache_validators(const char *url, char *out, uint32_t cap) {
+    http_cache_init();
+    int i = find(url);
+    uint32_t p = 0;
+    if (cap) out[0] = 0;
+    if (i < 0 || cap == 0) return 0;
+    const http_cache_entry_t *e = &entries[i];
+    uint32_t need = 0;
+    if (e->etag[0]) need += 17u + (uint32_t)strlen(e->etag);
+    if (e->last_modified[0]) need += 21u + (uint32_t)strlen(e->last_modified);
+    if (need >= cap) return 0;
+    if (e->etag[0]) {
+        p = put_str(out, p, cap, "If-None-Match: ");
+        p = put_str(out, p, cap, e->etag);
+        p = put_str(out, p, cap, "\r\n");
+    }
+    if (e->last_modified[0]) {
+        p = put_str(out, p, cap, "If-Modified-Since: ");
+        p = put_str(out, p, cap, e->last_modified);
+        p = put_str(out, p, cap, "\r\n");
+    }
+    return (int)p;
+}
+
+int http_cache_store(const char *url, const char *headers, uint32_t hlen,
+                     const void *body, uint32_t len) {
+    http_cache_meta_t m;
+    http_cache_init();
+    parse_headers(&m, headers, hlen);
+    if (m.no_store || m.vary_other || len > HTTP_CACHE_MAX_BODY ||
+        strlen(url) >= HTTP_CACHE_URL_MAX) {
+        http_cache_remove(url);
+        return 1;
+    }
+
+    uint32_t hash = url_hash(url);
+    int slot = find(url);
+    if (slot >= 0) {
+        drop(slot);
+    }
+    /* Another URL hashing to the same body file loses its entry. */
+    for (int i = 0; i < HTTP_CACHE_MAX_ENTRIES; i++) {
+        if (entries[i].used && entries[i].hash == hash) drop(i);
+    }
+    while (total_bytes + len > HTTP_CACHE_BUDGET) {
+        int v = lru_victim();
+        if (v < 0) break;
+        drop(v);
+    }
+    slot = -1;
+    for (int i = 0; i < HTTP_CACHE_MAX_ENTRIES; i++) {
+        if (!entries[i].used) { slot = i; break; }
+    }
+    if (slot < 0) {
+        slot = lru_victim();
+        drop(slot);
+    }
+
+    char path[HTTP_CACHE_PATH_MAX];
+    body_path(hash, path);
+    defer_begin();
+    int rc = vfs_write_all(path, body, len);
+    defer_end();
+    if (rc < 0 || (uint32_t)rc != len) {
+        serial_printf("[http_cache] %s: write failed (%d)\n", url, rc);
+        defer_begin();
+        (void)vfs_unlink(path);
+        defer_end();
+        write_index();
+        return rc < 0 ? rc : VFS_EIO;
+    }
+
+    uint32_t now = rtc_get_epoch_seconds();
+    http_cache_entry_t *e = &entries[slot];
+    memset(e, 0, sizeof(*e));
+    e->used = true;
+    e->hash = hash;
+    e->size = len;
+    e->stored = now;
+    e->fresh_until = fresh_until(&m, now);
+    e->last_use = ++lru_clock;
+    copy_n(e->etag, HTTP_CACHE_ETAG_MAX, m.etag, HTTP_CACHE_ETAG_MAX);
+    copy_n(e->last_modified, HTTP_CACHE_DATE_MAX, m.last_modified, HTTP_CACHE_DATE_MAX);
+    copy_n(e->ctype, HTTP_CACHE_CTYPE_MAX, m.ctype, HTTP_CACHE_CTYPE_MAX);
+    copy_n(e->url, HTTP_CACHE_URL_MAX, url, HTTP_CACHE_URL_MAX);
+    total_bytes += len;
+    write_index();
+    return 0;
+}
+
+int http_cache_revalidated(const char *url, const char *headers,
+                           uint32_t hlen) {
+    http_cache_meta_t m;
+    http_cache_init();
+    int i = find(url);
+    if (i < 0) return -1;
+    parse_headers(&m, headers, hlen);
+    if (m.no_store) {
+        drop(i);
+        write_index();
+        return -1;
+    }
+    http_cache_entry_t *e = &entries[i];
+    /* A 304 only carries the headers that changed. */
+    if (m.etag[0]) copy_n(e->etag, HTTP_CACHE_ETAG_MAX, m.etag, HTTP_CACHE_ETAG_MAX);
+    if (m.last_modified[0]) {
+        copy_n(e->last_modified, HTTP_CACHE_DATE_MAX, m.last_modified,
+               HTTP_CACHE_DATE_MAX);
+    } else {
+        m.lm_epoch = parse_http_date(e->last_modified, (uint32_t)strlen(e->last_modified));
+    }
+    uint32_t now = rtc_get_epoch_seconds();
+    e->stored = now;
+    e->fresh_until = fresh_until(&m, now);
+    e->last_use = ++lru_clock;
+    index_dirty = true;
+    return 0;
+}
+
+void http_cache_remove(const char *url) {
+    http_cache_init();
+    int i = find(url);
+    if (i < 0) return;
+    drop(i);
+    write_index();
+}
+
+void http_cache_sync(void) {
+    if (!loaded) return;
+    if (index_dirty) write_index();
+    if (home_dirty) {
+        home_dirty = false;
+        (void)homefs_sync();
+    }
+}
+
+int http_cache_count(void) {
+    int n = 0;
+    http_cache_init();
+    for (int i = 0; i < HTTP_CACHE_MAX_ENTRIES; i++) {
+        if (entries[i].used) n++;
+    }
+    return n;
+}
+
+int http_cache_bytes(void) {
+    http_cache_init();
+    return (int)total_bytes;
+}
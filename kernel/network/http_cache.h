@@ -0,0 +1,68 @@
+#ifndef HTTP_CACHE_H
+#define HTTP_CACHE_H
+
+#include "types.h"
+
+/* Shared HTTP response cache under /home/.cache/http, keyed by URL.
+ *
+ * Bodies are stored decoded (after Content-Encoding and chunked
+ * framing), one file per entry; a text index beside them carries the
+ * validators and freshness lifetime and is loaded into memory by
+ * http_cache_init(). Size is bounded by HTTP_CACHE_BUDGET with
+ * least-recently-used eviction. Writes are batched: call
+ * http_cache_sync() when a burst of fetches is over to persist them.*/
+
+#define HTTP_CACHE_DIR          "/home/.cache/http"
+#define HTTP_CACHE_MAX_ENTRIES  128
+#define HTTP_CACHE_BUDGET       (2u * 1024u * 1024u)
+#define HTTP_CACHE_MAX_BODY     (512u * 1024u)
+#define HTTP_CACHE_URL_MAX      512
+
+/* http_cache_lookup results */
+#define HTTP_CACHE_MISS   0
+#define HTTP_CACHE_FRESH  1     /* serve from cache, no request */
+#define HTTP_CACHE_STALE  2     /* revalidate with http_cache_validators */
+
+void http_cache_init(void);
+
+/* Freshness of the entry for `url`. With allow_stale (history
+ * navigation) any stored entry counts as fresh. */
+int http_cache_lookup(const char *url, int allow_stale);
+
+/* Body length of the entry for `url`, or -1. */
+int http_cache_length(const char *url);
+
+/* Copy the body (up to cap bytes) and Content-Type (NUL-terminated,
+ * may be NULL) of the entry for `url`. Returns the byte count or a
+ * negative VFS error. Counts as a use for LRU. */
+int http_cache_read(const char *url, void *buf, uint32_t cap,
+                    char *ctype, uint32_t ctype_cap);
+
+/* Conditional request headers ("If-None-Match: ...\r\n" and/or
+ * "If-Modified-Since: ...\r\n") for the entry. Returns their length,
+ * 0 when there is nothing to validate with. */
+int http_cache_validators(const char *url, char *out, uint32_t cap);
+
+/* Store a 200 response to a GET. `headers` holds the response header
+ * lines (CRLF or LF separated; only the cache-relevant ones need be
+ * present). Returns 0 when stored, 1 when the response may not be
+ * cached (any old entry is dropped), negative on error. */
+int http_cache_store(const char *url, const char *headers, uint32_t hlen,
+                     const void *body, uint32_t len);
+
+/* A 304 answered the conditional request: refresh the entry's
+ * lifetime and validators from the new headers. Returns 0, or -1 if
+ * the entry is gone. */
+int http_cache_revalidated(const char *url, const char *headers,
+                           uint32_t hlen);
+
+/* Drop the entry for `url`, if any. */
+void http_cache_remove(const char *url);
+
+/* Write the index and flush /home if anything changed. */
+void http_cache_sync(void);
+
+int http_cache_count(void);
+int http_cache_bytes(void);
+
+#endif
@@ -257,6 +257,25 @@ int socket_avail(int fd) {
     return (int)used;
 }
 
+/* 1 when socket_recv would return without waiting for the network:
+ * TCP bytes are buffered, the TLS layer still holds plaintext from the
+ * last record, or the peer has closed. A TLS socket whose buffer holds
+ * only part of a record still reads as ready; recv then waits for the
+ * rest of that one record.*/
+int socket_readable(int fd) {
+    socket_t *s;
+    if (fd < 0 || fd >= SOCKET_MAX) return EBADF;
+    s = &sockets[fd];
+    if (!s->in_use) return EBADF;
+    if (s->tls_ctx != NULL && ((tls_ctx_t *)s->tls_ctx)->app_buf_len > 0u)
+        return 1;
+    if (s->rx_tail != s->rx_head) return 1;
+    if (s->type == SOCK_TYPE_TCP &&
+        (s->tcp_state == TCPS_CLOSE_WAIT || s->tcp_state == TCPS_CLOSED))
+        return 1;
+    return 0;
+}
+
 int socket_state(int fd) {
     socket_t *s;
     if (fd < 0 || fd >= SOCKET_MAX) return EBADF;
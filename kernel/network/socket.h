@@ -107,8 +107,10 @@ int socket_recvfrom(int fd, void *buf, uint32_t len, uint32_t *ip, uint16_t *por
 
 /* Non-blocking polling helpers.
  *   socket_avail: bytes pending in rx buffer (>= 0), or negative errno.
+ *   socket_readable: 1 if recv would not wait (data, TLS plaintext or EOF), else 0.
  *   socket_state: tcp_state_t for TCP sockets; 0 for UDP; negative errno on bad fd.*/
 int socket_avail   (int fd);
+int socket_readable(int fd);
 int socket_state   (int fd);
 
 /* UDP ingress dispatch - called from udp.c */
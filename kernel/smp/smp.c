@@ -10,6 +10,7 @@
 #include "serial.h"
 #include "idt.h"
 #include "isr.h"
+#include "fpu.h"
 
 /* Forward declarations for IPI C handlers (called from asm stubs). */
 void ipi_reschedule_c(void);
@@ -202,7 +203,7 @@ void smp_halt_others(void) {
     }
 }
 
-int smp_call_on_cpu(int cpu_id, void (*fn)(void*), void *arg) {
+int smp_call_start(int cpu_id, void (*fn)(void*), void *arg) {
     if (cpu_id < 0 || cpu_id >= smp_cpu_count()) return -1;
     if (cpu_id == smp_current_cpu()) { fn(arg); return 0; }
     per_cpu_t *t = &cpus[cpu_id];
@@ -213,13 +214,26 @@ int smp_call_on_cpu(int cpu_id, void (*fn)(void*), void *arg) {
     t->call_arg = arg;
     __atomic_store_n(&t->call_done, 0u, __ATOMIC_RELEASE);
     lapic_send_ipi(t->apic_id, IPI_CALL, LAPIC_DELIVER_FIXED);
+    return 0;
+}
+
+void smp_call_wait(int cpu_id) {
+    if (cpu_id == smp_current_cpu()) return;
+    per_cpu_t *t = &cpus[cpu_id];
     while (!__atomic_load_n(&t->call_done, __ATOMIC_ACQUIRE))
         __asm__ volatile("pause");
     __atomic_store_n(&t->call_pending, 0u, __ATOMIC_RELEASE);
+}
+
+int smp_call_on_cpu(int cpu_id, void (*fn)(void*), void *arg) {
+    if (smp_call_start(cpu_id, fn, arg) != 0) return -1;
+    smp_call_wait(cpu_id);
     return 0;
 }
 
 void ap_main_c(void) {
+    fpu_init_ap();
+
     /* Find our cpu slot by LAPIC ID (before kernel GDT / this_cpu is ready). */
     uint8_t my_apic = lapic_get_id();
     int cpu_id = 0;
@@ -9,6 +9,13 @@ void smp_init_ipi(void);
 void smp_reschedule(int cpu_id);
 void smp_halt_others(void);
 int  smp_call_on_cpu(int cpu_id, void (*fn)(void*), void *arg);
+
+/* smp_call_on_cpu split in two, so one caller can keep several CPUs
+ * busy at once: smp_call_start sends the IPI and returns, and
+ * smp_call_wait spins until fn has returned on that CPU. Every start
+ * that returned 0 needs its wait; the current CPU runs fn inline.*/
+int  smp_call_start(int cpu_id, void (*fn)(void*), void *arg);
+void smp_call_wait(int cpu_id);
 void smp_atomic_inc(uint32_t *p);
 
 #endif
@@ -0,0 +1,247 @@
+#!/usr/bin/env python3
+"""
+Local stand-in HTTP server for Content-Encoding, connection-reuse,
+cache-validation and progressive-rendering measurements.
+
+Serves a directory (default: tests/browser) over plain HTTP and honours
+Accept-Encoding with gzip or deflate, so the browser, curl -compressed
+and wget can be pointed at it from QEMU (the host is 10.0.2.2 under
+user-mode networking). Connections are kept alive unless the client
+asks otherwise or --close is given. Every request is logged with the
+bytes that crossed the wire next to the identity size and the number of
+requests served on that connection; a summary is printed on Ctrl-C.
+Every file carries an ETag and Last-Modified, and conditional requests
+(If-None-Match / If-Modified-Since) that still match get a 304.
+
+Usage:
+    python3 tools/http_gzip_server.py [--dir tests/browser] [--port 8000]
+                                      [--encoding auto|identity|gzip|
+                                                  deflate|raw-deflate]
+                                      [--chunked] [--close] [--delay MS]
+                                      [--max-age S] [--rate KBPS]
+    python3 tools/http_gzip_server.py --report [--dir tests/browser]
+
+--encoding forces one coding regardless of Accept-Encoding (raw-deflate
+sends bare RFC 1951 labelled "deflate", as some servers do). --report
+prints per-file sizes for each coding without starting a server.
+--delay holds every response for MS milliseconds, standing in for the
+round trip to a remote origin so concurrent fetches show up in timings.
+--max-age sends Cache-Control: max-age=S (0 forces revalidation);
+without it clients fall back to heuristic freshness from Last-Modified.
+--rate trickles every body out at KBPS kilobytes per second in small
+writes, standing in for a slow link so progressive rendering shows up.
+"""
+from __future__ import annotations
+import argparse
+import email.utils
+import gzip
+import http.server
+import mimetypes
+import sys
+import time
+import zlib
+from pathlib import Path
+
+REPO_ROOT = Path(__file__).resolve().parent.parent
+DEFAULT_DIR = REPO_ROOT / "tests" / "browser"
+
+
+def encode(data: bytes, coding: str) -> bytes:
+    if coding == "gzip":
+        return gzip.compress(data, compresslevel=6, mtime=0)
+    if coding == "deflate":
+        return zlib.compress(data, 6)
+    if coding == "raw-deflate":
+        c = zlib.compressobj(6, zlib.DEFLATED, -15)
+        return c.compress(data) + c.flush()
+    return data
+
+
+def pick_coding(forced: str, accept: str) -> str:
+    if forced != "auto":
+        return forced
+    offered = [t.split(";")[0].strip().lower() for t in accept.split(",")]
+    if "gzip" in offered:
+        return "gzip"
+    if "deflate" in offered:
+        return "deflate"
+    return "identity"
+
+
+class Stats:
+    requests = 0
+    not_modified = 0
+    connections = 0
+    wire = 0
+    identity = 0
+
+
+def not_modified(headers, etag: str, mtime: int) -> bool:
+    inm = headers.get("If-None-Match")
+    if inm is not None:
+        tags = [t.strip() for t in inm.split(",")]
+        return "*" in tags or etag in tags or ("W/" + etag) in tags
+    ims = headers.get("If-Modified-Since")
+    if ims:
+        try:
+            return mtime <= int(email.utils.parsedate_to_datetime(ims).timestamp())
+        except (TypeError, ValueError):
+            return False
+    return False
+
+
+def make_handler(root: Path, forced: str, chunked: bool, close: bool,
+                 delay_ms: int, max_age: int | None, rate_kbps: int):
+    class Handler(http.server.BaseHTTPRequestHandler):
+        protocol_version = "HTTP/1.1"
+        # Headers and body go out in separate writes; without this, Nagle
+        # plus the client's delayed ACK adds ~40 ms to every reused
+        # connection and swamps the timings.
+        disable_nagle_algorithm = True
+
+        def setup(self) -> None:
+            super().setup()
+            self.served = 0
+            Stats.connections += 1
+
+        def do_GET(self) -> None:
+            self.served += 1
+            if delay_ms:
+                time.sleep(delay_ms / 1000.0)
+            rel = self.path.split("?", 1)[0].lstrip("/") or "index.html"
+            path = (root / rel).resolve()
+            if (path != root and root not in path.parents) or not path.is_file():
+                self.send_error(404)
+                return
+            st = path.stat()
+            mtime = int(st.st_mtime)
+            etag = f'"{st.st_size:x}-{mtime:x}"'
+            if not_modified(self.headers, etag, mtime):
+                self.send_response(304)
+                self.send_validators(etag, mtime)
+                if close:
+                    self.send_header("Connection", "close")
+                    self.close_connection = True
+                self.end_headers()
+                Stats.requests += 1
+                Stats.not_modified += 1
+                print(f"[http] {rel}: 304 not modified "
+                      f"(request {self.served} on this connection)", flush=True)
+                return
+
+            data = path.read_bytes()
+            coding = pick_coding(forced, self.headers.get("Accept-Encoding", ""))
+            body = encode(data, coding)
+
+            self.send_response(200)
+            ctype = mimetypes.guess_type(path.name)[0] or "application/octet-stream"
+            self.send_header("Content-Type", ctype)
+            self.send_validators(etag, mtime)
+            if coding != "identity":
+                self.send_header("Content-Encoding",
+                                 "deflate" if coding == "raw-deflate" else coding)
+            if chunked:
+                self.send_header("Transfer-Encoding", "chunked")
+            else:
+                self.send_header("Content-Length", str(len(body)))
+            if close:
+                self.send_header("Connection", "close")
+                self.close_connection = True
+            self.end_headers()
+            if chunked:
+                for i in range(0, len(body), 1000):
+                    part = body[i:i + 1000]
+                    self.send_body(b"%x\r\n%s\r\n" % (len(part), part))
+                self.wfile.write(b"0\r\n\r\n")
+            else:
+                self.send_body(body)
+
+            Stats.requests += 1
+            Stats.wire += len(body)
+            Stats.identity += len(data)
+            print(f"[http] {rel}: {coding} {len(body)} / {len(data)} bytes "
+                  f"(request {self.served} on this connection)", flush=True)
+
+        def send_body(self, data: bytes) -> None:
+            if not rate_kbps:
+                self.wfile.write(data)
+                return
+            step = 1024
+            for i in range(0, len(data), step):
+                self.wfile.write(data[i:i + step])
+                self.wfile.flush()
+                time.sleep(step / (rate_kbps * 1024.0))
+
+        def send_validators(self, etag: str, mtime: int) -> None:
+            self.send_header("ETag", etag)
+            self.send_header("Last-Modified",
+                             email.utils.formatdate(mtime, usegmt=True))
+            if max_age is not None:
+                self.send_header("Cache-Control", f"max-age={max_age}")
+
+        def log_message(self, fmt: str, *args) -> None:
+            pass
+
+    return Handler
+
+
+def report(root: Path) -> None:
+    total = {"identity": 0, "gzip": 0, "deflate": 0}
+    for path in sorted(p for p in root.rglob("*") if p.is_file()):
+        data = path.read_bytes()
+        sizes = {c: len(encode(data, c)) for c in total}
+        for c in total:
+            total[c] += sizes[c]
+        print(f"{path.relative_to(root)}: {sizes['identity']} -> "
+              f"gzip {sizes['gzip']}, deflate {sizes['deflate']}")
+    ident = max(total["identity"], 1)
+    print(f"total: {total['identity']} -> gzip {total['gzip']} "
+          f"({100 * total['gzip'] // ident}%), deflate {total['deflate']} "
+          f"({100 * total['deflate'] // ident}%)")
+
+
+def main(argv: list[str]) -> int:
+    ap = argparse.ArgumentParser(description=__doc__,
+                                 formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("--dir", type=Path, default=DEFAULT_DIR)
+    ap.add_argument("--port", type=int, default=8000)
+    ap.add_argument("--encoding", default="auto",
+                    choices=["auto", "identity", "gzip", "deflate", "raw-deflate"])
+    ap.add_argument("--chunked", action="store_true")
+    ap.add_argument("--close", action="store_true",
+                    help="send Connection: close on every response")
+    ap.add_argument("--delay", type=int, default=0, metavar="MS")
+    ap.add_argument("--max-age", type=int, default=None, metavar="S")
+    ap.add_argument("--rate", type=int, default=0, metavar="KBPS")
+    ap.add_argument("--report", action="store_true")
+    args = ap.parse_args(argv)
+    root = args.dir.resolve()
+
+    if args.report:
+        report(root)
+        return 0
+
+    server = http.server.ThreadingHTTPServer(
+        ("", args.port),
+        make_handler(root, args.encoding, args.chunked, args.close, args.delay,
+                     args.max_age, args.rate))
+    server.daemon_threads = True
+    print(f"[http] serving {root} on :{args.port} "
+          f"(encoding={args.encoding}, chunked={args.chunked}, "
+          f"close={args.close}, delay={args.delay}ms, "
+          f"max-age={args.max_age}, rate={args.rate or 'unlimited'})",
+          flush=True)
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+    ident = max(Stats.identity, 1)
+    print(f"[http] {Stats.requests} requests ({Stats.not_modified} not modified) "
+          f"on {Stats.connections} connections, "
+          f"{Stats.wire} bytes on the wire "
+          f"for {Stats.identity} bytes of content ({100 * Stats.wire // ident}%)")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv[1:]))